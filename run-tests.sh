@@ -6,4 +6,15 @@
 # LICENSE file in the root directory of this source tree.
 
 set -x
-python3 "$(dirname "$0")/build/fbcode_builder/getdeps.py" test --allow-system-packages --no-testpilot watchman
+
+GETDEPS="$(dirname "$0")/build/fbcode_builder/getdeps.py"
+
+# `run-tests.sh --bench` runs the benchmark targets from the existing
+# build dir instead of the test suite.  The benchmarks only exist when
+# Google Benchmark was available at configure time; see CMakeLists.txt.
+if [ "$1" = "--bench" ]; then
+  BUILD_DIR="$(python3 "$GETDEPS" show-build-dir --allow-system-packages watchman)"
+  exec "$BUILD_DIR/pending_bench"
+fi
+
+python3 "$GETDEPS" test --allow-system-packages --no-testpilot watchman
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstring>
+#include "watchman/fs/FileDescriptor.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * Comparator primitives specialized at compile time on CaseSensitivity.
+ *
+ * A root's sensitivity is fixed when the watch is initialized, and a
+ * query's sensitivity is fixed at parse time, yet the per-file hot
+ * paths historically re-tested a CaseSensitivity member on every call.
+ * Code that knows its sensitivity up front should instead instantiate
+ * against one of these specializations (typically by templating the
+ * evaluator and dispatching once at construction), so case handling
+ * costs nothing per file: the sensitive variants below inline to plain
+ * memcmp with no branch on the mode.
+ *
+ * Only the two concrete modes are provided; CaseSensitivity::Unknown
+ * callers must resolve their mode first, as Root and Query both do.
+ */
+template <CaseSensitivity CS>
+struct CaseOps;
+
+template <>
+struct CaseOps<CaseSensitivity::CaseSensitive> {
+  static bool equal(w_string_piece a, w_string_piece b) {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+  }
+
+  static bool startsWith(w_string_piece str, w_string_piece prefix) {
+    return prefix.size() <= str.size() &&
+        memcmp(str.data(), prefix.data(), prefix.size()) == 0;
+  }
+};
+
+template <>
+struct CaseOps<CaseSensitivity::CaseInSensitive> {
+  static bool equal(w_string_piece a, w_string_piece b) {
+    return w_string_equal_caseless(a, b);
+  }
+
+  static bool startsWith(w_string_piece str, w_string_piece prefix) {
+    return str.startsWithCaseInsensitive(prefix);
+  }
+};
+
+} // namespace watchman
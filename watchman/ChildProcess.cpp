@@ -9,6 +9,7 @@
 #include <fmt/core.h>
 #include <folly/ScopeGuard.h>
 #include <folly/String.h>
+#include <folly/Synchronized.h>
 #include <memory>
 #include <system_error>
 #include <thread>
@@ -16,6 +17,66 @@
 
 namespace watchman {
 
+namespace {
+
+// Scratch buffers for pumping child process pipes.  hg can emit many
+// megabytes on stdout, and reading that through a small stack buffer
+// costs a poll + read round trip per BUFSIZ chunk.  These leases hand
+// out large reusable blocks drawn from a process-wide pool shared by
+// all child processes, so scm-heavy roots that run dozens of hg
+// commands per minute neither fault in fresh pages per invocation nor
+// pay thousands of extra syscalls per command.
+constexpr size_t kScratchBufferSize = 256 * 1024;
+// Bounds how many idle buffers the pool retains; concurrent pumps past
+// the bound simply allocate and free their own block.
+constexpr size_t kScratchBufferPoolLimit = 8;
+
+folly::Synchronized<std::vector<std::unique_ptr<char[]>>, std::mutex>&
+scratchBufferPool() {
+  static auto* pool = new folly::
+      Synchronized<std::vector<std::unique_ptr<char[]>>, std::mutex>();
+  return *pool;
+}
+
+class ScratchBufferLease {
+ public:
+  ScratchBufferLease() {
+    {
+      auto pool = scratchBufferPool().lock();
+      if (!pool->empty()) {
+        buf_ = std::move(pool->back());
+        pool->pop_back();
+      }
+    }
+    if (!buf_) {
+      buf_ = std::make_unique<char[]>(kScratchBufferSize);
+    }
+  }
+
+  ~ScratchBufferLease() {
+    auto pool = scratchBufferPool().lock();
+    if (pool->size() < kScratchBufferPoolLimit) {
+      pool->push_back(std::move(buf_));
+    }
+  }
+
+  ScratchBufferLease(const ScratchBufferLease&) = delete;
+  ScratchBufferLease& operator=(const ScratchBufferLease&) = delete;
+
+  char* data() {
+    return buf_.get();
+  }
+
+  size_t size() const {
+    return kScratchBufferSize;
+  }
+
+ private:
+  std::unique_ptr<char[]> buf_;
+};
+
+} // namespace
+
 ChildProcess::Environment::Environment() {
   // Construct the map from the current process environment
   uint32_t nenv, i;
@@ -50,12 +111,19 @@ ChildProcess::Environment::Environment(
     : map_(map) {}
 
 /* Constructs an envp array from a hash table.
- * The returned array occupies a single contiguous block of memory
- * such that it can be released by a single call to free(3).
- * The last element of the returned array is set to NULL for compatibility
- * with posix_spawn() */
-std::unique_ptr<char*, ChildProcess::Deleter>
-ChildProcess::Environment::asEnviron(size_t* env_size) const {
+ * The array occupies a single contiguous block of memory such that it
+ * can be released by a single call to free(3).
+ * The last element of the array is set to NULL for compatibility
+ * with posix_spawn().
+ * The block is cached and reused until the map is next mutated. */
+char** ChildProcess::Environment::asEnviron(size_t* env_size) const {
+  if (cachedEnviron_) {
+    if (env_size) {
+      *env_size = cachedSize_;
+    }
+    return cachedEnviron_.get();
+  }
+
   size_t len = (1 + map_.size()) * sizeof(char*);
 
   // Make a pass through to compute the required memory size
@@ -71,7 +139,7 @@ ChildProcess::Environment::asEnviron(size_t* env_size) const {
   if (!envp) {
     throw std::bad_alloc();
   }
-  auto result = std::unique_ptr<char*, Deleter>(envp, Deleter());
+  auto result = std::shared_ptr<char*>(envp, Deleter());
 
   // Now populate
   auto buf = (char*)(envp + map_.size() + 1);
@@ -98,21 +166,43 @@ ChildProcess::Environment::asEnviron(size_t* env_size) const {
 
   envp[map_.size()] = nullptr;
 
+  cachedEnviron_ = std::move(result);
+  cachedSize_ = len;
+
   if (env_size) {
     *env_size = len;
   }
-  return result;
+  return cachedEnviron_.get();
+}
+
+std::optional<w_string> ChildProcess::Environment::get(
+    const w_string& key) const {
+  auto it = map_.find(key);
+  if (it == map_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
 }
 
 void ChildProcess::Environment::set(const w_string& key, const w_string& val) {
-  map_[key] = val;
+  auto it = map_.find(key);
+  if (it != map_.end() && it->second == val) {
+    // No change; keep the cached environ block
+    return;
+  }
+  cachedEnviron_.reset();
+  if (it != map_.end()) {
+    it->second = val;
+  } else {
+    map_.emplace(key, val);
+  }
 }
 
 void ChildProcess::Environment::setBool(const w_string& key, bool bval) {
   if (bval) {
-    map_[key] = "true";
+    set(key, "true");
   } else {
-    map_.erase(key);
+    unset(key);
   }
 }
 
@@ -124,13 +214,21 @@ void ChildProcess::Environment::set(
 }
 
 void ChildProcess::Environment::unset(const w_string& key) {
-  map_.erase(key);
+  if (map_.erase(key)) {
+    cachedEnviron_.reset();
+  }
 }
 
 ChildProcess::Options::Options() : inner_(std::make_unique<Inner>()) {
 #ifdef POSIX_SPAWN_CLOEXEC_DEFAULT
   setFlags(POSIX_SPAWN_CLOEXEC_DEFAULT);
 #endif
+#ifdef POSIX_SPAWN_USEVFORK
+  // Ask glibc for the vfork-style fast path so the spawn doesn't pay
+  // for duplicating our page tables.  Newer glibc always spawns via
+  // CLONE_VFORK and simply ignores this flag.
+  setFlags(POSIX_SPAWN_USEVFORK);
+#endif
 }
 
 ChildProcess::Options::Inner::Inner() {
@@ -317,7 +415,7 @@ ChildProcess::ChildProcess(
       &options.inner_->actions,
       &options.inner_->attr,
       &argv[0],
-      envp.get());
+      envp);
 
   if (ret) {
     // Failed, so the creator cannot call wait() on us.
@@ -331,8 +429,8 @@ ChildProcess::ChildProcess(
   for (size_t i = 0; i < args.size(); ++i) {
     watchman::log(level, "argv[", i, "] ", args[i], "\n");
   }
-  for (size_t i = 0; envp.get()[i]; ++i) {
-    watchman::log(level, "envp[", i, "] ", envp.get()[i], "\n");
+  for (size_t i = 0; envp[i]; ++i) {
+    watchman::log(level, "envp[", i, "] ", envp[i], "\n");
   }
 
   // Close the other ends of the pipes
@@ -453,6 +551,10 @@ ChildProcess::pollingCommunicate(pipeWriteCallback writeCallback) {
   pfds.reserve(pipes_.size());
   revmap.reserve(pipes_.size());
 
+  // One pooled scratch block serves every readable fd in the loop; the
+  // data is appended into `outputs` before the next read.
+  ScratchBufferLease buf;
+
   while (!pipes_.empty()) {
     revmap.clear();
     pfds.clear();
@@ -502,8 +604,7 @@ ChildProcess::pollingCommunicate(pipeWriteCallback writeCallback) {
             " rev=",
             revmap[pfd.fd],
             " is readable\n");
-        char buf[BUFSIZ];
-        auto l = ::read(pfd.fd, buf, sizeof(buf));
+        auto l = ::read(pfd.fd, buf.data(), buf.size());
         if (l == -1 && (errno == EAGAIN || errno == EINTR)) {
           watchman::log(
               watchman::DBG,
@@ -540,7 +641,7 @@ ChildProcess::pollingCommunicate(pipeWriteCallback writeCallback) {
           pipes_.erase(revmap[pfd.fd]);
           continue;
         }
-        outputs[revmap[pfd.fd]].append(buf, l);
+        outputs[revmap[pfd.fd]].append(buf.data(), l);
       }
 
       if ((pfd.revents & POLLHUP) && revmap[pfd.fd] == STDIN_FILENO) {
@@ -614,16 +715,16 @@ folly::Future<std::optional<w_string>> ChildProcess::readPipe(int fd) {
     std::string result;
     p->setWith([&] {
       auto& pipe = pipes_[fd];
+      ScratchBufferLease buf;
       while (true) {
-        char buf[4096];
-        auto readResult = pipe->read.read(buf, sizeof(buf));
+        auto readResult = pipe->read.read(buf.data(), buf.size());
         readResult.throwIfError();
         auto len = readResult.value();
         if (len == 0) {
           // all done
           break;
         }
-        result.append(buf, len);
+        result.append(buf.data(), len);
       }
       return w_string(result.data(), result.size());
     });
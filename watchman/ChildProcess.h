@@ -38,8 +38,15 @@ class ChildProcess {
 
     Environment& operator=(const Environment&) = default;
 
-    // Returns the environment as an environ compatible array
-    std::unique_ptr<char*, Deleter> asEnviron(size_t* env_size = nullptr) const;
+    // Returns the environment as an environ compatible array.
+    // The flattened block is cached across calls: it is built on the
+    // first call and reused until the next mutation, so trigger-heavy
+    // workloads don't rebuild it for every spawn.  The returned pointer
+    // remains valid until this Environment is mutated or destroyed.
+    char** asEnviron(size_t* env_size = nullptr) const;
+
+    // Returns the value for key, if present
+    std::optional<w_string> get(const w_string& key) const;
 
     // Set a value in the environment
     void set(const w_string& key, const w_string& value);
@@ -52,6 +59,10 @@ class ChildProcess {
 
    private:
     std::unordered_map<w_string, w_string> map_;
+    // Cached result of asEnviron; shared so that copying an Environment
+    // shares the (immutable) block until either copy is mutated.
+    mutable std::shared_ptr<char*> cachedEnviron_;
+    mutable size_t cachedSize_{0};
   };
 
   class Options {
@@ -9,14 +9,27 @@
 
 #include <folly/MapUtil.h>
 
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/mman.h> // @manual
+#include <sys/stat.h> // @manual
+#endif
+
 #include "watchman/Command.h"
 #include "watchman/Errors.h"
 #include "watchman/Logging.h"
 #include "watchman/MapUtil.h"
 #include "watchman/Poison.h"
 #include "watchman/QueryableView.h"
+#include "watchman/ShmRing.h"
 #include "watchman/Shutdown.h"
+#include "watchman/ThreadPool.h"
+#include "watchman/TraceSpan.h"
+#include "watchman/bser.h"
 #include "watchman/root/Root.h"
+#include "watchman/scm/SCM.h"
 #include "watchman/watchman_cmd.h"
 
 namespace watchman {
@@ -41,6 +54,188 @@ folly::Synchronized<std::unordered_set<UserClient*>> clients;
 // TODO: If used in a hot loop, EdenFS has a faster implementation.
 // https://github.com/facebookexperimental/eden/blob/c745d644d969dae1e4c0d184c19320fac7c27ae5/eden/fs/utils/IDGen.h
 std::atomic<uint64_t> id_generator{1};
+
+int appendToString(const char* buffer, size_t size, void* data) {
+  static_cast<std::string*>(data)->append(buffer, size);
+  return 0;
+}
+
+// Cap on cached broadcast encodings.  A settle's fan-out only has a
+// couple of distinct payloads in flight at any moment, so this stays
+// tiny and is scanned linearly.
+constexpr size_t kBroadcastPduCacheSize = 8;
+
+// When one event fans a single payload out to many clients -- the log
+// and unilateral publishers enqueue the very same json value on every
+// subscriber -- each client used to render its own BSER copy of it.
+// The rendered PDU is shared here instead, keyed by value identity and
+// wire format: fan-out shares the json_ref itself, so pointer equality
+// is exact and costs no hashing, and the cached entry pins the value
+// so its address cannot be recycled while the entry lives.
+struct EncodedBroadcastPdu {
+  json_ref payload;
+  PduType type;
+  uint32_t capabilities;
+  std::shared_ptr<const std::string> pdu;
+};
+
+std::shared_ptr<const std::string> encodeBroadcastPdu(
+    const json_ref& payload,
+    PduFormat format) {
+  static folly::Synchronized<std::deque<EncodedBroadcastPdu>> cache;
+
+  auto matches = [&](const EncodedBroadcastPdu& entry) {
+    return entry.payload.get() == payload.get() && entry.type == format.type &&
+        entry.capabilities == format.capabilities;
+  };
+
+  {
+    auto rlocked = cache.rlock();
+    for (auto& entry : *rlocked) {
+      if (matches(entry)) {
+        return entry.pdu;
+      }
+    }
+  }
+
+  auto buf = std::make_shared<std::string>();
+  if (w_bser_write_pdu(
+          format.type == is_bser_v2 ? 2 : 1,
+          format.capabilities,
+          appendToString,
+          payload,
+          buf.get())) {
+    return nullptr;
+  }
+
+  auto wlocked = cache.wlock();
+  for (auto& entry : *wlocked) {
+    if (matches(entry)) {
+      // Raced with another client thread encoding the same payload;
+      // share its copy.
+      return entry.pdu;
+    }
+  }
+  if (wlocked->size() >= kBroadcastPduCacheSize) {
+    wlocked->pop_front();
+  }
+  wlocked->push_back({payload, format.type, format.capabilities, buf});
+  return buf;
+}
+
+#ifndef _WIN32
+
+// How many consecutive quiet poll rounds a client thread tolerates
+// before handing its connection to the idle parking poller.
+constexpr int kParkAfterIdleRounds = 2;
+
+/**
+ * Parking lot for idle client connections.
+ *
+ * Rather than keeping one blocked thread per connected client, a client
+ * whose socket and ping event have been quiet for a few poll rounds
+ * hands itself over to this poller, which multiplexes every parked
+ * connection on a single poll() loop. When a parked connection becomes
+ * ready a fresh thread is spawned to resume its regular command loop,
+ * so thread count tracks the number of active clients rather than the
+ * number of connections.
+ */
+class IdleClientParking {
+ public:
+  void park(std::shared_ptr<UserClient> client) {
+    bool start = false;
+    {
+      auto state = state_.lock();
+      state->parked.push_back(std::move(client));
+      if (!state->threadStarted) {
+        state->threadStarted = true;
+        start = true;
+      }
+    }
+    if (start) {
+      std::thread{[this] { loop(); }}.detach();
+    } else {
+      wake_->notify();
+    }
+  }
+
+ private:
+  struct State {
+    std::vector<std::shared_ptr<UserClient>> parked;
+    bool threadStarted{false};
+  };
+
+  void loop() noexcept {
+    w_set_thread_name("clientpark");
+
+    std::vector<std::shared_ptr<UserClient>> snapshot;
+    std::vector<EventPoll> pfds;
+
+    while (true) {
+      snapshot = state_.lock()->parked;
+
+      if (w_is_stopping()) {
+        // Resume everything so each client thread can run its shutdown
+        // path and deregister; the listener pings them at shutdown so
+        // their events are already signalled.
+        for (auto& client : snapshot) {
+          resume(client);
+        }
+        auto state = state_.lock();
+        if (state->parked.empty()) {
+          state->threadStarted = false;
+          return;
+        }
+        continue;
+      }
+
+      pfds.clear();
+      pfds.push_back(EventPoll{wake_.get(), false});
+      for (auto& client : snapshot) {
+        pfds.push_back(EventPoll{client->stm->getEvents(), false});
+        pfds.push_back(EventPoll{client->ping.get(), false});
+      }
+
+      // The bounded timeout is what notices w_is_stopping(); everything
+      // else wakes us via wake_ or a client event.
+      ignore_result(
+          w_poll_events(pfds.data(), static_cast<int>(pfds.size()), 2000));
+      wake_->testAndClear();
+
+      for (size_t i = 0; i < snapshot.size(); ++i) {
+        if (pfds[1 + i * 2].ready || pfds[2 + i * 2].ready) {
+          resume(snapshot[i]);
+        }
+      }
+    }
+  }
+
+  void resume(const std::shared_ptr<UserClient>& client) {
+    {
+      auto state = state_.lock();
+      auto& parked = state->parked;
+      auto it = std::find(parked.begin(), parked.end(), client);
+      if (it == parked.end()) {
+        return;
+      }
+      parked.erase(it);
+    }
+    // Same spawn as UserClient::create(); the resumed loop re-runs its
+    // setup, which is idempotent.
+    std::thread{[client] { client->clientThread(); }}.detach();
+  }
+
+  folly::Synchronized<State, std::mutex> state_;
+  std::shared_ptr<watchman_event> wake_{w_event_make_sockets()};
+};
+
+IdleClientParking& getIdleClientParking() {
+  static auto* parking = new IdleClientParking;
+  return *parking;
+}
+
+#endif
+
 } // namespace
 
 Client::Client() : Client(nullptr) {}
@@ -73,10 +268,45 @@ Client::~Client() {
   }
 }
 
+thread_local bool Client::executingPipelinedCommand{false};
+
 void Client::enqueueResponse(json_ref resp) {
   responses.push_back(std::move(resp));
 }
 
+bool Client::peerHasDisconnected() const {
+#ifdef _WIN32
+  // Named pipe handles don't support this style of polling; err on the
+  // side of letting the query run.
+  return false;
+#else
+  if (!stm) {
+    return false;
+  }
+  auto fd = stm->getFileDescriptor().fd();
+  if (fd == -1) {
+    return false;
+  }
+  struct pollfd pfd {};
+  pfd.fd = fd;
+  // Note: POLLIN alone must NOT be treated as a hangup; a pipelining
+  // client may legitimately have queued its next request while this
+  // one evaluates.  POLLRDHUP distinguishes a half-closed peer where
+  // available, and POLLHUP/POLLERR cover full closure everywhere.
+#ifdef POLLRDHUP
+  pfd.events = POLLRDHUP;
+#endif
+  if (poll(&pfd, 1, 0) <= 0) {
+    return false;
+  }
+  short gone = POLLHUP | POLLERR;
+#ifdef POLLRDHUP
+  gone |= POLLRDHUP;
+#endif
+  return (pfd.revents & gone) != 0;
+#endif
+}
+
 void Client::enqueueResponse(UntypedResponse resp) {
   enqueueResponse(std::move(resp).toJson());
 }
@@ -135,9 +365,40 @@ bool Client::dispatchCommand(const Command& command, CommandFlags mode) {
       return false;
     }
 
+    if (auto* userClient = dynamic_cast<UserClient*>(this);
+        userClient && userClient->asyncDispatchSeq.has_value() &&
+        !executingPipelinedCommand) {
+      auto seq = ++*userClient->asyncDispatchSeq;
+      if (def->flags.contains(CMD_EXPENSIVE) &&
+          def->flags.contains(CMD_ALLOW_PIPELINE)) {
+        // Async dispatch: the body runs at background priority on the
+        // pool and the response is delivered out of band tagged with
+        // the request ordinal, so the reader loop stays free for the
+        // cheap commands behind it.
+        userClient->launchPipelined(Command{command}, json_integer(seq));
+        return true;
+      }
+    }
+
+    // Inline dispatch of an expensive command pays its rate limit token
+    // here; offloaded commands are charged by launchPipelined().
+    if (def->flags.contains(CMD_EXPENSIVE) && !executingPipelinedCommand) {
+      if (auto* userClient = dynamic_cast<UserClient*>(this)) {
+        userClient->throttleExpensive(def->name);
+      }
+    }
+
     // Scope for the perf sample
     {
       logf(DBG, "dispatch_command: {}\n", def->name);
+
+      // Allocate a trace id for this request.  Spans recorded while the
+      // handler runs on this thread -- and across sync promise
+      // hand-offs to other threads -- correlate through it; see
+      // TraceSpan.h and the debug-trace command.
+      TraceContext traceContext{traceNextId()};
+      TraceSpan traceSpan{w_string::build("dispatch:", def->name)};
+
       auto sample_name = "dispatch_command:" + std::string{def->name};
       PerfSample sample(sample_name.c_str());
       perf_sample = &sample;
@@ -267,9 +528,57 @@ ClientDebugStatus UserClient::getDebugStatus() const {
     rv.peer->name = peerName_.get();
   }
   rv.since = std::chrono::system_clock::to_time_t(since_);
+  if (auto expensive = expensiveCount_.load(std::memory_order_relaxed)) {
+    rv.throttle.emplace();
+    rv.throttle->expensive = expensive;
+    rv.throttle->throttled = throttledCount_.load(std::memory_order_relaxed);
+    rv.throttle->total_delay_ms =
+        throttleDelayMs_.load(std::memory_order_relaxed);
+  }
   return rv;
 }
 
+void UserClient::throttleExpensive(std::string_view name) {
+  auto rate = cfg_get_double("command_rate_limit", 0.0);
+  if (rate <= 0.0) {
+    return;
+  }
+  auto burst = std::max(cfg_get_double("command_rate_burst", 4.0), 1.0);
+
+  auto now = std::chrono::steady_clock::now();
+  if (rateTokens_ < 0.0) {
+    // The first expensive command on a connection starts with full
+    // burst credit, so interactive use is never delayed.
+    rateTokens_ = burst;
+  } else {
+    std::chrono::duration<double> elapsed{now - rateLastRefill_};
+    rateTokens_ = std::min(burst, rateTokens_ + elapsed.count() * rate);
+  }
+  rateLastRefill_ = now;
+  expensiveCount_.fetch_add(1, std::memory_order_relaxed);
+
+  if (rateTokens_ >= 1.0) {
+    rateTokens_ -= 1.0;
+    return;
+  }
+
+  // Bucket is empty: wait for the token to accrue.  The bucket is
+  // floored at zero, so the wait is bounded by 1/rate per command.
+  auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::duration<double>((1.0 - rateTokens_) / rate));
+  logf(DBG, "client {}: throttling {} for {}ms\n", unique_id, name, wait.count());
+  throttledCount_.fetch_add(1, std::memory_order_relaxed);
+  throttleDelayMs_.fetch_add(wait.count(), std::memory_order_relaxed);
+  // Sleep in slices so a stopping server is not held up.
+  while (wait.count() > 0 && !w_is_stopping()) {
+    auto slice = std::min(wait, std::chrono::milliseconds{200});
+    std::this_thread::sleep_for(slice);
+    wait -= slice;
+  }
+  rateTokens_ = 0.0;
+  rateLastRefill_ = std::chrono::steady_clock::now();
+}
+
 void UserClient::vacateStates() {
   while (!states.empty()) {
     auto it = states.begin();
@@ -294,6 +603,150 @@ void UserClient::vacateStates() {
   }
 }
 
+#ifndef _WIN32
+bool UserClient::trySendViaShmRing(
+    const json_ref& response,
+    bool& client_alive) {
+  // The ring always carries BSER v2 regardless of the socket's
+  // negotiated format: the channel is opted into explicitly, so its
+  // consumer is not assumed to be the same code that spoke JSON on the
+  // control socket.
+  std::string pdu;
+  if (w_bser_write_pdu(2, /*capabilities=*/0, appendToString, response, &pdu)) {
+    return false;
+  }
+
+  auto seq = shmRing->tryAppend(pdu.data(), pdu.size());
+  if (!seq) {
+    // Ring is full; the payload follows on the socket instead.  The
+    // header's drop counter tells the consumer that it fell behind.
+    return false;
+  }
+
+  // Wake the consumer with a small control message carrying the
+  // sequence number it should drain the ring up to.  Control stays on
+  // the socket so the client needs no new wait primitive and ordering
+  // with socket-delivered fallbacks is preserved.
+  auto control = json_object(
+      {{"shm-seq", json_integer(json_int_t(*seq))},
+       {"unilateral", json_true()}});
+  auto encodeResult = writer.pduEncodeToStream(this->format, control, stm.get());
+  client_alive = encodeResult.hasValue();
+  return true;
+}
+#endif
+
+#ifdef __linux__
+bool UserClient::trySendViaMemfd(const json_ref& response, bool& client_alive) {
+  // The mmap consumer decodes a BSER PDU out of the mapping; a JSON
+  // client gets the plain socket path.
+  if (format.type != is_bser && format.type != is_bser_v2) {
+    return false;
+  }
+
+  int raw = ::memfd_create("watchman-response", MFD_CLOEXEC);
+  if (raw == -1) {
+    return false;
+  }
+  auto memStream = w_stm_fdopen(
+      FileDescriptor(raw, FileDescriptor::FDType::Generic));
+  if (!memStream) {
+    return false;
+  }
+
+  // Render the complete response PDU into the (unlinked) memfd.  The
+  // descriptor we pass below is the only reference the client gets, so
+  // the pages are reclaimed as soon as it closes or unmaps them.
+  auto encodeResult =
+      writer.pduEncodeToStream(this->format, response, memStream.get());
+  if (encodeResult.hasError()) {
+    return false;
+  }
+
+  struct stat st;
+  int memFd = int(memStream->getFileDescriptor().system_handle());
+  if (::fstat(memFd, &st) != 0) {
+    return false;
+  }
+
+  // The control message is the response from the protocol's point of
+  // view; the descriptor rides along as ancillary data on its leading
+  // bytes so the client receives both atomically.
+  auto control = json_object(
+      {{"response_via_memfd", json_true()},
+       {"memfd_size", json_integer(json_int_t(st.st_size))}});
+  std::string pdu;
+  if (w_bser_write_pdu(
+          format.type == is_bser_v2 ? 2 : 1,
+          format.capabilities,
+          appendToString,
+          control,
+          &pdu)) {
+    return false;
+  }
+
+  auto x = stm->writeWithFd(pdu.data(), int(pdu.size()), memFd);
+  if (x < 0) {
+    // Nothing was sent and the descriptor did not transfer (eg: the
+    // stream is not a unix socket); send the payload the usual way.
+    return false;
+  }
+  client_alive = size_t(x) == pdu.size();
+  return true;
+}
+#endif
+
+void UserClient::launchPipelined(Command&& command, json_ref tag) {
+  // Pay the rate limit token before the task reaches the pool, on the
+  // client thread, so a bucket-exhausted client cannot flood the pool
+  // with queued expensive work either.
+  if (auto* def = command.getCommandDefinition();
+      def && def->flags.contains(CMD_EXPENSIVE)) {
+    throttleExpensive(def->name);
+  }
+
+  auto shared = std::static_pointer_cast<UserClient>(shared_from_this());
+  pipelinedInFlight_.fetch_add(1, std::memory_order_acq_rel);
+  try {
+    // Background priority: a multi-second query body must not crowd
+    // out the pool's latency-sensitive tasks.
+    getThreadPool().addLowPriority(
+        [shared = std::move(shared),
+         command = std::move(command),
+         tag = std::move(tag)]() { shared->runPipelined(command, tag); });
+  } catch (...) {
+    pipelinedInFlight_.fetch_sub(1, std::memory_order_acq_rel);
+    throw;
+  }
+}
+
+void UserClient::runPipelined(
+    const Command& command,
+    const json_ref& tag) noexcept {
+  executingPipelinedCommand = true;
+  SCOPE_EXIT {
+    executingPipelinedCommand = false;
+  };
+
+  std::optional<json_ref> result;
+  try {
+    auto* def = command.getCommandDefinition();
+    // cmd_pipeline validated the definition before launching us.
+    result = def->handler(this, command.render()).toJson();
+  } catch (const std::exception& e) {
+    UntypedResponse resp;
+    auto msg = folly::exceptionStr(e);
+    resp.set("error", typed_string_to_json(msg.c_str()));
+    result = std::move(resp).toJson();
+  }
+  result->set("tag", json_ref(tag));
+
+  pipelinedResponses_.lock()->push_back(std::move(*result));
+  pipelinedInFlight_.fetch_sub(1, std::memory_order_acq_rel);
+  // Wake the client thread so it drains the queue promptly.
+  ping->notify();
+}
+
 void UserClient::clientThread() noexcept {
   status_.transitionTo(ClientStatus::THREAD_STARTED);
 
@@ -317,6 +770,9 @@ void UserClient::clientThread() noexcept {
   pfd[1].evt = ping.get();
 
   bool client_alive = true;
+#ifndef _WIN32
+  int idleRounds = 0;
+#endif
   while (!w_is_stopping() && client_alive) {
     // Wait for input from either the client socket or
     // via the ping pipe, which signals that some other
@@ -328,6 +784,26 @@ void UserClient::clientThread() noexcept {
       break;
     }
 
+#ifndef _WIN32
+    if (!pfd[0].ready && !pfd[1].ready) {
+      // Nothing happened this round. After a few quiet rounds, hand the
+      // connection over to the idle parking poller and release this
+      // thread; a new one is spawned when the socket or ping become
+      // ready. Readiness arriving after the poll above is not lost:
+      // the events stay signalled and the parking poll observes them.
+      if (responses.empty() &&
+          pipelinedInFlight_.load(std::memory_order_acquire) == 0 &&
+          pipelinedResponses_.lock()->empty() &&
+          ++idleRounds >= kParkAfterIdleRounds) {
+        getIdleClientParking().park(
+            std::static_pointer_cast<UserClient>(shared_from_this()));
+        return;
+      }
+      continue;
+    }
+    idleRounds = 0;
+#endif
+
     if (pfd[0].ready) {
       status_.transitionTo(ClientStatus::DECODING_REQUEST);
       json_error_t jerr;
@@ -428,6 +904,15 @@ void UserClient::clientThread() noexcept {
               continue;
             }
 
+            if (!sub->debug_paused &&
+                item->payload.get_optional("pre-settle")) {
+              // The IO thread just drained a batch and the settle clock
+              // is running; pre-render the payload now so the settle
+              // point delivers it at wire latency.
+              sub->speculativeEvaluate();
+              continue;
+            }
+
             if (!sub->debug_paused && item->payload.get_optional("settled")) {
               seenSettle = true;
               continue;
@@ -445,20 +930,22 @@ void UserClient::clientThread() noexcept {
       }
     }
 
-    /* now send our response(s) */
-    while (!responses.empty() && client_alive) {
-      status_.transitionTo(ClientStatus::SENDING_SUBSCRIPTION_RESPONSES);
-      auto& response_to_send = responses.front();
-
-      stm->setNonBlock(false);
-      /* Return the data in the same format that was used to ask for it.
-       * Update client liveness based on send success.
-       */
-      auto encodeResult =
-          writer.pduEncodeToStream(this->format, response_to_send, stm.get());
-      client_alive = encodeResult.hasValue();
-      stm->setNonBlock(true);
+    // Collect responses completed by pipelined command tasks; their
+    // completion pinged us, so they interleave with whatever the next
+    // poll wakes us for.
+    {
+      auto queued = pipelinedResponses_.lock();
+      while (!queued->empty()) {
+        responses.push_back(std::move(queued->front()));
+        queued->pop_front();
+      }
+    }
 
+    /* now send our response(s).  Everything queued by this wakeup --
+     * typically a whole settle's worth of subscription payloads --
+     * is batched into a single gather-write rather than one syscall
+     * per PDU. */
+    auto logResponse = [&](const json_ref& response_to_send) {
       std::optional<json_ref> subscriptionValue =
           response_to_send.get_optional("subscription");
       if (kResponseLogLimit && subscriptionValue &&
@@ -473,8 +960,111 @@ void UserClient::clientThread() noexcept {
               std::chrono::system_clock::now(), response_to_send});
         }
       }
+    };
+
+    std::vector<json_ref> socketBatch;
+    while (!responses.empty() && client_alive) {
+      status_.transitionTo(ClientStatus::SENDING_SUBSCRIPTION_RESPONSES);
+
+#ifndef _WIN32
+      if (shmRing && responses.front().get_optional("unilateral")) {
+        auto& response_to_send = responses.front();
+        stm->setNonBlock(false);
+        if (!trySendViaShmRing(response_to_send, client_alive)) {
+          /* Ring full or encode failure: the payload follows on the
+           * socket in order, by itself. */
+          auto encodeResult = writer.pduEncodeToStream(
+              this->format, response_to_send, stm.get());
+          client_alive = encodeResult.hasValue();
+        }
+        stm->setNonBlock(true);
+        logResponse(response_to_send);
+        responses.pop_front();
+        continue;
+      }
+#endif
+
+#ifdef __linux__
+      if (responses.front().get_optional("response_via_memfd")) {
+        auto& response_to_send = responses.front();
+        stm->setNonBlock(false);
+        if (!trySendViaMemfd(response_to_send, client_alive)) {
+          // memfd unavailable or the stream refused the descriptor:
+          // the full response follows on the socket; the absence of
+          // "memfd_size" tells the client which transport it got.
+          auto encodeResult = writer.pduEncodeToStream(
+              this->format, response_to_send, stm.get());
+          client_alive = encodeResult.hasValue();
+        }
+        stm->setNonBlock(true);
+        logResponse(response_to_send);
+        responses.pop_front();
+        continue;
+      }
+#endif
 
-      responses.pop_front();
+      // A payload fanned out by a publisher is the very same json value
+      // in every subscriber's queue; render it once process-wide and
+      // just write the bytes here.  A refcount above one is the tell:
+      // per-client responses are built fresh and are uniquely owned by
+      // the queue at this point.
+      auto isSharedBroadcast = [&](const json_ref& r) {
+        if (this->format.type != is_bser && this->format.type != is_bser_v2) {
+          return false;
+        }
+        auto refs = r.get()->refcount.load(std::memory_order_relaxed);
+        return refs != size_t(-1) && refs > 1;
+      };
+      if (isSharedBroadcast(responses.front())) {
+        if (auto pdu = encodeBroadcastPdu(responses.front(), this->format)) {
+          auto& response_to_send = responses.front();
+          stm->setNonBlock(false);
+          auto wrote = stm->write(pdu->data(), int(pdu->size()));
+          client_alive = wrote == int(pdu->size());
+          stm->setNonBlock(true);
+          logResponse(response_to_send);
+          responses.pop_front();
+          continue;
+        }
+        // Encode failure: fall through and let the batch path render it
+        // for this client alone.
+      }
+
+      // Collect the run of consecutive socket-bound responses.  We stop
+      // at ring-eligible, memfd-marked and shared broadcast payloads so
+      // ordering between the channels is preserved.
+      socketBatch.clear();
+      while (!responses.empty()) {
+#ifndef _WIN32
+        if (shmRing && responses.front().get_optional("unilateral")) {
+          break;
+        }
+#endif
+#ifdef __linux__
+        if (responses.front().get_optional("response_via_memfd")) {
+          break;
+        }
+#endif
+        // (only once the batch is non-empty: if the shared payload
+        // failed to encode above, the batch is its fallback.)
+        if (!socketBatch.empty() && isSharedBroadcast(responses.front())) {
+          break;
+        }
+        socketBatch.push_back(std::move(responses.front()));
+        responses.pop_front();
+      }
+
+      /* Return the data in the same format that was used to ask for it.
+       * Update client liveness based on send success. */
+      stm->setNonBlock(false);
+      auto encodeResult =
+          writer.pduEncodeManyToStream(this->format, socketBatch, stm.get());
+      client_alive = encodeResult.hasValue();
+      stm->setNonBlock(true);
+
+      for (auto& response_to_send : socketBatch) {
+        logResponse(response_to_send);
+      }
     }
   }
 
@@ -512,10 +1102,23 @@ void w_leave_state(
 
   // Now remove the state assertion
   assertion->root->assertedStates.wlock()->removeAssertion(assertion);
+  assertion->root->assertedStatesVersion++;
   // Increment state transition counter for this root
   assertion->root->stateTransCount++;
 
   if (client) {
     mapRemove(client->states, assertion->name);
   }
+
+  // A vacated hg state (eg: hg.update or hg.transaction after a rebase)
+  // means the SCM caches are about to be consulted with fresh keys.
+  // Warm them in the background so the next interactive SCM-aware query
+  // doesn't pay for the hg invocations.  The root reference keeps the
+  // SCM alive for the duration of the job.
+  if (assertion->name.piece().startsWith("hg.")) {
+    auto root = assertion->root;
+    if (auto* scm = root->view()->getSCM()) {
+      watchman::getThreadPool().run([root, scm] { scm->prewarm(); });
+    }
+  }
 }
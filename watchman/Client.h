@@ -9,10 +9,16 @@
 
 #include <eden/common/utils/ProcessNameCache.h>
 #include <fmt/core.h>
+#include <folly/Synchronized.h>
 
+#include <atomic>
 #include <chrono>
 #include <deque>
+#include <list>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "watchman/Clock.h"
 #include "watchman/CommandRegistry.h"
@@ -26,7 +32,9 @@ namespace watchman {
 class ClientStateAssertion;
 class Command;
 class Root;
+class ShmRing;
 struct Query;
+struct QueryContextScratch;
 struct QueryResult;
 
 class Client : public std::enable_shared_from_this<Client> {
@@ -40,6 +48,14 @@ class Client : public std::enable_shared_from_this<Client> {
   void enqueueResponse(json_ref resp);
   void enqueueResponse(UntypedResponse resp);
 
+  /**
+   * Best-effort check for whether the peer has hung up its end of the
+   * connection.  Used to abandon long-running queries whose requester
+   * is gone.  Returns false when detection is not possible (no stream,
+   * or on Windows).
+   */
+  bool peerHasDisconnected() const;
+
   const uint64_t unique_id;
   std::unique_ptr<watchman_stream> stm;
   std::unique_ptr<watchman_event> ping;
@@ -56,6 +72,14 @@ class Client : public std::enable_shared_from_this<Client> {
   // client thread.
   PerfSample* perf_sample = nullptr;
 
+  /**
+   * True on threads currently executing a pipelined command for some
+   * client.  State that belongs to the inline dispatch thread (such as
+   * perf_sample and current_command) must not be touched while this is
+   * set.
+   */
+  static thread_local bool executingPipelinedCommand;
+
   // Queue of things to send to the client.
   std::deque<json_ref> responses;
 
@@ -90,6 +114,15 @@ class ClientSubscription
 
   void processSubscription();
 
+  /**
+   * Pre-evaluate the subscription against the current view position
+   * while the settle clock is still running, buffering the rendered
+   * response for delivery at the settle point.  Invoked on the client
+   * thread when the IO thread publishes a "pre-settle" hint after
+   * draining a batch of events.
+   */
+  void speculativeEvaluate();
+
   std::shared_ptr<UserClient> lockClient();
   std::optional<UntypedResponse> buildSubscriptionResults(
       const std::shared_ptr<Root>& root,
@@ -103,16 +136,98 @@ class ClientSubscription
     json_ref response;
   };
 
+  /**
+   * Remembers the last rendered record per path for emit_deltas
+   * subscriptions, bounded and LRU-evicted.  Each result batch is
+   * rewritten to carry only the fields that changed since the previous
+   * emission of the same path (plus "name"); paths not in the cache are
+   * sent in full.  Clients merge the patches into their own per-path
+   * state, so full and delta records need no explicit marker.
+   */
+  class DeltaCache {
+   public:
+    explicit DeltaCache(size_t maxEntries);
+
+    /**
+     * Rewrites `record` (a rendered file object) in place to contain
+     * only the changed fields, and updates the cache.  Records for
+     * paths we have not seen (or whose state was evicted) pass through
+     * unchanged.
+     */
+    void apply(json_ref& record);
+
+    /** Forget all cached records, eg: across a fresh instance. */
+    void clear();
+
+   private:
+    struct Entry {
+      json_ref record;
+      std::list<w_string>::iterator lruIt;
+    };
+
+    const size_t maxEntries_;
+    // Front is most recently used
+    std::list<w_string> lru_;
+    std::unordered_map<w_string, Entry> map_;
+  };
+
+  /**
+   * Session-stable path interning for subscriptions that negotiated
+   * path_dictionary.  Each batch replaces rendered "name" strings with
+   * u32 ids; ids seen for the first time are announced in a
+   * "path-dictionary" array of [id, path] bindings on the same
+   * response, so the client can expand ids locally and repeated
+   * notifications for hot paths stop resending their full paths.
+   */
+  class PathDictionary {
+   public:
+    /**
+     * Returns the id for `path`.  A path seen for the first time is
+     * assigned the next id and a [id, path] binding is appended to
+     * `newBindings`.
+     */
+    uint32_t intern(const w_string& path, std::vector<json_ref>& newBindings);
+
+    /** Forget all bindings, eg: across a fresh instance. */
+    void clear();
+
+   private:
+    std::unordered_map<w_string, uint32_t> ids_;
+    uint32_t nextId_{1};
+  };
+
   std::shared_ptr<Root> root;
   w_string name;
   /* whether this subscription is paused */
   bool debug_paused = false;
 
+  /* non-null when the subscription negotiated emit_deltas */
+  std::unique_ptr<DeltaCache> deltaCache;
+
+  /* non-null when the subscription negotiated path_dictionary */
+  std::unique_ptr<PathDictionary> pathDictionary;
+
   std::shared_ptr<Query> query;
+  // Retained container capacity handed to each run of `query` so that
+  // steady-state settles allocate nothing before the first match.
+  std::unique_ptr<QueryContextScratch> contextScratch;
   bool vcs_defer;
   uint32_t last_sub_tick{0};
+  // Speculative pre-evaluation state (see speculativeEvaluate): a
+  // response pre-rendered during the settle countdown awaiting delivery
+  // at the settle point, and the root tick it was evaluated at (0 means
+  // no speculation outstanding).  Only touched from the owning client's
+  // thread, like the rest of the subscription state.
+  std::optional<UntypedResponse> speculativeResponse;
+  uint32_t speculativeTick{0};
   // map of statename => bool.  If true, policy is drop, else defer
   std::unordered_map<w_string, bool> drop_or_defer;
+  // Which entries of drop_or_defer were asserted as of
+  // lastAssertedStatesVersion.  Refreshed by get_subscription_action()
+  // only when root->assertedStatesVersion has moved on, so the common
+  // settle with no state activity never takes the assertedStates lock.
+  std::unordered_set<w_string> assertedPolicyStates;
+  uint64_t lastAssertedStatesVersion{0};
   std::weak_ptr<Client> weakClient;
 
   std::deque<LoggedResponse> lastResponses;
@@ -170,16 +285,33 @@ struct PeerInfo : serde::Object {
   }
 };
 
+struct ClientThrottleStatus : serde::Object {
+  int64_t expensive;
+  int64_t throttled;
+  int64_t total_delay_ms;
+
+  template <typename X>
+  void map(X& x) {
+    x("expensive", expensive);
+    x("throttled", throttled);
+    x("total-delay-ms", total_delay_ms);
+  }
+};
+
 struct ClientDebugStatus : serde::Object {
   std::string state;
   std::optional<PeerInfo> peer;
   std::optional<int64_t> since;
+  // Present once the client has dispatched an expensive command; see
+  // UserClient::throttleExpensive().
+  std::optional<ClientThrottleStatus> throttle;
 
   template <typename X>
   void map(X& x) {
     x("state", state);
     x("peer", peer);
     x("since", since);
+    x("throttle", throttle);
   }
 };
 
@@ -213,8 +345,59 @@ class UserClient final : public Client {
       std::shared_ptr<Publisher::Subscriber>>
       unilateralSub;
 
+#ifndef _WIN32
+  /**
+   * Opt-in shared memory fast channel negotiated via the `shm-channel`
+   * command.  When present, unilateral payloads are appended to the
+   * ring as BSER v2 PDUs and only a small `{"shm-seq": n}` control
+   * message travels over the socket; payloads that don't fit fall back
+   * to the socket in order.  Only touched by the client thread.
+   */
+  std::unique_ptr<ShmRing> shmRing;
+#endif
+
   bool unsubByName(const w_string& name);
 
+  /**
+   * Launches `command` on the thread pool to be answered out of band
+   * with a response carrying `tag`, so a slow command does not
+   * head-of-line block the connection.  Called by the `pipeline`
+   * command handler on the client thread after it has validated that
+   * the command is flagged CMD_ALLOW_PIPELINE.
+   */
+  void launchPipelined(Command&& command, json_ref tag);
+
+  /**
+   * Engaged when the client has opted into async dispatch via the
+   * `async-dispatch` command.  The value counts commands dispatched on
+   * this connection since it was enabled; a CMD_EXPENSIVE command is
+   * offloaded to the pool and its out-of-band response carries the
+   * count as its "tag" so the client can pair it with the request
+   * ordinal.  Only touched by the client thread.
+   */
+  std::optional<json_int_t> asyncDispatchSeq;
+
+  /**
+   * Charges one token from this connection's rate limit bucket before a
+   * CMD_EXPENSIVE command runs, sleeping until the token accrues when
+   * the bucket is empty.  The bucket refills at `command_rate_limit`
+   * tokens per second (0, the default, disables limiting) up to a burst
+   * allowance of `command_rate_burst` tokens, so interactive clients
+   * that query occasionally always hold credit and are never delayed,
+   * while a client spamming full-tree queries back-to-back is slowed to
+   * the configured rate.  Only the offending connection waits; every
+   * other client dispatches on its own thread.  Called on the client
+   * thread for both inline dispatch and pipelined launch.
+   */
+  void throttleExpensive(std::string_view name);
+
+  /**
+   * Runs the command loop for this client. Invoked on a dedicated thread
+   * by create(), and again by the idle client parking poller whenever a
+   * parked connection becomes ready.
+   */
+  void clientThread() noexcept;
+
  private:
   UserClient() = delete;
   UserClient(UserClient&&) = delete;
@@ -229,10 +412,57 @@ class UserClient final : public Client {
  private:
   ClientDebugStatus getDebugStatus() const;
 
+#ifndef _WIN32
+  /**
+   * Encodes `response` as a BSER v2 PDU, appends it to shmRing and
+   * sends the `{"shm-seq": n}` control message on the socket.  Returns
+   * false when the payload should be sent over the socket instead
+   * (ring full or encode failure); only updates `client_alive` when it
+   * touched the socket itself.
+   */
+  bool trySendViaShmRing(const json_ref& response, bool& client_alive);
+#endif
+
+#ifdef __linux__
+  /**
+   * Renders `response` as a PDU into an unlinked memfd and sends a
+   * small `{"response_via_memfd": true, "memfd_size": n}` control
+   * message with the descriptor attached via SCM_RIGHTS, so the client
+   * can mmap the result instead of copying it through the socket.
+   * Returns false when the full response should be sent over the
+   * socket instead (memfd or encode failure, non-BSER client, or the
+   * socket refused ancillary data); only updates `client_alive` when
+   * it touched the socket itself.
+   */
+  bool trySendViaMemfd(const json_ref& response, bool& client_alive);
+#endif
+
   // Abandon any states that haven't been explicit vacated.
   void vacateStates();
 
-  void clientThread() noexcept;
+  // Executes one pipelined command on a pool thread and queues its
+  // tagged response.
+  void runPipelined(const Command& command, const json_ref& tag) noexcept;
+
+  /**
+   * Responses completed by pipelined command tasks; drained into
+   * `responses` by the client thread before each send pass.  This is
+   * the only response path that is touched off the client thread.
+   */
+  folly::Synchronized<std::deque<json_ref>, std::mutex> pipelinedResponses_;
+  // Number of pipelined commands still executing on the pool.  The
+  // client thread does not park while any are in flight.
+  std::atomic<size_t> pipelinedInFlight_{0};
+
+  // Token bucket state for throttleExpensive().  The bucket itself is
+  // only touched by the client thread; the counters are read by
+  // debug-status from other threads.  A negative token count means the
+  // bucket has not yet been primed with its burst credit.
+  double rateTokens_{-1.0};
+  std::chrono::steady_clock::time_point rateLastRefill_;
+  std::atomic<uint64_t> expensiveCount_{0};
+  std::atomic<uint64_t> throttledCount_{0};
+  std::atomic<uint64_t> throttleDelayMs_{0};
 
   const std::chrono::system_clock::time_point since_;
   const pid_t peerPid_;
@@ -6,6 +6,7 @@
  */
 
 #include "watchman/Clock.h"
+#include <fmt/core.h>
 #include <folly/Overload.h>
 #include <folly/String.h>
 #include <folly/Synchronized.h>
@@ -17,6 +18,34 @@ using namespace watchman;
 static int proc_pid;
 static uint64_t proc_start_time;
 
+namespace {
+
+// Consumes a run of decimal digits at `p`, advancing it past them.
+// Returns false if no digits are present.
+bool parseDecimal(const char*& p, uint64_t& out) {
+  const char* start = p;
+  uint64_t value = 0;
+  while (*p >= '0' && *p <= '9') {
+    value = (value * 10) + (*p - '0');
+    ++p;
+  }
+  if (p == start) {
+    return false;
+  }
+  out = value;
+  return true;
+}
+
+bool consumeChar(const char*& p, char expected) {
+  if (*p != expected) {
+    return false;
+  }
+  ++p;
+  return true;
+}
+
+} // namespace
+
 void ClockSpec::init() {
   struct timeval tv;
 
@@ -29,30 +58,34 @@ void ClockSpec::init() {
 
 ClockSpec::ClockSpec(const json_ref& value) {
   auto parseClockString = [=](const char* str) {
-    uint64_t start_time;
-    int pid;
-    ClockRoot root_number;
-    ClockTicks ticks;
-    // Parse a >= 2.8.2 version clock string
-    if (sscanf(
-            str,
-            "c:%" PRIu64 ":%d:%" PRIu64 ":%" PRIu64,
-            &start_time,
-            &pid,
-            &root_number,
-            &ticks) == 4) {
-      spec = Clock{start_time, pid, ClockPosition{root_number, ticks}};
-      return true;
+    // This runs for every since query and subscription establishment,
+    // so parse the digit runs by hand rather than through sscanf.
+    if (str[0] != 'c' || str[1] != ':') {
+      return false;
     }
+    const char* p = str + 2;
 
-    if (sscanf(str, "c:%d:%" PRIu64, &pid, &ticks) == 2) {
-      // old-style clock value (<= 2.8.2) -- by setting clock time and root
-      // number to 0 we guarantee that this is treated as a fresh instance
-      spec = Clock{0, pid, ClockPosition{root_number, ticks}};
+    uint64_t first, second;
+    if (!parseDecimal(p, first) || !consumeChar(p, ':') ||
+        !parseDecimal(p, second)) {
+      return false;
+    }
+
+    // Try a >= 2.8.2 version clock string first
+    ClockRoot root_number;
+    ClockTicks ticks;
+    if (consumeChar(p, ':') && parseDecimal(p, root_number) &&
+        consumeChar(p, ':') && parseDecimal(p, ticks)) {
+      spec = Clock{
+          first, static_cast<int>(second), ClockPosition{root_number, ticks}};
       return true;
     }
 
-    return false;
+    // old-style clock value (<= 2.8.2) -- by setting clock time and root
+    // number to 0 we guarantee that this is treated as a fresh instance
+    spec =
+        Clock{0, static_cast<int>(first), ClockPosition{0, ClockTicks{second}}};
+    return true;
   };
 
   switch (value.type()) {
@@ -200,19 +233,25 @@ bool clock_id_string(
     ClockTicks ticks,
     char* buf,
     size_t bufsize) {
-  int res = snprintf(
+  // Clock strings are rendered for every query response and every
+  // subscription notification; fmt's integer formatting is considerably
+  // cheaper than going through snprintf's format parser.
+  if (bufsize == 0) {
+    return false;
+  }
+  auto result = fmt::format_to_n(
       buf,
-      bufsize,
-      "c:%" PRIu64 ":%d:%" PRIu64 ":%" PRIu64,
+      bufsize - 1,
+      FMT_STRING("c:{}:{}:{}:{}"),
       proc_start_time,
       proc_pid,
       root_number,
       ticks);
-
-  if (res == -1) {
+  if (result.size >= bufsize) {
     return false;
   }
-  return (size_t)res < bufsize;
+  buf[result.size] = '\0';
+  return true;
 }
 
 w_string ClockPosition::toClockString() const {
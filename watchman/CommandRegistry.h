@@ -107,6 +107,15 @@ inline constexpr auto CMD_DAEMON = CommandFlags::raw(1);
 inline constexpr auto CMD_CLIENT = CommandFlags::raw(2);
 inline constexpr auto CMD_POISON_IMMUNE = CommandFlags::raw(4);
 inline constexpr auto CMD_ALLOW_ANY_USER = CommandFlags::raw(8);
+// The handler only reads client state and may therefore be wrapped in
+// a `pipeline` command and executed on a pool thread concurrently with
+// other commands on the same connection.
+inline constexpr auto CMD_ALLOW_PIPELINE = CommandFlags::raw(16);
+// The handler may run for a long time (it walks or queries a tree).
+// Clients that have opted in via the `async-dispatch` command get
+// these offloaded to a background pool thread automatically so they
+// don't head-of-line block the connection; requires CMD_ALLOW_PIPELINE.
+inline constexpr auto CMD_EXPENSIVE = CommandFlags::raw(32);
 
 struct CommandDefinition {
   const std::string_view name;
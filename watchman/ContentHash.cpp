@@ -8,6 +8,7 @@
 #include "watchman/ContentHash.h"
 #include <fmt/core.h>
 #include <folly/ScopeGuard.h>
+#include <algorithm>
 #include <string>
 #include "watchman/Hash.h"
 #include "watchman/Logging.h"
@@ -24,8 +25,26 @@
 #include <openssl/sha.h>
 #endif
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 namespace watchman {
 
+namespace {
+#ifndef _WIN32
+// Files at least this large are hashed from a sequential memory
+// mapping rather than through the read buffer; smaller files aren't
+// worth the mmap/munmap round trip.
+constexpr size_t kMmapHashThreshold = 128 * 1024;
+// Feed the digest in bounded chunks; CommonCrypto's update function
+// takes a 32-bit length, so one giant update would truncate on macOS.
+constexpr size_t kMmapHashChunkSize = 64 * 1024 * 1024;
+#endif
+} // namespace
+
 using HashValue = typename ContentHashCache::HashValue;
 using Node = typename ContentHashCache::Node;
 
@@ -43,11 +62,16 @@ std::size_t ContentHashCacheKey::hashValue() const {
        static_cast<uint64_t>(mtime.tv_nsec)});
 }
 
+// Enough segments to keep a full complement of ThreadPool workers from
+// contending while staying small relative to the cache capacity.
+constexpr size_t kContentHashCacheShards = 16;
+
 ContentHashCache::ContentHashCache(
     const w_string& rootPath,
     size_t maxItems,
     std::chrono::milliseconds errorTTL)
-    : cache_(maxItems, errorTTL), rootPath_(rootPath) {}
+    : cache_(kContentHashCacheShards, maxItems, errorTTL),
+      rootPath_(rootPath) {}
 
 folly::Future<std::shared_ptr<const Node>> ContentHashCache::get(
     const ContentHashCacheKey& key) {
@@ -69,7 +93,32 @@ HashValue ContentHashCache::computeHashImmediate(const char* fullPath) {
   SHA_CTX ctx;
   SHA1_Init(&ctx);
 
-  while (true) {
+  bool hashed = false;
+  auto& fd = stm->getFileDescriptor();
+  auto info = fd.getInfo();
+  if (size_t(info.size) >= kMmapHashThreshold) {
+    auto len = size_t(info.size);
+    void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd.fd(), 0);
+    if (map != MAP_FAILED) {
+      SCOPE_EXIT {
+        munmap(map, len);
+      };
+#ifdef POSIX_MADV_SEQUENTIAL
+      posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+#endif
+      auto* p = static_cast<const uint8_t*>(map);
+      while (len > 0) {
+        auto chunk = std::min(len, kMmapHashChunkSize);
+        SHA1_Update(&ctx, p, chunk);
+        p += chunk;
+        len -= chunk;
+      }
+      hashed = true;
+    }
+    // On mmap failure fall through to the read loop below
+  }
+
+  while (!hashed) {
     auto n = stm->read(buf, sizeof(buf));
     if (n == 0) {
       break;
@@ -160,6 +209,25 @@ HashValue ContentHashCache::computeHashImmediate(
 
 folly::Future<HashValue> ContentHashCache::computeHash(
     const ContentHashCacheKey& key) const {
+#ifdef POSIX_FADV_WILLNEED
+  // We run inline on the requesting thread at cache miss time, while
+  // the hash work itself queues behind whatever the pool is already
+  // chewing on.  A query rendering a batch of sha1 fields hits this
+  // once per uncached file in quick succession, so kicking off kernel
+  // readahead here means the data for the whole batch is in flight
+  // before the workers reach it, instead of each file faulting its
+  // pages in serially.
+  {
+    auto fullPath = w_string::pathCat({rootPath_, key.relativePath});
+    auto fd = ::open(fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      ::close(fd);
+    }
+    // If the open failed we simply skip the hint; the hash attempt
+    // below will surface the error through the proper channel.
+  }
+#endif
   return folly::via(
       &getThreadPool(), [key, this] { return computeHashImmediate(key); });
 }
@@ -39,7 +39,7 @@ namespace watchman {
 class ContentHashCache {
  public:
   using HashValue = std::array<uint8_t, 20>;
-  using Node = LRUCache<ContentHashCacheKey, HashValue>::NodeType;
+  using Node = ShardedLRUCache<ContentHashCacheKey, HashValue>::NodeType;
 
   // Construct a cache for a given root, holding the specified
   // maximum number of items, using the configured negative
@@ -78,7 +78,9 @@ class ContentHashCache {
   CacheStats stats() const;
 
  private:
-  LRUCache<ContentHashCacheKey, HashValue> cache_;
+  // Sharded to keep ThreadPool workers hashing different files from
+  // convoying on a single cache lock.
+  ShardedLRUCache<ContentHashCacheKey, HashValue> cache_;
   w_string rootPath_;
 };
 } // namespace watchman
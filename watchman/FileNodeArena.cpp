@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/FileNodeArena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "watchman/MemoryAccounting.h"
+
+namespace watchman {
+
+namespace {
+
+// Each allocation is preceded by a pointer to its owning slab, or nullptr
+// for oversized allocations that fell back to malloc.
+constexpr size_t kHeaderSize = sizeof(void*);
+
+constexpr size_t alignUp(size_t n) {
+  return (n + 15) & ~size_t(15);
+}
+
+} // namespace
+
+void FileNodeArena::Slab::release(Slab* slab) {
+  if (slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    recordMemoryFree(MemorySubsystem::View, sizeof(Slab) + slab->capacity);
+    free(slab);
+  }
+}
+
+FileNodeArena::~FileNodeArena() {
+  if (current_) {
+    Slab::release(current_);
+  }
+}
+
+void* FileNodeArena::allocate(size_t size) {
+  size_t need = alignUp(kHeaderSize + size);
+
+  if (need > kSlabSize - sizeof(Slab)) {
+    // Too big for a slab (pathologically long name); fall back to malloc
+    // with a null slab header so deallocate() knows to free() it.  These
+    // are not charged to MemoryAccounting: the header doesn't carry a
+    // size, so the matching free couldn't be recorded.
+    auto* base = static_cast<char*>(calloc(1, need));
+    if (!base) {
+      throw std::bad_alloc{};
+    }
+    return base + kHeaderSize;
+  }
+
+  if (!current_ || current_->used + need > current_->capacity) {
+    if (current_) {
+      // Drop the arena's reference; the slab frees itself when its last
+      // node is released.
+      Slab::release(current_);
+    }
+    auto* slab = static_cast<Slab*>(malloc(sizeof(Slab) + kSlabSize));
+    if (!slab) {
+      throw std::bad_alloc{};
+    }
+    recordMemoryAlloc(MemorySubsystem::View, sizeof(Slab) + kSlabSize);
+    new (slab) Slab{};
+    slab->capacity = kSlabSize;
+    current_ = slab;
+  }
+
+  char* base = current_->data() + current_->used;
+  current_->used += need;
+  current_->refs.fetch_add(1, std::memory_order_relaxed);
+
+  memset(base, 0, need);
+  memcpy(base, &current_, kHeaderSize);
+  return base + kHeaderSize;
+}
+
+void FileNodeArena::deallocate(void* ptr) {
+  char* base = static_cast<char*>(ptr) - kHeaderSize;
+  Slab* slab;
+  memcpy(&slab, base, kHeaderSize);
+  if (slab) {
+    Slab::release(slab);
+  } else {
+    free(base);
+  }
+}
+
+} // namespace watchman
@@ -7,6 +7,10 @@
 
 #include "watchman/IgnoreSet.h"
 
+#include <atomic>
+#include <map>
+#include <optional>
+
 // The path and everything below it is ignored.
 #define FULL_IGNORE 0x1
 // The grand-children of the path are ignored, but not the path
@@ -15,19 +19,178 @@
 
 namespace watchman {
 
+namespace {
+// Number of bits in IgnoreSet::component_bloom.
+constexpr uint32_t kBloomBits = 512;
+
+// Each component hash sets/tests two bit positions; the second probe is
+// re-mixed with a Knuth multiplicative hash so the two are decorrelated.
+uint32_t bloomFirst(StringHash hash) {
+  return hash % kBloomBits;
+}
+
+uint32_t bloomSecond(StringHash hash) {
+  return (hash * 2654435761u) % kBloomBits;
+}
+} // namespace
+
 void IgnoreSet::add(const w_string& path, bool is_vcs_ignore) {
   (is_vcs_ignore ? ignore_vcs : ignore_dirs).insert(path);
 
   tree.insert(path, is_vcs_ignore ? VCS_IGNORE : FULL_IGNORE);
 
+  auto hash = path.piece().baseName().hashValue();
+  for (auto bit : {bloomFirst(hash), bloomSecond(hash)}) {
+    component_bloom[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+
   if (!is_vcs_ignore) {
     dirs_vec.push_back(path);
   }
 }
 
+void IgnoreSet::compile() {
+  // Build a conventional pointer-chasing trie first, then flatten it.
+  struct BuildNode {
+    // Ordered so the flattened edge list can be binary searched if the
+    // fan-out ever warrants it.
+    std::map<unsigned char, size_t> edges;
+    uint8_t flags{0};
+  };
+  std::vector<BuildNode> build{1};
+
+  auto insert = [&](const w_string& path, uint8_t flag) {
+    size_t node = 0;
+    for (size_t i = 0; i < path.size(); ++i) {
+      auto b = (unsigned char)path.data()[i];
+      auto [it, added] = build[node].edges.emplace(b, build.size());
+      if (added) {
+        build.emplace_back();
+      }
+      node = it->second;
+    }
+    build[node].flags |= flag;
+  };
+  for (auto& path : ignore_dirs) {
+    insert(path, FULL_IGNORE);
+  }
+  for (auto& path : ignore_vcs) {
+    insert(path, VCS_IGNORE);
+  }
+
+  std::vector<CompiledNode> nodes;
+  std::vector<CompiledEdge> edges;
+  nodes.reserve(build.size());
+  for (auto& bn : build) {
+    nodes.push_back(CompiledNode{
+        (uint32_t)edges.size(), (uint16_t)bn.edges.size(), bn.flags});
+    for (auto& [byte, target] : bn.edges) {
+      edges.push_back(CompiledEdge{byte, (uint32_t)target});
+    }
+  }
+  compiled_nodes_ = std::move(nodes);
+  compiled_edges_ = std::move(edges);
+
+  static std::atomic<uint64_t> nextGeneration{1};
+  generation_ = nextGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool IgnoreSet::matchCompiled(const char* path, uint32_t pathlen) const {
+  uint32_t node = 0;
+  // End offset of the first (shortest) vcs-style entry that matched
+  // with a separator right after it; the shortest gives the grandchild
+  // check below the most room to find its second separator.
+  std::optional<uint32_t> vcsEnd;
+
+  for (uint32_t i = 0;; ++i) {
+    const auto& n = compiled_nodes_[node];
+    if (n.flags != 0 && (i == pathlen || is_slash(path[i]))) {
+      if (n.flags & FULL_IGNORE) {
+        // A full-style entry ignores itself and its whole subtree.
+        return true;
+      }
+      if (!vcsEnd.has_value() && i < pathlen) {
+        // vcs-style entries never match exactly; the path must extend
+        // below the entry, and by at least one more directory level,
+        // which is checked after the scan.
+        vcsEnd = i;
+      }
+    }
+    if (i == pathlen) {
+      break;
+    }
+    auto b = (unsigned char)path[i];
+    const auto* edge = &compiled_edges_[n.firstEdge];
+    const auto* end = edge + n.numEdges;
+    // Fan-out per node is tiny (typically one or two bytes), so a
+    // linear scan beats a binary search here.
+    while (edge != end && edge->byte != b) {
+      ++edge;
+    }
+    if (edge == end) {
+      break;
+    }
+    node = edge->target;
+  }
+
+  if (!vcsEnd.has_value()) {
+    return false;
+  }
+
+  // path[*vcsEnd] is a separator; this is an ignore iff another
+  // separator follows it, i.e. the path is at grandchild depth.
+  const char* skip_prefix = path + *vcsEnd + 1;
+  uint32_t len = pathlen - *vcsEnd - 1;
+#ifndef _WIN32
+  return memchr(skip_prefix, '/', len) != nullptr;
+#else
+  while (len > 0) {
+    if (is_slash(*skip_prefix)) {
+      return true;
+    }
+    skip_prefix++;
+    len--;
+  }
+  return false;
+#endif
+}
+
+bool IgnoreSet::mayContainIgnoredComponent(const char* path, uint32_t pathlen)
+    const {
+  for (auto component : w_string_piece(path, pathlen).pathComponents()) {
+    if (component.empty()) {
+      continue;
+    }
+    auto hash = component.hashValue();
+    bool hit = true;
+    for (auto bit : {bloomFirst(hash), bloomSecond(hash)}) {
+      if (!(component_bloom[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+        hit = false;
+        break;
+      }
+    }
+    if (hit) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool IgnoreSet::isIgnored(const char* path, uint32_t pathlen) const {
   const char* skip_prefix;
   uint32_t len;
+
+  // For an ignore entry to prefix-match the path, the entry's final
+  // component must appear somewhere in the path; probe the bloom filter
+  // for each component before paying for the radix tree walk.
+  if (!mayContainIgnoredComponent(path, pathlen)) {
+    return false;
+  }
+
+  if (!compiled_nodes_.empty()) {
+    return matchCompiled(path, pathlen);
+  }
+
   auto leaf = tree.longestMatch((const unsigned char*)path, (int)pathlen);
 
   if (!leaf) {
@@ -94,6 +257,38 @@ bool IgnoreSet::isIgnored(const char* path, uint32_t pathlen) const {
 #endif
 }
 
+bool IgnoreMemo::isIgnored(
+    const IgnoreSet& set,
+    const char* path,
+    uint32_t pathlen) {
+  if (set.generation() != generation_) {
+    // The set was swapped by a live ignore update; the memoized prefix
+    // may no longer be ignored under the replacement.
+    lastIgnored_ = w_string{};
+    generation_ = set.generation();
+  }
+  if (!lastIgnored_.empty() && pathlen > lastIgnored_.size() &&
+      is_slash(path[lastIgnored_.size()]) &&
+      memcmp(path, lastIgnored_.data(), lastIgnored_.size()) == 0) {
+    return true;
+  }
+
+  if (!set.isIgnored(path, pathlen)) {
+    return false;
+  }
+
+  // Prefer remembering the containing directory when it is itself
+  // ignored, so that sibling paths within the same burst hit the memo
+  // rather than just descendants of this one.
+  auto dir = w_string_piece{path, pathlen}.dirName();
+  if (dir.size() && set.isIgnored(dir.data(), dir.size())) {
+    lastIgnored_ = dir.asWString();
+  } else {
+    lastIgnored_ = w_string{path, pathlen};
+  }
+  return true;
+}
+
 bool IgnoreSet::isIgnoreVCS(const w_string& path) const {
   return ignore_vcs.find(path) != ignore_vcs.end();
 }
@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <folly/Synchronized.h>
+#include <array>
+#include <memory>
 #include <unordered_set>
 #include <vector>
 #include "watchman/thirdparty/libart/src/art.h"
@@ -21,6 +24,11 @@ class IgnoreSet {
   // or a vcs-style grandchild ignore.
   void add(const w_string& path, bool is_vcs_ignore);
 
+  // Freezes the set into a flat byte-trie matcher.  Called once after
+  // root init has populated the set; isIgnored uses the compiled form
+  // when present and falls back to the radix tree before compilation.
+  void compile();
+
   // Tests whether path is ignored.
   // Returns true if the path is ignored, false otherwise.
   bool isIgnored(const char* path, uint32_t pathlen) const;
@@ -35,7 +43,29 @@ class IgnoreSet {
     return dirs_vec;
   }
 
+  /**
+   * Process-unique identity of this compiled set, assigned by
+   * compile().  IgnoreMemo uses it to detect that the set it memoized
+   * against was swapped out (live ignore updates) and drop its cached
+   * answer.  Zero until compiled.
+   */
+  uint64_t generation() const {
+    return generation_;
+  }
+
  private:
+  // Returns true if some component of the path might match the final
+  // component of an ignore entry; false proves the path is not ignored.
+  bool mayContainIgnoredComponent(const char* path, uint32_t pathlen) const;
+
+  /* Bloom filter over hashes of the final path component of every ignore
+   * entry.  Any path that an entry prefix-matches must contain that entry's
+   * final component, so a negative probe here rules out a match without
+   * walking the exact structures below.  This keeps the common not-ignored
+   * case in the crawler and notify threads down to a couple of hash
+   * probes. */
+  std::array<uint64_t, 8> component_bloom{};
+
   // if the map has an entry for a given dir, we're ignoring it */
   std::unordered_set<w_string> ignore_vcs;
   std::unordered_set<w_string> ignore_dirs;
@@ -43,10 +73,106 @@ class IgnoreSet {
    * entries above.  This is used only on macOS and Windows because
    * we cannot exclude these dirs using the kernel watching APIs */
   art_tree<uint8_t, w_string> tree;
+
+  /* Compiled matcher built by compile(): a byte trie over the entry
+   * paths flattened into two contiguous arrays.  Since every entry is
+   * an anchored prefix of the probed path, matching is one forward
+   * scan over the path bytes with the full/vcs semantics baked into
+   * the terminal flags; there is no per-entry work and the whole
+   * structure usually fits in a couple of cache lines. */
+  struct CompiledNode {
+    uint32_t firstEdge; // index into compiled_edges_
+    uint16_t numEdges;
+    uint8_t flags; // terminal FULL/VCS bits; 0 for interior nodes
+  };
+  struct CompiledEdge {
+    unsigned char byte;
+    uint32_t target; // index into compiled_nodes_
+  };
+  std::vector<CompiledNode> compiled_nodes_;
+  std::vector<CompiledEdge> compiled_edges_;
+
+  // isIgnored via the compiled trie; only valid after compile().
+  bool matchCompiled(const char* path, uint32_t pathlen) const;
   /* On macOS, we need to preserve the order of the ignore list so
    * that we can exclude things deterministically and fit within
    * system limits. */
   std::vector<w_string> dirs_vec;
+
+  uint64_t generation_{0};
+};
+
+/**
+ * Hot-swappable holder for a root's IgnoreSet.  Probes forward to an
+ * immutable snapshot, so the io and notify threads keep matching while
+ * Root::reloadConfigFile() swaps in a set derived from an edited
+ * .watchmanconfig.  Swaps are rare; reads vastly dominate, and each
+ * probe pays one shared-lock acquisition over the plain set.
+ */
+class LiveIgnoreSet {
+ public:
+  /*implicit*/ LiveIgnoreSet(IgnoreSet&& initial)
+      : current_{std::make_shared<const IgnoreSet>(std::move(initial))} {}
+
+  /// Snapshot of the current set; keeps the matcher alive across a swap.
+  std::shared_ptr<const IgnoreSet> get() const {
+    return current_.copy();
+  }
+
+  /// Replace the set.  In-flight probes complete against the old
+  /// snapshot; new probes observe the replacement.
+  void swap(IgnoreSet&& next) {
+    *current_.wlock() = std::make_shared<const IgnoreSet>(std::move(next));
+  }
+
+  bool isIgnored(const char* path, uint32_t pathlen) const {
+    return get()->isIgnored(path, pathlen);
+  }
+
+  bool isIgnoreVCS(const w_string& path) const {
+    return get()->isIgnoreVCS(path);
+  }
+
+  bool isIgnoreDir(const w_string& path) const {
+    return get()->isIgnoreDir(path);
+  }
+
+  std::vector<w_string> getIgnoredDirs() const {
+    return get()->getIgnoredDirs();
+  }
+
+ private:
+  folly::Synchronized<std::shared_ptr<const IgnoreSet>> current_;
+};
+
+/**
+ * Single-entry memo in front of IgnoreSet::isIgnored for the notify
+ * threads.  Ignored events arrive in bursts clustered under one
+ * directory (VCS object writes in particular), so remembering the most
+ * recently matched ignored directory answers the rest of the burst with
+ * one prefix compare instead of a full lookup.  Not thread safe; keep
+ * one per thread that consumes events.
+ */
+class IgnoreMemo {
+ public:
+  // Equivalent to set.isIgnored(path, pathlen).
+  bool isIgnored(const IgnoreSet& set, const char* path, uint32_t pathlen);
+
+  // Convenience for callers holding the live holder; snapshots once.
+  bool isIgnored(const LiveIgnoreSet& live, const char* path, uint32_t pathlen) {
+    return isIgnored(*live.get(), path, pathlen);
+  }
+
+ private:
+  /* Most recent ignored path; everything strictly below it is also
+   * ignored, so a separator-checked prefix match suffices.  This holds
+   * for both entry styles: full-style entries ignore their whole
+   * subtree, and vcs-style entries only match at grandchild depth and
+   * deeper, where every descendant matches too. */
+  w_string lastIgnored_;
+  // generation() of the set lastIgnored_ was memoized against; a
+  // mismatch means the set was swapped and the memo must be dropped.
+  uint64_t generation_{0};
 };
 
 } // namespace watchman
@@ -8,11 +8,19 @@
 #include "watchman/InMemoryView.h"
 #include <fmt/core.h>
 #include <folly/ScopeGuard.h>
+#include <folly/String.h>
+#include <folly/synchronization/Baton.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <memory>
 #include <thread>
 #include "watchman/Errors.h"
+#include "watchman/MemoryAccounting.h"
+#include "watchman/PDU.h"
 #include "watchman/ThreadPool.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/Query.h"
@@ -22,6 +30,7 @@
 #include "watchman/thirdparty/wildmatch/wildmatch.h"
 #include "watchman/watcher/Watcher.h"
 #include "watchman/watchman_file.h"
+#include "watchman/watchman_stream.h"
 
 // Each root gets a number that uniquely identifies it within the process. This
 // helps avoid confusion if a root is removed and then added again.
@@ -56,15 +65,57 @@ InMemoryViewCaches::InMemoryViewCaches(
     const w_string& rootPath,
     size_t maxHashes,
     size_t maxSymlinks,
+    size_t maxRenderedFragments,
     std::chrono::milliseconds errorTTL)
     : contentHashCache(rootPath, maxHashes, errorTTL),
-      symlinkTargetCache(rootPath, maxSymlinks, errorTTL) {}
+      symlinkTargetCache(rootPath, maxSymlinks, errorTTL),
+      renderCache(maxRenderedFragments, errorTTL) {}
 
 InMemoryFileResult::InMemoryFileResult(
     const watchman_file* file,
     InMemoryViewCaches& caches)
     : file_(file), caches_(caches) {}
 
+namespace {
+// Every generator mints its per-file results through here so they are
+// placed in the context's slab arena instead of being individually
+// heap-allocated; see InMemoryFileResult::operator new.
+std::unique_ptr<InMemoryFileResult> makeFileResult(
+    FileNodeArena& arena,
+    const watchman_file* file,
+    InMemoryViewCaches& caches) {
+  return std::unique_ptr<InMemoryFileResult>(
+      new (arena) InMemoryFileResult(file, caches));
+}
+} // namespace
+
+w_string InMemoryFileResult::renderCacheKey() {
+  return w_string::pathCat({dirName(), baseName()});
+}
+
+std::optional<json_ref> InMemoryFileResult::getCachedRender(
+    const RenderCacheProbe& probe) {
+  auto node = caches_.renderCache.get(renderCacheKey());
+  if (!node) {
+    return std::nullopt;
+  }
+  const auto& cached = node->value();
+  if (cached.otimeTicks != file_->otime.ticks || cached.isNew != probe.isNew ||
+      cached.fieldListHash != probe.fieldListHash) {
+    return std::nullopt;
+  }
+  return cached.fragment;
+}
+
+void InMemoryFileResult::cacheRender(
+    const RenderCacheProbe& probe,
+    const json_ref& rendered) {
+  caches_.renderCache.set(
+      renderCacheKey(),
+      RenderedFragment{
+          file_->otime.ticks, probe.isNew, probe.fieldListHash, rendered});
+}
+
 void InMemoryFileResult::batchFetchProperties(
     const std::vector<std::unique_ptr<FileResult>>& files) {
   std::vector<folly::Future<folly::Unit>> readlinkFutures;
@@ -90,10 +141,10 @@ void InMemoryFileResult::batchFetchProperties(
     if (file->neededProperties() & FileResult::Property::SymlinkTarget) {
       if (!file->file_->stat.isSymlink()) {
         // If this file is not a symlink then we immediately yield
-        // a nullptr w_string instance rather than propagating an error.
-        // This behavior is relied upon by the field rendering code and
-        // checked in test_symlink.py.
-        file->symlinkTarget_ = w_string();
+        // NotSymlink rather than propagating an error.  The field
+        // rendering code turns that into a null value; this is checked
+        // in test_symlink.py.
+        file->symlinkTarget_ = NotSymlink{};
       } else {
         auto dir = file->dirName();
         dir.advance(file->caches_.symlinkTargetCache.rootPath().size());
@@ -135,10 +186,12 @@ void InMemoryFileResult::batchFetchProperties(
         dir.advance(1);
       }
 
+      // Keyed by the content fingerprint rather than the raw mtime, so
+      // metadata-only touches keep hitting the cached sha1.
       ContentHashCacheKey key{
           w_string::pathCat({dir, file->baseName()}),
           size_t(file->file_->stat.size),
-          file->file_->stat.mtime};
+          file->file_->content_mtime};
 
       sha1Futures.emplace_back(caches_.contentHashCache.get(key).thenTry(
           [file](folly::Try<std::shared_ptr<const ContentHashCache::Node>>&&
@@ -156,6 +209,12 @@ std::optional<FileInformation> InMemoryFileResult::stat() {
   return file_->stat;
 }
 
+std::optional<DType> InMemoryFileResult::dtype() {
+  // Decoded once when the stat landed; avoids copying the whole stat
+  // block out of the node just to inspect its mode.
+  return file_->dtype;
+}
+
 std::optional<size_t> InMemoryFileResult::size() {
   return file_->stat.size;
 }
@@ -183,6 +242,14 @@ w_string_piece InMemoryFileResult::dirName() {
   return *dirName_;
 }
 
+const watchman_dir* InMemoryFileResult::containingDir() {
+  return file_->parent;
+}
+
+std::optional<uint32_t> InMemoryFileResult::suffixId() {
+  return file_->suffix_id;
+}
+
 std::optional<bool> InMemoryFileResult::exists() {
   return file_->exists;
 }
@@ -238,36 +305,31 @@ watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name, bool create) {
     return rootDir_.get();
   }
 
-  const char* dir_component = dir_name.data();
-  const char* dir_end = dir_component + dir_name.size();
-
-  watchman_dir* dir = rootDir_.get();
-  dir_component += rootPath_.size() + 1; // Skip root path prefix
-
-  w_assert(dir_component <= dir_end, "impossible file name");
-
-  watchman_dir* parent;
-  while (true) {
-    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
-    // Note: if sep is NULL it means that we're looking at the basename
-    // component of the input directory name, which is the terminal
-    // iteration of this search.
+  auto& slot = dirCache_[dir_name.hashValue() & (kDirCacheSize - 1)];
+  if (slot.dir && slot.path == dir_name) {
+    return slot.dir;
+  }
 
-    w_string_piece component(
-        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
+  auto relative = dir_name.piece();
+  relative.advance(rootPath_.size() + 1); // Skip root path prefix
 
+  // Walk down one component at a time; the component views alias
+  // dir_name's storage, so splitting builds no intermediate strings.
+  watchman_dir* dir = rootDir_.get();
+  for (auto component : relative.pathComponents()) {
     auto child = dir->getChildDir(component);
 
-    if (!child && !create) {
-      return nullptr;
-    }
-    if (!child && sep && create) {
-      // A component in the middle wasn't present.  Since we're in create
-      // mode, we know that the leaf must exist.  The assumption is that
-      // we have another pending item for the parent.  We'll create the
-      // parent dir now and our other machinery will populate its contents
-      // later.
-      w_string child_name(dir_component, (uint32_t)(sep - dir_component));
+    if (!child) {
+      if (!create) {
+        return nullptr;
+      }
+      // The component wasn't present and we're in create mode.  When it
+      // is a middle component, the assumption is that we have another
+      // pending item for the parent; we create the dir now and our other
+      // machinery will populate its contents later.
+      // Dir names like "node_modules" recur throughout a tree; intern the
+      // component so sibling dirs share one allocation.
+      w_string child_name = internPathComponent(component);
 
       // Careful! dir->dirs is keyed by non-owning string pieces so the
       // child_name MUST be stored or otherwise kept alive by the watchman_dir
@@ -278,30 +340,15 @@ watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name, bool create) {
       child = new_child.get();
     }
 
-    parent = dir;
     dir = child;
-
-    if (!sep) {
-      // We reached the end of the string
-      if (dir) {
-        // We found the dir
-        return dir;
-      }
-      // We need to create the dir
-      break;
-    }
-
-    // Skip to the next component for the next iteration
-    dir_component = sep + 1;
   }
 
-  w_string child_name(dir_component, (uint32_t)(dir_end - dir_component));
-  // Careful! parent->dirs is keyed by non-owning string pieces so the
-  // child_name MUST be stored or otherwise kept alive by the watchman_dir
-  // instance constructed below!
-  auto& new_child = parent->dirs[child_name];
-  new_child.reset(new watchman_dir(child_name, parent));
-  return new_child.get();
+  // Misses (create=false, dir absent) are not cached: a subsequent
+  // create-mode call for the same path must take the walk.
+  slot.path = dir_name;
+  slot.dir = dir;
+
+  return dir;
 }
 
 const watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name) const {
@@ -309,45 +356,18 @@ const watchman_dir* ViewDatabase::resolveDir(const w_string& dir_name) const {
     return rootDir_.get();
   }
 
-  const char* dir_component = dir_name.data();
-  const char* dir_end = dir_component + dir_name.size();
+  auto relative = dir_name.piece();
+  relative.advance(rootPath_.size() + 1); // Skip root path prefix
 
   watchman_dir* dir = rootDir_.get();
-  dir_component += rootPath_.size() + 1; // Skip root path prefix
-
-  w_assert(dir_component <= dir_end, "impossible file name");
-
-  while (true) {
-    auto sep = (const char*)memchr(dir_component, '/', dir_end - dir_component);
-    // Note: if sep is NULL it means that we're looking at the basename
-    // component of the input directory name, which is the terminal
-    // iteration of this search.
-
-    w_string_piece component(
-        dir_component, sep ? (sep - dir_component) : (dir_end - dir_component));
-
-    auto child = dir->getChildDir(component);
-    if (!child) {
-      return nullptr;
-    }
-
-    dir = child;
-
-    if (!sep) {
-      // We reached the end of the string
-      if (dir) {
-        // We found the dir
-        return dir;
-      }
-      // Does not exist
+  for (auto component : relative.pathComponents()) {
+    dir = dir->getChildDir(component);
+    if (!dir) {
       return nullptr;
     }
-
-    // Skip to the next component for the next iteration
-    dir_component = sep + 1;
   }
 
-  return nullptr;
+  return dir;
 }
 
 watchman_file* ViewDatabase::getOrCreateChildFile(
@@ -363,24 +383,271 @@ watchman_file* ViewDatabase::getOrCreateChildFile(
 
   // ... but take the shorter string from inside the file that
   // we create as the key.
-  auto file = watchman_file::make(file_name, dir);
+  auto file = watchman_file::make(file_name, dir, fileArena_);
   auto& file_ptr = dir->files[file->getName()];
   file_ptr = std::move(file);
 
   file_ptr->ctime = ctime;
 
+  // Files never change name, so suffix index membership is established
+  // exactly once here; the node unlinks itself when it is freed.
+  if (auto suffix = file_ptr->getName().asLowerCaseSuffix()) {
+    // Suffix strings recur across every root in the daemon, so share one
+    // buffer through the component pool rather than keeping a per-file
+    // (and, via the map key below, per-root) copy.
+    auto shared = internPathComponent(*suffix);
+    file_ptr->suffix_id = internSuffixId(shared);
+    SuffixListOps::insertHead(suffixes_[shared], file_ptr.get());
+  }
+
   return file_ptr.get();
 }
 
+void ViewDatabase::insertBatch(
+    watchman_dir* dir,
+    std::vector<NewFileRecord>& records,
+    ClockStamp otime,
+    std::vector<watchman_file*>& createdOut) {
+  if (records.empty()) {
+    return;
+  }
+
+  dir->files.reserve(dir->files.size() + records.size());
+  createdOut.reserve(createdOut.size() + records.size());
+
+  watchman_file* first = nullptr;
+  watchman_file* last = nullptr;
+  for (auto& record : records) {
+    auto file = watchman_file::make(record.name, dir, fileArena_);
+    auto& file_ptr = dir->files[file->getName()];
+    file_ptr = std::move(file);
+    auto* f = file_ptr.get();
+
+    f->ctime = otime;
+    // Same one-time suffix membership as getOrCreateChildFile.
+    if (auto suffix = f->getName().asLowerCaseSuffix()) {
+      auto shared = internPathComponent(*suffix);
+      f->suffix_id = internSuffixId(shared);
+      SuffixListOps::insertHead(suffixes_[shared], f);
+    }
+
+    f->exists = true;
+    f->otime = otime;
+    memcpy(&f->stat, &record.stat, sizeof(f->stat));
+    f->content_mtime = record.stat.mtime;
+    f->dtype = record.stat.dtype();
+
+    // Build the detached chain with later records closer to the head,
+    // matching what sequential markFileChanged calls would produce.
+    RecencyListOps::insertHead(first, f);
+    if (!last) {
+      last = f;
+    }
+    appendChangeJournal(f, otime);
+    createdOut.push_back(f);
+  }
+
+  if (activeBatch_) {
+    // Route through the in-scope batch chain so the eventual flush
+    // preserves marking order across both mechanisms.
+    RecencyListOps::spliceHead(activeBatch_->first_, first, last);
+    if (!activeBatch_->last_) {
+      activeBatch_->last_ = last;
+    }
+  } else {
+    RecencyListOps::spliceHead(latestFile_, first, last);
+  }
+}
+
 void ViewDatabase::markFileChanged(watchman_file* file, ClockStamp otime) {
+  if (activeBatch_) {
+    activeBatch_->markFileChanged(file, otime);
+    return;
+  }
+
+  if (latestFile_ == file && file->otime.ticks == otime.ticks) {
+    // Re-marked at the same tick; appending another journal record
+    // would only create an equal-tick duplicate that readers cannot
+    // tell apart from the current one.
+    file->otime = otime;
+    refreshChangeJournalTail(file, otime);
+    return;
+  }
+
   file->otime = otime;
 
   if (latestFile_ != file) {
-    // unlink from list
-    file->removeFromFileList();
+    RecencyListOps::unlink(file);
+    RecencyListOps::insertHead(latestFile_, file);
+  }
+
+  appendChangeJournal(file, otime);
+}
+
+ViewDatabase::FileChangeBatch::FileChangeBatch(ViewDatabase& view)
+    : view_{view} {
+  w_check(!view_.activeBatch_, "FileChangeBatch scopes must not nest");
+  view_.activeBatch_ = this;
+}
+
+ViewDatabase::FileChangeBatch::~FileChangeBatch() {
+  flush();
+  view_.activeBatch_ = nullptr;
+}
+
+void ViewDatabase::FileChangeBatch::flush() {
+  if (!first_) {
+    return;
+  }
+  RecencyListOps::spliceHead(view_.latestFile_, first_, last_);
+  first_ = nullptr;
+  last_ = nullptr;
+}
 
-    // and move to the head
-    insertAtHeadOfFileList(file);
+void ViewDatabase::FileChangeBatch::markFileChanged(
+    watchman_file* file,
+    ClockStamp otime) {
+  // The front of the logical index is the chain head while the chain is
+  // non-empty, so the same-tick dedup check must look there first.
+  auto* head = first_ ? first_ : view_.latestFile_;
+  if (head == file && file->otime.ticks == otime.ticks) {
+    file->otime = otime;
+    view_.refreshChangeJournalTail(file, otime);
+    return;
+  }
+
+  file->otime = otime;
+
+  if (file != first_) {
+    if (file == last_) {
+      // Re-marking the oldest file in the chain; splicing what we have
+      // is cheaper than hunting backwards for a replacement tail.
+      flush();
+    }
+    // unlink() works whether the file sits on the main index or on the
+    // detached chain: prev always points at the relevant next slot.
+    RecencyListOps::unlink(file);
+    RecencyListOps::insertHead(first_, file);
+    if (!last_) {
+      last_ = file;
+    }
+  }
+
+  view_.appendChangeJournal(file, otime);
+}
+
+void ViewDatabase::appendChangeJournal(watchman_file* file, ClockStamp otime) {
+  file->journal_seq = ++journalSeq_;
+  changeJournal_.push_back(
+      {otime.ticks, file->journal_seq, file, otime.timestamp, file->exists});
+  maybeCompactChangeJournal();
+  maybeSealJournalCheckpoint();
+}
+
+void ViewDatabase::refreshChangeJournalTail(
+    watchman_file* file,
+    ClockStamp otime) {
+  // The most recent append overall was this file's, so keep its
+  // packed mirror fields honest: a delete observed within the same
+  // tick must be visible to the age-out sweep.
+  if (!changeJournal_.empty() && changeJournal_.back().file == file &&
+      changeJournal_.back().seq == file->journal_seq) {
+    changeJournal_.back().timestamp = otime.timestamp;
+    changeJournal_.back().exists = file->exists;
+  }
+}
+
+void ViewDatabase::maybeCompactChangeJournal() {
+  // Rewrite once superseded records make up at least half the journal,
+  // with a floor so that small journals aren't rewritten constantly.
+  constexpr size_t kMinRecordsBeforeCompaction = 16 * 1024;
+  if (changeJournal_.size() < kMinRecordsBeforeCompaction ||
+      changeJournal_.size() < 2 * journalLiveAtLastCompaction_) {
+    return;
+  }
+  changeJournal_.erase(
+      std::remove_if(
+          changeJournal_.begin(),
+          changeJournal_.end(),
+          [](const ChangeJournalEntry& entry) {
+            return entry.seq != entry.file->journal_seq;
+          }),
+      changeJournal_.end());
+  journalLiveAtLastCompaction_ = changeJournal_.size();
+}
+
+void ViewDatabase::maybeSealJournalCheckpoint() {
+  // Seal the cold half of the journal into a compacted checkpoint once
+  // the hot tail grows large.  Ancient-clock since queries then merge
+  // the pre-deduped windows instead of re-scanning (and re-skipping the
+  // superseded records of) the whole history on every run.
+  constexpr size_t kSealThreshold = 32 * 1024;
+  constexpr size_t kMaxRetainedCheckpoints = 16;
+  if (changeJournal_.size() < kSealThreshold) {
+    return;
+  }
+
+  // Split on a tick boundary so a window never divides an equal-tick
+  // cohort; readers reason about coverage purely in ticks.
+  size_t split = changeJournal_.size() / 2;
+  const auto sealTick = changeJournal_[split - 1].tick;
+  while (split < changeJournal_.size() &&
+         changeJournal_[split].tick == sealTick) {
+    ++split;
+  }
+  if (split == changeJournal_.size()) {
+    // The whole journal shares the newest tick; try again later.
+    return;
+  }
+
+  JournalCheckpoint cp;
+  cp.fromTick =
+      journalCheckpoints_.empty() ? 0 : journalCheckpoints_.back().toTick;
+  cp.toTick = sealTick;
+  for (size_t i = 0; i < split; ++i) {
+    const auto& entry = changeJournal_[i];
+    if (entry.seq == entry.file->journal_seq) {
+      cp.entries.push_back(entry);
+    }
+  }
+  journalCheckpoints_.push_back(std::move(cp));
+  changeJournal_.erase(changeJournal_.begin(), changeJournal_.begin() + split);
+
+  // The compaction trigger compares against the live count; recount the
+  // remaining tail so sealing doesn't skew it.
+  journalLiveAtLastCompaction_ = size_t(std::count_if(
+      changeJournal_.begin(),
+      changeJournal_.end(),
+      [](const ChangeJournalEntry& entry) {
+        return entry.seq == entry.file->journal_seq;
+      }));
+
+  if (journalCheckpoints_.size() > kMaxRetainedCheckpoints) {
+    // Clocks older than the dropped window fall back to the recency
+    // list walk; raising the floor keeps the coverage claim honest.
+    checkpointFloorTick_ = journalCheckpoints_.front().toTick;
+    journalCheckpoints_.erase(journalCheckpoints_.begin());
+  }
+}
+
+void ViewDatabase::pruneChangeJournal(
+    const std::unordered_set<const watchman_file*>& files) {
+  if (files.empty()) {
+    return;
+  }
+  auto prune = [&](std::vector<ChangeJournalEntry>& entries) {
+    entries.erase(
+        std::remove_if(
+            entries.begin(),
+            entries.end(),
+            [&](const ChangeJournalEntry& entry) {
+              return files.count(entry.file) != 0;
+            }),
+        entries.end());
+  };
+  prune(changeJournal_);
+  for (auto& cp : journalCheckpoints_) {
+    prune(cp.entries);
   }
 }
 
@@ -406,21 +673,66 @@ void ViewDatabase::markDirDeleted(
   }
 
   if (recursive) {
+    // Don't walk the subtree inline; `rm -rf` of a large tree would pin
+    // the IO thread for the duration. Queue a tombstone per child dir
+    // and let processDeferredDeletes() drain them in bounded slices.
+    // The current journal sequence distinguishes the tombstoned state
+    // from anything observed afterwards.
     for (auto& it : dir->dirs) {
-      auto child = it.second.get();
-
-      markDirDeleted(child, otime, true);
+      deferredDeletes_.push_back({it.second->getFullPath(), journalSeq_});
     }
   }
 }
 
-void ViewDatabase::insertAtHeadOfFileList(struct watchman_file* file) {
-  file->next = latestFile_;
-  if (file->next) {
-    file->next->prev = &file->next;
+void ViewDatabase::noteDirObserved(watchman_dir* dir) {
+  dir->last_observed_seq = ++journalSeq_;
+}
+
+size_t ViewDatabase::processDeferredDeletes(ClockStamp otime, size_t budget) {
+  size_t work = 0;
+
+  while (!deferredDeletes_.empty() && work < budget) {
+    auto entry = std::move(deferredDeletes_.front());
+    deferredDeletes_.pop_front();
+    ++work;
+
+    auto dir = resolveDir(entry.path, false);
+    if (!dir) {
+      // Aged out or never existed; nothing to mark.
+      continue;
+    }
+    if (dir->last_observed_seq > entry.seq) {
+      // The dir was seen on disk after the tombstone was queued
+      // (eg: moved away and back, or recreated and crawled), so the
+      // crawl already reconciled this subtree. The tombstone is stale.
+      continue;
+    }
+    if (!dir->last_check_existed) {
+      // Already known-deleted; mirrors the early return in
+      // markDirDeleted.
+      continue;
+    }
+    dir->last_check_existed = false;
+
+    for (auto& it : dir->files) {
+      auto file = it.second.get();
+      // Files touched after the tombstone was queued reflect newer
+      // observations than the delete we're applying; leave them be.
+      if (file->exists && file->journal_seq <= entry.seq) {
+        auto full_name = dir->getFullPathToChild(file->getName());
+        logf(DBG, "mark_deleted: {}\n", full_name);
+        file->exists = false;
+        markFileChanged(file, otime);
+        ++work;
+      }
+    }
+
+    for (auto& it : dir->dirs) {
+      deferredDeletes_.push_back({it.second->getFullPath(), entry.seq});
+    }
   }
-  latestFile_ = file;
-  file->prev = &latestFile_;
+
+  return deferredDeletes_.size();
 }
 
 InMemoryView::PendingChangeLogEntry::PendingChangeLogEntry(
@@ -451,6 +763,34 @@ json_ref InMemoryView::PendingChangeLogEntry::asJsonValue() const {
   });
 }
 
+namespace {
+
+std::vector<w_string> parseLazyDirs(
+    const w_string& root_path,
+    const Configuration& config) {
+  std::vector<w_string> result;
+  auto lazy = config.get("lazy_dirs");
+  if (!lazy) {
+    return result;
+  }
+  if (!lazy->isArray()) {
+    logf(ERR, "lazy_dirs must be an array of strings\n");
+    return result;
+  }
+  for (auto& jdir : lazy->array()) {
+    if (!jdir.isString()) {
+      logf(ERR, "lazy_dirs must be an array of strings\n");
+      continue;
+    }
+    auto fullname = w_string::pathCat({root_path, json_to_w_string(jdir)});
+    logf(DBG, "deferring crawl of {} until first use\n", fullname);
+    result.push_back(std::move(fullname));
+  }
+  return result;
+}
+
+} // namespace
+
 InMemoryView::InMemoryView(
     FileSystem& fileSystem,
     const w_string& root_path,
@@ -462,11 +802,17 @@ InMemoryView::InMemoryView(
       view_(folly::in_place, root_path),
       rootNumber_(next_root_number++),
       rootPath_(root_path),
+      configFilePath_(w_string::build(root_path, "/.watchmanconfig")),
+      lazyDirs_(parseLazyDirs(root_path, config_)),
       watcher_(std::move(watcher)),
+      changedPathLogLimit_(
+          size_t(config_.getInt("subscription_scope_log_size", 8192))),
+      compactSliceSize_(size_t(config_.getInt("view_compact_slice", 2048))),
       caches_(
           root_path,
           config_.getInt("content_hash_max_items", 128 * 1024),
           config_.getInt("symlink_target_max_items", 32 * 1024),
+          config_.getInt("render_cache_max_items", 8 * 1024),
           std::chrono::milliseconds(
               config_.getInt("content_hash_negative_cache_ttl_ms", 2000))),
       enableContentCacheWarming_(
@@ -474,16 +820,87 @@ InMemoryView::InMemoryView(
       maxFilesToWarmInContentCache_(
           size_t(config_.getInt("content_hash_max_warm_per_settle", 1024))),
       syncContentCacheWarming_(
-          config_.getBool("content_hash_warm_wait_before_settle", false)) {
+          config_.getBool("content_hash_warm_wait_before_settle", false)),
+      adaptiveSettle_(config_.getBool("settle_adaptive", false)),
+      settleSpeculation_(config_.getBool("settle_speculation", true)),
+      adaptiveSettleMax_(std::chrono::milliseconds(
+          config_.getInt("settle_adaptive_max_ms", 500))) {
+  // On by default: per-thread rings are cheap enough to leave enabled,
+  // and when chasing a stuck settle in production it is too late to
+  // turn instrumentation on after the fact.  The size is per writing
+  // thread; 0 disables the log entirely.
   json_int_t in_memory_view_ring_log_size =
-      config_.getInt("in_memory_view_ring_log_size", 0);
+      config_.getInt("in_memory_view_ring_log_size", 1024);
   if (in_memory_view_ring_log_size) {
-    this->processedPaths_ = std::make_unique<RingBuffer<PendingChangeLogEntry>>(
-        in_memory_view_ring_log_size);
+    this->processedPaths_ =
+        std::make_unique<PerThreadRingLog<PendingChangeLogEntry>>(
+            in_memory_view_ring_log_size);
+  }
+
+  json_int_t spillThreshold = config_.getInt("pending_spill_threshold", 0);
+  if (spillThreshold > 0) {
+    // Arm the disk spill tier on the watcher-facing queue: it is the
+    // one that grows without bound when a watcher storm outpaces the
+    // IO thread.  localPending drains fully every iteration.
+    pendingFromWatcher_.lock()->setSpillThreshold(size_t(spillThreshold));
+  }
+
+  if (!lazyDirs_.empty()) {
+    unmaterializedDirs_.wlock()->insert(lazyDirs_.begin(), lazyDirs_.end());
   }
 }
 
-InMemoryView::~InMemoryView() = default;
+std::unique_ptr<ViewDatabase::TeardownBundle> ViewDatabase::detachTeardown() {
+  auto bundle = std::make_unique<TeardownBundle>();
+  bundle->latestFile = latestFile_;
+  bundle->suffixes = std::move(suffixes_);
+  bundle->rootDir = std::move(rootDir_);
+  // The head file's prev points at the address of the list head; the
+  // head now lives in the bundle.  The suffix heads need no such fixup:
+  // moving the map leaves its nodes (and their addresses) intact.
+  if (bundle->latestFile) {
+    bundle->latestFile->prev = &bundle->latestFile;
+  }
+  latestFile_ = nullptr;
+  suffixes_.clear();
+  changeJournal_.clear();
+  deferredDeletes_.clear();
+  clearDirCache();
+  return bundle;
+}
+
+InMemoryView::~InMemoryView() {
+  // Unwatching a large root frees millions of nodes.  Hand the tree to
+  // the shared pool as background work so watch-del and reap return in
+  // milliseconds instead of waiting for destructors to run; other roots
+  // keep being serviced meanwhile.
+  auto bundle = view_.wlock()->detachTeardown();
+  try {
+    getThreadPool().addLowPriority([bundle = std::move(bundle)]() mutable {
+      MemoryScope memScope{MemorySubsystem::View};
+      bundle.reset();
+    });
+  } catch (const std::exception&) {
+    // The pool is not running (tests, process shutdown).  The bundle --
+    // whether still here or already moved into the rejected task -- is
+    // torn down inline as it goes out of scope.
+  }
+}
+
+namespace {
+/**
+ * Shrinks an unordered child map whose population has fallen well
+ * below its bucket count.  Erase-heavy churn (age out, compaction)
+ * otherwise leaves the bucket array sized for the high-water mark
+ * forever.
+ */
+template <typename Map>
+void maybeShrinkChildMap(Map& map) {
+  if (map.bucket_count() > 16 && map.size() * 4 < map.bucket_count()) {
+    map.rehash(0);
+  }
+}
+} // namespace
 
 ClockStamp InMemoryView::ageOutFile(
     std::unordered_set<w_string>& dirs_to_erase,
@@ -503,61 +920,377 @@ ClockStamp InMemoryView::ageOutFile(
   // We don't need to stop watching it, because we already stopped watching it
   // when we marked it as !exists.
   parent->files.erase(file->getName());
+  maybeShrinkChildMap(parent->files);
+  ++fileFreeGen_;
 
   return ageOutOtime;
 }
 
+namespace {
+/** Collects every file node in the subtree rooted at dir. */
+void collectSubtreeFiles(
+    const watchman_dir* dir,
+    std::unordered_set<const watchman_file*>& files) {
+  for (auto& it : dir->files) {
+    files.insert(it.second.get());
+  }
+  for (auto& it : dir->dirs) {
+    collectSubtreeFiles(it.second.get(), files);
+  }
+}
+} // namespace
+
+void InMemoryView::eraseAgedDirs(
+    ViewDatabase& view,
+    const std::unordered_set<w_string>& dirs_to_erase,
+    std::unordered_set<const watchman_file*>& aged_files) {
+  // The resolve cache holds raw pointers into the subtrees we are about
+  // to free.
+  view.clearDirCache();
+  for (auto& name : dirs_to_erase) {
+    auto parent = view.resolveDir(name.dirName(), false);
+    if (parent) {
+      // Erasing the dir frees any file nodes still hanging off its
+      // subtree, so record them for journal pruning as well.
+      if (auto* child = parent->getChildDir(name.baseName())) {
+        collectSubtreeFiles(child, aged_files);
+      }
+      parent->dirs.erase(name.baseName());
+      maybeShrinkChildMap(parent->dirs);
+      ++fileFreeGen_;
+    }
+  }
+}
+
 void InMemoryView::ageOut(PerfSample& sample, std::chrono::seconds minAge) {
   uint32_t num_aged_files = 0;
-  uint32_t num_walked = 0;
   std::unordered_set<w_string> dirs_to_erase;
+  // Pointer identities of every file node this pass frees, so their
+  // change journal records can be dropped before the pointers can be
+  // reused.
+  std::unordered_set<const watchman_file*> aged_files;
 
   auto now = std::chrono::system_clock::now();
   lastAgeOutTimestamp_ = now;
   auto view = view_.wlock();
 
-  watchman_file* file = view->getLatestFile();
+  // Phase one: sweep the packed change journal for candidates.  The
+  // fields the filter needs -- observation timestamp and existence as
+  // of the record -- are mirrored into the journal records themselves,
+  // so the overwhelmingly common case of a live or recently changed
+  // file is rejected by a linear scan of a contiguous array without
+  // dereferencing any node.  Only plausible candidates are chased, to
+  // confirm the record is still the file's current one and to re-check
+  // against the node's (possibly re-marked) otime.  Nothing is freed
+  // during the sweep, so every file pointer in the journal is valid.
+  uint32_t num_walked = 0;
+  std::vector<watchman_file*> candidates;
+  auto sweep = [&](const std::vector<ViewDatabase::ChangeJournalEntry>&
+                       entries) {
+    num_walked += uint32_t(entries.size());
+    for (const auto& entry : entries) {
+      if (entry.exists ||
+          std::chrono::system_clock::from_time_t(entry.timestamp) + minAge >
+              now) {
+        // If this record is current the file cannot be aged; if it is
+        // superseded, the file's newer record decides instead.
+        continue;
+      }
+      auto* file = entry.file;
+      if (entry.seq != file->journal_seq) {
+        continue;
+      }
+      if (file->exists ||
+          std::chrono::system_clock::from_time_t(file->otime.timestamp) +
+                  minAge >
+              now) {
+        continue;
+      }
+      candidates.push_back(file);
+      aged_files.insert(file);
+    }
+  };
+  // The oldest (and so likeliest aged) records live in the sealed
+  // checkpoints; a file's current record is in exactly one place, so
+  // no candidate can be collected twice.
+  sweep(view->changeJournal());
+  for (const auto& cp : view->journalCheckpoints()) {
+    sweep(cp.entries);
+  }
+
+  // Phase two: unlink and free the candidates.  Each erase frees only
+  // that node, so the remaining candidate pointers stay valid.
+  for (auto* file : candidates) {
+    auto agedOtime = ageOutFile(dirs_to_erase, file);
+
+    // Revise tick for fresh instance reporting
+    lastAgeOutTick_ = std::max(lastAgeOutTick_, agedOtime.ticks);
+
+    num_aged_files++;
+  }
+
+  eraseAgedDirs(*view, dirs_to_erase, aged_files);
+
+  view->pruneChangeJournal(aged_files);
+
+  // A full sweep may have freed the node the incremental compactor
+  // planned to resume from.
+  compactCursor_ = nullptr;
+
+  if (num_aged_files + dirs_to_erase.size()) {
+    logf(ERR, "aged {} files, {} dirs\n", num_aged_files, dirs_to_erase.size());
+  }
+  sample.add_meta(
+      "age_out",
+      json_object(
+          {{"walked", json_integer(num_walked)},
+           {"files", json_integer(num_aged_files)},
+           {"dirs", json_integer(dirs_to_erase.size())}}));
+}
+
+void InMemoryView::compactSlice(Root& root) {
+  if (compactSliceSize_ == 0 || root.gc_interval.load().count() == 0) {
+    // Compaction follows the same policy switch as ageOut(): a root
+    // that never ages out must keep its deleted nodes so that since
+    // queries can continue to report them.
+    return;
+  }
+
+  uint32_t num_aged = 0;
+  std::unordered_set<w_string> dirs_to_erase;
+  std::unordered_set<const watchman_file*> aged_files;
+
+  auto now = std::chrono::system_clock::now();
+  auto view = view_.wlock();
+
+  // Resume where the previous slice left off; the recency-ordered
+  // list means a freshly changed node moves to the head, where the
+  // next wrap-around pass will reconsider it.
+  watchman_file* file = compactCursor_ ? compactCursor_ : view->getLatestFile();
   watchman_file* prior = nullptr;
-  while (file) {
-    ++num_walked;
+  size_t walked = 0;
+
+  while (file && walked < compactSliceSize_) {
+    ++walked;
     if (file->exists ||
-        std::chrono::system_clock::from_time_t(file->otime.timestamp) + minAge >
+        std::chrono::system_clock::from_time_t(file->otime.timestamp) +
+                root.gc_age.load() >
             now) {
       prior = file;
       file = file->next;
       continue;
     }
 
+    aged_files.insert(file);
     auto agedOtime = ageOutFile(dirs_to_erase, file);
-
-    // Revise tick for fresh instance reporting
     lastAgeOutTick_ = std::max(lastAgeOutTick_, agedOtime.ticks);
+    ++num_aged;
 
-    num_aged_files++;
-
-    // Go back to last good file node; we can't trust that the
-    // value of file->next saved before age_out_file is a valid
-    // file node as anything past that point may have also been
-    // aged out along with it.
+    // As in ageOut(): anything past the freed node may have been freed
+    // with it, so step back to the last node known good.  If that was
+    // the resume point itself we end the slice and restart from the
+    // head next time.
     file = prior;
   }
 
-  for (auto& name : dirs_to_erase) {
-    auto parent = view->resolveDir(name.dirName(), false);
-    if (parent) {
-      parent->dirs.erase(name.baseName());
+  if (!dirs_to_erase.empty()) {
+    eraseAgedDirs(*view, dirs_to_erase, aged_files);
+    view->pruneChangeJournal(aged_files);
+    // Erasing a subtree can free the node we were about to save as the
+    // resume point, so start over rather than chase a dangling pointer.
+    compactCursor_ = nullptr;
+  } else {
+    if (!aged_files.empty()) {
+      view->pruneChangeJournal(aged_files);
     }
+    compactCursor_ = file;
   }
 
-  if (num_aged_files + dirs_to_erase.size()) {
-    logf(ERR, "aged {} files, {} dirs\n", num_aged_files, dirs_to_erase.size());
+  compactSlices_.fetch_add(1, std::memory_order_relaxed);
+  if (num_aged + dirs_to_erase.size()) {
+    compactAgedFiles_.fetch_add(num_aged, std::memory_order_relaxed);
+    compactErasedDirs_.fetch_add(
+        dirs_to_erase.size(), std::memory_order_relaxed);
+    logf(
+        DBG,
+        "compactSlice: walked {} aged {} files, {} dirs\n",
+        walked,
+        num_aged,
+        dirs_to_erase.size());
+  }
+}
+
+namespace {
+// Bump when the snapshot layout changes; mismatched snapshots are ignored.
+constexpr json_int_t kViewSnapshotVersion = 1;
+} // namespace
+
+bool InMemoryView::saveViewSnapshot(const w_string& path) const {
+  std::vector<json_ref> files;
+
+  {
+    auto view = view_.rlock();
+    for (const watchman_file* f = view->getLatestFile(); f; f = f->next) {
+      const auto& st = f->stat;
+      files.push_back(json_array(
+          {w_string_to_json(f->parent->getFullPath()),
+           w_string_to_json(f->getName().asWString()),
+           json_boolean(f->exists),
+           json_integer(f->otime.ticks),
+           json_integer(f->otime.timestamp),
+           json_integer(f->ctime.ticks),
+           json_integer(f->ctime.timestamp),
+           json_integer(st.mode),
+           json_integer(st.size),
+           json_integer(st.uid),
+           json_integer(st.gid),
+           json_integer(st.ino),
+           json_integer(st.dev),
+           json_integer(st.nlink),
+           json_integer(st.atime.tv_sec),
+           json_integer(st.atime.tv_nsec),
+           json_integer(st.mtime.tv_sec),
+           json_integer(st.mtime.tv_nsec),
+           json_integer(st.ctime.tv_sec),
+           json_integer(st.ctime.tv_nsec)}));
+    }
+  }
+
+  // Carry the query-scope hints across the restart so the next cold
+  // start can crawl the subtrees somebody was actually querying first.
+  // Readers treat the key as optional, so older snapshots stay loadable
+  // without a version bump.
+  std::vector<json_ref> hints;
+  for (auto& hint : crawlHints_.copy()) {
+    hints.push_back(w_string_to_json(hint));
+  }
+
+  auto numFiles = files.size();
+  auto snapshot = json_object(
+      {{"version", json_integer(kViewSnapshotVersion)},
+       {"root", w_string_to_json(rootPath_)},
+       {"most_recent_tick",
+        json_integer(mostRecentTick_.load(std::memory_order_acquire))},
+       {"crawl_hints", json_array(std::move(hints))},
+       {"files", json_array(std::move(files))}});
+
+  auto file = w_stm_open(path.c_str(), O_WRONLY | O_TRUNC | O_CREAT, 0600);
+  if (!file) {
+    logf(
+        ERR,
+        "save_snapshot: unable to open {} for write: {}\n",
+        path,
+        folly::errnoStr(errno));
+    return false;
+  }
+
+  PduBuffer buffer;
+  auto res = buffer.pduEncodeToStream(
+      PduFormat{is_bser_v2, 0}, snapshot, file.get());
+  if (res.hasError()) {
+    logf(
+        ERR,
+        "save_snapshot: failed writing {}: {}\n",
+        path,
+        folly::errnoStr(res.error()));
+    return false;
+  }
+
+  logf(ERR, "wrote view snapshot of {} files to {}\n", numFiles, path);
+  return true;
+}
+
+bool InMemoryView::loadViewSnapshot(ViewDatabase& view, const w_string& path) {
+  auto file = w_stm_open(path.c_str(), O_RDONLY);
+  if (!file) {
+    // Never having written a snapshot is not noteworthy
+    return false;
+  }
+
+  json_error_t jerr;
+  PduBuffer buffer;
+  auto snapshot = buffer.decodeNext(file.get(), &jerr);
+  if (!snapshot) {
+    logf(ERR, "load_snapshot: failed to parse {}: {}\n", path, jerr.text);
+    return false;
+  }
+
+  try {
+    if (snapshot->get("version").asInt() != kViewSnapshotVersion ||
+        json_to_w_string(snapshot->get("root")) != rootPath_) {
+      logf(ERR, "load_snapshot: {} is for a different root or layout\n", path);
+      return false;
+    }
+
+    const auto& files = snapshot->get("files").array();
+
+    // The snapshot records the recency index newest-first; replaying it
+    // oldest-first through markFileChanged reproduces the same ordering.
+    // Batched so a multi-million-file replay pays one head splice
+    // rather than per-file fixups; nothing reads the view until the
+    // initial crawl that follows.
+    ViewDatabase::FileChangeBatch batch{view};
+    for (auto it = files.rbegin(); it != files.rend(); ++it) {
+      const auto& entry = it->array();
+
+      auto* dir = view.resolveDir(json_to_w_string(entry.at(0)), true);
+      auto name = json_to_w_string(entry.at(1));
+
+      ClockStamp ctime{
+          static_cast<ClockTicks>(entry.at(5).asInt()),
+          static_cast<time_t>(entry.at(6).asInt())};
+      auto* f = view.getOrCreateChildFile(dir, name, ctime);
+
+      f->exists = entry.at(2).asBool();
+
+      auto& st = f->stat;
+      st.mode = static_cast<mode_t>(entry.at(7).asInt());
+      st.size = static_cast<off_t>(entry.at(8).asInt());
+      st.uid = static_cast<uid_t>(entry.at(9).asInt());
+      st.gid = static_cast<gid_t>(entry.at(10).asInt());
+      st.ino = static_cast<ino_t>(entry.at(11).asInt());
+      st.dev = static_cast<dev_t>(entry.at(12).asInt());
+      st.nlink = static_cast<nlink_t>(entry.at(13).asInt());
+      st.atime.tv_sec = entry.at(14).asInt();
+      st.atime.tv_nsec = entry.at(15).asInt();
+      st.mtime.tv_sec = entry.at(16).asInt();
+      st.mtime.tv_nsec = entry.at(17).asInt();
+      st.ctime.tv_sec = entry.at(18).asInt();
+      st.ctime.tv_nsec = entry.at(19).asInt();
+
+      view.markFileChanged(
+          f,
+          ClockStamp{
+              static_cast<ClockTicks>(entry.at(3).asInt()),
+              static_cast<time_t>(entry.at(4).asInt())});
+    }
+
+    // Continue the tick sequence where the previous incarnation stopped
+    // so that the restored otimes remain meaningfully ordered against
+    // anything we observe from here on.
+    auto tick =
+        static_cast<ClockTicks>(snapshot->get("most_recent_tick").asInt());
+    if (tick > mostRecentTick_.load(std::memory_order_acquire)) {
+      mostRecentTick_.store(tick, std::memory_order_release);
+    }
+
+    // Optional key; replayed oldest-first through recordCrawlHint so
+    // both the most-recent-first ordering and the in-root validation
+    // are preserved.
+    if (auto hints = snapshot->get_optional("crawl_hints")) {
+      const auto& arr = hints->array();
+      for (auto it = arr.rbegin(); it != arr.rend(); ++it) {
+        recordCrawlHint(json_to_w_string(*it));
+      }
+    }
+
+    logf(ERR, "restored view of {} files from {}\n", files.size(), path);
+  } catch (const std::exception& exc) {
+    logf(ERR, "load_snapshot: malformed snapshot {}: {}\n", path, exc.what());
+    return false;
   }
-  sample.add_meta(
-      "age_out",
-      json_object(
-          {{"walked", json_integer(num_walked)},
-           {"files", json_integer(num_aged_files)},
-           {"dirs", json_integer(dirs_to_erase.size())}}));
+
+  return true;
 }
 
 void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
@@ -565,6 +1298,103 @@ void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
   auto view = view_.rlock();
   ctx->generationStarted();
 
+  // For clock-based since queries we can share a single walk of the
+  // changed-file prefix across the many subscriptions that fire with the
+  // same basis at a settle point.
+  if (auto* since_clock = std::get_if<QuerySince::Clock>(&ctx->since.since);
+      since_clock && !since_clock->is_fresh_instance) {
+    auto endTicks = mostRecentTick_.load(std::memory_order_acquire);
+
+    std::shared_ptr<const TimeGeneratorMemo> memo = *timeGenMemo_.rlock();
+    if (!memo || memo->sinceTicks != since_clock->ticks ||
+        memo->endTicks != endTicks || memo->freeGen != fileFreeGen_) {
+      auto fresh = std::make_shared<TimeGeneratorMemo>();
+      fresh->sinceTicks = since_clock->ticks;
+      fresh->endTicks = endTicks;
+      fresh->freeGen = fileFreeGen_;
+      // Scan the tail of the contiguous change journal rather than
+      // chasing the recency linked list over cold nodes.  Reverse
+      // iteration with superseded records skipped yields exactly the
+      // recency order of the list.  Old ticks live in sealed
+      // checkpoints, pre-deduped at seal time, which are merged in
+      // newest-first until one ends at or before the since tick.
+      // Clocks older than the checkpoint retention floor walk the
+      // recency list instead, which is complete for any since value.
+      const auto since = since_clock->ticks;
+      if (since >= view->journalCoverageFloor()) {
+        const auto& journal = view->changeJournal();
+        for (auto it = journal.rbegin();
+             it != journal.rend() && it->tick > since;
+             ++it) {
+          if (it->seq != it->file->journal_seq) {
+            // The file changed again later; its newer record was
+            // already visited.
+            continue;
+          }
+          fresh->files.push_back(it->file);
+        }
+        const auto& checkpoints = view->journalCheckpoints();
+        for (auto cp = checkpoints.rbegin();
+             cp != checkpoints.rend() && cp->toTick > since;
+             ++cp) {
+          for (auto it = cp->entries.rbegin();
+               it != cp->entries.rend() && it->tick > since;
+               ++it) {
+            if (it->seq != it->file->journal_seq) {
+              // Superseded by a later window or the live tail.
+              continue;
+            }
+            fresh->files.push_back(it->file);
+          }
+        }
+      } else {
+        for (watchman_file* f = view->getLatestFile();
+             f && f->otime.ticks > since;
+             f = f->next) {
+          fresh->files.push_back(f);
+        }
+      }
+      memo = fresh;
+      *timeGenMemo_.wlock() = std::move(fresh);
+    }
+
+    if (query->result_limit.has_value()) {
+      processTimeGeneratorPage(query, ctx, memo->files);
+      return;
+    }
+
+    for (watchman_file* f : memo->files) {
+      ctx->bumpNumWalked();
+      if (!ctx->fileMatchesRelativeRoot(f)) {
+        continue;
+      }
+      w_query_process_file(
+          query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
+    }
+    return;
+  }
+
+  if (query->result_limit.has_value()) {
+    // Paged timestamp-based query; collect the candidates so they can be
+    // emitted oldest-first
+    std::vector<watchman_file*> files;
+    for (watchman_file* f = view->getLatestFile(); f; f = f->next) {
+      if (auto* since_ts =
+              std::get_if<QuerySince::Timestamp>(&ctx->since.since);
+          since_ts && f->otime.timestamp <= since_ts->time) {
+        break;
+      }
+      if (auto* since_clock =
+              std::get_if<QuerySince::Clock>(&ctx->since.since);
+          since_clock && f->otime.ticks <= since_clock->ticks) {
+        break;
+      }
+      files.push_back(f);
+    }
+    processTimeGeneratorPage(query, ctx, files);
+    return;
+  }
+
   for (watchman_file* f = view->getLatestFile(); f; f = f->next) {
     ctx->bumpNumWalked();
     // Note that we use <= for the time comparisons in here so that we
@@ -586,7 +1416,43 @@ void InMemoryView::timeGenerator(const Query* query, QueryContext* ctx) const {
     }
 
     w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+        query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
+  }
+}
+
+void InMemoryView::processTimeGeneratorPage(
+    const Query* query,
+    QueryContext* ctx,
+    const std::vector<watchman_file*>& newestFirst) const {
+  // The clock cursor for a truncated page is only sound if the time
+  // generator is the sole producer of results; other generators emit
+  // files regardless of their ticks, so rewinding the clock would
+  // duplicate their output on every page.
+  const bool soleGenerator =
+      !query->paths.has_value() && !query->suffixes && !query->glob_tree;
+
+  // Emit oldest-first so that when the limit stops us, every file at or
+  // below the recorded tick has been evaluated; re-running the query
+  // since that tick picks up exactly the remainder. Several files can
+  // share a tick, so a page only ends on a tick boundary: stopping in
+  // the middle of a cohort would either lose or duplicate its remainder
+  // on the next page. The limit is therefore a target, not a hard cap.
+  for (auto it = newestFirst.rbegin(); it != newestFirst.rend(); ++it) {
+    watchman_file* f = *it;
+    if (ctx->limitReached() &&
+        (!soleGenerator || f->otime.ticks != ctx->lastTickGenerated)) {
+      ctx->hitResultLimit = true;
+      return;
+    }
+    ctx->bumpNumWalked();
+    if (soleGenerator) {
+      ctx->lastTickGenerated = f->otime.ticks;
+    }
+    if (!ctx->fileMatchesRelativeRoot(f)) {
+      continue;
+    }
+    w_query_process_file(
+        query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
   }
 }
 
@@ -641,7 +1507,7 @@ void InMemoryView::pathGenerator(const Query* query, QueryContext* ctx) const {
       if (f && (!f->exists || !f->stat.isDir())) {
         ctx->bumpNumWalked();
         w_query_process_file(
-            query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+            query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
         continue;
       }
     }
@@ -665,12 +1531,34 @@ void InMemoryView::dirGenerator(
     QueryContext* ctx,
     const watchman_dir* dir,
     uint32_t depth) const {
-  for (auto& it : dir->files) {
-    auto file = it.second.get();
-    ctx->bumpNumWalked();
+  // Overlapping path specs land on the same subtree more than once;
+  // consult the per-query memo so each directory is processed at most
+  // once.  A repeat visit that asks for more depth than the first one
+  // covered still descends, but skips the files it already emitted.
+  auto [memo, firstVisit] = ctx->pathGenVisited.emplace(dir, depth);
+  if (!firstVisit) {
+    if (memo->second >= depth) {
+      return;
+    }
+    memo->second = depth;
+  }
 
-    w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(file, caches_));
+  if (firstVisit) {
+    const bool skipDeleted = ctx->onlyReturnsExistingFiles();
+
+    for (auto& it : dir->files) {
+      auto file = it.second.get();
+      ctx->bumpNumWalked();
+
+      if (skipDeleted && !file->exists) {
+        // A fresh instance would drop this tombstone after materializing
+        // a FileResult for it; skip it here instead.
+        continue;
+      }
+
+      w_query_process_file(
+          query, ctx, makeFileResult(ctx->fileResultArena, file, caches_));
+    }
   }
 
   if (depth > 0) {
@@ -699,7 +1587,8 @@ void InMemoryView::globGeneratorDoublestar(
     const struct watchman_dir* dir,
     const GlobTree* node,
     const char* dir_name,
-    uint32_t dir_name_len) const {
+    uint32_t dir_name_len,
+    GlobCollect* collect) const {
   bool matched;
 
   // First step is to walk the set of files contained in this node
@@ -707,7 +1596,11 @@ void InMemoryView::globGeneratorDoublestar(
     auto file = it.second.get();
     auto file_name = file->getName();
 
-    ctx->bumpNumWalked();
+    if (collect) {
+      ++collect->numWalked;
+    } else {
+      ctx->bumpNumWalked();
+    }
 
     if (!file->exists) {
       // Globs can only match files that exist
@@ -734,10 +1627,15 @@ void InMemoryView::globGeneratorDoublestar(
               0) == WM_MATCH;
 
       if (matched) {
-        w_query_process_file(
-            ctx->query,
-            ctx,
-            std::make_unique<InMemoryFileResult>(file, caches_));
+        if (collect) {
+          collect->files.push_back(
+              makeFileResult(collect->arena, file, caches_));
+        } else {
+          w_query_process_file(
+              ctx->query,
+              ctx,
+              makeFileResult(ctx->fileResultArena, file, caches_));
+        }
         // No sense running multiple matches for this same file node
         // if this one succeeded.
         break;
@@ -756,48 +1654,49 @@ void InMemoryView::globGeneratorDoublestar(
 
     auto subject = make_path_name(
         dir_name, dir_name_len, child->name.data(), child->name.size());
-    globGeneratorDoublestar(ctx, child, node, subject.data(), subject.size());
+    globGeneratorDoublestar(
+        ctx, child, node, subject.data(), subject.size(), collect);
   }
 }
 
-/* Match each child of node against the children of dir */
-void InMemoryView::globGeneratorTree(
+/* Match one child of a pattern node against the children of dir */
+void InMemoryView::globGeneratorTreeChild(
     QueryContext* ctx,
-    const GlobTree* node,
-    const struct watchman_dir* dir) const {
-  if (!node->doublestar_children.empty()) {
-    globGeneratorDoublestar(ctx, dir, node, nullptr, 0);
-  }
-
-  for (const auto& child_node : node->children) {
-    w_assert(!child_node->is_doublestar, "should not get here with ** glob");
-
-    // If there are child dirs, consider them for recursion.
-    // Note that we don't restrict this to !leaf because the user may have
-    // set their globs list to something like ["some_dir", "some_dir/file"]
-    // and we don't want to preclude matching the latter.
-    if (!dir->dirs.empty()) {
-      // Attempt direct lookup if possible
-      if (!child_node->had_specials &&
-          ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
-        w_string_piece component(
-            child_node->pattern.data(), child_node->pattern.size());
-        const auto child_dir = dir->getChildDir(component);
-
-        if (child_dir) {
-          globGeneratorTree(ctx, child_node.get(), child_dir);
+    const GlobTree* child_node,
+    const struct watchman_dir* dir,
+    GlobCollect* collect) const {
+  w_assert(!child_node->is_doublestar, "should not get here with ** glob");
+
+  // If there are child dirs, consider them for recursion.
+  // Note that we don't restrict this to !leaf because the user may have
+  // set their globs list to something like ["some_dir", "some_dir/file"]
+  // and we don't want to preclude matching the latter.
+  if (!dir->dirs.empty()) {
+    // Attempt direct lookup if possible
+    if (!child_node->had_specials &&
+        ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
+      w_string_piece component(
+          child_node->pattern.data(), child_node->pattern.size());
+      const auto child_dir = dir->getChildDir(component);
+
+      if (child_dir) {
+        globGeneratorTree(ctx, child_node, child_dir, collect);
+      }
+    } else {
+      // Otherwise we have to walk and match
+      for (auto& it : dir->dirs) {
+        const auto child_dir = it.second.get();
+
+        if (!child_dir->last_check_existed) {
+          // Globs can only match files in dirs that exist
+          continue;
         }
-      } else {
-        // Otherwise we have to walk and match
-        for (auto& it : dir->dirs) {
-          const auto child_dir = it.second.get();
-
-          if (!child_dir->last_check_existed) {
-            // Globs can only match files in dirs that exist
-            continue;
-          }
 
-          if (wildmatch(
+        // Prefer the matcher compiled at parse time; wildmatch is the
+        // fallback for patterns it could not handle.
+        const bool matched = child_node->compiled
+            ? child_node->compiled->match(child_dir->name.view())
+            : wildmatch(
                   child_node->pattern.c_str(),
                   child_dir->name.c_str(),
                   ctx->query->glob_flags |
@@ -805,45 +1704,62 @@ void InMemoryView::globGeneratorTree(
                                CaseSensitivity::CaseSensitive
                            ? 0
                            : WM_CASEFOLD),
-                  0) == WM_MATCH) {
-            globGeneratorTree(ctx, child_node.get(), child_dir);
-          }
+                  0) == WM_MATCH;
+        if (matched) {
+          globGeneratorTree(ctx, child_node, child_dir, collect);
         }
       }
     }
+  }
 
-    // If the node is a leaf we are in a position to match files.
-    if (child_node->is_leaf && !dir->files.empty()) {
-      // Attempt direct lookup if possible
-      if (!child_node->had_specials &&
-          ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
-        w_string_piece component(
-            child_node->pattern.data(), child_node->pattern.size());
-        auto file = dir->getChildFile(component);
-
-        if (file) {
+  // If the node is a leaf we are in a position to match files.
+  if (child_node->is_leaf && !dir->files.empty()) {
+    // Attempt direct lookup if possible
+    if (!child_node->had_specials &&
+        ctx->query->case_sensitive == CaseSensitivity::CaseSensitive) {
+      w_string_piece component(
+          child_node->pattern.data(), child_node->pattern.size());
+      auto file = dir->getChildFile(component);
+
+      if (file) {
+        if (collect) {
+          ++collect->numWalked;
+        } else {
           ctx->bumpNumWalked();
-          if (file->exists) {
-            // Globs can only match files that exist
+        }
+        if (file->exists) {
+          // Globs can only match files that exist
+          if (collect) {
+            collect->files.push_back(
+                makeFileResult(collect->arena, file, caches_));
+          } else {
             w_query_process_file(
                 ctx->query,
                 ctx,
-                std::make_unique<InMemoryFileResult>(file, caches_));
+                makeFileResult(ctx->fileResultArena, file, caches_));
           }
         }
-      } else {
-        for (auto& it : dir->files) {
-          // Otherwise we have to walk and match
-          auto file = it.second.get();
-          auto file_name = file->getName();
+      }
+    } else {
+      for (auto& it : dir->files) {
+        // Otherwise we have to walk and match
+        auto file = it.second.get();
+        auto file_name = file->getName();
+        if (collect) {
+          ++collect->numWalked;
+        } else {
           ctx->bumpNumWalked();
+        }
 
-          if (!file->exists) {
-            // Globs can only match files that exist
-            continue;
-          }
+        if (!file->exists) {
+          // Globs can only match files that exist
+          continue;
+        }
 
-          if (wildmatch(
+        const bool matched = child_node->compiled
+            ? child_node->compiled->match(
+                  std::string_view{file_name.data(), file_name.size()})
+            : wildmatch(
                   child_node->pattern.c_str(),
                   file_name.data(),
                   ctx->query->glob_flags |
@@ -851,11 +1767,16 @@ void InMemoryView::globGeneratorTree(
                                CaseSensitivity::CaseSensitive
                            ? 0
                            : WM_CASEFOLD),
-                  0) == WM_MATCH) {
+                  0) == WM_MATCH;
+        if (matched) {
+          if (collect) {
+            collect->files.push_back(
+                makeFileResult(collect->arena, file, caches_));
+          } else {
             w_query_process_file(
                 ctx->query,
                 ctx,
-                std::make_unique<InMemoryFileResult>(file, caches_));
+                makeFileResult(ctx->fileResultArena, file, caches_));
           }
         }
       }
@@ -863,6 +1784,21 @@ void InMemoryView::globGeneratorTree(
   }
 }
 
+/* Match each child of node against the children of dir */
+void InMemoryView::globGeneratorTree(
+    QueryContext* ctx,
+    const GlobTree* node,
+    const struct watchman_dir* dir,
+    GlobCollect* collect) const {
+  if (!node->doublestar_children.empty()) {
+    globGeneratorDoublestar(ctx, dir, node, nullptr, 0, collect);
+  }
+
+  for (const auto& child_node : node->children) {
+    globGeneratorTreeChild(ctx, child_node.get(), dir, collect);
+  }
+}
+
 void InMemoryView::globGenerator(const Query* query, QueryContext* ctx) const {
   w_string relative_root;
 
@@ -881,7 +1817,102 @@ void InMemoryView::globGenerator(const Query* query, QueryContext* ctx) const {
         relative_root);
   }
 
-  globGeneratorTree(ctx, query->glob_tree.get(), dir);
+  const auto* tree = query->glob_tree.get();
+  const size_t numBranches =
+      tree->children.size() + (tree->doublestar_children.empty() ? 0 : 1);
+
+  if (numBranches > 1 && config_.getBool("enable_parallel_query", false)) {
+    // The top-level branches of the glob tree (eg: `src/**` vs
+    // `third_party/**`) walk independent portions of the view, so fan
+    // them out across the thread pool.  Each branch collects into a
+    // private buffer while we hold the view read lock on this thread,
+    // keeping the dir and file nodes stable; the buffers are then
+    // emitted in the order the serial walk would have produced them
+    // (doublestar walk first, then children in tree order), so output
+    // is identical.  Branches with overlapping matches can emit the
+    // same file more than once just like the serial walk; glob queries
+    // always run with dedup_results, which folds those away.
+    std::vector<GlobCollect> branches(numBranches);
+    std::atomic<size_t> pendingBranches{numBranches};
+    folly::Baton<> done;
+    std::atomic<bool> failed{false};
+    std::exception_ptr firstError;
+
+    size_t branchIndex = 0;
+    auto dispatch = [&](std::function<void(GlobCollect*)> walk) {
+      auto* out = &branches[branchIndex++];
+      auto task = [&, out, walk = std::move(walk)] {
+        try {
+          walk(out);
+        } catch (...) {
+          if (!failed.exchange(true, std::memory_order_acq_rel)) {
+            firstError = std::current_exception();
+          }
+        }
+        if (pendingBranches.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          done.post();
+        }
+      };
+      try {
+        getThreadPool().add(task);
+      } catch (const std::exception&) {
+        // Pool is saturated or stopped; walk this branch inline.
+        task();
+      }
+    };
+
+    if (!tree->doublestar_children.empty()) {
+      dispatch([&](GlobCollect* out) {
+        globGeneratorDoublestar(ctx, dir, tree, nullptr, 0, out);
+      });
+    }
+    for (const auto& child_node : tree->children) {
+      dispatch([&, node = child_node.get()](GlobCollect* out) {
+        globGeneratorTreeChild(ctx, node, dir, out);
+      });
+    }
+    done.wait();
+
+    if (firstError) {
+      std::rethrow_exception(firstError);
+    }
+
+    for (auto& branch : branches) {
+      ctx->bumpNumWalked(branch.numWalked);
+      for (auto& file : branch.files) {
+        w_query_process_file(query, ctx, std::move(file));
+      }
+    }
+    return;
+  }
+
+  globGeneratorTree(ctx, tree, dir);
+}
+
+void InMemoryView::suffixGenerator(const Query* query, QueryContext* ctx)
+    const {
+  auto view = view_.rlock();
+  ctx->generationStarted();
+
+  for (const auto& suffix : *query->suffixes) {
+    for (watchman_file* f = view->getSuffixHead(suffix); f;
+         f = f->suffix_next) {
+      ctx->bumpNumWalked();
+
+      if (!f->exists) {
+        // Match the semantics of the equivalent recursive glob: only
+        // files that currently exist are candidates.
+        continue;
+      }
+
+      if (!ctx->fileMatchesRelativeRoot(f)) {
+        continue;
+      }
+
+      w_query_process_file(
+          query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
+    }
+  }
 }
 
 void InMemoryView::allFilesGenerator(const Query* query, QueryContext* ctx)
@@ -890,14 +1921,44 @@ void InMemoryView::allFilesGenerator(const Query* query, QueryContext* ctx)
   auto view = view_.rlock();
   ctx->generationStarted();
 
+  // A fresh instance drops non-existing files anyway, so skip the
+  // tombstones here before allocating a FileResult for each.  After a
+  // big cleanup a large fraction of the file list can be deleted nodes
+  // awaiting age-out; the exists flag shares the cache line the walk
+  // already loads for the next pointer, so the skip costs one branch.
+  const bool skipDeleted = ctx->onlyReturnsExistingFiles();
+
+  if (query->expr && config_.getBool("enable_parallel_query", false)) {
+    // Collect the candidate set up front and let the query engine shard
+    // the expression evaluation across the thread pool. Matches are
+    // merged back in recency order, so output is identical to the
+    // serial walk below.
+    std::vector<std::unique_ptr<FileResult>> files;
+    for (f = view->getLatestFile(); f; f = f->next) {
+      ctx->bumpNumWalked();
+      if (skipDeleted && !f->exists) {
+        continue;
+      }
+      if (!ctx->fileMatchesRelativeRoot(f)) {
+        continue;
+      }
+      files.push_back(makeFileResult(ctx->fileResultArena, f, caches_));
+    }
+    w_query_process_file_parallel(query, ctx, files);
+    return;
+  }
+
   for (f = view->getLatestFile(); f; f = f->next) {
     ctx->bumpNumWalked();
+    if (skipDeleted && !f->exists) {
+      continue;
+    }
     if (!ctx->fileMatchesRelativeRoot(f)) {
       continue;
     }
 
     w_query_process_file(
-        query, ctx, std::make_unique<InMemoryFileResult>(f, caches_));
+        query, ctx, makeFileResult(ctx->fileResultArena, f, caches_));
   }
 }
 
@@ -923,13 +1984,89 @@ std::chrono::system_clock::time_point InMemoryView::getLastAgeOutTimeStamp()
   return lastAgeOutTimestamp_;
 }
 
+namespace {
+#ifdef __linux__
+/**
+ * Parses the root's pin_to_cpus config array into an affinity mask for
+ * the notify/IO thread pair.  Returns a human readable description of
+ * the placement for debug-status, or an empty string when no valid
+ * pinning is configured.
+ */
+w_string configuredCpuPlacement(const Configuration& config, cpu_set_t& set) {
+  auto cpus = config.get("pin_to_cpus");
+  if (!cpus) {
+    return w_string{};
+  }
+  if (!cpus->isArray()) {
+    logf(ERR, "pin_to_cpus must be an array of cpu indices; ignoring\n");
+    return w_string{};
+  }
+  CPU_ZERO(&set);
+  std::string desc;
+  for (auto& ele : cpus->array()) {
+    if (!ele.isInt() || ele.asInt() < 0 || ele.asInt() >= CPU_SETSIZE) {
+      logf(ERR, "pin_to_cpus entries must be valid cpu indices; ignoring\n");
+      return w_string{};
+    }
+    CPU_SET(int(ele.asInt()), &set);
+    if (!desc.empty()) {
+      desc += ",";
+    }
+    desc += std::to_string(ele.asInt());
+  }
+  if (desc.empty()) {
+    return w_string{};
+  }
+  desc = "pinned to cpus " + desc;
+  return w_string{desc.data(), desc.size()};
+}
+
+void applyCpuPlacement(const cpu_set_t& set, const w_string& rootPath) {
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    logf(
+        ERR,
+        "failed to apply pin_to_cpus for {}: {}\n",
+        rootPath,
+        folly::errnoStr(errno));
+  }
+}
+#endif
+} // namespace
+
 void InMemoryView::startThreads(const std::shared_ptr<Root>& root) {
   // Start a thread to call into the watcher API for filesystem notifications
   auto self = std::static_pointer_cast<InMemoryView>(shared_from_this());
   logf(DBG, "starting threads for {} {}\n", fmt::ptr(this), rootPath_);
-  std::thread notifyThreadInstance([self, root]() {
+
+#ifdef __linux__
+  // Keeping the notify/IO pair on one core complex keeps the view and
+  // pending structures resident on a single NUMA node.  No explicit
+  // memory policy is needed: the arena slabs and tree nodes are
+  // first-touched by these threads during crawling and event
+  // processing, so the kernel places them node-locally once the
+  // threads themselves are placed.
+  cpu_set_t pinnedCpus;
+  threadPlacement_ = configuredCpuPlacement(config_, pinnedCpus);
+  const bool pinThreads = !threadPlacement_.empty();
+  if (pinThreads) {
+    logf(ERR, "{}: threads {}\n", rootPath_, threadPlacement_);
+  }
+#endif
+
+  std::thread notifyThreadInstance([self, root
+#ifdef __linux__
+                                    ,
+                                    pinThreads,
+                                    pinnedCpus
+#endif
+  ]() {
     w_set_thread_name(
         "notify ", uintptr_t(self.get()), " ", self->rootPath_.view());
+#ifdef __linux__
+    if (pinThreads) {
+      applyCpuPlacement(pinnedCpus, self->rootPath_);
+    }
+#endif
     try {
       self->notifyThread(root);
     } catch (const std::exception& e) {
@@ -944,9 +2081,20 @@ void InMemoryView::startThreads(const std::shared_ptr<Root>& root) {
   pendingFromWatcher_.lockAndWait(std::chrono::milliseconds(-1) /* infinite */);
 
   // And now start the IO thread
-  std::thread ioThreadInstance([self, root]() {
+  std::thread ioThreadInstance([self, root
+#ifdef __linux__
+                                ,
+                                pinThreads,
+                                pinnedCpus
+#endif
+  ]() {
     w_set_thread_name(
         "io ", uintptr_t(self.get()), " ", self->rootPath_.view());
+#ifdef __linux__
+    if (pinThreads) {
+      applyCpuPlacement(pinnedCpus, self->rootPath_);
+    }
+#endif
     try {
       self->ioThread(root);
     } catch (const std::exception& e) {
@@ -969,6 +2117,168 @@ void InMemoryView::wakeThreads() {
   pendingFromWatcher_.lock()->ping();
 }
 
+bool InMemoryView::rescanSubtree(const w_string& path) {
+  // Queue the subtree as if the watcher had reported a recursive,
+  // desynced change on it; the io thread re-stats everything beneath it
+  // (via the parallel crawler when enabled) and only ticks entries whose
+  // stat data actually changed.
+  auto lock = pendingFromWatcher_.lock();
+  lock->add(
+      path,
+      std::chrono::system_clock::now(),
+      W_PENDING_VIA_NOTIFY | W_PENDING_RECURSIVE | W_PENDING_IS_DESYNCED);
+  lock->ping();
+  return true;
+}
+
+namespace {
+
+// True when `ancestor` is `path` itself or a path prefix of it ending
+// on a directory boundary.
+bool isAncestorOrSame(const w_string& ancestor, const w_string& path) {
+  return path.size() >= ancestor.size() &&
+      w_string_piece{path}.startsWith(ancestor) &&
+      (path.size() == ancestor.size() || path.data()[ancestor.size()] == '/');
+}
+
+} // namespace
+
+bool InMemoryView::isUnmaterializedDir(const w_string& path) const {
+  if (lazyDirs_.empty()) {
+    return false;
+  }
+  return unmaterializedDirs_.rlock()->count(path) != 0;
+}
+
+void InMemoryView::prepareForQuery(const Query& query) {
+  // Remember the scope for cold-start crawl prioritization, whether or
+  // not any lazy subtrees are configured.
+  if (query.relative_root) {
+    recordCrawlHint(*query.relative_root);
+  }
+
+  if (lazyDirs_.empty()) {
+    return;
+  }
+
+  // Full paths bounding what the query can touch.  Queries without a
+  // path scope (whole-root since/all-files queries) must observe
+  // everything, so their scope is the root itself.
+  std::vector<w_string> scopes;
+  const w_string& base = query.relative_root ? *query.relative_root : rootPath_;
+  if (query.paths) {
+    scopes.reserve(query.paths->size());
+    for (auto& path : *query.paths) {
+      scopes.push_back(w_string::pathCat({base, path.name}));
+    }
+  } else {
+    scopes.push_back(base);
+  }
+
+  std::vector<w_string> toMaterialize;
+  {
+    auto unmat = unmaterializedDirs_.wlock();
+    if (unmat->empty()) {
+      return;
+    }
+    for (auto it = unmat->begin(); it != unmat->end();) {
+      auto touches = [&](const w_string& scope) {
+        return isAncestorOrSame(scope, *it) || isAncestorOrSame(*it, scope);
+      };
+      if (std::any_of(scopes.begin(), scopes.end(), touches)) {
+        toMaterialize.push_back(*it);
+        it = unmat->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  if (toMaterialize.empty()) {
+    return;
+  }
+
+  // Queue the crawls; the io thread descends each subtree and the
+  // query's cookie sync completes behind that work.
+  auto lock = pendingFromWatcher_.lock();
+  for (auto& path : toMaterialize) {
+    log(ERR, rootPath_, ": materializing lazy subtree ", path, "\n");
+    lock->add(
+        path,
+        std::chrono::system_clock::now(),
+        W_PENDING_VIA_NOTIFY | W_PENDING_RECURSIVE);
+  }
+  lock->ping();
+}
+
+void InMemoryView::recordCrawlHint(const w_string& scope) {
+  if (scope == rootPath_ || !isAncestorOrSame(rootPath_, scope)) {
+    return;
+  }
+  auto hints = crawlHints_.wlock();
+  auto it = std::find(hints->begin(), hints->end(), scope);
+  if (it != hints->end()) {
+    // Refresh its position; recency is the eviction order.
+    hints->erase(it);
+  }
+  hints->insert(hints->begin(), scope);
+  if (hints->size() > kMaxCrawlHints) {
+    hints->resize(kMaxCrawlHints);
+  }
+}
+
+folly::SemiFuture<folly::Unit> InMemoryView::waitUntilReadyToQuery(
+    const w_string& scope) {
+  auto state = scopedReadiness_.wlock();
+  if (state->complete) {
+    return folly::makeSemiFuture();
+  }
+  for (auto& ready : state->readyScopes) {
+    if (isAncestorOrSame(ready, scope)) {
+      return folly::makeSemiFuture();
+    }
+  }
+  auto [p, f] = folly::makePromiseContract<folly::Unit>();
+  state->waiters.emplace_back(scope, std::move(p));
+  return std::move(f);
+}
+
+void InMemoryView::markSubtreeReady(const w_string& scope) {
+  std::vector<folly::Promise<folly::Unit>> toResolve;
+  {
+    auto state = scopedReadiness_.wlock();
+    state->readyScopes.push_back(scope);
+    auto it = state->waiters.begin();
+    while (it != state->waiters.end()) {
+      if (isAncestorOrSame(scope, it->first)) {
+        toResolve.push_back(std::move(it->second));
+        it = state->waiters.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  // Resolving a promise can run arbitrary code; do it outside the lock.
+  for (auto& p : toResolve) {
+    p.setValue();
+  }
+}
+
+void InMemoryView::finishScopedReadiness() {
+  std::vector<folly::Promise<folly::Unit>> toResolve;
+  {
+    auto state = scopedReadiness_.wlock();
+    state->complete = true;
+    state->readyScopes.clear();
+    for (auto& [_, p] : state->waiters) {
+      toResolve.push_back(std::move(p));
+    }
+    state->waiters.clear();
+  }
+  for (auto& p : toResolve) {
+    p.setValue();
+  }
+}
+
 folly::SemiFuture<folly::Unit> InMemoryView::waitForSettle(
     std::chrono::milliseconds settle_period) {
   auto [p, f] = folly::makePromiseContract<folly::Unit>();
@@ -997,6 +2307,36 @@ folly::SemiFuture<folly::Unit> InMemoryView::waitForSettle(
 CookieSync::SyncResult InMemoryView::syncToNow(
     const std::shared_ptr<Root>& root,
     std::chrono::milliseconds timeout) {
+  // Some watchers can vouch for a monotonic event position: everything
+  // that changed before this call is already queued behind it. For
+  // those, a barrier over the event queue replaces the cookie file and
+  // its two filesystem round trips. The barrier cannot substitute for a
+  // cookie while we are still (re)crawling, because a crawl discovers
+  // changes that never flowed through the event queue.
+  if ((watcher_->flags & WATCHER_PRECISELY_ORDERED) && root->inner.done_initial &&
+      !root->recrawlInfo.rlock()->shouldRecrawl) {
+    auto barrier = watcher_->syncBarrier();
+    if (barrier.valid()) {
+      try {
+        std::move(barrier).get(timeout);
+      } catch (folly::FutureTimeout&) {
+        auto why = fmt::format(
+            "syncToNow: timed out waiting for watcher sync barrier within {} milliseconds",
+            timeout.count());
+        log(ERR, why, "\n");
+        throw std::system_error(ETIMEDOUT, std::generic_category(), why);
+      }
+      if (!root->recrawlInfo.rlock()->shouldRecrawl) {
+        // No cookie files are involved on this path.
+        return CookieSync::SyncResult{};
+      }
+      // A recrawl was scheduled while the barrier was in flight (eg:
+      // the drain hit an IN_Q_OVERFLOW), so the queue alone no longer
+      // reflects the filesystem. Fall through to cookie sync, which
+      // waits out the recrawl.
+    }
+  }
+
   auto syncResult = syncToNowCookies(root, timeout);
 
   // Some watcher implementations (notably, FSEvents) reorder change events
@@ -1129,6 +2469,53 @@ bool InMemoryView::doAnyOfTheseFilesExist(
   return false;
 }
 
+void InMemoryView::noteChangedPath(const w_string& path) {
+  auto tick = mostRecentTick_.load(std::memory_order_acquire);
+  auto log = changedPaths_.wlock();
+  if (!log->entries.empty() && log->entries.back().tick == tick &&
+      log->entries.back().path == path) {
+    // Rescans commonly revisit the path that was just recorded;
+    // coalesce those rather than burning log capacity on them.
+    return;
+  }
+  log->entries.push_back({tick, path});
+  if (log->entries.size() > changedPathLogLimit_) {
+    // We can no longer answer authoritatively for bases that predate
+    // the entry we're about to forget.
+    log->completeSinceTick = log->entries.front().tick + 1;
+    log->entries.pop_front();
+  }
+}
+
+bool InMemoryView::subtreeMayHaveChangedSince(
+    const w_string& path,
+    ClockTicks sinceTick,
+    CaseSensitivity caseSensitive) const {
+  auto log = changedPaths_.rlock();
+  if (sinceTick + 1 < log->completeSinceTick) {
+    // The log has been truncated inside the window in question, so we
+    // cannot prove the subtree is unchanged.
+    return true;
+  }
+  w_string_piece scope{path};
+  for (auto it = log->entries.rbegin();
+       it != log->entries.rend() && it->tick > sinceTick;
+       ++it) {
+    w_string_piece changed{it->path};
+    if (changed.size() < scope.size() ||
+        (changed.size() > scope.size() && changed[scope.size()] != '/')) {
+      continue;
+    }
+    bool within = caseSensitive == CaseSensitivity::CaseSensitive
+        ? changed.startsWith(scope)
+        : changed.startsWithCaseInsensitive(scope);
+    if (within) {
+      return true;
+    }
+  }
+  return false;
+}
+
 const w_string& InMemoryView::getName() const {
   return watcher_->name;
 }
@@ -1141,6 +2528,8 @@ json_ref InMemoryView::getWatcherDebugInfo() const {
   return json_object({
       {"watcher", watcher_->getDebugInfo()},
       {"view", getViewDebugInfo()},
+      {"adaptive_settle_window_ms",
+       json_integer(coalesceWindowMs_.load(std::memory_order_relaxed))},
   });
 }
 
@@ -1149,17 +2538,54 @@ void InMemoryView::clearWatcherDebugInfo() {
   clearViewDebugInfo();
 }
 
+json_ref InMemoryView::debugRecentEvents() const {
+  if (!processedPaths_) {
+    return json_null();
+  }
+  auto entries = processedPaths_->readAll();
+  // Each thread's ring is in write order, but the rings themselves are
+  // concatenated arbitrarily; interleave them by timestamp.
+  std::stable_sort(
+      entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.now < b.now;
+      });
+  std::vector<json_ref> paths;
+  paths.reserve(entries.size());
+  for (auto& entry : entries) {
+    paths.push_back(entry.asJsonValue());
+  }
+  return json_array(std::move(paths));
+}
+
 json_ref InMemoryView::getViewDebugInfo() const {
-  auto processedPathsResult = json_null();
-  if (processedPaths_) {
-    std::vector<json_ref> paths;
-    for (auto& entry : processedPaths_->readAll()) {
-      paths.push_back(entry.asJsonValue());
+  auto processedPathsResult = debugRecentEvents();
+  size_t checkpointRecords = 0;
+  size_t checkpointCount = 0;
+  {
+    auto view = view_.rlock();
+    checkpointCount = view->journalCheckpoints().size();
+    for (auto& cp : view->journalCheckpoints()) {
+      checkpointRecords += cp.entries.size();
     }
-    processedPathsResult = json_array(std::move(paths));
   }
   return json_object({
       {"processed_paths", processedPathsResult},
+      {"change_journal_records",
+       json_integer(view_.rlock()->changeJournal().size())},
+      {"journal_checkpoints", json_integer(checkpointCount)},
+      {"journal_checkpoint_records", json_integer(checkpointRecords)},
+      {"cookie_fast_path_notifies",
+       json_integer(cookieFastPathNotifies_.load(std::memory_order_relaxed))},
+      {"governor_collapsed_items",
+       json_integer(governorCollapsedItems_.load(std::memory_order_relaxed))},
+      {"deferred_delete_dirs",
+       json_integer(view_.rlock()->deferredDeleteCount())},
+      {"compact_slices",
+       json_integer(compactSlices_.load(std::memory_order_relaxed))},
+      {"compact_aged_files",
+       json_integer(compactAgedFiles_.load(std::memory_order_relaxed))},
+      {"compact_erased_dirs",
+       json_integer(compactErasedDirs_.load(std::memory_order_relaxed))},
   });
 }
 
@@ -1176,16 +2602,18 @@ void InMemoryView::warmContentCache() {
 
   log(DBG, "considering files for content hash cache warming\n");
 
-  size_t n = 0;
+  std::vector<ContentHashCacheKey> keys;
   std::deque<folly::Future<std::shared_ptr<const ContentHashCache::Node>>>
       futures;
 
   {
     // Walk back in time until we hit the boundary, or hit the limit
-    // on the number of files we should warm up.
+    // on the number of files we should warm up.  Only collect the keys
+    // under the view lock; hashing is scheduled after we release it.
     auto view = view_.rlock();
     struct watchman_file* f;
-    for (f = view->getLatestFile(); f && n < maxFilesToWarmInContentCache_;
+    for (f = view->getLatestFile();
+         f && keys.size() < maxFilesToWarmInContentCache_;
          f = f->next) {
       if (f->otime.ticks <= lastWarmedTick_) {
         log(DBG,
@@ -1212,23 +2640,35 @@ void InMemoryView::warmContentCache() {
           // front of dir
           dir.advance(1);
         }
-        ContentHashCacheKey key{
+        keys.push_back(ContentHashCacheKey{
             w_string::pathCat({dir, f->getName()}),
             size_t(f->stat.size),
-            f->stat.mtime};
-
-        log(DBG, "warmContentCache: lookup ", key.relativePath, "\n");
-        auto f = caches_.contentHashCache.get(key);
-        if (syncContentCacheWarming_) {
-          futures.emplace_back(std::move(f));
-        }
-        ++n;
+            f->content_mtime});
       }
     }
 
     lastWarmedTick_ = mostRecentTick_;
   }
 
+  // Hash the small files first.  The ThreadPool drains this in order,
+  // so a few large files queued early can otherwise head-of-line block
+  // the many small ones that queries are most likely to want.
+  std::sort(
+      keys.begin(),
+      keys.end(),
+      [](const ContentHashCacheKey& a, const ContentHashCacheKey& b) {
+        return a.fileSize < b.fileSize;
+      });
+
+  size_t n = keys.size();
+  for (auto& key : keys) {
+    log(DBG, "warmContentCache: lookup ", key.relativePath, "\n");
+    auto f = caches_.contentHashCache.get(key);
+    if (syncContentCacheWarming_) {
+      futures.emplace_back(std::move(f));
+    }
+  }
+
   log(DBG,
       "warmContentCache, lastWarmedTick_ now ",
       lastWarmedTick_,
@@ -7,6 +7,8 @@
 
 #pragma once
 #include <folly/Synchronized.h>
+#include <array>
+#include <deque>
 #include <map>
 #include <memory>
 #include <unordered_map>
@@ -14,12 +16,14 @@
 #include <utility>
 #include "watchman/ContentHash.h"
 #include "watchman/CookieSync.h"
+#include "watchman/FileNodeArena.h"
 #include "watchman/PendingCollection.h"
 #include "watchman/PerfSample.h"
 #include "watchman/QueryableView.h"
 #include "watchman/Result.h"
 #include "watchman/RingBuffer.h"
 #include "watchman/SymlinkTargets.h"
+#include "watchman/TimerWheel.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/fs/DirHandle.h"
 #include "watchman/query/FileResult.h"
@@ -35,37 +39,77 @@ class RootConfig;
 struct GlobTree;
 class Watcher;
 
+// A rendered field-list fragment for one file, reusable while the
+// file's observed-change tick and the probe inputs are unchanged.
+// Shared across the subscriptions rendering the same field list
+// against the same root.
+struct RenderedFragment {
+  ClockTicks otimeTicks;
+  bool isNew;
+  size_t fieldListHash;
+  json_ref fragment;
+};
+
 // Helper struct to hold caches used by the InMemoryView
 struct InMemoryViewCaches {
   ContentHashCache contentHashCache;
   SymlinkTargetCache symlinkTargetCache;
+  LRUCache<w_string, RenderedFragment> renderCache;
 
   InMemoryViewCaches(
       const w_string& rootPath,
       size_t maxHashes,
       size_t maxSymlinks,
+      size_t maxRenderedFragments,
       std::chrono::milliseconds errorTTL);
 };
 
 class InMemoryFileResult final : public FileResult {
  public:
+  // These results are minted once per candidate file, which for a big
+  // query means millions of small heap allocations.  They are instead
+  // placed in the query's slab arena (QueryContext::fileResultArena):
+  // allocation is a bump within a contiguous page and release is a slab
+  // refcount drop.  No plain operator new is provided, so every
+  // creation site must name the arena.
+  static void* operator new(size_t size, FileNodeArena& arena) {
+    return arena.allocate(size);
+  }
+  static void operator delete(void* ptr) {
+    FileNodeArena::deallocate(ptr);
+  }
+  // Matching placement delete, used only if the constructor throws.
+  static void operator delete(void* ptr, FileNodeArena&) {
+    FileNodeArena::deallocate(ptr);
+  }
+
   InMemoryFileResult(const watchman_file* file, InMemoryViewCaches& caches);
   std::optional<FileInformation> stat() override;
+  std::optional<DType> dtype() override;
   std::optional<struct timespec> accessedTime() override;
   std::optional<struct timespec> modifiedTime() override;
   std::optional<struct timespec> changedTime() override;
   std::optional<size_t> size() override;
   w_string_piece baseName() override;
   w_string_piece dirName() override;
+  const watchman_dir* containingDir() override;
+  std::optional<uint32_t> suffixId() override;
   std::optional<bool> exists() override;
   std::optional<ResolvedSymlink> readLink() override;
   std::optional<ClockStamp> ctime() override;
   std::optional<ClockStamp> otime() override;
   std::optional<FileResult::ContentHash> getContentSha1() override;
+  std::optional<json_ref> getCachedRender(const RenderCacheProbe& probe)
+      override;
+  void cacheRender(const RenderCacheProbe& probe, const json_ref& rendered)
+      override;
   void batchFetchProperties(
       const std::vector<std::unique_ptr<FileResult>>& files) override;
 
  private:
+  // Full path to the file; keys entries in the render fragment cache.
+  w_string renderCacheKey();
+
   const watchman_file* file_;
   std::optional<w_string> dirName_;
   InMemoryViewCaches& caches_;
@@ -98,6 +142,15 @@ class ViewDatabase {
 
   const watchman_dir* resolveDir(const w_string& dirname) const;
 
+  /**
+   * Drops all entries from the resolveDir() path cache.  Must be called
+   * before erasing any watchman_dir node (see eraseAgedDirs), as the
+   * cache holds raw pointers into the tree.
+   */
+  void clearDirCache() {
+    dirCache_.fill(DirCacheEntry{});
+  }
+
   /**
    * Returns the direct child file named name if it already exists, else creates
    * that entry and returns it.
@@ -113,21 +166,306 @@ class ViewDatabase {
    */
   void markFileChanged(watchman_file* file, ClockStamp otime);
 
+  /**
+   * One newly discovered file destined for insertBatch(): the interned
+   * basename plus the stat data the crawler already obtained for it.
+   */
+  struct NewFileRecord {
+    w_string name;
+    FileInformation stat;
+  };
+
+  /**
+   * Bulk-inserts brand-new children of `dir` in one pass, all at one
+   * otime: reserves the child map once, creates and fully populates
+   * every node (existence, stat, dtype, suffix membership), appends the
+   * journal records, and links the whole set into the recency index
+   * with a single splice.  The lock-hold cost per crawled directory is
+   * one reservation plus straight-line work, instead of the per-file
+   * head fixups that repeated getOrCreateChildFile + markFileChanged
+   * pay -- the difference is pronounced for directories with hundreds
+   * of thousands of entries.
+   *
+   * The caller must guarantee that none of the names already exist in
+   * `dir`.  Created nodes are appended to `createdOut` in record order
+   * so the watcher can complete per-file registration afterwards.
+   */
+  void insertBatch(
+      watchman_dir* dir,
+      std::vector<NewFileRecord>& records,
+      ClockStamp otime,
+      std::vector<watchman_file*>& createdOut);
+
+  /**
+   * Batches recency-index updates.  While a batch is in scope,
+   * markFileChanged() links touched files into a detached chain and
+   * splices the whole chain onto the head of the index in one step at
+   * flush time, instead of paying the head fixups per file.  The
+   * resulting list order is identical to per-file marking; only the
+   * number of pointer writes differs, which matters when a checkout
+   * storm touches hundreds of thousands of files in one settle.
+   *
+   * Files on the detached chain are invisible to anything that walks
+   * the recency index directly, so the batch must be flushed before the
+   * view lock is released (see processAllPending's yield points) and
+   * before any in-scope reader walks the index (see
+   * flushActiveFileChangeBatch()).  Scopes must not nest.
+   */
+  class FileChangeBatch {
+   public:
+    explicit FileChangeBatch(ViewDatabase& view);
+    ~FileChangeBatch();
+    FileChangeBatch(const FileChangeBatch&) = delete;
+    FileChangeBatch& operator=(const FileChangeBatch&) = delete;
+
+    /**
+     * Splices the accumulated chain onto the recency index.  Idempotent;
+     * also performed by the destructor.
+     */
+    void flush();
+
+   private:
+    friend class ViewDatabase;
+
+    void markFileChanged(watchman_file* file, ClockStamp otime);
+
+    ViewDatabase& view_;
+    // Detached chain of files marked through this batch; first_ is the
+    // most recently marked (the head after splicing), last_ the oldest.
+    watchman_file* first_{nullptr};
+    watchman_file* last_{nullptr};
+  };
+
+  /**
+   * Flushes the active FileChangeBatch, if any, so that a subsequent
+   * walk of the recency index observes every file marked so far.
+   */
+  void flushActiveFileChangeBatch() {
+    if (activeBatch_) {
+      activeBatch_->flush();
+    }
+  }
+
   /**
    * Mark a directory as being removed from the view. Marks the contained set of
-   * files as deleted. If recursive is true, is recursively invoked on child
-   * dirs.
+   * files as deleted. If recursive is true, child dirs are queued as
+   * deferred-delete tombstones rather than being walked inline, so this
+   * runs in time proportional to the dir's own entries no matter how
+   * large the subtree is. The queued subtree is drained incrementally
+   * via processDeferredDeletes().
    */
   void markDirDeleted(watchman_dir* dir, ClockStamp otime, bool recursive);
 
+  /**
+   * Records that `dir` was just observed to exist on disk. Any
+   * deferred-delete tombstone queued before this call is thereby
+   * cancelled for this dir (but not for its children, whose own
+   * tombstones are queued with the dir's sequence).
+   */
+  void noteDirObserved(watchman_dir* dir);
+
+  /**
+   * Applies up to roughly `budget` file markings worth of queued
+   * deferred-delete work, marking files deleted at `otime`. Returns the
+   * number of tombstones still queued, so callers can keep slicing
+   * until it reaches zero.
+   */
+  size_t processDeferredDeletes(ClockStamp otime, size_t budget);
+
+  bool hasDeferredDeletes() const {
+    return !deferredDeletes_.empty();
+  }
+
+  /**
+   * Everything whose destruction is proportional to the size of the
+   * tree, detached from the view so it can be freed off-thread.  The
+   * member order matters: rootDir is destroyed first, because file
+   * nodes unlink themselves from the suffix index and the recency list
+   * as they go.
+   */
+  struct TeardownBundle {
+    watchman_file* latestFile{nullptr};
+    std::unordered_map<w_string, watchman_file*> suffixes;
+    std::unique_ptr<watchman_dir> rootDir;
+  };
+
+  /**
+   * Moves the dir/file tree, the suffix index, and the recency list
+   * head into a self-contained bundle and leaves this view empty.  The
+   * bundle's destruction performs the multi-million-node teardown that
+   * used to run inline in ~ViewDatabase; see ~InMemoryView, which ships
+   * it to the shared thread pool so watch-del and reap return without
+   * waiting for destructors.
+   */
+  std::unique_ptr<TeardownBundle> detachTeardown();
+
+  size_t deferredDeleteCount() const {
+    return deferredDeletes_.size();
+  }
+
+  /**
+   * Returns the head of the list of files whose lower-cased name suffix
+   * is `suffix`, or nullptr if no such file has ever been observed.
+   * Follow watchman_file::suffix_next for the remainder of the list.
+   */
+  watchman_file* getSuffixHead(const w_string& suffix) const {
+    auto it = suffixes_.find(suffix);
+    return it == suffixes_.end() ? nullptr : it->second;
+  }
+
+  /**
+   * One record in the clock-ordered change journal.  A record is current
+   * when its seq matches file->journal_seq; a file that changed again
+   * has a newer record further along and readers skip the stale one.
+   *
+   * timestamp and exists mirror the node's state as of this record so
+   * that the age-out sweep can reject the overwhelmingly common case --
+   * a live or recently changed file -- from the packed array alone,
+   * without dereferencing the node.
+   */
+  struct ChangeJournalEntry {
+    ClockTicks tick;
+    uint64_t seq;
+    watchman_file* file;
+    time_t timestamp;
+    bool exists;
+  };
+
+  /**
+   * Append-only journal of file changes, in tick order.  Scanning this
+   * contiguous array replaces chasing the recency linked list for
+   * clock-based since queries (tail only) and for age-out (full
+   * sweep).  Holds the hot tail only: cold halves are periodically
+   * sealed into journalCheckpoints(), so the tail plus the retained
+   * checkpoints are together complete for since values at or beyond
+   * journalCoverageFloor() (age-out separately prunes records for
+   * freed nodes; such old queries are forced to fresh instance anyway).
+   */
+  const std::vector<ChangeJournalEntry>& changeJournal() const {
+    return changeJournal_;
+  }
+
+  /**
+   * A sealed, compacted slice of the change journal covering ticks in
+   * (fromTick, toTick].  Entries superseded within the window were
+   * dropped at seal time; entries superseded by later windows (or the
+   * live tail) are skipped at read time via the usual seq check.
+   * Windows are consecutive and never divide an equal-tick cohort.
+   */
+  struct JournalCheckpoint {
+    ClockTicks fromTick;
+    ClockTicks toTick;
+    std::vector<ChangeJournalEntry> entries;
+  };
+
+  /**
+   * Retained checkpoints, oldest first.  Together with changeJournal()
+   * these answer clock-based since queries for any since value at or
+   * beyond journalCoverageFloor(): scan the tail, then merge checkpoint
+   * windows newest-first until one ends at or before the since tick.
+   */
+  const std::vector<JournalCheckpoint>& journalCheckpoints() const {
+    return journalCheckpoints_;
+  }
+
+  /**
+   * Oldest since tick the journal plus checkpoints are complete for.
+   * Older clocks (beyond the checkpoint retention cap) must fall back
+   * to walking the recency list.
+   */
+  ClockTicks journalCoverageFloor() const {
+    return checkpointFloorTick_;
+  }
+
+  /**
+   * Drops journal records referring to the given file nodes, which
+   * age-out is in the course of freeing.  Must be called in the same
+   * locked region as the age-out itself, before any new file nodes are
+   * allocated, so that pointer identity is unambiguous.
+   */
+  void pruneChangeJournal(const std::unordered_set<const watchman_file*>& files);
+
  private:
-  void insertAtHeadOfFileList(struct watchman_file* file);
+  /**
+   * A subtree scheduled for delete marking by a recursive
+   * markDirDeleted. The path is resolved when the tombstone is
+   * processed; `seq` is the journal sequence at queue time and gates
+   * both dir re-observation (watchman_dir::last_observed_seq) and
+   * per-file recreation (watchman_file::journal_seq) races.
+   */
+  struct DeferredDirDelete {
+    w_string path;
+    uint64_t seq;
+  };
+
+  /**
+   * Assigns the next journal sequence to `file` and appends its record,
+   * running the compaction and checkpoint-seal triggers.  The list-move
+   * half of a mark lives in markFileChanged / FileChangeBatch.
+   */
+  void appendChangeJournal(watchman_file* file, ClockStamp otime);
+
+  /**
+   * Refreshes the mirror fields of the file's current journal record
+   * when a same-tick re-mark carries new state (eg: a delete observed
+   * within the tick), so the age-out sweep stays honest without an
+   * equal-tick duplicate record.
+   */
+  void refreshChangeJournalTail(watchman_file* file, ClockStamp otime);
+
+  void maybeCompactChangeJournal();
+  void maybeSealJournalCheckpoint();
+
+  // Direct-mapped cache of recently resolved dir paths, consulted by the
+  // mutable resolveDir() before walking the tree one component at a
+  // time.  Event batches exhibit extreme parent locality (thousands of
+  // files in the same few dirs during a build), so a small table
+  // absorbs nearly all of the walks during storms.  Marking a dir
+  // deleted keeps its node alive, so cached pointers only go stale when
+  // a node is actually freed; clearDirCache() handles that.  The const
+  // resolveDir() runs under shared locks and must not touch this.
+  struct DirCacheEntry {
+    w_string path;
+    watchman_dir* dir{nullptr};
+  };
+  static constexpr size_t kDirCacheSize = 256;
+  std::array<DirCacheEntry, kDirCacheSize> dirCache_;
 
   const w_string rootPath_;
 
+  // Backing storage for watchman_file nodes. Slabs self-free once their
+  // last node is released, so destruction order relative to rootDir_ is
+  // not significant.
+  FileNodeArena fileArena_;
+
   /* the most recently changed file */
   watchman_file* latestFile_ = nullptr;
 
+  /* maps lower-cased suffix -> head of the list of files sharing that
+   * suffix, so suffix-limited queries only touch matching files.
+   * Files join their list in getOrCreateChildFile and unlink in their
+   * destructor; existence is tracked by the nodes themselves. */
+  std::unordered_map<w_string, watchman_file*> suffixes_;
+
+  // See changeJournal().  Superseded records accumulate as files change
+  // repeatedly; maybeCompactChangeJournal() rewrites the journal once
+  // they dominate.
+  std::vector<ChangeJournalEntry> changeJournal_;
+  uint64_t journalSeq_{0};
+  size_t journalLiveAtLastCompaction_{0};
+
+  // See journalCheckpoints().  Bounded by dropping the oldest window
+  // and raising checkpointFloorTick_ to its toTick.
+  std::vector<JournalCheckpoint> journalCheckpoints_;
+  ClockTicks checkpointFloorTick_{0};
+
+  // Subtrees awaiting deferred delete marking, in queue order.
+  std::deque<DeferredDirDelete> deferredDeletes_;
+
+  // The in-scope FileChangeBatch, through which markFileChanged routes
+  // while set; see the class comment for the flush obligations.
+  FileChangeBatch* activeBatch_{nullptr};
+
   std::unique_ptr<watchman_dir> rootDir_;
 
   // Inode number for the root dir.  This is used to detect what should
@@ -184,12 +522,19 @@ class InMemoryView final : public QueryableView {
   bool doAnyOfTheseFilesExist(
       const std::vector<w_string>& fileNames) const override;
 
+  bool subtreeMayHaveChangedSince(
+      const w_string& path,
+      ClockTicks sinceTick,
+      CaseSensitivity caseSensitive) const override;
+
   void timeGenerator(const Query* query, QueryContext* ctx) const override;
 
   void pathGenerator(const Query* query, QueryContext* ctx) const override;
 
   void globGenerator(const Query* query, QueryContext* ctx) const override;
 
+  void suffixGenerator(const Query* query, QueryContext* ctx) const override;
+
   void allFilesGenerator(const Query* query, QueryContext* ctx) const override;
 
   /**
@@ -202,9 +547,38 @@ class InMemoryView final : public QueryableView {
    */
   folly::SemiFuture<folly::Unit> waitUntilReadyToQuery() override;
 
+  /**
+   * Scoped readiness for the cold-start crawl: resolves once the crawl
+   * has fully covered `scope`, either because a hint phase finished it
+   * early (see fullCrawl) or because the whole initial crawl is done.
+   * After the initial crawl this always resolves immediately, including
+   * during recrawls -- the view is populated and queries interleave
+   * with recrawl batches instead of gating on readiness.
+   */
+  folly::SemiFuture<folly::Unit> waitUntilReadyToQuery(
+      const w_string& scope) override;
+
   void startThreads(const std::shared_ptr<Root>& root) override;
   void stopThreads() override;
   void wakeThreads() override;
+  bool rescanSubtree(const w_string& path) override;
+  void prepareForQuery(const Query& query) override;
+
+  /**
+   * Returns true when `path` names a configured lazy subtree that no
+   * query has touched yet; the crawlers consult this to defer crawling
+   * (and watching) it.  Public because the parallel crawl's filesystem
+   * shim lives outside the class.  See prepareForQuery().
+   */
+  bool isUnmaterializedDir(const w_string& path) const;
+
+  w_string threadPlacement() const override {
+    return threadPlacement_;
+  }
+
+  std::optional<PendingSpillStats> pendingSpillStats() override {
+    return pendingFromWatcher_.lock()->getSpillStats();
+  }
   void clientModeCrawl(const std::shared_ptr<Root>& root);
 
   const w_string& getName() const override;
@@ -214,6 +588,10 @@ class InMemoryView final : public QueryableView {
   json_ref getViewDebugInfo() const;
   void clearViewDebugInfo();
 
+  // Merges the per-thread processed-path rings into one array ordered
+  // by timestamp; backs the debug-recent-events command.
+  json_ref debugRecentEvents() const;
+
   // If content cache warming is configured, do the warm up now
   void warmContentCache();
 
@@ -231,28 +609,79 @@ class InMemoryView final : public QueryableView {
       std::unordered_set<w_string>& dirs_to_erase,
       watchman_file* file);
 
+  // Erases the dirs collected by ageOutFile(), accumulating any file
+  // nodes freed along with their subtrees into aged_files.
+  void eraseAgedDirs(
+      ViewDatabase& view,
+      const std::unordered_set<w_string>& dirs_to_erase,
+      std::unordered_set<const watchman_file*>& aged_files);
+
+  /**
+   * Incremental idle-time compaction.  Run from the settle path, it
+   * sweeps a bounded slice of the recency-ordered file list per call,
+   * removing deleted nodes under the same age policy as ageOut() and
+   * shrinking the child maps they leave behind, so dead-node overhead
+   * stays flat between full sweeps.  Progress counters are surfaced
+   * via getViewDebugInfo().
+   */
+  void compactSlice(Root& root);
+
   // When a watcher is desynced, it sets the W_PENDING_IS_DESYNCED flag, and the
   // crawler will set these recursively. If one of these flag is set,
   // processPending will return IsDesynced::Yes and it is expected that the
   // caller will abort all pending cookies after processAllPending returns.
   enum class IsDesynced { Yes, No };
 
+  /**
+   * Emits a page of time generator candidates, oldest first, for a query
+   * with result_limit set. `newestFirst` holds the candidate files in
+   * recency order; generation stops at the first tick boundary at or
+   * beyond the limit and records the resume point in the context.
+   */
+  void processTimeGeneratorPage(
+      const Query* query,
+      QueryContext* ctx,
+      const std::vector<watchman_file*>& newestFirst) const;
+
   /** Recursively walks files under a specified dir */
   void dirGenerator(
       const Query* query,
       QueryContext* ctx,
       const watchman_dir* dir,
       uint32_t depth) const;
+  /** Per-branch buffer used when independent glob tree branches are
+   * walked on the thread pool.  When a walk is handed one of these it
+   * appends candidates and counts walked files locally instead of
+   * emitting into the (single threaded) QueryContext; the query thread
+   * merges the buffers back in serial walk order. */
+  struct GlobCollect {
+    std::vector<std::unique_ptr<FileResult>> files;
+    int64_t numWalked{0};
+    // Slab arena for this branch's results.  Arena allocation is
+    // single-threaded, so each branch bumps its own pages rather than
+    // contending for the context's arena; the slabs free themselves
+    // once the last result they hold is released.
+    FileNodeArena arena;
+  };
   void globGeneratorTree(
       QueryContext* ctx,
       const GlobTree* node,
-      const struct watchman_dir* dir) const;
+      const struct watchman_dir* dir,
+      GlobCollect* collect = nullptr) const;
+  /** Walks one child branch of `node` against `dir`; the per-branch
+   * unit of work for the parallel glob walk. */
+  void globGeneratorTreeChild(
+      QueryContext* ctx,
+      const GlobTree* child_node,
+      const struct watchman_dir* dir,
+      GlobCollect* collect) const;
   void globGeneratorDoublestar(
       QueryContext* ctx,
       const struct watchman_dir* dir,
       const GlobTree* node,
       const char* dir_name,
-      uint32_t dir_name_len) const;
+      uint32_t dir_name_len,
+      GlobCollect* collect = nullptr) const;
 
   void notifyThread(const std::shared_ptr<Root>& root);
 
@@ -263,9 +692,14 @@ class InMemoryView final : public QueryableView {
   // Consume entries from `pending` and apply them to the InMemoryView. Any new
   // pending paths generated by processPath will be crawled before
   // processAllPending returns.
+  //
+  // Takes the caller's view lock holder so that a huge batch can yield
+  // the write lock on a latency budget (io_latency_budget_ms) and let
+  // queries interleave; the lock is held again when this returns.  The
+  // initial crawl never yields.
   IsDesynced processAllPending(
       const std::shared_ptr<Root>& root,
-      ViewDatabase& view,
+      folly::Synchronized<ViewDatabase>::LockedPtr& view,
       PendingChanges& pending);
 
   void processPath(
@@ -276,6 +710,32 @@ class InMemoryView final : public QueryableView {
       const FileInformation* pre_stat,
       std::vector<w_string>& pendingCookies);
 
+  /**
+   * Called on the IO thread for each pending path that is about to be
+   * applied to the view; records it in changedPaths_ at the current
+   * tick for subtreeMayHaveChangedSince().
+   */
+  void noteChangedPath(const w_string& path);
+
+  /**
+   * Called for a desynced recursive rescan request before committing to
+   * the full re-examination of the subtree. Stats a sample of
+   * directories ranked by recent-change likelihood (drawn from the
+   * recency index) and compares them against the view. Localized
+   * discrepancies are queued as targeted recursive crawls in `coll`;
+   * widespread discrepancies mean the sample cannot be trusted to have
+   * found everything, so the caller should fall through to the full
+   * crawl. Returns true when the verification handled the request.
+   *
+   * Sized by the `desync_sample_size` config key; 0 disables sampling
+   * entirely.
+   */
+  bool verifyDesyncedSubtree(
+      const std::shared_ptr<Root>& root,
+      ViewDatabase& view,
+      PendingChanges& coll,
+      const PendingChange& pending);
+
   /**
    * Crawl the given directory. Any cookies discovered during the crawl are
    * appended to pendingCookies.
@@ -318,6 +778,26 @@ class InMemoryView final : public QueryableView {
       const PendingChange& pending,
       const FileInformation* pre_stat);
 
+  /**
+   * Applies a paired directory rename in memory: grafts the subtree the
+   * view holds at `from` onto `to` -- copying each node's stat data and
+   * journaling it as changed at `otime`, exactly as a crawl of the
+   * destination would -- then tombstones the old paths via
+   * markDirDeleted.  No filesystem access is performed; the watcher
+   * vouched that `to` is the same tree that was at `from`.
+   *
+   * Returns false (leaving the view untouched) when the view has no
+   * live directory at `from`; the caller falls back to an ordinary
+   * recursive crawl of the destination.
+   */
+  bool renameDirSubtree(
+      ViewDatabase& view,
+      PendingChanges& coll,
+      const w_string& from,
+      const w_string& to,
+      std::chrono::system_clock::time_point now,
+      ClockStamp otime);
+
   // END IOTHREAD
 
  public:
@@ -340,6 +820,26 @@ class InMemoryView final : public QueryableView {
 
     // When the iothread last processed a pending event from the Watcher.
     std::optional<std::chrono::steady_clock::time_point> lastUnsettle;
+
+    // Idle housekeeping backoff: doubles per settled pass from
+    // trigger_settle up to biggestTimeout.  The deadline itself is
+    // parked on the shared TimerWheel (idleTimer pings us when it is
+    // due) while the thread waits with no timeout of its own, so many
+    // idle roots cost one coalesced wheel wakeup instead of one timed
+    // wait apiece.
+    std::chrono::milliseconds idleBackoff{0};
+    TimerWheel::Handle idleTimer;
+
+    // Adaptive coalescing state (the "settle_adaptive" config knob):
+    // a smoothed count of items stolen per wakeup, and the extra batch
+    // window currently applied before processing a storm of events.
+    double smoothedBatchSize{0.0};
+    std::chrono::milliseconds coalesceWindow{0};
+
+    // When the last pre-settle speculation hint was published, so that
+    // a storm costs at most one speculative evaluation per settle
+    // period.
+    std::chrono::steady_clock::time_point lastSpeculativeHint{};
   };
 
   // Returns a reference to the ViewDatabase without synchronizing on the mutex.
@@ -365,10 +865,48 @@ class InMemoryView final : public QueryableView {
       PendingCollection& pendingFromWatcher,
       PendingChanges& localPending);
 
+  /**
+   * Persisted view snapshot support, gated by the "view_snapshot_path"
+   * config key. The snapshot captures the file nodes, their cached stat
+   * data and the recency index so that a restarted daemon can seed its
+   * view and let the initial crawl act as a reconciliation pass instead
+   * of rebuilding every record from scratch.
+   */
+  bool loadViewSnapshot(ViewDatabase& view, const w_string& path);
+  bool saveViewSnapshot(const w_string& path) const;
+
+  /**
+   * Remember that a query was scoped to `scope` so the next cold start
+   * can crawl that subtree first.  No-op for the root itself; a
+   * whole-root query teaches us nothing about prioritization.
+   */
+  void recordCrawlHint(const w_string& scope);
+
+  /**
+   * Declare `scope` fully crawled and wake any scoped readiness waiters
+   * it covers.  Called by fullCrawl between hint phases.
+   */
+  void markSubtreeReady(const w_string& scope);
+
+  /**
+   * Declare the whole view ready: resolves every remaining scoped
+   * waiter and makes future scoped waits immediate.  Called once the
+   * initial crawl (or a recrawl) completes.
+   */
+  void finishScopedReadiness();
+
   // Performs settle-time actions.
   // Returns whether the root was reaped and the IO thread should terminate.
   Continue doSettleThings(Root& root, IoThreadState& state);
 
+  // Updates the adaptive coalescing window from the observed arrival
+  // rate and, during storms, keeps absorbing events until the window
+  // closes so that one processAllPending pass covers the whole burst.
+  void coalescePendingEvents(
+      const std::shared_ptr<Root>& root,
+      IoThreadState& state,
+      PendingCollection& pendingFromWatcher);
+
   FileSystem& fileSystem_;
   const Configuration config_;
 
@@ -378,11 +916,68 @@ class InMemoryView final : public QueryableView {
   std::atomic<ClockTicks> mostRecentTick_{1};
   const ClockRoot rootNumber_{0};
   const w_string rootPath_;
+  // Full path to <root>/.watchmanconfig; processPath compares pending
+  // paths against this to trigger Root::reloadConfigFile().
+  const w_string configFilePath_;
+
+  /**
+   * Subtrees configured for lazy materialization via the `lazy_dirs`
+   * config option (full paths).  They are recorded in the dir tree as
+   * the crawl passes over their parents, but are not descended into --
+   * and not watched -- until a query whose scope intersects them runs;
+   * prepareForQuery() then queues a recursive crawl of the subtree and
+   * removes it from unmaterializedDirs_, which starts as a copy of
+   * lazyDirs_ and only ever shrinks.  Like ignore_dirs, the set is
+   * fixed at watch time.
+   */
+  const std::vector<w_string> lazyDirs_;
+  folly::Synchronized<std::unordered_set<w_string>> unmaterializedDirs_;
+
+  /**
+   * Subtree scopes of recent queries (full paths, most recent first),
+   * recorded by prepareForQuery and persisted in the view snapshot.
+   * The next cold start crawls these before the rest of the tree so
+   * that scoped queries -- the IDE pattern -- become answerable long
+   * before the whole crawl finishes.  Bounded; purely a prioritization
+   * hint, so losing entries is harmless.
+   */
+  static constexpr size_t kMaxCrawlHints = 8;
+  folly::Synchronized<std::vector<w_string>> crawlHints_;
+
+  /**
+   * Cold-start readiness state backing the scoped
+   * waitUntilReadyToQuery overload.  readyScopes are the hint subtrees
+   * the initial crawl has completed so far; waiters are parked until a
+   * covering scope is marked ready or the crawl finishes.  Once
+   * `complete` is set (at the end of the initial crawl) scoped waits
+   * resolve immediately forever after.
+   */
+  struct ScopedReadiness {
+    bool complete{false};
+    std::vector<w_string> readyScopes;
+    std::vector<std::pair<w_string, folly::Promise<folly::Unit>>> waiters;
+  };
+  folly::Synchronized<ScopedReadiness> scopedReadiness_;
 
   ClockTicks lastAgeOutTick_{0};
   // This is system_clock instead of steady_clock because it's compared with a
   // file's otime.
   std::chrono::system_clock::time_point lastAgeOutTimestamp_{};
+  // Bumped (under the view write lock) every time file nodes are freed
+  // by age-out or compaction.  Guards the timeGenerator memo, which
+  // holds raw watchman_file pointers.  lastAgeOutTick_ cannot serve as
+  // that guard: it advances with std::max, so a pass that frees only
+  // files with older otime ticks leaves it unchanged.
+  uint64_t fileFreeGen_{0};
+
+  // Resume point for compactSlice().  Only touched while holding the
+  // view_ write lock, and reset whenever a full ageOut() or a dir
+  // erase may have freed the node it refers to.
+  watchman_file* compactCursor_{nullptr};
+  // Lifetime compaction progress, surfaced via getViewDebugInfo().
+  std::atomic<uint64_t> compactSlices_{0};
+  std::atomic<uint64_t> compactAgedFiles_{0};
+  std::atomic<uint64_t> compactErasedDirs_{0};
 
   using PendingSettles =
       std::multimap<std::chrono::milliseconds, folly::Promise<folly::Unit>>;
@@ -403,9 +998,56 @@ class InMemoryView final : public QueryableView {
    */
   PendingCollection pendingFromWatcher_;
 
+  /**
+   * True only when the IO thread has applied every pending item it ever
+   * stole and no deferred delete marking remains -- the state in which
+   * it is about to block waiting for new work.  Cleared while holding
+   * the pendingFromWatcher_ lock whenever items are stolen, and on
+   * recrawl, so a reader holding that lock who observes an empty
+   * collection plus this flag knows the view reflects everything the
+   * watcher has delivered.  The notify thread uses this to complete
+   * sync cookies directly when the pipeline is verifiably idle.
+   */
+  std::atomic<bool> ioThreadCaughtUp_{false};
+  // Cookies completed via the notify-thread fast path; surfaced in the
+  // view debug info.
+  std::atomic<uint64_t> cookieFastPathNotifies_{0};
+  // Items collapsed to directory markers by the ingestion governor
+  // (the "event_rate_limit" config knob); surfaced in the view debug
+  // info.
+  std::atomic<uint64_t> governorCollapsedItems_{0};
+
   std::atomic<bool> stopThreads_{false};
   std::shared_ptr<Watcher> watcher_;
 
+  /**
+   * Bounded log of recently changed paths, appended to by the IO
+   * thread as it processes pending items.  Scoped subscriptions
+   * consult it (via subtreeMayHaveChangedSince) so that a settle which
+   * only touched subtrees disjoint from their relative_root skips
+   * query evaluation entirely.  Entries are in tick order; once the
+   * cap evicts an entry the log only answers authoritatively for
+   * bases at or after completeSinceTick and older bases are treated as
+   * "may have changed".
+   */
+  struct ChangedPathLog {
+    struct Entry {
+      ClockTicks tick;
+      w_string path;
+    };
+    std::deque<Entry> entries;
+    ClockTicks completeSinceTick{0};
+  };
+  mutable folly::Synchronized<ChangedPathLog> changedPaths_;
+  // Maximum number of entries retained in changedPaths_
+  const size_t changedPathLogLimit_;
+  // How many file nodes one compactSlice() call may visit; 0 disables
+  // idle-time compaction.
+  const size_t compactSliceSize_;
+  // Description of the pin_to_cpus placement applied to the notify/IO
+  // threads; empty when none.  Written once in startThreads().
+  w_string threadPlacement_;
+
   // mutable because we pass a reference to other things from inside
   // const methods
   mutable InMemoryViewCaches caches_;
@@ -420,6 +1062,18 @@ class InMemoryView final : public QueryableView {
   // Remember what we've already warmed up
   uint32_t lastWarmedTick_{0};
 
+  // Should the IO thread widen its batch window under event storms?
+  bool adaptiveSettle_{false};
+  // Publish a pre-settle hint after draining a batch so subscriptions
+  // can pre-render their payloads while the settle clock runs (the
+  // "settle_speculation" config knob).
+  bool settleSpeculation_{true};
+  // Upper bound on the adaptive coalescing window
+  std::chrono::milliseconds adaptiveSettleMax_{500};
+  // The coalescing window currently in effect, exported by
+  // getWatcherDebugInfo
+  std::atomic<int64_t> coalesceWindowMs_{0};
+
   struct PendingChangeLogEntry {
     PendingChangeLogEntry() noexcept {
       // time_point is not noexcept so this can't be defaulted.
@@ -448,8 +1102,34 @@ class InMemoryView final : public QueryableView {
 
   static_assert(88 == sizeof(PendingChangeLogEntry));
 
-  // If set, paths processed by processPending are logged here.
-  std::unique_ptr<RingBuffer<PendingChangeLogEntry>> processedPaths_;
+  /**
+   * Memo of the most recent clock-based timeGenerator walk.
+   *
+   * When a root settles, every subscription on it re-walks the same
+   * changed-file prefix of the recency index from the same since tick.
+   * The first walk at a given (since, end) tick pair records the file
+   * nodes it visited; subsequent walks with the same basis reuse the
+   * list instead of chasing the linked list again.
+   *
+   * Validity: consumers hold the view rlock while iterating, so nodes
+   * cannot be aged out under them. A memo is only used when both its end
+   * tick matches mostRecentTick_ (any change invalidates it) and its
+   * free generation matches fileFreeGen_ (so it never resurrects freed
+   * nodes).
+   */
+  struct TimeGeneratorMemo {
+    ClockTicks sinceTicks;
+    ClockTicks endTicks;
+    uint64_t freeGen;
+    std::vector<watchman_file*> files;
+  };
+  mutable folly::Synchronized<std::shared_ptr<const TimeGeneratorMemo>>
+      timeGenMemo_;
+
+  // Paths processed by processPending are logged here; on by default
+  // (per-thread rings are cheap enough to leave enabled) and sized by
+  // in_memory_view_ring_log_size, which also turns it off when 0.
+  std::unique_ptr<PerThreadRingLog<PendingChangeLogEntry>> processedPaths_;
 
   // Track statPath() count during fullCrawl(). Used to report progress.
   std::shared_ptr<std::atomic<size_t>> fullCrawlStatCount_;
@@ -13,6 +13,7 @@
 #include <deque>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include "watchman/WatchmanConfig.h"
 
 namespace watchman {
@@ -563,6 +564,21 @@ class LRUCache {
     return CacheStats(state->stats, state->map.size());
   }
 
+  // Invokes func(key, value) for each successfully loaded entry, in
+  // least-to-most recently used order.  Entries with lookups still in
+  // flight and negatively cached errors are skipped.  Intended for
+  // snapshotting cache contents, e.g. to persist them across restarts;
+  // the lock is held for the duration, so func must be cheap and must
+  // not re-enter the cache.
+  template <typename Func>
+  void forEachCached(Func&& func) const {
+    auto state = state_.rlock();
+    for (const NodeType* node = state->evictionOrder.first_; node;
+         node = node->next_) {
+      func(node->key_, node->value());
+    }
+  }
+
   // Purge all of the entries from the cache
   void clear() {
     auto state = state_.wlock();
@@ -659,4 +675,122 @@ class LRUCache {
   const std::chrono::milliseconds fetchTimeout_;
   folly::Synchronized<State> state_;
 };
+
+/**
+ * ShardedLRUCache divides the key space across a number of independent
+ * LRUCache segments selected by key hash.  Each segment has its own
+ * lock, so concurrent lookups for different keys proceed in parallel
+ * rather than convoying on the single InternalState lock that LRUCache
+ * uses.
+ *
+ * The per-key semantics of get/set/erase are exactly those of LRUCache.
+ * Only the eviction scope differs: the overall capacity is divided
+ * evenly between the segments and each applies LRU eviction to its own
+ * portion, which approximates global LRU well when the hash spreads
+ * keys uniformly.
+ */
+template <typename KeyType, typename ValueType>
+class ShardedLRUCache {
+ public:
+  using NodeType = typename LRUCache<KeyType, ValueType>::NodeType;
+
+  // Construct a cache with numShards segments that together hold at
+  // least maxItems entries, using the specified negative caching TTL.
+  ShardedLRUCache(
+      size_t numShards,
+      size_t maxItems,
+      std::chrono::milliseconds errorTTL,
+      std::chrono::milliseconds fetchTimeout = std::chrono::seconds(300)) {
+    // Round the per-segment capacity up so that the total is never
+    // less than the requested maxItems.
+    auto perShard = (maxItems + numShards - 1) / numShards;
+    shards_.reserve(numShards);
+    for (size_t i = 0; i < numShards; ++i) {
+      shards_.push_back(std::make_unique<LRUCache<KeyType, ValueType>>(
+          perShard, errorTTL, fetchTimeout));
+    }
+  }
+
+  // No moving or copying
+  ShardedLRUCache(const ShardedLRUCache&) = delete;
+  ShardedLRUCache& operator=(const ShardedLRUCache&) = delete;
+  ShardedLRUCache(ShardedLRUCache&&) = delete;
+  ShardedLRUCache& operator=(ShardedLRUCache&&) = delete;
+
+  // Lookup key and return the result; see LRUCache::get().
+  std::shared_ptr<const NodeType> get(
+      const KeyType& key,
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now()) {
+    return shardFor(key).get(key, now);
+  }
+
+  // Lookup key using a getter function; see the LRUCache getter
+  // flavored get() for the full semantics, including the thundering
+  // herd protection, which applies per segment and therefore per key.
+  template <typename Func>
+  folly::Future<std::shared_ptr<const NodeType>> get(
+      const KeyType& key,
+      Func&& getter,
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now()) {
+    return shardFor(key).get(key, std::forward<Func>(getter), now);
+  }
+
+  // Explicitly set the value for a key; see LRUCache::set().
+  std::shared_ptr<const NodeType> set(
+      const KeyType& key,
+      ValueType&& value,
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now()) {
+    return shardFor(key).set(key, std::move(value), now);
+  }
+
+  // Erase the entry associated with key; see LRUCache::erase().
+  std::shared_ptr<const NodeType> erase(const KeyType& key) {
+    return shardFor(key).erase(key);
+  }
+
+  // Returns the total number of cached items across all segments
+  size_t size() const {
+    size_t total = 0;
+    for (auto& shard : shards_) {
+      total += shard->size();
+    }
+    return total;
+  }
+
+  // Returns cache statistics aggregated across all segments
+  CacheStats stats() const {
+    lrucache::Stats total;
+    size_t size = 0;
+    for (auto& shard : shards_) {
+      auto s = shard->stats();
+      total.cacheHit += s.cacheHit;
+      total.cacheShare += s.cacheShare;
+      total.cacheMiss += s.cacheMiss;
+      total.cacheEvict += s.cacheEvict;
+      total.cacheStore += s.cacheStore;
+      total.cacheLoad += s.cacheLoad;
+      total.cacheErase += s.cacheErase;
+      total.clearCount += s.clearCount;
+      size += s.size;
+    }
+    return CacheStats(total, size);
+  }
+
+  // Purge all of the entries from the cache
+  void clear() {
+    for (auto& shard : shards_) {
+      shard->clear();
+    }
+  }
+
+ private:
+  LRUCache<KeyType, ValueType>& shardFor(const KeyType& key) {
+    return *shards_[std::hash<KeyType>{}(key) % shards_.size()];
+  }
+
+  std::vector<std::unique_ptr<LRUCache<KeyType, ValueType>>> shards_;
+};
 } // namespace watchman
@@ -96,10 +96,68 @@ LogLevel logLabelToLevel(const w_string& label) {
   return getLevelMaps().labelToLevel.at(label);
 }
 
+// A stuck `watchman log-level` client must not pin every log payload
+// published during an event storm; laggards lose the oldest entries.
+static constexpr size_t kMaxRetainedLogItems = 4096;
+
 Log::Log()
-    : errorPub_(std::make_shared<Publisher>()),
-      debugPub_(std::make_shared<Publisher>()) {
+    : errorPub_(std::make_shared<Publisher>(kMaxRetainedLogItems)),
+      debugPub_(std::make_shared<Publisher>(kMaxRetainedLogItems)) {
   setStdErrLoggingLevel(ERR);
+  stderrDrainer_ = std::thread([this] { stdErrDrainLoop(); });
+}
+
+Log::~Log() {
+  {
+    std::lock_guard<std::mutex> lock(drainMutex_);
+    shuttingDown_ = true;
+  }
+  drainCond_.notify_one();
+  if (stderrDrainer_.joinable()) {
+    stderrDrainer_.join();
+  }
+  // Flush anything published after the drainer observed shutdown
+  doLogToStdErr();
+}
+
+void Log::wakeStdErrDrainer() {
+  {
+    std::lock_guard<std::mutex> lock(drainMutex_);
+    drainPending_ = true;
+  }
+  drainCond_.notify_one();
+}
+
+void Log::stdErrDrainLoop() {
+  w_set_thread_name("logdrain");
+  std::unique_lock<std::mutex> lock(drainMutex_);
+  while (true) {
+    drainCond_.wait(lock, [this] { return drainPending_ || shuttingDown_; });
+    if (drainPending_) {
+      drainPending_ = false;
+      lock.unlock();
+      doLogToStdErr();
+      lock.lock();
+    }
+    if (shuttingDown_ && !drainPending_) {
+      return;
+    }
+  }
+}
+
+void Log::handleFatal(LogLevel level) {
+  // This drains and terminates if it observes the fatal item we just
+  // published...
+  doLogToStdErr();
+  // ... but the drainer thread may have raced us and consumed it, in
+  // which case it is in the middle of terminating the process; make
+  // sure this thread does not return to the caller regardless.
+  log_stack_trace();
+  if (level == ABORT) {
+    abort();
+  } else {
+    _exit(1);
+  }
 }
 
 Log& getLog() {
@@ -125,7 +183,26 @@ char* Log::timeString(char* buf, size_t bufsize, timeval tv) {
 char* Log::currentTimeString(char* buf, size_t bufsize) {
   struct timeval tv;
   gettimeofday(&tv, NULL);
-  return timeString(buf, bufsize, tv);
+
+  // strftime/localtime_r are surprisingly expensive (the latter takes a
+  // process-wide timezone lock) and timestamps only change at second
+  // granularity, so cache the formatted prefix per thread and just
+  // refresh the milliseconds.
+  static thread_local time_t lastSec{0};
+  static thread_local char lastPrefix[64]{};
+  if (tv.tv_sec != lastSec || lastPrefix[0] == '\0') {
+    struct tm tm;
+#ifdef _WIN32
+    time_t seconds = (time_t)tv.tv_sec;
+    tm = *localtime(&seconds);
+#else
+    localtime_r(&tv.tv_sec, &tm);
+#endif
+    strftime(lastPrefix, sizeof(lastPrefix), "%Y-%m-%dT%H:%M:%S", &tm);
+    lastSec = tv.tv_sec;
+  }
+  snprintf(buf, bufsize, "%s,%03d", lastPrefix, (int)tv.tv_usec / 1000);
+  return buf;
 }
 
 namespace {
@@ -161,7 +238,7 @@ const char* Log::getThreadName() {
 }
 
 void Log::setStdErrLoggingLevel(LogLevel level) {
-  auto notify = [this]() { doLogToStdErr(); };
+  auto notify = [this]() { wakeStdErrDrainer(); };
   auto subs = subscribers_.lock();
   auto& debugSub = subs->debugSub_;
   auto& errorSub = subs->errorSub_;
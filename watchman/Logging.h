@@ -10,6 +10,10 @@
 #include <fmt/ranges.h>
 #include <folly/Synchronized.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include "watchman/PubSub.h"
 #include "watchman/watchman_preprocessor.h"
 #include "watchman/watchman_string.h"
@@ -60,6 +64,9 @@ class Log {
          {"level", typed_string_to_json(logLevelToLabel(level))}});
 
     pub.enqueue(std::move(payload));
+    if (level <= FATAL) {
+      handleFatal(level);
+    }
   }
 
   // Format a string and log it
@@ -88,9 +95,13 @@ class Log {
          {"level", typed_string_to_json(logLevelToLabel(level))}});
 
     pub.enqueue(std::move(payload));
+    if (level <= FATAL) {
+      handleFatal(level);
+    }
   }
 
   Log();
+  ~Log();
 
  private:
   std::shared_ptr<Publisher> errorPub_;
@@ -109,11 +120,27 @@ class Log {
   //    writing to stderr.
   folly::Synchronized<Subscribers, std::mutex> subscribers_;
 
+  // The stderr drain.  Publishing a log item only records it and pings
+  // this thread; the blocking write(2) to stderr happens here rather
+  // than on the logging (often notify/io) thread, so enabling verbose
+  // logging doesn't perturb the event pipeline being observed.
+  std::mutex drainMutex_;
+  std::condition_variable drainCond_;
+  bool drainPending_{false};
+  bool shuttingDown_{false};
+  std::thread stderrDrainer_;
+
   inline Publisher& levelToPub(LogLevel level) {
     return level == DBG ? *debugPub_ : *errorPub_;
   }
 
   void doLogToStdErr();
+  void wakeStdErrDrainer();
+  void stdErrDrainLoop();
+
+  // Fatal logs must still terminate the process synchronously on the
+  // calling thread; drains pending output first.
+  [[noreturn]] void handleFatal(LogLevel level);
 };
 
 // Get the logger singleton
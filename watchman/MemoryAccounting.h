@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace watchman {
+
+/**
+ * Coarse allocation attribution for the daemon's main memory consumers,
+ * surfaced by the `debug-memory` command.
+ *
+ * A full heap profile (`debug-prof-dump`) answers "what call stack
+ * allocated this?" but requires jemalloc profiling and an offline dump
+ * cycle.  This module answers the cheaper, always-on question "which
+ * subsystem owns the bytes?": when RSS grows we want to know at a glance
+ * whether it is the view (file node slabs), the pending queue, query
+ * churn, or client PDU buffers, without taking a dump.
+ *
+ * Attribution happens two ways:
+ *
+ *  - Owners whose subsystem is fixed (FileNodeArena slabs, PduBuffer,
+ *    watchman_pending_fs nodes) record directly against their bucket.
+ *
+ *  - json values are tagged at construction with the thread's current
+ *    MemoryScope and release against that same tag, so shared json
+ *    machinery charges whichever subsystem was running when the value
+ *    was built.  Values built outside any scope land in the Untagged
+ *    bucket.
+ *
+ * Counters are monotonic and relaxed; live figures are the difference of
+ * the alloc and free counters.  Callers that want allocation rates diff
+ * two successive `debug-memory` responses.
+ */
+enum class MemorySubsystem : uint8_t {
+  Untagged = 0,
+  View,
+  Pending,
+  Query,
+  Pdu,
+};
+
+constexpr size_t kMemorySubsystemCount = 5;
+
+inline const char* memorySubsystemName(MemorySubsystem subsystem) {
+  switch (subsystem) {
+    case MemorySubsystem::Untagged:
+      return "untagged";
+    case MemorySubsystem::View:
+      return "view";
+    case MemorySubsystem::Pending:
+      return "pending";
+    case MemorySubsystem::Query:
+      return "query";
+    case MemorySubsystem::Pdu:
+      return "pdu";
+  }
+  return "unknown";
+}
+
+namespace detail {
+
+struct MemoryCounters {
+  std::atomic<uint64_t> allocCount{0};
+  std::atomic<uint64_t> allocBytes{0};
+  std::atomic<uint64_t> freeCount{0};
+  std::atomic<uint64_t> freeBytes{0};
+};
+
+inline MemoryCounters memoryCounters[kMemorySubsystemCount];
+
+inline thread_local MemorySubsystem currentMemoryScope =
+    MemorySubsystem::Untagged;
+
+} // namespace detail
+
+/**
+ * The subsystem new json values on this thread are attributed to.
+ */
+inline MemorySubsystem currentMemorySubsystem() {
+  return detail::currentMemoryScope;
+}
+
+inline void recordMemoryAlloc(MemorySubsystem subsystem, size_t bytes) {
+  auto& c = detail::memoryCounters[static_cast<size_t>(subsystem)];
+  c.allocCount.fetch_add(1, std::memory_order_relaxed);
+  c.allocBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void recordMemoryFree(MemorySubsystem subsystem, size_t bytes) {
+  auto& c = detail::memoryCounters[static_cast<size_t>(subsystem)];
+  c.freeCount.fetch_add(1, std::memory_order_relaxed);
+  c.freeBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * RAII guard that sets the calling thread's attribution scope for the
+ * duration of a block; nests by restoring the prior scope on exit.
+ */
+class MemoryScope {
+ public:
+  explicit MemoryScope(MemorySubsystem subsystem)
+      : prev_{detail::currentMemoryScope} {
+    detail::currentMemoryScope = subsystem;
+  }
+
+  ~MemoryScope() {
+    detail::currentMemoryScope = prev_;
+  }
+
+  MemoryScope(const MemoryScope&) = delete;
+  MemoryScope& operator=(const MemoryScope&) = delete;
+
+ private:
+  MemorySubsystem prev_;
+};
+
+/**
+ * Snapshot of one subsystem's counters.  liveBytes/liveItems are derived
+ * from the monotonic counters and may transiently read slightly stale
+ * under concurrent churn; they converge when the subsystem quiesces.
+ */
+struct MemorySubsystemCounters {
+  uint64_t liveBytes;
+  uint64_t liveItems;
+  uint64_t allocCount;
+  uint64_t allocBytes;
+  uint64_t freeCount;
+  uint64_t freeBytes;
+};
+
+inline MemorySubsystemCounters readMemoryCounters(MemorySubsystem subsystem) {
+  auto& c = detail::memoryCounters[static_cast<size_t>(subsystem)];
+  MemorySubsystemCounters out;
+  out.allocCount = c.allocCount.load(std::memory_order_relaxed);
+  out.allocBytes = c.allocBytes.load(std::memory_order_relaxed);
+  out.freeCount = c.freeCount.load(std::memory_order_relaxed);
+  out.freeBytes = c.freeBytes.load(std::memory_order_relaxed);
+  out.liveBytes = out.allocBytes - out.freeBytes;
+  out.liveItems = out.allocCount - out.freeCount;
+  return out;
+}
+
+} // namespace watchman
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/MemoryBudget.h"
+
+#include <algorithm>
+
+#include "watchman/Errors.h"
+#include "watchman/MemoryAccounting.h"
+#include "watchman/WatchmanConfig.h"
+
+namespace watchman {
+
+namespace {
+
+// How often a queued query re-checks the live counters while waiting
+// for memory to drain; also bounds how stale a wakeup can be when no
+// query completion notifies the queue.
+constexpr std::chrono::milliseconds kAdmissionPollInterval{50};
+
+} // namespace
+
+MemoryBudget::MemoryBudget(
+    uint64_t budgetBytes,
+    std::chrono::milliseconds admissionTimeout)
+    : budgetBytes_{budgetBytes}, admissionTimeout_{admissionTimeout} {}
+
+MemoryBudget& MemoryBudget::get() {
+  // Meyers singleton; the config is loaded before the listener accepts
+  // any command that could execute a query.
+  static MemoryBudget instance{
+      uint64_t(cfg_get_int("memory_budget_mb", 0)) * 1024 * 1024,
+      std::chrono::milliseconds(
+          cfg_get_int("memory_budget_admission_timeout_ms", 5000))};
+  return instance;
+}
+
+uint64_t MemoryBudget::trackedLiveBytes() {
+  uint64_t total = 0;
+  for (size_t i = 0; i < kMemorySubsystemCount; ++i) {
+    auto counters = readMemoryCounters(static_cast<MemorySubsystem>(i));
+    // The monotonic counters are relaxed, so a reader racing a heavy
+    // free burst can transiently observe freeBytes ahead of allocBytes;
+    // treat that as zero rather than as a wrapped huge value.
+    if (counters.freeBytes < counters.allocBytes) {
+      total += counters.allocBytes - counters.freeBytes;
+    }
+  }
+  return total;
+}
+
+void MemoryBudget::admit() {
+  if (budgetBytes_ == 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock{mutex_};
+  if (trackedLiveBytes() < budgetBytes_ || running_ == 0) {
+    ++running_;
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  deferred_.fetch_add(1, std::memory_order_relaxed);
+  const auto deadline = std::chrono::steady_clock::now() + admissionTimeout_;
+  while (true) {
+    if (trackedLiveBytes() < budgetBytes_ || running_ == 0) {
+      ++running_;
+      admitted_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      QueryExecError::throwf(
+          "query was not admitted within {}ms: the daemon is over its "
+          "memory budget ({} tracked bytes, budget {})",
+          admissionTimeout_.count(),
+          trackedLiveBytes(),
+          budgetBytes_);
+    }
+    // Woken either by a query completing or by the poll interval, so a
+    // publisher backlog draining (which completes no query) still lets
+    // queued work through.
+    cv_.wait_for(
+        lock,
+        std::min(
+            kAdmissionPollInterval,
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - now)));
+  }
+}
+
+void MemoryBudget::release() {
+  if (budgetBytes_ == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    --running_;
+  }
+  cv_.notify_all();
+}
+
+MemoryBudget::Status MemoryBudget::status() const {
+  Status out;
+  out.budgetBytes = budgetBytes_;
+  out.liveBytes = trackedLiveBytes();
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    out.running = running_;
+  }
+  out.admitted = admitted_.load(std::memory_order_relaxed);
+  out.deferred = deferred_.load(std::memory_order_relaxed);
+  out.rejected = rejected_.load(std::memory_order_relaxed);
+  return out;
+}
+
+MemoryBudgetDebugStatus MemoryBudgetDebugStatus::get() {
+  auto status = MemoryBudget::get().status();
+  MemoryBudgetDebugStatus out;
+  out.budget_bytes = int64_t(status.budgetBytes);
+  out.live_bytes = int64_t(status.liveBytes);
+  out.queries_running = int64_t(status.running);
+  out.queries_admitted = int64_t(status.admitted);
+  out.queries_deferred = int64_t(status.deferred);
+  out.queries_rejected = int64_t(status.rejected);
+  return out;
+}
+
+} // namespace watchman
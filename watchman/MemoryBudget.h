@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "watchman/Serde.h"
+
+namespace watchman {
+
+/**
+ * Global memory governor for query admission.
+ *
+ * The tracked live bytes from MemoryAccounting (view slabs, pending
+ * queue, query render buffers, client PDU buffers) are compared against
+ * a configured budget before each query executes.  When the daemon is
+ * over budget, new queries queue behind the ones already running rather
+ * than piling more result sets on top of an already swollen heap; a
+ * query that cannot be admitted within the admission timeout is
+ * rejected with a QueryExecError.  One query is always allowed to run
+ * so an over-budget daemon degrades to serialized queries instead of
+ * refusing service entirely.
+ *
+ * Configured by the global `memory_budget_mb` key (0, the default,
+ * disables the governor) and `memory_budget_admission_timeout_ms`.
+ */
+class MemoryBudget {
+ public:
+  MemoryBudget(uint64_t budgetBytes, std::chrono::milliseconds admissionTimeout);
+
+  /** Process-wide instance; budget read from the global config on
+   * first use. */
+  static MemoryBudget& get();
+
+  /** Sum of live bytes across all tracked subsystems. */
+  static uint64_t trackedLiveBytes();
+
+  /**
+   * Admits one query, blocking while the daemon is over budget and
+   * other queries are running.  Throws QueryExecError if the admission
+   * timeout elapses first.  A disabled budget admits immediately.
+   */
+  void admit();
+
+  /** Releases one admitted query and wakes any queued ones. */
+  void release();
+
+  uint64_t budgetBytes() const {
+    return budgetBytes_;
+  }
+
+  struct Status {
+    uint64_t budgetBytes;
+    uint64_t liveBytes;
+    uint64_t running;
+    uint64_t admitted;
+    uint64_t deferred;
+    uint64_t rejected;
+  };
+  Status status() const;
+
+ private:
+  const uint64_t budgetBytes_;
+  const std::chrono::milliseconds admissionTimeout_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  uint64_t running_{0};
+
+  std::atomic<uint64_t> admitted_{0};
+  std::atomic<uint64_t> deferred_{0};
+  std::atomic<uint64_t> rejected_{0};
+};
+
+/** RAII admission token held for the duration of one query execution. */
+class QueryMemoryAdmission {
+ public:
+  QueryMemoryAdmission() {
+    MemoryBudget::get().admit();
+  }
+  ~QueryMemoryAdmission() {
+    MemoryBudget::get().release();
+  }
+
+  QueryMemoryAdmission(const QueryMemoryAdmission&) = delete;
+  QueryMemoryAdmission& operator=(const QueryMemoryAdmission&) = delete;
+};
+
+/** Memory governor section of the `debug-status` response. */
+struct MemoryBudgetDebugStatus : serde::Object {
+  int64_t budget_bytes;
+  int64_t live_bytes;
+  int64_t queries_running;
+  int64_t queries_admitted;
+  int64_t queries_deferred;
+  int64_t queries_rejected;
+
+  template <typename X>
+  void map(X& x) {
+    x("budget_bytes", budget_bytes);
+    x("live_bytes", live_bytes);
+    x("queries_running", queries_running);
+    x("queries_admitted", queries_admitted);
+    x("queries_deferred", queries_deferred);
+    x("queries_rejected", queries_rejected);
+  }
+
+  static MemoryBudgetDebugStatus get();
+};
+
+} // namespace watchman
@@ -8,22 +8,62 @@
 #include "watchman/PDU.h"
 #include <folly/Range.h>
 #include <folly/String.h>
+#include <folly/compression/Compression.h>
+#include <vector>
+#include "watchman/CommandRegistry.h"
 #include "watchman/Constants.h"
 #include "watchman/Logging.h"
+#include "watchman/MemoryAccounting.h"
 #include "watchman/bser.h"
 #include "watchman/portability/WinError.h"
 #include "watchman/watchman_stream.h"
 
 namespace watchman {
 
+namespace {
+
+// Compressed PDU support.  A v2 PDU whose header carries
+// BSER_CAP_COMPRESSION_ZSTD holds one zstd frame as its payload; the
+// length marker advertises the frame size and inflating the frame
+// yields the document bytes.  The capability is negotiated per client:
+// only peers that set the bit in their request header receive
+// compressed responses.
+
+// Don't bother compressing small payloads; the frame overhead and
+// extra copy aren't worth it below this.
+constexpr size_t kCompressMinBytes = 8 * 1024;
+
+bool zstdCodecAvailable() {
+  static const bool available =
+      folly::io::hasCodec(folly::io::CodecType::ZSTD);
+  return available;
+}
+
+std::unique_ptr<folly::io::Codec> zstdCodec() {
+  return folly::io::getCodec(folly::io::CodecType::ZSTD);
+}
+
+} // namespace
+
+// Advertised so clients can probe support before setting the
+// capability bit on their PDUs.
+static w_ctor_fn_type(registerPduCompressionCapability) {
+  if (zstdCodecAvailable()) {
+    capability_register("pdu-compression-zstd");
+  }
+}
+w_ctor_fn_reg(registerPduCompressionCapability)
+
 PduBuffer::PduBuffer()
     : buf((char*)malloc(WATCHMAN_IO_BUF_SIZE)), allocd(WATCHMAN_IO_BUF_SIZE) {
   if (!buf) {
     throw std::bad_alloc();
   }
+  recordMemoryAlloc(MemorySubsystem::Pdu, allocd);
 }
 
 PduBuffer::~PduBuffer() {
+  recordMemoryFree(MemorySubsystem::Pdu, allocd);
   free(buf);
 }
 
@@ -56,6 +96,8 @@ bool PduBuffer::fillBuffer(watchman_stream* stm) {
       return false;
     }
 
+    recordMemoryFree(MemorySubsystem::Pdu, allocd);
+    recordMemoryAlloc(MemorySubsystem::Pdu, allocd * 2);
     buf = newBuf;
     allocd *= 2;
 
@@ -206,14 +248,37 @@ std::optional<json_ref> PduBuffer::readBserPdu(
     return std::nullopt;
   }
 
-  // val tells us exactly how much storage we need for this PDU
-  if (val > allocd - wpos) {
-    ideal = allocd;
-    while ((ideal - wpos) < (uint32_t)val) {
-      ideal *= 2;
-    }
-    if (ideal > allocd) {
-      auto newBuf = (char*)realloc(buf, ideal);
+  // val tells us exactly how much storage we need for this PDU.  The
+  // positions are 32-bit, so refuse advertised lengths the buffer
+  // arithmetic cannot represent before trusting them for allocation.
+  if (val < 0 || uint64_t(val) >= UINT32_MAX - WATCHMAN_IO_BUF_SIZE) {
+    snprintf(
+        jerr->text,
+        sizeof(jerr->text),
+        "refusing to allocate %" PRIi64 " bytes advertised by PDU header",
+        int64_t(val));
+    return std::nullopt;
+  }
+
+  // Make the whole document contiguous starting at rpos, so the
+  // remaining payload streams directly into its final parse position:
+  // no doubling re-allocations mid-read and no later memmove of a
+  // multi-megabyte body.  The prefix that arrived alongside the header
+  // is at most an IO buffer's worth, so carrying it over is cheap.
+  if (uint64_t(val) > allocd - rpos) {
+    if (uint64_t(val) <= allocd) {
+      // Room enough overall; slide the small buffered prefix to the
+      // front instead of growing.
+      shuntDown();
+    } else {
+      // Grow to the advertised size in one step, rounded up to the IO
+      // buffer granularity.  A fresh allocation beats realloc here:
+      // realloc would copy the whole old buffer, consumed bytes
+      // included.
+      ideal = uint32_t(
+          (uint64_t(val) + WATCHMAN_IO_BUF_SIZE - 1) / WATCHMAN_IO_BUF_SIZE *
+          WATCHMAN_IO_BUF_SIZE);
+      auto newBuf = (char*)malloc(ideal);
 
       if (!newBuf) {
         snprintf(
@@ -224,14 +289,25 @@ std::optional<json_ref> PduBuffer::readBserPdu(
         return std::nullopt;
       }
 
+      uint32_t have = wpos - rpos;
+      memcpy(newBuf, buf + rpos, have);
+      free(buf);
+      recordMemoryFree(MemorySubsystem::Pdu, allocd);
+      recordMemoryAlloc(MemorySubsystem::Pdu, ideal);
       buf = newBuf;
       allocd = ideal;
+      rpos = 0;
+      wpos = have;
     }
   }
 
-  // We have enough room for the whole thing, let's read it in
+  // We have enough room for the whole thing, let's read it in.  Read
+  // exactly up to the end of the PDU: stopping at the boundary keeps
+  // any pipelined follow-up PDU out of this cycle, where the position
+  // reset below would have discarded its leading bytes.
   while ((wpos - rpos) < val) {
-    r = stm->read(buf + wpos, allocd - wpos);
+    uint32_t want = uint32_t(val - (wpos - rpos));
+    r = stm->read(buf + wpos, want);
     if (r <= 0) {
       jerr->position = wpos - rpos;
       snprintf(
@@ -239,7 +315,7 @@ std::optional<json_ref> PduBuffer::readBserPdu(
           sizeof(jerr->text),
           "error reading %" PRIu32 " bytes val=%" PRIu64 " wpos=%" PRIu32
           " rpos=%" PRIu32 " for PDU: %s",
-          uint32_t(allocd - wpos),
+          want,
           int64_t(val),
           wpos,
           rpos,
@@ -249,9 +325,30 @@ std::optional<json_ref> PduBuffer::readBserPdu(
     wpos += r;
   }
 
+  if (bser_version == 2 && (bser_capabilities & BSER_CAP_COMPRESSION_ZSTD)) {
+    // The payload is one zstd frame carrying the document bytes.
+    std::optional<json_ref> obj;
+    try {
+      auto doc =
+          zstdCodec()->uncompress(folly::StringPiece{buf + rpos, size_t(val)});
+      obj = bunser(doc.data(), doc.data() + doc.size());
+    } catch (const BserParseError& e) {
+      *jerr = e.detail;
+    } catch (const std::exception& exc) {
+      snprintf(
+          jerr->text,
+          sizeof(jerr->text),
+          "failed to inflate compressed PDU: %s",
+          exc.what());
+    }
+    rpos += uint32_t(val);
+    stm->setNonBlock(true);
+    return obj;
+  }
+
   std::optional<json_ref> obj;
   try {
-    obj = bunser(buf + rpos, buf + wpos);
+    obj = bunser(buf + rpos, buf + rpos + val);
   } catch (const BserParseError& e) {
     // Deserialization failed. Log the message that failed to deserialize to
     // stderr.
@@ -264,13 +361,205 @@ std::optional<json_ref> PduBuffer::readBserPdu(
     *jerr = e.detail;
   }
 
-  // Ensure that we move the read position to the wpos; we consumed it all
-  rpos = wpos;
+  // We consumed exactly the advertised length.
+  rpos += uint32_t(val);
 
   stm->setNonBlock(true);
   return obj;
 }
 
+bool PduBuffer::discardBytes(
+    watchman_stream* stm,
+    json_int_t len,
+    json_error_t* jerr) {
+  while (len > 0) {
+    uint32_t avail = wpos - rpos;
+    if (avail == 0) {
+      if (!fillBuffer(stm)) {
+        snprintf(jerr->text, sizeof(jerr->text), "unable to fill buffer");
+        return false;
+      }
+      continue;
+    }
+    uint32_t n = (json_int_t)avail < len ? avail : (uint32_t)len;
+    rpos += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool PduBuffer::streamBserPduElements(
+    watchman_stream* stm,
+    uint32_t bser_version,
+    const std::function<bool(json_ref)>& onElement,
+    json_error_t* jerr) {
+  json_int_t total;
+  json_int_t bser_capabilities;
+
+  MemoryScope memScope{MemorySubsystem::Pdu};
+
+  rpos += 2;
+
+  // We don't handle EAGAIN cleanly in here
+  stm->setNonBlock(false);
+  if (!decodePduInfo(stm, bser_version, &total, &bser_capabilities, jerr)) {
+    return false;
+  }
+
+  if (bser_version == 2 && (bser_capabilities & BSER_CAP_COMPRESSION_ZSTD)) {
+    // A compressed PDU is one opaque frame, so element-at-a-time
+    // streaming cannot see inside it.  Buffer and inflate the whole
+    // payload, then deliver the decoded root element-wise when it is
+    // an array.
+    while ((json_int_t)(wpos - rpos) < total) {
+      if (!fillBuffer(stm)) {
+        snprintf(jerr->text, sizeof(jerr->text), "unable to fill buffer");
+        return false;
+      }
+    }
+    std::optional<json_ref> obj;
+    try {
+      auto doc = zstdCodec()->uncompress(
+          folly::StringPiece{buf + rpos, size_t(total)});
+      obj = bunser(doc.data(), doc.data() + doc.size());
+    } catch (const BserParseError& e) {
+      *jerr = e.detail;
+      return false;
+    } catch (const std::exception& exc) {
+      snprintf(
+          jerr->text,
+          sizeof(jerr->text),
+          "failed to inflate compressed PDU: %s",
+          exc.what());
+      return false;
+    }
+    rpos += uint32_t(total);
+    stm->setNonBlock(true);
+    if (obj->isArray()) {
+      for (auto& elem : obj->array()) {
+        if (!onElement(json_ref{elem})) {
+          break;
+        }
+      }
+    } else {
+      onElement(std::move(*obj));
+    }
+    return true;
+  }
+
+  // Bytes of the PDU body not yet consumed from rpos; used both to
+  // detect the end of the document and to discard the remainder if the
+  // consumer stops early.
+  json_int_t remaining = total;
+
+  // Decode the root array header. fillBuffer shunts consumed bytes down
+  // before growing, so the buffer only ever needs to hold the largest
+  // single element rather than the whole PDU.
+  size_t header_size;
+  std::optional<json_int_t> count;
+  while (!(count = bunser_array_header(buf + rpos, wpos - rpos, &header_size))) {
+    if (header_size == kDecodeIntFailed) {
+      // The root value is not an array; buffer the whole document and
+      // deliver it as a single element.
+      while ((json_int_t)(wpos - rpos) < remaining) {
+        if (!fillBuffer(stm)) {
+          snprintf(jerr->text, sizeof(jerr->text), "unable to fill buffer");
+          return false;
+        }
+      }
+      std::optional<json_ref> obj;
+      try {
+        obj = bunser(buf + rpos, buf + rpos + remaining);
+      } catch (const BserParseError& e) {
+        *jerr = e.detail;
+        return false;
+      }
+      rpos += remaining;
+      onElement(std::move(*obj));
+      stm->setNonBlock(true);
+      return true;
+    }
+    if (!fillBuffer(stm)) {
+      snprintf(jerr->text, sizeof(jerr->text), "unable to fill buffer");
+      return false;
+    }
+  }
+  rpos += header_size;
+  remaining -= header_size;
+
+  for (json_int_t i = 0; i < *count; i++) {
+    // Wait until the next element is complete in the buffer
+    size_t size;
+    for (;;) {
+      size_t needed;
+      std::optional<size_t> measured;
+      try {
+        measured = bunser_skip(buf + rpos, wpos - rpos, &needed);
+      } catch (const BserParseError& e) {
+        *jerr = e.detail;
+        return false;
+      }
+      if (measured) {
+        size = *measured;
+        break;
+      }
+      if (!fillBuffer(stm)) {
+        snprintf(jerr->text, sizeof(jerr->text), "unable to fill buffer");
+        return false;
+      }
+    }
+
+    std::optional<json_ref> elem;
+    try {
+      elem = bunser(buf + rpos, buf + rpos + size);
+    } catch (const BserParseError& e) {
+      *jerr = e.detail;
+      return false;
+    }
+    rpos += size;
+    remaining -= size;
+
+    if (!onElement(std::move(*elem))) {
+      // The consumer has seen enough; skip to the end of the PDU so that
+      // the buffer is positioned at the next one.
+      if (!discardBytes(stm, remaining, jerr)) {
+        return false;
+      }
+      break;
+    }
+  }
+
+  stm->setNonBlock(true);
+  return true;
+}
+
+bool PduBuffer::decodeEachPduElement(
+    watchman_stream* stm,
+    const std::function<bool(json_ref)>& onElement,
+    json_error_t* jerr) {
+  *jerr = json_error_t();
+  if (!readAndDetectPdu(stm, jerr)) {
+    return false;
+  }
+
+  switch (format.type) {
+    case is_bser:
+      return streamBserPduElements(stm, 1, onElement, jerr);
+    case is_bser_v2:
+      return streamBserPduElements(stm, 2, onElement, jerr);
+    default: {
+      // The JSON formats are newline delimited and must be parsed in one
+      // shot anyway; deliver the decoded document whole.
+      auto obj = decodePdu(stm, jerr);
+      if (!obj) {
+        return false;
+      }
+      onElement(std::move(*obj));
+      return true;
+    }
+  }
+}
+
 bool PduBuffer::readAndDetectPdu(watchman_stream* stm, json_error_t* jerr) {
   PduFormat detected_format;
 
@@ -461,6 +750,10 @@ bool PduBuffer::streamPdu(watchman_stream* stm, json_error_t* jerr) {
 std::optional<json_ref> PduBuffer::decodePdu(
     watchman_stream* stm,
     json_error_t* jerr) {
+  // json values materialized straight off the wire are charged to the
+  // pdu subsystem; values built while executing the decoded command are
+  // tagged by whichever scope that code runs under.
+  MemoryScope memScope{MemorySubsystem::Pdu};
   switch (format.type) {
     case is_json_compact:
       return readJsonPdu(stm, jerr);
@@ -486,18 +779,39 @@ std::optional<json_ref> PduBuffer::decodeNext(
 namespace {
 
 struct jbuffer_write_data {
+  // Payload chunks at least this large are worth referencing in place
+  // via a segment rather than copying into the staging buffer.
+  static constexpr size_t kZeroCopyThreshold = 64;
+  // Bound the chain so a huge document doesn't accumulate an unbounded
+  // number of segments before we drain them to the stream.
+  static constexpr size_t kMaxSegments = 512;
+
   watchman_stream* stm;
   PduBuffer* jr;
+  // Gather-write chain, in document order.  Segments reference either
+  // spans of jr->buf or stable payload chunks recorded by write_stable().
+  std::vector<StreamSegment> segs;
 
   bool flush() {
-    while (jr->wpos - jr->rpos) {
-      int x = stm->write(jr->buf + jr->rpos, jr->wpos - jr->rpos);
+    while (!segs.empty()) {
+      int x = stm->writev(segs.data(), (int)segs.size());
 
       if (x <= 0) {
         return false;
       }
 
-      jr->rpos += x;
+      // Drop fully written segments; advance a partially written one
+      size_t wrote = (size_t)x;
+      auto it = segs.begin();
+      while (it != segs.end() && wrote >= it->size) {
+        wrote -= it->size;
+        ++it;
+      }
+      if (it != segs.end() && wrote) {
+        it->data = (char*)it->data + wrote;
+        it->size -= wrote;
+      }
+      segs.erase(segs.begin(), it);
     }
 
     jr->clear();
@@ -509,13 +823,28 @@ struct jbuffer_write_data {
     return data->write(buffer, size);
   }
 
+  // Sink for payload chunks whose storage stays valid until the whole
+  // document is dumped: reference them in place instead of copying.
+  static int write_stable(const char* buffer, size_t size, void* ptr) {
+    auto data = (jbuffer_write_data*)ptr;
+    if (size < kZeroCopyThreshold) {
+      // Too small to be worth an iovec entry
+      return data->write(buffer, size);
+    }
+    if (data->segs.size() >= kMaxSegments && !data->flush()) {
+      return -1;
+    }
+    data->segs.push_back(StreamSegment{const_cast<char*>(buffer), size});
+    return 0;
+  }
+
   int write(const char* buffer, size_t size) {
     while (size) {
       // Accumulate in the buffer
       int room = jr->allocd - jr->wpos;
 
-      // No room? send it over the wire
-      if (!room) {
+      // No room (or no room in the chain)? send it over the wire
+      if (!room || segs.size() >= kMaxSegments) {
         if (!flush()) {
           return -1;
         }
@@ -526,8 +855,16 @@ struct jbuffer_write_data {
         room = (int)size;
       }
 
-      // Stick it in the buffer
-      memcpy(jr->buf + jr->wpos, buffer, room);
+      // Stick it in the buffer and record where it landed, merging with
+      // the previous segment when it is contiguous in the buffer
+      char* dst = jr->buf + jr->wpos;
+      memcpy(dst, buffer, room);
+      if (!segs.empty() &&
+          (char*)segs.back().data + segs.back().size == dst) {
+        segs.back().size += room;
+      } else {
+        segs.push_back(StreamSegment{dst, (size_t)room});
+      }
 
       buffer += room;
       size -= room;
@@ -540,6 +877,112 @@ struct jbuffer_write_data {
 
 } // namespace
 
+namespace {
+
+int appendToStdString(const char* buffer, size_t size, void* ptr) {
+  static_cast<std::string*>(ptr)->append(buffer, size);
+  return 0;
+}
+
+// Encode one PDU whose peer accepted BSER_CAP_COMPRESSION_ZSTD: dump
+// the document body alone, compress it as a single zstd frame, and
+// emit an envelope advertising the frame length.  Payloads that are
+// small or that fail to shrink travel plain with the bit cleared so
+// the peer knows not to inflate them.
+int encodeBserCompressedInto(
+    uint32_t bser_capabilities,
+    const json_ref& json,
+    jbuffer_write_data& data) {
+  std::string doc;
+  bser_ctx_t ctx{2, bser_capabilities, appendToStdString};
+  if (w_bser_dump(&ctx, json, &doc)) {
+    return -1;
+  }
+
+  if (doc.size() >= kCompressMinBytes) {
+    try {
+      auto frame = zstdCodec()->compress(doc);
+      if (frame.size() < doc.size()) {
+        if (w_bser_write_pdu_header(
+                2,
+                bser_capabilities | BSER_CAP_COMPRESSION_ZSTD,
+                json_int_t(frame.size()),
+                jbuffer_write_data::write,
+                &data) != 0) {
+          return -1;
+        }
+        return data.write(frame.data(), frame.size());
+      }
+    } catch (const std::exception& exc) {
+      log(ERR, "zstd compression failed; sending plain PDU: ", exc.what(), "\n");
+    }
+  }
+
+  if (w_bser_write_pdu_header(
+          2,
+          bser_capabilities & ~uint32_t(BSER_CAP_COMPRESSION_ZSTD),
+          json_int_t(doc.size()),
+          jbuffer_write_data::write,
+          &data) != 0) {
+    return -1;
+  }
+  return data.write(doc.data(), doc.size());
+}
+
+// Encode one PDU into the staging buffer/segment chain without flushing,
+// so consecutive PDUs can share a single gather-write.
+int encodeBserInto(
+    uint32_t bser_version,
+    uint32_t bser_capabilities,
+    const json_ref& json,
+    jbuffer_write_data& data) {
+  if (bser_version == 2 && (bser_capabilities & BSER_CAP_COMPRESSION_ZSTD)) {
+    if (zstdCodecAvailable()) {
+      return encodeBserCompressedInto(bser_capabilities, json, data);
+    }
+    // No codec in this build; never echo the bit on a plain payload.
+    bser_capabilities &= ~uint32_t(BSER_CAP_COMPRESSION_ZSTD);
+  }
+  // Shard huge row arrays across pool workers first; both the measure
+  // and write passes below then splice the finished bytes instead of
+  // walking a million-row DOM twice on one thread.
+  bserParallelPreencode(json, bser_version, bser_capabilities);
+  return w_bser_write_pdu(
+      bser_version,
+      bser_capabilities,
+      jbuffer_write_data::write,
+      json,
+      &data,
+      jbuffer_write_data::write_stable);
+}
+
+int encodeJsonInto(const json_ref& json, int flags, jbuffer_write_data& data) {
+  int res = json_dump_callback(json, jbuffer_write_data::write, &data, flags);
+  if (res == 0) {
+    res = data.write("\n", 1);
+  }
+  return res;
+}
+
+int encodePduInto(PduFormat format, const json_ref& json, jbuffer_write_data& data) {
+  switch (format.type) {
+    case is_json_compact:
+      return encodeJsonInto(json, JSON_COMPACT, data);
+    case is_json_pretty:
+      return encodeJsonInto(json, JSON_INDENT(4), data);
+    case is_bser:
+      return encodeBserInto(1, format.capabilities, json, data);
+    case is_bser_v2:
+      return encodeBserInto(2, format.capabilities, json, data);
+    case need_data:
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+}
+
+} // namespace
+
 ResultErrno<folly::Unit> PduBuffer::bserEncodeToStream(
     uint32_t bser_version,
     uint32_t bser_capabilities,
@@ -547,10 +990,7 @@ ResultErrno<folly::Unit> PduBuffer::bserEncodeToStream(
     watchman_stream* stm) {
   jbuffer_write_data data = {stm, this};
 
-  int res = w_bser_write_pdu(
-      bser_version, bser_capabilities, jbuffer_write_data::write, json, &data);
-
-  if (res != 0) {
+  if (encodeBserInto(bser_version, bser_capabilities, json, data) != 0) {
     return errno;
   }
 
@@ -567,15 +1007,33 @@ ResultErrno<folly::Unit> PduBuffer::jsonEncodeToStream(
     int flags) {
   jbuffer_write_data data = {stm, this};
 
-  int res = json_dump_callback(json, jbuffer_write_data::write, &data, flags);
-  if (res != 0) {
+  if (encodeJsonInto(json, flags, data) != 0) {
     return errno;
   }
 
-  if (data.write("\n", 1) != 0) {
+  if (!data.flush()) {
     return errno;
   }
 
+  return folly::unit;
+}
+
+ResultErrno<folly::Unit> PduBuffer::pduEncodeManyToStream(
+    PduFormat format,
+    const std::vector<json_ref>& pdus,
+    watchman_stream* stm) {
+  jbuffer_write_data data = {stm, this};
+
+  for (const auto& json : pdus) {
+    if (encodePduInto(format, json, data) != 0) {
+      return errno;
+    }
+  }
+
+  // One flush for the whole burst.  The staging buffer still drains
+  // itself mid-encode when it fills, so memory stays bounded for large
+  // batches; the syscall count is then proportional to the bytes sent
+  // rather than the number of PDUs.
   if (!data.flush()) {
     return errno;
   }
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
 #include "watchman/Result.h"
 #include "watchman/thirdparty/jansson/jansson.h"
 
@@ -63,8 +64,36 @@ class PduBuffer {
   ResultErrno<folly::Unit>
   pduEncodeToStream(PduFormat format, const json_ref& json, Stream* stm);
 
+  /**
+   * Encodes every element of `pdus` as its own PDU but defers the flush
+   * until the last one, so a burst of queued responses goes out in as
+   * few gather-writes as possible -- usually one -- instead of at least
+   * one syscall per PDU.
+   */
+  ResultErrno<folly::Unit> pduEncodeManyToStream(
+      PduFormat format,
+      const std::vector<json_ref>& pdus,
+      Stream* stm);
+
   std::optional<json_ref> decodeNext(Stream* stm, json_error_t* jerr);
 
+  /**
+   * Incremental variant of decodeNext. When the next PDU is BSER encoded
+   * and its root value is an array, onElement is invoked for each element
+   * as soon as its bytes have arrived, so memory usage is bounded by the
+   * largest element rather than the whole PDU. Any other PDU is decoded in
+   * full and delivered to onElement once.
+   *
+   * If onElement returns false the remainder of the PDU is discarded and
+   * the buffer is left positioned at the next PDU.
+   *
+   * Returns false and populates jerr on error.
+   */
+  bool decodeEachPduElement(
+      Stream* stm,
+      const std::function<bool(json_ref)>& onElement,
+      json_error_t* jerr);
+
   bool readAndDetectPdu(Stream* stm, json_error_t* jerr);
   std::optional<json_ref> decodePdu(Stream* stm, json_error_t* jerr);
   bool streamPdu(Stream* stm, json_error_t* jerr);
@@ -77,6 +106,12 @@ class PduBuffer {
   std::optional<json_ref> readJsonPdu(Stream* stm, json_error_t* jerr);
   std::optional<json_ref>
   readBserPdu(Stream* stm, uint32_t bser_version, json_error_t* jerr);
+  bool streamBserPduElements(
+      Stream* stm,
+      uint32_t bser_version,
+      const std::function<bool(json_ref)>& onElement,
+      json_error_t* jerr);
+  bool discardBytes(Stream* stm, json_int_t len, json_error_t* jerr);
   bool decodePduInfo(
       Stream* stm,
       uint32_t bser_version,
@@ -7,12 +7,60 @@
 
 #include "watchman/PendingCollection.h"
 #include <folly/Synchronized.h>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <utility>
 #include "watchman/Cookie.h"
 #include "watchman/Logging.h"
+#include "watchman/TraceSpan.h"
 #include "watchman/watchman_dir.h"
+#include "watchman/watchman_stream.h"
 
 using namespace watchman;
 
+namespace {
+
+// On-disk layout of one spilled pending item; immediately followed by
+// `pathLen` bytes of path.  Spool files never outlive the process, so
+// the layout does not need to be stable across versions.
+struct SpoolRecordHeader {
+  uint32_t pathLen;
+  PendingFlags::UnderlyingType flags;
+  int64_t nowSinceEpoch;
+  uint64_t sequence;
+};
+
+bool writeAll(watchman::Stream* stm, const void* data, size_t size) {
+  auto p = static_cast<const char*>(data);
+  while (size != 0) {
+    auto chunk = std::min<size_t>(size, size_t(INT_MAX));
+    int n = stm->write(p, int(chunk));
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+bool readAll(watchman::Stream* stm, void* data, size_t size) {
+  auto p = static_cast<char*>(data);
+  while (size != 0) {
+    auto chunk = std::min<size_t>(size, size_t(INT_MAX));
+    int n = stm->read(p, int(chunk));
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+} // namespace
+
 namespace watchman {
 
 const PendingFlags::NameTable PendingFlags::table = {
@@ -21,8 +69,15 @@ const PendingFlags::NameTable PendingFlags::table = {
     {W_PENDING_NONRECURSIVE_SCAN, "NONRECURSIVE_SCAN"},
     {W_PENDING_VIA_NOTIFY, "VIA_NOTIFY"},
     {W_PENDING_IS_DESYNCED, "IS_DESYNCED"},
+    {W_PENDING_KNOWN_REMOVED, "KNOWN_REMOVED"},
+    {W_PENDING_COOKIE, "COOKIE"},
 };
 
+uint64_t nextPendingEventSequence() {
+  static std::atomic<uint64_t> seq{0};
+  return seq.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
 bool is_path_prefix(
     const char* path,
     size_t path_len,
@@ -51,20 +106,51 @@ bool is_path_prefix(
 
 } // namespace watchman
 
+// Out of line so that Stream is complete where the spool members are
+// destroyed.
+PendingChanges::~PendingChanges() = default;
+
 void PendingChanges::clear() {
   pending_.reset();
   tree_.clear();
   syncs_.clear();
+  rawCount_ = 0;
+  hasCookieItems_ = false;
+  // A clear accompanies a recrawl, which re-discovers anything the
+  // spool held; drop the files rather than replay stale records.
+  spoolWrite_.reset();
+  spoolRead_.reset();
+  spoolWriteItems_ = 0;
+  spoolReadItems_ = 0;
+  spoolCookies_ = 0;
 }
 
 void PendingChanges::add(
     const w_string& path,
     std::chrono::system_clock::time_point now,
     PendingFlags flags) {
+  add(path, now, flags, nextPendingEventSequence());
+}
+
+void PendingChanges::add(
+    const w_string& path,
+    std::chrono::system_clock::time_point now,
+    PendingFlags flags,
+    uint64_t sequence) {
+  if (maybeSpill(path, now, flags, sequence)) {
+    return;
+  }
+
+  if (flags & W_PENDING_COOKIE) {
+    // Cookie items are never pruned below, so record their presence
+    // regardless of which branch the item takes.
+    hasCookieItems_ = true;
+  }
+
   auto existing = tree_.search(path);
   if (existing) {
     /* Entry already exists: consolidate */
-    consolidateItem(existing->get(), flags);
+    consolidateItem(existing->get(), flags, sequence);
     /* all done */
     return;
   }
@@ -74,7 +160,7 @@ void PendingChanges::add(
   }
 
   // Try to allocate the new node before we prune any children.
-  auto p = std::make_shared<watchman_pending_fs>(path, now, flags);
+  auto p = std::make_shared<watchman_pending_fs>(path, now, flags, sequence);
 
   maybePruneObsoletedChildren(path, flags);
 
@@ -92,20 +178,59 @@ void PendingChanges::add(
   return add(dir->getFullPathToChild(name), now, flags);
 }
 
+void PendingChanges::addBatch(std::vector<PendingChange> batch) {
+  // Byte-wise path order places a directory immediately ahead of its
+  // contents, so a recursive parent is already indexed by the time its
+  // children are considered and they take the cheap
+  // isObsoletedByContainingDir exit instead of being inserted into the
+  // tree and pruned again. The stable sort keeps duplicates of the same
+  // path in arrival order so that consolidation sees the same sequence
+  // of flags it would have seen from individual add() calls.
+  std::stable_sort(
+      batch.begin(), batch.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.path < rhs.path;
+      });
+
+  for (auto& change : batch) {
+    add(change.path, change.now, change.flags);
+  }
+}
+
+PendingSync::PendingSync(folly::Promise<folly::Unit> promise)
+    : promise(std::move(promise)),
+      traceId(currentTraceId()),
+      enqueued(std::chrono::steady_clock::now()) {}
+
+void PendingSync::complete() {
+  traceRecordSpan(
+      traceId,
+      w_string{"pending_sync"},
+      enqueued,
+      std::chrono::steady_clock::now() - enqueued);
+  promise.setValue();
+}
+
 void PendingChanges::addSync(folly::Promise<folly::Unit> promise) {
-  syncs_.push_back(std::move(promise));
+  syncs_.push_back(PendingSync{std::move(promise)});
+}
+
+void PendingChanges::addSync(PendingSync sync) {
+  syncs_.push_back(std::move(sync));
 }
 
 void PendingChanges::append(
     std::shared_ptr<watchman_pending_fs> chain,
-    std::vector<folly::Promise<folly::Unit>> syncs) {
+    std::vector<PendingSync> syncs) {
   auto p = std::move(chain);
   while (p) {
+    if (p->flags & W_PENDING_COOKIE) {
+      hasCookieItems_ = true;
+    }
     auto target_p =
         tree_.search((const uint8_t*)p->path.data(), p->path.size());
     if (target_p) {
       /* Entry already exists: consolidate */
-      consolidateItem(target_p->get(), p->flags);
+      consolidateItem(target_p->get(), p->flags, p->sequence);
       p = std::move(p->next);
       continue;
     }
@@ -129,23 +254,213 @@ void PendingChanges::append(
       std::make_move_iterator(syncs.end()));
 }
 
+void PendingChanges::appendRaw(
+    std::shared_ptr<watchman_pending_fs> chain,
+    std::vector<PendingSync> syncs) {
+  // Splice the whole chain onto the head of the list without touching the
+  // tree. The consumer applies the dedup when it appends these items into
+  // its local PendingChanges, so all we pay under the lock is a pointer
+  // walk to fix up the links.
+  while (chain) {
+    auto next = std::move(chain->next);
+    if (maybeSpill(chain->path, chain->now, chain->flags, chain->sequence)) {
+      chain = std::move(next);
+      continue;
+    }
+    if (chain->flags & W_PENDING_COOKIE) {
+      hasCookieItems_ = true;
+    }
+    linkHead(std::move(chain));
+    ++rawCount_;
+    chain = std::move(next);
+  }
+
+  syncs_.insert(
+      syncs_.end(),
+      std::make_move_iterator(syncs.begin()),
+      std::make_move_iterator(syncs.end()));
+}
+
 std::shared_ptr<watchman_pending_fs> PendingChanges::stealItems() {
   tree_.clear();
-  return std::move(pending_);
+  rawCount_ = 0;
+  hasCookieItems_ = false;
+  auto chain = std::move(pending_);
+  if (spoolReadItems_ + spoolWriteItems_ != 0) {
+    replaySpool(chain);
+  }
+  return chain;
 }
 
-std::vector<folly::Promise<folly::Unit>> PendingChanges::stealSyncs() {
-  std::vector<folly::Promise<folly::Unit>> syncs;
+std::vector<PendingSync> PendingChanges::stealSyncs() {
+  if (spoolReadItems_ + spoolWriteItems_ != 0) {
+    // Some of these syncs may have been requested after items that are
+    // still parked in the spool; fulfilling them now would assert that
+    // those events were processed.  Hold them until the spool drains.
+    return {};
+  }
+  std::vector<PendingSync> syncs;
   std::swap(syncs, syncs_);
   return syncs;
 }
 
 bool PendingChanges::empty() const {
-  return 0 == tree_.size() && syncs_.empty();
+  return 0 == tree_.size() && 0 == rawCount_ &&
+      0 == spoolReadItems_ + spoolWriteItems_ && syncs_.empty();
 }
 
 uint32_t PendingChanges::getPendingItemCount() const {
-  return tree_.size();
+  return tree_.size() + rawCount_ + spoolReadItems_ + spoolWriteItems_;
+}
+
+bool PendingChanges::hasSyncs() const {
+  return !syncs_.empty();
+}
+
+bool PendingChanges::hasCookieItems() const {
+  return hasCookieItems_ || spoolCookies_ != 0;
+}
+
+void PendingChanges::setSpillThreshold(size_t maxItems) {
+  spillThreshold_ = maxItems;
+}
+
+std::optional<PendingSpillStats> PendingChanges::getSpillStats() const {
+  if (spillThreshold_ == 0) {
+    return std::nullopt;
+  }
+  PendingSpillStats stats;
+  stats.queueDepth = tree_.size() + rawCount_;
+  stats.spoolDepth = spoolReadItems_ + spoolWriteItems_;
+  stats.spilledTotal = spillCount_;
+  stats.replayedTotal = replayCount_;
+  return stats;
+}
+
+bool PendingChanges::maybeSpill(
+    const w_string& path,
+    std::chrono::system_clock::time_point now,
+    PendingFlags flags,
+    uint64_t sequence) {
+  if (spillThreshold_ == 0 || spoolBroken_) {
+    return false;
+  }
+  // Once anything is spooled, every subsequent item must spool too:
+  // replaying an old record after a newer in-memory event for the same
+  // path would resurrect stale flags.
+  if (spoolReadItems_ + spoolWriteItems_ == 0 &&
+      tree_.size() + rawCount_ < spillThreshold_) {
+    return false;
+  }
+  return spillItem(path, now, flags, sequence);
+}
+
+bool PendingChanges::spillItem(
+    const w_string& path,
+    std::chrono::system_clock::time_point now,
+    PendingFlags flags,
+    uint64_t sequence) {
+  if (!spoolWrite_) {
+    spoolWrite_ = w_stm_open_anonymous();
+    if (!spoolWrite_) {
+      logf(
+          ERR,
+          "pending spill: unable to open spool file; "
+          "items will be kept in memory\n");
+      spoolBroken_ = true;
+      return false;
+    }
+    logf(
+        ERR,
+        "pending queue reached {} items; spilling further items to disk\n",
+        getPendingItemCount());
+  }
+  SpoolRecordHeader hdr;
+  hdr.pathLen = path.size();
+  hdr.flags = flags.asRaw();
+  hdr.nowSinceEpoch = int64_t(now.time_since_epoch().count());
+  hdr.sequence = sequence;
+  if (!writeAll(spoolWrite_.get(), &hdr, sizeof(hdr)) ||
+      !writeAll(spoolWrite_.get(), path.data(), path.size())) {
+    // The partial record lies beyond the last accounted item, so the
+    // replay side (which reads by count, not to EOF) never sees it.
+    logf(
+        ERR,
+        "pending spill: write to spool file failed; "
+        "items will be kept in memory\n");
+    spoolBroken_ = true;
+    return false;
+  }
+  ++spoolWriteItems_;
+  ++spillCount_;
+  if (flags & W_PENDING_COOKIE) {
+    ++spoolCookies_;
+  }
+  return true;
+}
+
+void PendingChanges::replaySpool(std::shared_ptr<watchman_pending_fs>& chain) {
+  // Replaying at most one threshold's worth per steal keeps the
+  // consumer's working set bounded while the spool drains.
+  size_t budget = spillThreshold_;
+  while (budget != 0) {
+    if (spoolReadItems_ == 0) {
+      spoolRead_.reset();
+      if (spoolWriteItems_ == 0) {
+        break;
+      }
+      // Rotate: every record in the write spool is newer than anything
+      // replayed so far, so it becomes the read spool wholesale.
+      if (!spoolWrite_->rewind()) {
+        abandonSpool();
+        return;
+      }
+      spoolRead_ = std::move(spoolWrite_);
+      spoolReadItems_ = std::exchange(spoolWriteItems_, 0);
+    }
+    SpoolRecordHeader hdr;
+    std::string pathBuf;
+    if (!readAll(spoolRead_.get(), &hdr, sizeof(hdr))) {
+      abandonSpool();
+      return;
+    }
+    pathBuf.resize(hdr.pathLen);
+    if (!readAll(spoolRead_.get(), pathBuf.data(), pathBuf.size())) {
+      abandonSpool();
+      return;
+    }
+    auto p = std::make_shared<watchman_pending_fs>(
+        w_string{pathBuf.data(), pathBuf.size()},
+        std::chrono::system_clock::time_point{
+            std::chrono::system_clock::duration{hdr.nowSinceEpoch}},
+        PendingFlags::raw(hdr.flags),
+        hdr.sequence);
+    if (p->flags & W_PENDING_COOKIE && spoolCookies_ != 0) {
+      --spoolCookies_;
+    }
+    // This prepends replayed (older) records ahead of the newer
+    // in-memory items; that is fine because consolidation keys off the
+    // event sequence carried by each item, not merge order.
+    p->next = std::move(chain);
+    chain = std::move(p);
+    --spoolReadItems_;
+    ++replayCount_;
+    --budget;
+  }
+}
+
+void PendingChanges::abandonSpool() {
+  logf(
+      ERR,
+      "pending spill: spool file IO failed; discarding {} spilled items. "
+      "Some filesystem changes may be missed until the next recrawl\n",
+      spoolReadItems_ + spoolWriteItems_);
+  spoolWrite_.reset();
+  spoolRead_.reset();
+  spoolWriteItems_ = 0;
+  spoolReadItems_ = 0;
+  spoolCookies_ = 0;
+  spoolBroken_ = true;
 }
 
 // if there are any entries that are obsoleted by a recursive insert,
@@ -155,27 +470,16 @@ void PendingChanges::maybePruneObsoletedChildren(
     PendingFlags flags) {
   if ((flags & (W_PENDING_RECURSIVE | W_PENDING_CRAWL_ONLY)) ==
       W_PENDING_RECURSIVE) {
-    uint32_t pruned = 0;
-
-    // Since deletion invalidates the iterator, we need to repeatedly
-    // call this to prune out the nodes.  It will return 0 once no
-    // matching prefixes are found and deleted.
-    // Deletion is a bit awkward in this radix tree implementation.
-    // We can't recursively delete a given prefix as a built-in operation
-    // and it is non-trivial to add that functionality right now.
     // When we lop-off a portion of a tree that we're going to analyze
-    // recursively, we have to iterate each leaf and explicitly delete
-    // that leaf.
-    // Since deletion invalidates the iteration state we have to signal
-    // to stop iteration after each deletion and then retry the prefix
-    // deletion.
+    // recursively, every leaf under it gets erased in a single pass by
+    // erasePrefix.
     //
     // We need to compare the prefix to make sure that we don't delete
     // a sibling node by mistake (see commentary on the is_path_prefix
     // function for more on that).
 
-    auto callback = [&](const w_string& key,
-                        std::shared_ptr<watchman_pending_fs>& p) -> int {
+    auto shouldErase = [&](const w_string& key,
+                           std::shared_ptr<watchman_pending_fs>& p) -> bool {
       w_check(
           p,
           "Pending changes should be removed from both the list and the tree.");
@@ -194,25 +498,19 @@ void PendingChanges::maybePruneObsoletedChildren(
             path.size(),
             path);
 
-        // Unlink the child from the pending index.
+        // Unlink the child from the pending index; erasePrefix removes
+        // it from the art tree.
         unlinkItem(p);
-
-        // Remove it from the art tree.
-        tree_.erase(key);
-
-        // Stop iteration because we just invalidated the iterator state
-        // by modifying the tree mid-iteration.
-        return 1;
+        return true;
       }
 
-      return 0;
+      return false;
     };
 
-    while (tree_.iterPrefix(
-        reinterpret_cast<const uint8_t*>(path.data()), path.size(), callback)) {
-      // OK; try again
-      ++pruned;
-    }
+    uint32_t pruned = tree_.erasePrefix(
+        reinterpret_cast<const uint8_t*>(path.data()),
+        path.size(),
+        shouldErase);
 
     if (pruned) {
       logf(
@@ -227,7 +525,8 @@ void PendingChanges::maybePruneObsoletedChildren(
 
 void PendingChanges::consolidateItem(
     watchman_pending_fs* p,
-    PendingFlags flags) {
+    PendingFlags flags,
+    uint64_t sequence) {
   // Increase the strength of the pending item if either of these
   // flags are set.
   // We upgrade crawl-only as well as recursive; it indicates that
@@ -238,6 +537,29 @@ void PendingChanges::consolidateItem(
       (W_PENDING_CRAWL_ONLY | W_PENDING_RECURSIVE |
        W_PENDING_NONRECURSIVE_SCAN | W_PENDING_IS_DESYNCED));
 
+  // The newest event's view of whether the path still exists is
+  // authoritative: a trusted removal upgrades the item, while any later
+  // event that might have recreated the path downgrades it back to a
+  // confirming stat.  "Newest" is decided by the per-event sequence,
+  // not by the order the events reach this consolidation -- the
+  // notify->IO handoff head-splices batches and the disk spool replays
+  // old records into newer chains, so older events are routinely the
+  // incoming side here.
+  if (sequence >= p->sequence) {
+    p->sequence = sequence;
+    if (flags & W_PENDING_KNOWN_REMOVED) {
+      p->flags.set(W_PENDING_KNOWN_REMOVED);
+    } else {
+      p->flags.clear(W_PENDING_KNOWN_REMOVED);
+    }
+  }
+
+  // A path is only metadata-clean if every event coalesced into the
+  // item said so; one content-bearing event taints the whole window.
+  if (!(flags & W_PENDING_ATTRIB_ONLY)) {
+    p->flags.clear(W_PENDING_ATTRIB_ONLY);
+  }
+
   maybePruneObsoletedChildren(p->path, p->flags);
 }
 
@@ -309,7 +631,9 @@ void PendingCollectionBase::ping() {
 }
 
 bool PendingCollectionBase::checkAndResetPinged() {
-  if (pending_ || pinged_) {
+  // Spilled items must keep the consumer awake even when nothing new
+  // arrives, or a quiescent period would strand them on disk.
+  if (pending_ || spoolReadItems_ + spoolWriteItems_ != 0 || pinged_) {
     pinged_ = false;
     return true;
   }
@@ -11,7 +11,11 @@
 #include <folly/futures/Promise.h>
 #include <chrono>
 #include <condition_variable>
+#include <memory>
+#include <optional>
+#include <vector>
 #include "eden/common/utils/OptionSet.h"
+#include "watchman/MemoryAccounting.h"
 #include "watchman/thirdparty/libart/src/art.h"
 #include "watchman/watchman_string.h"
 
@@ -19,7 +23,32 @@ struct watchman_dir;
 
 namespace watchman {
 
-struct PendingFlags : facebook::eden::OptionSet<PendingFlags, uint8_t> {
+class Stream;
+
+/**
+ * A sync barrier parked in a PendingChanges queue.
+ *
+ * Besides the promise, it carries the trace id of the request that
+ * asked for the sync and the time it was enqueued, so the thread that
+ * eventually fulfills it can record a trace span covering the
+ * cross-thread queue-to-flush latency.  Fulfill via complete() rather
+ * than poking the promise directly.
+ */
+struct PendingSync {
+  /** Wraps `promise`, stamping the calling thread's current trace id
+   * and the current time. */
+  explicit PendingSync(folly::Promise<folly::Unit> promise);
+
+  /** Records the span against the carried trace id and fulfills the
+   * promise. */
+  void complete();
+
+  folly::Promise<folly::Unit> promise;
+  uint64_t traceId;
+  std::chrono::steady_clock::time_point enqueued;
+};
+
+struct PendingFlags : facebook::eden::OptionSet<PendingFlags, uint32_t> {
   using OptionSet::OptionSet;
   static const NameTable table;
 };
@@ -82,6 +111,64 @@ constexpr inline auto W_PENDING_IS_DESYNCED = PendingFlags::raw(16);
  */
 constexpr inline auto W_PENDING_VIA_PWALK = PendingFlags::raw(32);
 
+/**
+ * Set by a watcher when the kernel event that produced this item
+ * unambiguously reported the path as removed (inotify IN_DELETE /
+ * IN_MOVED_FROM; FSEvents ItemRemoved with no creation or rename flags).
+ *
+ * statPath() trusts the event and applies the deletion without issuing a
+ * confirming lstat.  If the path was recreated after the event was
+ * generated, the recreation's own notification is behind us in the queue
+ * and will re-stat it.
+ *
+ * consolidateItem() treats the most recent event for a path -- by
+ * event sequence, not by the order batches happen to be merged -- as
+ * authoritative: a later event without this flag clears it.
+ */
+constexpr inline auto W_PENDING_KNOWN_REMOVED = PendingFlags::raw(64);
+
+/**
+ * Set by the notify thread when the path is one of this root's own sync
+ * cookies, checked against the CookieSync prefix at ingestion time.
+ *
+ * Cookie events sit on the latency path of every synchronized query, so
+ * the IO thread treats a batch carrying this flag as urgent: it must not
+ * be held back by event-storm coalescing or any other deliberate delay.
+ * Cookies discovered by crawling do not carry the flag; they are found
+ * again by the prefix check in processPath().
+ */
+constexpr inline auto W_PENDING_COOKIE = PendingFlags::raw(128);
+
+/**
+ * Set by a watcher when the kernel event positively attributes this
+ * change to file metadata only (inotify IN_ATTRIB with no modify,
+ * create, delete or rename bits): the file's bytes are untouched.
+ *
+ * statPath() uses this to preserve the file's content fingerprint
+ * (watchman_file::content_mtime) across mtime-only touches, which keeps
+ * cached content sha1s valid without re-reading the file.
+ *
+ * consolidateItem() only keeps the flag when every coalesced event for
+ * the path carried it; a single content-bearing event in the window
+ * clears it.  Watchers that cannot make the distinction simply never
+ * set it.
+ */
+constexpr inline auto W_PENDING_ATTRIB_ONLY = PendingFlags::raw(256);
+
+/**
+ * Set by a watcher on a directory that it knows was just renamed into
+ * place: the watcher paired both halves of the move via its native
+ * rename cookies and holds the source path, retrievable once through
+ * Watcher::takeRenameSource().
+ *
+ * statPath() uses this to apply the rename by grafting the source
+ * subtree onto the destination path in memory (and tombstoning the old
+ * paths) instead of re-statting every file beneath the destination --
+ * the difference between a pointer walk and a 100k-lstat crawl when a
+ * large build directory is renamed.
+ */
+constexpr inline auto W_PENDING_RENAMED = PendingFlags::raw(512);
+
 /**
  * Represents a change notification from the Watcher.
  */
@@ -91,16 +178,41 @@ struct PendingChange {
   PendingFlags flags;
 };
 
+/**
+ * Returns the next value of the process-wide pending event sequence.
+ *
+ * Every pending item is stamped with one at the moment the event
+ * enters a PendingChanges, so "which event is newer" survives the
+ * merge steps -- appendRaw() head-splices batches and replaySpool()
+ * prepends older records, both of which invert arrival order on the
+ * chain.  consolidateItem() compares sequences rather than trusting
+ * the order items happen to be merged in.
+ */
+uint64_t nextPendingEventSequence();
+
 struct watchman_pending_fs : watchman::PendingChange {
   // We own the next entry and will destroy that chain when we
   // are destroyed.
   std::shared_ptr<watchman_pending_fs> next;
 
+  // Sequence of the newest event folded into this item; see
+  // nextPendingEventSequence().
+  uint64_t sequence;
+
   watchman_pending_fs(
       w_string path,
       std::chrono::system_clock::time_point now,
-      PendingFlags flags)
-      : PendingChange{std::move(path), now, flags} {}
+      PendingFlags flags,
+      uint64_t sequence = nextPendingEventSequence())
+      : PendingChange{std::move(path), now, flags}, sequence(sequence) {
+    // Node shells only; the path is a shared w_string and is not
+    // charged here.
+    recordMemoryAlloc(MemorySubsystem::Pending, sizeof(watchman_pending_fs));
+  }
+
+  ~watchman_pending_fs() {
+    recordMemoryFree(MemorySubsystem::Pending, sizeof(watchman_pending_fs));
+  }
 
  private:
   // Only used for unlinking during pruning.
@@ -108,6 +220,21 @@ struct watchman_pending_fs : watchman::PendingChange {
   friend class PendingChanges;
 };
 
+/**
+ * Counters describing the state of the disk spill tier, surfaced via
+ * debug-status.
+ */
+struct PendingSpillStats {
+  // Items currently held in memory (tree + raw chain).
+  uint64_t queueDepth;
+  // Items currently parked in the spool files.
+  uint64_t spoolDepth;
+  // Lifetime count of items written to a spool.
+  uint64_t spilledTotal;
+  // Lifetime count of items replayed from a spool.
+  uint64_t replayedTotal;
+};
+
 /**
  * Holds a linked list of watchman_pending_fs instances and a trie that
  * efficiently prunes redundant changes.
@@ -115,6 +242,7 @@ struct watchman_pending_fs : watchman::PendingChange {
 class PendingChanges {
  public:
   PendingChanges() = default;
+  ~PendingChanges();
   PendingChanges(PendingChanges&&) = delete;
   PendingChanges& operator=(PendingChanges&&) = delete;
 
@@ -128,23 +256,50 @@ class PendingChanges {
   /**
    * Add a pending entry.  Will consolidate an existing entry with the same
    * name. The caller must own the collection lock.
+   *
+   * The overload taking an explicit sequence is for re-adding an event
+   * that already entered a PendingChanges once (eg: the notify thread's
+   * rate governor rewriting a stolen batch); fresh events omit it and
+   * are stamped here.
    */
   void add(
       const w_string& path,
       std::chrono::system_clock::time_point now,
       PendingFlags flags);
+  void add(
+      const w_string& path,
+      std::chrono::system_clock::time_point now,
+      PendingFlags flags,
+      uint64_t sequence);
   void add(
       watchman_dir* dir,
       const char* name,
       std::chrono::system_clock::time_point now,
       PendingFlags flags);
 
+  /**
+   * Add a whole batch of pending entries, such as one drained kernel
+   * read's worth of notifications, in a single call.
+   *
+   * The batch is sorted so that parent directories are considered before
+   * their contents: when a recursive parent and its children arrive
+   * together, the children consolidate against the parent immediately
+   * instead of being inserted into the tree and pruned again afterwards.
+   */
+  void addBatch(std::vector<PendingChange> batch);
+
   /**
    * Add a sync request. The consumer of this sync should fulfill it after
    * processing all of the pending items.
    */
   void addSync(folly::Promise<folly::Unit> promise);
 
+  /**
+   * Re-park an already-stamped sync, preserving the trace id and
+   * enqueue time captured when the requesting thread created it.
+   */
+  void addSync(PendingSync sync);
+
   /**
    * Merge the full contents of `chain` into this collection. They are usually
    * from a stealItems() call.
@@ -153,13 +308,28 @@ class PendingChanges {
    */
   void append(
       std::shared_ptr<watchman_pending_fs> chain,
-      std::vector<folly::Promise<folly::Unit>> syncs);
+      std::vector<PendingSync> syncs);
+
+  /**
+   * Like append(), but splices `chain` onto the list without applying the
+   * prefix-dedup logic or indexing the items in the tree.
+   *
+   * This is a producer-side fast path: the notify thread hands off batches
+   * to the IO thread under the PendingCollection mutex, and the IO thread
+   * re-appends them into its local PendingChanges where the dedup runs
+   * without blocking the kernel-facing thread. Items added this way are
+   * invisible to add()'s consolidation until the next stealItems(), which
+   * only costs a redundant stat if the same path arrives via both paths.
+   */
+  void appendRaw(
+      std::shared_ptr<watchman_pending_fs> chain,
+      std::vector<PendingSync> syncs);
 
   /* Moves the head of the chain of items to the caller.
    * The tree is cleared and the caller owns the whole chain */
   std::shared_ptr<watchman_pending_fs> stealItems();
 
-  std::vector<folly::Promise<folly::Unit>> stealSyncs();
+  std::vector<PendingSync> stealSyncs();
 
   /**
    * Returns true if there are no items or syncs.
@@ -167,19 +337,95 @@ class PendingChanges {
   bool empty() const;
 
   /**
-   * Returns the number of unique pending items in the collection. Does not
-   * include sync requests.
+   * Returns true if any sync requests are pending.
+   */
+  bool hasSyncs() const;
+
+  /**
+   * Returns true if any item flagged W_PENDING_COOKIE is in the
+   * collection.  Like sync requests, cookie events gate a blocked query
+   * and must not wait out deliberate delays such as event coalescing.
+   */
+  bool hasCookieItems() const;
+
+  /**
+   * Returns the number of unique pending items in the collection,
+   * including any parked in the disk spool. Does not include sync
+   * requests.
    */
   uint32_t getPendingItemCount() const;
 
+  /**
+   * Arms the disk spill tier: once the in-memory item count reaches
+   * `maxItems`, further items are batch-serialized to an anonymous
+   * temp spool file instead of being linked into memory, and are
+   * replayed (at most `maxItems` per stealItems() call) as the queue
+   * drains.  This trades controlled disk IO for survival during
+   * watcher storms that would otherwise grow the collection without
+   * bound.  Pass 0 (the default state) to disable.
+   *
+   * Spilled items bypass the consolidation tree until they are
+   * replayed, so a pathological storm may pay some redundant stats;
+   * that is the same trade appendRaw() makes.  Sync promises are
+   * withheld by stealSyncs() while the spool is non-empty so that a
+   * sync can never be fulfilled ahead of events that preceded it.
+   */
+  void setSpillThreshold(size_t maxItems);
+
+  /**
+   * Returns spill counters, or nullopt when the spill tier is not
+   * armed.
+   */
+  std::optional<PendingSpillStats> getSpillStats() const;
+
  protected:
   art_tree<std::shared_ptr<watchman_pending_fs>, w_string> tree_;
   std::shared_ptr<watchman_pending_fs> pending_;
-  std::vector<folly::Promise<folly::Unit>> syncs_;
+  std::vector<PendingSync> syncs_;
+  // Count of items linked into pending_ via appendRaw() that are not
+  // indexed in tree_.
+  uint32_t rawCount_{0};
+  // Whether any current item carries W_PENDING_COOKIE; reset when the
+  // items are stolen or cleared.  Cookie items are never pruned by the
+  // dedup logic, so once set the bit stays truthful until then.
+  bool hasCookieItems_{false};
+
+  // Disk spill tier state.  Records flow strictly write spool ->
+  // (rotate on drain) -> read spool, so each file is only ever
+  // sequentially written or sequentially read and every spooled item
+  // is older than every in-memory item added after it.
+  size_t spillThreshold_{0};
+  std::unique_ptr<Stream> spoolWrite_;
+  std::unique_ptr<Stream> spoolRead_;
+  uint64_t spoolWriteItems_{0};
+  uint64_t spoolReadItems_{0};
+  // Number of spooled items carrying W_PENDING_COOKIE, so
+  // hasCookieItems() stays truthful while cookies are parked on disk.
+  uint64_t spoolCookies_{0};
+  uint64_t spillCount_{0};
+  uint64_t replayCount_{0};
+  // Set on the first spool IO failure; disables further spilling so
+  // items fall back to memory (the pre-spill behavior).
+  bool spoolBroken_{false};
 
  private:
+  bool maybeSpill(
+      const w_string& path,
+      std::chrono::system_clock::time_point now,
+      PendingFlags flags,
+      uint64_t sequence);
+  bool spillItem(
+      const w_string& path,
+      std::chrono::system_clock::time_point now,
+      PendingFlags flags,
+      uint64_t sequence);
+  void replaySpool(std::shared_ptr<watchman_pending_fs>& chain);
+  void abandonSpool();
   void maybePruneObsoletedChildren(w_string path, PendingFlags flags);
-  inline void consolidateItem(watchman_pending_fs* p, PendingFlags flags);
+  inline void consolidateItem(
+      watchman_pending_fs* p,
+      PendingFlags flags,
+      uint64_t sequence);
   bool isObsoletedByContainingDir(const w_string& path);
   inline void linkHead(std::shared_ptr<watchman_pending_fs>&& p);
   inline void unlinkItem(std::shared_ptr<watchman_pending_fs>& p);
@@ -7,8 +7,12 @@
 
 #include "watchman/PerfSample.h"
 #include <folly/Synchronized.h>
+#include <folly/lang/Bits.h>
+#include <algorithm>
 #include <condition_variable>
+#include <memory>
 #include <thread>
+#include <unordered_map>
 #include "watchman/ChildProcess.h"
 #include "watchman/Logging.h"
 #include "watchman/Options.h"
@@ -71,8 +75,107 @@ PerfLogThread& getPerfThread(bool start = true) {
   static PerfLogThread perfThread(start);
   return perfThread;
 }
+
+using HistogramMap =
+    std::unordered_map<w_string, std::unique_ptr<PerfHistogram>>;
+
+folly::Synchronized<HistogramMap>& getHistogramMap() {
+  // Deliberately leaked so that samples recorded during shutdown
+  // never race with destruction.
+  static auto& map = *new folly::Synchronized<HistogramMap>();
+  return map;
+}
 } // namespace
 
+size_t PerfHistogram::bucketFor(uint64_t value) {
+  if (value < kSubBucketCount) {
+    return size_t(value);
+  }
+  size_t exponent = folly::findLastSet(value) - 1;
+  size_t index = ((exponent - (kSubBucketShift - 1)) << kSubBucketShift) +
+      ((value >> (exponent - kSubBucketShift)) & kSubBucketMask);
+  return std::min(index, kNumBuckets - 1);
+}
+
+uint64_t PerfHistogram::bucketLowerBound(size_t index) {
+  if (index < kSubBucketCount) {
+    return index;
+  }
+  size_t octave = index >> kSubBucketShift;
+  size_t sub = index & kSubBucketMask;
+  return uint64_t(kSubBucketCount + sub) << (octave - 1);
+}
+
+void PerfHistogram::add(uint64_t value) {
+  buckets_[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  auto prev = max_.load(std::memory_order_relaxed);
+  while (prev < value &&
+         !max_.compare_exchange_weak(prev, value, std::memory_order_relaxed)) {
+  }
+}
+
+json_ref PerfHistogram::toJson() const {
+  // Snapshot the buckets; concurrent adds may tear across counters but
+  // each individual bucket is consistent, which is fine for monitoring.
+  std::array<uint64_t, kNumBuckets> snap;
+  uint64_t total = 0;
+  for (size_t i = 0; i < kNumBuckets; ++i) {
+    snap[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += snap[i];
+  }
+
+  auto percentile = [&](double pct) -> uint64_t {
+    uint64_t target = uint64_t(pct * double(total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+      seen += snap[i];
+      if (seen > target) {
+        return bucketLowerBound(i);
+      }
+    }
+    return bucketLowerBound(kNumBuckets - 1);
+  };
+
+  auto obj = json_object(
+      {{"count", json_integer(total)},
+       {"sum", json_integer(sum_.load(std::memory_order_relaxed))},
+       {"max", json_integer(max_.load(std::memory_order_relaxed))}});
+  if (total > 0) {
+    obj.set("p50", json_integer(percentile(0.50)));
+    obj.set("p90", json_integer(percentile(0.90)));
+    obj.set("p99", json_integer(percentile(0.99)));
+  }
+  return obj;
+}
+
+PerfHistogram& perfHistogram(const w_string& name) {
+  auto& map = getHistogramMap();
+  {
+    auto rlock = map.rlock();
+    auto it = rlock->find(name);
+    if (it != rlock->end()) {
+      return *it->second;
+    }
+  }
+  auto wlock = map.wlock();
+  auto& slot = (*wlock)[name];
+  if (!slot) {
+    slot = std::make_unique<PerfHistogram>();
+  }
+  return *slot;
+}
+
+json_ref renderPerfMetrics() {
+  auto obj = json_object();
+  auto rlock = getHistogramMap().rlock();
+  for (auto& [name, histogram] : *rlock) {
+    obj.set(name, histogram->toJson());
+  }
+  return obj;
+}
+
 void processSamples(
     size_t argv_limit,
     size_t maximum_batch_size,
@@ -138,6 +241,12 @@ bool PerfSample::finish() {
 #undef DIFFU
 #endif
 
+  // Feed the in-process histogram for this sample type regardless of
+  // whether the sample crosses the logging threshold; percentiles are
+  // only meaningful over the full population.
+  perfHistogram(w_string{description, W_STRING_UNICODE})
+      .add(uint64_t(w_timeval_diff(time_begin, time_end) * 1e6));
+
   if (!will_log) {
     if (wall_time_elapsed_thresh == 0) {
       auto thresh = cfg_get_json("perf_sampling_thresh");
@@ -8,14 +8,75 @@
 #pragma once
 
 #include <folly/portability/SysTime.h>
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 #include "watchman/thirdparty/jansson/jansson.h"
+#include "watchman/watchman_string.h"
 
 // Performance metrics sampling
 
 namespace watchman {
 
+/**
+ * Log-scaled value histogram in the spirit of HdrHistogram.
+ *
+ * Values are bucketed into 16 linear sub-buckets per power of two,
+ * giving about 6% relative precision, so percentiles can be estimated
+ * without retaining individual samples.  Recording is a handful of
+ * relaxed atomic increments and never takes a lock; rendering walks a
+ * snapshot of the buckets.
+ *
+ * Values are unitless as far as the histogram is concerned.  The
+ * histograms fed from PerfSample::finish() record elapsed wall time in
+ * microseconds.
+ */
+class PerfHistogram {
+ public:
+  /** Record a single value. */
+  void add(uint64_t value);
+
+  /**
+   * Render count/sum/max plus estimated p50/p90/p99 as a json object.
+   * Percentile estimates are bucket lower bounds.
+   */
+  json_ref toJson() const;
+
+ private:
+  static constexpr size_t kSubBucketShift = 4;
+  static constexpr size_t kSubBucketCount = size_t(1) << kSubBucketShift;
+  static constexpr uint64_t kSubBucketMask = kSubBucketCount - 1;
+  // Covers values up to 2^40 (about 12 days when recording
+  // microseconds); anything larger saturates into the last bucket.
+  static constexpr size_t kNumBuckets = 37 * kSubBucketCount;
+
+  static size_t bucketFor(uint64_t value);
+  static uint64_t bucketLowerBound(size_t index);
+
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * Returns the process-wide histogram for the given metric name,
+ * creating it on first use.  Histograms are never destroyed, so the
+ * returned reference remains valid for the life of the process.
+ *
+ * PerfSample::finish() feeds the histogram named after the sample
+ * description automatically; call this directly for metrics that are
+ * not wall-time samples (queue depths, etc).
+ */
+PerfHistogram& perfHistogram(const w_string& name);
+
+/**
+ * Render every registered histogram as a json object keyed by metric
+ * name.  Backs the `debug-metrics` command.
+ */
+json_ref renderPerfMetrics();
+
 class PerfSample {
  public:
   // What we're sampling across
@@ -14,11 +14,13 @@ namespace watchman {
 Publisher::Subscriber::Subscriber(
     std::shared_ptr<Publisher> pub,
     Notifier notify,
-    const std::optional<json_ref>& info)
+    const std::optional<json_ref>& info,
+    size_t maxInflight)
     : serial_(0),
       publisher_(std::move(pub)),
       notify_(notify),
-      info_(std::move(info)) {}
+      info_(std::move(info)),
+      maxInflight_(maxInflight) {}
 
 Publisher::Subscriber::~Subscriber() {
   // In the loop below we may own a reference to some other
@@ -106,9 +108,10 @@ void getPending(
 
 std::shared_ptr<Publisher::Subscriber> Publisher::subscribe(
     Notifier notify,
-    const std::optional<json_ref>& info) {
-  auto sub =
-      std::make_shared<Publisher::Subscriber>(shared_from_this(), notify, info);
+    const std::optional<json_ref>& info,
+    size_t maxInflight) {
+  auto sub = std::make_shared<Publisher::Subscriber>(
+      shared_from_this(), notify, info, maxInflight);
   state_.wlock()->subscribers.emplace_back(sub);
   return sub;
 }
@@ -136,7 +139,17 @@ void Publisher::state::collectGarbage() {
 }
 
 bool Publisher::enqueue(json_ref&& payload) {
-  std::vector<std::shared_ptr<Subscriber>> subscribers;
+  std::vector<json_ref> batch;
+  batch.push_back(std::move(payload));
+  return enqueueBatch(std::move(batch));
+}
+
+bool Publisher::enqueueBatch(std::vector<json_ref>&& payloads) {
+  if (payloads.empty()) {
+    return false;
+  }
+
+  std::vector<std::shared_ptr<Subscriber>> toNotify;
 
   {
     auto wlock = state_.wlock();
@@ -144,32 +157,77 @@ bool Publisher::enqueue(json_ref&& payload) {
     // We need to collect live references for the notify portion,
     // but since we're holding the wlock, take this opportunity to
     // detect and prune dead subscribers and clean up some garbage.
+    uint64_t maxSeenSerial = 0;
+    uint64_t newestSerial =
+        wlock->items.empty() ? 0 : wlock->items.back()->serial;
+    bool anySubscribers = false;
     auto it = wlock->subscribers.begin();
     while (it != wlock->subscribers.end()) {
       auto sub = it->lock();
       // Prune vacated weak_ptr's
       if (!sub) {
         it = wlock->subscribers.erase(it);
-      } else {
-        ++it;
-        // Remember that live reference so that we can notify
-        // outside of the lock below.
-        subscribers.emplace_back(std::move(sub));
+        continue;
       }
+      ++it;
+      anySubscribers = true;
+      maxSeenSerial = std::max(maxSeenSerial, sub->getSerial());
+
+      // Flow control: a subscriber already sitting on its advertised
+      // max-inflight backlog has a wakeup in flight, and getPending
+      // drains everything unseen, so the items we append below ride
+      // along with that wakeup rather than triggering another.  This
+      // read is stable because getPending serializes against us via
+      // the state lock: any drain that we didn't observe here will
+      // observe the items we are about to append.
+      uint64_t backlog = newestSerial > sub->getSerial()
+          ? newestSerial - sub->getSerial()
+          : 0;
+      if (sub->getMaxInflight() && backlog >= sub->getMaxInflight()) {
+        ++wlock->deferredWakeups;
+        continue;
+      }
+
+      // Remember that live reference so that we can notify
+      // outside of the lock below.
+      toNotify.emplace_back(std::move(sub));
     }
 
     wlock->collectGarbage();
 
-    if (subscribers.empty()) {
+    if (!anySubscribers) {
       return false;
     }
 
-    wlock->items.emplace_back(
-        std::make_shared<Item>(wlock->nextSerial++, std::move(payload)));
+    for (auto& payload : payloads) {
+      // Coalesce with the most recent item if it carries an identical
+      // payload that no subscriber has observed yet; repeatedly published
+      // idempotent payloads (eg: `settled` during an event storm) would
+      // otherwise pile up behind a slow consumer.  We still ping the
+      // subscribers below in that case.
+      bool coalesced = !wlock->items.empty() &&
+          wlock->items.back()->serial > maxSeenSerial &&
+          json_equal(wlock->items.back()->payload, payload);
+
+      if (!coalesced) {
+        wlock->items.emplace_back(
+            std::make_shared<Item>(wlock->nextSerial++, std::move(payload)));
+      }
+    }
+
+    // Respect the retention bound: a wedged subscriber must not pin
+    // every payload published during an event storm.  Laggards skip
+    // ahead to the oldest retained item on their next getPending.
+    if (maxItems_) {
+      while (wlock->items.size() > maxItems_) {
+        wlock->items.pop_front();
+        ++wlock->droppedItems;
+      }
+    }
   }
 
   // and notify them outside of the lock
-  for (auto& sub : subscribers) {
+  for (auto& sub : toNotify) {
     auto& n = sub->getNotify();
     if (n) {
       n();
@@ -183,6 +241,8 @@ json_ref Publisher::getDebugInfo() const {
 
   auto rlock = state_.rlock();
   ret.set("next_serial", json_integer(rlock->nextSerial));
+  ret.set("dropped_items", json_integer(rlock->droppedItems));
+  ret.set("deferred_wakeups", json_integer(rlock->deferredWakeups));
 
   std::vector<json_ref> subscribers_arr;
 
@@ -191,6 +251,7 @@ json_ref Publisher::getDebugInfo() const {
     if (sub) {
       auto sub_json = json_object({
           {"serial", json_integer(sub->getSerial())},
+          {"max_inflight", json_integer(sub->getMaxInflight())},
       });
       if (auto& info = sub->getInfo()) {
         sub_json.set("info", json_ref(*info));
@@ -19,6 +19,12 @@ namespace watchman {
 
 class Publisher : public std::enable_shared_from_this<Publisher> {
  public:
+  // maxItems bounds the number of retained items: when the queue grows
+  // past it because the slowest subscriber has stopped consuming, the
+  // oldest items are dropped so that a wedged consumer cannot pin every
+  // payload published during an event storm.  0 means never drop.
+  explicit Publisher(size_t maxItems = 0) : maxItems_(maxItems) {}
+
   struct Item {
     Item(uint64_t s, json_ref p) : serial{s}, payload{std::move(p)} {}
 
@@ -46,12 +52,16 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
     // Information for debugging purposes
     const std::optional<json_ref> info_;
 
+    // Advertised flow control bound; see subscribe().
+    const size_t maxInflight_;
+
    public:
     ~Subscriber();
     Subscriber(
         std::shared_ptr<Publisher> pub,
         Notifier notify,
-        const std::optional<json_ref>& info);
+        const std::optional<json_ref>& info,
+        size_t maxInflight);
     Subscriber(const Subscriber&) = delete;
 
     // Returns all as yet unseen published items for this subscriber.
@@ -61,6 +71,10 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
       return serial_;
     }
 
+    size_t getMaxInflight() const {
+      return maxInflight_;
+    }
+
     Notifier& getNotify() {
       return notify_;
     }
@@ -73,9 +87,18 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
   // Register a new subscriber.
   // When the Subscriber object is released, the registration is
   // automatically removed.
+  //
+  // maxInflight advertises the subscriber's flow control bound: while it
+  // already has at least that many unconsumed items, further publishes
+  // append to its backlog without waking it again.  Because getPending
+  // always drains everything unseen, the one wakeup it already has
+  // pending delivers the whole accumulated batch; 0 (the default) wakes
+  // it on every publish.  Consumers that fully drain getPending on each
+  // wakeup should advertise 1.
   std::shared_ptr<Subscriber> subscribe(
       Notifier notify,
-      const std::optional<json_ref>& info = std::nullopt);
+      const std::optional<json_ref>& info = std::nullopt,
+      size_t maxInflight = 0);
 
   // Returns true if there are any subscribers.
   // This is racy and intended to be used to gate building a payload
@@ -86,6 +109,12 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
   // Returns true if the item was queued.
   bool enqueue(json_ref&& payload);
 
+  // Enqueue a group of items as a single generation: one lock
+  // acquisition, consecutive serials and at most one wakeup per
+  // subscriber, however many payloads the generation carries.
+  // Returns true if any item was queued.
+  bool enqueueBatch(std::vector<json_ref>&& payloads);
+
   // Return debugging info useful for state inspection.
   json_ref getDebugInfo() const;
 
@@ -99,10 +128,16 @@ class Publisher : public std::enable_shared_from_this<Publisher> {
     std::deque<std::shared_ptr<const Item>> items;
     // The subscribers
     std::vector<std::weak_ptr<Subscriber>> subscribers;
+    // Number of items dropped to respect maxItems_
+    uint64_t droppedItems{0};
+    // Number of wakeups suppressed because a subscriber was already at
+    // its advertised max-inflight bound
+    uint64_t deferredWakeups{0};
 
     void collectGarbage();
     void enqueue(json_ref&& payload);
   };
+  const size_t maxItems_;
   folly::Synchronized<state> state_;
 
   friend class Subscriber;
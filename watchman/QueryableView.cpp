@@ -16,6 +16,11 @@ QueryableView::QueryableView(const w_string& root_path, bool requiresCrawl)
 
 QueryableView::~QueryableView() = default;
 
+std::unique_ptr<SCM> QueryableView::exchangeSCM(std::unique_ptr<SCM> scm) {
+  std::swap(scm_, scm);
+  return scm;
+}
+
 /** Perform a time-based (since) query and emit results to the supplied
  * query context */
 void QueryableView::timeGenerator(const Query*, QueryContext*) const {
@@ -31,6 +36,12 @@ void QueryableView::globGenerator(const Query*, QueryContext*) const {
   throw QueryExecError("globGenerator not implemented");
 }
 
+void QueryableView::suffixGenerator(const Query* query, QueryContext* ctx)
+    const {
+  // Views without a suffix index evaluate the equivalent glob patterns.
+  globGenerator(query, ctx);
+}
+
 void QueryableView::allFilesGenerator(const Query*, QueryContext*) const {
   throw QueryExecError("allFilesGenerator not implemented");
 }
@@ -8,10 +8,13 @@
 #pragma once
 
 #include <folly/futures/Future.h>
+#include <optional>
 #include <vector>
 #include "watchman/Clock.h"
 #include "watchman/CookieSync.h"
+#include "watchman/PendingCollection.h"
 #include "watchman/PerfSample.h"
+#include "watchman/fs/FileDescriptor.h"
 #include "watchman/watchman_string.h"
 
 namespace watchman {
@@ -44,6 +47,13 @@ class QueryableView : public std::enable_shared_from_this<QueryableView> {
 
   virtual void globGenerator(const Query* query, QueryContext* ctx) const;
 
+  /**
+   * Walks files whose name suffix is in the query's suffix set.
+   * The default delegates to the glob generator, which can evaluate the
+   * equivalent glob patterns compiled by parse_suffixes().
+   */
+  virtual void suffixGenerator(const Query* query, QueryContext* ctx) const;
+
   virtual void allFilesGenerator(const Query* query, QueryContext* ctx) const;
 
   virtual ClockPosition getMostRecentRootNumberAndTickValue() const = 0;
@@ -74,6 +84,29 @@ class QueryableView : public std::enable_shared_from_this<QueryableView> {
   virtual bool doAnyOfTheseFilesExist(
       const std::vector<w_string>& fileNames) const = 0;
 
+  /**
+   * Returns true if anything at or under `path` (a fully qualified
+   * directory path) may have changed since the given tick.  Returning
+   * false is a guarantee that a query scoped to that subtree with that
+   * basis would observe nothing new, so scoped subscriptions use this
+   * to skip evaluation when a settle only touched disjoint subtrees.
+   * Views that do not track recent changes must return true.
+   */
+  virtual bool subtreeMayHaveChangedSince(
+      const w_string& /*path*/,
+      ClockTicks /*sinceTick*/,
+      CaseSensitivity /*caseSensitive*/) const {
+    return true;
+  }
+
+  /**
+   * Invoked before a query synchronizes and generates, giving the view
+   * a chance to materialize lazily-crawled subtrees the query's scope
+   * touches (see the `lazy_dirs` config option).  The default does
+   * nothing.
+   */
+  virtual void prepareForQuery(const Query& /*query*/) {}
+
   bool isVCSOperationInProgress() const;
 
   /**
@@ -89,17 +122,67 @@ class QueryableView : public std::enable_shared_from_this<QueryableView> {
    */
   virtual void wakeThreads() {}
 
+  /**
+   * Queue a recursive re-stat of the given subtree through the normal
+   * pending stream, leaving clocks elsewhere in the tree untouched.
+   * Returns false when this view cannot scope the work, in which case
+   * the caller should fall back to a full recrawl.  See
+   * Root::scheduleSubtreeRecrawl().
+   */
+  virtual bool rescanSubtree(const w_string& /*path*/) {
+    return false;
+  }
+
+  /**
+   * Human readable description of where this view's helper threads were
+   * placed (cpu pinning), for debug-status.  Empty when no placement
+   * policy is in effect.
+   */
+  virtual w_string threadPlacement() const {
+    return w_string{};
+  }
+
+  /**
+   * Counters for the pending-queue disk spill tier, for debug-status.
+   * Returns nullopt when this view has no such queue or the tier is
+   * not armed.
+   */
+  virtual std::optional<PendingSpillStats> pendingSpillStats() {
+    return std::nullopt;
+  }
+
   virtual const w_string& getName() const = 0;
   virtual json_ref getWatcherDebugInfo() const = 0;
   virtual void clearWatcherDebugInfo() = 0;
   FOLLY_NODISCARD virtual folly::SemiFuture<folly::Unit>
   waitUntilReadyToQuery() = 0;
 
+  /**
+   * Scoped variant: resolves as soon as the view can answer queries
+   * whose paths all fall under `scope`, which may be well before the
+   * whole view is ready.  The default conservatively delegates to
+   * whole-view readiness; views that crawl incrementally override this
+   * (see InMemoryView's hint-prioritized cold start).
+   */
+  FOLLY_NODISCARD virtual folly::SemiFuture<folly::Unit> waitUntilReadyToQuery(
+      const w_string& /*scope*/) {
+    return waitUntilReadyToQuery();
+  }
+
   // Return the SCM detected for this watched root
   SCM* getSCM() const {
     return scm_.get();
   }
 
+ protected:
+  /**
+   * Exchange the SCM implementation detected at construction time for a
+   * replacement, returning the previous instance.  The Eden view uses
+   * this to layer thrift-backed fast paths over the detected SCM; most
+   * views keep the detected instance.
+   */
+  std::unique_ptr<SCM> exchangeSCM(std::unique_ptr<SCM> scm);
+
  private:
   // The source control system that we detected during initialization
   std::unique_ptr<SCM> scm_;
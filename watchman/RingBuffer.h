@@ -7,7 +7,12 @@
 
 #pragma once
 
+#include <folly/Synchronized.h>
 #include <folly/experimental/LockFreeRingBuffer.h>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace watchman {
 
@@ -53,4 +58,72 @@ class RingBuffer {
   std::atomic<typename folly::LockFreeRingBuffer<T>::Cursor> lastClear_;
 };
 
+/**
+ * A set of fixed-size lock-free rings, one per writing thread.
+ *
+ * write() touches only the calling thread's own ring, so concurrent
+ * writers (the iothread and crawl pool workers) never bounce a shared
+ * head cursor's cache line between cores; that is what makes the log
+ * cheap enough to leave enabled in production.  readAll() concatenates
+ * every thread's entries in no particular order across threads; the
+ * caller sorts by whatever timestamp the entry carries.  Rings of
+ * exited threads are retained so their recent history stays readable.
+ */
+template <typename T>
+class PerThreadRingLog {
+ public:
+  explicit PerThreadRingLog(uint32_t perThreadCapacity)
+      : perThreadCapacity_{perThreadCapacity} {}
+
+  void write(const T& entry) {
+    myRing().write(entry);
+  }
+
+  std::vector<T> readAll() const {
+    std::vector<T> entries;
+    auto rings = rings_.rlock();
+    for (auto& ring : *rings) {
+      for (auto& entry : ring->readAll()) {
+        entries.push_back(std::move(entry));
+      }
+    }
+    return entries;
+  }
+
+  void clear() {
+    auto rings = rings_.rlock();
+    for (auto& ring : *rings) {
+      ring->clear();
+    }
+  }
+
+ private:
+  RingBuffer<T>& myRing() {
+    // Keyed by instance id rather than `this` so that a new log
+    // allocated at a recycled address cannot alias a dead one's slot.
+    // The map pins each ring for the life of the thread, which is a
+    // slow leak only if views are churned endlessly; views live for
+    // the duration of a watch, so in practice this is a handful of
+    // entries per thread.
+    static thread_local std::
+        unordered_map<uint64_t, std::shared_ptr<RingBuffer<T>>>
+            threadRings;
+    auto& slot = threadRings[id_];
+    if (!slot) {
+      slot = std::make_shared<RingBuffer<T>>(perThreadCapacity_);
+      rings_.wlock()->push_back(slot);
+    }
+    return *slot;
+  }
+
+  static uint64_t nextId() {
+    static std::atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  const uint32_t perThreadCapacity_;
+  const uint64_t id_{nextId()};
+  folly::Synchronized<std::vector<std::shared_ptr<RingBuffer<T>>>> rings_;
+};
+
 } // namespace watchman
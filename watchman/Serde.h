@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include "watchman/bser.h"
 #include "watchman/thirdparty/jansson/jansson.h"
 
 /**
@@ -21,6 +22,10 @@ Brief API overview:
 `serde::decode<T>(json)` decodes a JSON value into T, or throws an exception
 if not possible.
 
+`serde::decodeBser<T>(buf, end)` decodes a BSER-encoded buffer directly into
+T, reading fields in place rather than materializing intermediate json_ref
+values.
+
 To define how a struct is mapped, derive from `serde::Object` and implement a
 `map` template function. See the `serde::Object` documentation.
 
@@ -84,6 +89,44 @@ class FieldDecoder {
   const std::unordered_map<w_string, json_ref>& map_;
 };
 
+/**
+ * Decodes the fields of a serde::Object straight from an encoded BSER
+ * object. `map` runs once to bind each declared field to its key; the
+ * encoded object is then scanned in a single pass, dispatching each key
+ * to its binding and skipping unknown keys in place. No intermediate
+ * key/value map is built.
+ */
+class BserFieldDecoder {
+ public:
+  template <size_t N, typename T>
+  void operator()(const char (&name)[N], T& field);
+
+  template <size_t N, typename T>
+  void required(const char (&name)[N], T& field);
+
+  template <size_t N, typename T, typename P>
+  void skip_if(const char (&name)[N], T& field, P&& predicate);
+
+  template <size_t N, typename T>
+  void skip_if_default(const char (&name)[N], T& field);
+
+  void decodeFrom(const BserValue& value);
+
+ private:
+  struct Binding {
+    std::string_view name;
+    void* field;
+    void (*assign)(void* field, const BserValue& value);
+    bool required;
+    bool seen;
+  };
+
+  template <size_t N, typename T>
+  void bind(const char (&name)[N], T& field, bool required);
+
+  std::vector<Binding> bindings_;
+};
+
 } // namespace detail
 
 /**
@@ -413,6 +456,168 @@ struct Serde<Nothing> {
   }
 };
 
+// BSER-Direct Decoding
+//
+// BserSerde mirrors Serde, but reads values straight from the encoded
+// BSER buffer via a BserValue cursor rather than from a json_ref DOM.
+// The primary template falls back to materializing just its own subtree,
+// so any type with only a Serde specialization keeps working; add a
+// BserSerde specialization when a type is hot enough to care.
+
+template <typename T, typename Enable = void>
+struct BserSerde {
+  static T fromBser(const BserValue& v) {
+    return decode<T>(v.toJson());
+  }
+};
+
+template <>
+struct BserSerde<json_ref> {
+  static json_ref fromBser(const BserValue& v) {
+    return v.toJson();
+  }
+};
+
+template <>
+struct BserSerde<bool> {
+  static bool fromBser(const BserValue& v) {
+    return v.asBool();
+  }
+};
+
+template <>
+struct BserSerde<json_int_t> {
+  static json_int_t fromBser(const BserValue& v) {
+    return v.asInteger();
+  }
+};
+
+template <>
+struct BserSerde<w_string> {
+  static w_string fromBser(const BserValue& v) {
+    return v.asWString();
+  }
+};
+
+template <>
+struct BserSerde<std::string> {
+  static std::string fromBser(const BserValue& v) {
+    auto piece = v.asStringPiece();
+    return std::string{piece};
+  }
+};
+
+/**
+ * Attempt to decode a C++ value directly from the BSER-encoded value
+ * spanning [buf, end). Equivalent to `decode<T>(bunser(buf, end))`, but
+ * objects, arrays, strings, and integers are read from the buffer in
+ * place; in particular, a serde::Object is decoded in a single pass over
+ * its encoded fields without building the intermediate key/value map.
+ *
+ * Throws BserParseError on malformed input, and MissingKey if a required
+ * field is absent.
+ */
+template <typename T>
+T decodeBser(const char* buf, const char* end);
+
+/**
+ * Recursion entry point for BSER-direct decoding; the cursor analogue of
+ * `decode`.
+ */
+template <typename T>
+T decodeBserValue(const BserValue& v) {
+  using Base = std::remove_const_t<std::remove_reference_t<T>>;
+  if constexpr (std::is_integral_v<Base> && !std::is_same_v<Base, bool>) {
+    // TODO: bounds-checking, as in decode()
+    return BserSerde<json_int_t>::fromBser(v);
+  } else {
+    return BserSerde<Base>::fromBser(v);
+  }
+}
+
+template <typename T>
+T decodeBser(const char* buf, const char* end) {
+  return decodeBserValue<T>(BserValue{buf, end});
+}
+
+template <typename T>
+struct BserSerde<T, std::enable_if_t<std::is_base_of_v<Object, T>>> {
+  static T fromBser(const BserValue& v) {
+    T rv;
+    detail::BserFieldDecoder decoder;
+    rv.map(decoder);
+    decoder.decodeFrom(v);
+    return rv;
+  }
+};
+
+template <typename T>
+struct BserSerde<std::optional<T>> {
+  static std::optional<T> fromBser(const BserValue& v) {
+    if (v.isNull()) {
+      return std::nullopt;
+    }
+    return decodeBserValue<T>(v);
+  }
+};
+
+template <typename T>
+struct BserSerde<std::vector<T>> {
+  static std::vector<T> fromBser(const BserValue& v) {
+    if (!v.isArray()) {
+      // BSER templates (and anything else exotic) take the DOM path.
+      return decode<std::vector<T>>(v.toJson());
+    }
+    std::vector<T> result;
+    v.eachArrayElement([&](const BserValue& element) {
+      result.push_back(decodeBserValue<T>(element));
+    });
+    return result;
+  }
+};
+
+namespace detail {
+
+template <size_t I, typename... E>
+struct WriteTupleBser {
+  static void write(std::tuple<E...>& tuple, size_t index, const BserValue& v) {
+    if constexpr (I < sizeof...(E)) {
+      if (index == I) {
+        auto& element = std::get<I>(tuple);
+        element = decodeBserValue<std::remove_reference_t<decltype(element)>>(v);
+      } else {
+        WriteTupleBser<I + 1, E...>::write(tuple, index, v);
+      }
+    }
+  }
+};
+
+} // namespace detail
+
+template <size_t Required, typename... E>
+struct BserSerde<Array<Required, E...>> {
+  using Tuple = Array<Required, E...>;
+
+  static Tuple fromBser(const BserValue& v) {
+    Tuple tuple{};
+
+    if (v.arraySize() < Required) {
+      // TODO: make a better exception type
+      throw std::domain_error("array must have at least N elements");
+    }
+
+    size_t index = 0;
+    v.eachArrayElement([&](const BserValue& element) {
+      if (index < sizeof...(E)) {
+        detail::WriteTupleBser<0, E...>::write(tuple, index, element);
+      }
+      ++index;
+    });
+
+    return tuple;
+  }
+};
+
 namespace detail {
 
 template <size_t N, typename T>
@@ -482,6 +687,59 @@ void FieldDecoder::skip_if_default(const char (&name)[N], T& field) {
   (*this)(name, field);
 }
 
+template <size_t N, typename T>
+void BserFieldDecoder::bind(const char (&name)[N], T& field, bool required) {
+  // Fields left untouched by the scan keep this value, matching
+  // FieldDecoder's treatment of missing keys.
+  field = T{};
+  bindings_.push_back(Binding{
+      std::string_view{name, N - 1},
+      &field,
+      [](void* field, const BserValue& value) {
+        *static_cast<T*>(field) = decodeBserValue<T>(value);
+      },
+      required,
+      false});
+}
+
+template <size_t N, typename T>
+void BserFieldDecoder::operator()(const char (&name)[N], T& field) {
+  bind(name, field, false);
+}
+
+template <size_t N, typename T>
+void BserFieldDecoder::required(const char (&name)[N], T& field) {
+  bind(name, field, true);
+}
+
+template <size_t N, typename T, typename P>
+void BserFieldDecoder::skip_if(const char (&name)[N], T& field, P&&) {
+  bind(name, field, false);
+}
+
+template <size_t N, typename T>
+void BserFieldDecoder::skip_if_default(const char (&name)[N], T& field) {
+  bind(name, field, false);
+}
+
+inline void BserFieldDecoder::decodeFrom(const BserValue& value) {
+  value.eachObjectField([&](std::string_view key, const BserValue& v) {
+    for (auto& binding : bindings_) {
+      if (!binding.seen && binding.name == key) {
+        binding.assign(binding.field, v);
+        binding.seen = true;
+        return;
+      }
+    }
+    // Unknown keys are never an error; see Protocol Evolution above.
+  });
+  for (auto& binding : bindings_) {
+    if (binding.required && !binding.seen) {
+      throw MissingKey{"key is missing"};
+    }
+  }
+}
+
 } // namespace detail
 
 } // namespace watchman::serde
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/ShmRing.h"
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <new>
+#include <system_error>
+
+#include <fmt/core.h>
+
+namespace watchman {
+
+static_assert(
+    std::atomic<uint64_t>::is_always_lock_free,
+    "shared memory cursors must be lock free");
+static_assert(sizeof(ShmRing::RecordHeader) == 16);
+
+namespace {
+
+constexpr size_t kPageSize = 4096;
+
+size_t roundUpToPage(size_t n) {
+  return (n + kPageSize - 1) & ~(kPageSize - 1);
+}
+
+} // namespace
+
+std::unique_ptr<ShmRing> ShmRing::create(
+    size_t capacityBytes,
+    uint64_t clientId) {
+  auto capacity = roundUpToPage(capacityBytes);
+  auto name = fmt::format("/watchman-{}-{}-{}", getuid(), getpid(), clientId);
+
+  auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1 && errno == EEXIST) {
+    // Stale segment from a crashed predecessor with the same pid;
+    // nothing can legitimately be attached to it.
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  }
+  if (fd == -1) {
+    throw std::system_error(
+        errno, std::generic_category(), fmt::format("shm_open({})", name));
+  }
+
+  auto total = sizeof(Header) + capacity;
+  if (ftruncate(fd, total) != 0) {
+    int err = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::system_error(
+        err, std::generic_category(), fmt::format("ftruncate({})", name));
+  }
+
+  auto* mapping =
+      mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int err = errno;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::system_error(
+        err, std::generic_category(), fmt::format("mmap({})", name));
+  }
+
+  // Placement-new starts the lifetime of the atomics; the storage is
+  // already zeroed by ftruncate.
+  auto* hdr = new (mapping) Header{};
+  hdr->magic = kMagic;
+  hdr->version = kVersion;
+  hdr->capacity = uint32_t(capacity);
+
+  return std::unique_ptr<ShmRing>(
+      new ShmRing(std::move(name), mapping, capacity));
+}
+
+ShmRing::ShmRing(std::string name, void* mapping, size_t capacity)
+    : name_{std::move(name)}, mapping_{mapping}, capacity_{capacity} {}
+
+ShmRing::~ShmRing() {
+  munmap(mapping_, sizeof(Header) + capacity_);
+  shm_unlink(name_.c_str());
+}
+
+uint64_t ShmRing::droppedCount() const {
+  return header()->dropped.load(std::memory_order_relaxed);
+}
+
+std::optional<uint64_t> ShmRing::tryAppend(const void* data, size_t len) {
+  auto* hdr = header();
+
+  auto need = (sizeof(RecordHeader) + len + 7) & ~uint64_t{7};
+  if (need > capacity_) {
+    hdr->dropped.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+
+  // We are the sole writer, so a relaxed load of our own cursor is
+  // fine; the reader's cursor needs acquire so that reusing the bytes
+  // it released happens-after it finished reading them.
+  auto writePos = hdr->writePos.load(std::memory_order_relaxed);
+  auto readPos = hdr->readPos.load(std::memory_order_acquire);
+
+  auto offset = writePos % capacity_;
+  auto contiguous = capacity_ - offset;
+  // If the record won't fit before the end of the storage, burn the
+  // tail with a wrap marker and start it at offset zero instead.
+  uint64_t skip = contiguous < need ? contiguous : 0;
+
+  if (capacity_ - (writePos - readPos) < skip + need) {
+    hdr->dropped.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+
+  auto* base = ringBase();
+  if (skip) {
+    uint32_t marker = kWrapMarker;
+    memcpy(base + offset, &marker, sizeof(marker));
+    writePos += skip;
+    offset = 0;
+  }
+
+  RecordHeader rh{uint32_t(len), 0, nextSeq_};
+  memcpy(base + offset, &rh, sizeof(rh));
+  memcpy(base + offset + sizeof(rh), data, len);
+
+  // Publish the bytes before the cursor, and the cursor before the
+  // sequence number the control message refers to.
+  hdr->writePos.store(writePos + need, std::memory_order_release);
+  hdr->writeSeq.store(nextSeq_, std::memory_order_release);
+
+  return nextSeq_++;
+}
+
+} // namespace watchman
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace watchman {
+
+/**
+ * Single-producer single-consumer byte ring in a POSIX shared memory
+ * segment, used as an opt-in fast path for delivering unilateral PDUs
+ * to a co-located client.  The client negotiates the channel with the
+ * `shm-channel` command; control traffic and wakeups stay on the unix
+ * socket, only payload bytes move through the ring.
+ *
+ * Layout is a Header followed by `capacity` bytes of storage.  Records
+ * are 8-byte aligned: a RecordHeader (length, sequence number) followed
+ * by the payload, which is a complete BSER v2 PDU.  A length equal to
+ * kWrapMarker tells the reader to jump back to the start of the ring;
+ * because all cursors advance in multiples of 8 there is always room
+ * for at least the length field at the end of the storage.
+ *
+ * The daemon is the only writer and the attached client the only
+ * reader.  The writer owns writePos/writeSeq and the reader owns
+ * readPos; each side only loads the other's cursor, so no locks are
+ * needed.  When a record does not fit the writer gives up rather than
+ * waiting: the caller falls back to the socket and the drop is counted
+ * in the header for the client to observe.
+ */
+class ShmRing {
+ public:
+  static constexpr uint64_t kMagic = 0x77617463686d7368ULL; // "watchmsh"
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kWrapMarker = UINT32_MAX;
+
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    /// Sequence number of the most recently published record.
+    std::atomic<uint64_t> writeSeq;
+    /// Byte cursors; monotonically increasing, interpreted mod capacity.
+    std::atomic<uint64_t> writePos;
+    std::atomic<uint64_t> readPos;
+    /// Payloads that did not fit and fell back to the socket.
+    std::atomic<uint64_t> dropped;
+  };
+
+  struct RecordHeader {
+    uint32_t len;
+    uint32_t pad;
+    uint64_t seq;
+  };
+
+  /**
+   * Creates and maps a new segment sized to hold `capacityBytes` of
+   * ring storage (rounded up to a page multiple).  The segment is
+   * created mode 0600 so only the owning uid can attach.  Throws
+   * std::system_error on failure.
+   */
+  static std::unique_ptr<ShmRing> create(
+      size_t capacityBytes,
+      uint64_t clientId);
+
+  /// Unmaps and unlinks the segment.
+  ~ShmRing();
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  /// The shm_open() name the client passes to attach.
+  const std::string& name() const {
+    return name_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  uint64_t droppedCount() const;
+
+  /**
+   * Appends one payload.  Returns its sequence number on success, or
+   * std::nullopt when the ring lacks space (the drop is counted and
+   * the caller should send the payload over the socket instead).
+   */
+  std::optional<uint64_t> tryAppend(const void* data, size_t len);
+
+ private:
+  ShmRing(std::string name, void* mapping, size_t capacity);
+
+  Header* header() const {
+    return static_cast<Header*>(mapping_);
+  }
+
+  char* ringBase() const {
+    return static_cast<char*>(mapping_) + sizeof(Header);
+  }
+
+  const std::string name_;
+  void* const mapping_;
+  const size_t capacity_;
+  uint64_t nextSeq_{1};
+};
+
+} // namespace watchman
+
+#endif
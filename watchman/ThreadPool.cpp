@@ -6,10 +6,18 @@
  */
 
 #include "watchman/ThreadPool.h"
+#include <algorithm>
 #include "watchman/Logging.h"
 
 namespace watchman {
 
+namespace {
+// Identifies the pool and queue owned by the current thread, if it is a
+// worker, so that tasks spawned by a task stay on the spawner's queue.
+thread_local ThreadPool* currentPool = nullptr;
+thread_local size_t currentWorkerIndex = 0;
+} // namespace
+
 ThreadPool& getThreadPool() {
   static ThreadPool pool;
   return pool;
@@ -20,7 +28,7 @@ ThreadPool::~ThreadPool() {
 }
 
 void ThreadPool::start(size_t numWorkers, size_t maxItems) {
-  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_lock<std::mutex> lock(idleMutex_);
   if (!workers_.empty()) {
     throw std::runtime_error("ThreadPool already started");
   }
@@ -28,60 +36,184 @@ void ThreadPool::start(size_t numWorkers, size_t maxItems) {
     throw std::runtime_error("Cannot restart a stopped pool");
   }
   maxItems_ = maxItems;
+  lowPriorityLimit_ = std::max<size_t>(1, numWorkers / 2);
+
+  for (auto i = 0U; i < numWorkers; ++i) {
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  }
 
   for (auto i = 0U; i < numWorkers; ++i) {
     workers_.emplace_back([this, i]() noexcept {
       w_set_thread_name("ThreadPool-", i);
-      runWorker();
+      runWorker(i);
     });
   }
 }
 
-void ThreadPool::runWorker() {
-  while (true) {
-    folly::Func task;
+bool ThreadPool::tryRunOneTask(size_t myIndex) {
+  folly::Func task;
 
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      condition_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
-      if (stopping_ && tasks_.empty()) {
-        return;
+  {
+    auto& q = *queues_[myIndex];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+  }
+
+  if (!task) {
+    // Nothing of our own; steal from the back of a peer's queue
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      auto& q = *queues_[(myIndex + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        break;
       }
-      task = std::move(tasks_.front());
-      tasks_.pop_front();
     }
+  }
 
+  if (task) {
+    pendingTasks_.fetch_sub(1, std::memory_order_acq_rel);
     task();
+    return true;
+  }
+
+  // No normal work anywhere; consider a background task if we're under
+  // the concurrency cap (ignored while stopping so the queue drains).
+  // The slot is claimed before looking at the queue: merely reading
+  // the counter first would let a burst of workers all pass the check
+  // while it still reads zero and overshoot the cap together.
+  if (lowPriorityRunning_.fetch_add(1, std::memory_order_acq_rel) >=
+          lowPriorityLimit_ &&
+      !stopping_.load(std::memory_order_acquire)) {
+    lowPriorityRunning_.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(lowPriorityQueue_.mutex);
+    if (!lowPriorityQueue_.tasks.empty()) {
+      task = std::move(lowPriorityQueue_.tasks.front());
+      lowPriorityQueue_.tasks.pop_front();
+    }
+  }
+  if (!task) {
+    lowPriorityRunning_.fetch_sub(1, std::memory_order_acq_rel);
+    return false;
+  }
+
+  pendingLowPriority_.fetch_sub(1, std::memory_order_acq_rel);
+  task();
+  lowPriorityRunning_.fetch_sub(1, std::memory_order_acq_rel);
+  if (pendingLowPriority_.load(std::memory_order_acquire) > 0) {
+    // We just freed a background slot; wake a sleeper for the backlog.
+    {
+      std::lock_guard<std::mutex> lock(idleMutex_);
+    }
+    condition_.notify_one();
+  }
+  return true;
+}
+
+void ThreadPool::runWorker(size_t myIndex) {
+  currentPool = this;
+  currentWorkerIndex = myIndex;
+
+  while (true) {
+    if (tryRunOneTask(myIndex)) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idleMutex_);
+    condition_.wait(lock, [this] {
+      return stopping_.load(std::memory_order_acquire) ||
+          pendingTasks_.load(std::memory_order_acquire) > 0 ||
+          (pendingLowPriority_.load(std::memory_order_acquire) > 0 &&
+           lowPriorityRunning_.load(std::memory_order_acquire) <
+               lowPriorityLimit_);
+    });
+    if (stopping_ && pendingTasks_.load(std::memory_order_acquire) == 0 &&
+        pendingLowPriority_.load(std::memory_order_acquire) == 0) {
+      return;
+    }
   }
 }
 
 void ThreadPool::stop(bool join) {
   {
-    std::unique_lock<std::mutex> lock(mutex_);
-    stopping_ = true;
+    std::unique_lock<std::mutex> lock(idleMutex_);
+    stopping_.store(true, std::memory_order_release);
   }
   condition_.notify_all();
 
   if (join) {
     for (auto& worker : workers_) {
-      worker.join();
+      if (worker.joinable()) {
+        worker.join();
+      }
     }
   }
 }
 
 void ThreadPool::add(folly::Func func) {
+  if (stopping_.load(std::memory_order_acquire)) {
+    throw std::runtime_error("cannot add tasks after pool has stopped");
+  }
+  if (queues_.empty()) {
+    throw std::runtime_error("cannot add tasks before the pool has started");
+  }
+  if (pendingTasks_.load(std::memory_order_acquire) + 1 >= maxItems_) {
+    throw std::runtime_error("thread pool queue is full");
+  }
+
+  // Tasks spawned by a worker go on that worker's own queue; external
+  // producers distribute round-robin across the queues.
+  size_t index = currentPool == this
+      ? currentWorkerIndex
+      : nextQueue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
   {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (stopping_) {
-      throw std::runtime_error("cannot add tasks after pool has stopped");
-    }
-    if (tasks_.size() + 1 >= maxItems_) {
-      throw std::runtime_error("thread pool queue is full");
-    }
+    auto& q = *queues_[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.emplace_back(std::move(func));
+  }
+  pendingTasks_.fetch_add(1, std::memory_order_release);
 
-    tasks_.emplace_back(std::move(func));
+  {
+    // Pairs with the predicate check in runWorker: a worker between
+    // checking pendingTasks_ and blocking holds idleMutex_, so by the
+    // time we acquire and release it here, any such worker is actually
+    // waiting and will observe the notification.
+    std::lock_guard<std::mutex> lock(idleMutex_);
+  }
+  condition_.notify_one();
+}
+
+void ThreadPool::addLowPriority(folly::Func func) {
+  if (stopping_.load(std::memory_order_acquire)) {
+    throw std::runtime_error("cannot add tasks after pool has stopped");
+  }
+  if (queues_.empty()) {
+    throw std::runtime_error("cannot add tasks before the pool has started");
   }
+  if (pendingTasks_.load(std::memory_order_acquire) +
+          pendingLowPriority_.load(std::memory_order_acquire) + 1 >=
+      maxItems_) {
+    throw std::runtime_error("thread pool queue is full");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(lowPriorityQueue_.mutex);
+    lowPriorityQueue_.tasks.emplace_back(std::move(func));
+  }
+  pendingLowPriority_.fetch_add(1, std::memory_order_release);
 
+  {
+    // Same wakeup pairing as add().
+    std::lock_guard<std::mutex> lock(idleMutex_);
+  }
   condition_.notify_one();
 }
 } // namespace watchman
@@ -7,8 +7,10 @@
 
 #pragma once
 #include <folly/Executor.h>
+#include <atomic>
 #include <condition_variable>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -16,7 +18,7 @@
 
 namespace watchman {
 
-// Almost the dumbest possible thread pool implementation.
+// A modest thread pool implementation.
 // This allows us to set an upper bound on the number of concurrent
 // tasks that are executed in the thread pool.  Contrast with
 // std::async which leaves it to the implementation to decide
@@ -24,6 +26,11 @@ namespace watchman {
 // thread pool with an unspecified number of threads.
 // Constraining the concurrency is important for watchman so
 // that we can limit the amount of I/O that we might induce.
+//
+// Each worker owns its own queue; producers distribute tasks
+// round-robin across the queues and idle workers steal from their
+// peers, so fine-grained tasks don't serialize every push and pop
+// on a single mutex at high core counts.
 
 class ThreadPool : public folly::Executor {
  public:
@@ -49,16 +56,52 @@ class ThreadPool : public folly::Executor {
   // If the thread pool has been stopped, throws a runtime_error.
   void add(folly::Func func) override;
 
+  // Run a function at background priority.  Workers only claim these
+  // when no normal task is runnable, and at most half of them execute
+  // background tasks at any one time, so long-running bodies (command
+  // handlers offloaded from client threads) cannot monopolize the pool.
+  void addLowPriority(folly::Func func);
+
  private:
+  // A per-worker task queue with its own lock.  The owning worker pops
+  // from the front; thieves take from the back to reduce contention on
+  // the same end of the deque.
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<folly::Func> tasks;
+  };
+
   std::vector<std::thread> workers_;
-  std::deque<folly::Func> tasks_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+  // Background-priority tasks.  A single shared queue is fine here:
+  // these tasks are coarse (seconds, not microseconds) so the lock is
+  // not a bottleneck.
+  WorkerQueue lowPriorityQueue_;
+  // Number of workers currently executing a background task, bounded
+  // by lowPriorityLimit_ (racy check-then-claim may exceed it by one
+  // transiently, which is harmless).
+  std::atomic<size_t> lowPriorityRunning_{0};
+  size_t lowPriorityLimit_{1};
 
-  std::mutex mutex_;
+  // Guards only the idle wait.  Producers take it briefly after
+  // publishing a task so that a worker that is about to go to sleep
+  // cannot miss the wakeup.
+  std::mutex idleMutex_;
   std::condition_variable condition_;
-  bool stopping_{false};
+  std::atomic<bool> stopping_{false};
+  // Total number of queued-but-unclaimed tasks across all normal
+  // queues; background tasks are counted separately so a worker does
+  // not busy-wait on work it is not allowed to claim.
+  std::atomic<size_t> pendingTasks_{0};
+  std::atomic<size_t> pendingLowPriority_{0};
+  std::atomic<size_t> nextQueue_{0};
   size_t maxItems_;
 
-  void runWorker();
+  void runWorker(size_t myIndex);
+  // Pop a task from our own queue, or steal one from a peer, and run it.
+  // Returns false if no task was available anywhere.
+  bool tryRunOneTask(size_t myIndex);
 };
 
 // Return a reference to the shared thread pool for the watchman process.
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/TimerWheel.h"
+#include "watchman/Logging.h"
+
+namespace watchman {
+
+TimerWheel& TimerWheel::get() {
+  static TimerWheel wheel;
+  return wheel;
+}
+
+TimerWheel::~TimerWheel() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+uint64_t TimerWheel::nowTick() const {
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - epoch_)
+                     .count();
+  return static_cast<uint64_t>(elapsed) / kTickMs;
+}
+
+TimerWheel::Handle TimerWheel::schedule(
+    std::chrono::milliseconds delay,
+    Callback fn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!started_) {
+    epoch_ = std::chrono::steady_clock::now();
+    thread_ = std::thread([this] { serviceThread(); });
+    started_ = true;
+  }
+  // Round up so a timer never fires early, and always at least one tick
+  // out so it lands ahead of the tick currently being drained.
+  uint64_t delayTicks =
+      (static_cast<uint64_t>(std::max<int64_t>(delay.count(), 0)) + kTickMs -
+       1) /
+      kTickMs;
+  auto handle = std::make_shared<Timer>(
+      std::move(fn), nowTick() + std::max<uint64_t>(delayTicks, 1));
+  insert(handle);
+  if (handle->dueTick_ < sleepingUntilTick_) {
+    cond_.notify_one();
+  }
+  return handle;
+}
+
+void TimerWheel::cancel(const Handle& handle) {
+  if (!handle) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  handle->cancelled_.store(true, std::memory_order_relaxed);
+  // Release the callback's captures now; the slot entry itself is
+  // discarded when its tick is drained.
+  handle->fn_ = nullptr;
+}
+
+void TimerWheel::insert(Handle handle) {
+  auto due = handle->dueTick_;
+  uint64_t delta = due > currentTick_ ? due - currentTick_ : 0;
+  // Pick the finest level whose slot span covers the remaining delay;
+  // anything past the top level's horizon is clamped there and takes
+  // another trip through insert() when its slot cascades.
+  int level = 0;
+  while (level < kLevels - 1 && (delta >> (kSlotBits * (level + 1))) != 0) {
+    ++level;
+  }
+  uint64_t slotTick = delta == 0 ? currentTick_ : due;
+  auto slot = (slotTick >> (kSlotBits * level)) & kSlotMask;
+  levels_[level].slots[slot].push_back(std::move(handle));
+  levels_[level].bitmap |= 1ull << slot;
+}
+
+void TimerWheel::advanceOneTick(std::vector<Callback>& due) {
+  ++currentTick_;
+  // When a level's worth of low bits rolls over, the next coarser slot
+  // becomes current: redistribute its timers to finer levels (or fire
+  // them this tick if they are already due).
+  for (int level = 1; level < kLevels; ++level) {
+    if ((currentTick_ & ((1ull << (kSlotBits * level)) - 1)) != 0) {
+      break;
+    }
+    auto slot = (currentTick_ >> (kSlotBits * level)) & kSlotMask;
+    auto pending = std::move(levels_[level].slots[slot]);
+    levels_[level].slots[slot].clear();
+    levels_[level].bitmap &= ~(1ull << slot);
+    for (auto& handle : pending) {
+      if (handle->cancelled_.load(std::memory_order_relaxed)) {
+        continue;
+      }
+      insert(std::move(handle));
+    }
+  }
+  auto slot = currentTick_ & kSlotMask;
+  auto firing = std::move(levels_[0].slots[slot]);
+  levels_[0].slots[slot].clear();
+  levels_[0].bitmap &= ~(1ull << slot);
+  for (auto& handle : firing) {
+    if (handle->cancelled_.load(std::memory_order_relaxed) || !handle->fn_) {
+      continue;
+    }
+    if (handle->dueTick_ > currentTick_) {
+      // Level 0 slots repeat every kSlotsPerLevel ticks, so a timer
+      // clamped here from a cascade can come up one lap early.
+      insert(std::move(handle));
+      continue;
+    }
+    due.push_back(std::move(handle->fn_));
+  }
+}
+
+uint64_t TimerWheel::nextDueTick() const {
+  uint64_t best = ~0ull;
+  for (int level = 0; level < kLevels; ++level) {
+    auto bitmap = levels_[level].bitmap;
+    auto base = currentTick_ >> (kSlotBits * level);
+    while (bitmap) {
+      auto slot = static_cast<uint64_t>(__builtin_ctzll(bitmap));
+      bitmap &= bitmap - 1;
+      auto delta = (slot - (base & kSlotMask) + kSlotsPerLevel) & kSlotMask;
+      if (delta == 0) {
+        delta = kSlotsPerLevel;
+      }
+      // For level 0 this is when the slot fires; for coarser levels it
+      // is when the slot cascades, which is never later than any timer
+      // it holds.
+      auto candidate = (base + delta) << (kSlotBits * level);
+      best = std::min(best, candidate);
+    }
+  }
+  return best;
+}
+
+void TimerWheel::serviceThread() noexcept {
+  w_set_thread_name("timerwheel");
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    auto next = nextDueTick();
+    if (next == ~0ull) {
+      sleepingUntilTick_ = ~0ull;
+      cond_.wait(lock);
+      continue;
+    }
+    auto nt = nowTick();
+    if (nt < next) {
+      sleepingUntilTick_ = next;
+      cond_.wait_until(
+          lock,
+          epoch_ + std::chrono::milliseconds(next * kTickMs));
+      sleepingUntilTick_ = ~0ull;
+      continue;
+    }
+    // The span up to the due tick holds no occupied slots, so jump it
+    // rather than stepping tick by tick.
+    if (next > currentTick_ + 1) {
+      currentTick_ = next - 1;
+    }
+    std::vector<Callback> due;
+    advanceOneTick(due);
+    if (!due.empty()) {
+      lock.unlock();
+      for (auto& fn : due) {
+        try {
+          fn();
+        } catch (const std::exception& exc) {
+          log(ERR, "timer wheel callback threw: ", exc.what(), "\n");
+        }
+      }
+      lock.lock();
+    }
+  }
+}
+
+} // namespace watchman
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "watchman/watchman_system.h"
+
+namespace watchman {
+
+/**
+ * A hierarchical timing wheel shared by every root in the process.
+ *
+ * Coarse deadlines (idle housekeeping, reap checks) used to be
+ * implemented as per-root waits with their own timeouts, so a daemon
+ * with hundreds of idle roots woke once per root per deadline.  The
+ * wheel hashes all timers into slots and its single service thread
+ * sleeps until the next non-empty slot is due, giving one wakeup per
+ * due instant process-wide regardless of the number of roots.
+ *
+ * Callbacks run on the service thread and must be cheap and non
+ * blocking -- typically a ping() that wakes the thread that owns the
+ * actual work.  A timer cancelled before it fires releases its callback
+ * immediately; cancellation that races the firing may still observe the
+ * callback run.
+ */
+class TimerWheel {
+ public:
+  using Callback = std::function<void()>;
+
+  class Timer {
+    friend class TimerWheel;
+
+   public:
+    explicit Timer(Callback fn, uint64_t dueTick)
+        : fn_{std::move(fn)}, dueTick_{dueTick} {}
+
+   private:
+    // Guarded by the owning wheel's mutex until extraction.
+    Callback fn_;
+    uint64_t dueTick_;
+    std::atomic<bool> cancelled_{false};
+  };
+  using Handle = std::shared_ptr<Timer>;
+
+  // Returns the process-wide wheel; the service thread starts on the
+  // first schedule() call.
+  static TimerWheel& get();
+
+  TimerWheel() = default;
+  ~TimerWheel();
+
+  // Arranges for fn to run on the service thread no earlier than
+  // `delay` from now (rounded up to the tick size).
+  Handle schedule(std::chrono::milliseconds delay, Callback fn);
+
+  // Prevents the timer from firing if it has not already been
+  // extracted for delivery, and drops its callback (and anything the
+  // callback captured).
+  void cancel(const Handle& handle);
+
+ private:
+  // 64 slots per level and four levels at a 16ms tick cover ~1s, ~65s,
+  // ~70min and ~130 days of horizon respectively; timers beyond the
+  // horizon re-enter the wheel when their clamped slot comes due.
+  static constexpr uint64_t kTickMs = 16;
+  static constexpr int kLevels = 4;
+  static constexpr int kSlotBits = 6;
+  static constexpr uint64_t kSlotsPerLevel = 1ull << kSlotBits;
+  static constexpr uint64_t kSlotMask = kSlotsPerLevel - 1;
+
+  struct Level {
+    std::array<std::vector<Handle>, kSlotsPerLevel> slots;
+    // Bit s set iff slots[s] is non-empty; lets the service thread
+    // compute the next due instant without scanning empty slots.
+    uint64_t bitmap{0};
+  };
+
+  void serviceThread() noexcept;
+  // All of the below require mutex_ to be held.
+  void insert(Handle handle);
+  void advanceOneTick(std::vector<Callback>& due);
+  uint64_t nextDueTick() const;
+  uint64_t nowTick() const;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::array<Level, kLevels> levels_;
+  uint64_t currentTick_{0};
+  // The tick the service thread is currently sleeping towards, so
+  // schedule() only wakes it for strictly earlier deadlines.
+  uint64_t sleepingUntilTick_{~0ull};
+  bool started_{false};
+  bool stopping_{false};
+  std::chrono::steady_clock::time_point epoch_;
+  std::thread thread_;
+};
+
+} // namespace watchman
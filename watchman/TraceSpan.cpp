@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/TraceSpan.h"
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace watchman {
+
+namespace {
+
+struct SpanRecord {
+  uint64_t traceId;
+  w_string name;
+  // Microseconds on the steady clock, so spans recorded by different
+  // threads order correctly against each other.
+  int64_t startUs;
+  int64_t durationUs;
+  w_string tid;
+};
+
+// A bounded ring of the most recent spans.  Bounded so that an
+// always-on recorder cannot grow without limit; 8k spans covers a few
+// thousand recent requests at a handful of spans each.
+constexpr size_t kMaxSpans = 8192;
+
+struct SpanRing {
+  std::vector<SpanRecord> spans;
+  // Index of the oldest record once the ring has wrapped.
+  size_t next{0};
+};
+
+folly::Synchronized<SpanRing>& spanRing() {
+  static folly::Synchronized<SpanRing> ring;
+  return ring;
+}
+
+thread_local uint64_t threadTraceId = 0;
+
+w_string currentThreadIdString() {
+  // Match the representation the logger uses for thread ids so spans
+  // can be lined up against log lines.
+  std::stringstream ss;
+  ss << std::this_thread::get_id();
+  auto str = ss.str();
+  return w_string{str.data(), str.size()};
+}
+
+} // namespace
+
+uint64_t traceNextId() {
+  static std::atomic<uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t currentTraceId() {
+  return threadTraceId;
+}
+
+TraceContext::TraceContext(uint64_t traceId) : saved_(threadTraceId) {
+  threadTraceId = traceId;
+}
+
+TraceContext::~TraceContext() {
+  threadTraceId = saved_;
+}
+
+TraceSpan::TraceSpan(w_string name)
+    : name_(std::move(name)), start_(std::chrono::steady_clock::now()) {}
+
+TraceSpan::~TraceSpan() {
+  traceRecordSpan(
+      threadTraceId, name_, start_, std::chrono::steady_clock::now() - start_);
+}
+
+void traceRecordSpan(
+    uint64_t traceId,
+    const w_string& name,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration duration) {
+  SpanRecord record{
+      traceId,
+      name,
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          start.time_since_epoch())
+          .count(),
+      std::chrono::duration_cast<std::chrono::microseconds>(duration).count(),
+      currentThreadIdString()};
+
+  auto ring = spanRing().wlock();
+  if (ring->spans.size() < kMaxSpans) {
+    ring->spans.push_back(std::move(record));
+  } else {
+    ring->spans[ring->next] = std::move(record);
+    ring->next = (ring->next + 1) % kMaxSpans;
+  }
+}
+
+json_ref traceCollectSpans() {
+  std::vector<SpanRecord> snapshot;
+  {
+    auto ring = spanRing().rlock();
+    snapshot.reserve(ring->spans.size());
+    // Oldest first: from the wrap point to the end, then the refilled
+    // prefix.
+    for (size_t i = ring->next; i < ring->spans.size(); ++i) {
+      snapshot.push_back(ring->spans[i]);
+    }
+    for (size_t i = 0; i < ring->next; ++i) {
+      snapshot.push_back(ring->spans[i]);
+    }
+  }
+
+  std::vector<json_ref> result;
+  result.reserve(snapshot.size());
+  for (auto& record : snapshot) {
+    result.push_back(json_object({
+        {"trace-id", json_integer(record.traceId)},
+        {"name", w_string_to_json(record.name)},
+        {"start-us", json_integer(record.startUs)},
+        {"duration-us", json_integer(record.durationUs)},
+        {"tid", w_string_to_json(record.tid)},
+    }));
+  }
+  return json_array(std::move(result));
+}
+
+void traceClearSpans() {
+  auto ring = spanRing().wlock();
+  ring->spans.clear();
+  ring->next = 0;
+}
+
+} // namespace watchman
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "watchman/thirdparty/jansson/jansson.h"
+#include "watchman/watchman_string.h"
+
+namespace watchman {
+
+/**
+ * Lightweight trace spans for following one request across threads.
+ *
+ * A command dispatch allocates a trace id and installs it in a
+ * thread-local slot for the duration of the dispatch.  Code that does
+ * work on behalf of the request wraps the work in a TraceSpan, which
+ * stamps the current trace id, a start time and a duration into a
+ * bounded global ring buffer on destruction.  Hand-offs that cross
+ * threads (such as PendingCollection sync promises) capture the trace
+ * id at enqueue time and record their own span when they complete, so
+ * the ring buffer reconstructs the client thread -> IO thread -> eval
+ * -> render timeline for a single query.
+ *
+ * Recording a span is one short critical section on the ring buffer;
+ * spans are per phase, not per file, so the steady-state cost is noise.
+ * The `debug-trace` command dumps (and optionally clears) the buffer.
+ */
+
+/** Allocate a fresh trace id.  Ids are never zero. */
+uint64_t traceNextId();
+
+/** The trace id installed on this thread, or 0 when untraced. */
+uint64_t currentTraceId();
+
+/**
+ * RAII holder that installs a trace id in the thread-local slot and
+ * restores the previous id on destruction.  Use this at the point
+ * where a request starts executing on a thread.
+ */
+class TraceContext {
+ public:
+  explicit TraceContext(uint64_t traceId);
+  ~TraceContext();
+
+  TraceContext(const TraceContext&) = delete;
+  TraceContext& operator=(const TraceContext&) = delete;
+
+ private:
+  uint64_t saved_;
+};
+
+/**
+ * RAII span: records the elapsed time between construction and
+ * destruction against the thread's current trace id.
+ */
+class TraceSpan {
+ public:
+  explicit TraceSpan(w_string name);
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+  w_string name_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * Record a span explicitly.  This is the cross-thread variant used
+ * when the start time and trace id were captured on a different
+ * thread than the one completing the work.  A zero traceId still
+ * records the span; it simply cannot be correlated to a request.
+ */
+void traceRecordSpan(
+    uint64_t traceId,
+    const w_string& name,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::duration duration);
+
+/**
+ * Render the ring buffer, oldest span first, as a json array of
+ * objects with `trace-id`, `name`, `start-us`, `duration-us` and
+ * `tid` keys.  Start times are microseconds on the steady clock so
+ * spans from different threads order correctly against each other.
+ */
+json_ref traceCollectSpans();
+
+/** Discard all recorded spans. */
+void traceClearSpans();
+
+} // namespace watchman
@@ -7,12 +7,14 @@
 
 #include "watchman/TriggerCommand.h"
 #include <folly/String.h>
+#include <algorithm>
 #include "watchman/Errors.h"
 #include "watchman/PDU.h"
 #include "watchman/QueryableView.h"
 #include "watchman/Shutdown.h"
 #include "watchman/UserDir.h"
 #include "watchman/query/Query.h"
+#include "watchman/query/QueryContext.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
 #include "watchman/root/Root.h"
@@ -63,11 +65,51 @@ void parse_redirection(
   }
 }
 
+#ifndef _WIN32
+/**
+ * Resolve a bare command name through PATH, mirroring the search that
+ * posix_spawnp would otherwise repeat on every spawn.  Returns nullopt
+ * when the name already contains a slash or when nothing matches; in
+ * the latter case we leave it to posix_spawnp to report the failure at
+ * spawn time, as before.
+ */
+std::optional<w_string> resolve_executable_path(
+    const ChildProcess::Environment& env,
+    const w_string& cmd0) {
+  if (memchr(cmd0.data(), '/', cmd0.size())) {
+    return std::nullopt;
+  }
+  auto path = env.get("PATH");
+  if (!path) {
+    return std::nullopt;
+  }
+
+  std::vector<folly::StringPiece> elems;
+  folly::split(':', path->view(), elems);
+  for (auto& dir : elems) {
+    if (dir.empty()) {
+      continue;
+    }
+    auto candidate =
+        w_string::pathCat({w_string_piece(dir.data(), dir.size()), cmd0});
+    if (access(candidate.c_str(), X_OK) == 0) {
+      return candidate;
+    }
+  }
+  return std::nullopt;
+}
+#endif
+
+/**
+ * Size of the coalescing buffer used when spooling a name list.  Large
+ * matches write out with one syscall per chunk of this size rather
+ * than two per file.
+ */
+constexpr size_t kStdinSpoolChunkSize = 64 * 1024;
+
 ResultErrno<std::unique_ptr<watchman_stream>> prepare_stdin(
     TriggerCommand* cmd,
     QueryResult* res) {
-  char stdin_file_name[WATCHMAN_NAME_MAX];
-
   if (cmd->stdin_style == trigger_input_style::input_dev_null) {
     return w_stm_open("/dev/null", O_RDONLY | O_CLOEXEC);
   }
@@ -80,32 +122,26 @@ ResultErrno<std::unique_ptr<watchman_stream>> prepare_stdin(
     }
   }
 
-  /* prepare the input stream for the child process */
-  snprintf(
-      stdin_file_name,
-      sizeof(stdin_file_name),
-      "%s/wmanXXXXXX",
-      getTemporaryDirectory().c_str());
-  auto stdin_file = w_mkstemp(stdin_file_name);
+  /* Spool the input for the child process into an anonymous temporary
+   * file; we'll pass the fd on to the child as stdin */
+  auto stdin_file = w_stm_open_anonymous();
   if (!stdin_file) {
     int err = errno;
     logf(
         ERR,
-        "unable to create a temporary file: {} {}\n",
-        stdin_file_name,
+        "unable to create a temporary file for trigger stdin: {}\n",
         folly::errnoStr(err));
     return err;
   }
 
-  /* unlink the file, we don't need it in the filesystem;
-   * we'll pass the fd on to the child as stdin */
-  unlink(stdin_file_name); // FIXME: windows path translation
-
   switch (cmd->stdin_style) {
     case input_json: {
       PduBuffer buffer;
 
       logf(DBG, "input_json: sending json object to stm\n");
+      // toJson() consumes the rendered results, so their refs are
+      // released as soon as the dump completes rather than riding
+      // along until the trigger process has been spawned.
       auto encodeResult = buffer.jsonEncodeToStream(
           std::move(res->resultsArray).toJson(), stdin_file.get(), 0);
       if (encodeResult.hasError()) {
@@ -117,21 +153,50 @@ ResultErrno<std::unique_ptr<watchman_stream>> prepare_stdin(
       }
       break;
     }
-    case input_name_list:
+    case input_name_list: {
+      // Coalesce the names into large chunks; a 100k file match would
+      // otherwise cost two write syscalls per name.
+      std::string chunk;
+      chunk.reserve(kStdinSpoolChunkSize);
+      auto flushChunk = [&]() -> int {
+        if (chunk.empty()) {
+          return 0;
+        }
+        if (stdin_file->write(chunk.data(), chunk.size()) !=
+            (int)chunk.size()) {
+          return errno;
+        }
+        chunk.clear();
+        return 0;
+      };
       for (auto& name : res->resultsArray.results) {
         auto& nameStr = json_to_w_string(name);
-        if (stdin_file->write(nameStr.data(), nameStr.size()) !=
-                (int)nameStr.size() ||
-            stdin_file->write("\n", 1) != 1) {
-          int err = errno;
-          logf(
-              ERR,
-              "write failure while producing trigger stdin: {}\n",
-              folly::errnoStr(err));
-          return err;
+        chunk.append(nameStr.data(), nameStr.size());
+        chunk.push_back('\n');
+        if (chunk.size() >= kStdinSpoolChunkSize) {
+          if (int err = flushChunk()) {
+            logf(
+                ERR,
+                "write failure while producing trigger stdin: {}\n",
+                folly::errnoStr(err));
+            return err;
+          }
         }
       }
+      if (int err = flushChunk()) {
+        logf(
+            ERR,
+            "write failure while producing trigger stdin: {}\n",
+            folly::errnoStr(err));
+        return err;
+      }
+      // The names now live in the spool file; drop our rendered copy
+      // before the spawn machinery adds its own argv/env allocations,
+      // trimming the daemon's peak footprint for very large matches.
+      res->resultsArray.results.clear();
+      res->resultsArray.results.shrink_to_fit();
       break;
+    }
     case input_dev_null:
       // already handled above
       break;
@@ -141,7 +206,7 @@ ResultErrno<std::unique_ptr<watchman_stream>> prepare_stdin(
   return stdin_file;
 }
 
-void spawn_command(
+std::unique_ptr<ChildProcess> spawn_command(
     const std::shared_ptr<Root>& root,
     TriggerCommand* cmd,
     QueryResult* res,
@@ -170,7 +235,7 @@ void spawn_command(
         root->root_path,
         cmd->triggername,
         folly::errnoStr(stdin_file_res.error()));
-    return;
+    return nullptr;
   }
 
   auto stdin_file = std::move(stdin_file_res).value();
@@ -201,6 +266,9 @@ void spawn_command(
 
   // Compute args
   std::vector<json_ref> args = cmd->command.value().array();
+  if (cmd->resolvedArgv0) {
+    args[0] = w_string_to_json(*cmd->resolvedArgv0);
+  }
 
   if (cmd->append_files) {
     // Measure how much space the base args take up
@@ -271,12 +339,9 @@ void spawn_command(
   log(DBG, "using ", working_dir, " for working dir\n");
   opts.chdir(working_dir.c_str());
 
+  std::unique_ptr<ChildProcess> proc;
   try {
-    if (cmd->current_proc) {
-      cmd->current_proc->kill();
-      cmd->current_proc->wait();
-    }
-    cmd->current_proc = std::make_unique<ChildProcess>(
+    proc = std::make_unique<ChildProcess>(
         json_array(std::move(args)), std::move(opts));
   } catch (const std::exception& exc) {
     log(ERR,
@@ -290,7 +355,8 @@ void spawn_command(
   }
 
   // We have integration tests that check for this string
-  log(cmd->current_proc ? DBG : ERR, "posix_spawnp: ", cmd->triggername, "\n");
+  log(proc ? DBG : ERR, "posix_spawnp: ", cmd->triggername, "\n");
+  return proc;
 }
 
 } // namespace
@@ -299,10 +365,12 @@ TriggerCommand::TriggerCommand(
     SavedStateFactory savedStateFactory,
     const std::shared_ptr<Root>& root,
     const json_ref& trig)
-    : definition(trig),
+    : contextScratch(std::make_unique<QueryContextScratch>()),
+      definition(trig),
       append_files(false),
       stdin_style(input_dev_null),
       max_files_stdin(0),
+      max_concurrency(1),
       stdout_flags(0),
       stderr_flags(0),
       savedStateFactory_{savedStateFactory},
@@ -374,6 +442,12 @@ TriggerCommand::TriggerCommand(
   }
   max_files_stdin = ival;
 
+  auto conc = trig.get_default("max_concurrency", json_integer(1)).asInt();
+  if (conc < 1) {
+    throw CommandValidationError("max_concurrency must be >= 1");
+  }
+  max_concurrency = conc;
+
   parse_redirection(trig, stdout_name, &stdout_flags, "stdout");
   parse_redirection(trig, stderr_name, &stderr_flags, "stderr");
 
@@ -382,6 +456,11 @@ TriggerCommand::TriggerCommand(
       {{"WATCHMAN_ROOT", root->root_path},
        {"WATCHMAN_SOCK", get_sock_name_legacy()},
        {"WATCHMAN_TRIGGER", triggername}});
+
+#ifndef _WIN32
+  resolvedArgv0 =
+      resolve_executable_path(env, json_to_w_string(command->array()[0]));
+#endif
 }
 
 TriggerCommand::~TriggerCommand() {
@@ -432,6 +511,11 @@ void TriggerCommand::run(const std::shared_ptr<Root>& root) {
       current_proc->kill();
       current_proc->wait();
     }
+    for (auto& proc : procPool_) {
+      proc->kill();
+      proc->wait();
+    }
+    procPool_.clear();
   } catch (const std::exception& exc) {
     log(ERR, "Uncaught exception in trigger thread: ", exc.what(), "\n");
   }
@@ -448,8 +532,11 @@ void TriggerCommand::stop() {
 }
 
 void TriggerCommand::start(const std::shared_ptr<Root>& root) {
-  subscriber_ =
-      root->unilateralResponses->subscribe([this] { ping_->notify(); });
+  // The trigger thread drains all pending items per ping, so one
+  // in-flight item is enough to guarantee it observes everything
+  // published behind it.
+  subscriber_ = root->unilateralResponses->subscribe(
+      [this] { ping_->notify(); }, std::nullopt, /*maxInflight=*/1);
   triggerThread_ = std::thread([this, root] {
     try {
       run(root);
@@ -489,8 +576,12 @@ bool TriggerCommand::maybeSpawn(const std::shared_ptr<Root>& root) {
   query->sync_timeout = std::chrono::milliseconds(0);
   log(DBG, "assessing trigger ", triggername, "\n");
   try {
-    auto res =
-        w_query_execute(query.get(), root, time_generator, savedStateFactory_);
+    auto res = w_query_execute(
+        query.get(),
+        root,
+        time_generator,
+        savedStateFactory_,
+        contextScratch.get());
 
     log(DBG,
         "trigger \"",
@@ -512,7 +603,15 @@ bool TriggerCommand::maybeSpawn(const std::shared_ptr<Root>& root) {
 
     if (!res.resultsArray.results.empty()) {
       didRun = true;
-      spawn_command(root, this, &res, saved_spec.get());
+      if (max_concurrency > 1) {
+        spawnPooled(root, res, saved_spec.get());
+      } else {
+        if (current_proc) {
+          current_proc->kill();
+          current_proc->wait();
+        }
+        current_proc = spawn_command(root, this, &res, saved_spec.get());
+      }
     }
     return didRun;
   } catch (const QueryExecError& e) {
@@ -526,8 +625,74 @@ bool TriggerCommand::maybeSpawn(const std::shared_ptr<Root>& root) {
   }
 }
 
+void TriggerCommand::reapPool() {
+  procPool_.erase(
+      std::remove_if(
+          procPool_.begin(),
+          procPool_.end(),
+          [](std::unique_ptr<ChildProcess>& proc) {
+            return proc->terminated();
+          }),
+      procPool_.end());
+}
+
+void TriggerCommand::spawnPooled(
+    const std::shared_ptr<Root>& root,
+    QueryResult& res,
+    ClockSpec* since_spec) {
+  auto& results = res.resultsArray.results;
+
+  // Deliver the result set in chunks so that each child receives a
+  // bounded name list; when no stdin limit is configured, split evenly
+  // so that one pass through the results fills the pool.
+  size_t chunkSize = max_files_stdin > 0
+      ? max_files_stdin
+      : (results.size() + max_concurrency - 1) / max_concurrency;
+  if (chunkSize == 0) {
+    chunkSize = 1;
+  }
+
+  auto nameIt = res.dedupedFileNames.begin();
+  for (size_t off = 0; off < results.size(); off += chunkSize) {
+    // Reap whatever already finished; when the pool is saturated, block
+    // on the oldest child to free a slot.
+    reapPool();
+    while (procPool_.size() >= max_concurrency) {
+      procPool_.front()->wait();
+      reapPool();
+    }
+    if (w_is_stopping() || stopTrigger_) {
+      return;
+    }
+
+    auto end = std::min(off + chunkSize, results.size());
+    QueryResult chunk;
+    chunk.isFreshInstance = res.isFreshInstance;
+    chunk.clockAtStartOfQuery = res.clockAtStartOfQuery;
+    chunk.resultsArray.templ = res.resultsArray.templ;
+    chunk.resultsArray.results.assign(
+        std::make_move_iterator(results.begin() + off),
+        std::make_move_iterator(results.begin() + end));
+    if (append_files) {
+      // The deduped name set drives argv appending; hand each child a
+      // distinct slice of it.  The set may be slightly smaller than the
+      // rendered results, so slice it with its own cursor.
+      for (size_t i = off; i < end && nameIt != res.dedupedFileNames.end();
+           ++i, ++nameIt) {
+        chunk.dedupedFileNames.insert(*nameIt);
+      }
+    }
+
+    auto proc = spawn_command(root, this, &chunk, since_spec);
+    if (proc) {
+      procPool_.push_back(std::move(proc));
+    }
+  }
+}
+
 bool TriggerCommand::waitNoIntr() {
   if (!w_is_stopping() && !stopTrigger_) {
+    reapPool();
     if (current_proc && current_proc->terminated()) {
       current_proc.reset();
       return true;
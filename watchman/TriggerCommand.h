@@ -17,21 +17,40 @@ namespace watchman {
 
 class Event;
 class Root;
+struct ClockSpec;
 struct Query;
+struct QueryContextScratch;
+struct QueryResult;
 
 enum trigger_input_style { input_dev_null, input_json, input_name_list };
 
 struct TriggerCommand {
   w_string triggername;
   std::shared_ptr<Query> query;
+  /* Retained container capacity handed to each run of `query` so that
+   * steady-state settles allocate nothing before the first match. */
+  std::unique_ptr<QueryContextScratch> contextScratch;
   json_ref definition;
   std::optional<json_ref> command;
+  /* Absolute path for command[0], resolved through PATH once at
+   * definition time so that each spawn skips the executable search.
+   * Unset when command[0] already names a path or resolution failed. */
+  std::optional<w_string> resolvedArgv0;
   ChildProcess::Environment env;
 
   bool append_files;
   enum trigger_input_style stdin_style;
   uint32_t max_files_stdin;
 
+  /* Maximum number of concurrently running children for this trigger.
+   * With the default of 1 the trigger behaves as it always has: a fresh
+   * spawn replaces the previous child.  Larger values enable pooled
+   * execution: the result set is delivered in chunks of max_files_stdin
+   * (or split evenly across the pool when that is unset), one child per
+   * chunk, and the next settle's query proceeds while earlier children
+   * are still running. */
+  uint32_t max_concurrency;
+
   int stdout_flags;
   int stderr_flags;
   std::string stdout_name;
@@ -61,11 +80,24 @@ struct TriggerCommand {
   bool maybeSpawn(const std::shared_ptr<Root>& root);
   bool waitNoIntr();
 
+  // Spawn one child per chunk of the result set, blocking on the oldest
+  // child whenever the pool is at max_concurrency.
+  void spawnPooled(
+      const std::shared_ptr<Root>& root,
+      QueryResult& res,
+      ClockSpec* since_spec);
+  // Drop children that have already exited from the pool.
+  void reapPool();
+
   const SavedStateFactory savedStateFactory_;
   std::thread triggerThread_;
   std::shared_ptr<Publisher::Subscriber> subscriber_;
   std::unique_ptr<Event> ping_;
   bool stopTrigger_{false};
+
+  /* Children running in pooled mode (max_concurrency > 1), oldest
+   * first.  Only touched from the trigger thread. */
+  std::vector<std::unique_ptr<ChildProcess>> procPool_;
 };
 
 } // namespace watchman
@@ -392,15 +392,28 @@ const char* cfg_get_trouble_url() {
 
 namespace watchman {
 
-Configuration::Configuration() {}
+Configuration::Configuration()
+    : local_{std::make_shared<folly::atomic_shared_ptr<const json_ref>>()} {}
 
 Configuration::Configuration(std::optional<json_ref> local)
-    : local_{std::move(local)} {}
+    : local_{std::make_shared<folly::atomic_shared_ptr<const json_ref>>()} {
+  if (local) {
+    local_->store(std::make_shared<const json_ref>(std::move(*local)));
+  }
+}
+
+void Configuration::reload(std::optional<json_ref> local) {
+  local_->store(
+      local ? std::make_shared<const json_ref>(std::move(*local))
+            : std::shared_ptr<const json_ref>{});
+}
 
 std::optional<json_ref> Configuration::get(const char* name) const {
-  // Highest precedence: options set locally
-  if (local_) {
-    std::optional<json_ref> val = local_->get_optional(name);
+  // Highest precedence: options set locally.  The snapshot is swapped
+  // wholesale by reload(), so this read is lock-free and a concurrent
+  // reload cannot tear the json underneath us.
+  if (auto snap = local_->load(std::memory_order_acquire)) {
+    std::optional<json_ref> val = snap->get_optional(name);
     if (val) {
       return std::move(*val);
     }
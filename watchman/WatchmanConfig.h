@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <folly/concurrency/AtomicSharedPtr.h>
+#include <memory>
 #include "watchman/thirdparty/jansson/jansson.h"
 
 class w_string;
@@ -41,8 +43,20 @@ class Configuration {
   bool getBool(const char* name, bool defval) const;
   double getDouble(const char* name, double defval) const;
 
+  /**
+   * Atomically replaces the local (per-root) config snapshot.  Every
+   * copy of a Configuration shares the same snapshot holder, so the
+   * new values become visible to all holders (the Root, its view, the
+   * watcher) immediately; readers never take a lock.  Pass nullopt to
+   * drop the local config entirely (the file was removed).
+   */
+  void reload(std::optional<json_ref> local);
+
  private:
-  std::optional<json_ref> local_;
+  // Immutable snapshot of the local config json, swapped wholesale by
+  // reload().  The outer shared_ptr is what copies of this object
+  // share; the inner pointer is null when there is no local config.
+  std::shared_ptr<folly::atomic_shared_ptr<const json_ref>> local_;
 };
 
 } // namespace watchman
@@ -51,6 +51,60 @@ std::vector<char> predictable_bser_data() {
   return output;
 }
 
+/**
+ * A columnar template array shaped like a file-list query response:
+ * one string column and three integer columns (size, mtime, ticks),
+ * which is the shape the per-column integer size-class planning in
+ * bser_template() is aimed at.
+ */
+json_ref template_file_list() {
+  constexpr size_t kRootSize = 10000;
+
+  std::vector<json_ref> templ;
+  templ.push_back(typed_string_to_json("name"));
+  templ.push_back(typed_string_to_json("size"));
+  templ.push_back(typed_string_to_json("mtime_ms"));
+  templ.push_back(typed_string_to_json("ticks"));
+
+  std::vector<json_ref> rows;
+  rows.reserve(kRootSize);
+  for (size_t i = 0; i < kRootSize; ++i) {
+    std::vector<json_ref> row;
+    row.push_back(
+        typed_string_to_json(fmt::format("dir/subdir/filename-{}.cpp", i)));
+    row.push_back(json_integer(1000 + i));
+    row.push_back(json_integer(1661943594000 + json_int_t(i)));
+    row.push_back(json_integer(3604891 + json_int_t(i)));
+    rows.push_back(json_array(std::move(row)));
+  }
+
+  json_ref root = json_array(std::move(rows));
+  json_array_set_template_new(root, json_array(std::move(templ)));
+  return root;
+}
+
+std::vector<char> dump_bser(const json_ref& root) {
+  bser_ctx_t ctx;
+  ctx.bser_version = 2;
+  ctx.bser_capabilities = 0;
+  std::vector<char> output;
+  ctx.dump = [](const char* buffer, size_t size, void* opaque) -> int {
+    auto& output = *static_cast<std::vector<char>*>(opaque);
+    output.insert(output.end(), buffer, buffer + size);
+    return 0;
+  };
+  if (w_bser_dump(&ctx, root, &output)) {
+    throw std::runtime_error("w_bser_dump failed");
+  }
+  return output;
+}
+
+std::vector<char> template_bser_data() {
+  auto output = dump_bser(template_file_list());
+  fmt::print("generated {} bytes of template BSER data\n", output.size());
+  return output;
+}
+
 w_string random_string(std::mt19937& mt) {
   static const unsigned kMaximumLength = 60;
   static const char kCharTable[62 + 1] =
@@ -194,6 +248,19 @@ void bser_parse_unpredictable(benchmark::State& state) {
 }
 BENCHMARK(bser_parse_unpredictable);
 
+void bser_parse_template(benchmark::State& state) {
+  ParseBenchmark<template_bser_data>::run(state);
+}
+BENCHMARK(bser_parse_template);
+
+void bser_dump_template(benchmark::State& state) {
+  json_ref root = template_file_list();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(dump_bser(root));
+  }
+}
+BENCHMARK(bser_dump_template);
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -6,6 +6,9 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include "watchman/Hash.h"
 #include "watchman/watchman_string.h"
 
 namespace {
@@ -39,6 +42,81 @@ void string_piece_hash(benchmark::State& state) {
 
 BENCHMARK(string_piece_hash);
 
+// Builds a synthetic repository path of the requested length; typical
+// watched-root inputs are 20-200 bytes.
+std::string make_path(size_t len) {
+  std::string path = "src/";
+  while (path.size() < len) {
+    path += "components/widgets/FooBarBaz.cpp";
+  }
+  path.resize(len);
+  return path;
+}
+
+void string_piece_hash_path(benchmark::State& state) {
+  auto path = make_path(state.range(0));
+  w_string_piece piece{path.data(), path.size()};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(piece.hashValue());
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(string_piece_hash_path)->Arg(20)->Arg(50)->Arg(100)->Arg(200);
+
+// Builds a deep path with the requested number of components, the shape
+// that path component splitting sees during dir resolution.
+std::string make_deep_path(size_t components) {
+  std::string path;
+  for (size_t i = 0; i < components; ++i) {
+    if (!path.empty()) {
+      path += '/';
+    }
+    path += "component";
+  }
+  return path;
+}
+
+void string_piece_path_components(benchmark::State& state) {
+  auto path = make_deep_path(state.range(0));
+  w_string_piece piece{path.data(), path.size()};
+  for (auto _ : state) {
+    size_t n = 0;
+    for (auto component : piece.pathComponents()) {
+      n += component.size();
+    }
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * path.size());
+}
+
+BENCHMARK(string_piece_path_components)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+
+void string_piece_split_vector(benchmark::State& state) {
+  auto path = make_deep_path(state.range(0));
+  w_string_piece piece{path.data(), path.size()};
+  for (auto _ : state) {
+    std::vector<w_string_piece> parts;
+    piece.split(parts, '/');
+    benchmark::DoNotOptimize(parts);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * path.size());
+}
+
+BENCHMARK(string_piece_split_vector)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+
+void hash_bytes_seeded(benchmark::State& state) {
+  auto path = make_path(state.range(0));
+  uint64_t seed = 0;
+  for (auto _ : state) {
+    seed = watchman::w_hash_bytes(path.data(), path.size(), seed);
+    benchmark::DoNotOptimize(seed);
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(hash_bytes_seeded)->Arg(20)->Arg(50)->Arg(100)->Arg(200);
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include <fmt/core.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "watchman/Clock.h"
+#include "watchman/InMemoryView.h"
+#include "watchman/query/Query.h"
+#include "watchman/query/QueryContext.h"
+#include "watchman/query/eval.h"
+#include "watchman/query/parse.h"
+#include "watchman/root/Root.h"
+#include "watchman/test/lib/FakeFileSystem.h"
+#include "watchman/test/lib/FakeWatcher.h"
+
+using namespace watchman;
+
+namespace {
+
+const w_string kRootPath{FAKEFS_ROOT "root"};
+
+std::unique_ptr<SavedStateInterface> noSavedState(
+    w_string_piece,
+    const json_ref&,
+    const SCM*,
+    Configuration,
+    std::function<void(PerfSample&)>) {
+  throw std::runtime_error("benchmarks do not use saved states");
+}
+
+// Builds the path list for a synthetic tree: files are spread 32 per
+// leaf directory across `depth` levels of fan-out-16 directories, with
+// a mix of source-like suffixes so the suffix index sees realistic
+// cardinality.
+std::vector<std::string> makeTreePaths(size_t fileCount, size_t depth) {
+  static const char* kSuffixes[] = {"cpp", "h", "js", "json", "txt"};
+  std::vector<std::string> paths;
+  paths.reserve(fileCount);
+  for (size_t i = 0; i < fileCount; ++i) {
+    std::string path = FAKEFS_ROOT "root";
+    size_t dirSeed = i / 32;
+    for (size_t level = 0; level < depth; ++level) {
+      path += fmt::format("/dir{}", dirSeed % 16);
+      dirSeed /= 16;
+    }
+    path += fmt::format("/file{}.{}", i, kSuffixes[i % 5]);
+    paths.push_back(std::move(path));
+  }
+  return paths;
+}
+
+void populate(FakeFileSystem& fs, const std::vector<std::string>& paths) {
+  for (const auto& path : paths) {
+    fs.addNode(path.c_str(), fs.fakeFile());
+  }
+}
+
+// One InMemoryView + Root over a FakeFileSystem, driven the same way
+// InMemoryViewTest drives the IO thread.
+struct ViewHarness {
+  explicit ViewHarness(FakeFileSystem& fs)
+      : fs{fs},
+        watcher{std::make_shared<FakeWatcher>(fs)},
+        view{std::make_shared<InMemoryView>(fs, kRootPath, config, watcher)},
+        pending{view->unsafeAccessPendingFromWatcher()},
+        root{std::make_shared<Root>(
+            fs,
+            kRootPath,
+            "fs_type",
+            w_string_to_json("{}"),
+            config,
+            view,
+            [] {})} {
+    pending.lock()->ping();
+  }
+
+  // Performs the initial crawl on first call; applies pending batches on
+  // subsequent calls.
+  void step() {
+    view->stepIoThread(root, state, pending);
+  }
+
+  std::shared_ptr<Query> parse(const char* specJson) {
+    auto spec = json_loads(specJson, 0, nullptr);
+    return parseQuery(root, *spec);
+  }
+
+  FakeFileSystem& fs;
+  Configuration config{json_object()};
+  std::shared_ptr<FakeWatcher> watcher;
+  std::shared_ptr<InMemoryView> view;
+  PendingCollection& pending;
+  std::shared_ptr<Root> root;
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+};
+
+// Initial crawl cost over trees of increasing size.
+void view_full_crawl(benchmark::State& state) {
+  FakeFileSystem fs;
+  auto paths = makeTreePaths(state.range(0), 3);
+  populate(fs, paths);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    ViewHarness harness{fs};
+    state.ResumeTiming();
+    harness.step();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(view_full_crawl)->Arg(1000)->Arg(10000)->Arg(50000);
+
+// Applying a batch of watcher notifications to an established view.
+void view_process_pending_batch(benchmark::State& state) {
+  FakeFileSystem fs;
+  auto paths = makeTreePaths(50000, 3);
+  populate(fs, paths);
+
+  ViewHarness harness{fs};
+  harness.step();
+
+  const size_t batchSize = state.range(0);
+  size_t next = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<const char*> batch;
+    batch.reserve(batchSize);
+    for (size_t i = 0; i < batchSize; ++i) {
+      const auto& path = paths[next++ % paths.size()];
+      fs.updateMetadata(
+          path.c_str(), [](FileInformation& fi) { fi.size += 1; });
+      batch.push_back(path.c_str());
+    }
+    state.ResumeTiming();
+
+    {
+      auto lock = harness.pending.lock();
+      for (const char* path : batch) {
+        lock->add(path, {}, W_PENDING_VIA_NOTIFY);
+      }
+      lock->ping();
+    }
+    harness.step();
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * batchSize);
+}
+
+BENCHMARK(view_process_pending_batch)->Arg(16)->Arg(256)->Arg(4096);
+
+// Full-view walk plus expression evaluation, the shape of a non-since
+// query with no generator of its own.
+void view_all_files_query(benchmark::State& state) {
+  FakeFileSystem fs;
+  auto paths = makeTreePaths(state.range(0), 3);
+  populate(fs, paths);
+
+  ViewHarness harness{fs};
+  harness.step();
+
+  auto query = harness.parse(
+      R"({"expression": ["allof", ["type", "f"], ["suffix", "cpp"]],
+          "fields": ["name"],
+          "sync_timeout": 0})");
+
+  for (auto _ : state) {
+    auto res = w_query_execute(query.get(), harness.root, nullptr, noSavedState);
+    benchmark::DoNotOptimize(res);
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(view_all_files_query)->Arg(10000)->Arg(50000);
+
+// One observed change fanned out to N since-query subscribers, the way
+// subscription notifications are built.
+void view_subscription_fanout(benchmark::State& state) {
+  FakeFileSystem fs;
+  auto paths = makeTreePaths(50000, 3);
+  populate(fs, paths);
+
+  ViewHarness harness{fs};
+  harness.step();
+
+  const size_t subscribers = state.range(0);
+  size_t next = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto sinceClock = harness.view->getCurrentClockString();
+    const auto& path = paths[next++ % paths.size()];
+    fs.updateMetadata(path.c_str(), [](FileInformation& fi) { fi.size += 1; });
+    {
+      auto lock = harness.pending.lock();
+      lock->add(path.c_str(), {}, W_PENDING_VIA_NOTIFY);
+      lock->ping();
+    }
+    harness.step();
+    auto spec = fmt::format(
+        R"({{"since": "{}",
+             "fields": ["name", "size", "exists"],
+             "sync_timeout": 0}})",
+        sinceClock);
+    auto query = harness.parse(spec.c_str());
+    state.ResumeTiming();
+
+    for (size_t i = 0; i < subscribers; ++i) {
+      auto res =
+          w_query_execute(query.get(), harness.root, nullptr, noSavedState);
+      benchmark::DoNotOptimize(res);
+    }
+  }
+  state.SetItemsProcessed(int64_t(state.iterations()) * subscribers);
+}
+
+BENCHMARK(view_subscription_fanout)->Arg(1)->Arg(8)->Arg(64);
+
+} // namespace
+
+int main(int argc, char** argv) {
+  ClockSpec::init();
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  ::benchmark::RunSpecifiedBenchmarks();
+}
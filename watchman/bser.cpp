@@ -7,9 +7,15 @@
 
 #include "watchman/bser.h"
 #include "watchman/Logging.h"
+#include "watchman/ThreadPool.h"
 #include "watchman/thirdparty/jansson/jansson_private.h"
 
+#include <folly/Portability.h>
 #include <math.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
 
 /*
  * This defines a binary serialization of the JSON data objects in this
@@ -132,6 +138,111 @@ int bser_int(const bser_ctx_t* ctx, json_int_t val, void* data) {
   return ctx->dump(iptr, size, data);
 }
 
+/**
+ * Emits an integer with a caller-supplied size class (1, 2, 4 or 8), as a
+ * single dump call covering both the tag and the payload.  BSER permits
+ * any size class wide enough to hold the value, which is what lets
+ * bser_template() amortize the INT_SIZE decision over a whole column.
+ */
+int bser_int_fixed(const bser_ctx_t* ctx, json_int_t val, int size, void* data) {
+  char buf[1 + sizeof(int64_t)];
+
+  if (folly::kIsLittleEndian) {
+    // The low `size` bytes of the 8-byte store are exactly the narrow
+    // encoding, so one fixed-size copy serves every size class.
+    static const char tag[9] = {
+        0, BSER_INT8, BSER_INT16, 0, BSER_INT32, 0, 0, 0, BSER_INT64};
+    buf[0] = tag[size];
+    int64_t i64 = val;
+    memcpy(buf + 1, &i64, sizeof(i64));
+  } else {
+    switch (size) {
+      case 1: {
+        buf[0] = BSER_INT8;
+        int8_t i8 = (int8_t)val;
+        memcpy(buf + 1, &i8, sizeof(i8));
+        break;
+      }
+      case 2: {
+        buf[0] = BSER_INT16;
+        int16_t i16 = (int16_t)val;
+        memcpy(buf + 1, &i16, sizeof(i16));
+        break;
+      }
+      case 4: {
+        buf[0] = BSER_INT32;
+        int32_t i32 = (int32_t)val;
+        memcpy(buf + 1, &i32, sizeof(i32));
+        break;
+      }
+      case 8: {
+        buf[0] = BSER_INT64;
+        int64_t i64 = (int64_t)val;
+        memcpy(buf + 1, &i64, sizeof(i64));
+        break;
+      }
+      default:
+        return -1;
+    }
+  }
+
+  return ctx->dump(buf, 1 + size, data);
+}
+
+/**
+ * For a template array whose rows are columnar (value arrays in template
+ * order), returns one size class per column: the width that can hold
+ * every integer cell in that column, or 0 when the column holds anything
+ * other than integers.  Missing trailing cells (short rows) do not
+ * disqualify a column.
+ *
+ * File-list responses are dominated by integer columns (sizes, mtimes,
+ * ticks), so making the size-class decision once per column rather than
+ * once per cell takes the branchy INT_SIZE chain out of the row loop.
+ */
+std::vector<int> planIntegerColumns(
+    const std::vector<json_ref>& rows,
+    size_t numColumns) {
+  std::vector<json_int_t> minVal(numColumns, 0);
+  std::vector<json_int_t> maxVal(numColumns, 0);
+  // 0 = no integer seen yet, 1 = integers only, 2 = disqualified
+  std::vector<char> state(numColumns, 0);
+
+  for (auto& row : rows) {
+    if (!row.isArray()) {
+      continue;
+    }
+    auto& cells = row.array();
+    size_t pn = std::min(numColumns, cells.size());
+    for (size_t pi = 0; pi < pn; pi++) {
+      if (state[pi] == 2) {
+        continue;
+      }
+      if (!cells[pi].isInt()) {
+        state[pi] = 2;
+        continue;
+      }
+      auto val = cells[pi].asInt();
+      if (state[pi] == 0) {
+        state[pi] = 1;
+        minVal[pi] = val;
+        maxVal[pi] = val;
+      } else {
+        minVal[pi] = std::min(minVal[pi], val);
+        maxVal[pi] = std::max(maxVal[pi], val);
+      }
+    }
+  }
+
+  std::vector<int> widths(numColumns, 0);
+  for (size_t pi = 0; pi < numColumns; pi++) {
+    if (state[pi] == 1) {
+      widths[pi] = std::max(INT_SIZE(minVal[pi]), INT_SIZE(maxVal[pi]));
+    }
+  }
+  return widths;
+}
+
 int bser_generic_string(
     const bser_ctx_t* ctx,
     w_string_piece str,
@@ -149,7 +260,10 @@ int bser_generic_string(
     return -1;
   }
 
-  if (ctx->dump(str.data(), str.size(), data)) {
+  // The string body is backed by the document being dumped, so route it
+  // through the stable-payload sink when one is configured.
+  auto dump_body = ctx->dump_stable ? ctx->dump_stable : ctx->dump;
+  if (dump_body(str.data(), str.size(), data)) {
     return -1;
   }
 
@@ -173,7 +287,11 @@ int bser_mixedstring(const bser_ctx_t* ctx, w_string_piece str, void* data) {
       !(BSER_CAP_DISABLE_UNICODE_FOR_ERRORS & ctx->bser_capabilities) &&
       !(BSER_CAP_DISABLE_UNICODE & ctx->bser_capabilities)) {
     auto utf8_clean = str.asUTF8Clean();
-    return bser_utf8string(ctx, utf8_clean, data);
+    // utf8_clean is a temporary whose storage dies with this frame, so it
+    // must not be referenced in place via the stable-payload sink.
+    bser_ctx_t transient_ctx = *ctx;
+    transient_ctx.dump_stable = nullptr;
+    return bser_utf8string(&transient_ctx, utf8_clean, data);
   } else {
     return bser_bytestring(ctx, str, data);
   }
@@ -181,6 +299,67 @@ int bser_mixedstring(const bser_ctx_t* ctx, w_string_piece str, void* data) {
 
 int bser_array(const bser_ctx_t* ctx, const json_ref& array, void* data);
 
+// Emits one row of a template array: the values in template order with
+// skip markers for absent properties.  Shared between bser_template()
+// and the parallel pre-encoder, which shards rows across threads.
+int bser_template_row(
+    const bser_ctx_t* ctx,
+    const json_ref& obj,
+    const std::vector<json_ref>& templ_arr,
+    const std::vector<int>& int_widths,
+    void* data) {
+  size_t pn = templ_arr.size();
+
+  if (obj.isArray()) {
+    // Columnar row: the values are already in template order, so we
+    // can emit them without any key lookups.  A short row stands for
+    // an object whose trailing properties are not set.
+    auto& row = obj.array();
+    for (size_t pi = 0; pi < pn; pi++) {
+      if (pi >= row.size()) {
+        if (ctx->dump(&bser_skip, sizeof(bser_skip), data)) {
+          return -1;
+        }
+        continue;
+      }
+      if (!int_widths.empty() && int_widths[pi] != 0) {
+        // Integer column: the plan already picked the size class, and
+        // guarantees every present cell is an integer.
+        if (bser_int_fixed(ctx, row[pi].asInt(), int_widths[pi], data)) {
+          return -1;
+        }
+        continue;
+      }
+      if (w_bser_dump(ctx, row[pi], data)) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  // For each factored key
+  for (size_t pi = 0; pi < pn; pi++) {
+    const char* key = json_string_value(templ_arr[pi]);
+
+    // Look up the object property
+    auto val = json_object_get(obj, key);
+    if (!val) {
+      // property not set on this one; emit a skip
+      if (ctx->dump(&bser_skip, sizeof(bser_skip), data)) {
+        return -1;
+      }
+      continue;
+    }
+
+    // Emit value
+    if (w_bser_dump(ctx, *val, data)) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
 int bser_template(
     const bser_ctx_t* ctx,
     const json_ref& array,
@@ -211,28 +390,18 @@ int bser_template(
   auto& templ_arr = templ.array();
   size_t pn = templ_arr.size();
 
+  // Render-time results store their rows columnar, so plan the integer
+  // columns up front.  Documents whose first row is an object skip the
+  // planning pass and take the generic per-cell path below.
+  std::vector<int> int_widths;
+  if (n != 0 && array_arr[0].isArray()) {
+    int_widths = planIntegerColumns(array_arr, pn);
+  }
+
   // For each object
   for (size_t i = 0; i < n; i++) {
-    auto& obj = array_arr[i];
-
-    // For each factored key
-    for (size_t pi = 0; pi < pn; pi++) {
-      const char* key = json_string_value(templ_arr[pi]);
-
-      // Look up the object property
-      auto val = json_object_get(obj, key);
-      if (!val) {
-        // property not set on this one; emit a skip
-        if (ctx->dump(&bser_skip, sizeof(bser_skip), data)) {
-          return -1;
-        }
-        continue;
-      }
-
-      // Emit value
-      if (w_bser_dump(ctx, *val, data)) {
-        return -1;
-      }
+    if (bser_template_row(ctx, array_arr[i], templ_arr, int_widths, data)) {
+      return -1;
     }
   }
 
@@ -244,6 +413,29 @@ int bser_array(const bser_ctx_t* ctx, const json_ref& array, void* data) {
     return -1;
   }
 
+  if (auto pre = json_array_get_preencoded(array)) {
+    // The elements were already encoded (by BserRenderSink or the
+    // parallel pre-encoder); splice the finished bytes.  The measuring
+    // pass simply sums the chunk sizes.
+    if (pre->bserVersion == ctx->bser_version &&
+        pre->bserCapabilities == ctx->bser_capabilities) {
+      for (auto& chunk : pre->chunks) {
+        if (ctx->dump(chunk.data(), chunk.size(), data)) {
+          return -1;
+        }
+      }
+      return 0;
+    }
+    if (array.array().empty() && pre->rowCount != 0) {
+      // Render-sink results have no DOM to fall back on; encoding them
+      // for a different format is a caller bug, so fail loudly rather
+      // than emit an empty array.
+      return -1;
+    }
+    // Opportunistically pre-encoded arrays keep their DOM; take the
+    // normal path below for this format.
+  }
+
   auto templ = json_array_get_template(array);
   if (templ && !templ->array().empty()) {
     return bser_template(ctx, array, *templ, data);
@@ -354,7 +546,8 @@ int w_bser_write_pdu(
     const uint32_t bser_capabilities,
     json_dump_callback_t dump,
     const json_ref& json,
-    void* data) {
+    void* data,
+    json_dump_callback_t dump_stable) {
   json_int_t m_size = 0;
   bser_ctx_t ctx{bser_version, bser_capabilities, measure};
 
@@ -368,6 +561,7 @@ int w_bser_write_pdu(
 
   // To actually write the contents
   ctx.dump = dump;
+  ctx.dump_stable = dump_stable;
 
   if (bser_version == 2) {
     if (dump(BSER_V2_MAGIC, 2, data)) {
@@ -397,6 +591,320 @@ int w_bser_write_pdu(
   return 0;
 }
 
+int w_bser_write_pdu_header(
+    const uint32_t bser_version,
+    const uint32_t bser_capabilities,
+    json_int_t payload_len,
+    json_dump_callback_t dump,
+    void* data) {
+  bser_ctx_t ctx{bser_version, bser_capabilities, dump};
+
+  if (!is_bser_version_supported(&ctx)) {
+    return -1;
+  }
+
+  if (dump(
+          bser_version == 2 ? BSER_V2_MAGIC : BSER_MAGIC,
+          2,
+          data)) {
+    return -1;
+  }
+
+  if (bser_version == 2) {
+    if (dump(
+            (const char*)&bser_capabilities, sizeof(bser_capabilities), data)) {
+      return -1;
+    }
+  }
+
+  return bser_int(&ctx, payload_len, data);
+}
+
+namespace watchman {
+
+namespace {
+// Chunk granularity for BserRenderSink; rows never split the encoding
+// of a single dump callback across chunks, so a chunk can run slightly
+// over this when a long string lands at the boundary.
+constexpr size_t kRenderSinkChunkSize = 1024 * 1024;
+
+int append_to_string(const char* buffer, size_t size, void* data) {
+  static_cast<std::string*>(data)->append(buffer, size);
+  return 0;
+}
+} // namespace
+
+BserRenderSink::BserRenderSink(
+    uint32_t bserVersion,
+    uint32_t bserCapabilities,
+    size_t numColumns)
+    : version_(bserVersion),
+      capabilities_(bserCapabilities),
+      numColumns_(numColumns) {
+  chunks_.emplace_back();
+}
+
+int BserRenderSink::collect(const char* buffer, size_t size, void* data) {
+  static_cast<BserRenderSink*>(data)->put(buffer, size);
+  return 0;
+}
+
+void BserRenderSink::put(const char* buf, size_t size) {
+  auto* chunk = &chunks_.back();
+  if (!chunk->empty() && chunk->size() + size > kRenderSinkChunkSize) {
+    chunks_.emplace_back();
+    chunk = &chunks_.back();
+  }
+  chunk->append(buf, size);
+}
+
+void BserRenderSink::dumpValue(const json_ref& v) {
+  bser_ctx_t ctx{version_, capabilities_, collect};
+  if (w_bser_dump(&ctx, v, this)) {
+    // Only reachable via an unsupported version or unrepresentable
+    // value; neither can occur for rendered result rows.
+    throw std::runtime_error("BserRenderSink: failed to encode result row");
+  }
+}
+
+void BserRenderSink::append(const json_ref& row) {
+  ++rowCount_;
+  if (numColumns_ == 0) {
+    dumpValue(row);
+    return;
+  }
+  // Columnar row in template order, emitted exactly as bser_template()
+  // would: values only, with a skip marker standing in for any missing
+  // trailing cells.
+  auto& cells = row.array();
+  for (size_t pi = 0; pi < numColumns_; ++pi) {
+    if (pi >= cells.size()) {
+      put(&bser_skip, sizeof(bser_skip));
+      continue;
+    }
+    dumpValue(cells[pi]);
+  }
+}
+
+std::shared_ptr<const BserPreencodedArray> BserRenderSink::finish(
+    std::optional<json_ref> templ) {
+  // Build everything bser_array()/bser_template() writes before the
+  // rows: header byte, the template key array if any, then the row
+  // count (a BSER integer, so dumping a json integer encodes it).
+  std::string prefix;
+  bser_ctx_t pctx{version_, capabilities_, append_to_string};
+  if (templ) {
+    prefix.push_back(bser_template_hdr);
+    if (w_bser_dump(&pctx, *templ, &prefix)) {
+      throw std::runtime_error("BserRenderSink: failed to encode template");
+    }
+  } else {
+    prefix.push_back(bser_array_hdr);
+  }
+  if (w_bser_dump(&pctx, json_integer(rowCount_), &prefix)) {
+    throw std::runtime_error("BserRenderSink: failed to encode row count");
+  }
+
+  auto out = std::make_shared<BserPreencodedArray>();
+  out->bserVersion = version_;
+  out->bserCapabilities = capabilities_;
+  out->rowCount = rowCount_;
+  out->chunks.reserve(chunks_.size() + 1);
+  size_t total = prefix.size();
+  out->chunks.push_back(std::move(prefix));
+  for (auto& chunk : chunks_) {
+    if (chunk.empty()) {
+      continue;
+    }
+    total += chunk.size();
+    out->chunks.push_back(std::move(chunk));
+  }
+  out->totalBytes = total;
+  chunks_.clear();
+  return out;
+}
+
+namespace {
+
+// Below this many rows the sharding overhead outweighs the win.
+constexpr size_t kParallelEncodeRowThreshold = 8192;
+// Upper bound on concurrent shards; each shard carries a contiguous
+// row range so the stitched output is byte-identical to one pass.
+constexpr size_t kParallelEncodeShards = 8;
+
+// Encodes rows [begin, end) of `rows` into `out`.  templ_arr/int_widths
+// are empty for a plain (non-template) array.
+int encodeRowRange(
+    uint32_t version,
+    uint32_t capabilities,
+    const std::vector<json_ref>& rows,
+    const std::vector<json_ref>& templ_arr,
+    const std::vector<int>& int_widths,
+    size_t begin,
+    size_t end,
+    std::string& out) {
+  bser_ctx_t ctx{version, capabilities, append_to_string};
+  for (size_t i = begin; i < end; ++i) {
+    int res = templ_arr.empty()
+        ? w_bser_dump(&ctx, rows[i], &out)
+        : bser_template_row(&ctx, rows[i], templ_arr, int_widths, &out);
+    if (res) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void preencodeOneArray(
+    const json_ref& array,
+    uint32_t version,
+    uint32_t capabilities) {
+  auto& rows = array.array();
+  const size_t n = rows.size();
+
+  auto templ = json_array_get_template(array);
+  bool templated = templ && !templ->array().empty();
+
+  // Mirror bser_template(): the column plan runs once over the whole
+  // array so every shard uses the same integer widths, keeping the
+  // stitched bytes identical to a serial encode.
+  std::vector<json_ref> templ_arr;
+  std::vector<int> int_widths;
+  if (templated) {
+    templ_arr = templ->array();
+    if (rows[0].isArray()) {
+      int_widths = planIntegerColumns(rows, templ_arr.size());
+    }
+  }
+
+  // Everything the serial encoder writes before the rows.
+  std::string prefix;
+  bser_ctx_t pctx{version, capabilities, append_to_string};
+  prefix.push_back(templated ? bser_template_hdr : bser_array_hdr);
+  if (templated && w_bser_dump(&pctx, *templ, &prefix)) {
+    return;
+  }
+  if (w_bser_dump(&pctx, json_integer(n), &prefix)) {
+    return;
+  }
+
+  const size_t shardCount = std::min(kParallelEncodeShards, n);
+  std::vector<std::string> shardBytes(shardCount);
+  std::atomic<size_t> nextShard{0};
+  std::atomic<bool> failed{false};
+
+  auto encodeClaimedShards = [&]() {
+    while (true) {
+      size_t s = nextShard.fetch_add(1, std::memory_order_acq_rel);
+      if (s >= shardCount || failed.load(std::memory_order_acquire)) {
+        return;
+      }
+      if (encodeRowRange(
+              version,
+              capabilities,
+              rows,
+              templ_arr,
+              int_widths,
+              n * s / shardCount,
+              n * (s + 1) / shardCount,
+              shardBytes[s])) {
+        failed.store(true, std::memory_order_release);
+      }
+    }
+  };
+
+  // Helpers on the pool race the calling thread for shards; the caller
+  // participates so progress never depends on pool capacity (this can
+  // itself be running on a pool thread), and a pool that is stopped or
+  // full simply leaves all the shards to the caller.  The sync state is
+  // shared so a helper finishing last can release its lock after the
+  // caller has already moved on.
+  struct SyncState {
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t active{0};
+  };
+  auto sync = std::make_shared<SyncState>();
+  for (size_t i = 1; i < shardCount; ++i) {
+    {
+      std::lock_guard<std::mutex> lock(sync->mutex);
+      ++sync->active;
+    }
+    try {
+      getThreadPool().add([&, sync]() {
+        encodeClaimedShards();
+        std::lock_guard<std::mutex> lock(sync->mutex);
+        --sync->active;
+        sync->cond.notify_one();
+      });
+    } catch (const std::exception&) {
+      std::lock_guard<std::mutex> lock(sync->mutex);
+      --sync->active;
+      break;
+    }
+  }
+
+  encodeClaimedShards();
+
+  {
+    std::unique_lock<std::mutex> lock(sync->mutex);
+    sync->cond.wait(lock, [&] { return sync->active == 0; });
+  }
+
+  if (failed.load(std::memory_order_acquire)) {
+    // Leave the array unannotated; the serial encoder will report the
+    // problem in context.
+    return;
+  }
+
+  auto pre = std::make_shared<BserPreencodedArray>();
+  pre->bserVersion = version;
+  pre->bserCapabilities = capabilities;
+  pre->rowCount = n;
+  size_t total = prefix.size();
+  pre->chunks.reserve(shardCount + 1);
+  pre->chunks.push_back(std::move(prefix));
+  for (auto& bytes : shardBytes) {
+    if (bytes.empty()) {
+      continue;
+    }
+    total += bytes.size();
+    pre->chunks.push_back(std::move(bytes));
+  }
+  pre->totalBytes = total;
+  json_array_set_preencoded(array, std::move(pre));
+}
+
+bool worthPreencoding(const json_ref& value) {
+  return value.isArray() &&
+      json_array_size(value) >= kParallelEncodeRowThreshold &&
+      !json_array_get_preencoded(value);
+}
+
+} // namespace
+
+void bserParallelPreencode(
+    const json_ref& json,
+    uint32_t bserVersion,
+    uint32_t bserCapabilities) {
+  if (worthPreencoding(json)) {
+    preencodeOneArray(json, bserVersion, bserCapabilities);
+    return;
+  }
+  if (!json.isObject()) {
+    return;
+  }
+  // Responses put their bulk (query results, trigger file lists) in an
+  // array one level down; anything deeper is not worth scanning for.
+  for (auto& it : json.object()) {
+    if (worthPreencoding(it.second)) {
+      preencodeOneArray(it.second, bserVersion, bserCapabilities);
+    }
+  }
+}
+
+} // namespace watchman
+
 namespace {
 
 /**
@@ -515,6 +1023,26 @@ class BserParser {
   }
 
   json_int_t parseInteger(char type) {
+    assert(type >= BSER_INT8 && type <= BSER_INT64);
+    if (folly::kIsLittleEndian) {
+      // The integer tags are consecutive, so the payload width is implied
+      // by the tag and we can load and sign-extend without re-branching on
+      // the size class.  This is the hottest spot when decoding file-list
+      // responses, which are dominated by integer columns.
+      size_t width = size_t{1} << (type - BSER_INT8);
+      const char* p = ensure(width);
+      uint64_t raw;
+      if (static_cast<size_t>(end - p) >= sizeof(raw)) {
+        // A fixed 8-byte load; the bytes past `width` are document bytes
+        // we have not consumed and get shifted out below.
+        memcpy(&raw, p, sizeof(raw));
+      } else {
+        raw = 0;
+        memcpy(&raw, p, width);
+      }
+      unsigned shift = 64 - 8 * static_cast<unsigned>(width);
+      return static_cast<int64_t>(raw << shift) >> shift;
+    }
     switch (type) {
       case BSER_INT8:
         return parseInteger<int8_t>();
@@ -734,3 +1262,393 @@ json_ref bunser(const char* buf, const char* end) {
   }
   return BserParser{buf, end}.expectValue();
 }
+
+namespace {
+
+/**
+ * Measures the value at `buf` without building json_refs, tolerating a
+ * truncated buffer by returning std::nullopt (with *needed set to a lower
+ * bound on the bytes to retry with). This is what lets the incremental PDU
+ * decoder find element boundaries before the whole document has arrived.
+ */
+std::optional<size_t>
+skipValue(const char* buf, size_t avail, size_t* needed, size_t depth) {
+  if (depth >= kMaximumDepth) {
+    throw BserParseTooDeep{};
+  }
+  if (avail == 0) {
+    *needed = 1;
+    return std::nullopt;
+  }
+
+  switch (buf[0]) {
+    case BSER_TRUE:
+    case BSER_FALSE:
+    case BSER_NULL:
+    case BSER_SKIP:
+      return 1;
+
+    case BSER_INT8:
+    case BSER_INT16:
+    case BSER_INT32:
+    case BSER_INT64: {
+      // On success bunser_int leaves the encoded size in *needed
+      if (!bunser_int(buf, avail, needed)) {
+        return std::nullopt;
+      }
+      return *needed;
+    }
+
+    case BSER_REAL:
+      if (avail < 1 + sizeof(double)) {
+        *needed = 1 + sizeof(double);
+        return std::nullopt;
+      }
+      return 1 + sizeof(double);
+
+    case BSER_BYTESTRING:
+    case BSER_UTF8STRING: {
+      size_t int_size;
+      auto len = bunser_int(buf + 1, avail - 1, &int_size);
+      if (!len) {
+        if (int_size == kDecodeIntFailed) {
+          throw BserParseError("invalid string size");
+        }
+        *needed = 1 + int_size;
+        return std::nullopt;
+      }
+      if (*len < 0) {
+        throw BserParseError("string has negative size");
+      }
+      size_t total = 1 + int_size + size_t(*len);
+      if (avail < total) {
+        *needed = total;
+        return std::nullopt;
+      }
+      return total;
+    }
+
+    case BSER_ARRAY:
+    case BSER_OBJECT: {
+      size_t int_size;
+      auto count = bunser_int(buf + 1, avail - 1, &int_size);
+      if (!count) {
+        if (int_size == kDecodeIntFailed) {
+          throw BserParseError("invalid container size");
+        }
+        *needed = 1 + int_size;
+        return std::nullopt;
+      }
+      if (*count < 0) {
+        throw BserParseError("container has negative size");
+      }
+      // An object is count pairs of key and value; a key is just another
+      // value as far as measuring is concerned.
+      json_int_t values = buf[0] == BSER_OBJECT ? *count * 2 : *count;
+      size_t pos = 1 + int_size;
+      for (json_int_t i = 0; i < values; i++) {
+        size_t child_needed;
+        auto child = skipValue(
+            buf + pos, avail > pos ? avail - pos : 0, &child_needed, depth + 1);
+        if (!child) {
+          *needed = pos + child_needed;
+          return std::nullopt;
+        }
+        pos += *child;
+      }
+      return pos;
+    }
+
+    case BSER_TEMPLATE: {
+      // The key array comes first; we need its element count to know how
+      // many values each templated object carries.
+      size_t pos = 1;
+      if (avail < pos + 1) {
+        *needed = pos + 1;
+        return std::nullopt;
+      }
+      if (buf[pos] != BSER_ARRAY) {
+        throw BserParseError("template keys must be an array");
+      }
+      size_t int_size;
+      auto key_count = bunser_int(
+          buf + pos + 1, avail > pos + 1 ? avail - pos - 1 : 0, &int_size);
+      if (!key_count) {
+        if (int_size == kDecodeIntFailed) {
+          throw BserParseError("invalid template key count");
+        }
+        *needed = pos + 1 + int_size;
+        return std::nullopt;
+      }
+      if (*key_count <= 0) {
+        throw BserParseError("templates require a non-empty key set");
+      }
+      pos += 1 + int_size;
+
+      // The keys themselves
+      for (json_int_t i = 0; i < *key_count; i++) {
+        size_t child_needed;
+        auto child = skipValue(
+            buf + pos, avail > pos ? avail - pos : 0, &child_needed, depth + 1);
+        if (!child) {
+          *needed = pos + child_needed;
+          return std::nullopt;
+        }
+        pos += *child;
+      }
+
+      // The number of objects
+      auto element_count = bunser_int(
+          buf + pos, avail > pos ? avail - pos : 0, &int_size);
+      if (!element_count) {
+        if (int_size == kDecodeIntFailed) {
+          throw BserParseError("invalid template element count");
+        }
+        *needed = pos + int_size;
+        return std::nullopt;
+      }
+      if (*element_count < 0) {
+        throw BserParseError("template has negative size");
+      }
+      pos += int_size;
+
+      // key_count values per object; BSER_SKIP placeholders measure as a
+      // single byte via skipValue.
+      for (json_int_t i = 0; i < *element_count * *key_count; i++) {
+        size_t child_needed;
+        auto child = skipValue(
+            buf + pos, avail > pos ? avail - pos : 0, &child_needed, depth + 1);
+        if (!child) {
+          *needed = pos + child_needed;
+          return std::nullopt;
+        }
+        pos += *child;
+      }
+      return pos;
+    }
+
+    default:
+      throw BserParseError(
+          "invalid bser encoding type: {:02x}", uint8_t(buf[0]));
+  }
+}
+
+} // namespace
+
+std::optional<size_t>
+bunser_skip(const char* buf, size_t avail, size_t* needed) {
+  return skipValue(buf, avail, needed, 0);
+}
+
+std::optional<json_int_t>
+bunser_array_header(const char* buf, size_t avail, size_t* needed) {
+  if (avail == 0) {
+    *needed = 1;
+    return std::nullopt;
+  }
+  if (buf[0] != BSER_ARRAY) {
+    *needed = kDecodeIntFailed;
+    return std::nullopt;
+  }
+  size_t int_size;
+  auto count = bunser_int(buf + 1, avail - 1, &int_size);
+  if (!count) {
+    if (int_size == kDecodeIntFailed) {
+      *needed = kDecodeIntFailed;
+    } else {
+      *needed = 1 + int_size;
+    }
+    return std::nullopt;
+  }
+  if (*count < 0) {
+    *needed = kDecodeIntFailed;
+    return std::nullopt;
+  }
+  *needed = 1 + int_size;
+  return count;
+}
+
+namespace watchman {
+
+namespace {
+
+/**
+ * Reads a tagged integer at `p`, advancing `p` past it. Unlike
+ * bunser_int, truncation is an error here: cursors only operate on
+ * complete documents.
+ */
+json_int_t cursorReadInt(const char*& p, const char* end) {
+  size_t consumed;
+  auto value = bunser_int(p, end - p, &consumed);
+  if (!value) {
+    if (consumed == kDecodeIntFailed) {
+      throw BserParseError("expected an integer value");
+    }
+    throw BserParseError("unexpected EOF in bser document");
+  }
+  p += consumed;
+  return *value;
+}
+
+size_t cursorReadSize(const char*& p, const char* end, const char* label) {
+  json_int_t size = cursorReadInt(p, end);
+  if (size < 0) {
+    throw BserParseError("{} has negative size", label);
+  }
+  size_t rv = size;
+  if (rv > kMaximumContainerSize) {
+    throw BserParseError("{} size is too large: {}", label, rv);
+  }
+  return rv;
+}
+
+/**
+ * Measures the complete value at `p` and advances `p` past it.
+ */
+void cursorSkipValue(const char*& p, const char* end) {
+  size_t needed;
+  auto size = bunser_skip(p, end - p, &needed);
+  if (!size) {
+    throw BserParseError("unexpected EOF in bser document");
+  }
+  p += *size;
+}
+
+} // namespace
+
+char BserValue::tag() const {
+  if (buf_ >= end_) {
+    throw BserParseError("unexpected EOF in bser document");
+  }
+  return *buf_;
+}
+
+bool BserValue::isNull() const {
+  return tag() == BSER_NULL;
+}
+
+bool BserValue::isBool() const {
+  char t = tag();
+  return t == BSER_TRUE || t == BSER_FALSE;
+}
+
+bool BserValue::isInteger() const {
+  switch (tag()) {
+    case BSER_INT8:
+    case BSER_INT16:
+    case BSER_INT32:
+    case BSER_INT64:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool BserValue::isString() const {
+  char t = tag();
+  return t == BSER_BYTESTRING || t == BSER_UTF8STRING;
+}
+
+bool BserValue::isArray() const {
+  return tag() == BSER_ARRAY;
+}
+
+bool BserValue::isObject() const {
+  return tag() == BSER_OBJECT;
+}
+
+bool BserValue::asBool() const {
+  switch (tag()) {
+    case BSER_TRUE:
+      return true;
+    case BSER_FALSE:
+      return false;
+    default:
+      throw BserParseError("expected a boolean value");
+  }
+}
+
+json_int_t BserValue::asInteger() const {
+  const char* p = buf_;
+  return cursorReadInt(p, end_);
+}
+
+double BserValue::asReal() const {
+  if (tag() != BSER_REAL) {
+    throw BserParseError("expected a real value");
+  }
+  if (static_cast<size_t>(end_ - buf_) < 1 + sizeof(double)) {
+    throw BserParseError("unexpected EOF in bser document");
+  }
+  double dval;
+  memcpy(&dval, buf_ + 1, sizeof(dval));
+  if (!isfinite(dval)) {
+    throw BserParseError("reals must be finite");
+  }
+  return dval;
+}
+
+std::string_view BserValue::asStringPiece() const {
+  if (!isString()) {
+    throw BserParseError("expected a string value");
+  }
+  const char* p = buf_ + 1;
+  size_t length = cursorReadSize(p, end_, "string");
+  if (length > static_cast<size_t>(end_ - p)) {
+    throw BserParseError("unexpected EOF in bser document");
+  }
+  return std::string_view{p, length};
+}
+
+w_string BserValue::asWString() const {
+  char t = tag();
+  auto piece = asStringPiece();
+  return w_string{
+      piece.data(),
+      piece.size(),
+      t == BSER_BYTESTRING ? W_STRING_BYTE : W_STRING_UNICODE};
+}
+
+size_t BserValue::arraySize() const {
+  if (!isArray()) {
+    throw BserParseError("expected an array value");
+  }
+  const char* p = buf_ + 1;
+  return cursorReadSize(p, end_, "array");
+}
+
+void BserValue::eachArrayElement(
+    folly::FunctionRef<void(const BserValue&)> fn) const {
+  if (!isArray()) {
+    throw BserParseError("expected an array value");
+  }
+  const char* p = buf_ + 1;
+  size_t count = cursorReadSize(p, end_, "array");
+  for (size_t i = 0; i < count; i++) {
+    BserValue element{p, end_};
+    cursorSkipValue(p, end_);
+    fn(element);
+  }
+}
+
+void BserValue::eachObjectField(
+    folly::FunctionRef<void(std::string_view, const BserValue&)> fn) const {
+  if (!isObject()) {
+    throw BserParseError("expected an object value");
+  }
+  const char* p = buf_ + 1;
+  size_t count = cursorReadSize(p, end_, "object");
+  for (size_t i = 0; i < count; i++) {
+    auto key = BserValue{p, end_}.asStringPiece();
+    cursorSkipValue(p, end_);
+    BserValue value{p, end_};
+    cursorSkipValue(p, end_);
+    fn(key, value);
+  }
+}
+
+json_ref BserValue::toJson() const {
+  return bunser(buf_, end_);
+}
+
+} // namespace watchman
@@ -7,13 +7,21 @@
 
 #pragma once
 
+#include <string_view>
+
 #include <fmt/core.h>
+#include <folly/Function.h>
 #include "watchman/thirdparty/jansson/jansson.h"
 
 typedef struct bser_ctx {
   uint32_t bser_version;
   uint32_t bser_capabilities;
   json_dump_callback_t dump;
+  // Optional sink for payload chunks whose storage is guaranteed to stay
+  // valid until the whole document has been dumped (string bodies backed
+  // by the json_ref being encoded). Consumers can reference such chunks
+  // in place rather than copying them. Falls back to `dump` when null.
+  json_dump_callback_t dump_stable = nullptr;
 } bser_ctx_t;
 
 class BserParseError : public std::exception {
@@ -52,15 +60,124 @@ class BserParseTooDeep : public BserParseError {
 // BSERv2 capabilities. Must be powers of 2.
 #define BSER_CAP_DISABLE_UNICODE 0x1
 #define BSER_CAP_DISABLE_UNICODE_FOR_ERRORS 0x2
+// The PDU payload is a single zstd frame; inflating it yields the
+// document bytes exactly as a plain PDU would carry them after the
+// length marker (which advertises the compressed size).  Negotiated
+// per client: a peer sets this bit to accept compressed PDUs, and the
+// sender echoes it only on PDUs it actually compressed, so small or
+// incompressible payloads can still travel plain.
+#define BSER_CAP_COMPRESSION_ZSTD 0x4
 
 int w_bser_write_pdu(
     const uint32_t bser_version,
     const uint32_t capabilities,
     json_dump_callback_t dump,
     const json_ref& json,
+    void* data,
+    json_dump_callback_t dump_stable = nullptr);
+
+/**
+ * Write just the PDU envelope (magic, the capability word for v2, and
+ * the advertised payload length) with no document body.  Used by the
+ * compressed PDU path, whose payload is a zstd frame rather than bser
+ * bytes that w_bser_write_pdu could measure itself.
+ */
+int w_bser_write_pdu_header(
+    const uint32_t bser_version,
+    const uint32_t capabilities,
+    json_int_t payload_len,
+    json_dump_callback_t dump,
     void* data);
+
 int w_bser_dump(const bser_ctx_t* ctx, const json_ref& json, void* data);
 
+namespace watchman {
+
+/**
+ * The complete encoded bytes of one BSER array value (header, template
+ * if any, count and rows), held in bounded-size chunks.  Attached to an
+ * otherwise empty json array via json_array_set_preencoded(); the BSER
+ * encoder splices the chunks verbatim when it reaches that array.
+ */
+struct BserPreencodedArray {
+  uint32_t bserVersion;
+  uint32_t bserCapabilities;
+  size_t rowCount;
+  size_t totalBytes;
+  std::vector<std::string> chunks;
+};
+
+/**
+ * When `json` is (or is an object directly containing) an array of at
+ * least several thousand rows, encodes the rows in parallel: shards are
+ * claimed by thread pool workers (the calling thread participates, so
+ * progress does not depend on pool capacity) and the finished bytes are
+ * attached via json_array_set_preencoded() for the encoder to splice.
+ * Output is byte-identical to the serial encoder.  A no-op for small
+ * documents or arrays that already carry encoded bytes; arrays keep
+ * their DOM, so encoding the same document for a client with a
+ * different BSER version or capability set falls back to the normal
+ * path.
+ *
+ * Safe to call on a document shared with other threads (eg: a result
+ * cache hit being encoded for several clients at once): the annotation
+ * slot is atomic, and racing annotators at worst duplicate the encode
+ * work, with the last store winning.
+ */
+void bserParallelPreencode(
+    const json_ref& json,
+    uint32_t bserVersion,
+    uint32_t bserCapabilities);
+
+/**
+ * Encodes query result rows to BSER as they are rendered, so each row's
+ * json tree can be released immediately instead of accumulating until
+ * the response is serialized.  Query memory is then bounded by the
+ * encoded size of the result (held in ~1MiB chunks) rather than by the
+ * much larger DOM representation.
+ *
+ * Rows are either bare values (numColumns == 0, single-field queries)
+ * or columnar arrays in field-list order; the latter are emitted in
+ * BSER template form, matching what bser_template() would produce for
+ * the equivalent DOM, minus the column-wide integer sizing pass (each
+ * cell picks its own minimal width, which is equally valid BSER).
+ */
+class BserRenderSink {
+ public:
+  BserRenderSink(
+      uint32_t bserVersion,
+      uint32_t bserCapabilities,
+      size_t numColumns);
+
+  /** Encodes one row; the caller may release it immediately after. */
+  void append(const json_ref& row);
+
+  size_t rowCount() const {
+    return rowCount_;
+  }
+
+  /**
+   * Seals the sink: prepends the array/template header and row count
+   * and returns the finished value.  templ is the field-name key array
+   * for columnar rows, or std::nullopt when numColumns is 0.
+   */
+  std::shared_ptr<const BserPreencodedArray> finish(
+      std::optional<json_ref> templ);
+
+ private:
+  void dumpValue(const json_ref& v);
+  void put(const char* buf, size_t size);
+  static int collect(const char* buffer, size_t size, void* data);
+
+  uint32_t version_;
+  uint32_t capabilities_;
+  size_t numColumns_;
+  size_t rowCount_{0};
+  std::vector<std::string> chunks_;
+};
+
+} // namespace watchman
+
 constexpr size_t kDecodeIntFailed = ~size_t{};
 
 /**
@@ -80,3 +197,89 @@ bunser_int(const char* buf, size_t avail, size_t* needed);
  * Ignores any unused data at the end of the buffer.
  */
 json_ref bunser(const char* buf, const char* end);
+
+/**
+ * Computes the encoded size of the complete BSER value at the start of
+ * [buf, buf+avail) without materializing it.
+ *
+ * Returns the size if the whole value is present. Returns std::nullopt if
+ * more data is required; *needed is set to a lower bound on the number of
+ * bytes that must be available before it is worth retrying.
+ *
+ * Throws BserParseError if the buffer does not begin a valid BSER value.
+ */
+std::optional<size_t> bunser_skip(const char* buf, size_t avail, size_t* needed);
+
+/**
+ * Attempts to decode a BSER array header at the start of [buf, buf+avail).
+ *
+ * Returns the element count if successful; *needed is set to the number of
+ * header bytes consumed. Returns std::nullopt if more data is required and
+ * sets *needed to the number of bytes to retry with.
+ *
+ * If *needed is kDecodeIntFailed, the value is not a BSER array.
+ */
+std::optional<json_int_t>
+bunser_array_header(const char* buf, size_t avail, size_t* needed);
+
+namespace watchman {
+
+/**
+ * A non-owning cursor over a single encoded value inside a BSER document.
+ *
+ * Unlike bunser(), which materializes the whole document as json_ref
+ * values, a cursor carries only the value's position and decodes on
+ * demand, in place. String accessors return views into the underlying
+ * buffer, so the buffer must outlive anything decoded from it by
+ * reference.
+ *
+ * Construction is free; accessors throw BserParseError when the encoding
+ * is malformed, truncated, or not of the requested type.
+ */
+class BserValue {
+ public:
+  /// `buf` must point at the first byte of an encoded value; `end` is the
+  /// end of the enclosing document.
+  BserValue(const char* buf, const char* end) : buf_{buf}, end_{end} {}
+
+  bool isNull() const;
+  bool isBool() const;
+  bool isInteger() const;
+  bool isString() const;
+  bool isArray() const;
+  bool isObject() const;
+
+  bool asBool() const;
+  json_int_t asInteger() const;
+  double asReal() const;
+
+  /// Returns a view of the string payload without copying it.
+  std::string_view asStringPiece() const;
+
+  /// Returns the string payload as a w_string, preserving the encoded
+  /// string type (byte vs unicode) the same way the DOM decoder does.
+  w_string asWString() const;
+
+  /// Number of elements in an array value.
+  size_t arraySize() const;
+
+  /// Invokes `fn` once per array element, in encoded order.
+  void eachArrayElement(folly::FunctionRef<void(const BserValue&)> fn) const;
+
+  /// Invokes `fn` once per object field, in encoded order. Keys are
+  /// views into the buffer.
+  void eachObjectField(
+      folly::FunctionRef<void(std::string_view, const BserValue&)> fn) const;
+
+  /// Materializes this value as a json_ref, for consumers that need the
+  /// DOM form of a subtree.
+  json_ref toJson() const;
+
+ private:
+  char tag() const;
+
+  const char* buf_;
+  const char* end_;
+};
+
+} // namespace watchman
@@ -17,8 +17,13 @@
 #include "watchman/InMemoryView.h"
 #include "watchman/LRUCache.h"
 #include "watchman/Logging.h"
+#include "watchman/MemoryBudget.h"
+#include "watchman/PerfSample.h"
 #include "watchman/Poison.h"
 #include "watchman/QueryableView.h"
+#include "watchman/TraceSpan.h"
+#include "watchman/query/eval.h"
+#include "watchman/query/parse.h"
 #include "watchman/root/Root.h"
 #include "watchman/watchman_cmd.h"
 
@@ -91,6 +96,31 @@ static UntypedResponse cmd_debug_ageout(Client* client, const json_ref& args) {
 }
 W_CMD_REG("debug-ageout", cmd_debug_ageout, CMD_DAEMON, w_cmd_realpath_root);
 
+/* debug-query-plan */
+static UntypedResponse cmd_debug_query_plan(
+    Client* client,
+    const json_ref& args) {
+  /* resolve the root */
+  if (json_array_size(args) != 3) {
+    throw ErrorResponse("wrong number of arguments for 'debug-query-plan'");
+  }
+
+  auto root = resolveRoot(client, args);
+
+  // Parsing runs the planning pass; report what it chose without
+  // evaluating the query.
+  auto query = parseQuery(root, args.at(2));
+
+  UntypedResponse resp;
+  resp.set("plan", explainQueryPlan(*query));
+  return resp;
+}
+W_CMD_REG(
+    "debug-query-plan",
+    cmd_debug_query_plan,
+    CMD_DAEMON,
+    w_cmd_realpath_root);
+
 static UntypedResponse cmd_debug_poison(Client* client, const json_ref& args) {
   auto root = resolveRoot(client, args);
 
@@ -110,6 +140,22 @@ static UntypedResponse cmd_debug_poison(Client* client, const json_ref& args) {
 }
 W_CMD_REG("debug-poison", cmd_debug_poison, CMD_DAEMON, w_cmd_realpath_root);
 
+/* debug-metrics */
+static UntypedResponse cmd_debug_metrics(Client*, const json_ref& args) {
+  if (json_array_size(args) != 1) {
+    throw ErrorResponse("wrong number of arguments for 'debug-metrics'");
+  }
+
+  UntypedResponse resp;
+  resp.set("metrics", renderPerfMetrics());
+  return resp;
+}
+W_CMD_REG(
+    "debug-metrics",
+    cmd_debug_metrics,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    NULL);
+
 static UntypedResponse cmd_debug_drop_privs(Client* client, const json_ref&) {
   client->client_is_owner = false;
 
@@ -295,12 +341,14 @@ struct DebugStatusCommand : PrettyCommand<DebugStatusCommand> {
   struct Response : BaseResponse {
     std::vector<RootDebugStatus> roots;
     std::vector<ClientDebugStatus> clients;
+    MemoryBudgetDebugStatus memory;
 
     template <typename X>
     void map(X& x) {
       BaseResponse::map(x);
       x("roots", roots);
       x("clients", clients);
+      x("memory", memory);
     }
   };
 
@@ -309,6 +357,7 @@ struct DebugStatusCommand : PrettyCommand<DebugStatusCommand> {
     res.version = w_string{PACKAGE_VERSION, W_STRING_UNICODE};
     res.roots = Root::getStatusForAllRoots();
     res.clients = UserClient::getStatusForAllClients();
+    res.memory = MemoryBudgetDebugStatus::get();
     return res;
   }
 
@@ -345,6 +394,19 @@ struct DebugStatusCommand : PrettyCommand<DebugStatusCommand> {
       fmt::print("  - state: {}\n", client.state);
       fmt::print("\n");
     }
+
+    fmt::print("MEMORY\n------\n");
+    if (response.memory.budget_bytes) {
+      fmt::print("  - budget_bytes: {}\n", response.memory.budget_bytes);
+    } else {
+      fmt::print("  - budget: disabled\n");
+    }
+    fmt::print("  - live_bytes: {}\n", response.memory.live_bytes);
+    fmt::print("  - queries_running: {}\n", response.memory.queries_running);
+    fmt::print("  - queries_admitted: {}\n", response.memory.queries_admitted);
+    fmt::print("  - queries_deferred: {}\n", response.memory.queries_deferred);
+    fmt::print("  - queries_rejected: {}\n", response.memory.queries_rejected);
+    fmt::print("\n");
     // fmt does not flush, so when the stream is not line buffered the stream
     // needs to be manually flushed (or else nothing is written to stdout).
     // eventually this can be fmt::flush instead:
@@ -471,5 +533,58 @@ W_CMD_REG(
     CMD_DAEMON,
     w_cmd_realpath_root);
 
+/* debug-recent-events /root
+ * Returns the merged per-thread processed-path rings, ordered by
+ * timestamp.  The rings are always on, so this shows the events
+ * leading up to a problem (a stuck settle, say) without having had to
+ * enable anything beforehand. */
+UntypedResponse cmdDebugRecentEvents(Client* client, const json_ref& args) {
+  if (json_array_size(args) != 2) {
+    throw ErrorResponse("wrong number of arguments for 'debug-recent-events'");
+  }
+
+  auto root = resolveRoot(client, args);
+
+  auto view = std::dynamic_pointer_cast<InMemoryView>(root->view());
+  if (!view) {
+    throw ErrorResponse("root is not an InMemoryView watcher");
+  }
+
+  UntypedResponse resp;
+  resp.set("events", view->debugRecentEvents());
+  return resp;
+}
+W_CMD_REG(
+    "debug-recent-events",
+    cmdDebugRecentEvents,
+    CMD_DAEMON,
+    w_cmd_realpath_root);
+
+/* debug-trace [clear]
+ * Returns the trace span ring, oldest span first.  Spans from the
+ * same request share a trace-id, so grouping by that id reconstructs
+ * where a slow query's time went (dispatch, cookie sync, pending
+ * queue, generation, render) across the threads involved.  Passing
+ * "clear" discards the rings contents after rendering them. */
+UntypedResponse cmdDebugTrace(Client*, const json_ref& args) {
+  bool clear = false;
+  if (json_array_size(args) == 2) {
+    if (!args.at(1).isString() || json_to_w_string(args.at(1)) != "clear") {
+      throw ErrorResponse("debug-trace: second argument must be 'clear'");
+    }
+    clear = true;
+  } else if (json_array_size(args) != 1) {
+    throw ErrorResponse("wrong number of arguments for 'debug-trace'");
+  }
+
+  UntypedResponse resp;
+  resp.set("spans", traceCollectSpans());
+  if (clear) {
+    traceClearSpans();
+  }
+  return resp;
+}
+W_CMD_REG("debug-trace", cmdDebugTrace, CMD_DAEMON, NULL);
+
 } // namespace
 } // namespace watchman
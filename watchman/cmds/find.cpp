@@ -29,7 +29,10 @@ static UntypedResponse cmd_find(Client* client, const json_ref& args) {
   }
   query->clientPid = client->stm ? client->stm->getPeerProcessID() : 0;
 
-  auto res = w_query_execute(query.get(), root, nullptr, getInterface);
+  auto res = w_query_execute(
+      query.get(), root, nullptr, getInterface, nullptr, [&] {
+        return client->peerHasDisconnected();
+      });
   UntypedResponse response;
   response.set(
       {{"clock", res.clockAtStartOfQuery.toJson()},
@@ -40,7 +43,7 @@ static UntypedResponse cmd_find(Client* client, const json_ref& args) {
 W_CMD_REG(
     "find",
     cmd_find,
-    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE | CMD_EXPENSIVE,
     w_cmd_realpath_root);
 
 /* vim:ts=2:sw=2:et:
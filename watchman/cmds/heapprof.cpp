@@ -9,10 +9,50 @@
 #include <folly/String.h>
 #include <folly/memory/Malloc.h>
 #include "watchman/Client.h"
+#include "watchman/MemoryAccounting.h"
 #include "watchman/watchman_cmd.h"
 
 using namespace watchman;
 
+// Reports the per-subsystem MemoryAccounting counters.  The counters
+// are monotonic, so callers measure allocation rates by diffing two
+// successive responses; the live_* figures answer "who owns the bytes"
+// directly when RSS grows, without the jemalloc dump cycle that
+// debug-prof-dump requires.
+static UntypedResponse cmd_debug_memory(Client*, const json_ref&) {
+  static constexpr MemorySubsystem kSubsystems[] = {
+      MemorySubsystem::Untagged,
+      MemorySubsystem::View,
+      MemorySubsystem::Pending,
+      MemorySubsystem::Query,
+      MemorySubsystem::Pdu,
+  };
+
+  std::unordered_map<w_string, json_ref> subsystems;
+  for (auto subsystem : kSubsystems) {
+    auto c = readMemoryCounters(subsystem);
+    subsystems.emplace(
+        w_string{memorySubsystemName(subsystem), W_STRING_UNICODE},
+        json_object({
+            {"live_bytes", json_integer(c.liveBytes)},
+            {"live_items", json_integer(c.liveItems)},
+            {"total_allocations", json_integer(c.allocCount)},
+            {"total_allocated_bytes", json_integer(c.allocBytes)},
+            {"total_frees", json_integer(c.freeCount)},
+            {"total_freed_bytes", json_integer(c.freeBytes)},
+        }));
+  }
+
+  UntypedResponse resp;
+  resp.set("memory", json_object(std::move(subsystems)));
+  return resp;
+}
+W_CMD_REG(
+    "debug-memory",
+    cmd_debug_memory,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    NULL);
+
 #if defined(FOLLY_USE_JEMALLOC)
 
 // This command is present to manually trigger a  heap profile dump when
@@ -123,7 +123,7 @@ static UntypedResponse cmd_list_capabilities(Client*, const json_ref&) {
 W_CMD_REG(
     "list-capabilities",
     cmd_list_capabilities,
-    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE,
     NULL);
 
 /* get-sockname */
@@ -153,7 +153,7 @@ static UntypedResponse cmd_get_sockname(Client*, const json_ref&) {
 W_CMD_REG(
     "get-sockname",
     cmd_get_sockname,
-    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE,
     NULL);
 
 static UntypedResponse cmd_get_config(Client* client, const json_ref& args) {
@@ -173,7 +173,11 @@ static UntypedResponse cmd_get_config(Client* client, const json_ref& args) {
   resp.set("config", std::move(*config));
   return resp;
 }
-W_CMD_REG("get-config", cmd_get_config, CMD_DAEMON, w_cmd_realpath_root);
+W_CMD_REG(
+    "get-config",
+    cmd_get_config,
+    CMD_DAEMON | CMD_ALLOW_PIPELINE,
+    w_cmd_realpath_root);
 
 } // namespace
 
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/Client.h"
+#include "watchman/Command.h"
+#include "watchman/Poison.h"
+#include "watchman/watchman_cmd.h"
+
+using namespace watchman;
+
+/* pipeline {"tag": T, "command": [...]}
+ *
+ * Executes the wrapped command on a worker thread and delivers its
+ * response out of band with a "tag" field echoing T, so a slow command
+ * (a cold query, say) does not head-of-line block cheaper commands on
+ * the same connection.  Only commands flagged CMD_ALLOW_PIPELINE --
+ * ones whose handlers don't mutate per-client state -- may be wrapped;
+ * everything else keeps the strictly ordered inline path.  Responses
+ * to pipelined commands may arrive in any order relative to each other
+ * and to inline responses; the tag is how the client matches them up.
+ */
+static UntypedResponse cmd_pipeline(Client* clientbase, const json_ref& args) {
+  auto* client = dynamic_cast<UserClient*>(clientbase);
+
+  if (json_array_size(args) != 2) {
+    throw ErrorResponse("wrong number of arguments for 'pipeline'");
+  }
+  const auto& spec = args.at(1);
+  if (!spec.isObject()) {
+    throw ErrorResponse("the argument to 'pipeline' must be an object");
+  }
+
+  auto tag = spec.get_optional("tag");
+  if (!tag || !(tag->isInt() || tag->isString())) {
+    throw ErrorResponse(
+        "'pipeline' requires a 'tag' that is an integer or string");
+  }
+
+  auto cmdJson = spec.get_optional("command");
+  if (!cmdJson || !cmdJson->isArray()) {
+    throw ErrorResponse("'pipeline' requires a 'command' array");
+  }
+
+  auto command = Command::parse(*cmdJson);
+  auto* def = command.getCommandDefinition();
+  if (!def) {
+    throw ErrorResponse("unknown command {}", command.name());
+  }
+  if (!def->flags.contains(CMD_ALLOW_PIPELINE)) {
+    throw ErrorResponse("command {} cannot be pipelined", command.name());
+  }
+
+  // The pool task bypasses dispatchCommand, so replicate its gating
+  // here where we can still answer inline.
+  if (!def->flags.contains(CMD_DAEMON)) {
+    throw ErrorResponse(
+        "command {} not available in this mode", command.name());
+  }
+  {
+    auto reason = poisoned_reason.rlock();
+    if (!reason->empty() && !def->flags.contains(CMD_POISON_IMMUNE)) {
+      throw ErrorResponse("{}", *reason);
+    }
+  }
+  if (!client->client_is_owner && !def->flags.contains(CMD_ALLOW_ANY_USER)) {
+    throw ErrorResponse(
+        "you must be the process owner to execute '{}'", def->name);
+  }
+
+  client->launchPipelined(std::move(command), json_ref(*tag));
+
+  // The tagged response is delivered when the task completes; nothing
+  // to send now.
+  throw ResponseWasHandledManually{};
+}
+W_CMD_REG("pipeline", cmd_pipeline, CMD_DAEMON | CMD_ALLOW_ANY_USER, NULL);
+W_CAP_REG("pipeline")
+
+/* async-dispatch true|false
+ *
+ * Opts this connection into (or out of) automatic offload of
+ * CMD_EXPENSIVE commands.  While enabled, the server counts every
+ * command dispatched on the connection; an expensive command (query,
+ * since, find, ...) runs on a background pool thread and its response
+ * arrives out of band with a "tag" field set to that command's ordinal,
+ * while cheap commands keep the ordered inline path.  It is `pipeline`
+ * without the per-command wrapping, for clients that issue a mix of
+ * slow queries and latency-sensitive health checks over one connection.
+ */
+static UntypedResponse cmd_async_dispatch(
+    Client* clientbase,
+    const json_ref& args) {
+  auto* client = dynamic_cast<UserClient*>(clientbase);
+
+  if (json_array_size(args) != 2) {
+    throw ErrorResponse("wrong number of arguments for 'async-dispatch'");
+  }
+  const auto& arg = args.at(1);
+  if (!arg.isBool()) {
+    throw ErrorResponse("the argument to 'async-dispatch' must be a boolean");
+  }
+
+  bool enable = arg.asBool();
+  if (enable) {
+    // Restart the ordinal count; the response to this command is the
+    // last one guaranteed to be strictly ordered.
+    client->asyncDispatchSeq = 0;
+  } else {
+    // In-flight offloaded responses may still arrive after this.
+    client->asyncDispatchSeq.reset();
+  }
+
+  UntypedResponse resp;
+  resp.set("async-dispatch", json_boolean(enable));
+  return resp;
+}
+W_CMD_REG(
+    "async-dispatch",
+    cmd_async_dispatch,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    NULL);
+W_CAP_REG("async-dispatch")
@@ -7,11 +7,16 @@
 
 #include "watchman/query/Query.h"
 #include "watchman/Client.h"
+#include "watchman/bser.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
+#include "watchman/root/Root.h"
 #include "watchman/saved_state/SavedStateFactory.h"
 #include "watchman/watchman_cmd.h"
 
+#include <thread>
+#include <vector>
+
 using namespace watchman;
 
 /* query /root {query} */
@@ -30,26 +35,163 @@ static UntypedResponse cmd_query(Client* client, const json_ref& args) {
     query->sync_timeout = std::chrono::milliseconds(0);
   }
 
-  auto res = w_query_execute(query.get(), root, nullptr, getInterface);
+  // BSER clients get their result rows encoded as they are rendered,
+  // bounding query memory by the encoded size of the response instead
+  // of accumulating the whole DOM; JSON clients keep the DOM path since
+  // the streamed bytes are BSER-only.
+  std::optional<BserRenderSink> renderSink;
+  if (client->format.type == is_bser || client->format.type == is_bser_v2) {
+    renderSink.emplace(
+        client->format.type == is_bser_v2 ? 2 : 1,
+        client->format.capabilities,
+        query->fieldList.size() > 1 ? query->fieldList.size() : 0);
+  }
+
+  auto res = w_query_execute(
+      query.get(),
+      root,
+      nullptr,
+      getInterface,
+      nullptr,
+      [&] { return client->peerHasDisconnected(); },
+      renderSink ? &*renderSink : nullptr);
   UntypedResponse response;
   response.set(
       {{"is_fresh_instance", json_boolean(res.isFreshInstance)},
        {"clock", res.clockAtStartOfQuery.toJson()},
        {"files", std::move(res.resultsArray).toJson()},
        {"debug", res.debugInfo.render()}});
+  if (query->result_limit.has_value()) {
+    response.set("is_limited", json_boolean(res.isLimited));
+  }
   if (res.savedStateInfo) {
     response.set("saved-state-info", std::move(*res.savedStateInfo));
   }
 
   add_root_warnings_to_response(response, root);
 
+  // Opt-in zero-copy delivery for giant results: mark the response so
+  // the client thread renders it into an unlinked memfd and passes the
+  // descriptor over the unix socket instead of copying hundreds of MB
+  // through it; see UserClient::trySendViaMemfd.  Unsupported
+  // platforms and transports fall back to the plain socket write.
+  if (auto viaMemfd = query_spec.get_optional("response_via_memfd");
+      viaMemfd && viaMemfd->isTrue()) {
+    response.set("response_via_memfd", json_true());
+  }
+
   return response;
 }
 W_CMD_REG(
     "query",
     cmd_query,
-    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_CLIENT | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE |
+        CMD_EXPENSIVE,
     w_cmd_realpath_root);
 
+/* multi-query [{"root": "/path", "query": {query}}, ...]
+ *
+ * Runs one query per entry concurrently, each against its own root, and
+ * returns the results as an array tagged by root path.  The roots hold
+ * independent locks, so the overall latency is the slowest root rather
+ * than the sum of all of them. */
+static UntypedResponse cmd_multi_query(Client* client, const json_ref& args) {
+  if (json_array_size(args) != 2) {
+    throw ErrorResponse("wrong number of arguments for 'multi-query'");
+  }
+
+  const auto& entries = args.at(1);
+  if (!entries.isArray() || entries.array().empty()) {
+    throw ErrorResponse(
+        "'multi-query' expects a non-empty array of {\"root\", \"query\"} entries");
+  }
+
+  struct PerRoot {
+    std::shared_ptr<Root> root;
+    std::shared_ptr<Query> query;
+    std::optional<json_ref> result;
+    std::optional<std::string> error;
+  };
+  std::vector<PerRoot> perRoot;
+  perRoot.reserve(entries.array().size());
+
+  // Resolve and parse everything up front so that malformed input fails
+  // the whole command before any query has started running.
+  for (const auto& entry : entries.array()) {
+    if (!entry.isObject()) {
+      throw ErrorResponse("each 'multi-query' entry must be an object");
+    }
+    auto rootName = entry.get_optional("root");
+    if (!rootName || !rootName->isString()) {
+      throw ErrorResponse(
+          "each 'multi-query' entry requires a \"root\" string");
+    }
+    auto root = resolveRootByName(client, json_string_value(*rootName));
+
+    auto querySpec = entry.get_optional("query");
+    auto query = parseQuery(root, querySpec ? *querySpec : json_object());
+    query->clientPid = client->stm ? client->stm->getPeerProcessID() : 0;
+    if (client->client_mode) {
+      query->sync_timeout = std::chrono::milliseconds(0);
+    }
+
+    perRoot.push_back(
+        PerRoot{std::move(root), std::move(query), std::nullopt, std::nullopt});
+  }
+
+  // Each query spends most of its time blocked on its root's sync cookie
+  // and view locks, so run them on dedicated threads rather than the
+  // shared pool: the parallel evaluator schedules its shard work there,
+  // and parking blocked queries in the pool could starve it.
+  std::vector<std::thread> threads;
+  threads.reserve(perRoot.size());
+  for (auto& entry : perRoot) {
+    threads.emplace_back([&entry] {
+      try {
+        auto res =
+            w_query_execute(entry.query.get(), entry.root, nullptr, getInterface);
+        auto obj = json_object(
+            {{"root", w_string_to_json(entry.root->root_path)},
+             {"is_fresh_instance", json_boolean(res.isFreshInstance)},
+             {"clock", res.clockAtStartOfQuery.toJson()},
+             {"files", std::move(res.resultsArray).toJson()}});
+        if (entry.query->result_limit.has_value()) {
+          obj.set("is_limited", json_boolean(res.isLimited));
+        }
+        entry.result = std::move(obj);
+      } catch (const std::exception& exc) {
+        entry.error = exc.what();
+      }
+    });
+  }
+  for (auto& thr : threads) {
+    thr.join();
+  }
+
+  std::vector<json_ref> results;
+  results.reserve(perRoot.size());
+  for (auto& entry : perRoot) {
+    if (entry.error) {
+      // A root that failed doesn't fail its siblings; report the error
+      // in that root's slot so the caller can retry it alone.
+      results.push_back(json_object(
+          {{"root", w_string_to_json(entry.root->root_path)},
+           {"error",
+            typed_string_to_json(entry.error->c_str(), W_STRING_MIXED)}}));
+    } else {
+      results.push_back(std::move(*entry.result));
+    }
+  }
+
+  UntypedResponse response;
+  response.set("results", json_array(std::move(results)));
+  return response;
+}
+W_CMD_REG(
+    "multi-query",
+    cmd_multi_query,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE | CMD_EXPENSIVE,
+    NULL);
+
 /* vim:ts=2:sw=2:et:
  */
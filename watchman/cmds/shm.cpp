@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+
+#include "watchman/Client.h"
+#include "watchman/Errors.h"
+#include "watchman/ShmRing.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+#include "watchman/watchman_cmd.h"
+
+#ifndef _WIN32
+
+using namespace watchman;
+
+namespace {
+
+constexpr size_t kDefaultRingSize = size_t{1} << 20;
+constexpr size_t kMinRingSize = size_t{64} << 10;
+constexpr size_t kMaxRingSize = size_t{64} << 20;
+
+} // namespace
+
+/* shm-channel [{"size": BYTES}]
+ * Negotiates a shared memory fast channel for this connection.  The
+ * daemon creates a ring segment (mode 0600, so only the owning uid can
+ * attach) and returns its shm_open() name; from then on unilateral
+ * payloads are appended to the ring as BSER v2 PDUs and the socket
+ * carries a small {"shm-seq": n} control message per payload.  The
+ * client mmaps the segment, and on each control message drains records
+ * up to the given sequence number, advancing the readPos cursor in the
+ * ring header as it consumes them.  Payloads that do not fit in the
+ * ring fall back to the socket in order and bump the header's drop
+ * counter. */
+static UntypedResponse cmd_shm_channel(
+    Client* clientbase,
+    const json_ref& args) {
+  UserClient* client = (UserClient*)clientbase;
+
+  size_t size = kDefaultRingSize;
+  if (json_array_size(args) > 1) {
+    auto opts = args.at(1);
+    if (!opts.isObject()) {
+      throw ErrorResponse("expected 2nd parameter to be an options object");
+    }
+    if (auto jsize = opts.get_optional("size")) {
+      if (!jsize->isInt() || jsize->asInt() <= 0) {
+        throw ErrorResponse("size must be a positive integer");
+      }
+      size = std::clamp(size_t(jsize->asInt()), kMinRingSize, kMaxRingSize);
+    }
+  }
+
+  // Replaces any previously negotiated ring.  Records still sitting in
+  // the old segment are lost, so clients should drain before
+  // renegotiating.
+  client->shmRing = ShmRing::create(size, client->unique_id);
+
+  UntypedResponse resp;
+  resp.set(
+      {{"shm-name", typed_string_to_json(client->shmRing->name().c_str())},
+       {"capacity", json_integer(client->shmRing->capacity())},
+       {"shm-version", json_integer(ShmRing::kVersion)},
+       {"payload-format", typed_string_to_json("bser-v2")}});
+  return resp;
+}
+W_CMD_REG("shm-channel", cmd_shm_channel, CMD_DAEMON, NULL);
+
+#endif
@@ -35,7 +35,10 @@ static UntypedResponse cmd_since(Client* client, const json_ref& args) {
   auto query = parseQueryLegacy(root, args, 3, nullptr, clockspec, nullptr);
   query->clientPid = client->stm ? client->stm->getPeerProcessID() : 0;
 
-  auto res = w_query_execute(query.get(), root, nullptr, getInterface);
+  auto res = w_query_execute(
+      query.get(), root, nullptr, getInterface, nullptr, [&] {
+        return client->peerHasDisconnected();
+      });
   UntypedResponse response;
   response.set(
       {{"is_fresh_instance", json_boolean(res.isFreshInstance)},
@@ -52,7 +55,7 @@ static UntypedResponse cmd_since(Client* client, const json_ref& args) {
 W_CMD_REG(
     "since",
     cmd_since,
-    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE | CMD_EXPENSIVE,
     w_cmd_realpath_root);
 
 /* vim:ts=2:sw=2:et:
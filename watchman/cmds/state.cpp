@@ -81,6 +81,7 @@ static UntypedResponse cmd_state_enter(
   // This will throw if the state is already asserted or pending assertion
   // so we do this prior to linking it in to the client.
   root->assertedStates.wlock()->queueAssertion(assertion);
+  root->assertedStatesVersion++;
 
   // Increment state transition counter for this root
   root->stateTransCount++;
@@ -115,6 +116,7 @@ static UntypedResponse cmd_state_enter(
           // The client side of this will get removed when the client
           // disconnects or attempts to leave the state.
           root->assertedStates.wlock()->removeAssertion(assertion);
+          root->assertedStatesVersion++;
           return;
         }
         auto clock = w_string_to_json(root->view()->getCurrentClockString());
@@ -140,6 +142,7 @@ static UntypedResponse cmd_state_enter(
             assertion->enterPayload = payload;
           }
         }
+        root->assertedStatesVersion++;
       })
       .via(&getThreadPool());
 
@@ -196,6 +199,7 @@ static UntypedResponse cmd_state_leave(
     // and also in the post-sync portion of the code in cmd_state_enter().
     assertion->disposition = ClientStateDisposition::PendingLeave;
   }
+  root->assertedStatesVersion++;
 
   // Remove the association from the client.  We'll remove it from the
   // root on the other side of the sync.
@@ -6,12 +6,14 @@
  */
 
 #include <folly/MapUtil.h>
+#include <algorithm>
 #include "watchman/Client.h"
 #include "watchman/Errors.h"
 #include "watchman/Logging.h"
 #include "watchman/MapUtil.h"
 #include "watchman/QueryableView.h"
 #include "watchman/query/Query.h"
+#include "watchman/query/QueryContext.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
 #include "watchman/root/Root.h"
@@ -21,10 +23,88 @@
 
 using namespace watchman;
 
+// Clients that understand merged delta records can request them with
+// the emit_deltas subscription field.
+W_CAP_REG("subscription-deltas")
+
+// Clients that understand interned path ids can request them with the
+// path_dictionary subscription field.
+W_CAP_REG("path-dictionary")
+
+uint32_t ClientSubscription::PathDictionary::intern(
+    const w_string& path,
+    std::vector<json_ref>& newBindings) {
+  auto [it, inserted] = ids_.emplace(path, nextId_);
+  if (inserted) {
+    ++nextId_;
+    newBindings.push_back(
+        json_array({json_integer(it->second), w_string_to_json(path)}));
+  }
+  return it->second;
+}
+
+void ClientSubscription::PathDictionary::clear() {
+  ids_.clear();
+  nextId_ = 1;
+}
+
+ClientSubscription::DeltaCache::DeltaCache(size_t maxEntries)
+    : maxEntries_(std::max<size_t>(maxEntries, 1)) {}
+
+void ClientSubscription::DeltaCache::clear() {
+  lru_.clear();
+  map_.clear();
+}
+
+void ClientSubscription::DeltaCache::apply(json_ref& record) {
+  if (!record.isObject()) {
+    // Only object-shaped records carry per-field state
+    return;
+  }
+  auto nameValue = record.get_optional("name");
+  if (!nameValue || !nameValue->isString()) {
+    return;
+  }
+  auto name = json_to_w_string(*nameValue);
+
+  auto it = map_.find(name);
+  if (it == map_.end()) {
+    // First sighting (or state was evicted): send in full and remember
+    if (map_.size() >= maxEntries_) {
+      map_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    lru_.push_front(name);
+    map_.emplace(name, Entry{record, lru_.begin()});
+    return;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second.lruIt);
+  it->second.lruIt = lru_.begin();
+
+  auto& prevFields = it->second.record.object();
+  auto delta = json_object();
+  delta.set("name", json_ref(*nameValue));
+  for (auto& [key, value] : record.object()) {
+    if (key == "name") {
+      continue;
+    }
+    auto prevIt = prevFields.find(key);
+    if (prevIt == prevFields.end() || !json_equal(prevIt->second, value)) {
+      delta.set(key, json_ref(value));
+    }
+  }
+
+  it->second.record = record;
+  record = std::move(delta);
+}
+
 ClientSubscription::ClientSubscription(
     const std::shared_ptr<Root>& root,
     std::weak_ptr<Client> client)
-    : root(root), weakClient(client) {}
+    : root(root),
+      contextScratch(std::make_unique<QueryContextScratch>()),
+      weakClient(client) {}
 
 std::shared_ptr<UserClient> ClientSubscription::lockClient() {
   auto client = weakClient.lock();
@@ -78,14 +158,32 @@ static std::tuple<sub_action, w_string> get_subscription_action(
 
   if (sub->last_sub_tick != position.ticks) {
     if (!sub->drop_or_defer.empty()) {
-      auto assertedStates = root->assertedStates.rlock();
+      // Refresh our snapshot of which policy states are asserted, but
+      // only when the asserted-state set has changed since we last
+      // looked; the common settle with no state activity is then a
+      // single atomic load rather than a lock acquisition and a map
+      // walk per policy.
+      auto version =
+          root->assertedStatesVersion.load(std::memory_order_acquire);
+      if (version != sub->lastAssertedStatesVersion) {
+        auto assertedStates = root->assertedStates.rlock();
+        sub->assertedPolicyStates.clear();
+        for (auto& policy_iter : sub->drop_or_defer) {
+          if (assertedStates->isStateAsserted(policy_iter.first)) {
+            sub->assertedPolicyStates.insert(policy_iter.first);
+          }
+        }
+        sub->lastAssertedStatesVersion = version;
+      }
+
       // This subscription has some policy for states.
       // Figure out what we should do.
       for (auto& policy_iter : sub->drop_or_defer) {
         auto name = policy_iter.first;
         bool policy_is_drop = policy_iter.second;
 
-        if (!assertedStates->isStateAsserted(name)) {
+        if (sub->assertedPolicyStates.find(name) ==
+            sub->assertedPolicyStates.end()) {
           continue;
         }
 
@@ -136,6 +234,62 @@ void ClientSubscription::processSubscription() {
   }
 }
 
+void ClientSubscription::speculativeEvaluate() {
+  // A batch of changes landed but the settle clock is still running;
+  // evaluate the subscription now and buffer the rendered response so
+  // the settle point can deliver it at wire latency.  If more changes
+  // land before the settle, the regular run patches in the remainder
+  // (buildSubscriptionResults advances since_spec, so the follow-up
+  // reports only the late arrivals -- a valid since stream, just split
+  // across two payloads).
+  //
+  // Subscriptions with a drop policy never speculate: a later drop
+  // would force us to discard a response whose delta-cache and
+  // path-dictionary mutations have already committed, corrupting the
+  // client's session state.  For the same reason a buffered response is
+  // always delivered before any newer evaluation.
+  if (!drop_or_defer.empty()) {
+    return;
+  }
+  if (query->since_spec && query->since_spec->hasScmParams()) {
+    // SCM-aware queries shell out to the VCS; too heavy to run twice.
+    return;
+  }
+  if (vcs_defer && root->view()->isVCSOperationInProgress()) {
+    return;
+  }
+  if (speculativeResponse) {
+    // Still holding an undelivered payload from an earlier hint.
+    return;
+  }
+  auto position = root->view()->getMostRecentRootNumberAndTickValue();
+  if (last_sub_tick == position.ticks || speculativeTick == position.ticks) {
+    return;
+  }
+  try {
+    ClockSpec at;
+    auto response =
+        buildSubscriptionResults(root, at, OnStateTransition::DontAdvance);
+    if (auto* clock = std::get_if<ClockSpec::Clock>(&at.spec)) {
+      // Evaluation ran (even if it matched nothing); the settle can
+      // skip its own run when no further changes arrive by then.
+      speculativeTick = clock->position.ticks;
+    }
+    if (response) {
+      speculativeResponse = std::move(*response);
+    }
+  } catch (const std::exception& exc) {
+    // since_spec only advances on success, so nothing is lost; the
+    // settle-time run will retry with the same basis.
+    log(ERR,
+        "Error speculatively evaluating subscription ",
+        name,
+        ": ",
+        exc.what(),
+        ". Deferring to the settle.\n");
+  }
+}
+
 void ClientSubscription::processSubscriptionImpl() {
   auto client = lockClient();
   if (!client) {
@@ -178,12 +332,51 @@ void ClientSubscription::processSubscriptionImpl() {
           name,
           " until VCS operations complete\n");
       executeQuery = false;
+    } else if (
+        query->relative_root &&
+        !(query->since_spec && query->since_spec->hasScmParams()) &&
+        !root->view()->subtreeMayHaveChangedSince(
+            *query->relative_root, last_sub_tick, root->case_sensitive)) {
+      // Everything in this settle landed outside our relative_root, so
+      // evaluating the query cannot produce results.  Fast-forward our
+      // tick but deliberately leave since_spec alone: the next real
+      // run then also covers the window we skipped, so a change we
+      // somehow failed to route is reported late rather than never.
+      log(DBG,
+          "subscription ",
+          name,
+          " scope ",
+          *query->relative_root,
+          " untouched by this settle; skipping evaluation\n");
+      last_sub_tick = position.ticks;
+      executeQuery = false;
     }
 
     if (executeQuery) {
       try {
-        last_sub_tick =
-            runSubscriptionRules(client.get(), root).position().ticks;
+        // Deliver any payload pre-rendered during the settle countdown
+        // first, so the response stream stays ordered.  If the position
+        // has not moved since it was evaluated it covers this settle
+        // entirely; otherwise since_spec already advanced past the
+        // speculated window and the regular run below reports only the
+        // late arrivals.
+        bool covered = false;
+        if (speculativeTick) {
+          if (speculativeResponse) {
+            add_root_warnings_to_response(*speculativeResponse, root);
+            client->enqueueResponse(std::move(*speculativeResponse));
+          }
+          covered = speculativeTick == position.ticks;
+          if (covered) {
+            last_sub_tick = speculativeTick;
+          }
+          speculativeResponse.reset();
+          speculativeTick = 0;
+        }
+        if (!covered) {
+          last_sub_tick =
+              runSubscriptionRules(client.get(), root).position().ticks;
+        }
       } catch (const std::exception& exc) {
         // This may happen if an SCM aware query fails to run hg for
         // whatever reason.  Since last_sub_tick is not advanced,
@@ -240,7 +433,8 @@ std::optional<UntypedResponse> ClientSubscription::buildSubscriptionResults(
   logf(DBG, "running subscription {} {}\n", name, fmt::ptr(this));
 
   try {
-    auto res = w_query_execute(query.get(), root, time_generator, getInterface);
+    auto res = w_query_execute(
+        query.get(), root, time_generator, getInterface, contextScratch.get());
 
     logf(
         DBG,
@@ -273,6 +467,70 @@ std::optional<UntypedResponse> ClientSubscription::buildSubscriptionResults(
       return std::nullopt;
     }
 
+    // Rewrite the batch into per-path field patches when the client
+    // negotiated emit_deltas.  Templated renders are positional arrays
+    // rather than field maps, so they pass through unchanged.
+    if (deltaCache && !res.resultsArray.templ) {
+      if (res.isFreshInstance) {
+        // The client rebuilds its state from scratch on a fresh
+        // instance, so ours must restart too.
+        deltaCache->clear();
+      }
+      for (auto& record : res.resultsArray.results) {
+        deltaCache->apply(record);
+      }
+    }
+
+    // Replace rendered paths with session-stable ids when the client
+    // negotiated path_dictionary.  Ids introduced by this batch are
+    // announced on the same response, so client-side expansion can
+    // never observe an unbound id.
+    std::optional<json_ref> newDictBindings;
+    if (pathDictionary) {
+      if (res.isFreshInstance) {
+        // The client rebuilds its state from scratch on a fresh
+        // instance, so the id space restarts with it.
+        pathDictionary->clear();
+      }
+      auto nameIndex = query->fieldList.indexOf("name");
+      std::vector<json_ref> bindings;
+      if (nameIndex) {
+        for (auto& record : res.resultsArray.results) {
+          if (record.isString()) {
+            // Bare value from a name-only field list
+            record = json_integer(pathDictionary->intern(
+                json_to_w_string(record), bindings));
+          } else if (record.isArray()) {
+            // Columnar row; the name sits at its field-list position
+            auto& row = record.array();
+            if (*nameIndex < row.size() && row[*nameIndex].isString()) {
+              std::vector<json_ref> newRow{row.begin(), row.end()};
+              newRow[*nameIndex] = json_integer(pathDictionary->intern(
+                  json_to_w_string(row[*nameIndex]), bindings));
+              record = json_array(std::move(newRow));
+            }
+          } else if (record.isObject()) {
+            auto nameValue = record.get_optional("name");
+            if (nameValue && nameValue->isString()) {
+              // The object node can be shared with the per-file render
+              // cache, the query result cache and the delta cache, so
+              // rewrite a copy rather than mutating it in place; the
+              // field values themselves are shared by refcount.
+              std::unordered_map<w_string, json_ref> fields = record.object();
+              fields.insert_or_assign(
+                  w_string{"name"},
+                  json_integer(pathDictionary->intern(
+                      json_to_w_string(*nameValue), bindings)));
+              record = json_object(std::move(fields));
+            }
+          }
+        }
+      }
+      if (!bindings.empty()) {
+        newDictBindings = json_array(std::move(bindings));
+      }
+    }
+
     UntypedResponse response;
 
     // It is way too much of a hassle to try to recreate the clock value if it's
@@ -294,6 +552,9 @@ std::optional<UntypedResponse> ClientSubscription::buildSubscriptionResults(
     if (res.savedStateInfo) {
       response.set({{"saved-state-info", std::move(*res.savedStateInfo)}});
     }
+    if (newDictBindings) {
+      response.set({{"path-dictionary", std::move(*newDictBindings)}});
+    }
 
     return response;
   } catch (const QueryExecError& e) {
@@ -537,6 +798,24 @@ static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
   }
   sub->vcs_defer = defer.asBool();
 
+  auto emit_deltas = query_spec.get_default("emit_deltas", json_false());
+  if (!emit_deltas.isBool()) {
+    throw ErrorResponse("emit_deltas must be boolean");
+  }
+  if (emit_deltas.asBool()) {
+    sub->deltaCache = std::make_unique<ClientSubscription::DeltaCache>(
+        size_t(root->config.getInt("subscription_delta_cache_size", 16384)));
+  }
+
+  auto path_dictionary = query_spec.get_default("path_dictionary", json_false());
+  if (!path_dictionary.isBool()) {
+    throw ErrorResponse("path_dictionary must be boolean");
+  }
+  if (path_dictionary.asBool()) {
+    sub->pathDictionary =
+        std::make_unique<ClientSubscription::PathDictionary>();
+  }
+
   if (defer_array) {
     for (auto& elt : *defer_array) {
       sub->drop_or_defer[json_to_w_string(elt)] = false;
@@ -585,7 +864,12 @@ static UntypedResponse cmd_subscribe(Client* clientbase, const json_ref& args) {
                 client->ping->notify();
               }
             },
-            info_json)));
+            info_json,
+            // The client thread drains every pending item per wakeup, so
+            // one unconsumed item is enough to guarantee delivery of
+            // everything published behind it; advertising 1 coalesces a
+            // settle generation into a single ping.
+            /*maxInflight=*/1)));
   }
 
   client->subscriptions[sub->name] = sub;
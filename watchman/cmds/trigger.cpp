@@ -61,7 +61,11 @@ static UntypedResponse cmd_trigger_delete(
   }
 
   if (res) {
-    w_state_save();
+    // O(entry) journal append rather than a full state-file rewrite.
+    w_state_append(json_object(
+        {{"op", typed_string_to_json("trigger-del")},
+         {"root", w_string_to_json(root->root_path)},
+         {"name", json_ref(jname)}}));
   }
 
   UntypedResponse resp;
@@ -184,7 +188,13 @@ static UntypedResponse cmd_trigger(Client* client, const json_ref& args) {
   }
 
   if (need_save) {
-    w_state_save();
+    // O(entry) journal append rather than a full state-file rewrite;
+    // registering hundreds of triggers would otherwise rewrite the
+    // whole state file once per registration.
+    w_state_append(json_object(
+        {{"op", typed_string_to_json("trigger-set")},
+         {"root", w_string_to_json(root->root_path)},
+         {"trigger", trig}}));
   }
 
   return resp;
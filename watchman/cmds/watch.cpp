@@ -10,7 +10,9 @@
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
 #include "watchman/LogConfig.h"
+#include "watchman/Logging.h"
 #include "watchman/QueryableView.h"
+#include "watchman/WatchmanConfig.h"
 #include "watchman/root/Root.h"
 #include "watchman/root/watchlist.h"
 #include "watchman/watchman_cmd.h"
@@ -95,7 +97,7 @@ static UntypedResponse cmd_clock(Client* client, const json_ref& args) {
 W_CMD_REG(
     "clock",
     cmd_clock,
-    CMD_DAEMON | CMD_ALLOW_ANY_USER,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE,
     w_cmd_realpath_root);
 
 /* watch-del /root
@@ -138,7 +140,11 @@ static UntypedResponse cmd_watch_list(Client*, const json_ref&) {
   resp.set("roots", std::move(root_paths));
   return resp;
 }
-W_CMD_REG("watch-list", cmd_watch_list, CMD_DAEMON | CMD_ALLOW_ANY_USER, NULL);
+W_CMD_REG(
+    "watch-list",
+    cmd_watch_list,
+    CMD_DAEMON | CMD_ALLOW_ANY_USER | CMD_ALLOW_PIPELINE,
+    NULL);
 
 // For each directory component in candidate_dir to the root of the filesystem,
 // look for root_file.  If root_file is present, update relpath to reflect the
@@ -266,7 +272,31 @@ static UntypedResponse cmd_watch(Client* client, const json_ref& args) {
     throw ErrorResponse("wrong number of arguments to 'watch'");
   }
 
-  auto root = resolveOrCreateRoot(client, args);
+  std::vector<json_ref> args_array = args.array();
+  w_string rel_path_from_watch;
+
+  // With consolidation enabled, a watch request for a directory inside
+  // an existing watched root reuses that root instead of spinning up a
+  // nested watch.  Overlapping watches otherwise each run their own
+  // crawl and kernel registrations over the same underlying files.
+  // The response carries relative_path exactly as watch-project does,
+  // so the client can scope its queries to the subtree it asked about.
+  if (cfg_get_bool("consolidate_overlapping_watches", false)) {
+    w_string_piece prefix;
+    w_string_piece relpiece;
+    auto requested = json_to_w_string(args_array[1]);
+    if (findEnclosingRoot(requested, prefix, relpiece) && !relpiece.empty()) {
+      logf(
+          ERR,
+          "watch: consolidating {} into enclosing watched root {}\n",
+          requested,
+          prefix);
+      rel_path_from_watch = relpiece.asWString();
+      args_array[1] = w_string_to_json(prefix.asWString());
+    }
+  }
+
+  auto root = resolveOrCreateRoot(client, json_array(std::move(args_array)));
   root->view()->waitUntilReadyToQuery().get();
 
   UntypedResponse resp;
@@ -282,6 +312,9 @@ static UntypedResponse cmd_watch(Client* client, const json_ref& args) {
          {"watcher", w_string_to_json(root->view()->getName())}});
   }
   add_root_warnings_to_response(resp, root);
+  if (!rel_path_from_watch.empty()) {
+    resp.set("relative_path", w_string_to_json(rel_path_from_watch));
+  }
   return resp;
 }
 W_CMD_REG(
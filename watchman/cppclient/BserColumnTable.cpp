@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BserColumnTable.h"
+
+#include <cstring>
+
+#include <fmt/core.h>
+
+#include "WatchmanConnection.h"
+
+namespace watchman {
+
+namespace {
+
+// BSER value tags, as emitted by the service (see watchman/bser.cpp).
+constexpr uint8_t kArray = 0x00;
+constexpr uint8_t kObject = 0x01;
+constexpr uint8_t kByteString = 0x02;
+constexpr uint8_t kInt8 = 0x03;
+constexpr uint8_t kInt16 = 0x04;
+constexpr uint8_t kInt32 = 0x05;
+constexpr uint8_t kInt64 = 0x06;
+constexpr uint8_t kReal = 0x07;
+constexpr uint8_t kTrue = 0x08;
+constexpr uint8_t kFalse = 0x09;
+constexpr uint8_t kNull = 0x0a;
+constexpr uint8_t kTemplate = 0x0b;
+constexpr uint8_t kSkip = 0x0c;
+constexpr uint8_t kUtf8String = 0x0d;
+
+// Bounds-checked walker over a contiguous BSER byte range.
+struct Cursor {
+  const uint8_t* p;
+  const uint8_t* end;
+
+  [[noreturn]] static void fail(const char* what) {
+    throw WatchmanError(fmt::format("invalid bser: {}", what));
+  }
+
+  void need(size_t n) const {
+    if (static_cast<size_t>(end - p) < n) {
+      fail("truncated value");
+    }
+  }
+
+  uint8_t peek() const {
+    need(1);
+    return *p;
+  }
+
+  uint8_t next() {
+    need(1);
+    return *p++;
+  }
+
+  // Integers are stored in the local byte order, matching the
+  // service's encoder.
+  template <typename T>
+  int64_t readFixed() {
+    need(sizeof(T));
+    T v;
+    memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+  }
+
+  // Reads an integer value including its tag byte.
+  int64_t readInt() {
+    switch (next()) {
+      case kInt8:
+        return readFixed<int8_t>();
+      case kInt16:
+        return readFixed<int16_t>();
+      case kInt32:
+        return readFixed<int32_t>();
+      case kInt64:
+        return readFixed<int64_t>();
+      default:
+        fail("expected an integer");
+    }
+  }
+
+  // Reads a real value including its tag byte.
+  double readReal() {
+    if (next() != kReal) {
+      fail("expected a real");
+    }
+    need(sizeof(double));
+    double v;
+    memcpy(&v, p, sizeof(double));
+    p += sizeof(double);
+    return v;
+  }
+
+  // Reads a string value including its tag byte; the returned piece
+  // aliases the underlying buffer.
+  folly::StringPiece readString() {
+    auto tag = next();
+    if (tag != kByteString && tag != kUtf8String) {
+      fail("expected a string");
+    }
+    auto len = readInt();
+    if (len < 0) {
+      fail("negative string length");
+    }
+    need(len);
+    folly::StringPiece piece{reinterpret_cast<const char*>(p), size_t(len)};
+    p += len;
+    return piece;
+  }
+
+  // Advances over one complete value of any type.
+  void skipValue() {
+    switch (next()) {
+      case kInt8:
+        need(1);
+        p += 1;
+        break;
+      case kInt16:
+        need(2);
+        p += 2;
+        break;
+      case kInt32:
+        need(4);
+        p += 4;
+        break;
+      case kInt64:
+        need(8);
+        p += 8;
+        break;
+      case kReal:
+        need(sizeof(double));
+        p += sizeof(double);
+        break;
+      case kTrue:
+      case kFalse:
+      case kNull:
+      case kSkip:
+        break;
+      case kByteString:
+      case kUtf8String: {
+        auto len = readInt();
+        if (len < 0) {
+          fail("negative string length");
+        }
+        need(len);
+        p += len;
+        break;
+      }
+      case kArray: {
+        auto n = readInt();
+        while (n-- > 0) {
+          skipValue();
+        }
+        break;
+      }
+      case kObject: {
+        auto n = readInt();
+        while (n-- > 0) {
+          skipValue(); // key
+          skipValue(); // value
+        }
+        break;
+      }
+      case kTemplate: {
+        if (next() != kArray) {
+          fail("template keys must be an array");
+        }
+        auto nkeys = readInt();
+        if (nkeys < 0) {
+          fail("negative column count");
+        }
+        for (int64_t i = 0; i < nkeys; ++i) {
+          skipValue();
+        }
+        auto nrows = readInt();
+        if (nrows < 0) {
+          fail("negative row count");
+        }
+        for (int64_t i = 0; i < nkeys * nrows; ++i) {
+          skipValue();
+        }
+        break;
+      }
+      default:
+        fail("unknown value tag");
+    }
+  }
+};
+
+// Validates the PDU framing and leaves the cursor at the root value.
+void skipPduHeader(Cursor& c) {
+  c.need(2);
+  if (c.p[0] != 0x00 || c.p[1] != 0x01) {
+    Cursor::fail("bad pdu header (expected bser v1)");
+  }
+  c.p += 2;
+  c.readInt(); // remaining length; the caller already framed the pdu
+}
+
+// Walks the top-level object's keys; on a match the cursor is left at
+// the corresponding value and true is returned.
+bool seekTopLevelKey(Cursor& c, folly::StringPiece key) {
+  skipPduHeader(c);
+  if (c.next() != kObject) {
+    Cursor::fail("root is not an object");
+  }
+  auto n = c.readInt();
+  while (n-- > 0) {
+    if (c.readString() == key) {
+      return true;
+    }
+    c.skipValue();
+  }
+  return false;
+}
+
+const char* cellTypeName(BserColumnTable::CellType t) {
+  switch (t) {
+    case BserColumnTable::CellType::Int:
+      return "int";
+    case BserColumnTable::CellType::Real:
+      return "real";
+    case BserColumnTable::CellType::String:
+      return "string";
+    case BserColumnTable::CellType::Bool:
+      return "bool";
+  }
+  return "unknown";
+}
+
+} // namespace
+
+BserColumnTable BserColumnTable::fromPdu(
+    std::unique_ptr<folly::IOBuf> pdu,
+    folly::StringPiece arrayKey) {
+  if (!pdu) {
+    throw WatchmanError("null pdu");
+  }
+  // String columns alias the buffer, so it must be one contiguous
+  // range for the life of the table.
+  auto range = pdu->coalesce();
+  Cursor c{range.begin(), range.end()};
+
+  BserColumnTable table;
+  table.pdu_ = std::move(pdu);
+
+  if (!seekTopLevelKey(c, arrayKey)) {
+    throw WatchmanError(
+        fmt::format("response has no \"{}\" key", std::string{arrayKey}));
+  }
+  if (c.next() != kTemplate) {
+    throw WatchmanError(fmt::format(
+        "\"{}\" is not a template array; the service only emits these "
+        "for field lists of two or more fields",
+        std::string{arrayKey}));
+  }
+  if (c.next() != kArray) {
+    Cursor::fail("template keys must be an array");
+  }
+  auto ncols = c.readInt();
+  if (ncols < 0) {
+    Cursor::fail("negative column count");
+  }
+  table.columns_.resize(ncols);
+  for (auto& col : table.columns_) {
+    col.name_ = c.readString().str();
+  }
+  auto nrows = c.readInt();
+  if (nrows < 0) {
+    Cursor::fail("negative row count");
+  }
+  table.numRows_ = nrows;
+  for (auto& col : table.columns_) {
+    col.present_.assign(table.numRows_, 0);
+  }
+
+  // Types the column's storage on its first value; every later value
+  // must agree.
+  auto ensureType = [&](Column& col, CellType t) {
+    if (!col.sawValue_) {
+      col.sawValue_ = true;
+      col.type_ = t;
+      switch (t) {
+        case CellType::Int:
+        case CellType::Bool:
+          col.ints_.assign(table.numRows_, 0);
+          break;
+        case CellType::Real:
+          col.reals_.assign(table.numRows_, 0.0);
+          break;
+        case CellType::String:
+          col.strings_.assign(table.numRows_, folly::StringPiece{});
+          break;
+      }
+    } else if (col.type_ != t) {
+      throw WatchmanError(fmt::format(
+          "column \"{}\" mixes {} and {} cells; use the decoded path",
+          col.name_,
+          cellTypeName(col.type_),
+          cellTypeName(t)));
+    }
+  };
+
+  for (size_t row = 0; row < table.numRows_; ++row) {
+    for (auto& col : table.columns_) {
+      switch (c.peek()) {
+        case kSkip:
+        case kNull:
+          c.next();
+          break;
+        case kInt8:
+        case kInt16:
+        case kInt32:
+        case kInt64: {
+          auto v = c.readInt();
+          ensureType(col, CellType::Int);
+          col.ints_[row] = v;
+          col.present_[row] = 1;
+          break;
+        }
+        case kReal: {
+          auto v = c.readReal();
+          ensureType(col, CellType::Real);
+          col.reals_[row] = v;
+          col.present_[row] = 1;
+          break;
+        }
+        case kTrue:
+        case kFalse: {
+          auto tag = c.next();
+          ensureType(col, CellType::Bool);
+          col.ints_[row] = tag == kTrue ? 1 : 0;
+          col.present_[row] = 1;
+          break;
+        }
+        case kByteString:
+        case kUtf8String: {
+          auto v = c.readString();
+          ensureType(col, CellType::String);
+          col.strings_[row] = v;
+          col.present_[row] = 1;
+          break;
+        }
+        default:
+          throw WatchmanError(fmt::format(
+              "column \"{}\" holds a nested value; use the decoded path",
+              col.name_));
+      }
+    }
+  }
+
+  return table;
+}
+
+const BserColumnTable::Column* BserColumnTable::findColumn(
+    folly::StringPiece name) const {
+  for (const auto& col : columns_) {
+    if (name == col.name_) {
+      return &col;
+    }
+  }
+  return nullptr;
+}
+
+bool bserPduHasTopLevelKey(folly::ByteRange pdu, folly::StringPiece key) {
+  Cursor c{pdu.begin(), pdu.end()};
+  return seekTopLevelKey(c, key);
+}
+
+} // namespace watchman
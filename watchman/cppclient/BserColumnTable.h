@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <folly/Range.h>
+#include <folly/io/IOBuf.h>
+
+namespace watchman {
+
+// Columnar view over a BSER "template" (compact) array inside a raw
+// response PDU.
+//
+// The service encodes query results as a template array: the field
+// names once, then the cell values row-major.  Decoding that through
+// run() re-expands it into one folly::dynamic map per row, which for
+// large results costs more CPU on the client than the service spent
+// producing them.  This class walks the template in a single pass and
+// stores each field as one typed vector instead: integers land in a
+// contiguous int64_t column, strings become StringPieces aliasing the
+// receive buffer (no copies), and nothing map-shaped is built per row.
+//
+// Obtain the PDU with WatchmanConnection::runRaw() and hand it over:
+//
+//   auto table = BserColumnTable::fromPdu(std::move(pdu), "files");
+//   auto* names = table.findColumn("name");
+//   auto* sizes = table.findColumn("size");
+//   for (size_t i = 0; i < table.numRows(); ++i) {
+//     use(names->strings()[i], sizes->ints()[i]);
+//   }
+//
+// The table owns the PDU; string columns are invalidated when the
+// table is destroyed.  Malformed or unsupported input (including
+// columns that mix cell types, which the service never emits) raises
+// WatchmanError; callers wanting maximum generality should fall back
+// to the decoded run() path.
+class BserColumnTable {
+ public:
+  enum class CellType : uint8_t { Int, Real, String, Bool };
+
+  class Column {
+   public:
+    const std::string& name() const {
+      return name_;
+    }
+
+    // The cell type observed for this column.  Columns whose every
+    // cell was missing report Int with an all-zero presence vector.
+    CellType type() const {
+      return type_;
+    }
+
+    size_t size() const {
+      return present_.size();
+    }
+
+    // One entry per row: 1 if the row carried a value, 0 if the cell
+    // was skipped or null.  Absent cells read as 0 / empty in the
+    // typed vectors below.
+    const std::vector<uint8_t>& present() const {
+      return present_;
+    }
+
+    // Valid when type() is Int or Bool; bools decode as 0/1.
+    const std::vector<int64_t>& ints() const {
+      return ints_;
+    }
+
+    // Valid when type() is Real.
+    const std::vector<double>& reals() const {
+      return reals_;
+    }
+
+    // Valid when type() is String.  The pieces alias the PDU owned by
+    // the table; they are not copies.
+    const std::vector<folly::StringPiece>& strings() const {
+      return strings_;
+    }
+
+   private:
+    friend class BserColumnTable;
+
+    std::string name_;
+    CellType type_{CellType::Int};
+    bool sawValue_{false};
+    std::vector<uint8_t> present_;
+    std::vector<int64_t> ints_;
+    std::vector<double> reals_;
+    std::vector<folly::StringPiece> strings_;
+  };
+
+  // Decodes the template array stored under `arrayKey` in the
+  // top-level response object.  Takes ownership of the PDU (it backs
+  // the string columns) and coalesces it if the chain is fragmented.
+  // Throws WatchmanError if the PDU is malformed, the key is absent,
+  // or its value is not a template array (the service only emits
+  // templates for field lists of two or more fields).
+  static BserColumnTable fromPdu(
+      std::unique_ptr<folly::IOBuf> pdu,
+      folly::StringPiece arrayKey = "files");
+
+  size_t numRows() const {
+    return numRows_;
+  }
+
+  const std::vector<Column>& columns() const {
+    return columns_;
+  }
+
+  // Returns the named column, or nullptr if the field list did not
+  // include it.  Linear scan; field lists are short.
+  const Column* findColumn(folly::StringPiece name) const;
+
+ private:
+  BserColumnTable() = default;
+
+  std::unique_ptr<folly::IOBuf> pdu_;
+  std::vector<Column> columns_;
+  size_t numRows_{0};
+};
+
+// Returns true if the top-level object of the raw PDU contains `key`.
+// Walks the encoding without allocating, so it is cheap enough to use
+// as a routing probe before deciding whether a full decode is needed.
+// Throws WatchmanError if the PDU is malformed or its root is not an
+// object.
+bool bserPduHasTopLevelKey(folly::ByteRange pdu, folly::StringPiece key);
+
+} // namespace watchman
@@ -14,6 +14,55 @@ namespace watchman {
 
 using namespace folly;
 
+namespace {
+
+/**
+ * Expands a path-dictionary subscription payload in place: merges the
+ * [id, path] bindings carried by `data` into `dict` and rewrites
+ * interned integer names in "files" back into path strings, so the
+ * subscription callback observes the same shape as an ordinary
+ * subscription.  Payloads from subscriptions that did not negotiate
+ * path_dictionary pass through untouched.
+ */
+void expandPathDictionary(
+    std::unordered_map<int64_t, std::string>& dict,
+    dynamic& data) {
+  if (auto* fresh = data.get_ptr("is_fresh_instance");
+      fresh && fresh->isBool() && fresh->asBool()) {
+    // The daemon restarts the id space on a fresh instance
+    dict.clear();
+  }
+  if (auto* bindings = data.get_ptr("path-dictionary")) {
+    for (auto& binding : *bindings) {
+      dict[binding[0].asInt()] = binding[1].asString();
+    }
+    data.erase("path-dictionary");
+  }
+  auto* files = data.get_ptr("files");
+  if (!files || !files->isArray()) {
+    return;
+  }
+  for (auto& file : *files) {
+    if (file.isInt()) {
+      // Bare value from a name-only field list
+      auto it = dict.find(file.asInt());
+      if (it != dict.end()) {
+        file = it->second;
+      }
+    } else if (file.isObject()) {
+      auto* name = file.get_ptr("name");
+      if (name && name->isInt()) {
+        auto it = dict.find(name->asInt());
+        if (it != dict.end()) {
+          *name = it->second;
+        }
+      }
+    }
+  }
+}
+
+} // namespace
+
 WatchmanClient::~WatchmanClient() {
   // We need to explicitly close the connection so in the case that it outlives
   // us it doesn't accidentally call our callback.
@@ -70,6 +119,9 @@ void WatchmanClient::connectionCallback(Try<dynamic>&& try_data) {
       LOG(ERROR) << "Unexpected subscription update: "
                  << subscription_data->asString();
     } else {
+      // Expansion happens here on the connection thread so that
+      // binding merges are serialized with the payloads that use them.
+      expandPathDictionary(subscription->pathDict_, data);
       auto exec = subscription->executor_;
       exec->add([sub_ptr = std::move(subscription),
                  data = std::move(data)]() mutable {
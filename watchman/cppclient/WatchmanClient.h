@@ -121,6 +121,10 @@ struct Subscription {
   const std::string name_;
   WatchPathPtr watchPath_;
   bool active_{true};
+  // Accumulated id -> path bindings for subscriptions established with
+  // the path_dictionary option.  Only touched from the connection
+  // callback, which delivers updates serially.
+  std::unordered_map<int64_t, std::string> pathDict_;
 };
 
 using SubscriptionPtr = std::shared_ptr<Subscription>;
@@ -7,6 +7,8 @@
 
 #include "WatchmanConnection.h"
 
+#include "BserColumnTable.h"
+
 #include <cstdlib>
 
 #include <fmt/core.h>
@@ -216,33 +218,65 @@ Future<dynamic> WatchmanConnection::run(const dynamic& command) noexcept {
     return cmd->promise.getFuture();
   }
 
-  bool shouldWrite;
   {
     std::lock_guard<std::mutex> g(mutex_);
-    // We only need to call sendCommand if we don't have a command in
-    // progress; the completion handler will trigger it once we receive
-    // the response
-    shouldWrite = commandQ_.empty();
     commandQ_.push_back(cmd);
+    sendQ_.push_back(cmd);
   }
 
-  if (shouldWrite) {
-    eventBase_->runInEventBaseThread(
-        [shared_this = shared_from_this()] { shared_this->sendCommand(); });
-  }
+  // Write the command as soon as the event base gets to it; we don't
+  // wait for responses to earlier commands, so callers can pipeline.
+  eventBase_->runInEventBaseThread(
+      [shared_this = shared_from_this()] { shared_this->sendCommands(); });
 
   return cmd->promise.getFuture();
 }
 
+Future<std::unique_ptr<folly::IOBuf>> WatchmanConnection::runRaw(
+    const dynamic& command) noexcept {
+  auto cmd = std::make_shared<QueuedCommand>(command);
+  cmd->raw = true;
+  if (broken_) {
+    cmd->rawPromise.setException(WatchmanError("The connection was broken"));
+    return cmd->rawPromise.getFuture();
+  }
+  if (!sock_) {
+    cmd->rawPromise.setException(WatchmanError(
+        "No socket (did you call connect() and check result for exceptions?)"));
+    return cmd->rawPromise.getFuture();
+  }
+
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    commandQ_.push_back(cmd);
+    sendQ_.push_back(cmd);
+  }
+
+  eventBase_->runInEventBaseThread(
+      [shared_this = shared_from_this()] { shared_this->sendCommands(); });
+
+  return cmd->rawPromise.getFuture();
+}
+
+size_t WatchmanConnection::pendingCommandCount() {
+  std::lock_guard<std::mutex> g(mutex_);
+  return commandQ_.size();
+}
+
 // Generate a failure for all queued commands
 void WatchmanConnection::failQueuedCommands(folly::exception_wrapper&& ex) {
   std::lock_guard<std::mutex> g(mutex_);
   auto q = commandQ_;
   commandQ_.clear();
+  sendQ_.clear();
 
   broken_ = true;
   for (auto& cmd : q) {
-    if (!cmd->promise.isFulfilled()) {
+    if (cmd->raw) {
+      if (!cmd->rawPromise.isFulfilled()) {
+        cmd->rawPromise.setException(ex);
+      }
+    } else if (!cmd->promise.isFulfilled()) {
       cmd->promise.setException(ex);
     }
   }
@@ -259,29 +293,22 @@ void WatchmanConnection::failQueuedCommands(folly::exception_wrapper&& ex) {
   }
 }
 
-// Sends the next eligible command to the Watchman service
-void WatchmanConnection::sendCommand(bool pop) {
-  std::shared_ptr<QueuedCommand> cmd;
-
-  {
-    std::lock_guard<std::mutex> g(mutex_);
-
-    if (pop) {
-      // We finished processing this one, discard it and focus
-      // on the next item, if any.
-      commandQ_.pop_front();
-    }
-    if (commandQ_.empty()) {
-      return;
+// Writes every not-yet-sent command to the Watchman service.  Runs in
+// the event base thread, which keeps the write order identical to the
+// order the commands were queued.
+void WatchmanConnection::sendCommands() {
+  while (true) {
+    std::shared_ptr<QueuedCommand> cmd;
+    {
+      std::lock_guard<std::mutex> g(mutex_);
+      if (sendQ_.empty()) {
+        return;
+      }
+      cmd = std::move(sendQ_.front());
+      sendQ_.pop_front();
     }
-    cmd = commandQ_.front();
+    sock_->writeChain(this, toBserIOBuf(cmd->cmd, serialization_opts()));
   }
-
-  sock_->writeChain(this, toBserIOBuf(cmd->cmd, serialization_opts()));
-}
-
-void WatchmanConnection::popAndSendCommand() {
-  sendCommand(/* pop = */ true);
 }
 
 // Called when AsyncSocket::writeChain completes
@@ -364,6 +391,36 @@ void WatchmanConnection::decodeNextResponse() {
     }
 
     try {
+      // If the oldest outstanding command asked for the raw PDU, probe
+      // rather than parse: a unilateral PDU or an error response must
+      // still take the decoded path below, but in the common case we
+      // hand the buffer straight to the caller without building a
+      // dynamic per row.  The probe walks the encoding without
+      // allocating.
+      bool rawWanted = false;
+      {
+        std::lock_guard<std::mutex> g(mutex_);
+        rawWanted = !commandQ_.empty() && commandQ_.front()->raw;
+      }
+      if (rawWanted) {
+        auto range = pdu->coalesce();
+        bool needsDecode = bserPduHasTopLevelKey(range, "error");
+        for (const auto& k : kUnilateralLabels) {
+          needsDecode =
+              needsDecode || bserPduHasTopLevelKey(range, k.getString());
+        }
+        if (!needsDecode) {
+          std::shared_ptr<QueuedCommand> cmd;
+          {
+            std::lock_guard<std::mutex> g(mutex_);
+            cmd = std::move(commandQ_.front());
+            commandQ_.pop_front();
+          }
+          cmd->rawPromise.setValue(std::move(pdu));
+          continue;
+        }
+      }
+
       auto decoded = parseBser(pdu.get());
 
       bool is_unilateral = false;
@@ -386,8 +443,9 @@ void WatchmanConnection::decodeNextResponse() {
         continue;
       }
 
-      // It's actually a command response; get the cmd so that we
-      // can fulfil its promise
+      // It's actually a command response; responses arrive in the
+      // order the commands were issued, so it belongs to the oldest
+      // outstanding command.
       std::shared_ptr<QueuedCommand> cmd;
       {
         std::lock_guard<std::mutex> g(mutex_);
@@ -396,18 +454,26 @@ void WatchmanConnection::decodeNextResponse() {
               std::runtime_error("No commands have been queued"));
           return;
         }
-        cmd = commandQ_.front();
+        cmd = std::move(commandQ_.front());
+        commandQ_.pop_front();
       }
 
       // Dispatch outside of the lock in case it tries to send another
       // command
-      cmd->promise.setTry(watchmanResponseToTry(std::move(decoded)));
-
-      // Now we're in a position to send the next queued command.
-      // We remove it after dispatching the try above in case that
-      // queued up more commands; we want to be the one thing that
-      // is responsible for sending the next queued command here
-      popAndSendCommand();
+      if (cmd->raw) {
+        // We only reach the decoded path for a raw command when the
+        // probe saw an "error" key, so surface it as the usual
+        // response error.
+        auto result = watchmanResponseToTry(std::move(decoded));
+        if (result.hasException()) {
+          cmd->rawPromise.setException(result.exception());
+        } else {
+          cmd->rawPromise.setException(make_exception_wrapper<WatchmanError>(
+              "unexpected decoded response for a raw command"));
+        }
+      } else {
+        cmd->promise.setTry(watchmanResponseToTry(std::move(decoded)));
+      }
     } catch (...) {
       failQueuedCommands(folly::exception_wrapper{std::current_exception()});
       return;
@@ -69,9 +69,32 @@ class WatchmanConnection
           folly::dynamic::array("relative_root")));
 
   // Issue a watchman command, yielding the results at a later time.
-  // If the connection was terminated, will throw immediately
+  // If the connection was terminated, will throw immediately.
+  // Commands are pipelined: each is written to the socket as soon as
+  // possible rather than waiting for the responses to earlier commands.
+  // The service answers commands in the order received, so responses
+  // are correlated with the oldest outstanding command; unilateral
+  // PDUs (subscription and log notifications) carry their own labels
+  // and are routed to the callback instead.
   folly::Future<folly::dynamic> run(const folly::dynamic& command) noexcept;
 
+  // Issue a watchman command, yielding the raw BSER response PDU
+  // instead of a decoded folly::dynamic.  Intended for feeding
+  // BserColumnTable, which exposes template-array results as typed
+  // columns without materializing a map per row; decoding a large
+  // query result through run() can cost more CPU than the service
+  // spent producing it.  Protocol-level errors still surface as
+  // WatchmanResponseError, and unilateral PDUs that arrive while a
+  // raw command is outstanding are detected with a lightweight key
+  // probe and routed to the callback as usual.
+  folly::Future<std::unique_ptr<folly::IOBuf>> runRaw(
+      const folly::dynamic& command) noexcept;
+
+  // Number of commands that have been issued but not yet answered.
+  // Used by pooling layers to route new work to the least loaded
+  // connection.
+  size_t pendingCommandCount();
+
   // Close the connection.  All queued commands will be cancelled
   void close();
 
@@ -90,14 +113,17 @@ class WatchmanConnection
   struct QueuedCommand {
     folly::dynamic cmd;
     folly::Promise<folly::dynamic> promise;
+    // When set, the response is delivered undecoded via rawPromise
+    // and `promise` is unused.
+    bool raw{false};
+    folly::Promise<std::unique_ptr<folly::IOBuf>> rawPromise;
 
     explicit QueuedCommand(const folly::dynamic& command);
   };
 
   folly::Future<std::string> getSockPath();
   void failQueuedCommands(folly::exception_wrapper&& ex);
-  void sendCommand(bool pop = false);
-  void popAndSendCommand();
+  void sendCommands();
   void decodeNextResponse();
   folly::Try<folly::dynamic> watchmanResponseToTry(folly::dynamic&& value);
   std::unique_ptr<folly::IOBuf> splitNextPdu();
@@ -126,7 +152,12 @@ class WatchmanConnection
   folly::dynamic versionCmd_;
   std::shared_ptr<folly::AsyncSocket> sock_;
   std::mutex mutex_;
+  // Commands awaiting their response, oldest first.  Responses arrive
+  // in issue order so the front is always the one being answered.
   std::deque<std::shared_ptr<QueuedCommand>> commandQ_;
+  // Commands not yet written to the socket; drained in order by
+  // sendCommands() on the event base thread.
+  std::deque<std::shared_ptr<QueuedCommand>> sendQ_;
   folly::IOBufQueue bufQ_{folly::IOBufQueue::cacheChainLength()};
   bool broken_{false};
   bool closing_{false};
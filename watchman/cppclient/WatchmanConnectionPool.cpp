@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "WatchmanConnectionPool.h"
+
+#include <algorithm>
+
+namespace watchman {
+
+using namespace folly;
+
+WatchmanConnectionPool::WatchmanConnectionPool(
+    EventBase* eventBase,
+    size_t maxConnectionsPerSocket,
+    Executor* cpuExecutor)
+    : eventBase_(eventBase),
+      maxConnectionsPerSocket_(std::max<size_t>(1, maxConnectionsPerSocket)),
+      cpuExecutor_(cpuExecutor) {
+  CHECK_NOTNULL(eventBase);
+}
+
+WatchmanConnectionPool::~WatchmanConnectionPool() {
+  closeAll();
+}
+
+std::shared_ptr<WatchmanConnectionPool::Entry>
+WatchmanConnectionPool::leaseConnection(
+    const std::optional<std::string>& sockPath) {
+  std::lock_guard<std::mutex> g(mutex_);
+  auto& pool = entries_[sockPath.value_or(std::string{})];
+
+  // Drop connections that have broken or been closed; their queued
+  // commands were already failed by the connection itself.
+  pool.erase(
+      std::remove_if(
+          pool.begin(),
+          pool.end(),
+          [](const std::shared_ptr<Entry>& entry) {
+            return entry->conn->isDead();
+          }),
+      pool.end());
+
+  // Prefer the connection with the fewest outstanding commands; only
+  // dial a new one when everything in the pool is busy and we are
+  // under the per-socket limit.
+  std::shared_ptr<Entry> best;
+  size_t bestPending = 0;
+  for (auto& entry : pool) {
+    auto pending = entry->conn->pendingCommandCount();
+    if (!best || pending < bestPending) {
+      best = entry;
+      bestPending = pending;
+    }
+  }
+  if (best && (bestPending == 0 || pool.size() >= maxConnectionsPerSocket_)) {
+    return best;
+  }
+
+  auto entry = std::make_shared<Entry>();
+  entry->conn = std::make_shared<WatchmanConnection>(
+      eventBase_,
+      sockPath ? std::optional<std::string>{*sockPath} : std::nullopt,
+      std::nullopt,
+      cpuExecutor_);
+  entry->ready = std::make_shared<SharedPromise<Unit>>();
+  pool.push_back(entry);
+
+  entry->conn->connect()
+      .thenValue([ready = entry->ready](dynamic&&) {
+        ready->setValue(Unit{});
+      })
+      .thenError([ready = entry->ready](exception_wrapper&& ex) {
+        ready->setException(std::move(ex));
+      });
+  return entry;
+}
+
+Future<dynamic> WatchmanConnectionPool::run(
+    const std::optional<std::string>& sockPath,
+    const dynamic& command) {
+  auto entry = leaseConnection(sockPath);
+  return entry->ready->getFuture().thenValue(
+      [conn = entry->conn, command](Unit) { return conn->run(command); });
+}
+
+void WatchmanConnectionPool::closeAll() {
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Entry>>> entries;
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    std::swap(entries, entries_);
+  }
+  for (auto& [_, pool] : entries) {
+    for (auto& entry : pool) {
+      entry->conn->close();
+    }
+  }
+}
+
+} // namespace watchman
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/futures/SharedPromise.h>
+
+#include "WatchmanConnection.h"
+
+namespace watchman {
+
+// A pool of persistent WatchmanConnections keyed by socket path, for
+// clients that issue commands at a rate where per-request connection
+// setup (socket connect plus version handshake) dominates.
+//
+// run() routes each command to the pooled connection with the fewest
+// outstanding commands, dialing new connections on demand up to
+// maxConnectionsPerSocket.  Connections pipeline their commands, so a
+// small pool is normally enough to saturate the service; additional
+// connections mainly help when individual responses are large enough
+// to serialize decode work.
+//
+// Subscriptions should not be established through a pool: unilateral
+// PDUs are delivered on whichever connection carried the subscribe
+// command, so subscribing clients should own a dedicated
+// WatchmanConnection (or WatchmanClient) instead.
+class WatchmanConnectionPool
+    : public std::enable_shared_from_this<WatchmanConnectionPool> {
+ public:
+  explicit WatchmanConnectionPool(
+      folly::EventBase* eventBase,
+      size_t maxConnectionsPerSocket = 2,
+      folly::Executor* cpuExecutor = nullptr);
+  ~WatchmanConnectionPool();
+
+  // Issue a command against the service reachable via sockPath,
+  // reusing a pooled connection when one exists.  An empty sockPath
+  // selects the default service (WATCHMAN_SOCK or CLI discovery);
+  // all such requests share one pool key.
+  folly::Future<folly::dynamic> run(
+      const std::optional<std::string>& sockPath,
+      const folly::dynamic& command);
+
+  // Close every pooled connection.  In-flight commands are failed.
+  void closeAll();
+
+ private:
+  struct Entry {
+    std::shared_ptr<WatchmanConnection> conn;
+    // Fulfilled once the connection handshake completed (or failed);
+    // commands leased before then chain behind it.
+    std::shared_ptr<folly::SharedPromise<folly::Unit>> ready;
+  };
+
+  std::shared_ptr<Entry> leaseConnection(
+      const std::optional<std::string>& sockPath);
+
+  folly::EventBase* eventBase_;
+  const size_t maxConnectionsPerSocket_;
+  folly::Executor* cpuExecutor_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Entry>>>
+      entries_;
+};
+
+} // namespace watchman
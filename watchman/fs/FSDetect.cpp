@@ -8,9 +8,16 @@
 #include "watchman/fs/FSDetect.h"
 #include <folly/FileUtil.h>
 #include <folly/String.h>
+#include <mutex>
+#include <unordered_map>
 #include "watchman/fs/FileDescriptor.h"
 #include "watchman/watchman_system.h"
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
 #ifdef HAVE_SYS_VFS_H
 #include <sys/vfs.h>
 #endif
@@ -122,18 +129,78 @@ w_string w_fstype_detect_macos_nfs(w_string fstype, w_string edenfs_indicator) {
 // need to have a fully comprehensive mapping of the underlying filesystem
 // type codes to names, just the known problematic types
 
-w_string w_fstype(const char* path) {
 #ifdef __linux__
-  // If possible, we prefer to read the filesystem type names from
-  // `/proc/self/mounts`
+namespace {
+
+// Memoized view of the mount table.  watch-project resolves the fstype
+// of every path it is given, and busy automation invokes it thousands
+// of times a day against an unchanged mount table; re-reading and
+// re-parsing /proc/self/mounts per call is pure overhead.  The kernel
+// flags an open procfs mounts handle with POLLERR|POLLPRI whenever the
+// mount table changes, so a zero-timeout poll() on a retained fd tells
+// us whether the cached parse is still trustworthy.
+struct MountTableCache {
+  std::mutex mutex;
+  watchman::FileDescriptor fd;
   std::string mounts;
-  if (folly::readFile("/proc/self/mounts", mounts)) {
-    auto fstype = find_fstype_in_linux_proc_mounts(path, mounts);
-    if (fstype) {
-      return *fstype;
+  std::unordered_map<w_string, w_string> fstypeByPath;
+};
+
+std::optional<w_string> cached_fstype_from_proc_mounts(const char* path) {
+  static MountTableCache cache;
+  std::lock_guard<std::mutex> lock(cache.mutex);
+
+  bool reload = false;
+  if (!cache.fd) {
+    reload = true;
+  } else {
+    struct pollfd pfd {};
+    pfd.fd = cache.fd.fd();
+    pfd.events = POLLPRI;
+    if (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLERR | POLLPRI))) {
+      reload = true;
+    }
+  }
+
+  if (reload) {
+    // Re-opening (rather than rewinding) the handle resets the
+    // change indication unambiguously.
+    cache.fd = watchman::FileDescriptor(
+        ::open("/proc/self/mounts", O_RDONLY | O_CLOEXEC),
+        watchman::FileDescriptor::FDType::Generic);
+    cache.mounts.clear();
+    cache.fstypeByPath.clear();
+    if (!cache.fd || !folly::readFile("/proc/self/mounts", cache.mounts)) {
+      return std::nullopt;
     }
   }
 
+  w_string key{path};
+  auto it = cache.fstypeByPath.find(key);
+  if (it != cache.fstypeByPath.end()) {
+    return it->second;
+  }
+  auto fstype = find_fstype_in_linux_proc_mounts(path, cache.mounts);
+  if (fstype) {
+    // Only positive results are memoized: a miss falls through to the
+    // statfs probe below, whose answer has no invalidation signal.
+    cache.fstypeByPath.emplace(std::move(key), *fstype);
+  }
+  return fstype;
+}
+
+} // namespace
+#endif
+
+w_string w_fstype(const char* path) {
+#ifdef __linux__
+  // If possible, we prefer to read the filesystem type names from
+  // `/proc/self/mounts`; the cache keeps the parsed table until the
+  // kernel reports a mount-table change on the retained handle.
+  if (auto fstype = cached_fstype_from_proc_mounts(path)) {
+    return *fstype;
+  }
+
   // Reading the mount table can fail for the simple reason that `/proc` isn't
   // mounted, so fall back to some slightly manual code that looks at known
   // filesystem type ids.
@@ -51,7 +51,7 @@ static_assert(S_IFMT == 0xF000, "The S_IFMT on Windows should be 0xF000");
  * Not all systems have a dtype concept so we have some conditional
  * code here to compensate.
  */
-enum class DType {
+enum class DType : uint8_t {
   Unknown = DT_UNKNOWN,
   Fifo = DT_FIFO,
   Char = DT_CHR,
@@ -6,6 +6,7 @@
  */
 
 #pragma once
+#include <vector>
 #include "watchman/Result.h"
 #include "watchman/fs/DirHandle.h"
 #include "watchman/fs/FileDescriptor.h"
@@ -46,6 +47,19 @@ class FileSystem {
       const char* path,
       CaseSensitivity caseSensitive = CaseSensitivity::Unknown) = 0;
 
+  /**
+   * Stat a batch of paths, returning results in the same order.  Each
+   * element holds either the FileInformation or the error raised for
+   * that path.
+   *
+   * The default implementation loops over getFileInformation(); the
+   * real filesystem submits the whole batch through io_uring on kernels
+   * that support it, collapsing per-path syscall overhead.
+   */
+  virtual std::vector<Result<FileInformation>> getFileInformationBatch(
+      const std::vector<const char*>& paths,
+      CaseSensitivity caseSensitive = CaseSensitivity::Unknown);
+
   /**
    * Watchman-specific API for creating an empty file on the filesystem.
    * On unix, the created file will have mode 0700.
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <optional>
+#include <vector>
+#include "watchman/Result.h"
+#include "watchman/fs/FileInformation.h"
+
+namespace watchman {
+
+/**
+ * Returns true if the running kernel supports batching statx calls
+ * through io_uring (Linux 5.6 and later).  The probe is performed once
+ * and cached; on other platforms this is always false.
+ */
+bool ioUringStatAvailable();
+
+/**
+ * lstat() every path in `paths` through a single io_uring submission
+ * ring, returning results in the same order.  Each element holds either
+ * the FileInformation or the error the kernel reported for that path.
+ *
+ * Returns std::nullopt if io_uring is unavailable or ring setup fails
+ * at runtime; the caller should fall back to per-path
+ * getFileInformation().  Note that this performs no canonical case
+ * checking, so it is only a faithful substitute on case sensitive
+ * filesystems.
+ */
+std::optional<std::vector<Result<FileInformation>>> ioUringStatBatch(
+    const std::vector<const char*>& paths);
+
+} // namespace watchman
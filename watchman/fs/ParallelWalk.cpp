@@ -25,10 +25,22 @@ struct ParallelWalkerContext {
   std::atomic<size_t> readDirTaskCount{0};
   std::atomic<bool> stopped{false};
 
-  // Output.
-  Queue<ReadDirResult> resultQueue{};
+  // Output. Results travel in batches to amortize queue handoff;
+  // errors are rare and go one at a time.
+  Queue<std::vector<ReadDirResult>> resultQueue{};
   Queue<IoErrorWithPath> errorQueue{};
 
+  // Batch currently being drained by nextResult(). Only touched by the
+  // result-consuming thread.
+  std::vector<ReadDirResult> currentBatch;
+  size_t currentBatchIndex{0};
+
+  // Throughput counters, surfaced via ParallelWalker::stats().
+  std::atomic<uint64_t> dirsRead{0};
+  std::atomic<uint64_t> entriesRead{0};
+  std::atomic<uint64_t> batchesPublished{0};
+  std::atomic<uint64_t> errorCount{0};
+
   ParallelWalkerContext(
       std::shared_ptr<FileSystem> fileSystem,
       folly::Executor* executor)
@@ -71,18 +83,6 @@ folly::Executor* getExecutor(size_t threadCountHint) {
   return e.get();
 }
 
-folly::fbstring pathJoin(
-    const folly::fbstring& dirName,
-    const folly::fbstring& baseName) {
-  if (dirName.empty()) {
-    return baseName;
-  }
-  if (baseName.empty()) {
-    return dirName;
-  }
-  return fmt::format("{}/{}", dirName, baseName);
-}
-
 // Update readDirTaskCount. +1 on construction. -1 on destruction.
 class ReadDirTaskCounter {
  public:
@@ -142,25 +142,70 @@ class ReadDirTaskCounter {
 const size_t kApproximateSizePerEntry = 32;
 
 /**
- * Read and stat dirPath's direct children.
- * Push ReadDirResult to context->resultQueue.
- * Push errors to context->errorQueue.
- * Spawn readDirTask for subdirectories.
+ * Number of ReadDirResults accumulated before a publish. Batching
+ * amortizes the queue handoff to the consumer; the value is small
+ * enough that the consumer is never left waiting long for a partially
+ * filled batch (a task flushes whenever its depth-first chain ends).
  */
+const size_t kResultBatchSize = 16;
+
+struct SubdirToRead {
+  AbsolutePath path;
+  size_t sizeHint;
+};
+
 void readDirTask(
     std::shared_ptr<ParallelWalkerContext> context,
     AbsolutePath dirFullPath,
     ReadDirTaskCounter&& counter,
-    size_t dirSizeHint = 0) {
-  if (context->stopped.load(std::memory_order_acquire)) {
-    return;
+    size_t dirSizeHint = 0);
+
+/**
+ * Publish the accumulated batch, then spawn tasks for the collected
+ * subdirectories. The order matters: a spawned task may publish
+ * immediately, and consumers rely on every parent being visible before
+ * its children.
+ */
+void flushBatch(
+    const std::shared_ptr<ParallelWalkerContext>& context,
+    std::vector<ReadDirResult>& batch,
+    std::vector<SubdirToRead>& toSpawn,
+    const ReadDirTaskCounter& counter) {
+  if (!batch.empty()) {
+    context->batchesPublished.fetch_add(1, std::memory_order_relaxed);
+    context->resultQueue.enqueue(std::move(batch));
+    batch = {};
+  }
+  for (auto& subdir : toSpawn) {
+    auto task = [context = context,
+                 path = std::move(subdir.path),
+                 counter = counter,
+                 sizeHint = subdir.sizeHint]() mutable {
+      readDirTask(
+          std::move(context), std::move(path), std::move(counter), sizeHint);
+    };
+    context->executor->add(std::move(task));
   }
+  toSpawn.clear();
+}
 
+/**
+ * Read and stat dirPath's direct children, appending the ReadDirResult
+ * to `batch` and its subdirectories to `subdirsToRead`.
+ * Push errors to context->errorQueue.
+ */
+void readOneDir(
+    const std::shared_ptr<ParallelWalkerContext>& context,
+    AbsolutePath dirFullPath,
+    size_t dirSizeHint,
+    std::vector<ReadDirResult>& batch,
+    std::vector<SubdirToRead>& subdirsToRead) {
   std::unique_ptr<DirHandle> dir;
   try {
     dir = context->fileSystem->openDir(dirFullPath.c_str());
   } catch (const std::system_error& err) {
     IoErrorWithPath error{std::move(dirFullPath), err, "opendir"};
+    context->errorCount.fetch_add(1, std::memory_order_relaxed);
     context->errorQueue.enqueue(error);
     return;
   }
@@ -183,16 +228,24 @@ void readDirTask(
     }
     // Get stat() information.
     PathComponent name(d_name);
+    // Build the full path here, off the consumer's thread; the consumer
+    // moves it into its own structures without re-concatenating.
+    auto fullPath = w_string::build(
+        w_string_piece{dirFullPath.data(), dirFullPath.size()},
+        "/",
+        w_string_piece{name.data(), name.size()});
     FileInformation st;
     if (dirent->has_stat) {
       st = dirent->stat;
     } else {
-      auto fileFullPath = pathJoin(dirFullPath, name);
       try {
-        st = context->fileSystem->getFileInformation(fileFullPath.c_str());
+        st = context->fileSystem->getFileInformation(fullPath.c_str());
       } catch (const std::system_error& err) {
         IoErrorWithPath error{
-            std::move(fileFullPath), err, "getFileInformation"};
+            AbsolutePath{fullPath.data(), fullPath.size()},
+            err,
+            "getFileInformation"};
+        context->errorCount.fetch_add(1, std::memory_order_relaxed);
         context->errorQueue.enqueue(error);
         // Contine checking other entries.
         continue;
@@ -203,39 +256,65 @@ void readDirTask(
     }
     DirEntryOwned entry{
         std::move(name),
+        std::move(fullPath),
         st,
     };
     entries.push_back(entry);
   }
 
+  context->dirsRead.fetch_add(1, std::memory_order_relaxed);
+  context->entriesRead.fetch_add(entries.size(), std::memory_order_relaxed);
+
   // Figure out subdirs to read before losing ownership of entries.
-  std::vector<std::pair<AbsolutePath, size_t>> subdirsToRead;
-  subdirsToRead.reserve(subdirCount);
+  subdirsToRead.reserve(subdirsToRead.size() + subdirCount);
   for (const auto& entry : entries) {
     if (entry.stat.isDir()) {
-      AbsolutePath subdirPath = pathJoin(dirFullPath, entry.name);
+      AbsolutePath subdirPath{entry.fullPath.data(), entry.fullPath.size()};
       size_t sizeHint = entry.stat.size / kApproximateSizePerEntry;
-      subdirsToRead.push_back(std::make_pair(subdirPath, sizeHint));
+      subdirsToRead.push_back(SubdirToRead{std::move(subdirPath), sizeHint});
     }
   }
 
-  // Enqueue ReadDirResult before reading subdirs.
-  ReadDirResult result{std::move(dirFullPath), std::move(entries), subdirCount};
-  context->resultQueue.enqueue(result);
+  batch.push_back(
+      ReadDirResult{std::move(dirFullPath), std::move(entries), subdirCount});
+}
 
-  // Spawn tasks to read subdirs.
-  for (auto& pair : subdirsToRead) {
-    auto& path = pair.first;
-    auto sizeHint = pair.second;
-    auto task = [context = context,
-                 path = std::move(path),
-                 counter = counter,
-                 sizeHint = sizeHint]() mutable {
-      readDirTask(
-          std::move(context), std::move(path), std::move(counter), sizeHint);
-    };
-    context->executor->add(std::move(task));
+/**
+ * Read dirPath recursively, chaining depth-first into one subdirectory
+ * at a time within this task and spawning tasks for the rest, so a
+ * chain of small directories costs one executor handoff instead of one
+ * per directory. Results are published in batches; a parent is always
+ * published before any task for its subdirectories is spawned.
+ */
+void readDirTask(
+    std::shared_ptr<ParallelWalkerContext> context,
+    AbsolutePath dirFullPath,
+    ReadDirTaskCounter&& counter,
+    size_t dirSizeHint) {
+  std::vector<ReadDirResult> batch;
+  std::vector<SubdirToRead> pendingSubdirs;
+
+  std::optional<SubdirToRead> current{
+      SubdirToRead{std::move(dirFullPath), dirSizeHint}};
+  while (current) {
+    if (context->stopped.load(std::memory_order_acquire)) {
+      return;
+    }
+    readOneDir(
+        context, std::move(current->path), current->sizeHint, batch,
+        pendingSubdirs);
+    current.reset();
+    if (batch.size() >= kResultBatchSize) {
+      // Publishes the batch and farms out all pending subdirectories;
+      // the depth-first chain continues only while results stay local.
+      flushBatch(context, batch, pendingSubdirs, counter);
+    }
+    if (!pendingSubdirs.empty()) {
+      current = std::move(pendingSubdirs.back());
+      pendingSubdirs.pop_back();
+    }
   }
+  flushBatch(context, batch, pendingSubdirs, counter);
 }
 
 } // namespace
@@ -260,11 +339,32 @@ ParallelWalker::~ParallelWalker() {
 }
 
 std::optional<ReadDirResult> ParallelWalker::nextResult() {
-  return context_->taskAwareDequeue(context_->resultQueue);
+  auto& context = *context_;
+  while (true) {
+    if (context.currentBatchIndex < context.currentBatch.size()) {
+      return std::move(context.currentBatch[context.currentBatchIndex++]);
+    }
+    auto batch = context.taskAwareDequeue(context.resultQueue);
+    if (!batch) {
+      return std::nullopt;
+    }
+    context.currentBatch = std::move(*batch);
+    context.currentBatchIndex = 0;
+  }
 }
 
 std::optional<IoErrorWithPath> ParallelWalker::nextError() {
   return context_->taskAwareDequeue(context_->errorQueue);
 }
 
+ParallelWalker::Stats ParallelWalker::stats() const {
+  Stats stats;
+  stats.dirsRead = context_->dirsRead.load(std::memory_order_relaxed);
+  stats.entriesRead = context_->entriesRead.load(std::memory_order_relaxed);
+  stats.batchesPublished =
+      context_->batchesPublished.load(std::memory_order_relaxed);
+  stats.errors = context_->errorCount.load(std::memory_order_relaxed);
+  return stats;
+}
+
 } // namespace watchman
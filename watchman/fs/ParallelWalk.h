@@ -11,6 +11,7 @@
 #include <vector>
 #include "watchman/fs/FileInformation.h"
 #include "watchman/fs/FileSystem.h"
+#include "watchman/watchman_string.h"
 
 /** Parallel filesystem walker. Collect path names and stats recursively. */
 
@@ -23,6 +24,11 @@ using AbsolutePath = folly::fbstring;
 /** Similar to `DirEntry` but always contains stat and owns the strings. */
 struct DirEntryOwned {
   PathComponent name;
+  // Full path to the entry, pre-built by the walker workers so a
+  // consumer inserting entries under a lock can move the refcounted
+  // string straight into its own structures instead of concatenating
+  // dir and name per entry there.
+  w_string fullPath;
   FileInformation stat;
 };
 
@@ -75,9 +81,27 @@ class ParallelWalker final {
    *
    * Parent directory is guarnateed to be provided before child directories.
    * After completion, always return nullopt without blocking.
+   *
+   * Results are delivered to the walker in batches; nextResult() must
+   * be called from a single thread.
    */
   std::optional<ReadDirResult> nextResult();
 
+  /** Cumulative walk throughput counters. */
+  struct Stats {
+    // Directories successfully read.
+    uint64_t dirsRead = 0;
+    // Directory entries seen across all directories.
+    uint64_t entriesRead = 0;
+    // Result batches published to the consumer queue.
+    uint64_t batchesPublished = 0;
+    // Errors delivered to the error queue.
+    uint64_t errors = 0;
+  };
+
+  /** Snapshot of walk progress. Callable at any time. */
+  Stats stats() const;
+
   /**
    * Obtain an occured error. Might block.
    *
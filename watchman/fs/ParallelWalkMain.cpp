@@ -49,10 +49,12 @@ void walk(watchman::AbsolutePath path, size_t threadCountHint) {
               << std::endl;
   }
 
-  std::cout << "  Dir#:  " << directory_count << std::endl;
-  std::cout << "  Path#: " << path_count << std::endl;
-  std::cout << "  Size:  " << size << std::endl;
-  std::cout << "  Time:  " << seconds << " seconds" << std::endl;
+  auto stats = walker.stats();
+  std::cout << "  Dir#:   " << directory_count << std::endl;
+  std::cout << "  Path#:  " << path_count << std::endl;
+  std::cout << "  Size:   " << size << std::endl;
+  std::cout << "  Batch#: " << stats.batchesPublished << std::endl;
+  std::cout << "  Time:   " << seconds << " seconds" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
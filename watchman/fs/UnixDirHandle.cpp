@@ -25,6 +25,12 @@
 #include <sys/vnode.h> // @manual
 #endif
 
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <atomic>
+#endif
+
 namespace watchman {
 
 #ifdef HAVE_GETATTRLISTBULK
@@ -73,6 +79,13 @@ class UnixDirHandle : public DirHandle {
   DIR* d_{nullptr};
   struct DirEntry ent_;
 
+#ifdef __linux__
+  bool useStatx_{false};
+  // Tracks whether the running kernel supports statx(); flipped off on
+  // the first ENOSYS so we only ever pay for the probe once.
+  static std::atomic<bool> statxWorks_;
+#endif
+
  public:
   explicit UnixDirHandle(const char* path, bool strict);
   ~UnixDirHandle() override;
@@ -81,6 +94,10 @@ class UnixDirHandle : public DirHandle {
 };
 #endif
 
+#ifdef __linux__
+std::atomic<bool> UnixDirHandle::statxWorks_{true};
+#endif
+
 #ifndef _WIN32
 /* Opens a directory making sure it's not a symlink */
 static DIR* opendir_nofollow(const char* path) {
@@ -207,6 +224,9 @@ UnixDirHandle::UnixDirHandle(const char* path, bool strict)
     attrlist_.fileattr = ATTR_FILE_TOTALSIZE | ATTR_FILE_LINKCOUNT;
     return;
   }
+#endif
+#ifdef __linux__
+  useStatx_ = cfg_get_bool("_use_statx", true);
 #endif
   d_ = strict ? opendir_nofollow(path) : opendir(path);
 
@@ -394,6 +414,45 @@ const DirEntry* UnixDirHandle::readDir() {
 
   ent_.d_name = dent->d_name;
   ent_.has_stat = false;
+
+#ifdef __linux__
+  // Prefetch stat data for the entry relative to the directory fd, so
+  // that crawl consumers (which take DirEntry::stat when has_stat is
+  // set) don't need to lstat the full path and pay for the kernel to
+  // re-resolve every path component. Errors, including races with
+  // concurrent deletion, simply leave has_stat unset so the consumer's
+  // own stat path reports them as before.
+  if (useStatx_ && statxWorks_.load(std::memory_order_relaxed) &&
+      strcmp(dent->d_name, ".") != 0 && strcmp(dent->d_name, "..") != 0) {
+    struct statx stx;
+    if (::statx(
+            dirfd(d_),
+            dent->d_name,
+            AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+            STATX_BASIC_STATS,
+            &stx) == 0) {
+      ent_.stat = watchman::FileInformation();
+      ent_.stat.mode = stx.stx_mode;
+      ent_.stat.size = stx.stx_size;
+      ent_.stat.uid = stx.stx_uid;
+      ent_.stat.gid = stx.stx_gid;
+      ent_.stat.ino = stx.stx_ino;
+      ent_.stat.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+      ent_.stat.nlink = stx.stx_nlink;
+      ent_.stat.atime.tv_sec = stx.stx_atime.tv_sec;
+      ent_.stat.atime.tv_nsec = stx.stx_atime.tv_nsec;
+      ent_.stat.mtime.tv_sec = stx.stx_mtime.tv_sec;
+      ent_.stat.mtime.tv_nsec = stx.stx_mtime.tv_nsec;
+      ent_.stat.ctime.tv_sec = stx.stx_ctime.tv_sec;
+      ent_.stat.ctime.tv_nsec = stx.stx_ctime.tv_nsec;
+      ent_.has_stat = true;
+    } else if (errno == ENOSYS) {
+      // Kernel predates statx; don't keep asking.
+      statxWorks_.store(false, std::memory_order_relaxed);
+    }
+  }
+#endif
+
   return &ent_;
 }
 
@@ -35,16 +35,18 @@ W_CMD_REG(
 void add_root_warnings_to_response(
     UntypedResponse& response,
     const std::shared_ptr<Root>& root) {
-  auto info = root->recrawlInfo.rlock();
+  // The warning text is rendered on demand from the structured error
+  // records; crawls only pay for collecting them.
+  auto warning = root->recrawlInfo.rlock()->renderWarning();
 
-  if (!info->warning) {
+  if (!warning) {
     return;
   }
 
   response.set(
       "warning",
       w_string_to_json(w_string::build(
-          info->warning.value(),
+          warning.value(),
           "\n",
           "To clear this warning, run:\n"
           "`watchman watch-del '",
@@ -86,7 +88,10 @@ resolveRootByName(Client* client, const char* rootName, bool create) {
       root = w_root_resolve(rootName, create);
     }
 
-    if (client->perf_sample) {
+    // perf_sample belongs to the client thread's inline dispatch;
+    // pipelined commands run concurrently with it and must leave it
+    // alone.
+    if (client->perf_sample && !Client::executingPipelinedCommand) {
       root->addPerfSampleMetadata(*client->perf_sample);
     }
     return root;
@@ -12,10 +12,12 @@
 #include <folly/String.h>
 #include <folly/Synchronized.h>
 #include <folly/net/NetworkSocket.h>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <optional>
 #include <thread>
+#include <vector>
 #include "watchman/Client.h"
 #include "watchman/Constants.h"
 #include "watchman/GroupLookup.h"
@@ -139,7 +141,12 @@ static FileDescriptor get_listener_unix_domain_socket(const char* path) {
   }
 #endif
 
-  if (::listen(listener_fd.system_handle(), 200) != 0) {
+  // A modest default backlog is not enough when CI fans out and a couple
+  // of thousand clients connect within a second; overflow makes the
+  // clients retry and amplifies the herd.  The kernel clips this to
+  // somaxconn, so a generous default is safe.
+  int backlog = (int)cfg_get_int("listen_backlog", 1024);
+  if (::listen(listener_fd.system_handle(), backlog) != 0) {
     logf(ERR, "listen({}): {}\n", path, folly::errnoStr(errno));
     return FileDescriptor();
   }
@@ -253,13 +260,23 @@ static void named_pipe_accept_loop() {
 #endif
 
 /** A helper for owning and running a socket-style (rather than
- * named pipe style) accept loop that runs in another thread.
+ * named pipe style) accept pool that runs in other threads.
+ *
+ * AF_UNIX listeners cannot be sharded across descriptors with
+ * SO_REUSEPORT the way TCP listeners can, so connection bursts are
+ * absorbed by polling the one listening socket from a small pool of
+ * acceptor threads instead.  Each wakeup drains the backlog until
+ * accept() would block, so a fan-out spike is spread across cores
+ * rather than serialized behind a single accept call per poll round
+ * trip.
  */
 class AcceptLoop {
  public:
-  /** Start an accept loop thread using the provided socket
+  /** Start a pool of accept threads using the provided socket
    * descriptor (`fd`).  The `name` parameter is used to name the
-   * thread */
+   * threads.  The pool size is `accept_concurrency` in the global
+   * config and defaults to a few threads; one is still enough for
+   * correctness, the rest are throughput during connect storms. */
   AcceptLoop(std::string name, FileDescriptor&& fd) {
     fd.setCloExec();
     fd.setNonBlock();
@@ -267,12 +284,21 @@ class AcceptLoop {
     std::shared_ptr<watchman_event> listener_event = w_event_make_sockets();
     w_push_listener_thread_event(listener_event);
 
-    thread_ = std::thread([listener_fd = std::move(fd),
-                           name = std::move(name),
-                           listener_event]() mutable {
-      w_set_thread_name(name);
-      accept_thread(std::move(listener_fd), listener_event);
-    });
+    std::shared_ptr<watchman_stream> listener = w_stm_fdopen(std::move(fd));
+    auto n_acceptors = std::max<json_int_t>(
+        1,
+        cfg_get_int(
+            "accept_concurrency",
+            std::min<json_int_t>(
+                4,
+                std::max<json_int_t>(
+                    1, std::thread::hardware_concurrency()))));
+    for (json_int_t i = 0; i < n_acceptors; ++i) {
+      threads_.push_back(std::thread([listener, name, listener_event, i]() {
+        w_set_thread_name(name, i);
+        accept_thread(listener, listener_event);
+      }));
+    }
   }
 
   AcceptLoop(const AcceptLoop&) = delete;
@@ -283,7 +309,7 @@ class AcceptLoop {
   }
 
   AcceptLoop& operator=(AcceptLoop&& other) {
-    thread_ = std::move(other.thread_);
+    threads_ = std::move(other.threads_);
     joined_ = other.joined_;
     // Ensure that we don't try to join the source,
     // as std::thread::join will std::terminate in that case.
@@ -301,17 +327,21 @@ class AcceptLoop {
     if (joined_) {
       return;
     }
-    thread_.join();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
     joined_ = true;
   }
 
  private:
+  // Accepting on a shared listening socket from several threads is safe;
+  // each pending connection is handed to exactly one accept() caller.
+  // The shutdown event pipe is never drained here, so it wakes every
+  // thread in the pool.
   static void accept_thread(
-      FileDescriptor&& listenerDescriptor,
+      std::shared_ptr<watchman_stream> listener,
       std::shared_ptr<watchman_event> listener_event) {
-    auto listener = w_stm_fdopen(std::move(listenerDescriptor));
     while (!w_is_stopping()) {
-      FileDescriptor client_fd;
       EventPoll pfd[2];
 
       pfd[0].evt = listener->getEvents();
@@ -325,40 +355,42 @@ class AcceptLoop {
         continue;
       }
 
-      if (w_is_stopping()) {
-        break;
-      }
-
+      // The listener is non-blocking, so drain the accept backlog before
+      // polling again; during connection bursts this takes the poll
+      // round trip out of the per-connection cost.
+      while (!w_is_stopping()) {
+        FileDescriptor client_fd;
 #ifdef HAVE_ACCEPT4
-      client_fd = FileDescriptor(
-          accept4(
-              listener->getFileDescriptor().system_handle(),
-              nullptr,
-              0,
-              SOCK_CLOEXEC),
-          FileDescriptor::FDType::Socket);
+        client_fd = FileDescriptor(
+            accept4(
+                listener->getFileDescriptor().system_handle(),
+                nullptr,
+                0,
+                SOCK_CLOEXEC),
+            FileDescriptor::FDType::Socket);
 #else
-      client_fd = FileDescriptor(
-          ::accept(listener->getFileDescriptor().system_handle(), nullptr, 0),
-          FileDescriptor::FDType::Socket);
+        client_fd = FileDescriptor(
+            ::accept(listener->getFileDescriptor().system_handle(), nullptr, 0),
+            FileDescriptor::FDType::Socket);
 #endif
-      if (!client_fd) {
-        continue;
+        if (!client_fd) {
+          break;
+        }
+        client_fd.setCloExec();
+        int bufsize = WATCHMAN_IO_BUF_SIZE;
+        ::setsockopt(
+            client_fd.system_handle(),
+            SOL_SOCKET,
+            SO_SNDBUF,
+            (char*)&bufsize,
+            sizeof(bufsize));
+
+        UserClient::create(w_stm_fdopen(std::move(client_fd)));
       }
-      client_fd.setCloExec();
-      int bufsize = WATCHMAN_IO_BUF_SIZE;
-      ::setsockopt(
-          client_fd.system_handle(),
-          SOL_SOCKET,
-          SO_SNDBUF,
-          (char*)&bufsize,
-          sizeof(bufsize));
-
-      UserClient::create(w_stm_fdopen(std::move(client_fd)));
     }
   }
 
-  std::thread thread_;
+  std::vector<std::thread> threads_;
   bool joined_{false};
 };
 
@@ -19,4 +19,18 @@ std::optional<DType> FileResult::dtype() {
   return statInfo->dtype();
 }
 
+const watchman_dir* FileResult::containingDir() {
+  return nullptr;
+}
+
+std::optional<uint32_t> FileResult::suffixId() {
+  return std::nullopt;
+}
+
+std::optional<json_ref> FileResult::getCachedRender(const RenderCacheProbe&) {
+  return std::nullopt;
+}
+
+void FileResult::cacheRender(const RenderCacheProbe&, const json_ref&) {}
+
 } // namespace watchman
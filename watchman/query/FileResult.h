@@ -11,13 +11,29 @@
 #include <vector>
 #include "watchman/Clock.h"
 #include "watchman/fs/FileInformation.h"
+#include "watchman/thirdparty/jansson/jansson.h"
 #include "watchman/watchman_string.h"
 
+struct watchman_dir;
+
 namespace watchman {
 
 struct NotSymlink {};
 using ResolvedSymlink = std::variant<NotSymlink, w_string>;
 
+// Inputs that determine whether a previously rendered field-list
+// fragment for a file may be reused by a different query run.
+// Everything else in a rendered fragment is a pure function of the
+// file's state and is keyed by the file's observed-change tick.
+struct RenderCacheProbe {
+  // Identity hash of the field renderer list the fragment was
+  // rendered from.
+  size_t fieldListHash;
+  // The value the "new" field must take; it is the only field whose
+  // value depends on the query's since parameter.
+  bool isNew;
+};
+
 // A View-independent way of accessing file properties in the
 // query engine.  A FileResult is not intended to be accessed
 // concurrently from multiple threads and may be unsafe to
@@ -68,6 +84,14 @@ class FileResult {
   using ContentHash = std::array<uint8_t, 20>;
   virtual std::optional<ContentHash> getContentSha1() = 0;
 
+  // Returns the in-memory directory node containing this file, or
+  // nullptr for results that are not backed by the InMemoryView.
+  // Query terms may use it to test directory ancestry by walking the
+  // parent pointers instead of comparing path strings.  The pointer is
+  // only guaranteed stable while no age-out has run; see
+  // lastAgeOutTickValueAtStartOfQuery.
+  virtual const watchman_dir* containingDir();
+
   // Maybe return the dtype.
   // Returns folly::none if the dtype is not currently known.
   // Returns DType::Unknown if we have dtype data but it doesn't
@@ -75,6 +99,13 @@ class FileResult {
   // on linux).
   virtual std::optional<DType> dtype();
 
+  // Returns the id of this file's lower-cased name suffix in the
+  // process-wide suffix dictionary (internSuffixId), 0 if the name
+  // has no suffix, or std::nullopt if this result type does not
+  // capture suffix ids, in which case the caller must derive the
+  // suffix from baseName() instead.
+  virtual std::optional<uint32_t> suffixId();
+
   // A bitset of Property values
   using Properties = uint_least16_t;
 
@@ -127,6 +158,14 @@ class FileResult {
   virtual void batchFetchProperties(
       const std::vector<std::unique_ptr<FileResult>>& files) = 0;
 
+  // Render fragment caching.  Views that can cheaply detect whether a
+  // file changed since a fragment was rendered (in-memory views key on
+  // the observed-change tick) may override these so that QueryContext
+  // can reuse fragments across the query runs of multiple subscriptions
+  // on the same root.  The default implementations cache nothing.
+  virtual std::optional<json_ref> getCachedRender(const RenderCacheProbe&);
+  virtual void cacheRender(const RenderCacheProbe&, const json_ref& rendered);
+
  protected:
   // To be called by one of the FileResult accessors when it needs
   // to record which properties are required to satisfy the request.
@@ -10,8 +10,306 @@
 #include <fmt/core.h>
 #include <folly/Range.h>
 
+#include <cctype>
+
+#include "watchman/thirdparty/wildmatch/wildmatch.h"
+
 namespace watchman {
 
+namespace {
+
+inline char foldByte(char c, bool fold) {
+  return fold ? static_cast<char>(std::tolower(static_cast<unsigned char>(c)))
+              : c;
+}
+
+inline void classSetByte(std::array<uint64_t, 4>& bits, unsigned char c) {
+  bits[c >> 6] |= uint64_t(1) << (c & 63);
+}
+
+inline bool classTestByte(const std::array<uint64_t, 4>& bits, unsigned char c) {
+  return (bits[c >> 6] >> (c & 63)) & 1;
+}
+
+} // namespace
+
+std::optional<GlobComponentMatcher> GlobComponentMatcher::compile(
+    std::string_view pattern,
+    int wildmatchFlags,
+    bool caseInsensitive) {
+  GlobComponentMatcher result;
+  result.caseFold_ = caseInsensitive || (wildmatchFlags & WM_CASEFOLD);
+  const bool noescape = wildmatchFlags & WM_NOESCAPE;
+
+  // wildmatch folds pattern characters as it reads them, but an escaped
+  // character is read after the fold and is therefore compared raw even
+  // under WM_CASEFOLD; `fold` distinguishes the two cases.
+  auto appendLiteral = [&](char c, bool fold) {
+    if (result.tokens_.empty() ||
+        result.tokens_.back().kind != Kind::Literal) {
+      result.tokens_.push_back(Token{Kind::Literal, {}, 0});
+    }
+    result.tokens_.back().literal.push_back(
+        foldByte(c, fold && result.caseFold_));
+  };
+
+  size_t i = 0;
+  while (i < pattern.size()) {
+    char c = pattern[i];
+    switch (c) {
+      case '*':
+        // Collapse runs of stars; within a single component they are
+        // equivalent.
+        if (result.tokens_.empty() ||
+            result.tokens_.back().kind != Kind::Star) {
+          result.tokens_.push_back(Token{Kind::Star, {}, 0});
+        }
+        ++i;
+        break;
+
+      case '?':
+        result.tokens_.push_back(Token{Kind::AnyChar, {}, 0});
+        ++i;
+        break;
+
+      case '\\':
+        if (noescape) {
+          appendLiteral(c, true);
+          ++i;
+          break;
+        }
+        if (i + 1 >= pattern.size()) {
+          // Trailing escape; wildmatch aborts the match, so don't
+          // pretend we can reproduce that here.
+          return std::nullopt;
+        }
+        appendLiteral(pattern[i + 1], false);
+        i += 2;
+        break;
+
+      case '[': {
+        if (result.caseFold_) {
+          // wildmatch's class matching under WM_CASEFOLD is asymmetric
+          // (single members are compared raw against the folded text
+          // byte, ranges get an extra uppercase probe); rather than
+          // reproduce that faithfully, leave folded classes to
+          // wildmatch.
+          return std::nullopt;
+        }
+
+        size_t j = i + 1;
+        bool negate = false;
+        if (j < pattern.size() &&
+            (pattern[j] == '^' || pattern[j] == '!')) {
+          negate = true;
+          ++j;
+        }
+
+        std::array<uint64_t, 4> bits{};
+        bool first = true;
+        bool closed = false;
+        while (j < pattern.size()) {
+          char cc = pattern[j];
+          if (cc == ']' && !first) {
+            closed = true;
+            ++j;
+            break;
+          }
+          first = false;
+          if (cc == '[' && j + 1 < pattern.size() && pattern[j + 1] == ':') {
+            // Named classes ([[:alpha:]] etc); let wildmatch handle
+            // those.
+            return std::nullopt;
+          }
+          // Note: unlike the rest of the pattern, backslash inside a
+          // class is an escape even under WM_NOESCAPE; wildmatch does
+          // the same.
+          if (cc == '\\') {
+            if (j + 1 >= pattern.size()) {
+              return std::nullopt;
+            }
+            cc = pattern[++j];
+          }
+          // Range?  Note that wildmatch also tests the lower bound as
+          // an individual member before it notices the `-`, which is
+          // observable when the range is reversed and otherwise empty.
+          if (j + 2 < pattern.size() && pattern[j + 1] == '-' &&
+              pattern[j + 2] != ']') {
+            char hi = pattern[j + 2];
+            if (hi == '\\') {
+              if (j + 3 >= pattern.size()) {
+                return std::nullopt;
+              }
+              hi = pattern[j + 3];
+              ++j;
+            }
+            classSetByte(bits, static_cast<unsigned char>(cc));
+            for (int b = static_cast<unsigned char>(cc);
+                 b <= static_cast<unsigned char>(hi);
+                 ++b) {
+              classSetByte(bits, static_cast<unsigned char>(b));
+            }
+            j += 3;
+            continue;
+          }
+          classSetByte(bits, static_cast<unsigned char>(cc));
+          ++j;
+        }
+        if (!closed) {
+          // Unterminated class; wildmatch aborts the whole match, so
+          // don't try to mimic it.
+          return std::nullopt;
+        }
+        if (negate) {
+          for (auto& word : bits) {
+            word = ~word;
+          }
+        }
+        Token token{Kind::CharClass, {}, 0};
+        token.classIndex = static_cast<uint32_t>(result.classes_.size());
+        result.classes_.push_back(bits);
+        result.tokens_.push_back(std::move(token));
+        i = j;
+        break;
+      }
+
+      default:
+        appendLiteral(c, true);
+        ++i;
+        break;
+    }
+  }
+
+  result.periodRule_ = wildmatchFlags & WM_PERIOD;
+  if (result.periodRule_) {
+    // wildmatch rejects a name fragment that begins with `.` when the
+    // pattern being matched against it reaches a `*` before any literal
+    // character has matched; `?` and classes may consume the dot but do
+    // not satisfy the requirement.  This applies both to the whole name
+    // and, because wildmatch recurses at star boundaries, to the
+    // remainder of the name each time a star hands off to the rest of
+    // the pattern.  Precompute, for every token position, whether the
+    // pattern suffix starting there trips the rule.
+    result.blocksDotStart_.resize(result.tokens_.size() + 1, 0);
+    for (size_t t = result.tokens_.size(); t > 0; --t) {
+      switch (result.tokens_[t - 1].kind) {
+        case Kind::Star:
+          result.blocksDotStart_[t - 1] = 1;
+          break;
+        case Kind::Literal:
+          result.blocksDotStart_[t - 1] = 0;
+          break;
+        default:
+          result.blocksDotStart_[t - 1] = result.blocksDotStart_[t];
+          break;
+      }
+    }
+  }
+
+  return result;
+}
+
+bool GlobComponentMatcher::match(std::string_view name) const {
+  // The classic iterative glob match: advance through tokens and name
+  // together, remembering the most recent star so a later mismatch can
+  // backtrack to it and consume one more byte.
+  constexpr size_t kNone = static_cast<size_t>(-1);
+  size_t ti = 0;
+  size_t ni = 0;
+  size_t starTok = kNone;
+  size_t starName = 0;
+
+  // True if handing the name fragment starting at `pos` to the pattern
+  // suffix starting at token `tok` violates the WM_PERIOD rule.
+  auto dotBlocked = [&](size_t tok, size_t pos) {
+    return periodRule_ && pos < name.size() && name[pos] == '.' &&
+        blocksDotStart_[tok];
+  };
+
+  if (dotBlocked(0, 0)) {
+    return false;
+  }
+
+  while (ni < name.size()) {
+    bool matchedHere = false;
+    if (ti < tokens_.size()) {
+      const auto& t = tokens_[ti];
+      switch (t.kind) {
+        case Kind::Star:
+          starTok = ti;
+          starName = ni;
+          ++ti;
+          matchedHere = !dotBlocked(ti, ni);
+          break;
+        case Kind::AnyChar:
+          ++ti;
+          ++ni;
+          matchedHere = true;
+          break;
+        case Kind::CharClass:
+          if (classTestByte(
+                  classes_[t.classIndex],
+                  static_cast<unsigned char>(
+                      foldByte(name[ni], caseFold_)))) {
+            ++ti;
+            ++ni;
+            matchedHere = true;
+          }
+          break;
+        case Kind::Literal: {
+          const auto& lit = t.literal;
+          if (name.size() - ni >= lit.size()) {
+            size_t k = 0;
+            while (k < lit.size() &&
+                   foldByte(name[ni + k], caseFold_) == lit[k]) {
+              ++k;
+            }
+            if (k == lit.size()) {
+              ni += lit.size();
+              ++ti;
+              matchedHere = true;
+            }
+          }
+          break;
+        }
+      }
+    }
+    if (!matchedHere) {
+      if (starTok == kNone) {
+        return false;
+      }
+      // Let the star swallow one more byte and retry from there,
+      // skipping restart positions the WM_PERIOD rule disallows.
+      do {
+        ti = starTok + 1;
+        ni = ++starName;
+      } while (dotBlocked(ti, ni));
+    }
+  }
+
+  // Name consumed; any remaining tokens must be stars.
+  while (ti < tokens_.size() && tokens_[ti].kind == Kind::Star) {
+    ++ti;
+  }
+  return ti == tokens_.size();
+}
+
+void GlobTree::compileMatchers(int wildmatchFlags, bool caseInsensitive) {
+  const bool fold = caseInsensitive || (wildmatchFlags & WM_CASEFOLD);
+  for (auto& child : children) {
+    // Case-sensitive literals use direct child lookup during the walk
+    // and need no matcher; everything else benefits from skipping
+    // wildmatch per name.
+    if (child->had_specials || fold) {
+      child->compiled = GlobComponentMatcher::compile(
+          child->pattern, wildmatchFlags, caseInsensitive);
+    }
+    child->compileMatchers(wildmatchFlags, caseInsensitive);
+  }
+  // doublestar_children are matched against whole relative paths by the
+  // doublestar walk; leave them on the wildmatch path.
+}
+
 GlobTree::GlobTree(const char* pattern, uint32_t pattern_len)
     : pattern(pattern, pattern_len),
       is_leaf(0),
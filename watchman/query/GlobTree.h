@@ -7,12 +7,64 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace watchman {
 
+/**
+ * A single glob path component compiled into a flat token program that
+ * is matched byte-wise against child names during the glob tree walk.
+ * This avoids re-parsing the pattern text through wildmatch for every
+ * name in every directory at that level of the walk.
+ *
+ * The supported syntax is the subset of wildmatch that can appear in a
+ * single path component: literal runs, `*`, `?`, `[...]` classes with
+ * ranges and `^`/`!` negation, and backslash escapes.  WM_CASEFOLD,
+ * WM_PERIOD and WM_NOESCAPE are baked in at compile time.  Anything the
+ * compiler does not fully understand (eg: `[[:alpha:]]` named classes)
+ * makes compile() return nullopt and the caller falls back to wildmatch.
+ */
+class GlobComponentMatcher {
+ public:
+  static std::optional<GlobComponentMatcher> compile(
+      std::string_view pattern,
+      int wildmatchFlags,
+      bool caseInsensitive);
+
+  // Returns true if `name` (a single path component) matches.
+  bool match(std::string_view name) const;
+
+ private:
+  enum class Kind : uint8_t { Literal, AnyChar, Star, CharClass };
+
+  struct Token {
+    Kind kind;
+    // Literal: the bytes to compare (stored folded when folding)
+    std::string literal;
+    // CharClass: index into classes_
+    uint32_t classIndex{0};
+  };
+
+  GlobComponentMatcher() = default;
+
+  std::vector<Token> tokens_;
+  // 256-bit membership bitmaps for CharClass tokens
+  std::vector<std::array<uint64_t, 4>> classes_;
+  bool caseFold_{false};
+  // WM_PERIOD: a name fragment starting with `.` cannot be handed to a
+  // pattern suffix that reaches `*` before any literal character.
+  // blocksDotStart_[t] records that property for the suffix starting at
+  // token t (with one extra trailing entry for the empty suffix).
+  bool periodRule_{false};
+  std::vector<uint8_t> blocksDotStart_;
+};
+
 /**
  * A node in the tree of node matching rules.
  */
@@ -24,6 +76,12 @@ struct GlobTree {
   // The list of ** rules that exist under this node
   std::vector<std::unique_ptr<GlobTree>> doublestar_children;
 
+  // Byte-wise matcher compiled from `pattern` by compileMatchers();
+  // nullopt when the pattern needs no matcher (case-sensitive literals
+  // use direct child lookup) or uses syntax the compiler cannot handle
+  // (those fall back to wildmatch during the walk).
+  std::optional<GlobComponentMatcher> compiled;
+
   unsigned is_leaf : 1; // if true, generate files for matches
   unsigned had_specials : 1; // if false, can do simple string compare
   unsigned is_doublestar : 1; // pattern begins with **
@@ -38,6 +96,11 @@ struct GlobTree {
   void unparse_into(
       std::vector<std::string>& globStrings,
       std::string_view relative) const;
+
+  // Recursively compile per-component matchers for the walk, once the
+  // query's glob flags and case mode are known.  Doublestar nodes match
+  // whole relative paths and are left on the wildmatch path.
+  void compileMatchers(int wildmatchFlags, bool caseInsensitive);
 };
 
 } // namespace watchman
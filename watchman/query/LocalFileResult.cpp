@@ -6,10 +6,26 @@
  */
 
 #include "watchman/query/LocalFileResult.h"
+
+#include <folly/synchronization/Baton.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include "watchman/ContentHash.h"
+#include "watchman/ThreadPool.h"
+#include "watchman/fs/IoUringStat.h"
 
 namespace watchman {
 
+namespace {
+
+// Don't bother spinning up a pool shard for fewer files than this; the
+// syscalls for a small batch are cheaper than the wakeups.
+constexpr size_t kMinFilesPerShard = 256;
+
+} // namespace
+
 LocalFileResult::LocalFileResult(
     w_string fullPath,
     ClockStamp clock,
@@ -112,33 +128,129 @@ std::optional<FileResult::ContentHash> LocalFileResult::getContentSha1() {
   return contentSha1_.value();
 }
 
-void LocalFileResult::batchFetchProperties(
+void LocalFileResult::fetchNeededProperties() {
+  getInfo();
+
+  if (neededProperties() & FileResult::Property::SymlinkTarget) {
+    ResolvedSymlink target = NotSymlink{};
+    // If this file is not a symlink then we immediately yield a "not a
+    // symlink" rather than propagating an error. This behavior is relied
+    // upon by the field rendering code and checked in test_symlink.py.
+    if (info_->isSymlink()) {
+      target = readSymbolicLink(fullPath_.c_str());
+    }
+    symlinkTarget_ = target;
+  }
+
+  if (neededProperties() & FileResult::Property::ContentSha1) {
+    // TODO: find a way to reference a ContentHashCache instance
+    // that will work with !InMemoryView based views.
+    contentSha1_ = makeResultWith(
+        [&] { return ContentHashCache::computeHashImmediate(fullPath_.c_str()); });
+  }
+
+  clearNeededProperties();
+}
+
+void LocalFileResult::prefetchInfoBatch(
     const std::vector<std::unique_ptr<FileResult>>& files) {
+  if (!ioUringStatAvailable()) {
+    // Without a vectored backend the batch call would just serialize
+    // the stats here, defeating the sharded fetch below.
+    return;
+  }
+
+  std::vector<LocalFileResult*> needInfo;
+  std::vector<const char*> paths;
   for (auto& f : files) {
-    auto localFile = dynamic_cast<LocalFileResult*>(f.get());
-    localFile->getInfo();
-
-    if (localFile->neededProperties() & FileResult::Property::SymlinkTarget) {
-      ResolvedSymlink target = NotSymlink{};
-      // If this file is not a symlink then we immediately yield a "not a
-      // symlink" rather than propagating an error. This behavior is relied
-      // upon by the field rendering code and checked in test_symlink.py.
-      if (localFile->info_->isSymlink()) {
-        target = readSymbolicLink(localFile->fullPath_.c_str());
-      }
-      localFile->symlinkTarget_ = target;
+    auto* local = dynamic_cast<LocalFileResult*>(f.get());
+    // The vectored path skips canonical case checking, so restrict it
+    // to case sensitive filesystems where getInfo() wouldn't check
+    // either.
+    if (local && !local->info_.has_value() &&
+        local->caseSensitivity_ == CaseSensitivity::CaseSensitive) {
+      needInfo.push_back(local);
+      paths.push_back(local->fullPath_.c_str());
     }
+  }
+  if (paths.empty()) {
+    return;
+  }
+
+  auto results = realFileSystem.getFileInformationBatch(
+      paths, CaseSensitivity::CaseSensitive);
+  for (size_t i = 0; i < needInfo.size(); ++i) {
+    if (results[i].hasValue()) {
+      needInfo[i]->info_ = std::move(results[i]).value();
+      needInfo[i]->exists_ = true;
+    } else {
+      // Match getInfo(): treat any error as effectively deleted.
+      needInfo[i]->exists_ = false;
+      needInfo[i]->info_ = FileInformation::makeDeletedFileInformation();
+    }
+  }
+}
+
+void LocalFileResult::batchFetchProperties(
+    const std::vector<std::unique_ptr<FileResult>>& files) {
+  // Resolve all the missing stat information in one vectored submission
+  // up front; the per-file fetches below then only pay for symlink and
+  // content hash work.
+  prefetchInfoBatch(files);
 
-    if (localFile->neededProperties() & FileResult::Property::ContentSha1) {
-      // TODO: find a way to reference a ContentHashCache instance
-      // that will work with !InMemoryView based views.
-      localFile->contentSha1_ = makeResultWith([&] {
-        return ContentHashCache::computeHashImmediate(
-            localFile->fullPath_.c_str());
-      });
+  const size_t n = files.size();
+  size_t shardCount = std::min<size_t>(
+      std::max<size_t>(std::thread::hardware_concurrency(), 1),
+      (n + kMinFilesPerShard - 1) / kMinFilesPerShard);
+
+  if (shardCount < 2) {
+    for (auto& f : files) {
+      dynamic_cast<LocalFileResult*>(f.get())->fetchNeededProperties();
     }
+    return;
+  }
+
+  // Every file in the batch needs one or more synchronous filesystem
+  // calls and each touches only its own result object, so fan the batch
+  // out across the pool and fill the whole wave in parallel.
+  const size_t perShard = (n + shardCount - 1) / shardCount;
+  std::atomic<size_t> pendingShards{shardCount};
+  folly::Baton<> done;
+  std::mutex errorMutex;
+  std::exception_ptr firstError;
+
+  for (size_t shard = 0; shard < shardCount; ++shard) {
+    const size_t begin = shard * perShard;
+    const size_t end = std::min(n, begin + perShard);
+    auto task = [&, begin, end] {
+      for (size_t i = begin; i < end; ++i) {
+        try {
+          dynamic_cast<LocalFileResult*>(files[i].get())
+              ->fetchNeededProperties();
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (!firstError) {
+            firstError = std::current_exception();
+          }
+        }
+      }
+      if (pendingShards.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        done.post();
+      }
+    };
+    try {
+      getThreadPool().add(task);
+    } catch (const std::exception&) {
+      // Pool is saturated or stopped; fetch this shard inline.
+      task();
+    }
+  }
+  done.wait();
 
-    localFile->clearNeededProperties();
+  if (firstError) {
+    // Match the serial path, which lets fetch errors propagate to the
+    // query executor.
+    std::rethrow_exception(firstError);
   }
 }
 
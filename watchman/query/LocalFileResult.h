@@ -69,6 +69,15 @@ class LocalFileResult : public FileResult {
  private:
   void getInfo();
   w_string getFullPath();
+  // Resolves all of the properties recorded as needed for this file
+  // with synchronous filesystem calls, then clears the needed set.
+  void fetchNeededProperties();
+  // Bulk-stats every file in the batch that still needs its
+  // FileInformation through the filesystem's vectored stat path, so
+  // that the subsequent per-file fetches are stat-free.  A no-op when
+  // the platform has no vectored stat support.
+  static void prefetchInfoBatch(
+      const std::vector<std::unique_ptr<FileResult>>& files);
 
   bool exists_{true};
   std::optional<FileInformation> info_;
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/MatchedSetCache.h"
+#include "watchman/query/QueryResultCache.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+
+namespace watchman {
+
+MatchedSetCache::MatchedSetCache(size_t maxEntries)
+    : maxEntries_{maxEntries} {}
+
+MatchedSet MatchedSetCache::lookup(
+    const w_string& specKey,
+    const ClockPosition& position) const {
+  auto map = entries_.rlock();
+  auto it = map->find(specKey);
+  if (it == map->end() ||
+      it->second.position.rootNumber != position.rootNumber ||
+      it->second.position.ticks != position.ticks) {
+    return nullptr;
+  }
+  return it->second.set;
+}
+
+void MatchedSetCache::insert(
+    const w_string& specKey,
+    const ClockPosition& position,
+    MatchedSet set) {
+  auto map = entries_.wlock();
+  auto it = map->find(specKey);
+  if (it != map->end()) {
+    it->second = Entry{position, std::move(set)};
+    return;
+  }
+  if (map->size() >= maxEntries_) {
+    // Evict the entry with the oldest clock; the map is small enough
+    // that a linear scan is fine.
+    auto victim = map->begin();
+    for (auto i = map->begin(); i != map->end(); ++i) {
+      if (i->second.position.ticks < victim->second.position.ticks) {
+        victim = i;
+      }
+    }
+    map->erase(victim);
+  }
+  map->emplace(specKey, Entry{position, std::move(set)});
+}
+
+w_string MatchedSetCache::keyFor(const json_ref& querySpec) {
+  auto stripped = json_object();
+  for (auto& [key, value] : querySpec.object()) {
+    if (key != "fields") {
+      stripped.set(key, json_ref(value));
+    }
+  }
+  return QueryResultCache::keyFor(stripped);
+}
+
+} // namespace watchman
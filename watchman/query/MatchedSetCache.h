@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "watchman/Clock.h"
+#include "watchman/fs/FileInformation.h"
+#include "watchman/watchman_string.h"
+
+class json_ref;
+
+namespace watchman {
+
+/**
+ * Everything the field renderers need to describe one matched file,
+ * captured by value so the snapshot stays valid after the view moves
+ * on.  Content hashes and symlink targets are deliberately absent:
+ * they are fetched lazily from disk and field lists that want them
+ * bypass the matched-set cache.
+ */
+struct MatchedFile {
+  /// Fully qualified path, as FileResult::dirName()/baseName() report it.
+  w_string fullPath;
+  FileInformation stat;
+  bool exists;
+  ClockStamp ctime;
+  ClockStamp otime;
+};
+
+using MatchedSet = std::shared_ptr<const std::vector<MatchedFile>>;
+
+/**
+ * A per-root cache of matched-file snapshots, keyed by the query spec
+ * with its field list removed.
+ *
+ * After one settle, several clients commonly ask "what changed" with
+ * the same since basis but different field lists.  The field list only
+ * affects rendering, so the generation and expression-evaluation work
+ * produces the same matched set for all of them; this cache lets the
+ * Nth such evaluation reuse the first one's immutable snapshot (shared
+ * by reference, never copied) and pay for rendering alone.
+ *
+ * Entries follow the same validity rule as QueryResultCache: a
+ * snapshot is only served at exactly the clock position it was
+ * recorded at, so any view tick invalidates implicitly.
+ */
+class MatchedSetCache {
+ public:
+  /// `maxEntries` of zero disables the cache entirely.
+  explicit MatchedSetCache(size_t maxEntries);
+
+  bool enabled() const {
+    return maxEntries_ != 0;
+  }
+
+  /**
+   * Returns the snapshot previously recorded for `specKey` if it was
+   * produced at exactly `position`, else nullptr.
+   */
+  MatchedSet lookup(const w_string& specKey, const ClockPosition& position)
+      const;
+
+  /**
+   * Records the snapshot produced for `specKey` at `position`.  A stale
+   * entry for the same spec is replaced in place; when the cache is full
+   * the entry with the oldest clock is evicted.
+   */
+  void insert(
+      const w_string& specKey,
+      const ClockPosition& position,
+      MatchedSet set);
+
+  /**
+   * Builds the cache key for a query spec: the canonical dump of the
+   * spec with the rendering-only "fields" key dropped, so that specs
+   * differing only in field list share an entry.
+   */
+  static w_string keyFor(const json_ref& querySpec);
+
+ private:
+  struct Entry {
+    ClockPosition position;
+    MatchedSet set;
+  };
+
+  const size_t maxEntries_;
+  folly::Synchronized<std::unordered_map<w_string, Entry>> entries_;
+};
+
+} // namespace watchman
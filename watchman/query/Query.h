@@ -27,12 +27,35 @@ struct QueryFieldRenderer {
 
 class QueryFieldList : public std::vector<QueryFieldRenderer*> {
  public:
+  /** Renders one complete row (or the bare value for a single-field
+   * list) with all the field dispatch baked in. */
+  using RenderRowFn =
+      std::optional<json_ref> (*)(FileResult* file, const QueryContext* ctx);
+
   /**
    * Adds the specified field to the list of those requested by the query.
    *
    * Throws QueryParseError if the name is invalid.
    */
   void add(const w_string& name);
+
+  /**
+   * Returns the position of the named field in the list, or
+   * std::nullopt if the query did not request it.
+   */
+  std::optional<size_t> indexOf(w_string_piece name) const;
+
+  /**
+   * Returns a render function specialized for this exact field list, or
+   * nullptr when the list doesn't match one of the precompiled common
+   * shapes and rendering must loop over the renderer table instead.
+   */
+  RenderRowFn specializedRender() const {
+    return specialized_;
+  }
+
+ private:
+  RenderRowFn specialized_{nullptr};
 };
 
 struct QueryPath {
@@ -48,6 +71,41 @@ struct Query {
   bool dedup_results = false;
   uint32_t bench_iterations = 0;
 
+  /**
+   * When set, sampled per-term evaluation timings are aggregated by
+   * term type and attached to the query_execute perf sample (which is
+   * force-logged for the run).  Profiled queries evaluate serially so
+   * the root-term sampler needs no synchronization.
+   */
+  bool debug_profile_terms = false;
+
+  /**
+   * When set, bounds the number of rows emitted for a since query. If the
+   * candidate set is larger, the response carries "is_limited": true and
+   * the returned clock is rewound to the newest tick that was fully
+   * evaluated, so re-issuing the query with that clock streams the next
+   * page. Pages end on a tick boundary, so a page can run slightly over
+   * the limit when several files share a tick. Only the time generator
+   * honors this; fresh instance results and the path/suffix/glob
+   * generators are never truncated.
+   */
+  std::optional<json_int_t> result_limit;
+
+  /**
+   * When set, rendered rows are sorted by this field before the response
+   * is returned; ascending unless `descending` is set.  The field must
+   * be present in the requested field list.  Ties keep emission order,
+   * which is deterministic even under parallel evaluation, so equal
+   * responses are byte-identical across runs.  Sorting needs the full
+   * rendered set in hand, so these queries keep their rows in DOM form
+   * rather than streaming them through a render sink.
+   */
+  struct OrderBy {
+    w_string field;
+    bool descending{false};
+  };
+  std::optional<OrderBy> order_by;
+
   /**
    * Optional full path to relative root, without and with trailing slash.
    */
@@ -60,6 +118,13 @@ struct Query {
   // Additional flags to pass to wildmatch in the glob_generator
   int glob_flags = 0;
 
+  /**
+   * Lower-cased suffix set for the suffix generator. When set, glob_tree
+   * also holds an equivalent set of recursive glob patterns so that views
+   * without a suffix index can fall back to their glob generator.
+   */
+  std::optional<std::vector<w_string>> suffixes;
+
   struct SettleTimeouts {
     std::chrono::milliseconds settle_period;
     std::chrono::milliseconds settle_timeout;
@@ -79,6 +144,23 @@ struct Query {
    */
   std::chrono::milliseconds sync_timeout;
 
+  /**
+   * When true, skip synchronization entirely regardless of sync_timeout
+   * and answer from the view as it stands.  The returned clock is the
+   * position the query was answered at, so a stale-tolerant caller can
+   * reconcile later with a `since` query from that clock.
+   */
+  bool stale_ok = false;
+
+  /**
+   * Bounds the total evaluation wall time; sync_timeout only bounds the
+   * cookie sync that precedes it.  When exceeded the query fails with
+   * an error rather than returning whatever was accumulated: a partial
+   * result paired with the returned clock would silently corrupt a
+   * caller's `since` reconciliation.  Unset means unbounded.
+   */
+  std::optional<std::chrono::milliseconds> query_timeout;
+
   uint32_t lock_timeout = 0;
 
   // We can't (and mustn't!) evaluate the clockspec
@@ -89,6 +171,15 @@ struct Query {
 
   std::unique_ptr<QueryExpr> expr;
 
+  /**
+   * Set by the planning pass in parseQuery when the generator selection
+   * above was synthesized from the expression rather than spelled out in
+   * the query spec; surfaced by the `debug-query-plan` command.  Empty
+   * when the caller's own generators (or the all-files fallback) are in
+   * effect.
+   */
+  w_string plannerInfo;
+
   // The query that we parsed into this struct
   std::optional<json_ref> query_spec;
 
@@ -7,6 +7,11 @@
 
 #include "watchman/query/QueryContext.h"
 
+#include <folly/hash/Hash.h>
+#include <algorithm>
+#include "watchman/Errors.h"
+#include "watchman/TraceSpan.h"
+#include "watchman/bser.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/eval.h"
 #include "watchman/query/parse.h"
@@ -23,11 +28,24 @@ std::optional<json_ref> file_result_to_json(
     const QueryFieldList& fieldList,
     const std::unique_ptr<FileResult>& file,
     const QueryContext* ctx) {
+  if (auto render = fieldList.specializedRender()) {
+    // One of the common field-list shapes; the whole row renders
+    // through a single direct call with no per-field dispatch.
+    return render(file.get(), ctx);
+  }
+
   if (fieldList.size() == 1) {
     return fieldList.front()->make(file.get(), ctx);
   }
-  std::unordered_map<w_string, json_ref> value;
-  value.reserve(fieldList.size());
+
+  // Multi-field rows are rendered in columnar template form: a
+  // positional array in fieldList order, with the matching key array
+  // attached as the outer array's template by renderResults().  The
+  // BSER encoder emits such rows with no per-row key handling at all,
+  // and the JSON dumper expands them back into objects at output time,
+  // so no json object is ever constructed per file.
+  std::vector<json_ref> row;
+  row.reserve(fieldList.size());
 
   for (auto& f : fieldList) {
     auto ele = f->make(file.get(), ctx);
@@ -35,9 +53,58 @@ std::optional<json_ref> file_result_to_json(
       // Need data to be loaded
       return std::nullopt;
     }
-    value.insert_or_assign(f->name, std::move(ele.value()));
+    row.push_back(std::move(ele.value()));
   }
-  return json_object(std::move(value));
+  return json_array(std::move(row));
+}
+
+// Orders rendered rows by the query's order_by field.  The sort keys
+// are located up front so the comparators only chase one level of
+// json_ref per comparison, and a stable sort keeps ties in emission
+// order, which is deterministic even when the expression was evaluated
+// in parallel (the parallel path merges verdicts in generator order).
+void sortRenderedRows(const Query& query, std::vector<json_ref>& rows) {
+  auto& spec = *query.order_by;
+  // Validated by parse_order_by, so the field is always present.
+  size_t keyIndex = *query.fieldList.indexOf(spec.field);
+  const bool columnar = query.fieldList.size() > 1;
+
+  struct SortEntry {
+    const json_ref* key;
+    size_t row;
+  };
+  std::vector<SortEntry> entries;
+  entries.reserve(rows.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    entries.push_back(SortEntry{
+        columnar ? &rows[i].array()[keyIndex] : &rows[i], i});
+  }
+
+  auto less = [](const json_ref& a, const json_ref& b) {
+    if (a.isString() && b.isString()) {
+      return json_to_w_string(a) < json_to_w_string(b);
+    }
+    if (a.isNumber() && b.isNumber()) {
+      return json_number_value(a) < json_number_value(b);
+    }
+    // Mixed or unordered values (null for a deleted file's mtime, an
+    // error object from a renderer) compare equal and keep their
+    // emission order.
+    return false;
+  };
+  std::stable_sort(
+      entries.begin(),
+      entries.end(),
+      [&](const SortEntry& a, const SortEntry& b) {
+        return spec.descending ? less(*b.key, *a.key) : less(*a.key, *b.key);
+      });
+
+  std::vector<json_ref> sorted;
+  sorted.reserve(rows.size());
+  for (auto& entry : entries) {
+    sorted.push_back(std::move(rows[entry.row]));
+  }
+  rows = std::move(sorted);
 }
 
 } // namespace
@@ -96,6 +163,15 @@ bool QueryContext::fileMatchesRelativeRoot(w_string_piece fullFilePath) {
   return dirMatchesRelativeRoot(fullFilePath.dirName());
 }
 
+bool QueryContext::onlyReturnsExistingFiles() const {
+  // Mirrors the fresh-instance filter in w_query_process_file(): when
+  // it will unconditionally drop files that do not exist, generators
+  // may skip them without producing a FileResult at all.
+  return !disableFreshInstance &&
+      std::holds_alternative<QuerySince::Clock>(since.since) &&
+      std::get<QuerySince::Clock>(since.since).is_fresh_instance;
+}
+
 bool QueryContext::fileMatchesRelativeRoot(const watchman_file* f) {
   // getFullPath() allocates memory; avoid it with this cheap test
   if (!query->relative_root) {
@@ -108,11 +184,102 @@ bool QueryContext::fileMatchesRelativeRoot(const watchman_file* f) {
 QueryContext::QueryContext(
     const Query* q,
     const std::shared_ptr<Root>& root,
-    bool disableFreshInstance)
+    bool disableFreshInstance,
+    QueryContextScratch* scratch)
     : created(std::chrono::steady_clock::now()),
+      traceId(currentTraceId()),
       query(q),
       root(root),
-      disableFreshInstance{disableFreshInstance} {}
+      disableFreshInstance{disableFreshInstance},
+      scratch_{scratch} {
+  if (scratch_) {
+    // Borrow the scratch containers: empty, but with the capacity a
+    // previous run of this query grew.
+    std::swap(resultsArray, scratch_->resultsArray);
+    std::swap(dedup, scratch_->dedup);
+    std::swap(namesToLog, scratch_->namesToLog);
+    std::swap(evalBatch_, scratch_->evalBatch);
+    std::swap(renderBatch_, scratch_->renderBatch);
+  }
+  // relative_root changes the rendered "name" field, so fragments built
+  // for such a query cannot be shared with other queries on the root.
+  if (!q->relative_root && !q->fieldList.empty()) {
+    size_t hash = 0;
+    for (auto* f : q->fieldList) {
+      // The renderers are singletons, so their addresses identify the
+      // field list.
+      hash = folly::hash::hash_combine(hash, uintptr_t(f));
+      if (f->name == "new") {
+        fieldListHasNew_ = true;
+      }
+    }
+    renderCacheFieldHash_ = hash;
+  }
+}
+
+QueryContext::~QueryContext() {
+  if (!scratch_) {
+    return;
+  }
+  // Return the borrowed containers for the next run. clear() keeps the
+  // vector capacity and the set's bucket array. renderResults() usually
+  // consumed resultsArray's storage already, but the frequent runs that
+  // match nothing keep theirs.
+  resultsArray.clear();
+  dedup.clear();
+  namesToLog.clear();
+  evalBatch_.clear();
+  renderBatch_.clear();
+  std::swap(resultsArray, scratch_->resultsArray);
+  std::swap(dedup, scratch_->dedup);
+  std::swap(namesToLog, scratch_->namesToLog);
+  std::swap(evalBatch_, scratch_->evalBatch);
+  std::swap(renderBatch_, scratch_->renderBatch);
+}
+
+std::optional<RenderCacheProbe> QueryContext::computeRenderCacheProbe(
+    FileResult* file) {
+  auto* since_clock = std::get_if<QuerySince::Clock>(&since.since);
+  // Fresh instance runs render every file in the tree; populating the
+  // cache from them would only churn it, so restrict caching to
+  // incremental clock-based runs, which is the shape every subscription
+  // settles into.
+  if (!since_clock || since_clock->is_fresh_instance) {
+    return std::nullopt;
+  }
+
+  bool isNew = false;
+  if (fieldListHasNew_) {
+    auto ctime = file->ctime();
+    if (!ctime.has_value()) {
+      // Need data to be loaded; don't consult the cache this round
+      return std::nullopt;
+    }
+    isNew = ctime->ticks > since_clock->ticks;
+  }
+
+  return RenderCacheProbe{*renderCacheFieldHash_, isNew};
+}
+
+std::optional<json_ref> QueryContext::renderFile(
+    const std::unique_ptr<FileResult>& file) {
+  std::optional<RenderCacheProbe> probe;
+  if (renderCacheFieldHash_.has_value()) {
+    probe = computeRenderCacheProbe(file.get());
+    if (probe.has_value()) {
+      auto cached = file->getCachedRender(*probe);
+      if (cached.has_value()) {
+        return cached;
+      }
+    }
+  }
+
+  auto rendered = file_result_to_json(query->fieldList, file, this);
+  if (rendered.has_value() && probe.has_value()) {
+    file->cacheRender(*probe, rendered.value());
+  }
+  return rendered;
+}
 
 void QueryContext::addToEvalBatch(std::unique_ptr<FileResult>&& file) {
   evalBatch_.emplace_back(std::move(file));
@@ -146,13 +313,62 @@ RenderResult QueryContext::renderResults() {
     // build a template for the serializer
     templ = field_list_to_json_name_array(query->fieldList);
   }
+  if (renderSink) {
+    // The rows already streamed into the sink as encoded bytes; seal it
+    // with the template and count.  resultsArray is empty in this mode.
+    RenderResult result;
+    result.preencoded = renderSink->finish(std::move(templ));
+    return result;
+  }
+  if (query->order_by && resultsArray.size() > 1) {
+    sortRenderedRows(*query, resultsArray);
+  }
   return RenderResult{std::move(resultsArray), std::move(templ)};
 }
 
+void QueryContext::pushRenderedRow(json_ref&& row) {
+  ++emittedRows_;
+  if (renderSink) {
+    renderSink->append(row);
+    return;
+  }
+  resultsArray.push_back(std::move(row));
+}
+
+void QueryContext::checkDeadline() {
+  if (!deadline && !clientGoneProbe) {
+    return;
+  }
+  // This runs once per evaluated file, so the common case must be a
+  // counter increment and nothing else.  Reading the clock every 1024
+  // files bounds the overshoot to well under a millisecond of work.
+  if ((++deadlineCheckCounter_ & 0x3ff) != 0) {
+    return;
+  }
+  if (deadline && std::chrono::steady_clock::now() > *deadline) {
+    QueryExecError::throwf(
+        "query_timeout of {}ms exceeded during evaluation",
+        query->query_timeout ? query->query_timeout->count() : 0);
+  }
+  // The disconnect probe does a syscall, so poll it an order of
+  // magnitude less often than the clock.
+  if (clientGoneProbe && (deadlineCheckCounter_ & 0x3fff) == 0 &&
+      clientGoneProbe()) {
+    throw QueryExecError(
+        "client disconnected while the query was evaluating; aborting");
+  }
+}
+
+bool QueryContext::limitReached() const {
+  return query->result_limit.has_value() &&
+      json_int_t(emittedRows_ + evalBatch_.size() + renderBatch_.size()) >=
+      *query->result_limit;
+}
+
 void QueryContext::maybeRender(std::unique_ptr<FileResult>&& file) {
-  auto maybeRendered = file_result_to_json(query->fieldList, file, this);
+  auto maybeRendered = renderFile(file);
   if (maybeRendered.has_value()) {
-    resultsArray.push_back(std::move(maybeRendered.value()));
+    pushRenderedRow(std::move(maybeRendered.value()));
     return;
   }
 
@@ -176,9 +392,9 @@ bool QueryContext::fetchRenderBatchNow() {
   auto toProcess = std::move(renderBatch_);
 
   for (auto& file : toProcess) {
-    auto maybeRendered = file_result_to_json(query->fieldList, file, this);
+    auto maybeRendered = renderFile(file);
     if (maybeRendered.has_value()) {
-      resultsArray.push_back(std::move(maybeRendered.value()));
+      pushRenderedRow(std::move(maybeRendered.value()));
     } else {
       renderBatch_.emplace_back(std::move(file));
     }
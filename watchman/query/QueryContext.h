@@ -8,19 +8,44 @@
 #pragma once
 
 #include <folly/stop_watch.h>
+#include <functional>
+#include <unordered_map>
 #include <unordered_set>
 #include "watchman/Clock.h"
+#include "watchman/FileNodeArena.h"
+#include "watchman/query/FileResult.h"
 #include "watchman/query/QueryExpr.h"
 #include "watchman/query/QueryResult.h"
 
+struct watchman_dir;
 struct watchman_file;
 
 namespace watchman {
 
+class BserRenderSink;
 class FileResult;
+struct MatchedFile;
 struct Query;
 class Root;
 
+/**
+ * Reusable container capacity for QueryContext.
+ *
+ * Long-lived query owners (subscriptions, triggers) keep one of these
+ * alongside their Query and hand it to w_query_execute(). Each run
+ * borrows the containers -- empty, but holding whatever capacity the
+ * previous run grew -- and returns them when the context is destroyed,
+ * so steady-state re-evaluation allocates nothing until a run outgrows
+ * the retained capacity.
+ */
+struct QueryContextScratch {
+  std::vector<json_ref> resultsArray;
+  std::unordered_set<w_string> dedup;
+  std::vector<w_string> namesToLog;
+  std::vector<std::unique_ptr<FileResult>> evalBatch;
+  std::vector<std::unique_ptr<FileResult>> renderBatch;
+};
+
 enum class QueryContextState {
   NotStarted,
   WaitingForCookieSync,
@@ -33,6 +58,11 @@ enum class QueryContextState {
 // Holds state for the execution of a query
 struct QueryContext : QueryContextBase {
   std::chrono::time_point<std::chrono::steady_clock> created;
+  // Trace id of the request this query runs on behalf of; captured
+  // from the constructing thread so that work done on other threads
+  // (and logs) can be correlated back to the dispatch.  Zero when the
+  // query was not started from a traced dispatch.
+  uint64_t traceId{0};
   folly::stop_watch<std::chrono::milliseconds> stopWatch;
   std::atomic<QueryContextState> state{QueryContextState::NotStarted};
   std::atomic<std::chrono::milliseconds> cookieSyncDuration{
@@ -54,6 +84,12 @@ struct QueryContext : QueryContextBase {
   std::unique_ptr<FileResult> file;
   QuerySince since;
 
+  // Slab arena backing the per-file result objects the generators mint
+  // (see InMemoryFileResult::operator new).  Arena allocation is
+  // single-threaded, which holds because generation runs on the query
+  // thread; the parallel glob walk gives each branch its own arena.
+  FileNodeArena fileResultArena;
+
   // Rendered results
   std::vector<json_ref> resultsArray;
 
@@ -70,13 +106,76 @@ struct QueryContext : QueryContextBase {
   // How many times we suppressed a result due to dedup checking
   uint32_t num_deduped{0};
 
+  // Directories the path generator has already walked during this
+  // execution, mapped to the remaining depth they were walked with.
+  // Overlapping path specs (clients commonly pass hundreds of sibling
+  // or nested paths in one query) would otherwise re-process the same
+  // subtree once per spec; a later visit only descends if it asks for
+  // more depth than an earlier one covered, and never re-emits a
+  // directory's own files.  Keyed on node identity, which is stable
+  // because the generator holds the view lock for its whole run; the
+  // map is never consulted outside of it.
+  std::unordered_map<const watchman_dir*, uint32_t> pathGenVisited;
+
+  // True if a result_limit query stopped generating before exhausting
+  // the candidate set
+  bool hitResultLimit{false};
+
+  // Highest otime tick among files evaluated by a paged (result_limit)
+  // time generator run. When the page was truncated, a follow-up query
+  // since this tick resumes where this one left off. Zero when paging
+  // does not apply.
+  ClockTicks lastTickGenerated{0};
+
   // Disable fresh instance queries
   bool disableFreshInstance{false};
 
+  // When set, evaluation must finish before this point; checkDeadline()
+  // aborts the query with QueryExecError once it passes.  Derived from
+  // the query's query_timeout at the start of execution.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+
+  // When set, periodically polled by checkDeadline(); returning true
+  // means the requesting client is gone and evaluation should stop
+  // rather than burn cores computing a result nobody will read.
+  std::function<bool()> clientGoneProbe;
+
+  // Throws QueryExecError if the deadline has passed or the client has
+  // disconnected.  Called per evaluated file; internally throttled so
+  // the clock read and probe run only every few thousand calls.
+  void checkDeadline();
+
+  // Sampled timing of the root expression term, maintained by
+  // w_query_process_file() when the query sets debug_profile_terms.
+  // The allof/anyof lists time their children themselves; this covers
+  // whatever term sits at the root of the tree.
+  TermSample rootTermSample;
+
+  // When non-null, every emitted result's render metadata is also
+  // copied here so the matched set can be cached for later evaluations
+  // that differ only in field list.  Cleared (set back to null) by the
+  // emission path if a result cannot serve its metadata synchronously,
+  // which tells w_query_execute() the capture is incomplete.
+  std::vector<MatchedFile>* matchedSetCapture{nullptr};
+
+  // When non-null, rendered rows stream into this sink (which encodes
+  // and releases them) instead of accumulating in resultsArray, and
+  // renderResults() returns the sink's pre-encoded bytes.  Provided by
+  // command handlers serving BSER clients; see BserRenderSink.
+  BserRenderSink* renderSink{nullptr};
+
+  // Number of rows emitted so far, whether into resultsArray or the
+  // render sink.
+  size_t numEmittedResults() const {
+    return emittedRows_;
+  }
+
   QueryContext(
       const Query* q,
       const std::shared_ptr<Root>& root,
-      bool disableFreshInstance);
+      bool disableFreshInstance,
+      QueryContextScratch* scratch = nullptr);
+  ~QueryContext();
   QueryContext(const QueryContext&) = delete;
   QueryContext& operator=(const QueryContext&) = delete;
 
@@ -100,7 +199,10 @@ struct QueryContext : QueryContextBase {
 
   /**
    * Returns a JSON array containing the query results. Also returns an optional
-   * template, for use by json_array_set_template.
+   * template, for use by json_array_set_template.  Multi-field results are
+   * columnar: each row is a positional array in field-list order and the
+   * template holds the matching keys; the serializers expand or factor
+   * that shape at output time.
    *
    * Consumes the resultsArray field.
    */
@@ -118,6 +220,13 @@ struct QueryContext : QueryContextBase {
   // them to w_query_process_file().
   void fetchEvalBatchNow();
 
+  // Returns true when result_limit is set and the result set, counting
+  // batches still pending evaluation or rendering, has reached it.
+  // Generators stop producing files at that point (the time generator
+  // first finishes the cohort of files sharing the current tick so the
+  // page ends on a resumable clock boundary).
+  bool limitReached() const;
+
   void maybeRender(std::unique_ptr<FileResult>&& file);
   void addToRenderBatch(std::unique_ptr<FileResult>&& file);
 
@@ -129,6 +238,12 @@ struct QueryContext : QueryContextBase {
 
   w_string computeWholeName(FileResult* file) const;
 
+  // Returns true when this query is a fresh instance whose results will
+  // only contain files that currently exist.  Generators use this to
+  // skip deleted nodes up front instead of materializing a FileResult
+  // per tombstone only for w_query_process_file() to drop it.
+  bool onlyReturnsExistingFiles() const;
+
   // Returns true if the filename associated with `f` matches
   // the relative_root constraint set on the query.
   // Delegates to dirMatchesRelativeRoot().
@@ -147,8 +262,30 @@ struct QueryContext : QueryContextBase {
   bool dirMatchesRelativeRoot(w_string_piece fullDirectoryPath);
 
  private:
+  // Routes a rendered row to the render sink when one is installed,
+  // otherwise appends it to resultsArray.
+  void pushRenderedRow(json_ref&& row);
+
+  // Renders the field list for `file`, consulting and populating the
+  // FileResult's render fragment cache when this query is eligible.
+  // Returns std::nullopt if more data needs to be loaded first.
+  std::optional<json_ref> renderFile(const std::unique_ptr<FileResult>& file);
+
+  // Computes the cache probe for `file`, or std::nullopt if this run
+  // cannot use cached fragments (timestamp since, fresh instance, or
+  // ctime not yet loaded).
+  std::optional<RenderCacheProbe> computeRenderCacheProbe(FileResult* file);
+
   std::optional<w_string> wholename_;
 
+  // Identity hash of the field renderer list, used to key cached render
+  // fragments.  Unset when the query shape (e.g. relative_root, which
+  // changes the rendered name) makes fragments unshareable.
+  std::optional<size_t> renderCacheFieldHash_;
+
+  // Whether the field list contains the since-dependent "new" field.
+  bool fieldListHasNew_{false};
+
   // Number of files considered as part of running this query
   int64_t numWalked_{0};
 
@@ -162,6 +299,19 @@ struct QueryContext : QueryContextBase {
   // expression and are just pending data to be loaded
   // for rendering the result fields.
   std::vector<std::unique_ptr<FileResult>> renderBatch_;
+
+  // When non-null, the containers above were borrowed from here and
+  // are returned (cleared, capacity intact) on destruction.
+  QueryContextScratch* scratch_{nullptr};
+
+  // Call counter used to throttle checkDeadline()'s clock reads and
+  // client probes.  Only touched from the emission path, which is
+  // single-threaded even for parallel evaluation.
+  uint32_t deadlineCheckCounter_{0};
+
+  // Rows emitted via pushRenderedRow(); tracked separately from
+  // resultsArray.size() because sink-bound rows never land there.
+  size_t emittedRows_{0};
 };
 
 } // namespace watchman
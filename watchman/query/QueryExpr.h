@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <map>
 #include <optional>
 #include <vector>
 #include "watchman/Clock.h"
@@ -43,11 +44,59 @@ enum AggregateOp {
   AllOf,
 };
 
+/**
+ * Sampled evaluation cost of one term type, accumulated by
+ * QueryExpr::collectTermSamples().  `evals` counts every evaluation;
+ * `samples`/`sampledNanos` cover the 1-in-N evaluations that were
+ * actually timed, so sampledNanos/samples estimates the mean cost per
+ * evaluation.
+ */
+struct TermSample {
+  uint64_t evals{0};
+  uint64_t samples{0};
+  uint64_t sampledNanos{0};
+};
+using TermSampleMap = std::map<w_string, TermSample>;
+
 class QueryExpr {
  public:
   virtual ~QueryExpr() = default;
   virtual EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) = 0;
 
+  /**
+   * Canonical term name as registered with the term parser, used to
+   * attribute profiling samples and explain query plans.
+   */
+  virtual w_string_piece name() const = 0;
+
+  /**
+   * Accumulates any sampled per-term timing this expression has
+   * gathered into `out`, keyed by term name, and forwards to child
+   * expressions.  Today only the allof/anyof lists time their children
+   * (as a byproduct of adaptive reordering), so a term's bucket
+   * reflects its cost as measured at the enclosing list boundary; the
+   * root term is timed separately by the query evaluator.  Counters
+   * are cumulative over the life of the parsed expression, which for
+   * subscriptions and triggers spans many runs.
+   */
+  virtual void collectTermSamples(TermSampleMap& out) const {
+    (void)out;
+  }
+
+  /**
+   * Called on the root of the expression tree before each query run,
+   * when no evaluate() calls are in flight. Long-lived queries
+   * (subscriptions, triggers) reuse their parsed expression across
+   * runs, so this is a safe point for adaptive expressions to retune
+   * themselves from statistics gathered during previous runs, or to
+   * compile per-run constants (the run's clock has already been
+   * resolved on `ctx`) out of the per-file path.
+   * Implementations holding child expressions must forward the call.
+   */
+  virtual void prepareForRun(QueryContextBase* ctx) {
+    (void)ctx;
+  }
+
   // If OTHER can be aggregated with THIS, returns a new expression instance
   // representing the combined state.  Op provides information on the containing
   // query and can be used to determine how aggregation is done.
@@ -58,6 +107,27 @@ class QueryExpr {
     return nullptr;
   }
 
+  /**
+   * If this expression evaluates to the same value for every file, returns
+   * that value. The parser uses this to constant-fold terms: identity
+   * operands are dropped from allof/anyof lists, absorbing operands
+   * collapse the whole list, and `not` of a constant folds away.
+   */
+  virtual std::optional<bool> constantValue() const {
+    return std::nullopt;
+  }
+
+  /**
+   * If this expression can only match a fixed set of wholenames
+   * (relative to the query root), returns those names.  The query
+   * planner uses this to point the path generator straight at the named
+   * files instead of walking every file in the view.  Terms whose match
+   * set is not a fixed name list return std::nullopt.
+   */
+  virtual std::optional<std::vector<w_string>> computeExactWholenames() const {
+    return std::nullopt;
+  }
+
   /**
    * Returns a set of glob expressions that form an upper bound on the results
    * of this expression. This SHOULD be a tight upper bound that restricts the
@@ -11,6 +11,12 @@ namespace watchman {
 
 json_ref RenderResult::toJson() && {
   auto arr = json_array(std::move(results));
+  if (preencoded) {
+    // The template, count and rows are already inside the encoded
+    // bytes, so no template annotation is attached.
+    json_array_set_preencoded(arr, std::move(preencoded));
+    return arr;
+  }
   if (templ) {
     json_array_set_template_new(arr, std::move(*templ));
   }
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <memory>
 #include <unordered_set>
 #include <vector>
 #include "watchman/Clock.h"
@@ -15,6 +16,8 @@
 
 namespace watchman {
 
+struct BserPreencodedArray;
+
 struct QueryDebugInfo {
   std::vector<w_string> cookieFileNames;
 
@@ -25,6 +28,11 @@ struct RenderResult {
   std::vector<json_ref> results;
   std::optional<json_ref> templ;
 
+  // When set, the rows were BSER-encoded as they were rendered and
+  // `results` is empty; toJson() returns an annotated array that the
+  // BSER encoder splices verbatim.  Only produced for BSER clients.
+  std::shared_ptr<const BserPreencodedArray> preencoded;
+
   json_ref toJson() &&;
 };
 
@@ -36,6 +44,9 @@ struct QueryResult {
   ClockSpec clockAtStartOfQuery;
   uint32_t stateTransCountAtStartOfQuery;
   std::optional<json_ref> savedStateInfo;
+  // True when a result_limit query stopped before exhausting the
+  // candidate set; clockAtStartOfQuery is rewound to the resume point.
+  bool isLimited{false};
   QueryDebugInfo debugInfo;
 };
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/query/QueryResultCache.h"
+
+namespace watchman {
+
+QueryResultCache::QueryResultCache(size_t maxEntries)
+    : maxEntries_{maxEntries} {}
+
+std::shared_ptr<const QueryResult> QueryResultCache::lookup(
+    const w_string& specKey,
+    const ClockPosition& position) const {
+  auto map = entries_.rlock();
+  auto it = map->find(specKey);
+  if (it == map->end() ||
+      it->second.position.rootNumber != position.rootNumber ||
+      it->second.position.ticks != position.ticks) {
+    return nullptr;
+  }
+  return it->second.result;
+}
+
+void QueryResultCache::insert(
+    const w_string& specKey,
+    const ClockPosition& position,
+    std::shared_ptr<const QueryResult> result) {
+  auto map = entries_.wlock();
+  auto it = map->find(specKey);
+  if (it != map->end()) {
+    it->second = Entry{position, std::move(result)};
+    return;
+  }
+  if (map->size() >= maxEntries_) {
+    // Evict the entry with the oldest clock; the map is small enough
+    // that a linear scan is fine.
+    auto victim = map->begin();
+    for (auto i = map->begin(); i != map->end(); ++i) {
+      if (i->second.position.ticks < victim->second.position.ticks) {
+        victim = i;
+      }
+    }
+    map->erase(victim);
+  }
+  map->emplace(specKey, Entry{position, std::move(result)});
+}
+
+w_string QueryResultCache::keyFor(const json_ref& querySpec) {
+  auto dumped = json_dumps(querySpec, JSON_COMPACT | JSON_SORT_KEYS);
+  return w_string{dumped.data(), dumped.size()};
+}
+
+} // namespace watchman
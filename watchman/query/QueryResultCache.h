@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <folly/Synchronized.h>
+#include <memory>
+#include <unordered_map>
+#include "watchman/query/QueryResult.h"
+
+namespace watchman {
+
+/**
+ * A small per-root cache of executed query results, keyed by the
+ * canonicalized query spec.
+ *
+ * An entry is only served when the root's clock position is exactly the
+ * position at which it was recorded: query results are a pure function
+ * of (spec, view state), so an unchanged clock guarantees the cached
+ * result is identical to what a re-execution would produce.  Any view
+ * tick therefore invalidates every entry implicitly, with no hooks into
+ * the write path.
+ *
+ * Callers are responsible for only caching queries whose execution is
+ * side-effect free; see the eligibility test in w_query_execute().
+ */
+class QueryResultCache {
+ public:
+  /// `maxEntries` of zero disables the cache entirely.
+  explicit QueryResultCache(size_t maxEntries);
+
+  bool enabled() const {
+    return maxEntries_ != 0;
+  }
+
+  /**
+   * Returns the result previously recorded for `specKey` if it was
+   * produced at exactly `position`.  The entry is shared rather than
+   * copied: callers that need a mutable result copy the pointee on
+   * their side, outside the cache lock, so a large result never stalls
+   * concurrent lookups.
+   */
+  std::shared_ptr<const QueryResult> lookup(
+      const w_string& specKey,
+      const ClockPosition& position) const;
+
+  /**
+   * Records the result produced for `specKey` at `position`.  A stale
+   * entry for the same spec is replaced in place; when the cache is full
+   * the entry with the oldest clock is evicted.
+   */
+  void insert(
+      const w_string& specKey,
+      const ClockPosition& position,
+      std::shared_ptr<const QueryResult> result);
+
+  /**
+   * Builds the canonical cache key for a query spec: a compact dump with
+   * sorted object keys, so that specs differing only in key order hash
+   * to the same entry.
+   */
+  static w_string keyFor(const json_ref& querySpec);
+
+ private:
+  struct Entry {
+    ClockPosition position;
+    std::shared_ptr<const QueryResult> result;
+  };
+
+  const size_t maxEntries_;
+  folly::Synchronized<std::unordered_map<w_string, Entry>> entries_;
+};
+
+} // namespace watchman
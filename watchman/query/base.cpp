@@ -9,7 +9,11 @@
 #include "watchman/query/QueryExpr.h"
 #include "watchman/query/TermRegistry.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <numeric>
 #include <queue>
 #include <unordered_set>
 #include <vector>
@@ -18,6 +22,10 @@ using namespace watchman;
 
 /* Basic boolean and compound expressions */
 
+namespace {
+std::unique_ptr<QueryExpr> makeConstantExpr(bool value);
+} // namespace
+
 class NotExpr : public QueryExpr {
   std::unique_ptr<QueryExpr> expr;
 
@@ -33,6 +41,18 @@ class NotExpr : public QueryExpr {
     return !*res;
   }
 
+  w_string_piece name() const override {
+    return "not";
+  }
+
+  void prepareForRun(QueryContextBase* ctx) override {
+    expr->prepareForRun(ctx);
+  }
+
+  void collectTermSamples(TermSampleMap& out) const override {
+    expr->collectTermSamples(out);
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query* query, const json_ref& term) {
     /* rigidly require ["not", expr] */
     if (!term.isArray() || json_array_size(term) != 2) {
@@ -41,6 +61,9 @@ class NotExpr : public QueryExpr {
 
     const auto& other = term.at(1);
     auto other_expr = parseQueryExpr(query, other);
+    if (auto value = other_expr->constantValue()) {
+      return makeConstantExpr(!*value);
+    }
     return std::make_unique<NotExpr>(std::move(other_expr));
   }
 
@@ -60,10 +83,18 @@ class TrueExpr : public QueryExpr {
     return true;
   }
 
+  w_string_piece name() const override {
+    return "true";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<TrueExpr>();
   }
 
+  std::optional<bool> constantValue() const override {
+    return true;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // We will match every path --> unbounded.
@@ -79,10 +110,18 @@ class FalseExpr : public QueryExpr {
     return false;
   }
 
+  w_string_piece name() const override {
+    return "false";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<FalseExpr>();
   }
 
+  std::optional<bool> constantValue() const override {
+    return false;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity) const override {
     // We will not match any path --> bounded by an empty list of globs.
@@ -92,38 +131,83 @@ class FalseExpr : public QueryExpr {
 
 W_TERM_PARSER(false, FalseExpr::parse);
 
+namespace {
+std::unique_ptr<QueryExpr> makeConstantExpr(bool value) {
+  if (value) {
+    return std::make_unique<TrueExpr>();
+  }
+  return std::make_unique<FalseExpr>();
+}
+} // namespace
+
 class ListExpr : public QueryExpr {
   bool allof;
   std::vector<std::unique_ptr<QueryExpr>> exprs;
 
+  // Per-term counters, indexed like `exprs`. A term is decisive when
+  // its result short-circuits the list: false fails an allof, true
+  // satisfies an anyof. Updated with relaxed atomics because the
+  // parallel evaluator runs shards of files concurrently; read and
+  // acted upon only by prepareForRun() between runs.
+  struct TermStats {
+    std::atomic<uint64_t> evals{0};
+    std::atomic<uint64_t> decisive{0};
+    std::atomic<uint64_t> sampledNanos{0};
+    std::atomic<uint64_t> samples{0};
+  };
+  std::unique_ptr<TermStats[]> stats_;
+  // Evaluation order over `exprs`; resorted by prepareForRun() once
+  // enough evaluations have accumulated. The terms are side-effect free
+  // and commutative, so any order preserves the list's result.
+  std::vector<uint32_t> order_;
+
+  // Time one term evaluation out of every (kSampleMask + 1); clock
+  // reads around every term would cost more than the cheap terms they
+  // measure.
+  static constexpr uint64_t kSampleMask = 63;
+  // Leave the user's order alone until we have seen enough evaluations
+  // to rank terms meaningfully.
+  static constexpr uint64_t kMinEvalsBeforeReorder = 256;
+
  public:
   ListExpr(bool isAll, std::vector<std::unique_ptr<QueryExpr>> exprs)
-      : allof(isAll), exprs(std::move(exprs)) {}
+      : allof(isAll),
+        exprs(std::move(exprs)),
+        stats_(new TermStats[this->exprs.size()]),
+        order_(this->exprs.size()) {
+    std::iota(order_.begin(), order_.end(), 0);
+  }
 
   EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
     bool needData = false;
 
-    for (auto& expr : exprs) {
-      auto res = expr->evaluate(ctx, file);
+    for (uint32_t idx : order_) {
+      auto& stats = stats_[idx];
+      auto evals = stats.evals.fetch_add(1, std::memory_order_relaxed);
+
+      EvaluateResult res;
+      if ((evals & kSampleMask) == 0) {
+        auto start = std::chrono::steady_clock::now();
+        res = exprs[idx]->evaluate(ctx, file);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        stats.sampledNanos.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count(),
+            std::memory_order_relaxed);
+        stats.samples.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        res = exprs[idx]->evaluate(ctx, file);
+      }
 
       if (!res.has_value()) {
         needData = true;
-      } else if (!*res) {
-        if (allof) {
-          // Return NoMatch even if we have needData set, as allof
-          // requires that all terms match and this one doesn't,
-          // so we can avoid loading the data for prior terms
-          // in this list
-          return false;
-        }
-      } else {
-        // Matched
-
-        if (!allof) {
-          // Similar to the condition above, we can short circuit loading
-          // other data if this one matches for the anyof case.
-          return true;
-        }
+      } else if (*res != allof) {
+        // This term decided the list, even if we have needData set:
+        // allof requires that all terms match and this one doesn't
+        // (and dually for anyof), so we can avoid loading the data
+        // for prior terms in this list.
+        stats.decisive.fetch_add(1, std::memory_order_relaxed);
+        return *res;
       }
     }
 
@@ -134,6 +218,56 @@ class ListExpr : public QueryExpr {
     return allof;
   }
 
+  w_string_piece name() const override {
+    return allof ? "allof" : "anyof";
+  }
+
+  void collectTermSamples(TermSampleMap& out) const override {
+    for (size_t i = 0; i < exprs.size(); ++i) {
+      auto& bucket = out[exprs[i]->name().asWString()];
+      bucket.evals += stats_[i].evals.load(std::memory_order_relaxed);
+      bucket.samples += stats_[i].samples.load(std::memory_order_relaxed);
+      bucket.sampledNanos +=
+          stats_[i].sampledNanos.load(std::memory_order_relaxed);
+      exprs[i]->collectTermSamples(out);
+    }
+  }
+
+  void prepareForRun(QueryContextBase* ctx) override {
+    for (auto& expr : exprs) {
+      expr->prepareForRun(ctx);
+    }
+
+    uint64_t totalEvals = 0;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+      totalEvals += stats_[i].evals.load(std::memory_order_relaxed);
+    }
+    if (totalEvals < kMinEvalsBeforeReorder) {
+      return;
+    }
+
+    // Rank each term by expected cost per decisive outcome: mean
+    // sampled evaluation time divided by the rate at which the term
+    // short-circuits the list. Cheap, selective terms sort first so an
+    // expensive pcre behind a type or suffix filter is rarely reached.
+    // Laplace smoothing keeps never-decisive and barely-sampled terms
+    // from producing degenerate ranks.
+    auto score = [&](uint32_t idx) {
+      auto& stats = stats_[idx];
+      auto evals = stats.evals.load(std::memory_order_relaxed);
+      auto decisive = stats.decisive.load(std::memory_order_relaxed);
+      auto samples = stats.samples.load(std::memory_order_relaxed);
+      auto nanos = stats.sampledNanos.load(std::memory_order_relaxed);
+      double meanCost = (double)(nanos + 1) / (double)(samples + 1);
+      double decisiveRate = (double)(decisive + 1) / (double)(evals + 2);
+      return meanCost / decisiveRate;
+    };
+    std::stable_sort(
+        order_.begin(), order_.end(), [&](uint32_t lhs, uint32_t rhs) {
+          return score(lhs) < score(rhs);
+        });
+  }
+
   static std::unique_ptr<QueryExpr>
   parse(Query* query, const json_ref& term, bool allof) {
     std::vector<std::unique_ptr<QueryExpr>> list;
@@ -149,11 +283,8 @@ class ListExpr : public QueryExpr {
     auto n = json_array_size(term) - 1;
     list.reserve(n);
 
-    for (size_t i = 0; i < n; i++) {
-      const auto& exp = term.at(i + 1);
-
-      auto op = allof ? AggregateOp::AllOf : AggregateOp::AnyOf;
-      auto parsed = parseQueryExpr(query, exp);
+    auto op = allof ? AggregateOp::AllOf : AggregateOp::AnyOf;
+    auto appendTerm = [&](std::unique_ptr<QueryExpr> parsed) {
       if (list.empty()) {
         list.emplace_back(std::move(parsed));
       } else {
@@ -165,6 +296,45 @@ class ListExpr : public QueryExpr {
           list.emplace_back(std::move(parsed));
         }
       }
+    };
+
+    for (size_t i = 0; i < n; i++) {
+      const auto& exp = term.at(i + 1);
+
+      auto parsed = parseQueryExpr(query, exp);
+
+      // Constant folding: identity operands drop out of the list, and an
+      // absorbing operand decides the whole list. Terms have no side
+      // effects, so skipping the remainder preserves short-circuit
+      // semantics.
+      if (auto value = parsed->constantValue()) {
+        if (*value == allof) {
+          continue;
+        }
+        return makeConstantExpr(*value);
+      }
+
+      // Flatten nested lists of the same operator so a deep
+      // allof-of-allofs evaluates as one pass over a single flat vector
+      // instead of a tree of virtual calls.
+      if (auto* nested = dynamic_cast<ListExpr*>(parsed.get());
+          nested && nested->allof == allof) {
+        for (auto& sub : nested->exprs) {
+          appendTerm(std::move(sub));
+        }
+        continue;
+      }
+
+      appendTerm(std::move(parsed));
+    }
+
+    if (list.empty()) {
+      // Every operand folded away, leaving the identity element.
+      return makeConstantExpr(allof);
+    }
+    if (list.size() == 1) {
+      // No need for the list wrapper around a single term.
+      return std::move(list.front());
     }
 
     return std::make_unique<ListExpr>(allof, std::move(list));
@@ -181,6 +351,30 @@ class ListExpr : public QueryExpr {
     return parse(query, term, false);
   }
 
+  std::optional<std::vector<w_string>> computeExactWholenames() const override {
+    if (allof) {
+      // Any one conjunct's fixed name set bounds the whole conjunction;
+      // the other conjuncts still filter during evaluation.
+      for (auto& expr : exprs) {
+        if (auto names = expr->computeExactWholenames()) {
+          return names;
+        }
+      }
+      return std::nullopt;
+    }
+
+    // anyof: the union is only fixed if every branch is.
+    std::vector<w_string> unionOfNames;
+    for (auto& expr : exprs) {
+      auto names = expr->computeExactWholenames();
+      if (!names.has_value()) {
+        return std::nullopt;
+      }
+      unionOfNames.insert(unionOfNames.end(), names->begin(), names->end());
+    }
+    return unionOfNames;
+  }
+
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity caseSensitive) const override {
     if (allof) {
@@ -5,13 +5,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "watchman/CaseOps.h"
 #include "watchman/Errors.h"
 #include "watchman/query/GlobEscaping.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/QueryExpr.h"
 #include "watchman/query/TermRegistry.h"
 #include "watchman/query/intcompare.h"
+#include "watchman/watchman_dir.h"
 
+#include <atomic>
 #include <memory>
 
 using namespace watchman;
@@ -20,27 +23,52 @@ static inline bool is_dir_sep(int c) {
   return c == '/' || c == '\\';
 }
 
+// Templated on the query's sensitivity (fixed at parse time) so that
+// the per-file comparisons below are a compile-time decision; the
+// sensitive instantiation inlines CaseOps down to plain memcmp.
+template <CaseSensitivity CS>
 class DirNameExpr : public QueryExpr {
   w_string dirname;
   struct w_query_int_compare depth;
-  using StartsWith = bool (*)(w_string_piece str, w_string_piece prefix);
-  StartsWith startswith;
-  CaseSensitivity caseSensitive;
+
+  // Resolved subtree fast path.  `resolvedDir_` is the view's directory
+  // node whose full path equals `dirname`, learned from the first file
+  // that matches by string comparison; subsequent files are then tested
+  // by walking their parent pointers, which is O(depth) pointer hops
+  // instead of O(path length) character compares.  Directory nodes are
+  // only erased by age-out, so the memo records the age-out tick it was
+  // learned under and is discarded when that tick changes.  Atomics
+  // because terms may be evaluated from several shards concurrently.
+  mutable std::atomic<const watchman_dir*> resolvedDir_{nullptr};
+  mutable std::atomic<uint32_t> resolvedAgeOutTick_{0};
 
  public:
-  explicit DirNameExpr(
-      w_string dirname,
-      struct w_query_int_compare depth,
-      CaseSensitivity caseSensitive)
-      : dirname(dirname), depth(depth), startswith(caseSensitive == CaseSensitivity::CaseInSensitive
-            ? [](w_string_piece str,
-                 w_string_piece
-                     prefix) { return str.startsWithCaseInsensitive(prefix); }
-            : [](w_string_piece str, w_string_piece prefix) {
-                return str.startsWith(prefix);
-              }), caseSensitive(caseSensitive) {}
-
-  EvaluateResult evaluate(QueryContextBase* ctx, FileResult*) override {
+  explicit DirNameExpr(w_string dirname, struct w_query_int_compare depth)
+      : dirname(dirname), depth(depth) {}
+
+  EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
+    // The ancestry test encodes exact node identity, so it is only valid
+    // for the case-sensitive term; idirname can match several distinct
+    // directory nodes.
+    const watchman_dir* parent = CS == CaseSensitivity::CaseSensitive
+        ? file->containingDir()
+        : nullptr;
+    if (parent) {
+      auto* resolved = resolvedDir_.load(std::memory_order_acquire);
+      if (resolved &&
+          resolvedAgeOutTick_.load(std::memory_order_acquire) ==
+              ctx->lastAgeOutTickValueAtStartOfQuery) {
+        json_int_t actual_depth = 0;
+        for (const watchman_dir* d = parent; d; d = d->parent) {
+          if (d == resolved) {
+            return eval_int_compare(actual_depth, &depth);
+          }
+          ++actual_depth;
+        }
+        return false;
+      }
+    }
+
     auto& str = ctx->getWholeName();
 
     if (str.size() <= dirname.size()) {
@@ -60,7 +88,7 @@ class DirNameExpr : public QueryExpr {
       return false;
     }
 
-    if (!startswith(str, dirname)) {
+    if (!CaseOps<CS>::startsWith(str, dirname)) {
       return false;
     }
 
@@ -73,78 +101,27 @@ class DirNameExpr : public QueryExpr {
       }
     }
 
-    return eval_int_compare(actual_depth, &depth);
-  }
-
-  // ["dirname", "foo"] -> ["dirname", "foo", ["depth", "ge", 0]]
-  static std::unique_ptr<QueryExpr>
-  parse(Query*, const json_ref& term, CaseSensitivity case_sensitive) {
-    const char* which = case_sensitive == CaseSensitivity::CaseInSensitive
-        ? "idirname"
-        : "dirname";
-    struct w_query_int_compare depth_comp;
-
-    if (!term.isArray()) {
-      QueryParseError::throwf("Expected array for '{}' term", which);
-    }
-
-    if (json_array_size(term) < 2) {
-      QueryParseError::throwf(
-          "Invalid number of arguments for '{}' term", which);
-    }
-
-    if (json_array_size(term) > 3) {
-      QueryParseError::throwf(
-          "Invalid number of arguments for '{}' term", which);
-    }
-
-    const auto& name = term.at(1);
-    if (!name.isString()) {
-      QueryParseError::throwf("Argument 2 to '{}' must be a string", which);
-    }
-
-    if (json_array_size(term) == 3) {
-      const auto& depth = term.at(2);
-      if (!depth.isArray()) {
-        QueryParseError::throwf(
-            "Invalid number of arguments for '{}' term", which);
+    if (parent) {
+      // This file's parent is `actual_depth` levels below the dirname
+      // node; walk up to it and remember it so that later files can be
+      // tested by ancestry alone.  Concurrent learners all derive the
+      // same node, so the stores never conflict within a run.
+      const watchman_dir* d = parent;
+      for (json_int_t i = 0; d && i < actual_depth; ++i) {
+        d = d->parent;
       }
-
-      const auto& depth_array = depth.array();
-
-      parse_int_compare(depth, &depth_comp);
-
-      if (strcmp("depth", json_string_value(depth_array.at(0)))) {
-        QueryParseError::throwf(
-            "Third parameter to '{}' should be a relational depth term", which);
+      if (d) {
+        resolvedAgeOutTick_.store(
+            ctx->lastAgeOutTickValueAtStartOfQuery, std::memory_order_release);
+        resolvedDir_.store(d, std::memory_order_release);
       }
-    } else {
-      depth_comp.operand = 0;
-      depth_comp.op = W_QUERY_ICMP_GE;
-    }
-
-    w_string dirname = json_to_w_string(name);
-    auto view = dirname.view();
-    auto last_not_slash = view.find_last_not_of('/');
-    w_string trimmed_dirname;
-    if (last_not_slash == std::string_view::npos) {
-      trimmed_dirname = dirname;
-    } else {
-      trimmed_dirname = w_string{view.substr(0, last_not_slash + 1)};
     }
 
-    return std::make_unique<DirNameExpr>(
-        std::move(trimmed_dirname), depth_comp, case_sensitive);
-  }
-  static std::unique_ptr<QueryExpr> parseDirName(
-      Query* query,
-      const json_ref& term) {
-    return parse(query, term, query->case_sensitive);
+    return eval_int_compare(actual_depth, &depth);
   }
-  static std::unique_ptr<QueryExpr> parseIDirName(
-      Query* query,
-      const json_ref& term) {
-    return parse(query, term, CaseSensitivity::CaseInSensitive);
+
+  w_string_piece name() const override {
+    return CS == CaseSensitivity::CaseInSensitive ? "idirname" : "dirname";
   }
 
   std::optional<std::vector<std::string>> computeGlobUpperBound(
@@ -154,7 +131,7 @@ class DirNameExpr : public QueryExpr {
     // bound elsewhere in the query, so for simplicity we avoid depth bounds
     // right now.
 
-    if (caseSensitive == CaseSensitivity::CaseInSensitive &&
+    if (CS == CaseSensitivity::CaseInSensitive &&
         outputCaseSensitive != CaseSensitivity::CaseInSensitive) {
       // The caller asked for a case-sensitive upper bound, so treat idirname as
       // unbounded.
@@ -169,15 +146,92 @@ class DirNameExpr : public QueryExpr {
     // literal character, and is therefore escaped.
     w_string outputPattern = convertLiteralPathToGlob(dirname);
     if (outputCaseSensitive == CaseSensitivity::CaseInSensitive) {
-      outputPattern = outputPattern.piece().asLowerCase();
+      outputPattern = outputPattern.asLowerCase();
     }
 
     return std::vector<std::string>{outputPattern.string() + "/**"};
   }
 };
 
-W_TERM_PARSER(dirname, DirNameExpr::parseDirName);
-W_TERM_PARSER(idirname, DirNameExpr::parseIDirName);
+// ["dirname", "foo"] -> ["dirname", "foo", ["depth", "ge", 0]]
+static std::unique_ptr<QueryExpr>
+parse_dirname(Query*, const json_ref& term, CaseSensitivity case_sensitive) {
+  const char* which = case_sensitive == CaseSensitivity::CaseInSensitive
+      ? "idirname"
+      : "dirname";
+  struct w_query_int_compare depth_comp;
+
+  if (!term.isArray()) {
+    QueryParseError::throwf("Expected array for '{}' term", which);
+  }
+
+  if (json_array_size(term) < 2) {
+    QueryParseError::throwf(
+        "Invalid number of arguments for '{}' term", which);
+  }
+
+  if (json_array_size(term) > 3) {
+    QueryParseError::throwf(
+        "Invalid number of arguments for '{}' term", which);
+  }
+
+  const auto& name = term.at(1);
+  if (!name.isString()) {
+    QueryParseError::throwf("Argument 2 to '{}' must be a string", which);
+  }
+
+  if (json_array_size(term) == 3) {
+    const auto& depth = term.at(2);
+    if (!depth.isArray()) {
+      QueryParseError::throwf(
+          "Invalid number of arguments for '{}' term", which);
+    }
+
+    const auto& depth_array = depth.array();
+
+    parse_int_compare(depth, &depth_comp);
+
+    if (strcmp("depth", json_string_value(depth_array.at(0)))) {
+      QueryParseError::throwf(
+          "Third parameter to '{}' should be a relational depth term", which);
+    }
+  } else {
+    depth_comp.operand = 0;
+    depth_comp.op = W_QUERY_ICMP_GE;
+  }
+
+  w_string dirname = json_to_w_string(name);
+  auto view = dirname.view();
+  auto last_not_slash = view.find_last_not_of('/');
+  w_string trimmed_dirname;
+  if (last_not_slash == std::string_view::npos) {
+    trimmed_dirname = dirname;
+  } else {
+    trimmed_dirname = w_string{view.substr(0, last_not_slash + 1)};
+  }
+
+  if (case_sensitive == CaseSensitivity::CaseInSensitive) {
+    return std::make_unique<DirNameExpr<CaseSensitivity::CaseInSensitive>>(
+        std::move(trimmed_dirname), depth_comp);
+  }
+  return std::make_unique<DirNameExpr<CaseSensitivity::CaseSensitive>>(
+      std::move(trimmed_dirname), depth_comp);
+}
+
+static std::unique_ptr<QueryExpr> parseDirName(
+    Query* query,
+    const json_ref& term) {
+  return parse_dirname(query, term, query->case_sensitive);
+}
+
+static std::unique_ptr<QueryExpr> parseIDirName(
+    Query* query,
+    const json_ref& term) {
+  return parse_dirname(query, term, CaseSensitivity::CaseInSensitive);
+}
+
+W_TERM_PARSER(dirname, parseDirName);
+W_TERM_PARSER(idirname, parseIDirName);
 
 /* vim:ts=2:sw=2:et:
  */
@@ -21,6 +21,10 @@ class ExistsExpr : public QueryExpr {
     return file->exists();
   }
 
+  w_string_piece name() const override {
+    return "exists";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<ExistsExpr>();
   }
@@ -62,6 +66,10 @@ class EmptyExpr : public QueryExpr {
     return false;
   }
 
+  w_string_piece name() const override {
+    return "empty";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref&) {
     return std::make_unique<EmptyExpr>();
   }
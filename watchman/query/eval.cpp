@@ -8,15 +8,25 @@
 #include "watchman/query/eval.h"
 #include <fmt/chrono.h>
 #include <folly/ScopeGuard.h>
+#include <folly/synchronization/Baton.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "watchman/CommandRegistry.h"
+#include "watchman/MemoryAccounting.h"
+#include "watchman/MemoryBudget.h"
+#include "watchman/ThreadPool.h"
+#include "watchman/TraceSpan.h"
 #include "watchman/Errors.h"
 #include "watchman/PerfSample.h"
 #include "watchman/QueryableView.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/LocalFileResult.h"
+#include "watchman/query/MatchedSetCache.h"
 #include "watchman/query/Query.h"
 #include "watchman/query/QueryContext.h"
+#include "watchman/query/QueryResultCache.h"
 #include "watchman/root/Root.h"
 #include "watchman/saved_state/SavedStateInterface.h"
 #include "watchman/scm/SCM.h"
@@ -45,6 +55,144 @@ const std::vector<w_string>& getUnconditionalLogFilePrefixes() {
       computeUnconditionalLogFilePrefixes();
   return names;
 }
+// Copy the render metadata for ctx->file into the matched-set capture
+// vector.  Every field renderer other than symlink_target and
+// content.sha1hex is a pure function of this data, so a later query
+// differing only in field list can render from the copy.  A result
+// type that cannot serve its metadata synchronously (LocalFileResult
+// before its batch fetch) aborts the capture rather than deferring.
+void captureMatchedFile(QueryContext* ctx) {
+  auto* file = ctx->file.get();
+  auto stat = file->stat();
+  auto exists = file->exists();
+  auto ctime = file->ctime();
+  auto otime = file->otime();
+  if (!stat.has_value() || !exists.has_value() || !ctime.has_value() ||
+      !otime.has_value()) {
+    ctx->matchedSetCapture = nullptr;
+    return;
+  }
+  ctx->matchedSetCapture->push_back(MatchedFile{
+      w_string::build(file->dirName(), "/", file->baseName()),
+      *stat,
+      *exists,
+      *ctime,
+      *otime});
+}
+
+// Emit ctx->file, which has already matched the query expression, into
+// the result set, applying dedup and unconditional-prefix logging.
+void emitMatchedFile(QueryContext* ctx) {
+  if (ctx->query->dedup_results) {
+    auto name = ctx->getWholeName();
+
+    auto inserted = ctx->dedup.insert(name);
+    if (!inserted.second) {
+      // Already present in the results, no need to emit it again
+      ctx->num_deduped++;
+      return;
+    }
+  }
+
+  auto logPrefixes = getUnconditionalLogFilePrefixes();
+  if (!logPrefixes.empty()) {
+    auto name = ctx->getWholeName();
+    for (auto& prefix : logPrefixes) {
+      if (name.piece().startsWith(prefix)) {
+        ctx->namesToLog.push_back(name);
+      }
+    }
+  }
+
+  if (ctx->matchedSetCapture) {
+    captureMatchedFile(ctx);
+  }
+
+  ctx->maybeRender(std::move(ctx->file));
+}
+
+/**
+ * A FileResult replaying one MatchedFile from a cached matched set.
+ * All metadata is available immediately; the two lazily fetched
+ * properties (content hash, symlink target) are never captured and the
+ * eligibility test in w_query_execute() keeps field lists that want
+ * them away from this path.
+ */
+class SnapshotFileResult final : public FileResult {
+ public:
+  explicit SnapshotFileResult(const MatchedFile& file) : file_{file} {}
+
+  std::optional<FileInformation> stat() override {
+    return file_.stat;
+  }
+  std::optional<struct timespec> accessedTime() override {
+    return file_.stat.atime;
+  }
+  std::optional<struct timespec> modifiedTime() override {
+    return file_.stat.mtime;
+  }
+  std::optional<struct timespec> changedTime() override {
+    return file_.stat.ctime;
+  }
+  std::optional<size_t> size() override {
+    return file_.stat.size;
+  }
+  w_string_piece baseName() override {
+    return file_.fullPath.piece().baseName();
+  }
+  w_string_piece dirName() override {
+    return file_.fullPath.piece().dirName();
+  }
+  std::optional<bool> exists() override {
+    return file_.exists;
+  }
+  std::optional<ResolvedSymlink> readLink() override {
+    // Unreachable while the eligibility test holds; never claim a
+    // target we did not capture.
+    throw std::runtime_error("symlink target not captured in matched set");
+  }
+  std::optional<ClockStamp> ctime() override {
+    return file_.ctime;
+  }
+  std::optional<ClockStamp> otime() override {
+    return file_.otime;
+  }
+  std::optional<ContentHash> getContentSha1() override {
+    // As with readLink(); make_sha1_hex() would render this as an
+    // error object rather than wrong data if it were ever reached.
+    throw std::runtime_error("content hash not captured in matched set");
+  }
+  void batchFetchProperties(
+      const std::vector<std::unique_ptr<FileResult>>& files) override {
+    for (auto& f : files) {
+      static_cast<SnapshotFileResult*>(f.get())->clearNeededProperties();
+    }
+  }
+
+ private:
+  // Refers into the shared snapshot vector, which the caller keeps
+  // alive for the duration of the render.
+  const MatchedFile& file_;
+};
+
+// Renders a cached matched set through the normal emission path, so
+// dedup, prefix logging and render batching behave exactly as they
+// would had the files come from a generator.
+void renderMatchedSet(QueryContext& ctx, const std::vector<MatchedFile>& files) {
+  ctx.state = QueryContextState::Rendering;
+  for (auto& matched : files) {
+    ctx.checkDeadline();
+    ctx.resetWholeName();
+    ctx.file = std::make_unique<SnapshotFileResult>(matched);
+    emitMatchedFile(&ctx);
+    ctx.file.reset();
+  }
+  while (!ctx.fetchRenderBatchNow()) {
+    // Loop as execute_common does; snapshot results resolve in one
+    // pass, but the contract allows several.
+  }
+}
+
 } // namespace
 
 /* Query evaluator */
@@ -52,6 +200,10 @@ void w_query_process_file(
     const Query* query,
     QueryContext* ctx,
     std::unique_ptr<FileResult> file) {
+  // Every generator and both batch paths emit through here, so this one
+  // hook covers deadline and client-disconnect checks for all of them.
+  ctx->checkDeadline();
+
   // TODO: Should this be implicit by assigning a file to the QueryContext? It
   // could be cleared when resetting the file.
   ctx->resetWholeName();
@@ -60,15 +212,16 @@ void w_query_process_file(
     ctx->file.reset();
   };
 
-  // For fresh instances, only return files that currently exist
+  // For fresh instances, only return files that currently exist.
+  // The in-memory generators pre-filter deleted nodes when
+  // onlyReturnsExistingFiles() holds, so this clause is the backstop
+  // for views and generators that do not.
   // TODO: shift this clause to execute_common and generate
   // a wrapped query: ["allof", "exists", EXPR] and execute that
   // instead of query->expr so that the lazy evaluation logic can
   // be automatically applied and avoid fetching the exists flag
   // for every file.  See also related TODO in batchFetchNow.
-  if (!ctx->disableFreshInstance &&
-      std::holds_alternative<QuerySince::Clock>(ctx->since.since) &&
-      std::get<QuerySince::Clock>(ctx->since.since).is_fresh_instance) {
+  if (ctx->onlyReturnsExistingFiles()) {
     auto exists = ctx->file->exists();
     if (!exists.has_value()) {
       // Reconsider this one later
@@ -83,7 +236,22 @@ void w_query_process_file(
   // We produce an output for this file if there is no expression,
   // or if the expression matched.
   if (query->expr) {
-    auto match = query->expr->evaluate(ctx, ctx->file.get());
+    EvaluateResult match;
+    if (query->debug_profile_terms &&
+        (ctx->rootTermSample.evals++ & 63) == 0) {
+      // Time one evaluation in 64, mirroring the sampling rate the
+      // list terms use internally; clock reads around every file would
+      // distort the cheap terms being measured.
+      auto start = std::chrono::steady_clock::now();
+      match = query->expr->evaluate(ctx, ctx->file.get());
+      ctx->rootTermSample.sampledNanos +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      ++ctx->rootTermSample.samples;
+    } else {
+      match = query->expr->evaluate(ctx, ctx->file.get());
+    }
 
     if (!match.has_value()) {
       // Reconsider this one later
@@ -94,28 +262,162 @@ void w_query_process_file(
     }
   }
 
-  if (ctx->query->dedup_results) {
-    auto name = ctx->getWholeName();
+  emitMatchedFile(ctx);
+}
 
-    auto inserted = ctx->dedup.insert(name);
-    if (!inserted.second) {
-      // Already present in the results, no need to emit it again
-      ctx->num_deduped++;
-      return;
+namespace {
+
+/**
+ * Minimal per-shard context used to evaluate expression terms off the
+ * query thread. Terms only consult the clock fields and getWholeName(),
+ * both of which are safe to serve without touching the parent context's
+ * mutable state.
+ */
+class ShardEvalContext final : public QueryContextBase {
+ public:
+  explicit ShardEvalContext(const QueryContext& parent) : parent_{parent} {
+    clockAtStartOfQuery = parent.clockAtStartOfQuery;
+    lastAgeOutTickValueAtStartOfQuery =
+        parent.lastAgeOutTickValueAtStartOfQuery;
+  }
+
+  void setFile(FileResult* file) {
+    file_ = file;
+    wholename_.reset();
+  }
+
+  const w_string& getWholeName() override {
+    if (!wholename_) {
+      wholename_ = parent_.computeWholeName(file_);
     }
+    return *wholename_;
   }
 
-  auto logPrefixes = getUnconditionalLogFilePrefixes();
-  if (!logPrefixes.empty()) {
-    auto name = ctx->getWholeName();
-    for (auto& prefix : logPrefixes) {
-      if (name.piece().startsWith(prefix)) {
-        ctx->namesToLog.push_back(name);
-      }
+ private:
+  const QueryContext& parent_;
+  FileResult* file_{nullptr};
+  std::optional<w_string> wholename_;
+};
+
+// Don't bother spinning up a shard for fewer files than this.
+constexpr size_t kMinFilesPerShard = 8192;
+
+} // namespace
+
+void w_query_process_file_parallel(
+    const Query* query,
+    QueryContext* ctx,
+    std::vector<std::unique_ptr<FileResult>>& files) {
+  enum Verdict : int8_t { kNoMatch, kMatch, kNeedMore };
+
+  const size_t n = files.size();
+  size_t shardCount = std::min<size_t>(
+      std::max<size_t>(std::thread::hardware_concurrency(), 1),
+      (n + kMinFilesPerShard - 1) / kMinFilesPerShard);
+
+  // Profiled queries stay on the serial path: the root-term sampler in
+  // w_query_process_file is unsynchronized, and attributing samples
+  // taken on shard threads would muddy the numbers anyway.
+  if (!query->expr || shardCount < 2 || query->debug_profile_terms) {
+    for (auto& file : files) {
+      w_query_process_file(query, ctx, std::move(file));
     }
+    files.clear();
+    return;
   }
 
-  ctx->maybeRender(std::move(ctx->file));
+  const bool freshInstanceOnly = !ctx->disableFreshInstance &&
+      std::holds_alternative<QuerySince::Clock>(ctx->since.since) &&
+      std::get<QuerySince::Clock>(ctx->since.since).is_fresh_instance;
+
+  std::vector<int8_t> verdicts(n, kNeedMore);
+  const size_t perShard = (n + shardCount - 1) / shardCount;
+  std::atomic<size_t> completedShards{0};
+  folly::Baton<> done;
+
+  // Shared-owned because a helper task can outlive this frame: once
+  // every shard is claimed, the last completer posts `done` and this
+  // function returns while late helpers may still be starting up.
+  // Such a helper touches only the claim counter before exiting;
+  // everything captured by reference is reached solely through a
+  // successful claim, which implies the frame is still waiting.
+  auto nextShard = std::make_shared<std::atomic<size_t>>(0);
+
+  auto runShards = [&, nextShard, shardCount] {
+    while (true) {
+      const size_t shard = nextShard->fetch_add(1, std::memory_order_relaxed);
+      if (shard >= shardCount) {
+        return;
+      }
+      const size_t begin = shard * perShard;
+      const size_t end = std::min(n, begin + perShard);
+      ShardEvalContext sctx{*ctx};
+      for (size_t i = begin; i < end; ++i) {
+        FileResult* file = files[i].get();
+        sctx.setFile(file);
+        try {
+          if (freshInstanceOnly) {
+            auto exists = file->exists();
+            if (!exists.has_value()) {
+              // Stays kNeedMore; the serial pass will batch-fetch it.
+              continue;
+            }
+            if (!exists.value()) {
+              verdicts[i] = kNoMatch;
+              continue;
+            }
+          }
+          auto match = query->expr->evaluate(&sctx, file);
+          verdicts[i] =
+              match.has_value() ? (*match ? kMatch : kNoMatch) : kNeedMore;
+        } catch (const std::exception&) {
+          // Leave as kNeedMore so the re-evaluation on the query thread
+          // surfaces the error deterministically.
+        }
+      }
+      if (completedShards.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+          shardCount) {
+        done.post();
+      }
+    }
+  };
+
+  // Shards are claimed from the shared counter and the calling thread
+  // works through them alongside the pool, so progress never depends
+  // on pool capacity: several queries blocked here could otherwise
+  // occupy every worker while their helper tasks sit queued behind
+  // them, a pool-wide deadlock.  A helper that arrives after all
+  // shards are claimed exits immediately.
+  for (size_t i = 1; i < shardCount; ++i) {
+    try {
+      getThreadPool().add(runShards);
+    } catch (const std::exception&) {
+      // Pool is saturated or stopped; the loop below covers every
+      // shard regardless.
+      break;
+    }
+  }
+  runShards();
+  done.wait();
+
+  // Merge in generator order on the query thread so dedup and rendering
+  // observe the same sequence as the serial path.
+  for (size_t i = 0; i < n; ++i) {
+    switch (verdicts[i]) {
+      case kNoMatch:
+        break;
+      case kMatch:
+        ctx->resetWholeName();
+        ctx->file = std::move(files[i]);
+        emitMatchedFile(ctx);
+        ctx->file.reset();
+        break;
+      case kNeedMore:
+        w_query_process_file(query, ctx, std::move(files[i]));
+        break;
+    }
+  }
+  files.clear();
 }
 
 void time_generator(
@@ -142,7 +444,10 @@ static void default_generators(
     generated = true;
   }
 
-  if (query->glob_tree) {
+  if (query->suffixes) {
+    root->view()->suffixGenerator(query, ctx);
+    generated = true;
+  } else if (query->glob_tree) {
     root->view()->globGenerator(query, ctx);
     generated = true;
   }
@@ -154,6 +459,69 @@ static void default_generators(
   }
 }
 
+namespace watchman {
+
+json_ref explainQueryPlan(const Query& query) {
+  // Mirrors the selection order in default_generators above; keep the
+  // two in sync.
+  std::vector<json_ref> generators;
+
+  if (query.since_spec) {
+    generators.push_back(json_object(
+        {{"generator", typed_string_to_json("time")},
+         {"note",
+          typed_string_to_json(
+              "walks files in recency order; a fresh instance walks "
+              "all files instead")}}));
+  }
+
+  if (query.paths.has_value()) {
+    std::vector<json_ref> paths;
+    paths.reserve(query.paths->size());
+    for (auto& path : *query.paths) {
+      paths.push_back(json_object(
+          {{"path", w_string_to_json(path.name)},
+           {"depth", json_integer(path.depth)}}));
+    }
+    generators.push_back(json_object(
+        {{"generator", typed_string_to_json("path")},
+         {"paths", json_array(std::move(paths))}}));
+  }
+
+  if (query.suffixes) {
+    std::vector<json_ref> suffixes;
+    suffixes.reserve(query.suffixes->size());
+    for (auto& suffix : *query.suffixes) {
+      suffixes.push_back(w_string_to_json(suffix));
+    }
+    generators.push_back(json_object(
+        {{"generator", typed_string_to_json("suffix")},
+         {"suffixes", json_array(std::move(suffixes))}}));
+  } else if (query.glob_tree) {
+    std::vector<json_ref> globs;
+    for (auto& glob : query.glob_tree->unparse()) {
+      globs.push_back(typed_string_to_json(glob.c_str(), W_STRING_UNICODE));
+    }
+    generators.push_back(json_object(
+        {{"generator", typed_string_to_json("glob")},
+         {"globs", json_array(std::move(globs))}}));
+  }
+
+  if (generators.empty()) {
+    generators.push_back(json_object(
+        {{"generator", typed_string_to_json("all-files")},
+         {"note", typed_string_to_json("walks every file in the view")}}));
+  }
+
+  auto ret = json_object({{"generators", json_array(std::move(generators))}});
+  if (!query.plannerInfo.empty()) {
+    ret.set("planned", w_string_to_json(query.plannerInfo));
+  }
+  return ret;
+}
+
+} // namespace watchman
+
 static void execute_common(
     QueryContext* ctx,
     PerfSample* sample,
@@ -161,6 +529,13 @@ static void execute_common(
     QueryGenerator generator) {
   ctx->stopWatch.reset();
 
+  if (ctx->query->expr) {
+    // No evaluations are in flight between runs of a subscription or
+    // trigger query, so adaptive expressions may retune themselves here
+    // from statistics gathered on previous runs.
+    ctx->query->expr->prepareForRun(ctx);
+  }
+
   if (ctx->query->dedup_results) {
     ctx->dedup.reserve(64);
   }
@@ -172,6 +547,7 @@ static void execute_common(
   }
 
   if (!(res->isFreshInstance && ctx->query->empty_on_fresh_instance)) {
+    TraceSpan span{w_string{"query:generate"}};
     if (!generator) {
       generator = default_generators;
     }
@@ -180,14 +556,17 @@ static void execute_common(
   ctx->generationDuration = ctx->stopWatch.lap();
   ctx->state = QueryContextState::Rendering;
 
-  // We may have some file results pending re-evaluation,
-  // so make sure that we process them before we get to
-  // the render phase below.
-  ctx->fetchEvalBatchNow();
-  while (!ctx->fetchRenderBatchNow()) {
-    // Depending on the implementation of the query terms and
-    // the field renderers, we may need to do a couple of fetches
-    // to get all that we need, so we loop until we get them all.
+  {
+    // We may have some file results pending re-evaluation,
+    // so make sure that we process them before we get to
+    // the render phase below.
+    TraceSpan span{w_string{"query:render"}};
+    ctx->fetchEvalBatchNow();
+    while (!ctx->fetchRenderBatchNow()) {
+      // Depending on the implementation of the query terms and
+      // the field renderers, we may need to do a couple of fetches
+      // to get all that we need, so we loop until we get them all.
+    }
   }
 
   ctx->renderDuration = ctx->stopWatch.lap();
@@ -220,12 +599,41 @@ static void execute_common(
     sample->force_log();
   }
 
+  if (sample && ctx->query->debug_profile_terms && ctx->query->expr) {
+    TermSampleMap buckets;
+    {
+      auto& rootBucket = buckets[ctx->query->expr->name().asWString()];
+      rootBucket.evals += ctx->rootTermSample.evals;
+      rootBucket.samples += ctx->rootTermSample.samples;
+      rootBucket.sampledNanos += ctx->rootTermSample.sampledNanos;
+    }
+    ctx->query->expr->collectTermSamples(buckets);
+
+    auto terms = json_object();
+    for (auto& [termName, bucket] : buckets) {
+      terms.set(
+          termName,
+          json_object(
+              {{"evals", json_integer(bucket.evals)},
+               {"samples", json_integer(bucket.samples)},
+               {"sampled_total_ns", json_integer(bucket.sampledNanos)},
+               {"est_ns_per_eval",
+                json_integer(
+                    bucket.samples ? bucket.sampledNanos / bucket.samples
+                                   : 0)}}));
+    }
+    sample->add_meta("term_samples", std::move(terms));
+    // The profile is the point of the run; don't let the perf sample
+    // thresholds discard it.
+    sample->force_log();
+  }
+
   if (sample && sample->finish()) {
     ctx->root->addPerfSampleMetadata(*sample);
     auto meta = json_object({
         {"fresh_instance", json_boolean(res->isFreshInstance)},
         {"num_deduped", json_integer(ctx->num_deduped)},
-        {"num_results", json_integer(ctx->resultsArray.size())},
+        {"num_results", json_integer(ctx->numEmittedResults())},
         {"num_walked", json_integer(ctx->getNumWalked())},
     });
     if (ctx->query->query_spec) {
@@ -237,6 +645,7 @@ static void execute_common(
 
   res->resultsArray = ctx->renderResults();
   res->dedupedFileNames = std::move(ctx->dedup);
+  res->isLimited = ctx->hitResultLimit;
 }
 
 // Capability indicating support for scm-aware since queries
@@ -246,12 +655,28 @@ QueryResult w_query_execute(
     const Query* query,
     const std::shared_ptr<Root>& root,
     QueryGenerator generator,
-    SavedStateFactory savedStateFactory) {
+    SavedStateFactory savedStateFactory,
+    QueryContextScratch* scratch,
+    std::function<bool()> clientGoneProbe,
+    BserRenderSink* renderSink) {
   QueryResult res;
   ClockSpec resultClock(ClockPosition{});
   bool disableFreshInstance{false};
   auto requestId = query->request_id;
 
+  // Everything json built while evaluating — rendered rows especially —
+  // is attributed to the query subsystem in debug-memory.
+  MemoryScope memScope{MemorySubsystem::Query};
+  // Admission against the global memory budget: an over-budget daemon
+  // queues new queries behind the running ones (and eventually rejects
+  // them) instead of stacking more result sets on a swollen heap.
+  QueryMemoryAdmission admission;
+  // Caller-supplied generators (e.g. triggers feeding a specific file
+  // list) produce results that are not a pure function of the spec, so
+  // they are never cached.  Note this before the scm/omit_changed_files
+  // paths below reassign `generator`.
+  const bool callerSuppliedGenerator = generator != nullptr;
+
   PerfSample sample("query_execute");
   if (requestId && !requestId->empty()) {
     log(DBG, "request_id = ", *requestId, "\n");
@@ -378,7 +803,16 @@ QueryResult w_query_execute(
     generator = [](const Query*, const std::shared_ptr<Root>&, QueryContext*) {
     };
   }
-  QueryContext ctx{query, root, disableFreshInstance};
+  QueryContext ctx{query, root, disableFreshInstance, scratch};
+  if (query->query_timeout) {
+    // The deadline covers everything from here on: sync_timeout bounds
+    // only the cookie sync, while this bounds the evaluation after it.
+    ctx.deadline = std::chrono::steady_clock::now() + *query->query_timeout;
+  }
+  ctx.clientGoneProbe = std::move(clientGoneProbe);
+  // Sorting needs the full rendered set in hand, so an order_by query
+  // keeps its rows in DOM form rather than streaming them into a sink.
+  ctx.renderSink = query->order_by ? nullptr : renderSink;
 
   // Track the query against the root.
   // This is to enable the `watchman debug-status` diagnostic command.
@@ -398,10 +832,37 @@ QueryResult w_query_execute(
           query->settle_timeouts->settle_timeout);
     }
   }
-  if (query->sync_timeout.count()) {
+  // Let the view queue up crawls of any lazily-materialized subtrees
+  // this query touches; the cookie sync below then waits them out.
+  root->view()->prepareForQuery(*query);
+
+  // Cold start: during the initial crawl, a query scoped under a
+  // relative_root becomes answerable as soon as the crawl has covered
+  // that subtree (hinted subtrees are crawled first; see fullCrawl),
+  // rather than waiting out the entire tree.  The wait is bounded like
+  // the cookie sync it stands in front of.
+  if (query->sync_timeout.count() && !query->stale_ok &&
+      !root->inner.done_initial.load(std::memory_order_acquire)) {
+    auto ready = root->view()->waitUntilReadyToQuery(
+        query->relative_root ? *query->relative_root : root->root_path);
+    try {
+      std::move(ready).get(query->sync_timeout);
+    } catch (const folly::FutureTimeout&) {
+      QueryExecError::throwf(
+          "timed out waiting for the initial crawl to cover this query's "
+          "scope in {}",
+          query->sync_timeout);
+    }
+  }
+
+  // Stale-tolerant callers opt out of the cookie round trip entirely;
+  // the clock captured below tells them the position they were served
+  // at so they can reconcile with a later `since` query.
+  if (query->sync_timeout.count() && !query->stale_ok) {
     ctx.state = QueryContextState::WaitingForCookieSync;
     ctx.stopWatch.reset();
     try {
+      TraceSpan span{w_string{"query:sync"}};
       auto result = root->syncToNow(query->sync_timeout);
       res.debugInfo.cookieFileNames = std::move(result.cookieFileNames);
     } catch (const std::exception& exc) {
@@ -432,6 +893,31 @@ QueryResult w_query_execute(
   std::get<ClockSpec::Clock>(res.clockAtStartOfQuery.spec) =
       std::get<ClockSpec::Clock>(ctx.clockAtStartOfQuery.spec);
 
+  // Identical specs arrive repeatedly from different tools between
+  // settles.  When the clock has not moved since we last answered the
+  // same spec, the result is guaranteed identical, so serve it from the
+  // per-root cache.  SCM-aware queries depend on state outside the view
+  // and named cursors advance on evaluation, so both are excluded.
+  const bool cacheable = root->queryCache.enabled() && query->query_spec &&
+      !callerSuppliedGenerator && query->bench_iterations == 0 &&
+      !(query->since_spec &&
+        (query->since_spec->hasScmParams() ||
+         std::holds_alternative<ClockSpec::NamedCursor>(
+             query->since_spec->spec)));
+  w_string cacheKey;
+  if (cacheable) {
+    cacheKey = QueryResultCache::keyFor(*query->query_spec);
+    if (auto cached = root->queryCache.lookup(
+            cacheKey, ctx.clockAtStartOfQuery.position())) {
+      log(DBG, "query cache hit at ", ctx.clockAtStartOfQuery.position().ticks, "\n");
+      // The entry stays shared inside the cache; take our own copy out
+      // here since callers consume and mutate their result.  The copy
+      // shares the rendered row nodes by refcount, so its cost is the
+      // vector of refs rather than the rendered data.
+      return QueryResult{*cached};
+    }
+  }
+
   // Evaluate the cursor for this root
   ctx.since = query->since_spec ? query->since_spec->evaluate(
                                       ctx.clockAtStartOfQuery.position(),
@@ -439,6 +925,51 @@ QueryResult w_query_execute(
                                       &root->inner.cursors)
                                 : QuerySince{};
 
+  // After one settle, several clients commonly issue the same since
+  // query with different field lists.  The field list only affects
+  // rendering, so those evaluations share a single matched-set
+  // snapshot: the first records it, the rest render straight from it.
+  // Paged queries are excluded because their truncation point depends
+  // on evaluation order, and fresh instances because their result is
+  // the whole view rather than a settle-sized delta.
+  std::vector<MatchedFile> capturedMatches;
+  w_string matchedSetKey;
+  if (cacheable && root->matchedSetCache.enabled() &&
+      !query->result_limit.has_value()) {
+    auto* sinceClock = std::get_if<QuerySince::Clock>(&ctx.since.since);
+    if (sinceClock && !sinceClock->is_fresh_instance) {
+      matchedSetKey = MatchedSetCache::keyFor(*query->query_spec);
+      // Content hashes and symlink targets are fetched lazily and are
+      // not captured in the snapshot, so field lists that want them
+      // take the full evaluation path.
+      const bool fieldsRenderable =
+          !query->fieldList.indexOf("symlink_target").has_value() &&
+          !query->fieldList.indexOf("content.sha1hex").has_value();
+      if (fieldsRenderable) {
+        if (auto matched = root->matchedSetCache.lookup(
+                matchedSetKey, ctx.clockAtStartOfQuery.position())) {
+          log(DBG,
+              "matched-set cache hit at ",
+              ctx.clockAtStartOfQuery.position().ticks,
+              "\n");
+          renderMatchedSet(ctx, *matched);
+          ctx.state = QueryContextState::Completed;
+          res.resultsArray = ctx.renderResults();
+          res.dedupedFileNames = std::move(ctx.dedup);
+          res.isFreshInstance = false;
+          if (!res.resultsArray.preencoded) {
+            root->queryCache.insert(
+                cacheKey,
+                ctx.clockAtStartOfQuery.position(),
+                std::make_shared<const QueryResult>(res));
+          }
+          return res;
+        }
+      }
+      ctx.matchedSetCapture = &capturedMatches;
+    }
+  }
+
   if (query->bench_iterations > 0) {
     for (uint32_t i = 0; i < query->bench_iterations; ++i) {
       QueryContext c{query, root, ctx.disableFreshInstance};
@@ -450,6 +981,37 @@ QueryResult w_query_execute(
   }
 
   execute_common(&ctx, &sample, &res, generator);
+
+  // When the page was truncated, rewind the returned clock to the last
+  // fully-evaluated tick so that re-issuing the query with it as the
+  // since parameter resumes at the next page.
+  if (res.isLimited && ctx.lastTickGenerated != 0) {
+    std::get<ClockSpec::Clock>(res.clockAtStartOfQuery.spec).position.ticks =
+        ctx.lastTickGenerated;
+  }
+
+  if (cacheable && !res.resultsArray.preencoded) {
+    // Pre-encoded results are bound to one client's wire format; a
+    // cache hit could later be served to a client using another, so
+    // only DOM-form results are cached.  The snapshot copy is taken
+    // here, outside the cache lock.
+    root->queryCache.insert(
+        cacheKey,
+        ctx.clockAtStartOfQuery.position(),
+        std::make_shared<const QueryResult>(res));
+  }
+
+  // A null capture pointer here means either the capture was never
+  // armed or a result could not serve its metadata synchronously; in
+  // both cases there is nothing trustworthy to share.  Eden can also
+  // discover mid-query that this is really a fresh instance.
+  if (ctx.matchedSetCapture && !res.isFreshInstance) {
+    root->matchedSetCache.insert(
+        matchedSetKey,
+        ctx.clockAtStartOfQuery.position(),
+        std::make_shared<const std::vector<MatchedFile>>(
+            std::move(capturedMatches)));
+  }
   return res;
 }
 
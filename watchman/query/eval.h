@@ -9,14 +9,17 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 #include "watchman/query/FileResult.h"
 #include "watchman/query/QueryResult.h"
 #include "watchman/saved_state/SavedStateInterface.h"
 
 namespace watchman {
 
+class BserRenderSink;
 struct Query;
 struct QueryContext;
+struct QueryContextScratch;
 class Root;
 
 // Generator callback, used to plug in an alternate
@@ -26,6 +29,11 @@ using QueryGenerator = std::function<void(
     const std::shared_ptr<Root>& root,
     QueryContext* ctx)>;
 
+// Describes which generators the default evaluation of this query would
+// use and why, without executing it.  Used by the `debug-query-plan`
+// command.
+json_ref explainQueryPlan(const Query& query);
+
 } // namespace watchman
 
 /**
@@ -33,12 +41,26 @@ using QueryGenerator = std::function<void(
  *
  * savedStateFactory allows testing this function without pulling in a wide
  * set of dependencies.
+ *
+ * scratch, when provided by a long-lived query owner, donates retained
+ * container capacity to this run's QueryContext; see QueryContextScratch.
+ *
+ * clientGoneProbe, when provided, is polled during evaluation; returning
+ * true aborts the query with an error so dead-client queries do not keep
+ * consuming cores.
+ *
+ * renderSink, when provided by a handler serving a BSER client, streams
+ * rendered rows into encoded bytes as they are produced so the result
+ * DOM never accumulates; see BserRenderSink.
  */
 watchman::QueryResult w_query_execute(
     const watchman::Query* query,
     const std::shared_ptr<watchman::Root>& root,
     watchman::QueryGenerator generator,
-    watchman::SavedStateFactory savedStateFactory);
+    watchman::SavedStateFactory savedStateFactory,
+    watchman::QueryContextScratch* scratch = nullptr,
+    std::function<bool()> clientGoneProbe = {},
+    watchman::BserRenderSink* renderSink = nullptr);
 
 // Allows a generator to process a file node
 // through the query engine
@@ -47,6 +69,16 @@ void w_query_process_file(
     watchman::QueryContext* ctx,
     std::unique_ptr<watchman::FileResult> file);
 
+// Evaluate a batch of files against the query expression, sharded across
+// the shared thread pool, then emit matches in batch order on the calling
+// thread so dedup and rendering behave identically to the serial path.
+// Files whose terms need more data are re-processed serially via
+// w_query_process_file. `files` is consumed.
+void w_query_process_file_parallel(
+    const watchman::Query* query,
+    watchman::QueryContext* ctx,
+    std::vector<std::unique_ptr<watchman::FileResult>>& files);
+
 void time_generator(
     const watchman::Query* query,
     const std::shared_ptr<watchman::Root>& root,
@@ -5,6 +5,8 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <algorithm>
+
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
 #include "watchman/query/FileResult.h"
@@ -201,29 +203,47 @@ MAKE_INT_FIELD(nlink, nlink)
   { #type "time_f", make_##type##time_f}
 // clang-format on
 
+// The "type" field only ever renders one of a handful of single letter
+// strings, so share one json value per letter across all rows rather
+// than allocating a fresh string for every file in every result set.
+const json_ref& type_letter(const char* letter) {
+  struct Letters {
+    std::unordered_map<char, json_ref> map;
+    Letters() {
+      for (auto* p = "fdlbcpsD?"; *p; ++p) {
+        char buf[2] = {*p, 0};
+        map.emplace(*p, typed_string_to_json(buf, W_STRING_UNICODE));
+      }
+    }
+  };
+  // Meyers singleton to avoid SIOF
+  static Letters letters;
+  return letters.map.at(letter[0]);
+}
+
 std::optional<json_ref> make_type_field(FileResult* file, const QueryContext*) {
   auto dtype = file->dtype();
   if (dtype.has_value()) {
     switch (*dtype) {
       case DType::Regular:
-        return typed_string_to_json("f", W_STRING_UNICODE);
+        return type_letter("f");
       case DType::Dir:
-        return typed_string_to_json("d", W_STRING_UNICODE);
+        return type_letter("d");
       case DType::Symlink:
-        return typed_string_to_json("l", W_STRING_UNICODE);
+        return type_letter("l");
       case DType::Block:
-        return typed_string_to_json("b", W_STRING_UNICODE);
+        return type_letter("b");
       case DType::Char:
-        return typed_string_to_json("c", W_STRING_UNICODE);
+        return type_letter("c");
       case DType::Fifo:
-        return typed_string_to_json("p", W_STRING_UNICODE);
+        return type_letter("p");
       case DType::Socket:
-        return typed_string_to_json("s", W_STRING_UNICODE);
+        return type_letter("s");
       case DType::Whiteout:
         // Whiteout shouldn't generally be visible to userspace,
         // and we don't have a defined letter code for it, so
         // treat it as "who knows!?"
-        return typed_string_to_json("?", W_STRING_UNICODE);
+        return type_letter("?");
       case DType::Unknown:
       default:
           // Not enough info; fall through and use the full stat data
@@ -239,34 +259,34 @@ std::optional<json_ref> make_type_field(FileResult* file, const QueryContext*) {
 
   auto stat = optionalStat.value();
   if (stat.isFile()) {
-    return typed_string_to_json("f", W_STRING_UNICODE);
+    return type_letter("f");
   }
   if (stat.isDir()) {
-    return typed_string_to_json("d", W_STRING_UNICODE);
+    return type_letter("d");
   }
   if (stat.isSymlink()) {
-    return typed_string_to_json("l", W_STRING_UNICODE);
+    return type_letter("l");
   }
 #ifndef _WIN32
   if (S_ISBLK(stat.mode)) {
-    return typed_string_to_json("b", W_STRING_UNICODE);
+    return type_letter("b");
   }
   if (S_ISCHR(stat.mode)) {
-    return typed_string_to_json("c", W_STRING_UNICODE);
+    return type_letter("c");
   }
   if (S_ISFIFO(stat.mode)) {
-    return typed_string_to_json("p", W_STRING_UNICODE);
+    return type_letter("p");
   }
   if (S_ISSOCK(stat.mode)) {
-    return typed_string_to_json("s", W_STRING_UNICODE);
+    return type_letter("s");
   }
 #endif
 #ifdef S_ISDOOR
   if (S_ISDOOR(stat.mode)) {
-    return typed_string_to_json("D", W_STRING_UNICODE);
+    return type_letter("D");
   }
 #endif
-  return typed_string_to_json("?", W_STRING_UNICODE);
+  return type_letter("?");
 }
 
 // Helper to construct the list of field defs
@@ -310,6 +330,91 @@ std::unordered_map<w_string, QueryFieldRenderer>& field_defs() {
   return map;
 }
 
+/**
+ * Renders one columnar row with the maker functions baked in as
+ * template arguments, so each field is a direct (and inlinable) call
+ * rather than an indirect call through the renderer table.
+ */
+template <
+    std::optional<json_ref> (*... makers)(FileResult*, const QueryContext*)>
+std::optional<json_ref> render_row(FileResult* file, const QueryContext* ctx) {
+  std::vector<json_ref> row;
+  row.reserve(sizeof...(makers));
+  auto append = [&](auto maker) {
+    auto ele = maker(file, ctx);
+    if (!ele.has_value()) {
+      // Need data to be loaded
+      return false;
+    }
+    row.push_back(std::move(ele.value()));
+    return true;
+  };
+  if (!(append(makers) && ...)) {
+    return std::nullopt;
+  }
+  return json_array(std::move(row));
+}
+
+/** Single-field lists render the bare value, not a row array. */
+template <std::optional<json_ref> (*maker)(FileResult*, const QueryContext*)>
+std::optional<json_ref> render_bare(FileResult* file, const QueryContext* ctx) {
+  return maker(file, ctx);
+}
+
+struct SpecializedShape {
+  std::vector<const QueryFieldRenderer*> fields;
+  QueryFieldList::RenderRowFn render;
+};
+
+/**
+ * The handful of field-list shapes that dominate real traffic, each
+ * paired with a render_row instantiation.  The renderers are
+ * singletons, so a shape is identified by pointer-comparing the list
+ * against these resolved entries.
+ */
+const std::vector<SpecializedShape>& specialized_shapes() {
+  static const std::vector<SpecializedShape> shapes = [] {
+    auto& defs = field_defs();
+    auto resolve = [&](std::initializer_list<const char*> names) {
+      std::vector<const QueryFieldRenderer*> fields;
+      fields.reserve(names.size());
+      for (auto* name : names) {
+        fields.push_back(&defs.at(w_string{name, W_STRING_UNICODE}));
+      }
+      return fields;
+    };
+    std::vector<SpecializedShape> result;
+    // Bare file listings
+    result.push_back({resolve({"name"}), render_bare<make_name>});
+    // The default field list from parse_field_list()
+    result.push_back(
+        {resolve({"name", "exists", "new", "size", "mode"}),
+         render_row<make_name, make_exists, make_new, make_size, make_mode>});
+    // The shape the docs recommend for subscriptions
+    result.push_back(
+        {resolve({"name", "size", "mtime_ms", "exists", "type"}),
+         render_row<
+             make_name,
+             make_size,
+             make_mtime_ms,
+             make_exists,
+             make_type_field>});
+    return result;
+  }();
+  return shapes;
+}
+
+QueryFieldList::RenderRowFn lookup_specialized_render(
+    const QueryFieldList& list) {
+  for (auto& shape : specialized_shapes()) {
+    if (list.size() == shape.fields.size() &&
+        std::equal(list.begin(), list.end(), shape.fields.begin())) {
+      return shape.render;
+    }
+  }
+  return nullptr;
+}
+
 } // namespace
 
 void QueryFieldList::add(const w_string& name) {
@@ -319,6 +424,16 @@ void QueryFieldList::add(const w_string& name) {
     QueryParseError::throwf("unknown field name '{}'", name);
   }
   this->push_back(&it->second);
+  specialized_ = lookup_specialized_render(*this);
+}
+
+std::optional<size_t> QueryFieldList::indexOf(w_string_piece name) const {
+  for (size_t i = 0; i < size(); ++i) {
+    if ((*this)[i]->name == name) {
+      return i;
+    }
+  }
+  return std::nullopt;
 }
 
 json_ref field_list_to_json_name_array(const QueryFieldList& fieldList) {
@@ -188,6 +188,12 @@ void parse_globs(Query* res, const json_ref& query) {
       throw QueryParseError("failed to compile multi-glob");
     }
   }
+
+  // Compile per-component byte-wise matchers now that the flags and
+  // case mode are settled.
+  res->glob_tree->compileMatchers(
+      res->glob_flags,
+      res->case_sensitive == CaseSensitivity::CaseInSensitive);
 }
 
 static w_string parse_suffix(const json_ref& ele) {
@@ -197,7 +203,7 @@ static w_string parse_suffix(const json_ref& ele) {
 
   auto str = json_to_w_string(ele);
 
-  return str.piece().asLowerCase(str.type());
+  return str.asLowerCase();
 }
 
 void parse_suffixes(Query* res, const json_ref& query) {
@@ -226,6 +232,9 @@ void parse_suffixes(Query* res, const json_ref& query) {
   res->glob_flags = WM_CASEFOLD;
   res->glob_tree = make_unique<GlobTree>("", 0);
 
+  std::vector<w_string> suffixSet;
+  suffixSet.reserve(suffixArray.size());
+
   for (auto& ele : suffixArray) {
     if (!ele.isString()) {
       throw QueryParseError("'suffix' must be a string or an array of strings");
@@ -236,7 +245,41 @@ void parse_suffixes(Query* res, const json_ref& query) {
     if (!add_glob(res->glob_tree.get(), pattern)) {
       throw QueryParseError("failed to compile multi-glob");
     }
+    suffixSet.push_back(std::move(suff));
   }
+
+  res->glob_tree->compileMatchers(
+      res->glob_flags,
+      res->case_sensitive == CaseSensitivity::CaseInSensitive);
+
+  res->suffixes = std::move(suffixSet);
+}
+
+bool buildGlobTreeFromUpperBound(
+    Query* res,
+    const std::vector<std::string>& bound) {
+  auto tree = make_unique<GlobTree>("", 0);
+  for (const auto& pattern : bound) {
+    if (!add_glob(
+            tree.get(),
+            w_string(pattern.data(), pattern.size(), W_STRING_BYTE))) {
+      return false;
+    }
+  }
+
+  // Overlapping upper bound patterns can generate the same file twice.
+  res->dedup_results = true;
+  // Deliberately no WM_PERIOD: the bound is an over-approximation of
+  // what the expression matches, and the expression may well match
+  // dotfiles where a user-written glob would not.  Over-matching only
+  // costs extra candidates; a generator that skipped dotfiles would
+  // drop results.
+  res->glob_flags = 0;
+  res->glob_tree = std::move(tree);
+  res->glob_tree->compileMatchers(
+      res->glob_flags,
+      res->case_sensitive == CaseSensitivity::CaseInSensitive);
+  return true;
 }
 
 } // namespace watchman
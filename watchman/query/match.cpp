@@ -5,8 +5,11 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cctype>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 #include "GlobEscaping.h"
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
@@ -57,6 +60,166 @@ w_string_piece trimGlobAfterDoubleStar(w_string_piece pattern) {
   }
   return pattern;
 }
+
+/**
+ * The result of a one-time scan over a wildmatch pattern, used to avoid
+ * the recursive matcher where cheaper tests suffice.
+ *
+ * The literal prefix and suffix are the unescaped literal runs before
+ * the first and after the last wildcard construct; both are necessary
+ * substrings of any matching name and reject most candidates with a
+ * memcmp.  When the pattern contains no wildcard at all the prefix is
+ * the entire pattern and matching degenerates to a string compare.
+ */
+struct PatternAnalysis {
+  std::string literalPrefix;
+  std::string literalSuffix;
+  // The whole pattern is literal text held in literalPrefix.
+  bool isLiteral{false};
+  // The pattern is eligible for the segment matcher: it is composed of
+  // '/'-separated segments free of classes and escapes, at least one of
+  // which is `**`.
+  bool segmentable{false};
+  std::vector<std::string> segments;
+};
+
+PatternAnalysis analyzePattern(const std::string& pattern, bool noescape) {
+  PatternAnalysis out;
+
+  bool anyMeta = false;
+  bool sawDoubleStar = false;
+  bool sawClassOrEscape = false;
+  std::string tail;
+
+  auto markMeta = [&] {
+    if (!anyMeta) {
+      out.literalPrefix = tail;
+      anyMeta = true;
+    }
+    tail.clear();
+  };
+
+  const char* pos = pattern.data();
+  const char* end = pos + pattern.size();
+  while (pos < end) {
+    char c = *pos;
+    switch (c) {
+      case '\\':
+        if (noescape) {
+          tail.push_back(c);
+          ++pos;
+          break;
+        }
+        sawClassOrEscape = true;
+        if (pos + 1 < end) {
+          tail.push_back(pos[1]);
+          pos += 2;
+          break;
+        }
+        // Trailing escape; let wildmatch decide what it means.
+        markMeta();
+        ++pos;
+        break;
+      case '*':
+        if (pos + 1 < end && pos[1] == '*') {
+          sawDoubleStar = true;
+        }
+        markMeta();
+        ++pos;
+        break;
+      case '?':
+        markMeta();
+        ++pos;
+        break;
+      case '[': {
+        sawClassOrEscape = true;
+        markMeta();
+        // Skip the class body; '!' or ']' directly after the bracket are
+        // part of it.
+        const char* scan = pos + 1;
+        if (scan < end && (*scan == '!' || *scan == '^')) {
+          ++scan;
+        }
+        if (scan < end && *scan == ']') {
+          ++scan;
+        }
+        while (scan < end && *scan != ']') {
+          if (*scan == '\\' && !noescape && scan + 1 < end) {
+            ++scan;
+          }
+          ++scan;
+        }
+        if (scan >= end) {
+          // Unterminated class; stop analyzing and let wildmatch handle
+          // the remainder.
+          return out;
+        }
+        pos = scan + 1;
+        break;
+      }
+      default:
+        tail.push_back(c);
+        ++pos;
+        break;
+    }
+  }
+
+  if (!anyMeta) {
+    out.literalPrefix = std::move(tail);
+    out.isLiteral = true;
+    return out;
+  }
+  out.literalSuffix = std::move(tail);
+
+  if (sawDoubleStar && !sawClassOrEscape &&
+      pattern.find("//") == std::string::npos && !pattern.empty() &&
+      pattern.front() != '/' && pattern.back() != '/') {
+    size_t start = 0;
+    while (start <= pattern.size()) {
+      auto sep = pattern.find('/', start);
+      if (sep == std::string::npos) {
+        out.segments.push_back(pattern.substr(start));
+        break;
+      }
+      out.segments.push_back(pattern.substr(start, sep - start));
+      start = sep + 1;
+    }
+    out.segmentable = true;
+  }
+  return out;
+}
+
+bool literalStartsWith(w_string_piece str, const std::string& lit, bool fold) {
+  if (str.size() < lit.size()) {
+    return false;
+  }
+  if (!fold) {
+    return memcmp(str.data(), lit.data(), lit.size()) == 0;
+  }
+  for (size_t i = 0; i < lit.size(); ++i) {
+    if (tolower((unsigned char)str.data()[i]) !=
+        tolower((unsigned char)lit[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool literalEndsWith(w_string_piece str, const std::string& lit, bool fold) {
+  if (str.size() < lit.size()) {
+    return false;
+  }
+  const char* base = str.data() + str.size() - lit.size();
+  if (!fold) {
+    return memcmp(base, lit.data(), lit.size()) == 0;
+  }
+  for (size_t i = 0; i < lit.size(); ++i) {
+    if (tolower((unsigned char)base[i]) != tolower((unsigned char)lit[i])) {
+      return false;
+    }
+  }
+  return true;
+}
 } // namespace
 class WildMatchExpr : public QueryExpr {
   std::string pattern;
@@ -64,6 +227,7 @@ class WildMatchExpr : public QueryExpr {
   bool wholename;
   bool noescape;
   bool includedotfiles;
+  PatternAnalysis analysis;
 
  public:
   WildMatchExpr(
@@ -76,7 +240,8 @@ class WildMatchExpr : public QueryExpr {
         caseSensitive(caseSensitive),
         wholename(wholename),
         noescape(noescape),
-        includedotfiles(includedotfiles) {}
+        includedotfiles(includedotfiles),
+        analysis(analyzePattern(pattern, noescape)) {}
 
   EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
     w_string_piece str;
@@ -94,6 +259,34 @@ class WildMatchExpr : public QueryExpr {
     str = normBuf;
 #endif
 
+    // Literal prefix/suffix rejection: both are necessary substrings of
+    // any matching name, and most candidates fail here without ever
+    // entering the backtracking matcher.
+    const bool fold = caseSensitive == CaseSensitivity::CaseInSensitive;
+    if (str.size() < analysis.literalPrefix.size() +
+            analysis.literalSuffix.size()) {
+      return false;
+    }
+    if (!literalStartsWith(str, analysis.literalPrefix, fold)) {
+      return false;
+    }
+    if (analysis.isLiteral) {
+      // The prefix is the entire pattern; the size test is all that is
+      // left after the comparison above.
+      return str.size() == analysis.literalPrefix.size();
+    }
+    if (!literalEndsWith(str, analysis.literalSuffix, fold)) {
+      return false;
+    }
+
+    if (wholename && analysis.segmentable) {
+      auto segRes = segmentMatch(str);
+      if (segRes.has_value()) {
+        return *segRes;
+      }
+      // Fall through for inputs the segment matcher declined.
+    }
+
     res =
         wildmatch(
             pattern.c_str(),
@@ -107,6 +300,85 @@ class WildMatchExpr : public QueryExpr {
     return res;
   }
 
+  w_string_piece name() const override {
+    return caseSensitive == CaseSensitivity::CaseInSensitive ? "imatch"
+                                                             : "match";
+  }
+
+  /**
+   * Iterative matcher for `**` patterns.  wildmatch() restarts the
+   * remainder of the pattern at every path offset when backtracking over
+   * `**`, which is quadratic on deep paths.  Splitting both pattern and
+   * name into path segments turns the problem into a small dynamic
+   * program over (pattern segment, name segment) pairs, where each
+   * non-`**` segment pair is delegated to wildmatch() without
+   * WM_PATHNAME so classes of characters within a segment keep their
+   * usual meaning.  Returns std::nullopt to defer to wildmatch() for
+   * inputs with empty segments, whose multi-slash handling is subtle.
+   */
+  std::optional<bool> segmentMatch(w_string_piece str) const {
+    std::vector<std::string> text;
+    {
+      const char* pos = str.data();
+      const char* end = pos + str.size();
+      const char* start = pos;
+      for (; pos <= end; ++pos) {
+        if (pos == end || *pos == '/') {
+          if (pos == start) {
+            return std::nullopt;
+          }
+          text.emplace_back(start, pos - start);
+          start = pos + 1;
+        }
+      }
+    }
+
+    const auto& pat = analysis.segments;
+    const size_t m = pat.size();
+    const size_t n = text.size();
+    const int segFlags = (includedotfiles ? 0 : WM_PERIOD) |
+        (caseSensitive == CaseSensitivity::CaseInSensitive ? WM_CASEFOLD : 0);
+
+    auto segmentIsMatch = [&](size_t i, size_t j) {
+      return wildmatch(pat[i].c_str(), text[j].c_str(), segFlags, 0) ==
+          WM_MATCH;
+    };
+    // With WM_PERIOD, `**` may not swallow a hidden segment.
+    auto mayConsume = [&](size_t j) {
+      return includedotfiles || text[j][0] != '.';
+    };
+
+    // dp[i][j]: do pattern segments i.. match name segments j.. ?
+    // `**/` matches zero or more directories, while a trailing `**`
+    // matches everything inside (at least one segment), mirroring
+    // wildmatch.
+    std::vector<uint8_t> dp((m + 1) * (n + 1), 0);
+    auto cell = [&](size_t i, size_t j) -> uint8_t& {
+      return dp[i * (n + 1) + j];
+    };
+    cell(m, n) = 1;
+    for (size_t ii = m; ii > 0; --ii) {
+      const size_t i = ii - 1;
+      const bool doubleStar = pat[i] == "**";
+      for (size_t jj = n + 1; jj > 0; --jj) {
+        const size_t j = jj - 1;
+        if (doubleStar) {
+          if (i + 1 == m) {
+            cell(i, j) =
+                j < n && mayConsume(j) && (j + 1 == n || cell(i, j + 1));
+          } else {
+            cell(i, j) = cell(i + 1, j) ||
+                (j < n && mayConsume(j) && cell(i, j + 1));
+          }
+        } else {
+          cell(i, j) =
+              j < n && cell(i + 1, j + 1) && segmentIsMatch(i, j);
+        }
+      }
+    }
+    return cell(0, 0) != 0;
+  }
+
   static std::unique_ptr<QueryExpr>
   parse(Query*, const json_ref& term, CaseSensitivity case_sensitive) {
     const char *pattern, *scope = "basename";
@@ -200,7 +472,7 @@ class WildMatchExpr : public QueryExpr {
       return std::nullopt;
     }
     if (outputCaseSensitive == CaseSensitivity::CaseInSensitive) {
-      outputPattern = outputPattern.piece().asLowerCase();
+      outputPattern = outputPattern.asLowerCase();
     }
     if (noescape) {
       outputPattern = convertNoEscapeGlobToGlob(outputPattern);
@@ -5,6 +5,7 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include "watchman/CaseOps.h"
 #include "watchman/Errors.h"
 #include "watchman/query/FileResult.h"
 #include "watchman/query/GlobEscaping.h"
@@ -16,32 +17,58 @@
 
 using namespace watchman;
 
+// Templated on the query's sensitivity (fixed at parse time) so the
+// per-file case handling in evaluate() is a compile-time decision; the
+// sensitive instantiation compares with plain memcmp and never runs
+// the case-folding allocations.
+template <CaseSensitivity CS>
 class NameExpr : public QueryExpr {
   w_string name;
   std::unordered_set<w_string> set;
-  CaseSensitivity caseSensitive;
+  // Hashes of the final path component of every entry in `set`.  A
+  // candidate whose basename hash is absent here cannot be in the set,
+  // and the basename hash is computed from a string piece without the
+  // allocation and full-path hashing that the set lookup needs.  Only
+  // populated for case-sensitive terms; folding a candidate's case to
+  // probe it would cost the very allocation it avoids.
+  std::unordered_set<StringHash> basenameHashes;
   bool wholename;
+
+ public:
   explicit NameExpr(
+      w_string name,
       std::unordered_set<w_string>&& set,
-      CaseSensitivity caseSensitive,
       bool wholename)
-      : set(std::move(set)),
-        caseSensitive(caseSensitive),
-        wholename(wholename) {}
+      : name(std::move(name)), set(std::move(set)), wholename(wholename) {
+    if (CS == CaseSensitivity::CaseSensitive) {
+      basenameHashes.reserve(this->set.size());
+      for (const auto& entry : this->set) {
+        basenameHashes.insert(entry.piece().baseName().hashValue());
+      }
+    }
+  }
 
- public:
   EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
     if (!set.empty()) {
       bool matched;
       w_string str;
 
+      if (CS == CaseSensitivity::CaseSensitive) {
+        w_string_piece base = wholename
+            ? ctx->getWholeName().piece().baseName()
+            : file->baseName();
+        if (basenameHashes.find(base.hashValue()) == basenameHashes.end()) {
+          return false;
+        }
+      }
+
       if (wholename) {
         str = ctx->getWholeName();
-        if (caseSensitive == CaseSensitivity::CaseInSensitive) {
-          str = str.piece().asLowerCase();
+        if (CS == CaseSensitivity::CaseInSensitive) {
+          str = str.asLowerCase();
         }
       } else {
-        str = caseSensitive == CaseSensitivity::CaseInSensitive
+        str = CS == CaseSensitivity::CaseInSensitive
             ? file->baseName().asLowerCase()
             : file->baseName().asWString();
       }
@@ -59,101 +86,25 @@ class NameExpr : public QueryExpr {
       str = file->baseName();
     }
 
-    if (caseSensitive == CaseSensitivity::CaseInSensitive) {
-      return w_string_equal_caseless(str, name);
-    }
-    return str == name;
+    return CaseOps<CS>::equal(str, name);
   }
 
-  static std::unique_ptr<QueryExpr>
-  parse(Query*, const json_ref& term, CaseSensitivity caseSensitive) {
-    const char *pattern = nullptr, *scope = "basename";
-    const char* which =
-        caseSensitive == CaseSensitivity::CaseInSensitive ? "iname" : "name";
-    std::unordered_set<w_string> set;
-
-    if (!term.isArray()) {
-      QueryParseError::throwf("Expected array for '{}' term", which);
-    }
-
-    if (json_array_size(term) > 3) {
-      QueryParseError::throwf(
-          "Invalid number of arguments for '{}' term", which);
-    }
-
-    if (json_array_size(term) == 3) {
-      const auto& jscope = term.at(2);
-      if (!jscope.isString()) {
-        QueryParseError::throwf("Argument 3 to '{}' must be a string", which);
-      }
-
-      scope = json_string_value(jscope);
-
-      if (strcmp(scope, "basename") && strcmp(scope, "wholename")) {
-        QueryParseError::throwf(
-            "Invalid scope '{}' for {} expression", scope, which);
-      }
-    }
-
-    const auto& name = term.at(1);
-
-    if (name.isArray()) {
-      const auto& name_array = name.array();
-
-      for (const auto& ele : name_array) {
-        if (!ele.isString()) {
-          QueryParseError::throwf(
-              "Argument 2 to '{}' must be either a string or an array of string",
-              which);
-        }
-      }
-
-      set.reserve(name_array.size());
-      for (const auto& jele : name_array) {
-        w_string element;
-        auto ele = json_to_w_string(jele);
-
-        if (caseSensitive == CaseSensitivity::CaseInSensitive) {
-          element = ele.piece().asLowerCase(ele.type()).normalizeSeparators();
-        } else {
-          element = ele.normalizeSeparators();
-        }
-
-        set.insert(element);
-      }
-
-    } else if (name.isString()) {
-      pattern = json_string_value(name);
-    } else {
-      QueryParseError::throwf(
-          "Argument 2 to '{}' must be either a string or an array of string",
-          which);
-    }
-
-    auto data = new NameExpr(
-        std::move(set), caseSensitive, !strcmp(scope, "wholename"));
-
-    if (pattern) {
-      data->name = json_to_w_string(name).normalizeSeparators();
-    }
-
-    return std::unique_ptr<QueryExpr>(data);
+  w_string_piece name() const override {
+    return CS == CaseSensitivity::CaseInSensitive ? "iname" : "name";
   }
 
-  static std::unique_ptr<QueryExpr> parseName(
-      Query* query,
-      const json_ref& term) {
-    return parse(query, term, query->case_sensitive);
-  }
-  static std::unique_ptr<QueryExpr> parseIName(
-      Query* query,
-      const json_ref& term) {
-    return parse(query, term, CaseSensitivity::CaseInSensitive);
+  std::optional<std::vector<w_string>> computeExactWholenames() const override {
+    // Only a case-sensitive wholename set pins down the exact files;
+    // lower-cased entries may not resolve in the view's tree.
+    if (!wholename || CS != CaseSensitivity::CaseSensitive || set.empty()) {
+      return std::nullopt;
+    }
+    return std::vector<w_string>(set.begin(), set.end());
   }
 
   std::optional<std::vector<std::string>> computeGlobUpperBound(
       CaseSensitivity outputCaseSensitive) const override {
-    if (caseSensitive == CaseSensitivity::CaseInSensitive &&
+    if (CS == CaseSensitivity::CaseInSensitive &&
         outputCaseSensitive != CaseSensitivity::CaseInSensitive) {
       // The caller asked for a case-sensitive upper bound, so treat iname as
       // unbounded.
@@ -168,14 +119,14 @@ class NameExpr : public QueryExpr {
       for (const auto& s : set) {
         w_string outputPattern = convertLiteralPathToGlob(s);
         if (outputCaseSensitive == CaseSensitivity::CaseInSensitive) {
-          outputPattern = outputPattern.piece().asLowerCase();
+          outputPattern = outputPattern.asLowerCase();
         }
         globUpperBound.insert(outputPattern.string());
       }
     } else {
       w_string outputPattern = convertLiteralPathToGlob(name);
       if (outputCaseSensitive == CaseSensitivity::CaseInSensitive) {
-        outputPattern = outputPattern.piece().asLowerCase();
+        outputPattern = outputPattern.asLowerCase();
       }
       globUpperBound.insert(outputPattern.string());
     }
@@ -184,8 +135,96 @@ class NameExpr : public QueryExpr {
   }
 };
 
-W_TERM_PARSER(name, NameExpr::parseName);
-W_TERM_PARSER(iname, NameExpr::parseIName);
+static std::unique_ptr<QueryExpr>
+parse_name(Query*, const json_ref& term, CaseSensitivity caseSensitive) {
+  const char *pattern = nullptr, *scope = "basename";
+  const char* which =
+      caseSensitive == CaseSensitivity::CaseInSensitive ? "iname" : "name";
+  std::unordered_set<w_string> set;
+
+  if (!term.isArray()) {
+    QueryParseError::throwf("Expected array for '{}' term", which);
+  }
+
+  if (json_array_size(term) > 3) {
+    QueryParseError::throwf("Invalid number of arguments for '{}' term", which);
+  }
+
+  if (json_array_size(term) == 3) {
+    const auto& jscope = term.at(2);
+    if (!jscope.isString()) {
+      QueryParseError::throwf("Argument 3 to '{}' must be a string", which);
+    }
+
+    scope = json_string_value(jscope);
+
+    if (strcmp(scope, "basename") && strcmp(scope, "wholename")) {
+      QueryParseError::throwf(
+          "Invalid scope '{}' for {} expression", scope, which);
+    }
+  }
+
+  const auto& name = term.at(1);
+
+  if (name.isArray()) {
+    const auto& name_array = name.array();
+
+    for (const auto& ele : name_array) {
+      if (!ele.isString()) {
+        QueryParseError::throwf(
+            "Argument 2 to '{}' must be either a string or an array of string",
+            which);
+      }
+    }
+
+    set.reserve(name_array.size());
+    for (const auto& jele : name_array) {
+      w_string element;
+      auto ele = json_to_w_string(jele);
+
+      if (caseSensitive == CaseSensitivity::CaseInSensitive) {
+        element = ele.asLowerCase().normalizeSeparators();
+      } else {
+        element = ele.normalizeSeparators();
+      }
+
+      set.insert(element);
+    }
+
+  } else if (name.isString()) {
+    pattern = json_string_value(name);
+  } else {
+    QueryParseError::throwf(
+        "Argument 2 to '{}' must be either a string or an array of string",
+        which);
+  }
+
+  w_string singleName;
+  if (pattern) {
+    singleName = json_to_w_string(name).normalizeSeparators();
+  }
+
+  const bool wholename = !strcmp(scope, "wholename");
+  if (caseSensitive == CaseSensitivity::CaseInSensitive) {
+    return std::make_unique<NameExpr<CaseSensitivity::CaseInSensitive>>(
+        std::move(singleName), std::move(set), wholename);
+  }
+  return std::make_unique<NameExpr<CaseSensitivity::CaseSensitive>>(
+      std::move(singleName), std::move(set), wholename);
+}
+
+static std::unique_ptr<QueryExpr> parseName(Query* query, const json_ref& term) {
+  return parse_name(query, term, query->case_sensitive);
+}
+
+static std::unique_ptr<QueryExpr> parseIName(
+    Query* query,
+    const json_ref& term) {
+  return parse_name(query, term, CaseSensitivity::CaseInSensitive);
+}
+
+W_TERM_PARSER(name, parseName);
+W_TERM_PARSER(iname, parseIName);
 
 /* vim:ts=2:sw=2:et:
  */
@@ -147,6 +147,9 @@ json_int_t parse_nonnegative_integer(std::string_view name, json_ref v) {
 }
 } // namespace
 
+W_CAP_REG("stale-ok")
+W_CAP_REG("query-timeout")
+
 void parse_sync(Query* res, const json_ref& query) {
   auto settle_period = query.get_optional("settle_period");
   auto settle_timeout = query.get_optional("settle_timeout");
@@ -174,6 +177,20 @@ void parse_sync(Query* res, const json_ref& query) {
                        .count()));
   res->sync_timeout = std::chrono::milliseconds{
       parse_nonnegative_integer("sync_timeout", sync_timeout)};
+
+  auto stale_ok = query.get_default("stale_ok", json_false());
+  if (!stale_ok.isBool()) {
+    throw QueryParseError("stale_ok must be a boolean");
+  }
+  res->stale_ok = stale_ok.asBool();
+}
+
+void parse_query_timeout(Query* res, const json_ref& query) {
+  auto query_timeout = query.get_default("query_timeout", json_integer(0));
+  auto value = parse_nonnegative_integer("query_timeout", query_timeout);
+  if (value > 0) {
+    res->query_timeout = std::chrono::milliseconds{value};
+  }
 }
 
 void parse_lock_timeout(Query* res, const json_ref& query) {
@@ -234,6 +251,66 @@ void parse_always_include_directories(Query* res, const json_ref& query) {
       parse_bool_param(query, "always_include_directories", false);
 }
 
+void parse_debug_profile_terms(Query* res, const json_ref& query) {
+  res->debug_profile_terms =
+      parse_bool_param(query, "debug_profile_terms", false);
+}
+
+W_CAP_REG("paged-since")
+
+void parse_result_limit(Query* res, const json_ref& query) {
+  auto limit = query.get_optional("limit");
+  if (!limit) {
+    return;
+  }
+
+  auto value = parse_nonnegative_integer("limit", *limit);
+  if (value > 0) {
+    // A limit of 0 is equivalent to no limit at all
+    res->result_limit = value;
+  }
+}
+
+W_CAP_REG("ordered-results")
+
+// Accepts "order_by": "name" or "order_by": ["mtime", "desc"].  Must run
+// after the field list has been parsed so the sort field can be
+// validated against it.
+void parse_order_by(Query* res, const json_ref& query) {
+  auto order = query.get_optional("order_by");
+  if (!order) {
+    return;
+  }
+
+  Query::OrderBy spec;
+  if (order->isString()) {
+    spec.field = json_to_w_string(*order);
+  } else if (
+      order->isArray() && order->array().size() == 2 &&
+      order->array()[0].isString() && order->array()[1].isString()) {
+    spec.field = json_to_w_string(order->array()[0]);
+    auto direction = json_to_w_string(order->array()[1]);
+    if (direction == "asc") {
+      spec.descending = false;
+    } else if (direction == "desc") {
+      spec.descending = true;
+    } else {
+      throw QueryParseError("order_by direction must be \"asc\" or \"desc\"");
+    }
+  } else {
+    throw QueryParseError(
+        "order_by must be a field name or a [field, direction] pair");
+  }
+
+  if (!res->fieldList.indexOf(spec.field).has_value()) {
+    throw QueryParseError(fmt::format(
+        "order_by field \"{}\" is not in the requested field list",
+        spec.field));
+  }
+
+  res->order_by = std::move(spec);
+}
+
 void parse_benchmark(Query* res, const json_ref& query) {
   // Preserve behavior by supporting a boolean value. Also support int values.
   auto bench = query.get_optional("bench");
@@ -259,6 +336,89 @@ void parse_case_sensitive(
                                        : CaseSensitivity::CaseInSensitive;
 }
 
+// Returns true if `pattern` contains no glob special characters and can
+// therefore be read back as a literal path.
+bool is_literal_glob_pattern(std::string_view pattern) {
+  return pattern.find_first_of("*?[]\\") == std::string_view::npos;
+}
+
+// The caller specified no generator, so the default would be to walk
+// every file in the view.  Inspect the compiled expression for a cheaper
+// plan:
+//
+//  - if it can only match a fixed set of wholenames (e.g. a top-level
+//    name term with a file list), point the path generator straight at
+//    the named files;
+//  - if its glob upper bound is empty, nothing can match at all;
+//  - otherwise, if the upper bound confines matches to literal subtrees
+//    (e.g. an allof containing a dirname term), scope the path generator
+//    to those subtrees.
+//
+// The expression still evaluates against the generated candidates, so a
+// plan that over-approximates the match set only costs the extra
+// candidates it walks; a plan that under-approximates would drop
+// results, which is why the subtree mapping rejects any pattern it does
+// not fully understand.
+void plan_generator_from_expression(Query* res) {
+  if (auto names = res->expr->computeExactWholenames()) {
+    std::vector<QueryPath> paths;
+    paths.reserve(names->size());
+    for (auto& name : *names) {
+      paths.push_back(QueryPath{std::move(name), 0});
+    }
+    res->paths = std::move(paths);
+    res->plannerInfo = "path generator over exact names from the expression";
+    return;
+  }
+
+  auto bound = res->expr->computeGlobUpperBound(res->case_sensitive);
+  if (!bound) {
+    return;
+  }
+
+  if (bound->empty()) {
+    res->paths.emplace();
+    res->plannerInfo = "expression cannot match any path";
+    return;
+  }
+
+  // Literal subtree bounds map onto direct path generator lookups, but
+  // only in case sensitive mode: the bound is expressed in folded case
+  // while the view's directory nodes are keyed by the case the
+  // filesystem reported.
+  if (res->case_sensitive == CaseSensitivity::CaseSensitive) {
+    std::vector<QueryPath> paths;
+    paths.reserve(bound->size());
+    bool literal = true;
+    for (auto& pattern : *bound) {
+      std::string_view pat{pattern};
+      int depth = 0;
+      if (pat.size() > 3 && pat.substr(pat.size() - 3) == "/**") {
+        // "<subtree>/**": everything below the subtree.
+        pat.remove_suffix(3);
+        depth = -1;
+      }
+      if (pat.empty() || !is_literal_glob_pattern(pat)) {
+        literal = false;
+        break;
+      }
+      paths.push_back(QueryPath{w_string{pat.data(), pat.size()}, depth});
+    }
+    if (literal) {
+      res->paths = std::move(paths);
+      res->plannerInfo = "path generator scoped to the expression's upper bound";
+      return;
+    }
+  }
+
+  // The bound has wildcard components (or is in folded case); it is
+  // still a glob, so scope the walk with the glob generator rather
+  // than falling all the way back to the full file list.
+  if (buildGlobTreeFromUpperBound(res, *bound)) {
+    res->plannerInfo = "glob generator scoped to the expression's upper bound";
+  }
+}
+
 } // namespace
 
 std::shared_ptr<Query> parseQuery(
@@ -272,11 +432,14 @@ std::shared_ptr<Query> parseQuery(
   parse_sync(res, query);
   parse_dedup(res, query);
   parse_lock_timeout(res, query);
+  parse_query_timeout(res, query);
   parse_relative_root(root, res, query);
   parse_empty_on_fresh_instance(res, query);
   parse_fail_if_no_saved_state(res, query);
   parse_omit_changed_files(res, query);
   parse_always_include_directories(res, query);
+  parse_debug_profile_terms(res, query);
+  parse_result_limit(res, query);
 
   /* Look for path generators */
   parse_paths(res, query);
@@ -292,10 +455,19 @@ std::shared_ptr<Query> parseQuery(
 
   parse_query_expression(res, query);
 
+  // If the caller specified no generator at all, try to derive one from
+  // the compiled expression instead of walking every file in the view.
+  if (res->expr && !res->paths.has_value() && !res->glob_tree &&
+      !res->suffixes && !res->since_spec) {
+    plan_generator_from_expression(res);
+  }
+
   parse_request_id(res, query);
 
   parse_field_list(query.get_optional("fields"), &res->fieldList);
 
+  parse_order_by(res, query);
+
   res->query_spec = query;
 
   return result;
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
 #include "watchman/Clock.h"
 #include "watchman/fs/FileSystem.h"
@@ -44,4 +45,15 @@ json_ref field_list_to_json_name_array(
 void parse_suffixes(watchman::Query* res, const json_ref& query);
 void parse_globs(watchman::Query* res, const json_ref& query);
 
+/**
+ * Compiles the patterns of an expression's glob upper bound into the
+ * query's glob_tree so that the glob generator scopes the walk.
+ * Returns false (leaving the query untouched) if a pattern does not
+ * compile.  Used by the planner; caller is responsible for ensuring no
+ * explicit generator was requested.
+ */
+bool buildGlobTreeFromUpperBound(
+    watchman::Query* res,
+    const std::vector<std::string>& bound);
+
 } // namespace watchman
@@ -6,7 +6,11 @@
  */
 
 #include <fmt/core.h>
+#include <folly/Synchronized.h>
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
 #include "watchman/Errors.h"
 #include "watchman/fs/FileSystem.h"
 #include "watchman/query/FileResult.h"
@@ -21,24 +25,115 @@
 
 using namespace watchman;
 
-class PcreExpr : public QueryExpr {
-  pcre2_code* re;
-  pcre2_match_data* matchData;
-  bool wholename;
+namespace {
 
- public:
-  explicit PcreExpr(pcre2_code* re, pcre2_match_data* matchData, bool wholename)
-      : re(re), matchData(matchData), wholename(wholename) {}
+/**
+ * A compiled (and JIT compiled) pattern, shared by every expression
+ * that parsed the same (pattern, options) pair.  pcre2_code is
+ * immutable once compiled and may be matched concurrently from many
+ * threads provided each caller brings its own match data, so sharing
+ * is safe; the mutable match scratch is thread local (see
+ * PcreExpr::evaluate).
+ */
+struct CompiledPcre {
+  pcre2_code* re{nullptr};
 
-  ~PcreExpr() override {
+  explicit CompiledPcre(pcre2_code* re) : re(re) {}
+  CompiledPcre(const CompiledPcre&) = delete;
+  CompiledPcre& operator=(const CompiledPcre&) = delete;
+  ~CompiledPcre() {
     if (re) {
       pcre2_code_free(re);
     }
-    if (matchData) {
-      pcre2_match_data_free(matchData);
+  }
+};
+
+using PcreCacheKey = std::pair<std::string, uint32_t>;
+
+/**
+ * Returns the shared compiled form of `pattern`, compiling (and JIT
+ * compiling) it on first use.  A fleet of clients subscribing with
+ * structurally identical expressions -- the normal shape when an IDE
+ * reconnects en masse -- would otherwise hold one compilation and one
+ * JIT translation apiece.  Entries are held weakly so a pattern's
+ * storage is reclaimed once the last expression using it is destroyed.
+ *
+ * Returns nullptr with *errcode and *erroff populated when the pattern
+ * does not compile.
+ */
+std::shared_ptr<const CompiledPcre> internCompiledPcre(
+    const std::string& pattern,
+    uint32_t options,
+    int* errcode,
+    size_t* erroff) {
+  static folly::Synchronized<
+      std::map<PcreCacheKey, std::weak_ptr<const CompiledPcre>>>
+      cache;
+
+  PcreCacheKey key{pattern, options};
+  {
+    auto rlock = cache.rlock();
+    auto it = rlock->find(key);
+    if (it != rlock->end()) {
+      if (auto shared = it->second.lock()) {
+        return shared;
+      }
     }
   }
 
+  auto re = pcre2_compile(
+      reinterpret_cast<const unsigned char*>(pattern.data()),
+      pattern.size(),
+      options,
+      errcode,
+      erroff,
+      nullptr);
+  if (!re) {
+    return nullptr;
+  }
+  // JIT-compile the pattern when the host pcre2 build supports it;
+  // pcre2_match transparently uses the JIT code if present, and the
+  // interpreter otherwise, so failure here is not an error.  Doing it
+  // before publication means the JIT translation is shared too.
+  pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
+
+  auto shared = std::shared_ptr<const CompiledPcre>(new CompiledPcre(re));
+
+  auto wlock = cache.wlock();
+  // Drop entries whose last owner has gone away while we're here.
+  for (auto it = wlock->begin(); it != wlock->end();) {
+    it = it->second.expired() ? wlock->erase(it) : std::next(it);
+  }
+  auto& slot = (*wlock)[key];
+  if (auto existing = slot.lock()) {
+    // Raced with another parse of the same pattern; share theirs.
+    return existing;
+  }
+  slot = shared;
+  return shared;
+}
+
+} // namespace
+
+class PcreExpr : public QueryExpr {
+  std::shared_ptr<const CompiledPcre> re;
+  bool wholename;
+  // Retained so that anyof aggregation can recombine patterns into a
+  // single alternation
+  std::string pattern;
+  uint32_t options;
+
+ public:
+  PcreExpr(
+      std::shared_ptr<const CompiledPcre> re,
+      bool wholename,
+      std::string pattern,
+      uint32_t options)
+      : re(std::move(re)),
+        wholename(wholename),
+        pattern(std::move(pattern)),
+        options(options) {}
+
   EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
     w_string_piece str;
     int rc;
@@ -49,22 +144,70 @@ class PcreExpr : public QueryExpr {
       str = file->baseName();
     }
 
-    logf(ERR, "NAME: {}\n", str);
+    // Match data blocks are single-thread-use, and the parallel
+    // evaluator runs this term from several pool threads at once, so
+    // the scratch lives per thread rather than per expression.  We
+    // never read captures -- only whether the pattern matched -- so a
+    // one-pair ovector is enough for every pattern: when it cannot
+    // hold all the captures, pcre2_match reports the match with a
+    // return of 0 instead of failing.
+    struct MatchDataDeleter {
+      void operator()(pcre2_match_data* md) const {
+        pcre2_match_data_free(md);
+      }
+    };
+    static thread_local std::unique_ptr<pcre2_match_data, MatchDataDeleter>
+        matchData{pcre2_match_data_create(1, nullptr)};
 
     rc = pcre2_match(
-        re,
+        re->re,
         reinterpret_cast<const unsigned char*>(str.data()),
         str.size(),
         0,
         0,
-        matchData,
+        matchData.get(),
         nullptr);
-    logf(ERR, "RC: {}\n", rc);
     // Errors are either PCRE2_ERROR_NOMATCH or non actionable. Thus only match
     // when we get a positive return value.
     return rc >= 0;
   }
 
+  w_string_piece name() const override {
+    return (options & PCRE2_CASELESS) ? "ipcre" : "pcre";
+  }
+
+  std::unique_ptr<QueryExpr> aggregate(
+      const QueryExpr* other,
+      const AggregateOp op) const override {
+    if (op != AggregateOp::AnyOf) {
+      return nullptr;
+    }
+    auto otherExpr = dynamic_cast<const PcreExpr*>(other);
+    if (!otherExpr || otherExpr->wholename != wholename ||
+        otherExpr->options != options) {
+      return nullptr;
+    }
+
+    // Fold adjacent pcre terms into a single regex set so that a batch of
+    // patterns is matched against the input in one pass. The branch-reset
+    // group keeps capture group numbering independent per branch, so
+    // backreferences inside the individual patterns keep working.
+    auto combined =
+        fmt::format("(?|(?:{})|(?:{}))", pattern, otherExpr->pattern);
+
+    size_t erroff = 0;
+    int errcode = 0;
+    auto combinedRe = internCompiledPcre(combined, options, &errcode, &erroff);
+    if (!combinedRe) {
+      // Both inputs compiled on their own, so this is unexpected; keep the
+      // terms separate rather than failing the query.
+      return nullptr;
+    }
+
+    return std::make_unique<PcreExpr>(
+        std::move(combinedRe), wholename, std::move(combined), options);
+  }
+
   static std::unique_ptr<QueryExpr>
   parse(Query*, const json_ref& term, CaseSensitivity caseSensitive) {
     const char *pattern, *scope = "basename";
@@ -95,15 +238,10 @@ class PcreExpr : public QueryExpr {
           fmt::format("Invalid scope '{}' for {} expression", scope, which));
     }
 
-    logf(ERR, "PATTERN: {}\n", pattern);
+    uint32_t options =
+        caseSensitive == CaseSensitivity::CaseInSensitive ? PCRE2_CASELESS : 0;
 
-    auto re = pcre2_compile(
-        reinterpret_cast<const unsigned char*>(pattern),
-        PCRE2_ZERO_TERMINATED,
-        caseSensitive == CaseSensitivity::CaseInSensitive ? PCRE2_CASELESS : 0,
-        &errcode,
-        &erroff,
-        nullptr);
+    auto re = internCompiledPcre(pattern, options, &errcode, &erroff);
     if (!re) {
       // From PCRE2 documentation:
       // https://www.pcre.org/current/doc/html/pcre2api.html#SEC32: "None of the
@@ -122,13 +260,8 @@ class PcreExpr : public QueryExpr {
           pattern));
     }
 
-    auto matchData = pcre2_match_data_create_from_pattern(re, nullptr);
-    if (!matchData) {
-      throw std::bad_alloc();
-    }
-
     return std::make_unique<PcreExpr>(
-        re, matchData, !strcmp(scope, "wholename"));
+        std::move(re), !strcmp(scope, "wholename"), pattern, options);
   }
   static std::unique_ptr<QueryExpr> parsePcre(
       Query* query,
@@ -37,17 +37,42 @@ class SinceExpr : public QueryExpr {
   std::unique_ptr<ClockSpec> spec;
   enum since_what field;
 
+  // The per-run comparison, compiled by prepareForRun() so that the
+  // per-file check is a single integer compare against threshold_
+  // rather than re-evaluating the clockspec and branching across its
+  // variants for every file.
+  enum class CompareMode { FreshInstance, Ticks, Timestamp };
+  CompareMode mode_{CompareMode::Timestamp};
+  int64_t threshold_{0};
+
  public:
   explicit SinceExpr(std::unique_ptr<ClockSpec> spec, enum since_what field)
       : spec(std::move(spec)), field(field) {}
 
-  EvaluateResult evaluate(QueryContextBase* ctx, FileResult* file) override {
-    time_t tval = 0;
-
+  void prepareForRun(QueryContextBase* ctx) override {
+    // The clockspec resolves against the run's start clock, which is
+    // fixed by the time we're called, so evaluate it exactly once here.
     auto since = spec->evaluate(
         ctx->clockAtStartOfQuery.position(),
         ctx->lastAgeOutTickValueAtStartOfQuery);
 
+    folly::variant_match(
+        since.since,
+        [&](const QuerySince::Timestamp& since_ts) {
+          mode_ = CompareMode::Timestamp;
+          threshold_ = since_ts.time;
+        },
+        [&](const QuerySince::Clock& since_clock) {
+          if (since_clock.is_fresh_instance) {
+            mode_ = CompareMode::FreshInstance;
+          } else {
+            mode_ = CompareMode::Ticks;
+            threshold_ = since_clock.ticks;
+          }
+        });
+  }
+
+  EvaluateResult evaluate(QueryContextBase*, FileResult* file) override {
     // Note that we use >= for the time comparisons in here so that we
     // report the things that changed inclusive of the boundary presented.
     // This is especially important for clients using the coarse unix
@@ -57,45 +82,36 @@ class SinceExpr : public QueryExpr {
     switch (field) {
       case since_what::SINCE_OCLOCK:
       case since_what::SINCE_CCLOCK: {
+        if (mode_ == CompareMode::FreshInstance) {
+          return file->exists();
+        }
         const auto clock =
             (field == since_what::SINCE_OCLOCK) ? file->otime() : file->ctime();
         if (!clock.has_value()) {
           return std::nullopt;
         }
-
-        return folly::variant_match(
-            since.since,
-            [&](const QuerySince::Timestamp& since_ts) -> std::optional<bool> {
-              return clock->timestamp >= since_ts.time;
-            },
-            [&](const QuerySince::Clock& since_clock) -> std::optional<bool> {
-              if (since_clock.is_fresh_instance) {
-                return file->exists();
-              }
-              return clock->ticks > since_clock.ticks;
-            });
-      }
-      case since_what::SINCE_MTIME: {
-        auto stat = file->stat();
-        if (!stat.has_value()) {
-          return std::nullopt;
+        if (mode_ == CompareMode::Ticks) {
+          return int64_t(clock->ticks) > threshold_;
         }
-        tval = stat->mtime.tv_sec;
-        break;
+        return int64_t(clock->timestamp) >= threshold_;
       }
+      case since_what::SINCE_MTIME:
       case since_what::SINCE_CTIME: {
+        // parse() guarantees a timestamp spec for these fields.
         auto stat = file->stat();
         if (!stat.has_value()) {
           return std::nullopt;
         }
-        tval = stat->ctime.tv_sec;
-        break;
+        auto tval = field == since_what::SINCE_MTIME ? stat->mtime.tv_sec
+                                                     : stat->ctime.tv_sec;
+        return int64_t(tval) >= threshold_;
       }
     }
+    return std::nullopt;
+  }
 
-    auto* since_ts = std::get_if<QuerySince::Timestamp>(&since.since);
-    w_check(since_ts, "expect a timestamp since");
-    return tval >= since_ts->time;
+  w_string_piece name() const override {
+    return "since";
   }
 
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref& term) {
@@ -12,6 +12,7 @@
 #include "watchman/query/QueryExpr.h"
 #include "watchman/query/TermRegistry.h"
 
+#include <algorithm>
 #include <memory>
 #include <unordered_set>
 
@@ -19,12 +20,30 @@ using namespace watchman;
 
 class SuffixExpr : public QueryExpr {
   std::unordered_set<w_string> suffixSet_;
+  // Dictionary ids of the suffixes above, sorted.  File records capture
+  // their suffix id at insert time, so results that expose one match
+  // with an integer search instead of deriving the suffix per file.
+  std::vector<uint32_t> suffixIds_;
 
  public:
   explicit SuffixExpr(std::unordered_set<w_string>&& suffixSet)
-      : suffixSet_(std::move(suffixSet)) {}
+      : suffixSet_(std::move(suffixSet)) {
+    // Interning (rather than merely looking up) guarantees ids exist
+    // even for suffixes no file has used yet; a file observed later
+    // with that suffix will resolve to the same id.
+    suffixIds_.reserve(suffixSet_.size());
+    for (auto const& suffix : suffixSet_) {
+      suffixIds_.push_back(internSuffixId(suffix));
+    }
+    std::sort(suffixIds_.begin(), suffixIds_.end());
+  }
 
   EvaluateResult evaluate(QueryContextBase*, FileResult* file) override {
+    if (auto id = file->suffixId()) {
+      // Id 0 means the name has no suffix; dictionary ids start at 1,
+      // so it never appears in suffixIds_.
+      return std::binary_search(suffixIds_.begin(), suffixIds_.end(), *id);
+    }
     if (suffixSet_.size() < 3) {
       // For small suffix sets, benchmarks indicated that iteration provides
       // better performance since no suffix allocation is necessary.
@@ -39,6 +58,10 @@ class SuffixExpr : public QueryExpr {
     return suffix && (suffixSet_.find(*suffix) != suffixSet_.end());
   }
 
+  w_string_piece name() const override {
+    return "suffix";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref& term) {
     std::unordered_set<w_string> suffixSet;
 
@@ -60,10 +83,10 @@ class SuffixExpr : public QueryExpr {
           throw QueryParseError(
               "Argument 2 to 'suffix' must be either a string or an array of string");
         }
-        suffixSet.insert(json_to_w_string(ele).piece().asLowerCase());
+        suffixSet.insert(json_to_w_string(ele).asLowerCase());
       }
     } else if (suffix.isString()) {
-      suffixSet.insert(json_to_w_string(suffix).piece().asLowerCase());
+      suffixSet.insert(json_to_w_string(suffix).asLowerCase());
     } else {
       throw QueryParseError(
           "Argument 2 to 'suffix' must be either a string or an array of string");
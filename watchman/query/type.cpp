@@ -18,9 +18,35 @@ using namespace watchman;
 
 class TypeExpr : public QueryExpr {
   char arg;
+  // Compiled form of `arg`: when the file record carries a known dtype,
+  // evaluation is a single byte compare against this.  DType::Unknown
+  // marks the types with no dtype representation (eg: Solaris doors),
+  // which always take the mode fallback below.
+  DType expected_;
+
+  static DType dtypeForArg(char arg) {
+    switch (arg) {
+      case 'b':
+        return DType::Block;
+      case 'c':
+        return DType::Char;
+      case 'p':
+        return DType::Fifo;
+      case 's':
+        return DType::Socket;
+      case 'd':
+        return DType::Dir;
+      case 'f':
+        return DType::Regular;
+      case 'l':
+        return DType::Symlink;
+      default:
+        return DType::Unknown;
+    }
+  }
 
  public:
-  explicit TypeExpr(char arg) : arg(arg) {}
+  explicit TypeExpr(char arg) : arg(arg), expected_(dtypeForArg(arg)) {}
 
   EvaluateResult evaluate(QueryContextBase*, FileResult* file) override {
     auto optionalDtype = file->dtype();
@@ -28,23 +54,8 @@ class TypeExpr : public QueryExpr {
       return std::nullopt;
     }
     auto dtype = *optionalDtype;
-    if (dtype != DType::Unknown) {
-      switch (arg) {
-        case 'b':
-          return dtype == DType::Block;
-        case 'c':
-          return dtype == DType::Char;
-        case 'p':
-          return dtype == DType::Fifo;
-        case 's':
-          return dtype == DType::Socket;
-        case 'd':
-          return dtype == DType::Dir;
-        case 'f':
-          return dtype == DType::Regular;
-        case 'l':
-          return dtype == DType::Symlink;
-      }
+    if (dtype != DType::Unknown && expected_ != DType::Unknown) {
+      return dtype == expected_;
     }
 
     auto stat = file->stat();
@@ -78,6 +89,10 @@ class TypeExpr : public QueryExpr {
     }
   }
 
+  w_string_piece name() const override {
+    return "type";
+  }
+
   static std::unique_ptr<QueryExpr> parse(Query*, const json_ref& term) {
     const char *typestr, *found;
     char arg;
@@ -8,13 +8,17 @@
 #pragma once
 
 #include <memory>
+#include <system_error>
 #include <unordered_map>
+#include <vector>
 #include "watchman/Clock.h"
 #include "watchman/CookieSync.h"
 #include "watchman/IgnoreSet.h"
 #include "watchman/PendingCollection.h"
 #include "watchman/PubSub.h"
 #include "watchman/Serde.h"
+#include "watchman/query/MatchedSetCache.h"
+#include "watchman/query/QueryResultCache.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/fs/FileSystem.h"
 #include "watchman/thirdparty/jansson/jansson.h"
@@ -97,7 +101,9 @@ class RootConfig {
   /* filesystem type name, as returned by w_fstype() */
   const w_string fs_type;
   const CaseSensitivity case_sensitive;
-  const IgnoreSet ignore;
+  /* Hot-swappable so that ignore_dirs edits in .watchmanconfig take
+   * effect live; see Root::reloadConfigFile(). */
+  LiveIgnoreSet ignore;
 };
 
 /**
@@ -112,6 +118,7 @@ IgnoreSet computeIgnoreSet(
 
 struct RootRecrawlInfo : serde::Object {
   int64_t count;
+  int64_t subtree_count;
   bool should_recrawl;
   std::optional<w_string> warning;
   w_string reason;
@@ -122,6 +129,7 @@ struct RootRecrawlInfo : serde::Object {
   template <typename X>
   void map(X& x) {
     x("count", count);
+    x("subtree-count", subtree_count);
     x("should-recrawl", should_recrawl);
     x("warning", warning);
     x("reason", reason);
@@ -159,6 +167,21 @@ struct RootQueryInfo : serde::Object {
   }
 };
 
+struct RootPendingSpillInfo : serde::Object {
+  int64_t queue_depth;
+  int64_t spool_depth;
+  int64_t spilled_total;
+  int64_t replayed_total;
+
+  template <typename X>
+  void map(X& x) {
+    x("queue_depth", queue_depth);
+    x("spool_depth", spool_depth);
+    x("spilled_total", spilled_total);
+    x("replayed_total", replayed_total);
+  }
+};
+
 struct RootDebugStatus : serde::Object {
   w_string path;
   w_string fstype;
@@ -174,6 +197,8 @@ struct RootDebugStatus : serde::Object {
   bool cancelled;
   bool enable_parallel_crawl;
   w_string crawl_status;
+  std::optional<w_string> thread_placement;
+  std::optional<RootPendingSpillInfo> pending_spill;
 
   template <typename X>
   void map(X& x) {
@@ -191,6 +216,8 @@ struct RootDebugStatus : serde::Object {
     x("cancelled", cancelled);
     x("crawl-status", crawl_status);
     x("enable_parallel_crawl", enable_parallel_crawl);
+    x("thread_placement", thread_placement);
+    x("pending_spill", pending_spill);
   }
 };
 
@@ -218,32 +245,50 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
 
   CookieSync cookies;
 
-  /* mutable config items */
+  /* mutable config items; re-derived live by reloadConfigFile() */
   std::atomic<bool> enable_parallel_crawl;
 
-  /* config options loaded via json file */
+  /* config options loaded via json file.  config_file is the snapshot
+   * taken when the watch was established (reported by watch-list);
+   * config itself observes reloads. */
   std::optional<json_ref> config_file;
   Configuration config;
 
-  const std::chrono::milliseconds trigger_settle{0};
+  std::atomic<std::chrono::milliseconds> trigger_settle{
+      std::chrono::milliseconds(0)};
   /**
    * Don't GC more often than this.
    *
    * If zero, then never age out.
    */
-  const std::chrono::seconds gc_interval{DEFAULT_GC_INTERVAL};
+  std::atomic<std::chrono::seconds> gc_interval{
+      std::chrono::seconds(DEFAULT_GC_INTERVAL)};
   /**
    * When GCing, age out files older than this.
    */
-  const std::chrono::seconds gc_age{DEFAULT_GC_AGE};
-  const std::chrono::seconds idle_reap_age{0};
+  std::atomic<std::chrono::seconds> gc_age{std::chrono::seconds(DEFAULT_GC_AGE)};
+  std::atomic<std::chrono::seconds> idle_reap_age{std::chrono::seconds(0)};
 
   // Stream of broadcast unilateral items emitted by this root
   std::shared_ptr<Publisher> unilateralResponses;
 
+  // Cache of recently executed query results, valid only while the
+  // root's clock position is unchanged.  Sized by the
+  // query_cache_entries config key; zero disables it.
+  QueryResultCache queryCache;
+
+  // Cache of matched-file snapshots keyed by spec-minus-fields, letting
+  // queries that differ only in field list share one generation and
+  // evaluation pass and pay for rendering alone.  Sized by the
+  // matched_set_cache_entries config key; zero disables it.
+  MatchedSetCache matchedSetCache;
+
   struct RecrawlInfo {
     /* how many times we've had to recrawl */
     uint64_t recrawlCount = 0;
+    /* how many times a scoped overflow let us re-crawl just one subtree
+     * instead of the whole root; see scheduleSubtreeRecrawl() */
+    uint64_t subtreeRecrawlCount = 0;
     /* if true, we've decided that we should re-crawl the root
      * for the sake of ensuring consistency */
     bool shouldRecrawl = true;
@@ -251,6 +296,26 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
     w_string reason{"startup"};
     // Last ad-hoc warning message
     std::optional<w_string> warning;
+    /* Structured open-error records accumulated by handle_open_errno().
+     * Formatting is deferred until a reader calls renderWarning(), so an
+     * error storm during the crawl pays for bookkeeping only.  One record
+     * is kept per failing subtree; later errors beneath a recorded
+     * directory just bump that record's counter. */
+    struct OpenError {
+      w_string path;
+      const char* sysCall;
+      std::error_code err;
+      // errors folded into this record because their path lives under
+      // `path`
+      uint64_t collapsed;
+    };
+    std::vector<OpenError> openErrors;
+    // errors discarded outright once openErrors reached its cap
+    uint64_t droppedOpenErrors = 0;
+    /* Renders `warning` together with the open-error records into the
+     * warning text shown to clients.  The caller holds the recrawlInfo
+     * lock. */
+    std::optional<w_string> renderWarning() const;
     std::chrono::steady_clock::time_point crawlStart;
     std::chrono::steady_clock::time_point crawlFinish;
     // Number of statPath() called during recrawl
@@ -265,6 +330,12 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
   // transitions
   std::atomic<uint32_t> stateTransCount{0};
   folly::Synchronized<ClientStateAssertions> assertedStates;
+  // Bumped after every mutation of assertedStates: queueing or removing
+  // an assertion as well as disposition changes. Subscription dispatch
+  // compares this against a cached value so that the settle path only
+  // takes the assertedStates lock when the asserted-state set has
+  // actually changed.
+  std::atomic<uint64_t> assertedStatesVersion{1};
 
   struct Inner {
     /**
@@ -322,8 +393,26 @@ class Root : public RootConfig, public std::enable_shared_from_this<Root> {
       std::chrono::milliseconds settle_period);
   CookieSync::SyncResult syncToNow(std::chrono::milliseconds timeout);
   void scheduleRecrawl(const char* why);
+  // Re-crawl only the named subtree rather than the whole root, for
+  // watchers whose overflow reports carry a path.  The subtree is fed
+  // through the view's pending stream as a recursive, desynced re-stat,
+  // so clocks elsewhere in the tree are preserved.  Falls back to
+  // scheduleRecrawl() when the path does not name a proper subtree or
+  // the view cannot scope the work.
+  void scheduleSubtreeRecrawl(const w_string& path, const char* why);
   void recrawlTriggered(const char* why);
 
+  // Re-reads <root>/.watchmanconfig, swaps the Configuration snapshot,
+  // and re-derives the tunables cached on this Root (settle window, gc
+  // and reap ages, parallel crawl) so they take effect without a
+  // watch-del cycle.  The ignore set is updated live as well: newly
+  // ignored subtrees are tombstoned out of the view in background
+  // slices and newly unignored ones are crawled incrementally.  Other
+  // structural options -- cookie location, watcher choice -- still
+  // require a re-watch.  Invoked by the io thread when it observes a
+  // change to the config file.
+  void reloadConfigFile();
+
   // Requests cancellation of the root.
   // Returns true if this request caused the root cancellation, false
   // if it was already in the process of being cancelled.
@@ -11,17 +11,18 @@
 using namespace watchman;
 
 void Root::considerAgeOut() {
-  if (gc_interval.count() == 0) {
+  auto interval = gc_interval.load(std::memory_order_acquire);
+  if (interval.count() == 0) {
     return;
   }
 
   auto now = std::chrono::system_clock::now();
-  if (now <= view()->getLastAgeOutTimeStamp() + gc_interval) {
+  if (now <= view()->getLastAgeOutTimeStamp() + interval) {
     // Don't check too often
     return;
   }
 
-  performAgeOut(gc_age);
+  performAgeOut(gc_age.load(std::memory_order_acquire));
 }
 
 void Root::performAgeOut(std::chrono::seconds min_age) {
@@ -11,32 +11,26 @@
 #endif
 
 void watchman_file::removeFromFileList() {
-  if (next) {
-    next->prev = prev;
-  }
-  // file->prev points to the address of either
-  // `previous_file->next` OR `root->inner.latest_file`.
-  // This next assignment is therefore fixing up either
-  // the linkage from the prior file node or from the
-  // head of the list.
-  if (prev) {
-    *prev = next;
-  }
+  watchman::RecencyListOps::unlink(this);
+}
+
+void watchman_file::removeFromSuffixList() {
+  watchman::SuffixListOps::unlink(this);
 }
 
 /* We embed our name string in the tail end of the struct that we're
- * allocating here.  This turns out to be more memory efficient due
- * to the way that the allocator bins sizeof(watchman_file); there's
- * a bit of unusable space after the end of the structure that happens
- * to be about the right size to fit a typical filename.
- * Embedding the name in the end allows us to make the most of this
- * memory and free up the separate heap allocation for file_name.
+ * allocating here.  This frees up the separate heap allocation for
+ * file_name, and since nodes are carved out of the view's arena slabs
+ * back to back, crawl-ordered records (and their names) end up
+ * contiguous in memory, which makes full file-list scans cache
+ * friendly.
  */
 std::unique_ptr<watchman_file, watchman_dir::Deleter> watchman_file::make(
     const w_string& name,
-    watchman_dir* parent) {
-  auto file = (watchman_file*)calloc(
-      1, sizeof(watchman_file) + sizeof(uint32_t) + name.size() + 1);
+    watchman_dir* parent,
+    watchman::FileNodeArena& arena) {
+  auto file = (watchman_file*)arena.allocate(
+      sizeof(watchman_file) + sizeof(uint32_t) + name.size() + 1);
   std::unique_ptr<watchman_file, watchman_dir::Deleter> filePtr(
       file, watchman_dir::Deleter());
 
@@ -55,11 +49,12 @@ std::unique_ptr<watchman_file, watchman_dir::Deleter> watchman_file::make(
 
 watchman_file::~watchman_file() {
   removeFromFileList();
+  removeFromSuffixList();
 }
 
 void free_file_node(struct watchman_file* file) {
   file->~watchman_file();
-  free(file);
+  watchman::FileNodeArena::deallocate(file);
 }
 
 /* vim:ts=2:sw=2:et:
@@ -7,12 +7,14 @@
 
 #include <fmt/core.h>
 #include <folly/String.h>
+#include <algorithm>
 #include "watchman/Logging.h"
 #include "watchman/QueryableView.h"
 #include "watchman/TriggerCommand.h"
 #include "watchman/fs/DirHandle.h"
 #include "watchman/fs/FSDetect.h"
 #include "watchman/root/Root.h"
+#include "watchman/root/resolve.h"
 #include "watchman/root/watchlist.h"
 
 namespace watchman {
@@ -158,7 +160,7 @@ w_string computeCookieDir(
     const w_string& root_path,
     const Configuration& config,
     CaseSensitivity case_sensitive,
-    const IgnoreSet& ignore) {
+    const LiveIgnoreSet& ignore) {
   auto ignores = getIgnoreVcs(config);
   for (auto& jignore : ignores.array()) {
     if (!jignore.isString()) {
@@ -232,6 +234,10 @@ IgnoreSet computeIgnoreSet(
     result.add(fullname, true);
   }
 
+  // The set is frozen from here on; compile it into the flat matcher
+  // that isIgnored runs on the hot notify and crawl paths.
+  result.compile();
+
   return result;
 }
 
@@ -247,16 +253,22 @@ Root::Root(
       cookies(
           fileSystem,
           computeCookieDir(root_path, config_, case_sensitive, ignore)),
-      enable_parallel_crawl{config_.getBool("enable_parallel_crawl", false)},
+      enable_parallel_crawl{config_.getBool("enable_parallel_crawl", true)},
       config_file(std::move(config_file)),
       config(std::move(config_)),
-      trigger_settle(int(config.getInt("settle", kDefaultSettlePeriod))),
-      gc_interval(
-          int(config.getInt("gc_interval_seconds", DEFAULT_GC_INTERVAL))),
-      gc_age(int(config.getInt("gc_age_seconds", DEFAULT_GC_AGE))),
-      idle_reap_age(
-          int(config.getInt("idle_reap_age_seconds", kDefaultReapAge))),
+      trigger_settle(std::chrono::milliseconds(
+          config.getInt("settle", kDefaultSettlePeriod))),
+      gc_interval(std::chrono::seconds(
+          config.getInt("gc_interval_seconds", DEFAULT_GC_INTERVAL))),
+      gc_age(std::chrono::seconds(config.getInt("gc_age_seconds", DEFAULT_GC_AGE))),
+      idle_reap_age(std::chrono::seconds(
+          config.getInt("idle_reap_age_seconds", kDefaultReapAge))),
       unilateralResponses(std::make_shared<Publisher>()),
+      queryCache(size_t(
+          std::max<json_int_t>(0, config.getInt("query_cache_entries", 16)))),
+      matchedSetCache(size_t(std::max<json_int_t>(
+          0,
+          config.getInt("matched_set_cache_entries", 16)))),
       view_{std::move(view)},
       saveGlobalStateHook_{std::move(saveGlobalStateHook)} {
   // This just opens and releases the dir.  If an exception is thrown
@@ -284,6 +296,76 @@ Root::~Root() {
   --live_roots;
 }
 
+void Root::reloadConfigFile() {
+  std::optional<json_ref> cfg;
+  try {
+    cfg = load_root_config(root_path.c_str());
+  } catch (const std::exception& exc) {
+    log(ERR,
+        root_path,
+        ": ignoring unparseable .watchmanconfig: ",
+        exc.what(),
+        "\n");
+    return;
+  }
+
+  config.reload(std::move(cfg));
+
+  // Re-derive the tunables cached on this Root.  Everything else reads
+  // through `config` and picks up the new snapshot on its own.
+  enable_parallel_crawl.store(
+      config.getBool("enable_parallel_crawl", true),
+      std::memory_order_release);
+  trigger_settle.store(std::chrono::milliseconds(
+      config.getInt("settle", kDefaultSettlePeriod)));
+  gc_interval.store(std::chrono::seconds(
+      config.getInt("gc_interval_seconds", DEFAULT_GC_INTERVAL)));
+  gc_age.store(
+      std::chrono::seconds(config.getInt("gc_age_seconds", DEFAULT_GC_AGE)));
+  idle_reap_age.store(std::chrono::seconds(
+      config.getInt("idle_reap_age_seconds", kDefaultReapAge)));
+
+  // Apply ignore_dirs edits live rather than requiring a re-watch.
+  // The new set is swapped in first so the crawls queued below run
+  // against it; statPath() turns a recursive re-scan of a path the new
+  // set ignores into a subtree tombstone, drained in background slices.
+  auto next = computeIgnoreSet(root_path, config);
+  auto prev = ignore.get();
+
+  std::vector<w_string> newlyIgnored;
+  for (auto& dir : next.getIgnoredDirs()) {
+    if (!prev->isIgnoreDir(dir)) {
+      newlyIgnored.push_back(dir);
+    }
+  }
+  std::vector<w_string> newlyUnignored;
+  for (auto& dir : prev->getIgnoredDirs()) {
+    if (!next.isIgnoreDir(dir)) {
+      newlyUnignored.push_back(dir);
+    }
+  }
+
+  // Swap unconditionally: ignore_vcs edits carry no dir list to diff
+  // but take effect for future crawls through the same snapshot.
+  ignore.swap(std::move(next));
+
+  if (!newlyIgnored.empty() || !newlyUnignored.empty()) {
+    // During a recrawl the view may be briefly unset.
+    if (auto view = this->view()) {
+      for (auto& dir : newlyUnignored) {
+        log(ERR, root_path, ": no longer ignoring ", dir, "; crawling it\n");
+        view->rescanSubtree(dir);
+      }
+      for (auto& dir : newlyIgnored) {
+        log(ERR, root_path, ": now ignoring ", dir, "; dropping it\n");
+        view->rescanSubtree(dir);
+      }
+    }
+  }
+
+  log(ERR, root_path, ": reloaded .watchmanconfig\n");
+}
+
 void Root::addPerfSampleMetadata(PerfSample& sample) const {
   // Note: if the root lock isn't held, we may read inaccurate numbers for
   // some of these properties.  We're ok with that, and don't want to force
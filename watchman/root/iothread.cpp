@@ -6,9 +6,14 @@
  */
 
 #include <fmt/chrono.h>
+#include <algorithm>
 #include <chrono>
+#include <limits>
+#include <unordered_set>
 #include "watchman/Errors.h"
 #include "watchman/InMemoryView.h"
+#include "watchman/MemoryAccounting.h"
+#include "watchman/TimerWheel.h"
 #include "watchman/fs/ParallelWalk.h"
 #include "watchman/root/Root.h"
 #include "watchman/root/warnerr.h"
@@ -34,6 +39,15 @@ void InMemoryView::fullCrawl(
 
   PerfSample sample("full-crawl");
 
+  // On a recrawl the view is already fully populated and the crawl below
+  // only reconciles stat data, so any intermediate state is as consistent
+  // as the one queries observe between steady-state batches; that lets us
+  // yield the write lock between batches further down.  The initial crawl
+  // holds the lock except between hint phases, and synchronized queries
+  // are admitted only once their scope has been fully covered (see the
+  // scoped waitUntilReadyToQuery), so they never see a partial view.
+  const bool isRecrawl = root->recrawlInfo.rlock()->recrawlCount > 0;
+
   auto view = view_.wlock();
   // Ensure that we observe these files with a new, distinct clock,
   // otherwise a fresh subscription established immediately after a watch
@@ -44,25 +58,109 @@ void InMemoryView::fullCrawl(
   root->recrawlInfo.wlock()->statCount = fullCrawlStatCount_;
 
   auto start = std::chrono::system_clock::now();
-  pendingFromWatcher.lock()->add(root->root_path, start, W_PENDING_RECURSIVE);
-  while (true) {
-    // There is the potential for a subtle race condition here.  Since we now
-    // coalesce overlaps we must consume our outstanding set before we merge
-    // in any new kernel notification information or we risk missing out on
-    // observing changes that happen during the initial crawl.  This
-    // translates to a two level loop; the outer loop sweeps in data from
-    // inotify, then the inner loop processes it and any dirs that we pick up
-    // from recursive processing.
-    {
-      auto lock = pendingFromWatcher.lock();
-      localPending.append(lock->stealItems(), lock->stealSyncs());
+
+  // If a previous incarnation of the daemon left a view snapshot behind,
+  // seed the view from it before crawling. The crawl below then acts as
+  // a reconciliation pass: statPath only ticks entries whose stat data
+  // actually changed, so otimes recorded before the restart survive it.
+  // Only an empty view is seeded; a recrawl has fresher data in memory.
+  if (!view->getLatestFile()) {
+    auto* snapshotPath = config_.getString("view_snapshot_path", "");
+    if (*snapshotPath) {
+      loadViewSnapshot(*view, w_string{snapshotPath});
     }
-    if (localPending.empty()) {
-      break;
+  }
+
+  // Subtree scopes that recent queries cared about, recorded by
+  // prepareForQuery and persisted in the view snapshot by the previous
+  // incarnation.  An initial crawl covers each of them as its own phase
+  // before sweeping the whole tree, so queries scoped under a finished
+  // hint can be admitted (via the scoped waitUntilReadyToQuery) while
+  // the bulk of the crawl is still running.  The root sweep revisits
+  // hinted subtrees, but their dirents and stat data are freshly cached
+  // so the second pass over them is cheap.  A recrawl skips all this:
+  // its view is already populated and queries interleave via the yields
+  // below.
+  std::vector<w_string> hints;
+  if (!isRecrawl) {
+    hints = crawlHints_.copy();
+  }
+
+  // waitUntilReadyToQuery() (the unscoped form) promises whole-view
+  // readiness, so syncs that drain during a hint phase must not be
+  // resolved by it; they are parked here and completed once the final
+  // full-tree drain is done.
+  std::vector<PendingSync> heldSyncs;
+  bool holdSyncs = false;
+
+  auto drainPending = [&] {
+    while (true) {
+      // There is the potential for a subtle race condition here.  Since we
+      // now coalesce overlaps we must consume our outstanding set before we
+      // merge in any new kernel notification information or we risk missing
+      // out on observing changes that happen during the initial crawl.  This
+      // translates to a two level loop; the outer loop sweeps in data from
+      // inotify, then the inner loop processes it and any dirs that we pick
+      // up from recursive processing.
+      {
+        auto lock = pendingFromWatcher.lock();
+        localPending.append(lock->stealItems(), lock->stealSyncs());
+      }
+      if (holdSyncs) {
+        auto syncs = localPending.stealSyncs();
+        heldSyncs.insert(
+            heldSyncs.end(),
+            std::make_move_iterator(syncs.begin()),
+            std::make_move_iterator(syncs.end()));
+      }
+      if (localPending.empty()) {
+        break;
+      }
+
+      (void)processAllPending(root, view, localPending);
+
+      if (isRecrawl) {
+        // Let queries interleave with the recrawl instead of stalling
+        // until the whole tree has been revisited.  Each batch gets a
+        // fresh tick after we reacquire the lock so that a clock read
+        // during the gap orders correctly against later batches.
+        view.unlock();
+        view = view_.wlock();
+        mostRecentTick_.fetch_add(1, std::memory_order_acq_rel);
+      }
     }
+  };
 
-    (void)processAllPending(root, *view, localPending);
+  // Hint phases must be enqueued and drained one at a time: the pending
+  // collection coalesces overlapping recursive adds, so a hint queued
+  // alongside the root item (or a broader hint) would be absorbed into
+  // it and lose its priority.
+  holdSyncs = true;
+  for (auto& hint : hints) {
+    pendingFromWatcher.lock()->add(hint, start, W_PENDING_RECURSIVE);
+    drainPending();
+    markSubtreeReady(hint);
+    // Open an admission window for queries scoped under the subtree
+    // that just completed; they grab the view lock in the gap.  The
+    // fresh tick keeps clock reads taken in the gap ordered against
+    // the remaining phases.  Only readiness-gated (or explicitly
+    // stale-tolerant) queries can observe the view here, and for them
+    // the hinted subtree is complete and current.
+    view.unlock();
+    view = view_.wlock();
+    mostRecentTick_.fetch_add(1, std::memory_order_acq_rel);
   }
+  holdSyncs = false;
+
+  pendingFromWatcher.lock()->add(root->root_path, start, W_PENDING_RECURSIVE);
+  drainPending();
+
+  // A reconciliation crawl over a seeded view may have queued deferred
+  // subtree deletes for dirs that vanished while the daemon was down;
+  // apply them before declaring the initial crawl complete.
+  view->processDeferredDeletes(
+      getClock(std::chrono::system_clock::now()),
+      std::numeric_limits<size_t>::max());
 
   auto recrawlInfo = root->recrawlInfo.wlock();
   recrawlInfo->shouldRecrawl = false;
@@ -79,6 +177,14 @@ void InMemoryView::fullCrawl(
 
   root->cookies.abortAllCookies();
 
+  // The final drain above swept the whole tree, so the syncs parked
+  // during the hint phases (and any scoped readiness waiters still
+  // outstanding) can now be completed.
+  for (auto& sync : heldSyncs) {
+    sync.complete();
+  }
+  finishScopedReadiness();
+
   root->addPerfSampleMetadata(sample);
 
   sample.finish();
@@ -127,11 +233,37 @@ InMemoryView::Continue InMemoryView::doSettleThings(
     // There is another settle pending, so only wait until then.
     state.currentTimeout = *nextPendingSettle - sinceUnsettle;
   } else {
-    state.currentTimeout =
-        std::min(state.biggestTimeout, state.currentTimeout * 2);
+    // The root is idle.  Park the next housekeeping deadline (age-out,
+    // reap, the next compaction slice) on the shared timer wheel and
+    // wait with no timeout of our own; the wheel folds every idle
+    // root's deadline into its slots, so the process takes one wakeup
+    // per due instant rather than one timed wait per root.  The
+    // doubling ladder is unchanged, it just lives on the wheel now.
+    state.idleBackoff = std::min(
+        state.biggestTimeout,
+        state.idleBackoff.count() ? state.idleBackoff * 2
+                                  : root.trigger_settle.load());
+    if (state.idleTimer) {
+      TimerWheel::get().cancel(state.idleTimer);
+    }
+    state.idleTimer = TimerWheel::get().schedule(
+        state.idleBackoff, [weakView = weak_from_this()] {
+          if (auto view = std::static_pointer_cast<InMemoryView>(
+                  weakView.lock())) {
+            view->pendingFromWatcher_.lock()->ping();
+          }
+        });
+    state.currentTimeout = std::chrono::milliseconds(-1);
   }
 
   root.considerAgeOut();
+
+  // The root is idle right now: no pending items and no queries
+  // blocked on us.  Fold a bounded slice of deleted-node compaction
+  // into the quiet window so dead nodes don't pile up between full
+  // age-out sweeps.
+  compactSlice(root);
+
   return Continue::Continue;
 }
 
@@ -142,13 +274,18 @@ void InMemoryView::clientModeCrawl(const std::shared_ptr<Root>& root) {
 
 namespace {
 
+// How much deferred-delete marking to apply per IO thread wakeup while
+// otherwise idle; between slices the thread polls the watcher so a huge
+// deleted tree doesn't starve event intake.
+constexpr size_t kDeferredDeleteSliceSize = 4096;
+
 std::chrono::milliseconds getBiggestTimeout(const Root& root) {
-  std::chrono::milliseconds biggest_timeout = root.gc_interval;
+  std::chrono::milliseconds biggest_timeout = root.gc_interval.load();
+  auto reap_age = root.idle_reap_age.load();
 
   if (biggest_timeout.count() == 0 ||
-      (root.idle_reap_age.count() != 0 &&
-       root.idle_reap_age < biggest_timeout)) {
-    biggest_timeout = root.idle_reap_age;
+      (reap_age.count() != 0 && reap_age < biggest_timeout)) {
+    biggest_timeout = reap_age;
   }
   if (biggest_timeout.count() == 0) {
     biggest_timeout = std::chrono::hours(24);
@@ -159,11 +296,28 @@ std::chrono::milliseconds getBiggestTimeout(const Root& root) {
 } // namespace
 
 void InMemoryView::ioThread(const std::shared_ptr<Root>& root) {
+  // json built on this thread (settle payloads, warnings) is attributed
+  // to the view subsystem in debug-memory.
+  MemoryScope memScope{MemorySubsystem::View};
+
   IoThreadState state{getBiggestTimeout(*root)};
-  state.currentTimeout = root->trigger_settle;
+  state.currentTimeout = root->trigger_settle.load();
 
   while (Continue::Continue == stepIoThread(root, state, pendingFromWatcher_)) {
   }
+
+  if (state.idleTimer) {
+    TimerWheel::get().cancel(state.idleTimer);
+  }
+
+  // Persist the view for the next incarnation of the daemon, but only
+  // once the initial crawl completed; reconciling against a partial view
+  // would manufacture a pile of spurious deletes.
+  auto* snapshotPath = config_.getString("view_snapshot_path", "");
+  if (*snapshotPath &&
+      root->inner.done_initial.load(std::memory_order_acquire)) {
+    saveViewSnapshot(w_string{snapshotPath});
+  }
 }
 
 InMemoryView::Continue InMemoryView::stepIoThread(
@@ -178,7 +332,14 @@ InMemoryView::Continue InMemoryView::stepIoThread(
     state.lastUnsettle = std::chrono::steady_clock::now();
     // Reduce sleep timeout to the settle duration ready for the next loop
     // through.
-    state.currentTimeout = root->trigger_settle;
+    state.currentTimeout = root->trigger_settle.load();
+    // Fresh activity restarts the idle housekeeping ladder; drop any
+    // wheel deadline from the previous idle spell.
+    state.idleBackoff = std::chrono::milliseconds(0);
+    if (state.idleTimer) {
+      TimerWheel::get().cancel(state.idleTimer);
+      state.idleTimer = nullptr;
+    }
   };
 
   if (!root->inner.done_initial.load(std::memory_order_acquire)) {
@@ -198,6 +359,17 @@ InMemoryView::Continue InMemoryView::stepIoThread(
     logf(DBG, " ... wake up\n");
     state.localPending.append(
         targetPendingLock->stealItems(), targetPendingLock->stealSyncs());
+    if (!state.localPending.empty()) {
+      // Taken on work the view does not yet reflect; cleared while the
+      // collection lock is still held so the notify thread's idle check
+      // (empty collection + this flag) can never observe a window where
+      // stolen items are in flight but unaccounted for.
+      ioThreadCaughtUp_.store(false, std::memory_order_release);
+    }
+  }
+
+  if (adaptiveSettle_) {
+    coalescePendingEvents(root, state, pendingFromWatcher);
   }
 
   if (root->inner.cancelled.load(std::memory_order_acquire)) {
@@ -212,6 +384,9 @@ InMemoryView::Continue InMemoryView::stepIoThread(
   if (root->recrawlInfo.rlock()->shouldRecrawl) {
     auto info = root->recrawlInfo.wlock();
     info->recrawlCount++;
+    // The view is about to be rebuilt; cookies must flow through the
+    // crawl (and the desync abort) rather than the idle fast path.
+    ioThreadCaughtUp_.store(false, std::memory_order_release);
     root->inner.done_initial.store(false, std::memory_order_release);
     // Now that done_initial is false, the next pass will recrawl.
     return Continue::Continue;
@@ -227,6 +402,27 @@ InMemoryView::Continue InMemoryView::stepIoThread(
   // Waiting for an event timed out or we were woken with a ping, so still
   // consider the root settled.
   if (state.localPending.empty()) {
+    if (view_.rlock()->hasDeferredDeletes()) {
+      // Apply a slice of queued subtree delete marking before we allow
+      // the root to settle; subscribers must not be told we're settled
+      // while deletes they should see are still unapplied.
+      auto view = view_.wlock();
+      mostRecentTick_.fetch_add(1, std::memory_order_acq_rel);
+      auto remaining = view->processDeferredDeletes(
+          getClock(std::chrono::system_clock::now()), kDeferredDeleteSliceSize);
+      markUnsettled(state);
+      if (remaining != 0) {
+        // Come straight back for the next slice, but go through the
+        // poll above so fresh watcher events interleave with the
+        // marking.
+        state.currentTimeout = std::chrono::milliseconds(0);
+      }
+      return Continue::Continue;
+    }
+    // Everything stolen has been applied and no deferred work remains:
+    // from here until the next steal, a cookie observed by the notify
+    // thread with an empty collection can be completed directly.
+    ioThreadCaughtUp_.store(true, std::memory_order_release);
     return doSettleThings(*root, state);
   }
 
@@ -248,7 +444,7 @@ InMemoryView::Continue InMemoryView::stepIoThread(
 
   mostRecentTick_.fetch_add(1, std::memory_order_acq_rel);
 
-  auto isDesynced = processAllPending(root, *view, state.localPending);
+  auto isDesynced = processAllPending(root, view, state.localPending);
   if (isDesynced == IsDesynced::Yes) {
     logf(ERR, "recrawl complete, aborting all pending cookies\n");
     root->cookies.abortAllCookies();
@@ -257,17 +453,108 @@ InMemoryView::Continue InMemoryView::stepIoThread(
   // Always mark unsettled after processing events because settle durations
   // should only include idle time, not time spent processing events.
   markUnsettled(state);
+
+  if (settleSpeculation_) {
+    // Hint subscriptions that a batch just landed so they can pre-render
+    // their payloads while the settle clock runs (see
+    // ClientSubscription::speculativeEvaluate).  Throttled to one hint
+    // per settle period so an event storm costs at most one wasted
+    // speculative evaluation per settle.
+    auto now = std::chrono::steady_clock::now();
+    if (now - state.lastSpeculativeHint >= root->trigger_settle.load()) {
+      state.lastSpeculativeHint = now;
+      root->unilateralResponses->enqueue(
+          json_object({{"pre-settle", json_true()}}));
+    }
+  }
   return Continue::Continue;
 }
 
+namespace {
+// Smoothed per-wakeup batch sizes at or above this many items are
+// treated as an event storm worth coalescing.
+constexpr double kCoalesceBatchThreshold = 32.0;
+} // namespace
+
+void InMemoryView::coalescePendingEvents(
+    const std::shared_ptr<Root>& root,
+    IoThreadState& state,
+    PendingCollection& pendingFromWatcher) {
+  // Fold this wakeup into the arrival-rate estimate. Empty wakeups
+  // participate too so that the window decays once a storm passes.
+  auto stolen = state.localPending.getPendingItemCount();
+  state.smoothedBatchSize = (state.smoothedBatchSize + double(stolen)) / 2.0;
+
+  if (state.smoothedBatchSize >= kCoalesceBatchThreshold) {
+    // Widen the window: start at the settle period and double from
+    // there, so sustained storms are absorbed in ever larger batches.
+    state.coalesceWindow = std::min(
+        adaptiveSettleMax_,
+        state.coalesceWindow.count() ? state.coalesceWindow * 2
+                                     : root->trigger_settle.load());
+  } else {
+    state.coalesceWindow /= 2;
+  }
+  coalesceWindowMs_.store(
+      state.coalesceWindow.count(), std::memory_order_relaxed);
+
+  if (stolen == 0 || state.coalesceWindow.count() == 0) {
+    return;
+  }
+
+  // Keep absorbing events until the window closes so that the whole
+  // burst is paid for with one processAllPending pass. Cookie syncs
+  // and cookie file events abort the window immediately: they sit on
+  // the latency path of every query and must not wait out a storm.
+  auto deadline = std::chrono::steady_clock::now() + state.coalesceWindow;
+  while (!state.localPending.hasSyncs() &&
+         !state.localPending.hasCookieItems()) {
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      break;
+    }
+    if (stopThreads_.load(std::memory_order_acquire) ||
+        root->inner.cancelled.load(std::memory_order_acquire)) {
+      break;
+    }
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - now);
+    auto lock = pendingFromWatcher.lockAndWait(remaining);
+    state.localPending.append(lock->stealItems(), lock->stealSyncs());
+  }
+}
+
+namespace {
+// How many pending items to process between latency-budget checks while
+// draining a batch; keeps the steady_clock reads off the per-item path.
+constexpr size_t kYieldCheckInterval = 1024;
+} // namespace
+
 InMemoryView::IsDesynced InMemoryView::processAllPending(
     const std::shared_ptr<Root>& root,
-    ViewDatabase& view,
+    folly::Synchronized<ViewDatabase>::LockedPtr& view,
     PendingChanges& coll) {
   auto desyncState = IsDesynced::No;
 
+  // A huge batch (say, a 500k-item checkout) would otherwise hold the
+  // view write lock for its entire drain, parking every query behind
+  // it.  Yield the lock on a latency budget so queries interleave with
+  // the drain, taking a fresh tick on reacquisition like the recrawl
+  // interleave in fullCrawl() so clock reads in the gap order correctly
+  // against later slices.  Cookies and syncs are unaffected: they only
+  // resolve after the full drain below, which their ordering guarantee
+  // requires.  The initial crawl must not yield because queries may
+  // never observe a partially populated view.
+  const std::chrono::milliseconds latencyBudget{
+      config_.getInt("io_latency_budget_ms", 50)};
+  const bool mayYieldLock = latencyBudget.count() > 0 &&
+      (root->inner.done_initial.load(std::memory_order_acquire) ||
+       root->recrawlInfo.rlock()->recrawlCount > 0);
+  auto sliceStart = std::chrono::steady_clock::now();
+  size_t itemsSinceCheck = 0;
+
   // Don't resolve any of these until any recursive crawls are done.
-  std::vector<std::vector<folly::Promise<folly::Unit>>> allSyncs;
+  std::vector<std::vector<PendingSync>> allSyncs;
 
   // Don't resolve cookies -- that is, unblock queries -- until all
   // pending paths are processed.  There is no inherent order in
@@ -277,46 +564,86 @@ InMemoryView::IsDesynced InMemoryView::processAllPending(
   // to all pending change events.
   std::vector<w_string> pendingCookies;
 
-  while (!coll.empty()) {
-    logf(
-        DBG,
-        "processing {} events in {}\n",
-        coll.getPendingItemCount(),
-        rootPath_);
-
-    auto pending = coll.stealItems();
-    auto syncs = coll.stealSyncs();
-    if (syncs.empty()) {
-      w_check(
-          pending != nullptr,
-          "coll.stealItems() and coll.size() did not agree about its size");
-    } else {
-      allSyncs.push_back(std::move(syncs));
-    }
+  {
+    // Batch recency-index updates for the whole drain: each touched
+    // file is linked onto a detached chain and the chain is spliced to
+    // the head of the index in one step, instead of paying the head
+    // fixups per file -- a large checkout storm is millions of pointer
+    // writes cheaper this way.  Flushed before every lock yield below
+    // so queries never observe an index missing in-flight files, and
+    // destroyed (final flush) before any cookie or sync is resolved.
+    ViewDatabase::FileChangeBatch batch{*view};
+
+    while (!coll.empty()) {
+      logf(
+          DBG,
+          "processing {} events in {}\n",
+          coll.getPendingItemCount(),
+          rootPath_);
+
+      {
+        // Track how deep the pending queue gets before we drain it;
+        // surfaced via `debug-metrics`.
+        static auto& depthHistogram =
+            perfHistogram(w_string{"pending_queue_depth"});
+        depthHistogram.add(coll.getPendingItemCount());
+      }
 
-    while (pending) {
-      if (!stopThreads_.load(std::memory_order_acquire)) {
-        if (pending->flags & W_PENDING_IS_DESYNCED) {
-          // The watcher is desynced but some cookies might be written to disk
-          // while the recursive crawl is ongoing. We are going to specifically
-          // ignore these cookies during that recursive crawl to avoid a race
-          // condition where cookies might be seen before some files have been
-          // observed as changed on disk. Due to this, and the fact that cookies
-          // notifications might simply have been dropped by the watcher, we
-          // need to abort the pending cookies to force them to be recreated on
-          // disk, and thus re-seen.
-          if (pending->flags & W_PENDING_CRAWL_ONLY) {
-            desyncState = IsDesynced::Yes;
+      auto pending = coll.stealItems();
+      auto syncs = coll.stealSyncs();
+      if (syncs.empty()) {
+        w_check(
+            pending != nullptr,
+            "coll.stealItems() and coll.size() did not agree about its size");
+      } else {
+        allSyncs.push_back(std::move(syncs));
+      }
+
+      while (pending) {
+        if (!stopThreads_.load(std::memory_order_acquire)) {
+          if (pending->flags & W_PENDING_IS_DESYNCED) {
+            // The watcher is desynced but some cookies might be written to
+            // disk while the recursive crawl is ongoing. We are going to
+            // specifically ignore these cookies during that recursive crawl to
+            // avoid a race condition where cookies might be seen before some
+            // files have been observed as changed on disk. Due to this, and
+            // the fact that cookies notifications might simply have been
+            // dropped by the watcher, we need to abort the pending cookies to
+            // force them to be recreated on disk, and thus re-seen.
+            if (pending->flags & W_PENDING_CRAWL_ONLY) {
+              desyncState = IsDesynced::Yes;
+            }
+          }
+
+          // processPath may insert new pending items into `coll`
+          processPath(root, *view, coll, *pending, nullptr, pendingCookies);
+
+          if (mayYieldLock && ++itemsSinceCheck >= kYieldCheckInterval) {
+            itemsSinceCheck = 0;
+            if (std::chrono::steady_clock::now() - sliceStart >=
+                latencyBudget) {
+              batch.flush();
+              view.unlock();
+              view = view_.wlock();
+              mostRecentTick_.fetch_add(1, std::memory_order_acq_rel);
+              sliceStart = std::chrono::steady_clock::now();
+            }
           }
         }
 
-        // processPath may insert new pending items into `coll`
-        processPath(root, view, coll, *pending, nullptr, pendingCookies);
+        // TODO: Document that continuing to run this loop when stopThreads_ is
+        // true fixes a stack overflow when pending is long.
+        pending = std::move(pending->next);
       }
+    }
 
-      // TODO: Document that continuing to run this loop when stopThreads_ is
-      // true fixes a stack overflow when pending is long.
-      pending = std::move(pending->next);
+    if (!pendingCookies.empty() || !allSyncs.empty()) {
+      // Unblocking a cookie or sync promises the caller that the view
+      // reflects everything observed so far, so any deferred subtree
+      // delete marking must land before we notify.
+      view->processDeferredDeletes(
+          getClock(std::chrono::system_clock::now()),
+          std::numeric_limits<size_t>::max());
     }
   }
 
@@ -338,7 +665,7 @@ InMemoryView::IsDesynced InMemoryView::processAllPending(
 
   for (auto& outer : allSyncs) {
     for (auto& sync : outer) {
-      sync.setValue();
+      sync.complete();
     }
   }
 
@@ -401,6 +728,32 @@ void InMemoryView::processPath(
     return;
   }
 
+  if (pending.path == configFilePath_ &&
+      root->inner.done_initial.load(std::memory_order_acquire)) {
+    // The root's config file changed; swap in the new snapshot so the
+    // tunables apply live.  Skipped during the initial crawl, which
+    // observes the file that was already loaded at watch time.
+    root->reloadConfigFile();
+  }
+
+  // Feed the subtree routing log before dispatching, so scoped
+  // subscriptions can tell whether this settle touched them at all.
+  noteChangedPath(pending.path);
+
+  // A desynced recursive rescan re-examines the whole subtree on the
+  // theory that we have no idea what the watcher dropped.  Most
+  // overflows are brief and localized, so first try to bound the damage
+  // by statting a sample of recently active directories; only when the
+  // sample itself looks rotten do we pay for the full crawl.  The
+  // CRAWL_ONLY exclusion keeps the verifier's own targeted re-adds (and
+  // the crawler's internal descent) from being re-intercepted here.
+  if (pending.flags.contains(W_PENDING_IS_DESYNCED) &&
+      pending.flags.contains(W_PENDING_RECURSIVE) &&
+      !pending.flags.contains(W_PENDING_CRAWL_ONLY) &&
+      verifyDesyncedSubtree(root, view, coll, pending)) {
+    return;
+  }
+
   if (pending.path == rootPath_ || (pending.flags & W_PENDING_CRAWL_ONLY)) {
     crawler(root, view, coll, pending, pendingCookies);
   } else {
@@ -410,6 +763,218 @@ void InMemoryView::processPath(
 
 namespace {
 
+/**
+ * One directory chosen for desync verification, together with the
+ * recently changed child file that put it in the sample (when the
+ * sample was drawn from the recency index rather than seeded
+ * explicitly).
+ */
+struct DesyncProbe {
+  w_string dirPath;
+  // The view's node for the directory itself; nullptr when the view has
+  // no such node (the root, or a cookie dir we have not crawled).
+  const watchman_file* dirFile;
+  w_string filePath;
+  const watchman_file* file;
+};
+
+bool statTripleMatches(const FileInformation& a, const FileInformation& b) {
+  return a.ino == b.ino && a.size == b.size &&
+      a.mtime.tv_sec == b.mtime.tv_sec && a.mtime.tv_nsec == b.mtime.tv_nsec;
+}
+
+bool isEqualOrInside(const w_string& path, const w_string& ancestor) {
+  if (path == ancestor) {
+    return true;
+  }
+  return path.size() > ancestor.size() &&
+      w_string_piece{path}.startsWith(ancestor) &&
+      is_slash(path.data()[ancestor.size()]);
+}
+
+} // namespace
+
+bool InMemoryView::verifyDesyncedSubtree(
+    const std::shared_ptr<Root>& root,
+    ViewDatabase& view,
+    PendingChanges& coll,
+    const PendingChange& pending) {
+  const auto sampleSize =
+      size_t(root->config.getInt("desync_sample_size", 64));
+  if (sampleSize == 0 ||
+      !root->inner.done_initial.load(std::memory_order_acquire)) {
+    // Disabled, or we don't yet have a view worth verifying against.
+    return false;
+  }
+
+  if (!(watcher_->flags & WATCHER_PRECISELY_ORDERED)) {
+    // A desync from a precisely ordered watcher is a reported overflow
+    // whose blast radius sampling can bound.  A lossy watcher may have
+    // dropped events silently long before it noticed anything, so a
+    // clean sample proves nothing; take the full recrawl.
+    return false;
+  }
+
+  // Directories whose contents changed most recently are the likeliest
+  // to have absorbed the dropped events, so draw the sample from the
+  // front of the recency index.  The scan is bounded so that
+  // verification stays cheap even when the subtree holds millions of
+  // nodes.
+  constexpr size_t kMaxChainScan = 8192;
+
+  // We are inside the drain's FileChangeBatch scope, so the hottest
+  // files may still be on the detached chain; splice them in before
+  // walking the index or the sample would miss exactly the dirs most
+  // likely to have absorbed the dropped events.
+  view.flushActiveFileChangeBatch();
+
+  std::vector<DesyncProbe> probes;
+  std::unordered_set<w_string> sampledDirs;
+  probes.reserve(sampleSize);
+
+  size_t scanned = 0;
+  for (watchman_file* f = view.getLatestFile();
+       f && scanned < kMaxChainScan && probes.size() < sampleSize;
+       f = f->next, ++scanned) {
+    if (!f->parent) {
+      continue;
+    }
+    auto dirPath = f->parent->getFullPath();
+    if (!isEqualOrInside(dirPath, pending.path)) {
+      continue;
+    }
+    if (!sampledDirs.insert(dirPath).second) {
+      continue;
+    }
+    auto* grandparent = f->parent->parent;
+    const watchman_file* dirFile =
+        grandparent ? grandparent->getChildFile(f->parent->name) : nullptr;
+    probes.push_back(DesyncProbe{
+        std::move(dirPath),
+        dirFile,
+        f->parent->getFullPathToChild(f->getName()),
+        f});
+  }
+
+  if (probes.empty()) {
+    // The view holds nothing recent under this path; nothing to verify
+    // against, so take the regular crawl.
+    return false;
+  }
+
+  // Cookie directories are always verified: a dropped cookie creation
+  // would otherwise leave its query waiting until timeout, since a
+  // clean sample skips the crawl that would have discovered the file.
+  for (auto& cookieDir : root->cookies.cookieDirs()) {
+    if (!isEqualOrInside(cookieDir, pending.path) ||
+        !sampledDirs.insert(cookieDir).second) {
+      continue;
+    }
+    const watchman_file* dirFile = nullptr;
+    if (const watchman_dir* dir = view.resolveDir(cookieDir)) {
+      dirFile = dir->parent ? dir->parent->getChildFile(dir->name) : nullptr;
+    }
+    probes.push_back(DesyncProbe{cookieDir, dirFile, w_string{}, nullptr});
+  }
+
+  size_t mismatches = 0;
+  std::vector<w_string> rescan;
+  for (auto& probe : probes) {
+    // A directory's (ino, size, mtime) triple moves on any name
+    // add/remove within it, so a match rules out structural drops.
+    bool dirOk;
+    try {
+      auto fresh = fileSystem_.getFileInformation(
+          probe.dirPath.c_str(), root->case_sensitive);
+      if (probe.dirFile) {
+        dirOk = probe.dirFile->exists &&
+            statTripleMatches(probe.dirFile->stat, fresh);
+      } else {
+        // No node of its own: the root (matched by inode identity) or a
+        // cookie dir outside the crawled tree (existence is all we know).
+        dirOk = probe.dirPath != rootPath_ || fresh.ino == view.getRootInode();
+      }
+    } catch (const std::system_error&) {
+      dirOk = probe.dirFile && !probe.dirFile->exists;
+    }
+
+    // Content writes don't touch the parent dir's stat, so also verify
+    // the hot child file that nominated this dir for the sample; that
+    // catches dropped modify events on recently active files.
+    bool fileOk = true;
+    if (dirOk && probe.file) {
+      try {
+        auto fresh = fileSystem_.getFileInformation(
+            probe.filePath.c_str(), root->case_sensitive);
+        fileOk = probe.file->exists &&
+            statTripleMatches(probe.file->stat, fresh);
+      } catch (const std::system_error&) {
+        fileOk = !probe.file->exists;
+      }
+    }
+
+    if (!dirOk || !fileOk) {
+      ++mismatches;
+      rescan.push_back(probe.dirPath);
+    }
+  }
+
+  if (mismatches * 8 > probes.size()) {
+    // Discrepancies are widespread, so the unsampled remainder is
+    // likely stale too; the sample can't bound the damage.
+    log(ERR,
+        "desync verification of ",
+        pending.path,
+        " found ",
+        mismatches,
+        " of ",
+        probes.size(),
+        " sampled dirs stale; escalating to a full subtree crawl\n");
+    return false;
+  }
+
+  // The targeted re-adds keep IS_DESYNCED and add CRAWL_ONLY, which is
+  // exactly the combination processAllPending() uses to abort and
+  // recreate outstanding cookies, preserving the desync contract for
+  // the dirs that really do get re-examined.
+  const PendingFlags rescanFlags = (pending.flags & W_PENDING_IS_DESYNCED) |
+      W_PENDING_RECURSIVE | W_PENDING_CRAWL_ONLY;
+  for (auto& path : rescan) {
+    coll.add(path, pending.now, rescanFlags);
+  }
+  log(ERR,
+      "desync verification of ",
+      pending.path,
+      " sampled ",
+      probes.size(),
+      " dirs, ",
+      mismatches,
+      " stale; rescanning only those instead of the whole subtree\n");
+  return true;
+}
+
+namespace {
+
+bool did_file_change(const FileInformation* saved, const FileInformation* fresh);
+
+/**
+ * When a crawl already has stat data in hand (Windows populates it
+ * straight from readdir and the parallel crawler pre-stats every
+ * entry), a plain file whose stat matches what the view holds cannot
+ * produce a change record: statPath() would compare the same data and
+ * leave the file untouched. Recognizing that in the crawler skips the
+ * pending-queue round trip and the statPath() call, which is the bulk
+ * of the cost of an overflow-recovery recrawl over a mostly unchanged
+ * tree. Directories are never considered unchanged here because the
+ * crawl must still descend into them.
+ */
+bool isUnchangedExistingFile(
+    const watchman_file* file,
+    const FileInformation& st) {
+  return file && file->exists && !st.isDir() &&
+      !did_file_change(&file->stat, &st);
+}
+
 void apply_dir_size_hint(watchman_dir* dir, uint32_t ndirs, uint32_t nfiles) {
   if (dir->files.empty() && nfiles > 0) {
     dir->files.reserve(nfiles);
@@ -497,6 +1062,9 @@ void InMemoryView::crawler(
     return;
   }
 
+  // The dir is live on disk; cancel any queued deferred delete for it.
+  view.noteDirObserved(dir);
+
   if (dir->files.empty()) {
     // Pre-size our hash(es) if we can, so that we can avoid collisions
     // and re-hashing during initial crawl
@@ -518,6 +1086,34 @@ void InMemoryView::crawler(
         uint32_t(root->config.getInt("hint_num_files_per_dir", 64)));
   }
 
+  // When the directory's own (ino, size, mtime) triple matches what the
+  // view recorded, readdir can't surface any structural change: no
+  // names were added or removed.  If the watcher also delivers per-file
+  // notifications, content changes to the children arrive on their own,
+  // so a recrawl pass over such a directory only needs the readdir scan
+  // for delete detection and can skip re-statting known plain files.
+  // The exception is a desynced crawl: it exists because the watcher
+  // overflowed and dropped events, so its per-file delivery cannot be
+  // trusted for exactly that window.
+  bool dirStatUnchanged = false;
+#ifndef _WIN32
+  if ((watcher_->flags & WATCHER_HAS_PER_FILE_NOTIFICATIONS) &&
+      !pending.flags.contains(W_PENDING_IS_DESYNCED)) {
+    auto parent = dir->parent;
+    watchman_file* dirFile =
+        parent ? parent->getChildFile(dir->name) : nullptr;
+    struct stat st;
+    int dfd = osdir->getFd();
+    if (dirFile && dirFile->exists && dfd != -1 && fstat(dfd, &st) == 0) {
+      FileInformation fresh{st};
+      dirStatUnchanged = dirFile->stat.ino == fresh.ino &&
+          dirFile->stat.size == fresh.size &&
+          dirFile->stat.mtime.tv_sec == fresh.mtime.tv_sec &&
+          dirFile->stat.mtime.tv_nsec == fresh.mtime.tv_nsec;
+    }
+  }
+#endif
+
   /* flag for delete detection */
   for (auto& it : dir->files) {
     auto file = it.second.get();
@@ -526,6 +1122,17 @@ void InMemoryView::crawler(
     }
   }
 
+  // Drain readdir into a batch before touching the child maps: the
+  // entry count is then exact, so one reservation below replaces the
+  // rehash-per-doubling storm that incremental growth pays on very
+  // large directories (hundreds of thousands of entries).
+  struct CrawlEntry {
+    w_string name;
+    bool has_stat;
+    FileInformation stat;
+  };
+  std::vector<CrawlEntry> entries;
+
   try {
     while (const DirEntry* dirent = osdir->readDir()) {
       // Don't follow parent/self links
@@ -534,13 +1141,67 @@ void InMemoryView::crawler(
         continue;
       }
 
-      // Queue it up for analysis if the file is newly existing
-      w_string name(dirent->d_name, W_STRING_BYTE);
+      // Basenames repeat across the tree, so pull the component from the
+      // interning pool rather than allocating a fresh copy per entry.
+      entries.push_back(CrawlEntry{
+          internPathComponent(dirent->d_name),
+          dirent->has_stat,
+          dirent->has_stat ? dirent->stat : FileInformation{}});
+    }
+
+    if (!entries.empty()) {
+      // reserve() never shrinks, so this is also safe on a recrawl
+      // where the map is already populated.
+      dir->files.reserve(std::max(dir->files.size(), entries.size()));
+      size_t ndirs = 0;
+      for (const auto& entry : entries) {
+        if (entry.has_stat && entry.stat.isDir()) {
+          ++ndirs;
+        }
+      }
+      if (ndirs) {
+        dir->dirs.reserve(std::max(dir->dirs.size(), ndirs));
+      }
+    }
+
+    // Brand-new plain files whose stat data arrived with the readdir
+    // batch have a fully determined outcome -- create the node, record
+    // the stat, mark it changed -- so they take the bulk insert path
+    // below instead of a pending-queue round trip each.  Eligibility is
+    // decided per directory: a desynced crawl re-examines everything
+    // the slow way, cookie files must never enter the tree, and the
+    // config file's directory keeps the per-file path so the reload
+    // intercept in processPath() still fires.
+    std::vector<ViewDatabase::NewFileRecord> newFiles;
+    const bool canBatchInserts =
+        !pending.flags.contains(W_PENDING_IS_DESYNCED) &&
+        !root->cookies.isCookieDir(path) &&
+        (!configFilePath_ || configFilePath_.dirName() != path);
+
+    for (auto& entry : entries) {
+      // Queue it up for analysis if the file is newly existing.
+      const w_string& name = entry.name;
       struct watchman_file* file = dir->getChildFile(name);
       if (file) {
         file->maybe_deleted = false;
       }
+      if (entry.has_stat &&
+          !(watcher_->flags & WATCHER_NEEDS_PER_FILE_WATCHES) &&
+          isUnchangedExistingFile(file, entry.stat)) {
+        continue;
+      }
+      if (dirStatUnchanged && file && file->exists && !file->stat.isDir()) {
+        // Known plain file in a directory whose stat triple is
+        // unchanged: the view's record for it is trusted (see above),
+        // so skip the pending-queue round trip and the stat syscall.
+        continue;
+      }
       if (!file || !file->exists || stat_all || recursive) {
+        if (canBatchInserts && !file && entry.has_stat &&
+            !entry.stat.isDir() && !dir->getChildDir(name)) {
+          newFiles.push_back(ViewDatabase::NewFileRecord{name, entry.stat});
+          continue;
+        }
         auto full_path = dir->getFullPathToChild(name);
 
         PendingFlags newFlags;
@@ -564,10 +1225,25 @@ void InMemoryView::crawler(
             view,
             coll,
             full_pending,
-            dirent->has_stat ? &dirent->stat : nullptr,
+            entry.has_stat ? &entry.stat : nullptr,
             pendingCookies);
       }
     }
+
+    if (!newFiles.empty()) {
+      // One routing-log entry for the directory covers every batched
+      // child: a scope contains the file iff it contains the parent.
+      noteChangedPath(path);
+      std::vector<watchman_file*> created;
+      view.insertBatch(dir, newFiles, getClock(pending.now), created);
+      for (auto* f : created) {
+        watcher_->startWatchFile(f);
+      }
+      if (fullCrawlStatCount_) {
+        fullCrawlStatCount_->fetch_add(
+            newFiles.size(), std::memory_order_release);
+      }
+    }
   } catch (const std::system_error& exc) {
     log(ERR,
         "Error while reading dir ",
@@ -614,6 +1290,11 @@ class CrawlerFileSystem : public FileSystem {
         !root_->cookies.isCookieDir(fullPath)) {
       return nullptr;
     }
+    // Configured lazy subtrees defer their crawl (and watch) until a
+    // query first touches them; see InMemoryView::prepareForQuery().
+    if (view_->isUnmaterializedDir(fullPath)) {
+      return nullptr;
+    }
     // Use watcher->startWatchDir to ensure side effects are applied
     // in the right order (ex. inotify_add_watch before opendir).
     // This requires startWatchDir to be thread-safe.
@@ -633,10 +1314,12 @@ class CrawlerFileSystem : public FileSystem {
   CrawlerFileSystem(
       FileSystem& fileSystem,
       std::shared_ptr<Root> root,
-      std::shared_ptr<Watcher> watcher)
+      std::shared_ptr<Watcher> watcher,
+      const InMemoryView* view)
       : fileSystem_{fileSystem},
         root_{std::move(root)},
-        watcher_{std::move(watcher)} {}
+        watcher_{std::move(watcher)},
+        view_{view} {}
 
   CrawlerFileSystem() = delete;
   CrawlerFileSystem(CrawlerFileSystem&&) = delete;
@@ -648,6 +1331,7 @@ class CrawlerFileSystem : public FileSystem {
   FileSystem& fileSystem_;
   std::shared_ptr<Root> root_;
   std::shared_ptr<Watcher> watcher_;
+  const InMemoryView* view_;
 };
 
 } // namespace
@@ -674,7 +1358,7 @@ void InMemoryView::crawlerParallel(
   // (via W_PENDING_RECURSIVE), and avoid extra syscalls.
 
   std::shared_ptr<CrawlerFileSystem> fs =
-      std::make_shared<CrawlerFileSystem>(fileSystem_, root, watcher_);
+      std::make_shared<CrawlerFileSystem>(fileSystem_, root, watcher_, this);
   size_t threadCountHint = config_.getInt("parallel_crawl_thread_count", 0);
   ParallelWalker walker{std::move(fs), path, threadCountHint};
 
@@ -689,10 +1373,12 @@ void InMemoryView::crawlerParallel(
     // Step 1a: Prepare the dirView.
     w_string dirPath{dirResult.dirFullPath.c_str()};
     auto dirView = view.resolveDir(dirPath, true);
-    if (dirView->files.empty()) {
-      dirView->files.reserve(dirResult.entries.size());
-      dirView->dirs.reserve(dirResult.subdirCount);
-    }
+    view.noteDirObserved(dirView);
+    // reserve() never shrinks, so this is also safe on a recrawl where
+    // the maps are already populated.
+    dirView->files.reserve(
+        std::max(dirView->files.size(), dirResult.entries.size()));
+    dirView->dirs.reserve(std::max(dirView->dirs.size(), dirResult.subdirCount));
     for (auto& it : dirView->files) {
       auto fileView = it.second.get();
       if (fileView->exists) {
@@ -702,19 +1388,37 @@ void InMemoryView::crawlerParallel(
 
     // Step 1b: Update files in the dirView via statPath().
     // Prepare the stat so statPath can avoid syscall.
+    // Brand-new plain files take the bulk insert path instead; the
+    // eligibility rules mirror crawler()'s.
+    std::vector<ViewDatabase::NewFileRecord> newFiles;
+    const bool canBatchInserts =
+        !pending.flags.contains(W_PENDING_IS_DESYNCED) &&
+        !root->cookies.isCookieDir(dirPath) &&
+        (!configFilePath_ || configFilePath_.dirName() != dirPath);
     for (auto& entry : dirResult.entries) {
-      w_string name{entry.name.c_str(), W_STRING_BYTE};
+      w_string_piece name{entry.name.data(), entry.name.size()};
       watchman_file* fileView = dirView->getChildFile(name);
       if (fileView) {
         fileView->maybe_deleted = false;
       }
-      auto fullPath = dirView->getFullPathToChild(name);
+      if (!(watcher_->flags & WATCHER_NEEDS_PER_FILE_WATCHES) &&
+          isUnchangedExistingFile(fileView, entry.stat)) {
+        continue;
+      }
+      if (canBatchInserts && !fileView && !entry.stat.isDir() &&
+          !dirView->getChildDir(name)) {
+        newFiles.push_back(
+            ViewDatabase::NewFileRecord{internPathComponent(name), entry.stat});
+        continue;
+      }
+      // The walker workers pre-built the full path; hand the refcounted
+      // string through rather than concatenating under the view lock.
       processPath(
           root,
           view,
           coll,
           PendingChange{
-              std::move(fullPath),
+              std::move(entry.fullPath),
               pending.now,
               inheritFlags,
           },
@@ -722,6 +1426,21 @@ void InMemoryView::crawlerParallel(
           pendingCookies);
     }
 
+    if (!newFiles.empty()) {
+      // One routing-log entry for the directory covers every batched
+      // child: a scope contains the file iff it contains the parent.
+      noteChangedPath(dirPath);
+      std::vector<watchman_file*> created;
+      view.insertBatch(dirView, newFiles, getClock(pending.now), created);
+      for (auto* f : created) {
+        watcher_->startWatchFile(f);
+      }
+      if (fullCrawlStatCount_) {
+        fullCrawlStatCount_->fetch_add(
+            newFiles.size(), std::memory_order_release);
+      }
+    }
+
     // Step 1c: Mark for deletion.
     for (auto& it : dirView->files) {
       auto fileView = it.second.get();
@@ -763,6 +1482,16 @@ void InMemoryView::crawlerParallel(
       }
     }
   }
+
+  auto stats = walker.stats();
+  logf(
+      DBG,
+      "crawlerParallel({}) read {} dirs / {} entries in {} batches, {} errors\n",
+      path,
+      stats.dirsRead,
+      stats.entriesRead,
+      stats.batchesPublished,
+      stats.errors);
 }
 
 namespace {
@@ -825,6 +1554,16 @@ void InMemoryView::statPath(
 
   if (root.ignore.isIgnoreDir(pending.path)) {
     logf(DBG, "{} matches ignore_dir rules\n", pending.path);
+    // A live ignore_dirs update queues a recursive re-scan of each
+    // newly ignored path; if the view still holds that subtree,
+    // tombstone it so the stale entries drain out in background
+    // slices.  Ordinary (non-recursive) events for ignored paths skip
+    // the dir lookup entirely.
+    if (recursive) {
+      if (auto* dir = view.resolveDir(pending.path, false)) {
+        view.markDirDeleted(dir, getClock(pending.now), true);
+      }
+    }
     return;
   }
 
@@ -848,6 +1587,16 @@ void InMemoryView::statPath(
     // file is missing (see "Step 1c" in crawlerParallel). Treat as deleted
     // without an extra getFileInformation() call.
     errcode = make_error_code(error_code::no_such_file_or_directory);
+  } else if (
+      pending.flags.contains(W_PENDING_KNOWN_REMOVED) &&
+      !pending.flags.contains(W_PENDING_IS_DESYNCED)) {
+    // The watcher's kernel event unambiguously reported this path as
+    // removed, so trust it and skip the confirming lstat.  If the path
+    // was recreated after the event was generated, the recreation's own
+    // notification is behind us in the queue and will re-stat it.  A
+    // desynced watcher may have missed that notification, so it does not
+    // get to take this shortcut.
+    errcode = make_error_code(error_code::no_such_file_or_directory);
   } else {
     try {
       st = fileSystem_.getFileInformation(path.c_str(), root.case_sensitive);
@@ -991,7 +1740,20 @@ void InMemoryView::statPath(
       }
     }
 
+    // Content fingerprint: when the kernel positively attributed this
+    // event to metadata only and the size and inode still match, the
+    // bytes are untouched -- keep the previous content mtime so cached
+    // sha1s keyed by it are returned without re-reading the file.
+    // Everything else (including events the watcher could not classify)
+    // refreshes the fingerprint.
+    if (!(pending.flags.contains(W_PENDING_ATTRIB_ONLY) && file->exists &&
+          file->stat.size == st.size && file->stat.ino == st.ino)) {
+      file->content_mtime = st.mtime;
+    }
+
     memcpy(&file->stat, &st, sizeof(file->stat));
+    // Decode the entry type once here so `type` terms are a byte compare.
+    file->dtype = st.dtype();
     watcher_->startWatchFile(file);
 
     if (st.isDir()) {
@@ -1000,6 +1762,44 @@ void InMemoryView::statPath(
       } else {
         // Ensure that we believe that this node exists
         dir_ent->last_check_existed = true;
+        view.noteDirObserved(dir_ent);
+      }
+
+      // A configured lazy subtree stays registered in the tree but is
+      // neither watched nor crawled until a query first touches it; see
+      // InMemoryView::prepareForQuery().
+      if (isUnmaterializedDir(pending.path)) {
+        logf(DBG, "{} is lazy; deferring crawl until first use\n", path);
+        return;
+      }
+
+      // The watcher paired both halves of a directory rename; graft the
+      // subtree we already hold at the source path onto this one in
+      // memory.  When that succeeds there is nothing left to learn from
+      // disk and the recursive crawl below is skipped entirely -- the
+      // whole point for a large renamed tree.
+      if (!viaPwalk && pending.flags.contains(W_PENDING_RENAMED)) {
+        if (auto source = watcher_->takeRenameSource(pending.path)) {
+          if (renameDirSubtree(
+                  view,
+                  coll,
+                  *source,
+                  pending.path,
+                  pending.now,
+                  getClock(pending.now))) {
+            logf(
+                DBG,
+                "rename {} -> {}: re-parented in memory, no crawl\n",
+                *source,
+                path);
+            return;
+          }
+          logf(
+              DBG,
+              "rename {} -> {}: source not in view, crawling\n",
+              *source,
+              path);
+        }
       }
 
       // Don't recurse if our parent is an ignore dir or via crawlerParallel
@@ -1046,6 +1846,111 @@ void InMemoryView::statPath(
   }
 }
 
+bool InMemoryView::renameDirSubtree(
+    ViewDatabase& view,
+    PendingChanges& coll,
+    const w_string& from,
+    const w_string& to,
+    std::chrono::system_clock::time_point now,
+    ClockStamp otime) {
+  auto* srcRoot = view.resolveDir(from, false);
+  if (!srcRoot || !srcRoot->last_check_existed) {
+    return false;
+  }
+
+  // Walk the source tree once, creating the mirror node under the
+  // destination for every live entry.  Stat data is copied straight
+  // from the source nodes: a rename changes no inode contents, so what
+  // we knew about each file at the old path is exactly what an lstat at
+  // the new path would report.  Every grafted file is journaled as
+  // changed (and, when its node is new, created) at `otime`, so since
+  // queries and subscriptions observe the rename as deletes at the old
+  // paths plus fresh files at the new ones, just as a crawl would have
+  // reported -- only without the crawl.
+  std::vector<std::pair<watchman_dir*, w_string>> stack;
+  stack.emplace_back(srcRoot, to);
+  size_t grafted = 0;
+  while (!stack.empty()) {
+    auto [src, dstPath] = std::move(stack.back());
+    stack.pop_back();
+
+    if (isUnmaterializedDir(src->getFullPath())) {
+      // A configured lazy subtree was never crawled, so the view holds
+      // nothing to graft for it; its new location is not configured
+      // lazy, so fill it the ordinary way.
+      coll.add(
+          dstPath, now, W_PENDING_RECURSIVE | W_PENDING_CRAWL_ONLY);
+      continue;
+    }
+
+    auto* dst = view.resolveDir(dstPath, true);
+    dst->last_check_existed = true;
+    view.noteDirObserved(dst);
+    // One routing-log entry per directory covers its files; see the
+    // matching convention in crawlerParallel().
+    noteChangedPath(dstPath);
+
+    for (auto& it : src->files) {
+      auto* srcFile = it.second.get();
+      if (!srcFile->exists) {
+        // Usually a tombstone from long before the rename, in which
+        // case the destination has no such entry.  But it can also be
+        // a casualty of a modify-then-rename race: a pre-rename event
+        // for this file, drained in an earlier pass, lstat()ed after
+        // the on-disk rename, saw ENOENT and tombstoned a file that
+        // moved with the directory.  The view cannot tell the two
+        // apart, so enqueue a confirming stat of the destination
+        // child instead of silently dropping it.
+        coll.add(w_string::build(dstPath, "/", srcFile->getName()), now, {});
+        continue;
+      }
+      auto* f = view.getOrCreateChildFile(
+          dst, srcFile->getName().asWString(), otime);
+      if (!f->exists) {
+        // Transitioning a stale tombstone back to existing makes the
+        // file effectively new, mirroring statPath().
+        f->ctime = otime;
+      }
+      f->exists = true;
+      memcpy(&f->stat, &srcFile->stat, sizeof(f->stat));
+      f->content_mtime = srcFile->content_mtime;
+      f->dtype = srcFile->dtype;
+      view.markFileChanged(f, otime);
+      watcher_->startWatchFile(f);
+      ++grafted;
+    }
+
+    for (auto& it : src->dirs) {
+      auto* child = it.second.get();
+      if (!child->last_check_existed) {
+        // Same race as the file tombstones above, writ larger: a
+        // pre-rename delete event may have marked a subtree deleted
+        // after the disk had already moved it.  Crawl the destination
+        // child to recover whatever is really there.
+        coll.add(
+            w_string::build(dstPath, "/", child->name),
+            now,
+            W_PENDING_RECURSIVE | W_PENDING_CRAWL_ONLY);
+        continue;
+      }
+      stack.emplace_back(child, w_string::build(dstPath, "/", child->name));
+    }
+  }
+
+  // The old paths are gone from disk; tombstone them through the usual
+  // deferred-delete machinery so the marking drains in bounded slices.
+  view.markDirDeleted(srcRoot, otime, true);
+  noteChangedPath(from);
+
+  logf(
+      DBG,
+      "renameDirSubtree: grafted {} files from {} onto {}\n",
+      grafted,
+      from,
+      to);
+  return true;
+}
+
 } // namespace watchman
 
 /* vim:ts=2:sw=2:et:
@@ -6,6 +6,7 @@
  */
 
 #include "watchman/Constants.h"
+#include "watchman/Cookie.h"
 #include "watchman/InMemoryView.h"
 #include "watchman/root/Root.h"
 #include "watchman/watcher/Watcher.h"
@@ -20,6 +21,23 @@ namespace watchman {
 void InMemoryView::notifyThread(const std::shared_ptr<Root>& root) {
   PendingChanges fromWatcher;
 
+  // Ingestion governor (the "event_rate_limit" config knob, events per
+  // second, 0 disables): a runaway writer in one root can push millions
+  // of per-file events a minute, and the cost of statting each one on
+  // the IO thread starves every other root in the daemon.  Past the
+  // threshold we collapse plain file events to a non-recursive scan
+  // marker on their containing directory; the pending tree dedups the
+  // markers, so a temp-file storm in one directory becomes a single
+  // entry, and the scan re-stats the directory's children so nothing is
+  // missed -- coarser, not lossier.  Entries that are already subtree
+  // markers (W_PENDING_RECURSIVE) and sync cookies pass through
+  // untouched.  Precision is restored once the rate stays below half
+  // the threshold for a full accounting window.
+  const json_int_t governorLimit = config_.getInt("event_rate_limit", 0);
+  auto governorWindowStart = std::chrono::steady_clock::now();
+  json_int_t governorWindowCount = 0;
+  bool governing = false;
+
   if (!watcher_->start(root)) {
     logf(
         ERR,
@@ -53,8 +71,116 @@ void InMemoryView::notifyThread(const std::shared_ptr<Root>& root) {
     } while (watcher_->waitNotify(0));
 
     if (!fromWatcher.empty()) {
+      auto items = fromWatcher.stealItems();
+      auto syncs = fromWatcher.stealSyncs();
+
+      // Tag this root's sync cookies while we still own the batch: the
+      // cheap substring test gates the authoritative prefix check so
+      // ordinary paths never touch the cookie lock.  The IO thread uses
+      // the tag to refuse to coalesce or otherwise delay a batch that a
+      // synchronized query is blocked on.
+      bool onlyCookies = items != nullptr;
+      json_int_t itemCount = 0;
+      for (auto* p = items.get(); p; p = p->next.get()) {
+        ++itemCount;
+        if (isPossiblyACookie(p->path) &&
+            root->cookies.isCookiePrefix(p->path)) {
+          p->flags.set(W_PENDING_COOKIE);
+        } else {
+          onlyCookies = false;
+        }
+      }
+
+      if (governorLimit > 0) {
+        auto now = std::chrono::steady_clock::now();
+        governorWindowCount += itemCount;
+        if (now - governorWindowStart >= std::chrono::seconds(1)) {
+          if (governing && governorWindowCount < governorLimit / 2) {
+            governing = false;
+            logf(
+                ERR,
+                "event rate for {} subsided ({} events in the last window); "
+                "restoring per-file precision\n",
+                root->root_path,
+                governorWindowCount);
+          }
+          governorWindowStart = now;
+          governorWindowCount = 0;
+        }
+        if (!governing && governorWindowCount > governorLimit) {
+          // React mid-window: a storm should not get a free second.
+          governing = true;
+          logf(
+              ERR,
+              "event rate for {} exceeded event_rate_limit ({}/sec); "
+              "collapsing file events to directory scan markers\n",
+              root->root_path,
+              governorLimit);
+        }
+      }
+
+      if (governing && items && !onlyCookies) {
+        PendingChanges collapsed;
+        json_int_t collapsedCount = 0;
+        for (auto* p = items.get(); p; p = p->next.get()) {
+          if (p->flags.contains(W_PENDING_COOKIE) ||
+              p->flags.contains(W_PENDING_RECURSIVE) ||
+              p->path == root->root_path) {
+            // Cookies must reach their exact path, and recursive
+            // entries are already coarse subtree markers that the
+            // pending tree prunes children against.  Carry the items'
+            // own sequences: the stolen chain is newest-first, so
+            // stamping fresh ones here would invert event order.
+            collapsed.add(p->path, p->now, p->flags, p->sequence);
+            continue;
+          }
+          // Per-path hints (known-removed, attrib-only) don't survive
+          // the widening; the scan re-derives the truth from stat.
+          collapsed.add(
+              p->path.dirName(),
+              p->now,
+              (p->flags & W_PENDING_IS_DESYNCED) | W_PENDING_VIA_NOTIFY |
+                  W_PENDING_NONRECURSIVE_SCAN,
+              p->sequence);
+          ++collapsedCount;
+        }
+        governorCollapsedItems_.fetch_add(
+            collapsedCount, std::memory_order_relaxed);
+        items = collapsed.stealItems();
+      }
+
+      // The batch was already deduped while accumulating in fromWatcher,
+      // and the IO thread dedups again when it merges into its local
+      // PendingChanges, so splice it over without doing tree work while
+      // holding the lock.
       auto lock = pendingFromWatcher_.lock();
-      lock->append(fromWatcher.stealItems(), fromWatcher.stealSyncs());
+
+      // Completing a cookie promises its query that the view reflects
+      // every change observed before the cookie was created, so cookies
+      // must normally wait out the whole ingest pipeline.  But when the
+      // batch holds nothing except this root's cookie files, the shared
+      // collection is empty, and the IO thread reports it has applied
+      // everything it ever stole, there is verifiably nothing ahead of
+      // the cookie and it can be completed right here, skipping the
+      // wake/drain round trip through the IO thread.  The items are
+      // still spliced through below so the cookie files are consumed
+      // (and kept out of the tree) the usual way; the IO thread's own
+      // notifyCookie for them finds nothing outstanding and is a no-op.
+      // Only a precisely ordered watcher may take this shortcut: a
+      // reordering one (eg: FSEvents) can report the cookie while older
+      // events are still buffered on its side, invisibly to the
+      // emptiness checks here.
+      if ((watcher_->flags & WATCHER_PRECISELY_ORDERED) && onlyCookies &&
+          syncs.empty() && lock->empty() &&
+          ioThreadCaughtUp_.load(std::memory_order_acquire) &&
+          root->inner.done_initial.load(std::memory_order_acquire)) {
+        for (auto* p = items.get(); p; p = p->next.get()) {
+          root->cookies.notifyCookie(p->path);
+        }
+        cookieFastPathNotifies_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      lock->appendRaw(std::move(items), std::move(syncs));
       lock->ping();
     }
   }
@@ -12,14 +12,15 @@
 using namespace watchman;
 
 bool Root::considerReap() {
-  if (idle_reap_age.count() == 0) {
+  auto reapAge = idle_reap_age.load(std::memory_order_acquire);
+  if (reapAge.count() == 0) {
     return false;
   }
 
   auto now = std::chrono::steady_clock::now();
 
   if (now > inner.last_cmd_timestamp.load(std::memory_order_acquire) +
-              idle_reap_age &&
+              reapAge &&
       (triggers.rlock()->empty()) && (now > inner.last_reap_timestamp) &&
       !unilateralResponses->hasSubscribers()) {
     // We haven't had any activity in a while, and there are no registered
@@ -28,7 +29,7 @@ bool Root::considerReap() {
         "root ",
         root_path,
         " has had no activity in ",
-        idle_reap_age,
+        reapAge,
         " and has no triggers or subscriptions, cancelling watch.  "
         "Set idle_reap_age_seconds in your .watchmanconfig to control this "
         "behavior\n");
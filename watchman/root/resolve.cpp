@@ -109,6 +109,8 @@ static void check_allowed_fs(const char* filename, const w_string& fs_type) {
   }
 }
 
+} // namespace
+
 std::optional<json_ref> load_root_config(const char* path) {
   char cfgfilename[WATCHMAN_NAME_MAX];
   snprintf(cfgfilename, sizeof(cfgfilename), "%s/.watchmanconfig", path);
@@ -125,8 +127,6 @@ std::optional<json_ref> load_root_config(const char* path) {
   return json_load_file(cfgfilename, 0);
 }
 
-} // namespace
-
 std::shared_ptr<Root>
 root_resolve(const char* filename_cstr, bool auto_watch, bool* created) {
   std::error_code realpath_err;
@@ -8,11 +8,20 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include "watchman/thirdparty/jansson/jansson.h"
 
 namespace watchman {
 class Root;
 }
 
+/**
+ * Loads <path>/.watchmanconfig, returning nullopt when the file does
+ * not exist.  Throws if the file exists but cannot be parsed.  Used
+ * both when establishing a watch and by Root::reloadConfigFile().
+ */
+std::optional<json_ref> load_root_config(const char* path);
+
 std::shared_ptr<watchman::Root> w_root_resolve(
     const char* path,
     bool auto_watch);
@@ -12,7 +12,9 @@
 using namespace watchman;
 
 void Root::recrawlTriggered(const char* why) {
-  recrawlInfo.wlock()->recrawlCount++;
+  // The watcher delivered the re-scan through its own event stream, so
+  // no full crawl is scheduled; account it as a subtree recrawl.
+  recrawlInfo.wlock()->subtreeRecrawlCount++;
 
   log(ERR, root_path, ": ", why, ": tree recrawl triggered\n");
 }
@@ -42,6 +44,25 @@ void Root::scheduleRecrawl(const char* why) {
   view()->wakeThreads();
 }
 
+void Root::scheduleSubtreeRecrawl(const w_string& path, const char* why) {
+  // A scoped recrawl only makes sense for a proper subtree of the root;
+  // anything else is equivalent to a full recrawl.
+  if (path.size() <= root_path.size() ||
+      !w_string_piece{path}.startsWith(root_path)) {
+    scheduleRecrawl(why);
+    return;
+  }
+
+  if (!view()->rescanSubtree(path)) {
+    // This view has no pending stream we can scope the work to.
+    scheduleRecrawl(why);
+    return;
+  }
+
+  recrawlInfo.wlock()->subtreeRecrawlCount++;
+  log(ERR, root_path, ": ", why, ": scheduling a recrawl of subtree ", path, "\n");
+}
+
 void Root::stopThreads() {
   view()->stopThreads();
 }
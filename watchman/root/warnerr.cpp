@@ -6,6 +6,7 @@
  */
 
 #include "watchman/root/warnerr.h"
+#include <fmt/core.h>
 #include "watchman/Errors.h"
 #include "watchman/Logging.h"
 #include "watchman/Poison.h"
@@ -14,6 +15,26 @@
 
 namespace watchman {
 
+namespace {
+
+// Don't record more distinct failing subtrees than this; a watch in
+// that much trouble needs a recrawl, not a longer warning message.
+constexpr size_t kMaxOpenErrorRecords = 32;
+
+// True if `path` is `ancestor` itself or lives somewhere beneath it.
+bool pathWithin(w_string_piece path, w_string_piece ancestor) {
+  if (!path.startsWith(ancestor)) {
+    return false;
+  }
+  if (path.size() == ancestor.size()) {
+    return true;
+  }
+  auto sep = path.data()[ancestor.size()];
+  return sep == '/' || sep == '\\';
+}
+
+} // namespace
+
 void handle_open_errno(
     Root& root,
     w_string_piece dirPath,
@@ -54,18 +75,83 @@ void handle_open_errno(
     return;
   }
 
-  auto warn = w_string::build(
+  if (!log_warning) {
+    log(err == error_code::no_such_file_or_directory ? DBG : ERR,
+        syscall,
+        "(",
+        dirPath,
+        ") -> ",
+        err.message(),
+        ". Marking this portion of the tree deleted\n");
+    return;
+  }
+
+  // Record (code, path) and defer the formatting to renderWarning().
+  // A recursive error storm -- an unreadable subtree with thousands of
+  // directories, say -- would otherwise spend the crawl's own time
+  // building warning strings that no client may ever read, so errors
+  // beneath an already-recorded directory just bump that record's
+  // counter and produce no text at all.
+  {
+    auto info = root.recrawlInfo.wlock();
+    for (auto& rec : info->openErrors) {
+      if (rec.err == err && pathWithin(dirPath, rec.path)) {
+        ++rec.collapsed;
+        return;
+      }
+    }
+    if (info->openErrors.size() >= kMaxOpenErrorRecords) {
+      ++info->droppedOpenErrors;
+      return;
+    }
+    info->openErrors.push_back(
+        {dirPath.asWString(), syscall, err, /*collapsed=*/0});
+  }
+
+  // One log line per recorded subtree rather than one per failing path.
+  log(ERR,
       syscall,
       "(",
       dirPath,
       ") -> ",
       err.message(),
-      ". Marking this portion of the tree deleted");
+      ". Marking this portion of the tree deleted\n");
+}
 
-  log(err == error_code::no_such_file_or_directory ? DBG : ERR, warn, "\n");
-  if (log_warning) {
-    root.recrawlInfo.wlock()->warning = warn;
+std::optional<w_string> Root::RecrawlInfo::renderWarning() const {
+  if (openErrors.empty()) {
+    return warning;
+  }
+  std::string buf;
+  if (warning) {
+    buf.append(warning->view());
+    buf.push_back('\n');
+  }
+  for (const auto& rec : openErrors) {
+    fmt::format_to(
+        std::back_inserter(buf),
+        "{}({}) -> {}. Marking this portion of the tree deleted\n",
+        rec.sysCall,
+        rec.path,
+        rec.err.message());
+    if (rec.collapsed) {
+      fmt::format_to(
+          std::back_inserter(buf),
+          "  (and {} more paths under that directory)\n",
+          rec.collapsed);
+    }
+  }
+  if (droppedOpenErrors) {
+    fmt::format_to(
+        std::back_inserter(buf),
+        "... and {} additional errors not individually recorded\n",
+        droppedOpenErrors);
+  }
+  // The callers append their own trailing newline
+  if (!buf.empty() && buf.back() == '\n') {
+    buf.pop_back();
   }
+  return w_string{buf.data(), buf.size()};
 }
 
 } // namespace watchman
@@ -150,10 +150,12 @@ RootDebugStatus Root::getStatus() const {
   {
     auto info = recrawlInfo.rlock();
     recrawl_info.count = info->recrawlCount;
+    recrawl_info.subtree_count = info->subtreeRecrawlCount;
     recrawl_info.should_recrawl = info->shouldRecrawl;
     recrawl_info.reason = info->reason;
-    if (info->warning) {
-      recrawl_info.warning = info->warning;
+    auto warning = info->renderWarning();
+    if (warning) {
+      recrawl_info.warning = warning;
     }
     std::shared_ptr<std::atomic<size_t>> stat_count = info->statCount;
     if (stat_count) {
@@ -174,7 +176,7 @@ RootDebugStatus Root::getStatus() const {
       recrawl_info.completed_at = -finish_ago;
       crawl_status = fmt::format(
           "needs recrawl: {}. Last crawl was {}ms ago",
-          info->warning ? info->warning->view() : std::string_view{},
+          warning ? warning->view() : std::string_view{},
           finish_ago);
     } else {
       recrawl_info.started_at = -start_ago;
@@ -264,6 +266,18 @@ RootDebugStatus Root::getStatus() const {
   obj.cancelled = inner.cancelled;
   obj.crawl_status = w_string{crawl_status.data(), crawl_status.size()};
   obj.enable_parallel_crawl = enable_parallel_crawl;
+  auto placement = view_->threadPlacement();
+  if (!placement.empty()) {
+    obj.thread_placement = std::move(placement);
+  }
+  if (auto spill = view_->pendingSpillStats()) {
+    RootPendingSpillInfo info;
+    info.queue_depth = int64_t(spill->queueDepth);
+    info.spool_depth = int64_t(spill->spoolDepth);
+    info.spilled_total = int64_t(spill->spilledTotal);
+    info.replayed_total = int64_t(spill->replayedTotal);
+    obj.pending_spill = info;
+  }
   return obj;
 }
 
@@ -6,8 +6,10 @@
  */
 
 #include "watchman/saved_state/LocalSavedStateInterface.h"
+#include <fmt/core.h>
 #include "watchman/CommandRegistry.h"
 #include "watchman/Errors.h"
+#include "watchman/LRUCache.h"
 #include "watchman/Logging.h"
 #include "watchman/fs/FileInformation.h"
 #include "watchman/scm/SCM.h"
@@ -18,6 +20,23 @@ W_CAP_REG("saved-state-local")
 
 namespace watchman {
 
+namespace {
+// Recent successful lookups, shared across roots and interface instances
+// (a fresh instance is constructed per query).  Keyed on the storage
+// path, project, metadata and lookup commit; the value is the commit id
+// whose state satisfied the lookup.  A hit is only trusted after
+// re-checking that the state file still exists, so this is purely a
+// shortcut past the commit walk and saved state GC retains its existing
+// semantics.  Switching back and forth between release branches repeats
+// the same lookups, which is where this pays off.
+LRUCache<std::string, w_string>& lookupCache() {
+  // Meyers singleton to avoid SIOF
+  static LRUCache<std::string, w_string> cache(
+      32, /* errorTTL */ std::chrono::seconds(0));
+  return cache;
+}
+} // namespace
+
 LocalSavedStateInterface::LocalSavedStateInterface(
     const json_ref& savedStateConfig,
     const SCM* scm)
@@ -59,6 +78,28 @@ LocalSavedStateInterface::LocalSavedStateInterface(
 SavedStateInterface::SavedStateResult
 LocalSavedStateInterface::getMostRecentSavedStateImpl(
     w_string_piece lookupCommitId) const {
+  auto cacheKey = fmt::format(
+      "{}:{}:{}:{}",
+      localStoragePath_,
+      project_,
+      projectMetadata_ ? *projectMetadata_ : w_string(""),
+      lookupCommitId);
+  if (auto node = lookupCache().get(cacheKey)) {
+    auto& commitId = node->value();
+    auto path = getLocalPath(commitId);
+    if (w_path_exists(path.c_str())) {
+      log(DBG, "Found cached saved state for commit ", commitId, "\n");
+      SavedStateInterface::SavedStateResult result;
+      result.commitId = commitId;
+      result.savedStateInfo = json_object(
+          {{"local-path", w_string_to_json(path)},
+           {"commit-id", w_string_to_json(commitId)}});
+      return result;
+    }
+    // The state was GC'd since we cached it; fall through to a full walk
+    lookupCache().erase(cacheKey);
+  }
+
   auto commitIds =
       scm_->getCommitsPriorToAndIncluding(lookupCommitId, maxCommits_);
   for (auto& commitId : commitIds) {
@@ -71,6 +112,12 @@ LocalSavedStateInterface::getMostRecentSavedStateImpl(
     // to be used.
     if (w_path_exists(path.c_str())) {
       log(DBG, "Found saved state for commit ", commitId, "\n");
+      if (commitId.piece() == lookupCommitId) {
+        // Only cache exact hits: for an older commit a more recent state
+        // could be published later and must win, and a state published
+        // after a miss must be visible to the very next query
+        lookupCache().set(cacheKey, commitId);
+      }
       SavedStateInterface::SavedStateResult result;
       result.commitId = commitId;
       result.savedStateInfo = json_object(
@@ -8,6 +8,7 @@
 #include "watchman/scm/Git.h"
 #include <fmt/core.h>
 #include <folly/String.h>
+#include <unordered_set>
 #include "watchman/ChildProcess.h"
 #include "watchman/CommandRegistry.h"
 #include "watchman/Logging.h"
@@ -79,6 +80,50 @@ Git::Git(w_string_piece rootPath, w_string_piece scmRoot)
           32,
           10) {}
 
+/*
+ * Entry kinds (separated by NUL):
+ *   "1 <XY> <sub> <mH> <mI> <mW> <hH> <hI> <path>"            changed
+ *   "u <XY> <sub> <m1> <m2> <m3> <mW> <h1> <h2> <h3> <path>"  unmerged
+ *   "? <path>"                                                untracked
+ * Rename entries ("2") carry a second NUL-separated path, so callers
+ * must pass --no-renames; anything unrecognized is skipped.
+ */
+void Git::appendStatusV2Paths(
+    w_string_piece output,
+    std::unordered_set<w_string>& paths) {
+  std::vector<w_string> entries;
+  output.split(entries, '\0');
+  for (auto& entry : entries) {
+    auto view = entry.view();
+    if (view.size() < 3) {
+      continue;
+    }
+
+    size_t fields;
+    if (view[0] == '?' && view[1] == ' ') {
+      fields = 1;
+    } else if (view[0] == '1' && view[1] == ' ') {
+      fields = 8;
+    } else if (view[0] == 'u' && view[1] == ' ') {
+      fields = 10;
+    } else {
+      continue;
+    }
+
+    // Skip over the leading metadata fields; the path is the remainder
+    size_t pos = 0;
+    while (fields > 0 &&
+           (pos = view.find(' ', pos)) != std::string_view::npos) {
+      ++pos;
+      --fields;
+    }
+    if (fields != 0 || pos >= view.size()) {
+      continue;
+    }
+    paths.emplace(view.data() + pos, view.size() - pos);
+  }
+}
+
 ChildProcess::Options Git::makeGitOptions(
     const std::optional<w_string>& requestId) const {
   ChildProcess::Options opt;
@@ -151,14 +196,35 @@ std::vector<w_string> Git::getFilesChangedSinceMergeBaseWith(
           key,
           [this, commit = std::move(commitCopy), requestId](
               const std::string&) {
-            auto result = runGit(
+            // `git diff` reports committed and tracked working copy
+            // changes relative to the merge base, but has no notion of
+            // untracked files, so we combine it with a status pipeline
+            // to match what `hg status --rev` reports.
+            auto diffResult = runGit(
                 {gitExecutablePath(), "diff", "--name-only", "-z", commit},
                 makeGitOptions(requestId),
                 "query for files changed since merge base");
 
-            std::vector<w_string> lines;
-            w_string_piece(result.output).split(lines, '\0');
-            return folly::makeFuture(lines);
+            auto statusResult = runGit(
+                {gitExecutablePath(),
+                 "status",
+                 "--porcelain=v2",
+                 "-z",
+                 "--no-renames",
+                 "--untracked-files=all"},
+                makeGitOptions(requestId),
+                "query the work tree status");
+
+            std::unordered_set<w_string> paths;
+            {
+              std::vector<w_string> diffLines;
+              w_string_piece(diffResult.output).split(diffLines, '\0');
+              paths.insert(diffLines.begin(), diffLines.end());
+            }
+            appendStatusV2Paths(statusResult.output, paths);
+
+            std::vector<w_string> lines{paths.begin(), paths.end()};
+            return folly::makeFuture(std::move(lines));
           })
       .get()
       ->value();
@@ -168,7 +234,7 @@ std::chrono::time_point<std::chrono::system_clock> Git::getCommitDate(
     w_string_piece commitId,
     const std::optional<w_string>& requestId) const {
   auto result = runGit(
-      {gitExecutablePath(), "log", "--format:%ct", "-n", "1", commitId.view()},
+      {gitExecutablePath(), "log", "--format=%ct", "-n", "1", commitId.view()},
       makeGitOptions(requestId),
       "get commit date");
   double timestamp;
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <chrono>
+#include <unordered_set>
 #include <vector>
 #include "watchman/ChildProcess.h"
 #include "watchman/LRUCache.h"
@@ -34,6 +35,12 @@ class Git : public SCM {
       int numCommits,
       const std::optional<w_string>& requestId = std::nullopt) const override;
 
+  // Parse `git status --porcelain=v2 -z` output and insert the work tree
+  // paths it mentions into `paths`.  Public for testing.
+  static void appendStatusV2Paths(
+      w_string_piece output,
+      std::unordered_set<w_string>& paths);
+
  private:
   std::string indexPath_;
   mutable LRUCache<std::string, std::vector<w_string>> commitsPrior_;
@@ -7,6 +7,7 @@
 
 #include "Mercurial.h"
 #include <fmt/core.h>
+#include <folly/ScopeGuard.h>
 #include <folly/String.h>
 #include <chrono>
 #include <cmath>
@@ -14,8 +15,10 @@
 #include "watchman/ChildProcess.h"
 #include "watchman/CommandRegistry.h"
 #include "watchman/Logging.h"
+#include "watchman/Options.h"
 #include "watchman/fs/FileSystem.h"
 #include "watchman/sockname.h"
+#include "watchman/thirdparty/jansson/jansson.h"
 
 // Capability indicating support for the mercurial SCM
 W_CAP_REG("scm-hg")
@@ -133,7 +136,154 @@ Mercurial::Mercurial(w_string_piece rootPath, w_string_piece scmRoot)
           Configuration(),
           "scm_hg_files_since_mergebase",
           32,
-          10) {}
+          10),
+      // The state directory is per-user, so hashing the scm root is
+      // enough to keep snapshots for different repos apart.
+      cachePersistPath_(fmt::format(
+          "{}/hg-mergebase-{:x}.json",
+          w_string_piece(flags.watchman_state_file).dirName(),
+          w_string_piece(scmRoot).hashValue())) {}
+
+namespace {
+// Bump when the snapshot layout changes; mismatched snapshots are
+// silently ignored and rewritten on the next cache store.
+constexpr json_int_t kCachePersistVersion = 1;
+} // namespace
+
+void Mercurial::loadPersistedCaches() const {
+  if (flags.dont_save_state) {
+    return;
+  }
+
+  std::optional<json_ref> snapshot;
+  try {
+    snapshot = json_load_file(cachePersistPath_.c_str(), 0);
+  } catch (const std::exception&) {
+    // Missing or unparseable snapshot; the first query simply pays the
+    // hg cost the way it always has.
+    return;
+  }
+
+  auto version = snapshot->get_optional("version");
+  if (!version || !version->isInt() ||
+      version->asInt() != kCachePersistVersion) {
+    return;
+  }
+  auto scmRoot = snapshot->get_optional("scm_root");
+  if (!scmRoot || !scmRoot->isString() ||
+      json_to_w_string(*scmRoot) != getSCMRoot()) {
+    return;
+  }
+
+  // The cache keys embed the dirstate mtime; only entries matching the
+  // dirstate as it stands now can ever be hit, so don't let stale ones
+  // occupy LRU slots.
+  auto mtime = getDirStateMtime();
+  auto suffix = fmt::format(":{}:{}", mtime.tv_sec, mtime.tv_nsec);
+  auto admissible = [&](const w_string& key) {
+    return key.size() > suffix.size() &&
+        memcmp(
+            key.data() + key.size() - suffix.size(),
+            suffix.data(),
+            suffix.size()) == 0;
+  };
+
+  size_t loaded = 0;
+  if (auto mergebase = snapshot->get_optional("mergebase");
+      mergebase && mergebase->isObject()) {
+    for (auto& [key, value] : mergebase->object()) {
+      if (!value.isString() || !admissible(key)) {
+        continue;
+      }
+      mergeBases_.set(std::string{key.view()}, json_to_w_string(value));
+      ++loaded;
+    }
+  }
+  if (auto commits = snapshot->get_optional("commits_prior");
+      commits && commits->isObject()) {
+    for (auto& [key, value] : commits->object()) {
+      if (!value.isArray() || !admissible(key)) {
+        continue;
+      }
+      std::vector<w_string> lines;
+      lines.reserve(value.array().size());
+      for (auto& line : value.array()) {
+        if (line.isString()) {
+          lines.push_back(json_to_w_string(line));
+        }
+      }
+      commitsPrior_.set(std::string{key.view()}, std::move(lines));
+      ++loaded;
+    }
+  }
+
+  if (loaded) {
+    // Seeding counts as cache stores; don't let it trigger an
+    // immediate no-op rewrite of the snapshot we just read.
+    lastPersistedStores_.store(
+        mergeBases_.stats().cacheStore + commitsPrior_.stats().cacheStore,
+        std::memory_order_release);
+    log(DBG,
+        "seeded ",
+        loaded,
+        " hg cache entries from ",
+        cachePersistPath_,
+        "\n");
+  }
+}
+
+void Mercurial::maybePersistCaches() const {
+  if (flags.dont_save_state) {
+    return;
+  }
+
+  auto stores =
+      mergeBases_.stats().cacheStore + commitsPrior_.stats().cacheStore;
+  auto last = lastPersistedStores_.load(std::memory_order_acquire);
+  if (stores == last ||
+      !lastPersistedStores_.compare_exchange_strong(last, stores)) {
+    // Nothing new since the last snapshot, or a racing caller claimed
+    // this delta and is writing it out already.
+    return;
+  }
+
+  auto mergebase = json_object();
+  mergeBases_.forEachCached(
+      [&](const std::string& key, const w_string& value) {
+        mergebase.set(w_string(key.data(), key.size()), w_string_to_json(value));
+      });
+  auto commits = json_object();
+  commitsPrior_.forEachCached(
+      [&](const std::string& key, const std::vector<w_string>& lines) {
+        std::vector<json_ref> arr;
+        arr.reserve(lines.size());
+        for (auto& line : lines) {
+          arr.push_back(w_string_to_json(line));
+        }
+        commits.set(w_string(key.data(), key.size()), json_array(std::move(arr)));
+      });
+
+  auto snapshot = json_object(
+      {{"version", json_integer(kCachePersistVersion)},
+       {"scm_root", w_string_to_json(getSCMRoot())},
+       {"mergebase", std::move(mergebase)},
+       {"commits_prior", std::move(commits)}});
+
+  // Write-then-rename so a crash mid-write can't leave a torn snapshot
+  // for the next daemon to trip over.
+  auto tmpPath = cachePersistPath_ + ".tmp";
+  if (json_dump_file(snapshot, tmpPath.c_str(), 0) == 0 &&
+      std::rename(tmpPath.c_str(), cachePersistPath_.c_str()) == 0) {
+    return;
+  }
+  log(DBG,
+      "failed to persist hg caches to ",
+      cachePersistPath_,
+      ": ",
+      folly::errnoStr(errno),
+      "\n");
+  std::remove(tmpPath.c_str());
+}
 
 struct timespec Mercurial::getDirStateMtime() const {
   try {
@@ -154,11 +304,15 @@ struct timespec Mercurial::getDirStateMtime() const {
 w_string Mercurial::mergeBaseWith(
     w_string_piece commitId,
     const std::optional<w_string>& requestId) const {
+  std::call_once(cacheLoadOnce_, [this] { loadPersistedCaches(); });
+
+  prewarmParams_.wlock()->mergeBaseCommit = commitId.asWString();
+
   auto mtime = getDirStateMtime();
   auto key = fmt::format("{}:{}:{}", commitId, mtime.tv_sec, mtime.tv_nsec);
   auto commit = std::string{commitId.view()};
 
-  return mergeBases_
+  auto mergeBase = mergeBases_
       .get(
           key,
           [this, commit, requestId](const std::string&) {
@@ -184,6 +338,8 @@ w_string Mercurial::mergeBaseWith(
           })
       .get()
       ->value();
+  maybePersistCaches();
+  return mergeBase;
 }
 
 std::vector<w_string> Mercurial::getFilesChangedSinceMergeBaseWith(
@@ -253,12 +409,16 @@ std::vector<w_string> Mercurial::getCommitsPriorToAndIncluding(
     w_string_piece commitId,
     int numCommits,
     const std::optional<w_string>& requestId) const {
+  std::call_once(cacheLoadOnce_, [this] { loadPersistedCaches(); });
+
+  prewarmParams_.wlock()->numCommits = numCommits;
+
   auto mtime = getDirStateMtime();
   auto key = fmt::format(
       "{}:{}:{}:{}", commitId, numCommits, mtime.tv_sec, mtime.tv_nsec);
   auto commitCopy = std::string{commitId.view()};
 
-  return commitsPrior_
+  auto commits = commitsPrior_
       .get(
           key,
           [this, commit = std::move(commitCopy), numCommits, requestId](
@@ -282,6 +442,35 @@ std::vector<w_string> Mercurial::getCommitsPriorToAndIncluding(
           })
       .get()
       ->value();
+  maybePersistCaches();
+  return commits;
+}
+
+void Mercurial::prewarm() const {
+  auto params = *prewarmParams_.rlock();
+  if (params.mergeBaseCommit.empty()) {
+    // No SCM-aware query has run yet, so we don't know what to warm
+    return;
+  }
+  if (prewarmInFlight_.exchange(true)) {
+    return;
+  }
+  SCOPE_EXIT {
+    prewarmInFlight_.store(false);
+  };
+
+  try {
+    // The dirstate mtime advanced during the operation, so these
+    // lookups populate the caches under the keys that the next
+    // interactive query will compute.
+    auto mergeBase = mergeBaseWith(params.mergeBaseCommit);
+    if (params.numCommits) {
+      getCommitsPriorToAndIncluding(mergeBase, params.numCommits);
+    }
+  } catch (const std::exception& exc) {
+    // Purely advisory; the interactive query will report any real error
+    log(DBG, "hg cache prewarm failed: ", exc.what(), "\n");
+  }
 }
 
 } // namespace watchman
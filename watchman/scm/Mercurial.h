@@ -8,6 +8,9 @@
 #pragma once
 #include "watchman/watchman_system.h"
 
+#include <folly/Synchronized.h>
+#include <atomic>
+#include <mutex>
 #include <string>
 #include "watchman/ChildProcess.h"
 #include "watchman/LRUCache.h"
@@ -36,12 +39,46 @@ class Mercurial : public SCM {
       int numCommits,
       const std::optional<w_string>& requestId = std::nullopt) const override;
 
+  // Re-run the most recent mergeBaseWith/getCommitsPriorToAndIncluding
+  // parameters so that their caches are warm under the post-operation
+  // dirstate mtime.  Invoked from the thread pool when an hg.* state is
+  // vacated; see prewarm() in SCM.h.
+  void prewarm() const override;
+
  private:
+  // Parameters observed on the most recent SCM-aware queries, replayed
+  // by prewarm().
+  struct PrewarmParams {
+    w_string mergeBaseCommit;
+    int numCommits{0};
+  };
+
   std::string dirStatePath_;
   mutable LRUCache<std::string, std::vector<w_string>> commitsPrior_;
   mutable LRUCache<std::string, w_string> mergeBases_;
   mutable LRUCache<std::string, std::vector<w_string>>
       filesChangedSinceMergeBaseWith_;
+  mutable folly::Synchronized<PrewarmParams> prewarmParams_;
+  mutable std::atomic<bool> prewarmInFlight_{false};
+
+  // The mergebase and commits-prior caches are snapshotted to a
+  // versioned json file in the state directory so a freshly restarted
+  // daemon answers its first scm-aware query without forking hg.  The
+  // cache keys embed the dirstate mtime, so only entries matching the
+  // current dirstate are admitted on load; anything else is already
+  // stale.  The clock-keyed files-changed cache is process-bound and is
+  // never persisted.
+  std::string cachePersistPath_;
+  mutable std::once_flag cacheLoadOnce_;
+  mutable std::atomic<uint64_t> lastPersistedStores_{0};
+
+  // Seeds the caches from the persisted snapshot, if one exists and
+  // matches the current format version and dirstate mtime.
+  void loadPersistedCaches() const;
+
+  // Rewrites the snapshot if any cache store happened since the last
+  // persist; called after the lookups that can populate the caches.
+  void maybePersistCaches() const;
 
   // Returns options for invoking hg
   ChildProcess::Options makeHgOptions(
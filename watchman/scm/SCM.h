@@ -86,6 +86,13 @@ class SCM {
       int numCommits,
       const std::optional<w_string>& requestId = std::nullopt) const = 0;
 
+  // Hint that an SCM operation (eg: a rebase) just completed.
+  // Implementations may use this to pre-compute and cache whatever the
+  // next SCM-aware query would otherwise have to wait for.  May be
+  // called from an arbitrary thread and may block; the default does
+  // nothing.
+  virtual void prewarm() const {}
+
  private:
   w_string rootPath_;
   w_string scmRoot_;
@@ -8,6 +8,10 @@
 #include "watchman/state.h"
 #include <folly/String.h>
 #include <folly/Synchronized.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include "watchman/Errors.h"
 #include "watchman/Logging.h"
 #include "watchman/Options.h"
@@ -15,6 +19,7 @@
 #include "watchman/QueryableView.h"
 #include "watchman/Shutdown.h"
 #include "watchman/TriggerCommand.h"
+#include "watchman/WatchmanConfig.h"
 #include "watchman/root/Root.h"
 #include "watchman/root/resolve.h"
 #include "watchman/root/watchlist.h"
@@ -36,31 +41,69 @@ using namespace watchman;
 namespace {
 struct state {
   bool needsSave{false};
+  // Records queued by w_state_append() and not yet written to the
+  // journal.
+  std::vector<json_ref> pendingAppends;
+  // Records written to the journal since the last full snapshot.  When
+  // this crosses kJournalCompactThreshold we fold the journal back into
+  // the snapshot so that replay time at load doesn't grow without
+  // bound.
+  size_t journalRecords{0};
 };
 folly::Synchronized<state, std::mutex> saveState;
 std::condition_variable stateCond;
 std::thread state_saver_thread;
+
+constexpr size_t kJournalCompactThreshold = 1024;
+
+std::string journal_file_name() {
+  return flags.watchman_state_file + ".journal";
+}
 } // namespace
 
 static bool do_state_save();
+static bool do_state_append(const std::vector<json_ref>& records);
+static void replay_journal();
 
 static void state_saver() noexcept {
   bool do_save;
+  std::vector<json_ref> appends;
 
   w_set_thread_name("statesaver");
 
   while (!w_is_stopping()) {
+    appends.clear();
     {
       auto state = saveState.lock();
-      if (!state->needsSave) {
+      if (!state->needsSave && state->pendingAppends.empty()) {
         stateCond.wait(state.as_lock());
       }
       do_save = state->needsSave;
       state->needsSave = false;
+
+      if (do_save ||
+          state->journalRecords + state->pendingAppends.size() >=
+              kJournalCompactThreshold) {
+        // A snapshot reflects the live state, which already includes
+        // whatever the queued records describe, so they are dropped
+        // rather than appended.
+        do_save = true;
+        state->pendingAppends.clear();
+        state->journalRecords = 0;
+      } else {
+        std::swap(appends, state->pendingAppends);
+        state->journalRecords += appends.size();
+      }
     }
 
     if (do_save) {
       do_state_save();
+    } else if (!appends.empty() && !do_state_append(appends)) {
+      // Couldn't append; fall back to a full snapshot so the change
+      // isn't lost.  The snapshot truncates the journal, so the counter
+      // is reset along with it.
+      do_state_save();
+      saveState.lock()->journalRecords = 0;
     }
   }
 }
@@ -108,6 +151,8 @@ bool w_state_load() {
     return false;
   }
 
+  replay_journal();
+
   return true;
 }
 
@@ -137,6 +182,53 @@ static bool do_state_save() {
 
   /* we've prepared what we're going to save, so write it out */
   buffer.jsonEncodeToStream(state, file.get(), JSON_INDENT(4));
+
+  // The snapshot supersedes everything in the journal; truncate it so
+  // the next load doesn't replay stale records on top of it.
+  auto journal = w_stm_open(
+      journal_file_name().c_str(), O_WRONLY | O_TRUNC | O_CREAT, 0600);
+  if (!journal) {
+    log(ERR,
+        "save_state: unable to truncate journal ",
+        journal_file_name(),
+        ": ",
+        folly::errnoStr(errno),
+        "\n");
+  }
+
+  return true;
+}
+
+/** Appends the queued records to the state journal as a sequence of
+ * BSER PDUs.  Unlike do_state_save() the cost here is proportional to
+ * the records being written, not to the number of watches and triggers
+ * in existence. */
+static bool do_state_append(const std::vector<json_ref>& records) {
+  PduBuffer buffer;
+
+  auto file = w_stm_open(
+      journal_file_name().c_str(), O_WRONLY | O_APPEND | O_CREAT, 0600);
+  if (!file) {
+    log(ERR,
+        "save_state: unable to open journal ",
+        journal_file_name(),
+        " for append: ",
+        folly::errnoStr(errno),
+        "\n");
+    return false;
+  }
+
+  for (const auto& record : records) {
+    auto encodeResult = buffer.bserEncodeToStream(2, 0, record, file.get());
+    if (encodeResult.hasError()) {
+      logf(
+          ERR,
+          "save_state: failed to append journal record: {}\n",
+          folly::errnoStr(encodeResult.error()));
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -151,6 +243,17 @@ void w_state_save() {
   stateCond.notify_one();
 }
 
+/** Queues one state-change record for the saver thread to append to the
+ * journal.  Does not immediately write it. */
+void w_state_append(json_ref record) {
+  if (flags.dont_save_state) {
+    return;
+  }
+
+  saveState.lock()->pendingAppends.push_back(std::move(record));
+  stateCond.notify_one();
+}
+
 bool w_root_save_state(json_ref& state) {
   bool result = true;
 
@@ -167,6 +270,19 @@ bool w_root_save_state(json_ref& state) {
 
       json_object_set_new(obj, "path", w_string_to_json(root->root_path));
 
+      // Record the wall-clock last access so that a restarting daemon
+      // can bring hot roots up first; see w_root_load_state.  The live
+      // timestamp is on the steady clock, so rebase it.
+      auto sinceCmd = std::chrono::steady_clock::now() -
+          root->inner.last_cmd_timestamp.load(std::memory_order_acquire);
+      auto lastAccessWall = std::chrono::system_clock::now() -
+          std::chrono::duration_cast<std::chrono::system_clock::duration>(
+              sinceCmd);
+      json_object_set_new(
+          obj,
+          "last_accessed",
+          json_integer(std::chrono::system_clock::to_time_t(lastAccessWall)));
+
       auto triggers = root->triggerListToJson();
       json_object_set_new(obj, "triggers", std::move(triggers));
 
@@ -179,9 +295,72 @@ bool w_root_save_state(json_ref& state) {
   return result;
 }
 
-bool w_root_load_state(const json_ref& state) {
-  size_t i;
+/** Re-establishes one saved watch: resolves the root, re-creates its
+ * trigger configuration and starts its threads.  Errors are logged and
+ * confined to the one root. */
+static void restore_watched_root(const json_ref& obj) {
+  bool created = false;
+  size_t j;
+
+  auto triggers = obj.get("triggers");
+  auto path = json_object_get(obj, "path");
+  const char* filename = path ? json_string_value(*path) : nullptr;
 
+  std::shared_ptr<Root> root;
+  try {
+    root = root_resolve(filename, true, &created);
+  } catch (const std::exception&) {
+    return;
+  }
+
+  {
+    auto wlock = root->triggers.wlock();
+    auto& map = *wlock;
+
+    /* re-create the trigger configuration */
+    for (j = 0; j < json_array_size(triggers); j++) {
+      const auto& tobj = triggers.at(j);
+
+      // Legacy rules format
+      auto rarray = tobj.get_optional("rules");
+      if (rarray) {
+        continue;
+      }
+
+      try {
+        auto cmd = std::make_unique<TriggerCommand>(getInterface, root, tobj);
+        cmd->start(root);
+        auto& mapEntry = map[cmd->triggername];
+        mapEntry = std::move(cmd);
+      } catch (const std::exception& exc) {
+        watchman::log(
+            watchman::ERR,
+            "loading trigger for ",
+            root->root_path,
+            ": ",
+            exc.what(),
+            "\n");
+      }
+    }
+  }
+
+  if (created) {
+    try {
+      root->view()->startThreads(root);
+    } catch (const std::exception& e) {
+      watchman::log(
+          watchman::ERR,
+          "root_start(",
+          root->root_path,
+          ") failed: ",
+          e.what(),
+          "\n");
+      root->cancel();
+    }
+  }
+}
+
+bool w_root_load_state(const json_ref& state) {
   auto watched = state.get_optional("watched");
   if (!watched) {
     return true;
@@ -191,70 +370,160 @@ bool w_root_load_state(const json_ref& state) {
     return false;
   }
 
-  for (i = 0; i < json_array_size(*watched); i++) {
-    const auto& obj = watched->at(i);
-    bool created = false;
-    size_t j;
-
-    auto triggers = obj.get("triggers");
-    auto path = json_object_get(obj, "path");
-    const char* filename = path ? json_string_value(*path) : nullptr;
-
-    std::shared_ptr<Root> root;
-    try {
-      root = root_resolve(filename, true, &created);
-    } catch (const std::exception&) {
-      continue;
+  // Restore hot roots first: a fleet restart is most visible as the
+  // interval before the roots people are actively working in answer
+  // queries again, so order by the saved last-accessed time.
+  std::vector<json_ref> entries;
+  entries.reserve(json_array_size(*watched));
+  for (size_t i = 0; i < json_array_size(*watched); i++) {
+    entries.push_back(watched->at(i));
+  }
+  auto lastAccessed = [](const json_ref& obj) -> json_int_t {
+    auto t = obj.get_optional("last_accessed");
+    return t && t->isInt() ? t->asInt() : 0;
+  };
+  std::stable_sort(
+      entries.begin(),
+      entries.end(),
+      [&](const json_ref& a, const json_ref& b) {
+        return lastAccessed(a) > lastAccessed(b);
+      });
+
+  // Root resolution is dominated by per-root filesystem work (realpath,
+  // config discovery, watcher setup), so with hundreds of saved roots a
+  // sequential pass keeps the last ones dark for minutes.  Spread the
+  // restoration over a bounded pool; workers claim entries in the
+  // hot-first order above.  root_resolve and the watch list are already
+  // safe for concurrent callers (clients race watch commands all the
+  // time), and the crawls themselves run on each root's own threads.
+  auto n_workers = std::max<json_int_t>(
+      1, cfg_get_int("root_restore_concurrency", 8));
+  n_workers = std::min<json_int_t>(n_workers, entries.size());
+
+  std::atomic<size_t> nextEntry{0};
+  auto worker = [&]() {
+    while (true) {
+      auto i = nextEntry.fetch_add(1, std::memory_order_relaxed);
+      if (i >= entries.size()) {
+        return;
+      }
+      restore_watched_root(entries[i]);
     }
+  };
+
+  if (n_workers <= 1) {
+    worker();
+  } else {
+    std::vector<std::thread> workers;
+    for (json_int_t i = 0; i < n_workers; ++i) {
+      workers.emplace_back(worker);
+    }
+    for (auto& thr : workers) {
+      thr.join();
+    }
+  }
 
-    {
-      auto wlock = root->triggers.wlock();
-      auto& map = *wlock;
-
-      /* re-create the trigger configuration */
-      for (j = 0; j < json_array_size(triggers); j++) {
-        const auto& tobj = triggers.at(j);
+  return true;
+}
 
-        // Legacy rules format
-        auto rarray = tobj.get_optional("rules");
-        if (rarray) {
-          continue;
-        }
+/** Applies one journal record on top of the loaded snapshot state. */
+static void apply_state_record(const json_ref& record) {
+  auto op = record.get_optional("op");
+  auto rootPath = record.get_optional("root");
+  if (!op || !op->isString() || !rootPath || !rootPath->isString()) {
+    return;
+  }
+  auto opName = json_to_w_string(*op);
 
-        try {
-          auto cmd = std::make_unique<TriggerCommand>(getInterface, root, tobj);
-          cmd->start(root);
-          auto& mapEntry = map[cmd->triggername];
-          mapEntry = std::move(cmd);
-        } catch (const std::exception& exc) {
-          watchman::log(
-              watchman::ERR,
-              "loading trigger for ",
-              root->root_path,
-              ": ",
-              exc.what(),
-              "\n");
-        }
-      }
-    }
+  bool created = false;
+  std::shared_ptr<Root> root;
+  try {
+    root = root_resolve(json_string_value(*rootPath), true, &created);
+  } catch (const std::exception&) {
+    return;
+  }
 
-    if (created) {
+  if (opName == "trigger-set") {
+    auto tobj = record.get_optional("trigger");
+    if (tobj && tobj->isObject()) {
       try {
-        root->view()->startThreads(root);
-      } catch (const std::exception& e) {
+        auto cmd = std::make_unique<TriggerCommand>(getInterface, root, *tobj);
+        auto wlock = root->triggers.wlock();
+        auto& entry = (*wlock)[cmd->triggername];
+        if (entry) {
+          entry->stop();
+        }
+        cmd->start(root);
+        entry = std::move(cmd);
+      } catch (const std::exception& exc) {
         watchman::log(
             watchman::ERR,
-            "root_start(",
+            "replaying trigger for ",
             root->root_path,
-            ") failed: ",
-            e.what(),
+            ": ",
+            exc.what(),
             "\n");
-        root->cancel();
+      }
+    }
+  } else if (opName == "trigger-del") {
+    auto name = record.get_optional("name");
+    if (name && name->isString()) {
+      std::unique_ptr<TriggerCommand> cmd;
+      {
+        auto wlock = root->triggers.wlock();
+        auto it = wlock->find(json_to_w_string(*name));
+        if (it != wlock->end()) {
+          std::swap(cmd, it->second);
+          wlock->erase(it);
+        }
+      }
+      if (cmd) {
+        cmd->stop();
       }
     }
   }
 
-  return true;
+  if (created) {
+    try {
+      root->view()->startThreads(root);
+    } catch (const std::exception& e) {
+      watchman::log(
+          watchman::ERR,
+          "root_start(",
+          root->root_path,
+          ") failed: ",
+          e.what(),
+          "\n");
+      root->cancel();
+    }
+  }
+}
+
+/** Replays any journal records written since the snapshot was last
+ * compacted.  Decode errors terminate the replay; everything up to the
+ * bad record still applies, mirroring how a truncated append would be
+ * recovered. */
+static void replay_journal() {
+  auto file = w_stm_open(journal_file_name().c_str(), O_RDONLY, 0);
+  if (!file) {
+    // No journal simply means nothing changed since the last snapshot.
+    return;
+  }
+
+  PduBuffer buffer;
+  json_error_t jerr;
+  size_t replayed = 0;
+
+  while (auto record = buffer.decodeNext(file.get(), &jerr)) {
+    apply_state_record(*record);
+    ++replayed;
+  }
+
+  if (replayed) {
+    // Fold what we just replayed into a fresh snapshot so the journal
+    // doesn't accumulate across restarts.
+    w_state_save();
+  }
 }
 
 /* vim:ts=2:sw=2:et:
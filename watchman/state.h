@@ -10,7 +10,19 @@
 #include "watchman/thirdparty/jansson/jansson.h"
 
 void w_state_shutdown();
+
+/** Arranges for a full snapshot of the state to be written out.
+ * Also compacts (truncates) the journal, which the snapshot supersedes. */
 void w_state_save();
+
+/** Queues a single state-change record to be appended to the state
+ * journal; an O(entry) alternative to w_state_save() for high-frequency
+ * changes such as trigger registration.  Recognized records:
+ *   {"op": "trigger-set", "root": path, "trigger": definition}
+ *   {"op": "trigger-del", "root": path, "name": triggername}
+ * Records are replayed on top of the snapshot at load time. */
+void w_state_append(json_ref record);
+
 bool w_state_load();
 
 bool w_root_save_state(json_ref& state);
@@ -7,6 +7,7 @@
 
 #include <chrono>
 #include <thread>
+#include "watchman/UserDir.h"
 #include "watchman/WatchmanConfig.h"
 #include "watchman/watchman_stream.h"
 
@@ -16,6 +17,30 @@
 
 using namespace watchman;
 
+int Stream::writeWithFd(const void*, int, int) {
+  // Only local unix sockets can carry file descriptors.
+  errno = ENOTSUP;
+  return -1;
+}
+
+int Stream::writev(const StreamSegment* segs, int count) {
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    auto* p = static_cast<const char*>(segs[i].data);
+    size_t remaining = segs[i].size;
+    while (remaining) {
+      int x = write(p, static_cast<int>(remaining));
+      if (x <= 0) {
+        return total ? total : x;
+      }
+      p += x;
+      remaining -= x;
+      total += x;
+    }
+  }
+  return total;
+}
+
 int w_poll_events(EventPoll* p, int n, int timeoutms) {
 #ifdef _WIN32
   if (!p->evt->isSocket()) {
@@ -69,3 +94,31 @@ std::unique_ptr<watchman_stream> w_mkstemp(char* templ) {
   return w_stm_fdopen(std::move(fd));
 #endif
 }
+
+std::unique_ptr<watchman_stream> w_stm_open_anonymous() {
+#if defined(O_TMPFILE) && !defined(_WIN32)
+  // An O_TMPFILE file never gets a directory entry, so there is no
+  // window in which a crash can leak a spool file and no unlink call.
+  FileDescriptor fd(
+      open(
+          getTemporaryDirectory().c_str(),
+          O_TMPFILE | O_RDWR | O_CLOEXEC,
+          0600),
+      FileDescriptor::FDType::Generic);
+  if (fd) {
+    return w_stm_fdopen(std::move(fd));
+  }
+  // Filesystem or kernel without O_TMPFILE support; fall through to
+  // the named-file path.
+#endif
+  char name[WATCHMAN_NAME_MAX];
+  snprintf(
+      name, sizeof(name), "%s/wmanXXXXXX", getTemporaryDirectory().c_str());
+  auto stm = w_mkstemp(name);
+#ifndef _WIN32
+  if (stm) {
+    unlink(name);
+  }
+#endif
+  return stm;
+}
@@ -7,7 +7,12 @@
 
 #include <folly/SocketAddress.h>
 #include <folly/net/NetworkSocket.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#include <limits.h>
 #include <memory>
+#include <vector>
 #include "watchman/Constants.h"
 #include "watchman/Logging.h"
 #include "watchman/fs/FileDescriptor.h"
@@ -224,6 +229,114 @@ class UnixStream : public watchman_stream {
     return x.value();
   }
 
+#ifndef _WIN32
+  int writev(const StreamSegment* segs, int count) override {
+    // StreamSegment is layout-compatible with iovec.
+    auto* iov = reinterpret_cast<const struct iovec*>(segs);
+    static_assert(sizeof(StreamSegment) == sizeof(struct iovec));
+
+    if (!blocking_) {
+      auto x = ::writev(fd.fd(), iov, std::min<int>(count, IOV_MAX));
+      if (x < 0) {
+        return -1;
+      }
+      errno = 0;
+      return static_cast<int>(x);
+    }
+
+    int wrote = 0;
+    int idx = 0;
+    size_t offset = 0;
+    std::vector<struct iovec> pending;
+    while (idx < count) {
+      struct pollfd pfd;
+      pfd.fd = fd.system_handle();
+      pfd.events = POLLOUT;
+      if (poll(&pfd, 1, kWriteTimeout) == 0) {
+        break;
+      }
+      if (pfd.revents & (POLLERR | POLLHUP)) {
+        break;
+      }
+
+      // Rebuild the remaining chain, accounting for a partial first
+      // segment from a prior short write.
+      pending.clear();
+      for (int i = idx; i < count && pending.size() < size_t(IOV_MAX); ++i) {
+        struct iovec v = iov[i];
+        if (i == idx) {
+          v.iov_base = static_cast<char*>(v.iov_base) + offset;
+          v.iov_len -= offset;
+        }
+        pending.push_back(v);
+      }
+
+      auto x = ::writev(fd.fd(), pending.data(), pending.size());
+      if (x < 0) {
+        break;
+      }
+      if (x == 0) {
+        errno = 0;
+        break;
+      }
+      wrote += x;
+
+      size_t advanced = static_cast<size_t>(x);
+      while (idx < count && advanced >= iov[idx].iov_len - offset) {
+        advanced -= iov[idx].iov_len - offset;
+        offset = 0;
+        ++idx;
+      }
+      offset += advanced;
+    }
+    return wrote == 0 ? -1 : wrote;
+  }
+
+  int writeWithFd(const void* buf, int size, int fdToSend) override {
+    // Attach the descriptor as SCM_RIGHTS ancillary data on the leading
+    // bytes; once the kernel accepts any part of the message the fd has
+    // been transferred and the remainder follows as a plain write.
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(buf);
+    iov.iov_len = size;
+
+    union {
+      struct cmsghdr hdr;
+      char space[CMSG_SPACE(sizeof(int))];
+    } cmsgbuf{};
+
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgbuf.space;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int));
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fdToSend, sizeof(int));
+
+    int x;
+    do {
+      x = ::sendmsg(fd.system_handle(), &msg, 0);
+    } while (x < 0 && errno == EINTR);
+    if (x < 0) {
+      // Nothing sent, descriptor not transferred; the caller falls
+      // back to a plain write.
+      return -1;
+    }
+    if (x < size) {
+      auto rest = write(static_cast<const char*>(buf) + x, size - x);
+      if (rest > 0) {
+        x += rest;
+      }
+    }
+    errno = 0;
+    return x;
+  }
+#endif
+
   watchman_event* getEvents() override {
     return &evt;
   }
@@ -6,9 +6,15 @@
  */
 
 #include <stdarg.h>
+#include <algorithm>
+#include <array>
+#include <mutex>
 #include <new>
 #include <ostream>
 #include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include "watchman/Hash.h"
 #include "watchman/thirdparty/jansson/utf.h"
 #include "watchman/watchman_string.h"
 
@@ -332,13 +338,10 @@ void w_string::reset() noexcept {
 }
 
 inline uint32_t hash_string(const char* str, size_t len) {
-  // Watchman used to use Bob Jenkins's lookup3. Many good hash functions exist,
-  // but, empirically, the standard library's are faster than lookup3 and
-  // convenient.
-  size_t hash = std::hash<std::string_view>{}(std::string_view(str, len));
-  // Supporting 32-bit is easy: we can skip the mix.
-  static_assert(
-      sizeof(size_t) == sizeof(uint64_t), "32-bit platforms are not supported");
+  // Watchman used to use Bob Jenkins's lookup3 and later the standard
+  // library's hash; w_hash_bytes is a wyhash-style word-at-a-time mix
+  // that measures faster on the short path components we hash here.
+  uint64_t hash = w_hash_bytes(str, len);
 
   // We could use do fancy mixing like with twang_32from64 but a simple xor
   // should be sufficient for hash tables.
@@ -378,6 +381,33 @@ std::optional<w_string> w_string::asLowerCaseSuffix() const {
   return piece().asLowerCaseSuffix();
 }
 
+w_string w_string::asLowerCase() const {
+  if (!str_ || str_->is_self_lowered()) {
+    return *this;
+  }
+
+  uint32_t len = str_->len;
+  const char* buf = str_->buf();
+  uint32_t i = 0;
+  while (i < len &&
+         buf[i] ==
+             static_cast<char>(tolower(static_cast<unsigned char>(buf[i])))) {
+    ++i;
+  }
+
+  if (i == len) {
+    // Folding is the identity for these bytes; remember that so future
+    // calls skip the scan entirely.
+    str_->set_self_lowered();
+    return *this;
+  }
+
+  auto folded = piece().asLowerCase(type());
+  // The folded copy is its own lower-case form by construction.
+  folded.str_->set_self_lowered();
+  return folded;
+}
+
 w_string w_string::normalizeSeparators(char targetSeparator) const {
   uint32_t len = str_->len;
 
@@ -467,6 +497,108 @@ StringHash w_string_piece::hashValue() const noexcept {
   return hash_string(data(), size());
 }
 
+namespace watchman {
+
+namespace {
+
+// A modest shard count keeps concurrent crawls from contending on a single
+// lock without bloating the tables.
+constexpr size_t kInternShardCount = 16;
+
+// How many inserts a shard absorbs between sweeps of entries that
+// nothing outside the pool references any more.  Steady-state crawls
+// mostly hit existing entries and never pay for a sweep.
+constexpr size_t kInternSweepInterval = 512;
+
+struct InternShard {
+  std::mutex mutex;
+  size_t insertsSinceSweep{0};
+  // Keyed by StringHash; 32-bit collisions are rare enough that a small
+  // vector of candidates per hash value suffices.
+  std::unordered_map<StringHash, std::vector<w_string>> entries;
+};
+
+// Drops entries whose only remaining reference is the pool itself; such
+// strings can only be resurrected through the pool, so checking the
+// reference count under the shard lock is race-free.  Called with the
+// shard lock held.
+void sweepShard(InternShard& shard) {
+  auto it = shard.entries.begin();
+  while (it != shard.entries.end()) {
+    auto& candidates = it->second;
+    candidates.erase(
+        std::remove_if(
+            candidates.begin(),
+            candidates.end(),
+            [](const w_string& str) { return str.isSoleOwner(); }),
+        candidates.end());
+    if (candidates.empty()) {
+      it = shard.entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+InternShard& internShardFor(StringHash hash) {
+  // Intentionally leaked: the pool lives for the process and client
+  // threads may still hold references during shutdown.
+  static auto* shards = new std::array<InternShard, kInternShardCount>;
+  return (*shards)[hash % kInternShardCount];
+}
+
+} // namespace
+
+w_string internPathComponent(w_string_piece component) {
+  auto hash = component.hashValue();
+  auto& shard = internShardFor(hash);
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto& candidates = shard.entries[hash];
+  for (auto& str : candidates) {
+    if (str.piece() == component) {
+      return str;
+    }
+  }
+
+  auto str = component.asWString();
+  candidates.push_back(str);
+  // The local `str` above keeps the fresh entry alive through the sweep.
+  if (++shard.insertsSinceSweep >= kInternSweepInterval) {
+    shard.insertsSinceSweep = 0;
+    sweepShard(shard);
+  }
+  return str;
+}
+
+InternPoolStats getInternPoolStats() {
+  InternPoolStats stats;
+  for (size_t i = 0; i < kInternShardCount; ++i) {
+    auto& shard = internShardFor(i);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto& entry : shard.entries) {
+      stats.entries += entry.second.size();
+    }
+  }
+  return stats;
+}
+
+uint32_t internSuffixId(const w_string& lowerCaseSuffix) {
+  // Suffix interning happens on the crawl path (once per file insert)
+  // and at query parse time, so a single mutex suffices; the suffix
+  // vocabulary is far smaller than the component vocabulary above.
+  static std::mutex mutex;
+  // Intentionally leaked for the same shutdown reason as the component
+  // pool.
+  static auto* ids = new std::unordered_map<w_string, uint32_t>;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto [it, inserted] = ids->emplace(lowerCaseSuffix, ids->size() + 1);
+  return it->second;
+}
+
+} // namespace watchman
+
 uint32_t strlen_uint32(const char* str) {
   size_t slen = strlen(str);
   if (slen > UINT32_MAX) {
@@ -573,10 +705,7 @@ w_string_new_len_typed(const char* str, uint32_t len, w_string_type_t type) {
 
 void w_string_delref(StringHeader* str) {
   if (str->decref()) {
-    // Call the destructor.  We can't use regular delete because
-    // we allocated with malloc().
-    str->~StringHeader();
-    free(str);
+    StringHeader::release(str);
   }
 }
 
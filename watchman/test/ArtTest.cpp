@@ -408,3 +408,65 @@ TEST(Art, insert_search_uuid) {
   XLOG(ERR) << "maximum is " << l->key;
   EXPECT_TRUE(l && l->key == "ffffcb46-a92e-4822-82af-a7190f9c1ec5");
 }
+
+TEST(Art, collect_prefix) {
+  art_tree<uintptr_t> t;
+
+  t.insert("api.foo.bar", 1);
+  t.insert("api.foo.baz", 2);
+  t.insert("api.foe.fum", 3);
+  t.insert("abc.123.456", 4);
+  t.insert("api.foo", 5);
+  t.insert("api", 6);
+
+  auto leaves = t.collectPrefix((const unsigned char*)"api.foo", 7);
+  EXPECT_EQ(3, leaves.size());
+  uintptr_t sum = 0;
+  for (auto* leaf : leaves) {
+    EXPECT_TRUE(leaf->key.compare(0, 7, "api.foo") == 0);
+    sum += leaf->value;
+  }
+  EXPECT_EQ(1 + 2 + 5, sum);
+
+  // A prefix that matches nothing yields an empty run
+  EXPECT_TRUE(t.collectPrefix((const unsigned char*)"xyz", 3).empty());
+
+  // The empty prefix covers the whole tree
+  EXPECT_EQ(t.size(), t.collectPrefix((const unsigned char*)"", 0).size());
+}
+
+TEST(Art, erase_prefix) {
+  art_tree<uintptr_t> t;
+
+  t.insert("api.foo.bar", 1);
+  t.insert("api.foo.baz", 2);
+  t.insert("api.foe.fum", 3);
+  t.insert("abc.123.456", 4);
+  t.insert("api.foo", 5);
+  t.insert("api", 6);
+
+  // The predicate filters which matching leaves are removed
+  auto erased = t.erasePrefix(
+      (const unsigned char*)"api.foo", 7, [](const std::string& key, uintptr_t&) {
+        return key.size() > 7;
+      });
+  EXPECT_EQ(2, erased);
+  EXPECT_EQ(4, t.size());
+  EXPECT_TRUE(t.search("api.foo.bar") == nullptr);
+  EXPECT_TRUE(t.search("api.foo.baz") == nullptr);
+
+  // Survivors are untouched
+  EXPECT_EQ(5, *t.search("api.foo"));
+  EXPECT_EQ(3, *t.search("api.foe.fum"));
+  EXPECT_EQ(4, *t.search("abc.123.456"));
+  EXPECT_EQ(6, *t.search("api"));
+
+  // Erasing everything under a prefix leaves siblings intact
+  erased = t.erasePrefix(
+      (const unsigned char*)"api", 3, [](const std::string&, uintptr_t&) {
+        return true;
+      });
+  EXPECT_EQ(3, erased);
+  EXPECT_EQ(1, t.size());
+  EXPECT_EQ(4, *t.search("abc.123.456"));
+}
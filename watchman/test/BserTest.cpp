@@ -311,6 +311,166 @@ TEST(Bser, bser_tests) {
   check_bser_typed_strings();
 }
 
+TEST(Bser, columnar_template_rows) {
+  json_error_t jerr;
+
+  // The same logical data, once as object rows and once as columnar
+  // (array-form) rows in template key order; the final row exercises
+  // the short-row "property not set" case.
+  auto object_form = json_loads(
+      "["
+      "{\"name\": \"fred\", \"age\": 20}, "
+      "{\"name\": \"pete\", \"age\": 30}, "
+      "{\"name\": \"lonely\"}"
+      "]",
+      0,
+      &jerr);
+  ASSERT_TRUE(object_form) << jerr.text;
+  auto array_form =
+      json_loads("[[\"fred\", 20], [\"pete\", 30], [\"lonely\"]]", 0, &jerr);
+  ASSERT_TRUE(array_form) << jerr.text;
+
+  auto templ_text = "[\"name\", \"age\"]";
+  json_array_set_template_new(
+      object_form.value(), json_loads(templ_text, 0, &jerr).value());
+  json_array_set_template_new(
+      array_form.value(), json_loads(templ_text, 0, &jerr).value());
+
+  // Both forms must produce byte-identical BSER.
+  for (uint32_t version : {1u, 2u}) {
+    auto obj_buf = bdumps(version, 0, object_form.value());
+    auto arr_buf = bdumps(version, 0, array_form.value());
+    ASSERT_NE(obj_buf, nullptr);
+    ASSERT_NE(arr_buf, nullptr);
+    EXPECT_EQ(*obj_buf, *arr_buf) << "BSER version " << version;
+  }
+
+  // The JSON dumper expands columnar rows back into objects, so both
+  // forms carry the same data on the JSON wire.  Object key order is
+  // unspecified, so compare reparsed values rather than raw text.
+  auto arr_json = json_dumps(array_form.value(), JSON_COMPACT);
+  EXPECT_EQ(
+      "[{\"name\":\"fred\",\"age\":20},{\"name\":\"pete\",\"age\":30},"
+      "{\"name\":\"lonely\"}]",
+      arr_json);
+  auto obj_round = json_loads(
+      json_dumps(object_form.value(), JSON_COMPACT).c_str(), 0, &jerr);
+  auto arr_round = json_loads(arr_json.c_str(), 0, &jerr);
+  ASSERT_TRUE(obj_round && arr_round);
+  EXPECT_TRUE(json_equal(obj_round.value(), arr_round.value()));
+}
+
+TEST(Bser, render_sink_matches_dom_encoding) {
+  json_error_t jerr;
+  auto rows_text = "[[\"fred\", 20], [\"pete\", 300000], [\"lonely\"]]";
+  auto templ_text = "[\"name\", \"age\"]";
+
+  for (uint32_t version : {1u, 2u}) {
+    // Encode once through the DOM template path...
+    auto dom = json_loads(rows_text, 0, &jerr);
+    ASSERT_TRUE(dom) << jerr.text;
+    json_array_set_template_new(
+        dom.value(), json_loads(templ_text, 0, &jerr).value());
+    auto dom_buf = bdumps(version, 0, dom.value());
+    ASSERT_NE(dom_buf, nullptr);
+
+    // ...and once row-by-row through the render sink, spliced via a
+    // pre-encoded annotation.
+    auto rows = json_loads(rows_text, 0, &jerr);
+    ASSERT_TRUE(rows) << jerr.text;
+    watchman::BserRenderSink sink{version, 0, 2};
+    for (auto& row : rows->array()) {
+      sink.append(row);
+    }
+    auto spliced = json_array();
+    json_array_set_preencoded(
+        spliced, sink.finish(json_loads(templ_text, 0, &jerr).value()));
+    auto sink_buf = bdumps(version, 0, spliced);
+    ASSERT_NE(sink_buf, nullptr);
+
+    // The DOM path plans integer widths per column while the sink sizes
+    // each cell on its own, so compare decoded values rather than bytes.
+    auto dom_round = bunser(dom_buf->data(), dom_buf->data() + dom_buf->size());
+    auto sink_round =
+        bunser(sink_buf->data(), sink_buf->data() + sink_buf->size());
+    EXPECT_TRUE(json_equal(dom_round, sink_round))
+        << "BSER version " << version;
+  }
+
+  // Single-value rows take the plain-array path, which the sink
+  // reproduces byte for byte.
+  auto names = json_loads("[\"one\", \"two\", \"three\"]", 0, &jerr);
+  ASSERT_TRUE(names) << jerr.text;
+  auto plain_buf = bdumps(1, 0, names.value());
+  ASSERT_NE(plain_buf, nullptr);
+  watchman::BserRenderSink plain_sink{1, 0, 0};
+  for (auto& name : names->array()) {
+    plain_sink.append(name);
+  }
+  auto plain_spliced = json_array();
+  json_array_set_preencoded(plain_spliced, plain_sink.finish(std::nullopt));
+  auto plain_sink_buf = bdumps(1, 0, plain_spliced);
+  ASSERT_NE(plain_sink_buf, nullptr);
+  EXPECT_EQ(*plain_buf, *plain_sink_buf);
+}
+
+TEST(Bser, parallel_preencode_matches_serial) {
+  // Enough rows to clear the parallel encoder's activation threshold.
+  constexpr size_t kRows = 10000;
+  json_error_t jerr;
+  auto templ = json_loads("[\"name\", \"size\"]", 0, &jerr);
+  ASSERT_TRUE(templ) << jerr.text;
+
+  auto makeRows = [&]() {
+    std::vector<json_ref> rows;
+    rows.reserve(kRows);
+    for (size_t i = 0; i < kRows; ++i) {
+      rows.push_back(json_array(
+          {typed_string_to_json(
+               ("file" + std::to_string(i)).c_str(), W_STRING_UNICODE),
+           json_integer(json_int_t(i) * 7919)}));
+    }
+    return json_array(std::move(rows));
+  };
+
+  for (uint32_t version : {1u, 2u}) {
+    auto serial = makeRows();
+    json_array_set_template_new(serial, json_ref(templ.value()));
+    auto serial_buf = bdumps(version, 0, serial);
+    ASSERT_NE(serial_buf, nullptr);
+
+    auto parallel = makeRows();
+    json_array_set_template_new(parallel, json_ref(templ.value()));
+    watchman::bserParallelPreencode(parallel, version, 0);
+    ASSERT_NE(json_array_get_preencoded(parallel), nullptr);
+    auto parallel_buf = bdumps(version, 0, parallel);
+    ASSERT_NE(parallel_buf, nullptr);
+
+    // Shards use the same column-wide integer plan as the serial
+    // encoder, so the stitched output is byte-identical.
+    EXPECT_EQ(*serial_buf, *parallel_buf) << "BSER version " << version;
+  }
+
+  // Plain (untemplated) arrays shard the same way.
+  auto plain_serial = makeRows();
+  auto plain_serial_buf = bdumps(1, 0, plain_serial);
+  ASSERT_NE(plain_serial_buf, nullptr);
+  auto plain_parallel = makeRows();
+  watchman::bserParallelPreencode(plain_parallel, 1, 0);
+  auto plain_parallel_buf = bdumps(1, 0, plain_parallel);
+  ASSERT_NE(plain_parallel_buf, nullptr);
+  EXPECT_EQ(*plain_serial_buf, *plain_parallel_buf);
+
+  // Bytes pre-encoded for one format don't poison another: the DOM is
+  // still attached, so a v2 encode of a v1-annotated array falls back
+  // to the normal path.
+  auto v2_buf = bdumps(2, 0, plain_parallel);
+  ASSERT_NE(v2_buf, nullptr);
+  auto v2_serial_buf = bdumps(2, 0, plain_serial);
+  ASSERT_NE(v2_serial_buf, nullptr);
+  EXPECT_EQ(*v2_serial_buf, *v2_buf);
+}
+
 TEST(Bser, bunser_int_returns_needed) {
   size_t needed;
 
@@ -333,6 +493,61 @@ TEST(Bser, bunser_int_returns_needed) {
   EXPECT_EQ(kDecodeIntFailed, needed);
 }
 
+TEST(Bser, bunser_skip_measures_values) {
+  size_t needed;
+
+  // Work around a bug in googletest 1.11 (Ubuntu 22.04) on gcc 11.2.
+  // https://github.com/google/googletest/issues/3384
+  auto nullopt = std::optional<size_t>{};
+
+  json_error_t jerr;
+  auto doc = json_loads(
+      "[{\"name\": \"fred\", \"age\": 20}, [1, 2, 3], \"hello\", 1.5, true, "
+      "null]",
+      JSON_DECODE_ANY,
+      &jerr);
+  ASSERT_TRUE(doc) << jerr.text;
+
+  auto dump_buf = bdumps(1, 0, doc.value());
+  ASSERT_NE(dump_buf, nullptr);
+
+  // The complete document measures to its full encoded size
+  EXPECT_EQ(
+      dump_buf->size(), bunser_skip(dump_buf->data(), dump_buf->size(), &needed));
+
+  // Every proper prefix reports a short read, asking for more than what is
+  // available but never more than the full document
+  for (size_t avail = 0; avail < dump_buf->size(); avail++) {
+    EXPECT_EQ(nullopt, bunser_skip(dump_buf->data(), avail, &needed))
+        << "avail=" << avail;
+    EXPECT_GT(needed, avail);
+    EXPECT_LE(needed, dump_buf->size());
+  }
+
+  // An invalid type byte is a parse error rather than a short read
+  EXPECT_THROW(bunser_skip("\xff", 1, &needed), BserParseError);
+}
+
+TEST(Bser, bunser_array_header_decodes_count) {
+  size_t needed;
+
+  // Work around a bug in googletest 1.11 (Ubuntu 22.04) on gcc 11.2.
+  // https://github.com/google/googletest/issues/3384
+  auto nullopt = std::optional<json_int_t>{};
+
+  // An array of two elements
+  EXPECT_EQ(2, bunser_array_header("\x00\x03\x02", 3, &needed));
+  EXPECT_EQ(3, needed);
+
+  // Truncated count
+  EXPECT_EQ(nullopt, bunser_array_header("\x00\x03", 2, &needed));
+  EXPECT_EQ(3, needed);
+
+  // Not an array
+  EXPECT_EQ(nullopt, bunser_array_header("\x02\x03\x02", 3, &needed));
+  EXPECT_EQ(kDecodeIntFailed, needed);
+}
+
 // NOTE: The returned pointer may not be aligned.
 using Alloc = std::unique_ptr<char[], std::function<void(void*)>>;
 
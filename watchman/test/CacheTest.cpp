@@ -70,6 +70,39 @@ TEST(CacheTest, basics) {
   EXPECT_EQ(cache.size(), 0) << "cleared out and have zero items";
 }
 
+TEST(CacheTest, sharded_basics) {
+  ShardedLRUCache<std::string, bool> cache(4, 64, kErrorTTL);
+
+  EXPECT_EQ(cache.size(), 0) << "initially empty";
+  EXPECT_EQ(cache.get("foo"), nullptr) << "nullptr for non-existent item";
+
+  EXPECT_TRUE(cache.set("foo", true)->value()) << "inserted true";
+  EXPECT_EQ(cache.size(), 1) << "size is now one";
+  EXPECT_TRUE(cache.get("foo")->value()) << "looked up item";
+
+  EXPECT_FALSE(cache.set("foo", false)->value()) << "replaced true with false";
+  EXPECT_EQ(cache.size(), 1) << "replacement didn't change size";
+
+  EXPECT_FALSE(cache.erase("foo")->value()) << "erased and returned false foo";
+  EXPECT_EQ(cache.erase("foo"), nullptr)
+      << "double erase doesn't return anything";
+
+  for (size_t i = 0; i < 32; ++i) {
+    EXPECT_NE(cache.set(std::to_string(i), true), nullptr) << "inserted";
+  }
+  EXPECT_EQ(cache.size(), 32) << "all items fit within the total capacity";
+  for (size_t i = 0; i < 32; ++i) {
+    EXPECT_TRUE(cache.get(std::to_string(i))) << "found node " << i;
+  }
+
+  auto stats = cache.stats();
+  EXPECT_EQ(stats.size, 32) << "aggregated size matches";
+  EXPECT_EQ(stats.cacheStore, 34) << "aggregated store count across shards";
+
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0) << "cleared out and have zero items";
+}
+
 TEST(CacheTest, future) {
   using Cache = LRUCache<int, int>;
   using Node = typename Cache::NodeType;
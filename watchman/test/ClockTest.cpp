@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/Clock.h"
+#include <folly/portability/GTest.h>
+
+using namespace watchman;
+
+namespace {
+
+ClockSpec parse(const char* str) {
+  return ClockSpec{w_string_to_json(w_string{str})};
+}
+
+} // namespace
+
+TEST(Clock, parse_current_format) {
+  auto spec = parse("c:1693500000:1234:7:42");
+  auto* clock = std::get_if<ClockSpec::Clock>(&spec.spec);
+  ASSERT_NE(clock, nullptr);
+  EXPECT_EQ(clock->start_time, 1693500000);
+  EXPECT_EQ(clock->pid, 1234);
+  EXPECT_EQ(clock->position.rootNumber, 7);
+  EXPECT_EQ(clock->position.ticks, 42);
+}
+
+TEST(Clock, parse_old_format) {
+  // <= 2.8.2 clocks carry only pid and ticks; start time and root
+  // number become 0 so the query is evaluated as a fresh instance
+  auto spec = parse("c:1234:42");
+  auto* clock = std::get_if<ClockSpec::Clock>(&spec.spec);
+  ASSERT_NE(clock, nullptr);
+  EXPECT_EQ(clock->start_time, 0);
+  EXPECT_EQ(clock->pid, 1234);
+  EXPECT_EQ(clock->position.rootNumber, 0);
+  EXPECT_EQ(clock->position.ticks, 42);
+}
+
+TEST(Clock, parse_named_cursor) {
+  auto spec = parse("n:foo");
+  auto* cursor = std::get_if<ClockSpec::NamedCursor>(&spec.spec);
+  ASSERT_NE(cursor, nullptr);
+  EXPECT_EQ(cursor->cursor, w_string{"n:foo"});
+}
+
+TEST(Clock, parse_invalid) {
+  EXPECT_THROW(parse("boom"), std::domain_error);
+  EXPECT_THROW(parse("c:"), std::domain_error);
+  EXPECT_THROW(parse("c:pid:ticks"), std::domain_error);
+  EXPECT_THROW(parse("c:123"), std::domain_error);
+}
+
+TEST(Clock, round_trip) {
+  ClockSpec::init();
+  ClockPosition position{3, 99};
+  auto rendered = ClockSpec{position}.toJson();
+  auto spec = ClockSpec{rendered};
+  EXPECT_EQ(spec.position().rootNumber, 3);
+  EXPECT_EQ(spec.position().ticks, 99);
+}
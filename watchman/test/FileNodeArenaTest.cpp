@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <cstring>
+#include <vector>
+#include "watchman/FileNodeArena.h"
+
+using namespace watchman;
+
+TEST(FileNodeArenaTest, allocations_are_zeroed_and_usable) {
+  FileNodeArena arena;
+  auto* p = static_cast<char*>(arena.allocate(128));
+  for (size_t i = 0; i < 128; ++i) {
+    EXPECT_EQ(0, p[i]);
+  }
+  memset(p, 0xab, 128);
+  FileNodeArena::deallocate(p);
+}
+
+TEST(FileNodeArenaTest, many_allocations_survive_arena_destruction) {
+  std::vector<void*> ptrs;
+  {
+    FileNodeArena arena;
+    // Enough to span several slabs.
+    for (size_t i = 0; i < 100000; ++i) {
+      ptrs.push_back(arena.allocate(64 + (i % 32)));
+    }
+  }
+  // Slabs self-free when their last node is released, so releasing after
+  // the arena is gone must be safe.
+  for (auto* p : ptrs) {
+    FileNodeArena::deallocate(p);
+  }
+}
+
+TEST(FileNodeArenaTest, oversized_allocations_fall_back_to_malloc) {
+  FileNodeArena arena;
+  auto* p = static_cast<char*>(arena.allocate(4 * 1024 * 1024));
+  EXPECT_EQ(0, p[4 * 1024 * 1024 - 1]);
+  FileNodeArena::deallocate(p);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "watchman/scm/Git.h"
+#include <folly/portability/GTest.h>
+
+using namespace watchman;
+
+namespace {
+w_string statusOutput() {
+  // One changed, one unmerged and one untracked entry, plus a header
+  // line that must be ignored.
+  std::string raw;
+  raw += "# branch.head main";
+  raw += '\0';
+  raw += "1 .M N... 100644 100644 100644 1111111 2222222 dir/modified.c";
+  raw += '\0';
+  raw +=
+      "u UU N... 100644 100644 100644 100644 3333333 4444444 5555555 conflict.c";
+  raw += '\0';
+  raw += "? untracked file.txt";
+  raw += '\0';
+  return w_string{raw.data(), raw.size()};
+}
+} // namespace
+
+TEST(Git, appendStatusV2Paths) {
+  std::unordered_set<w_string> paths;
+  Git::appendStatusV2Paths(statusOutput(), paths);
+
+  EXPECT_EQ(paths.size(), 3);
+  EXPECT_EQ(paths.count(w_string{"dir/modified.c"}), 1);
+  EXPECT_EQ(paths.count(w_string{"conflict.c"}), 1);
+  // Paths may contain spaces; only the metadata fields are delimited
+  EXPECT_EQ(paths.count(w_string{"untracked file.txt"}), 1);
+}
+
+TEST(Git, appendStatusV2PathsEmpty) {
+  std::unordered_set<w_string> paths;
+  Git::appendStatusV2Paths(w_string{""}, paths);
+  EXPECT_TRUE(paths.empty());
+}
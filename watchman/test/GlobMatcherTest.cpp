@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include "watchman/query/GlobTree.h"
+#include "watchman/thirdparty/wildmatch/wildmatch.h"
+
+using namespace watchman;
+
+namespace {
+
+// Verifies that the compiled matcher agrees with wildmatch for a single
+// pattern/name pair under the given flags.
+void expectParity(
+    const char* pattern,
+    const char* name,
+    int flags,
+    bool caseInsensitive) {
+  auto compiled = GlobComponentMatcher::compile(pattern, flags, caseInsensitive);
+  if (!compiled.has_value()) {
+    // Not compilable under these flags (eg: folded classes); the walk
+    // falls back to wildmatch, so there is nothing to compare.
+    return;
+  }
+  bool expected = wildmatch(
+                      pattern,
+                      name,
+                      flags | (caseInsensitive ? WM_CASEFOLD : 0),
+                      nullptr) == WM_MATCH;
+  EXPECT_EQ(expected, compiled->match(name))
+      << "pattern=" << pattern << " name=" << name << " flags=" << flags
+      << " fold=" << caseInsensitive;
+}
+
+} // namespace
+
+TEST(GlobMatcher, wildmatch_parity) {
+  static const char* patterns[] = {
+      "foo",
+      "foo.c",
+      "*",
+      "*.c",
+      "foo*",
+      "f*o",
+      "f*o*bar",
+      "a**b",
+      "?",
+      "f?o",
+      "??.c",
+      "[abc]oo",
+      "[a-c]oo",
+      "[^abc]oo",
+      "[!a-c]oo",
+      "[]]x",
+      "fo[o-]",
+      "\\*literal",
+      "foo\\?bar",
+  };
+  static const char* names[] = {
+      "foo",      "fo",    "fooo",  "foo.c", "bar.c", ".foo.c", "boo",
+      "aoo",      "doo",   "a_b",   "ab",    "axyzb", "x",      "xy",
+      "*literal", "foo?bar", "foobbar", "]x",  "fo-",   "foo.cc",
+  };
+  for (auto* pattern : patterns) {
+    for (auto* name : names) {
+      for (int flags : {0, WM_PERIOD, WM_NOESCAPE, WM_PERIOD | WM_NOESCAPE}) {
+        expectParity(pattern, name, flags, false);
+        expectParity(pattern, name, flags, true);
+      }
+    }
+  }
+}
+
+TEST(GlobMatcher, leading_period) {
+  // A star may not touch a dotfile name before a literal has matched...
+  auto star = GlobComponentMatcher::compile("*", WM_PERIOD, false);
+  ASSERT_TRUE(star.has_value());
+  EXPECT_TRUE(star->match("foo"));
+  EXPECT_FALSE(star->match(".foo"));
+
+  auto qstar = GlobComponentMatcher::compile("?*", WM_PERIOD, false);
+  ASSERT_TRUE(qstar.has_value());
+  EXPECT_TRUE(qstar->match("xy"));
+  EXPECT_FALSE(qstar->match(".x"));
+
+  // ... but a literal dot (and, per wildmatch, a lone `?`) is fine
+  auto dotstar = GlobComponentMatcher::compile(".*", WM_PERIOD, false);
+  ASSERT_TRUE(dotstar.has_value());
+  EXPECT_TRUE(dotstar->match(".foo"));
+
+  auto q = GlobComponentMatcher::compile("?", WM_PERIOD, false);
+  ASSERT_TRUE(q.has_value());
+  EXPECT_TRUE(q->match("."));
+
+  // Without WM_PERIOD dotfiles are fair game
+  auto anystar = GlobComponentMatcher::compile("*", 0, false);
+  ASSERT_TRUE(anystar.has_value());
+  EXPECT_TRUE(anystar->match(".foo"));
+}
+
+TEST(GlobMatcher, case_folding) {
+  auto m = GlobComponentMatcher::compile("FoO*.C", 0, true);
+  ASSERT_TRUE(m.has_value());
+  EXPECT_TRUE(m->match("foo.c"));
+  EXPECT_TRUE(m->match("FOOzzz.C"));
+  EXPECT_FALSE(m->match("fxo.c"));
+}
+
+TEST(GlobMatcher, unsupported_syntax_falls_back) {
+  // Named classes and trailing escapes stay on the wildmatch path
+  EXPECT_FALSE(
+      GlobComponentMatcher::compile("[[:alpha:]]*", 0, false).has_value());
+  EXPECT_FALSE(GlobComponentMatcher::compile("foo\\", 0, false).has_value());
+  EXPECT_FALSE(GlobComponentMatcher::compile("[abc", 0, false).has_value());
+  // wildmatch folds classes asymmetrically, so folded classes also fall
+  // back rather than guessing
+  EXPECT_FALSE(GlobComponentMatcher::compile("[a-c]x", 0, true).has_value());
+}
+
+TEST(GlobMatcher, tree_compilation_targets_wildcard_nodes) {
+  GlobTree root("", 0);
+  root.children.emplace_back(std::make_unique<GlobTree>("src", 3));
+  root.children.back()->had_specials = 0;
+  root.children.emplace_back(std::make_unique<GlobTree>("*.c", 3));
+  root.children.back()->had_specials = 1;
+
+  root.compileMatchers(0, /*caseInsensitive=*/false);
+
+  // Case-sensitive literals keep using direct child lookup
+  EXPECT_FALSE(root.children[0]->compiled.has_value());
+  ASSERT_TRUE(root.children[1]->compiled.has_value());
+  EXPECT_TRUE(root.children[1]->compiled->match("foo.c"));
+  EXPECT_FALSE(root.children[1]->compiled->match("foo.h"));
+
+  // In folding mode even literals get a matcher
+  root.compileMatchers(0, /*caseInsensitive=*/true);
+  ASSERT_TRUE(root.children[0]->compiled.has_value());
+  EXPECT_TRUE(root.children[0]->compiled->match("SRC"));
+}
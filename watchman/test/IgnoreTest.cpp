@@ -105,6 +105,81 @@ TEST(Ignore, correctness) {
   init_state(&state);
 
   run_correctness_test(&state, tests, sizeof(tests) / sizeof(tests[0]));
+
+  // The compiled matcher must give the same answers as the radix tree.
+  state.compile();
+  run_correctness_test(&state, tests, sizeof(tests) / sizeof(tests[0]));
+}
+
+TEST(Ignore, compiled_agrees_with_tree) {
+  IgnoreSet plain;
+  IgnoreSet compiled;
+  init_state(&plain);
+  init_state(&compiled);
+  compiled.compile();
+
+  // Probe every entry itself plus the hazardous neighbors of each:
+  // its parent-ish prefix, a sibling sharing all but the last byte,
+  // and descendants at child and grandchild depth (the depths where
+  // full-style and vcs-style semantics diverge).
+  std::vector<std::string> probes;
+  auto addProbes = [&](const char* entry) {
+    std::string e{entry};
+    probes.push_back(e);
+    probes.push_back(e.substr(0, e.size() - 1));
+    probes.push_back(e + "x");
+    probes.push_back(e + "/child");
+    probes.push_back(e + "/child/grandchild");
+  };
+  for (auto* entry : ignore_dirs) {
+    addProbes(entry);
+  }
+  for (auto* entry : ignore_vcs) {
+    addProbes(entry);
+  }
+  probes.push_back("unrelated/path");
+  probes.push_back("");
+
+  for (auto& probe : probes) {
+    EXPECT_EQ(
+        plain.isIgnored(probe.data(), strlen_uint32(probe.c_str())),
+        compiled.isIgnored(probe.data(), strlen_uint32(probe.c_str())))
+        << probe;
+  }
+}
+
+TEST(Ignore, memo_agrees_with_set) {
+  IgnoreSet state;
+  init_state(&state);
+
+  // Feed the memo an order that exercises arming, hits, and re-arming,
+  // including the hazardous neighbors of each cached prefix.
+  static const struct test_case tests[] = {
+      // Full-style ignore: the memo caches "build"...
+      {"build/lower", true},
+      // ...which must not leak onto siblings that merely share bytes,
+      {"buildfile", false},
+      {"builda/hello", false},
+      // but does answer further paths under it.
+      {"build/bar", true},
+      {"build/lower/baz", true},
+      // VCS-style ignore: grandchildren are cached, but the entry and
+      // its direct children stay unignored afterwards.
+      {".hg/store/foo", true},
+      {".hg/store/foo/deeper", true},
+      {".hg/wlock", false},
+      {".hg", false},
+      // Moving to an unrelated ignored subtree re-arms the memo.
+      {"foo/buck-out/gen/x", true},
+      {"foo/buck-out/gen/y", true},
+      {"foo/hello", false},
+  };
+
+  IgnoreMemo memo;
+  for (auto& t : tests) {
+    bool res = memo.isIgnored(state, t.path, strlen_uint32(t.path));
+    EXPECT_EQ(res, t.ignored) << t.path;
+  }
 }
 
 // Load up the words data file and build a list of strings from that list.
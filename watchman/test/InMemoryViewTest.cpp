@@ -8,6 +8,8 @@
 #include "watchman/InMemoryView.h"
 #include <folly/executors/ManualExecutor.h>
 #include <folly/portability/GTest.h>
+#include <algorithm>
+#include <set>
 #include "watchman/fs/FSDetect.h"
 #include "watchman/query/GlobTree.h"
 #include "watchman/query/Query.h"
@@ -81,6 +83,36 @@ TEST_P(InMemoryViewTest, drive_initial_crawl) {
   EXPECT_STREQ("dir/file.txt", ctx.resultsArray.at(1).asCString());
 }
 
+TEST_P(InMemoryViewTest, overlapping_path_specs_walk_each_dir_once) {
+  fs.defineContents({FAKEFS_ROOT "root/dir/file.txt"});
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  Query query;
+  query.fieldList.add("name");
+  query.paths.emplace();
+  // A duplicated spec, plus a shallow root spec followed by a deeper
+  // one covering the subtree the first spec already walked.
+  query.paths->emplace_back(QueryPath{"dir", 0});
+  query.paths->emplace_back(QueryPath{"dir", 0});
+  query.paths->emplace_back(QueryPath{"", 0});
+  query.paths->emplace_back(QueryPath{"", 1});
+
+  QueryContext ctx{&query, root, false};
+  view->pathGenerator(&query, &ctx);
+
+  // Each directory is processed once: no duplicate rows, and the
+  // deeper revisit of the root does not re-emit its files.
+  EXPECT_EQ(2, ctx.resultsArray.size());
+  EXPECT_STREQ("dir/file.txt", ctx.resultsArray.at(0).asCString());
+  EXPECT_STREQ("dir", ctx.resultsArray.at(1).asCString());
+  EXPECT_EQ(2, ctx.getNumWalked());
+}
+
 TEST_P(InMemoryViewTest, respond_to_watcher_events) {
   getLog().setStdErrLoggingLevel(DBG);
 
@@ -104,11 +136,11 @@ TEST_P(InMemoryViewTest, respond_to_watcher_events) {
   EXPECT_EQ(2, ctx1.resultsArray.size());
 
   auto one = ctx1.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   auto two = ctx1.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(0, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(0, two.at(1).asInt());
 
   // Update filesystem and ensure the query results don't update.
 
@@ -122,11 +154,11 @@ TEST_P(InMemoryViewTest, respond_to_watcher_events) {
   view->pathGenerator(&query, &ctx2);
 
   one = ctx2.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   two = ctx2.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(0, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(0, two.at(1).asInt());
 
   // Now notify the iothread of the change, process events, and assert the view
   // updates.
@@ -139,11 +171,50 @@ TEST_P(InMemoryViewTest, respond_to_watcher_events) {
   view->pathGenerator(&query, &ctx3);
 
   one = ctx3.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   two = ctx3.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(100, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(100, two.at(1).asInt());
+}
+
+TEST_P(InMemoryViewTest, subtree_change_log_routes_scoped_subscriptions) {
+  fs.defineContents(
+      {FAKEFS_ROOT "root/app/file.txt", FAKEFS_ROOT "root/lib/other.txt"});
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  auto base = view->getMostRecentRootNumberAndTickValue().ticks;
+
+  // The initial crawl logged everything, but that's all at or before
+  // `base`, so neither subtree has changed relative to it.
+  EXPECT_FALSE(view->subtreeMayHaveChangedSince(
+      FAKEFS_ROOT "root/app", base, CaseSensitivity::CaseSensitive));
+  EXPECT_FALSE(view->subtreeMayHaveChangedSince(
+      FAKEFS_ROOT "root/lib", base, CaseSensitivity::CaseSensitive));
+
+  fs.updateMetadata(FAKEFS_ROOT "root/app/file.txt", [&](FileInformation& fi) {
+    fi.size = 100;
+  });
+  pending.lock()->add(
+      FAKEFS_ROOT "root/app/file.txt", {}, W_PENDING_VIA_NOTIFY);
+  pending.lock()->ping();
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  // The touched subtree reports a change; the disjoint one does not.
+  EXPECT_TRUE(view->subtreeMayHaveChangedSince(
+      FAKEFS_ROOT "root/app", base, CaseSensitivity::CaseSensitive));
+  EXPECT_FALSE(view->subtreeMayHaveChangedSince(
+      FAKEFS_ROOT "root/lib", base, CaseSensitivity::CaseSensitive));
+
+  // A sibling whose name is a prefix of the changed path's directory
+  // must not be confused with it.
+  EXPECT_FALSE(view->subtreeMayHaveChangedSince(
+      FAKEFS_ROOT "root/ap", base, CaseSensitivity::CaseSensitive));
 }
 
 TEST_P(InMemoryViewTest, wait_for_respond_to_watcher_events) {
@@ -169,11 +240,11 @@ TEST_P(InMemoryViewTest, wait_for_respond_to_watcher_events) {
   EXPECT_EQ(2, ctx1.resultsArray.size());
 
   auto one = ctx1.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   auto two = ctx1.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(0, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(0, two.at(1).asInt());
 
   // Update filesystem and ensure the query results don't update.
 
@@ -187,11 +258,11 @@ TEST_P(InMemoryViewTest, wait_for_respond_to_watcher_events) {
   view->pathGenerator(&query, &ctx2);
 
   one = ctx2.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   two = ctx2.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(0, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(0, two.at(1).asInt());
 
   // Now notify the iothread of the change, process events, and assert the view
   // updates.
@@ -204,11 +275,11 @@ TEST_P(InMemoryViewTest, wait_for_respond_to_watcher_events) {
   view->pathGenerator(&query, &ctx3);
 
   one = ctx3.resultsArray.at(0);
-  EXPECT_STREQ("dir", one.get("name").asCString());
-  EXPECT_EQ(0, one.get("size").asInt());
+  EXPECT_STREQ("dir", one.at(0).asCString());
+  EXPECT_EQ(0, one.at(1).asInt());
   two = ctx3.resultsArray.at(1);
-  EXPECT_STREQ("dir/file.txt", two.get("name").asCString());
-  EXPECT_EQ(100, two.get("size").asInt());
+  EXPECT_STREQ("dir/file.txt", two.at(0).asCString());
+  EXPECT_EQ(100, two.at(1).asInt());
 }
 
 TEST_P(
@@ -246,8 +317,8 @@ TEST_P(
     EXPECT_EQ(1, ctx.resultsArray.size());
 
     auto one = ctx.resultsArray.at(0);
-    EXPECT_STREQ("file.txt", one.get("name").asCString());
-    EXPECT_EQ(0, one.get("size").asInt());
+    EXPECT_STREQ("file.txt", one.at(0).asCString());
+    EXPECT_EQ(0, one.at(1).asInt());
   }
 
   // A query starts, but the watcher has not notified us.
@@ -327,8 +398,8 @@ TEST_P(
     EXPECT_EQ(1, ctx.resultsArray.size());
 
     auto one = ctx.resultsArray.at(0);
-    EXPECT_STREQ("dir/file.txt", one.get("name").asCString());
-    EXPECT_EQ(0, one.get("size").asInt());
+    EXPECT_STREQ("dir/file.txt", one.at(0).asCString());
+    EXPECT_EQ(0, one.at(1).asInt());
   }
 
   // A query starts, but the watcher has not notified us.
@@ -467,6 +538,40 @@ TEST_P(InMemoryViewTest, waitUntilReadyToQuery_waits_for_initial_crawl) {
   std::move(syncFuture).get();
 }
 
+TEST_P(InMemoryViewTest, suffix_generator_only_walks_matching_files) {
+  fs.defineContents({
+      FAKEFS_ROOT "root/dir/main.cpp",
+      FAKEFS_ROOT "root/dir/readme.txt",
+      FAKEFS_ROOT "root/other/util.cpp",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  Query query;
+  query.fieldList.add("name");
+  query.suffixes.emplace();
+  query.suffixes->emplace_back("cpp");
+
+  QueryContext ctx{&query, root, false};
+  view->suffixGenerator(&query, &ctx);
+
+  ASSERT_EQ(2, ctx.resultsArray.size());
+  std::vector<std::string> names{
+      ctx.resultsArray.at(0).asString().string(),
+      ctx.resultsArray.at(1).asString().string()};
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ("dir/main.cpp", names.at(0));
+  EXPECT_EQ("other/util.cpp", names.at(1));
+
+  // The index means the generator never even considered readme.txt or
+  // the directory nodes.
+  EXPECT_EQ(2, ctx.getNumWalked());
+}
+
 TEST_P(InMemoryViewTest, directory_removal_does_not_report_parent) {
   getLog().setStdErrLoggingLevel(DBG);
 
@@ -524,9 +629,277 @@ TEST_P(InMemoryViewTest, directory_removal_does_not_report_parent) {
   // notification from the watcher for that directory.
 }
 
+TEST_P(InMemoryViewTest, recursive_directory_removal_marks_subtree) {
+  getLog().setStdErrLoggingLevel(DBG);
+
+  fs.defineContents({
+      FAKEFS_ROOT "root/dir/foo/sub/file.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  auto beforeChanges = view->getMostRecentRootNumberAndTickValue();
+
+  // Remove the whole subtree. Marking of child dirs is deferred to
+  // tombstones, so the iothread needs extra steps to finish applying it.
+  fs.removeRecursively(FAKEFS_ROOT "root/dir/foo");
+  pending.lock()->add(
+      FAKEFS_ROOT "root/dir/foo",
+      {},
+      W_PENDING_VIA_NOTIFY | W_PENDING_NONRECURSIVE_SCAN);
+  pending.lock()->ping();
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  while (view->unsafeAccessViewDatabase().hasDeferredDeletes()) {
+    pending.lock()->ping();
+    EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+  }
+
+  Query query;
+  query.fieldList.add("name");
+  query.fieldList.add("exists");
+  query.paths.emplace();
+  query.paths->emplace_back(QueryPath{"", 1});
+
+  QueryContext ctx{&query, root, false};
+  ctx.since = QuerySince::Clock{false, beforeChanges.ticks};
+
+  view->timeGenerator(&query, &ctx);
+
+  ASSERT_EQ(3, ctx.resultsArray.size());
+  std::vector<std::string> names;
+  for (auto& result : ctx.resultsArray) {
+    EXPECT_FALSE(result.at(1).asBool());
+    names.push_back(result.at(0).asString().string());
+  }
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ("dir/foo", names.at(0));
+  EXPECT_EQ("dir/foo/sub", names.at(1));
+  EXPECT_EQ("dir/foo/sub/file.txt", names.at(2));
+}
+
+TEST_P(InMemoryViewTest, recrawl_only_reports_files_whose_stat_changed) {
+  fs.defineContents({
+      FAKEFS_ROOT "root/dir/changed.txt",
+      FAKEFS_ROOT "root/dir/same.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  auto beforeRecrawl = view->getMostRecentRootNumberAndTickValue();
+
+  fs.updateMetadata(
+      FAKEFS_ROOT "root/dir/changed.txt",
+      [&](FileInformation& fi) { fi.size = 100; });
+
+  // Pretend the watcher overflowed and lost events: the whole tree must
+  // be revisited.
+  root->scheduleRecrawl("test overflow");
+  pending.lock()->ping();
+  // The first step observes shouldRecrawl; the second performs the
+  // crawl itself.
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  Query query;
+  query.fieldList.add("name");
+  query.fieldList.add("size");
+
+  QueryContext ctx{&query, root, false};
+  ctx.since = QuerySince::Clock{false, beforeRecrawl.ticks};
+  view->timeGenerator(&query, &ctx);
+
+  // Only the file whose stat data differs produces a change record;
+  // unchanged files and directories stay quiet despite the full
+  // revisit.
+  ASSERT_EQ(1, ctx.resultsArray.size());
+  EXPECT_STREQ(
+      "dir/changed.txt", ctx.resultsArray.at(0).at(0).asCString());
+  EXPECT_EQ(100, ctx.resultsArray.at(0).at(1).asInt());
+}
+
+TEST_P(InMemoryViewTest, subtree_recrawl_rescans_only_named_subtree) {
+  fs.defineContents({
+      FAKEFS_ROOT "root/aa/inside.txt",
+      FAKEFS_ROOT "root/bb/outside.txt",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  auto beforeRecrawl = view->getMostRecentRootNumberAndTickValue();
+
+  // Both files change on disk but the watcher reports nothing, so only
+  // the scoped recrawl below can notice either of them.
+  fs.updateMetadata(
+      FAKEFS_ROOT "root/aa/inside.txt",
+      [&](FileInformation& fi) { fi.size = 100; });
+  fs.updateMetadata(
+      FAKEFS_ROOT "root/bb/outside.txt",
+      [&](FileInformation& fi) { fi.size = 100; });
+
+  // Pretend the watcher overflowed with a path attached, as fsevents
+  // reports via kFSEventStreamEventFlagMustScanSubDirs.
+  root->scheduleSubtreeRecrawl(FAKEFS_ROOT "root/aa", "test overflow");
+  // No full crawl is scheduled; the subtree flows through the normal
+  // pending stream and a single step services it.
+  EXPECT_FALSE(root->recrawlInfo.rlock()->shouldRecrawl);
+  EXPECT_EQ(1, root->recrawlInfo.rlock()->subtreeRecrawlCount);
+  EXPECT_EQ(Continue::Continue, view->stepIoThread(root, state, pending));
+
+  Query query;
+  query.fieldList.add("name");
+
+  QueryContext ctx{&query, root, false};
+  ctx.since = QuerySince::Clock{false, beforeRecrawl.ticks};
+  view->timeGenerator(&query, &ctx);
+
+  // Only the named subtree was revisited; the sibling's clock is
+  // untouched even though its on-disk stat also differs.
+  ASSERT_EQ(1, ctx.resultsArray.size());
+  EXPECT_STREQ("aa/inside.txt", ctx.resultsArray.at(0).asCString());
+}
+
+TEST_P(InMemoryViewTest, idle_compaction_reclaims_deleted_nodes) {
+  // Make deleted nodes immediately eligible so a single idle slice
+  // can reclaim them; the default gc_age keeps them for days.
+  json_ref cfgJson = json_object();
+  json_object_set(cfgJson, "enable_parallel_crawl", json_boolean(GetParam()));
+  json_object_set(cfgJson, "gc_age_seconds", json_integer(0));
+  // The age-out timestamp starts at the epoch, so any modest interval
+  // lets considerAgeOut() run a full sweep on the first settle and
+  // steal the work from the incremental compactor.  Pick an interval
+  // that keeps the full sweep out of the picture entirely.
+  json_object_set(cfgJson, "gc_interval_seconds", json_integer(2000000000));
+  Configuration cfg{std::move(cfgJson)};
+
+  auto gcView = std::make_shared<InMemoryView>(fs, root_path, cfg, watcher);
+  auto& gcPending = gcView->unsafeAccessPendingFromWatcher();
+  gcPending.lock()->ping();
+
+  fs.defineContents({FAKEFS_ROOT "root/dir/file.txt"});
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), cfg, gcView, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, gcView->stepIoThread(root, state, gcPending));
+
+  // Remove the file and let the iothread observe the deletion.
+  fs.removeRecursively(FAKEFS_ROOT "root/dir/file.txt");
+  gcPending.lock()->add(FAKEFS_ROOT "root/dir/file.txt", {}, W_PENDING_VIA_NOTIFY);
+  gcPending.lock()->ping();
+  EXPECT_EQ(Continue::Continue, gcView->stepIoThread(root, state, gcPending));
+
+  // An empty wakeup settles the root, which runs a compaction slice.
+  gcPending.lock()->ping();
+  EXPECT_EQ(Continue::Continue, gcView->stepIoThread(root, state, gcPending));
+
+  auto debug = gcView->getViewDebugInfo();
+  EXPECT_GE(debug.get("compact_slices").asInt(), 1);
+  EXPECT_EQ(1, debug.get("compact_aged_files").asInt());
+}
+
+TEST_P(InMemoryViewTest, lazy_dirs_defer_crawl_until_first_touch) {
+  json_ref cfgJson = json_object();
+  json_object_set(cfgJson, "enable_parallel_crawl", json_boolean(GetParam()));
+  json_ref lazy = json_array();
+  json_array_append(lazy, typed_string_to_json("vendor"));
+  json_object_set(cfgJson, "lazy_dirs", lazy);
+  Configuration cfg{std::move(cfgJson)};
+
+  auto lazyView = std::make_shared<InMemoryView>(fs, root_path, cfg, watcher);
+  auto& lazyPending = lazyView->unsafeAccessPendingFromWatcher();
+  lazyPending.lock()->ping();
+
+  fs.defineContents({
+      FAKEFS_ROOT "root/src/main.c",
+      FAKEFS_ROOT "root/vendor/third/lib.c",
+  });
+
+  auto root = std::make_shared<Root>(
+      fs, root_path, "fs_type", w_string_to_json("{}"), cfg, lazyView, [] {});
+
+  InMemoryView::IoThreadState state{std::chrono::minutes(5)};
+  EXPECT_EQ(Continue::Continue, lazyView->stepIoThread(root, state, lazyPending));
+
+  Query query;
+  query.fieldList.add("name");
+  query.paths.emplace();
+  query.paths->emplace_back(QueryPath{"", -1});
+
+  auto enumerate = [&] {
+    QueryContext ctx{&query, root, false};
+    lazyView->pathGenerator(&query, &ctx);
+    std::set<std::string> names;
+    for (size_t i = 0; i < ctx.resultsArray.size(); ++i) {
+      names.insert(ctx.resultsArray.at(i).asCString());
+    }
+    return names;
+  };
+
+  // The initial crawl registered the lazy dir itself but did not
+  // descend into it.
+  auto names = enumerate();
+  EXPECT_EQ(1, names.count("src/main.c"));
+  EXPECT_EQ(1, names.count("vendor"));
+  EXPECT_EQ(0, names.count("vendor/third"));
+  EXPECT_EQ(0, names.count("vendor/third/lib.c"));
+
+  // A query scoped elsewhere leaves the subtree unmaterialized.
+  Query elsewhere;
+  elsewhere.relative_root = w_string{FAKEFS_ROOT "root/src"};
+  lazyView->prepareForQuery(elsewhere);
+  lazyPending.lock()->ping();
+  EXPECT_EQ(Continue::Continue, lazyView->stepIoThread(root, state, lazyPending));
+  EXPECT_EQ(0, enumerate().count("vendor/third/lib.c"));
+
+  // A query scoped to the subtree materializes it.
+  Query scoped;
+  scoped.relative_root = w_string{FAKEFS_ROOT "root/vendor"};
+  lazyView->prepareForQuery(scoped);
+  EXPECT_EQ(Continue::Continue, lazyView->stepIoThread(root, state, lazyPending));
+
+  names = enumerate();
+  EXPECT_EQ(1, names.count("vendor/third"));
+  EXPECT_EQ(1, names.count("vendor/third/lib.c"));
+}
+
 INSTANTIATE_TEST_CASE_P(
     InMemoryViewTests,
     InMemoryViewTest,
     testing::Values(false, true));
 
+TEST(ConfigurationTest, reload_is_observed_by_copies) {
+  json_ref cfgJson = json_object();
+  json_object_set(cfgJson, "settle", json_integer(20));
+  Configuration config{json_ref{cfgJson}};
+
+  // The Root, the view, and the watcher each hold their own copy.
+  Configuration copy = config;
+  EXPECT_EQ(20, copy.getInt("settle", 0));
+
+  json_ref newJson = json_object();
+  json_object_set(newJson, "settle", json_integer(250));
+  config.reload(json_ref{newJson});
+  // Copies share the snapshot holder, so they observe the reload
+  // without being told about it.
+  EXPECT_EQ(250, copy.getInt("settle", 0));
+
+  // Dropping the local config falls back to defaults.
+  config.reload(std::nullopt);
+  EXPECT_EQ(0, copy.getInt("settle", 0));
+}
+
 } // namespace
@@ -55,6 +55,58 @@ TEST(JsonTest, double_round_trip) {
   }
 }
 
+TEST(JsonTest, small_integers_are_shared) {
+  // Small values share immortal singletons; copies must not free them
+  auto a = json_integer(42);
+  auto b = json_integer(42);
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(42, a.asInt());
+  {
+    auto c = a;
+    EXPECT_EQ(c.get(), a.get());
+  }
+  EXPECT_EQ(42, json_integer_value(a));
+
+  EXPECT_EQ(json_integer(-1).get(), json_integer(-1).get());
+  EXPECT_EQ(json_integer(255).get(), json_integer(255).get());
+
+  // Values outside the cached range are distinct heap objects but
+  // still compare equal
+  auto big1 = json_integer(1 << 20);
+  auto big2 = json_integer(1 << 20);
+  EXPECT_NE(big1.get(), big2.get());
+  EXPECT_TRUE(json_equal(big1, big2));
+  EXPECT_NE(json_integer(-2).get(), json_integer(-2).get());
+}
+
+TEST(JsonTest, heap_nodes_are_recycled) {
+  // Node storage comes from a thread-local freelist pool; freeing a
+  // node and allocating another of the same size class on the same
+  // thread must hand the storage straight back (LIFO), without a trip
+  // through the heap.
+  const json_t* first;
+  {
+    auto v = json_integer(1 << 20);
+    first = v.get();
+  }
+  {
+    auto v = json_integer(1 << 21);
+    EXPECT_EQ(first, v.get());
+    EXPECT_EQ(1 << 21, v.asInt());
+  }
+
+  // Same for container nodes, which land in a different size bin.
+  const json_t* obj;
+  {
+    auto v = json_object({{"key", json_integer(1 << 20)}});
+    obj = v.get();
+  }
+  {
+    auto v = json_object();
+    EXPECT_EQ(obj, v.get());
+  }
+}
+
 TEST(JsonTest, too_deep_parse_tree) {
   std::string document(10000, '[');
 
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include "watchman/MemoryAccounting.h"
+#include "watchman/thirdparty/jansson/jansson.h"
+
+using namespace watchman;
+
+TEST(MemoryAccounting, scope_nests_and_restores) {
+  EXPECT_EQ(MemorySubsystem::Untagged, currentMemorySubsystem());
+  {
+    MemoryScope outer{MemorySubsystem::Query};
+    EXPECT_EQ(MemorySubsystem::Query, currentMemorySubsystem());
+    {
+      MemoryScope inner{MemorySubsystem::Pdu};
+      EXPECT_EQ(MemorySubsystem::Pdu, currentMemorySubsystem());
+    }
+    EXPECT_EQ(MemorySubsystem::Query, currentMemorySubsystem());
+  }
+  EXPECT_EQ(MemorySubsystem::Untagged, currentMemorySubsystem());
+}
+
+TEST(MemoryAccounting, json_charged_to_scope_and_released) {
+  auto before = readMemoryCounters(MemorySubsystem::Query);
+  {
+    MemoryScope scope{MemorySubsystem::Query};
+    auto obj = json_object(
+        {{"name", w_string_to_json("hello world")},
+         {"size", json_integer(12345678)}});
+
+    auto during = readMemoryCounters(MemorySubsystem::Query);
+    EXPECT_GT(during.liveBytes, before.liveBytes);
+    EXPECT_GT(during.allocCount, before.allocCount);
+  }
+  // Dropping the last reference releases against the same subsystem the
+  // values were charged to, even though no scope is active now.
+  auto after = readMemoryCounters(MemorySubsystem::Query);
+  EXPECT_EQ(before.liveBytes, after.liveBytes);
+  EXPECT_EQ(before.liveItems, after.liveItems);
+}
+
+TEST(MemoryAccounting, values_built_outside_scopes_are_untagged) {
+  auto queryBefore = readMemoryCounters(MemorySubsystem::Query);
+  auto untaggedBefore = readMemoryCounters(MemorySubsystem::Untagged);
+
+  auto str = w_string_to_json("untagged value");
+
+  auto queryAfter = readMemoryCounters(MemorySubsystem::Query);
+  auto untaggedAfter = readMemoryCounters(MemorySubsystem::Untagged);
+  EXPECT_EQ(queryBefore.allocCount, queryAfter.allocCount);
+  EXPECT_GT(untaggedAfter.allocCount, untaggedBefore.allocCount);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+
+#include <thread>
+
+#include "watchman/Errors.h"
+#include "watchman/MemoryAccounting.h"
+#include "watchman/MemoryBudget.h"
+
+using namespace watchman;
+using namespace std::chrono_literals;
+
+namespace {
+
+/**
+ * Inflates the query subsystem's live bytes for the duration of a test
+ * so the governor observes an over-budget daemon; restores the global
+ * counters on destruction.
+ */
+struct InflatedUsage {
+  static constexpr size_t kBytes = 64 * 1024 * 1024;
+
+  InflatedUsage() {
+    recordMemoryAlloc(MemorySubsystem::Query, kBytes);
+  }
+  ~InflatedUsage() {
+    recordMemoryFree(MemorySubsystem::Query, kBytes);
+  }
+};
+
+} // namespace
+
+TEST(MemoryBudget, disabled_budget_always_admits) {
+  InflatedUsage usage;
+  MemoryBudget budget{0, 1ms};
+  budget.admit();
+  budget.release();
+  EXPECT_EQ(0, budget.status().rejected);
+}
+
+TEST(MemoryBudget, over_budget_serializes_then_rejects) {
+  InflatedUsage usage;
+  MemoryBudget budget{1024 * 1024, 20ms};
+
+  // The first query is always admitted so an over-budget daemon
+  // degrades to serialized queries rather than refusing service.
+  budget.admit();
+
+  // With one query running and the budget exhausted, the next admission
+  // waits out the timeout and is rejected.
+  EXPECT_THROW(budget.admit(), QueryExecError);
+  auto status = budget.status();
+  EXPECT_EQ(1, status.running);
+  EXPECT_EQ(1, status.rejected);
+  EXPECT_EQ(1, status.deferred);
+
+  budget.release();
+  budget.admit();
+  budget.release();
+  EXPECT_EQ(0, budget.status().running);
+}
+
+TEST(MemoryBudget, queued_query_admitted_when_running_query_completes) {
+  InflatedUsage usage;
+  MemoryBudget budget{1024 * 1024, 5000ms};
+
+  budget.admit();
+
+  std::thread waiter{[&] {
+    budget.admit();
+    budget.release();
+  }};
+
+  // Give the waiter time to queue, then complete the running query;
+  // the queued one must be admitted well before its 5s timeout.
+  /* sleep override */ std::this_thread::sleep_for(50ms);
+  budget.release();
+  waiter.join();
+
+  auto status = budget.status();
+  EXPECT_EQ(0, status.running);
+  EXPECT_EQ(2, status.admitted);
+  EXPECT_EQ(0, status.rejected);
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include <vector>
+#include "watchman/PendingCollection.h"
+
+using namespace watchman;
+
+namespace {
+
+// Synthesized event traces standing in for recorded storms.  The shapes
+// match the workloads we size the ingestion path for:
+//
+//  - checkout: a broad tree where each path is reported exactly once
+//  - build: a small set of output directories hammered over and over,
+//    so almost every event consolidates with an existing entry
+//  - rm -rf: leaves stream in first and the doomed ancestor arrives
+//    last flagged recursive, obsoleting everything beneath it
+//
+// Regenerate equivalent traces rather than shipping captures: the
+// performance-relevant properties are path count, depth, and the
+// duplication/prune ratios, all of which are controlled here.
+
+std::vector<PendingChange> makeCheckoutTrace(size_t dirs, size_t filesPerDir) {
+  auto now = std::chrono::system_clock::now();
+  std::vector<PendingChange> trace;
+  trace.reserve(dirs * (filesPerDir + 1));
+  for (size_t d = 0; d < dirs; ++d) {
+    auto dir = w_string::format("/fake/root/src/module{}/deep/nested{}", d, d);
+    trace.push_back({dir, now, W_PENDING_VIA_NOTIFY});
+    for (size_t f = 0; f < filesPerDir; ++f) {
+      trace.push_back(
+          {w_string::format("{}/file{}.cpp", dir, f),
+           now,
+           W_PENDING_VIA_NOTIFY});
+    }
+  }
+  return trace;
+}
+
+std::vector<PendingChange> makeBuildTrace(size_t outputDirs, size_t events) {
+  auto now = std::chrono::system_clock::now();
+  std::vector<PendingChange> trace;
+  trace.reserve(events);
+  for (size_t i = 0; i < events; ++i) {
+    trace.push_back(
+        {w_string::format(
+             "/fake/root/buck-out/gen/dir{}/output.o", i % outputDirs),
+         now,
+         W_PENDING_VIA_NOTIFY});
+  }
+  return trace;
+}
+
+std::vector<PendingChange> makeRmrfTrace(size_t leaves) {
+  auto now = std::chrono::system_clock::now();
+  std::vector<PendingChange> trace;
+  trace.reserve(leaves + 1);
+  for (size_t i = 0; i < leaves; ++i) {
+    trace.push_back(
+        {w_string::format(
+             "/fake/root/node_modules/pkg{}/lib/index{}.js", i / 8, i),
+         now,
+         W_PENDING_VIA_NOTIFY});
+  }
+  // The ancestor lands last and obsoletes every leaf above.
+  trace.push_back(
+      {w_string{"/fake/root/node_modules"},
+       now,
+       W_PENDING_VIA_NOTIFY | W_PENDING_RECURSIVE});
+  return trace;
+}
+
+void addTrace(PendingChanges& coll, const std::vector<PendingChange>& trace) {
+  for (auto& change : trace) {
+    coll.add(change.path, change.now, change.flags);
+  }
+}
+
+// Insert throughput on a mostly-unique trace: every add takes the
+// tree-index path and almost nothing consolidates.
+void insert_checkout_trace(benchmark::State& state) {
+  auto trace = makeCheckoutTrace(200, 20);
+  for (auto _ : state) {
+    PendingChanges coll;
+    addTrace(coll, trace);
+    benchmark::DoNotOptimize(coll.getPendingItemCount());
+  }
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(insert_checkout_trace);
+
+// Dedup throughput: a handful of output paths reported thousands of
+// times, so nearly every add consolidates against an existing item.
+void dedup_build_trace(benchmark::State& state) {
+  auto trace = makeBuildTrace(64, 50000);
+  for (auto _ : state) {
+    PendingChanges coll;
+    addTrace(coll, trace);
+    benchmark::DoNotOptimize(coll.getPendingItemCount());
+  }
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(dedup_build_trace);
+
+// Isolates the art-tree prefix prune: the collection is pre-loaded with
+// the leaves outside the timed region, and only the recursive ancestor
+// insert (which walks and unlinks the whole subtree) is measured.
+void prefix_prune_rmrf(benchmark::State& state) {
+  auto leaves = makeRmrfTrace(size_t(state.range(0)));
+  auto ancestor = leaves.back();
+  leaves.pop_back();
+  for (auto _ : state) {
+    state.PauseTiming();
+    PendingChanges coll;
+    addTrace(coll, leaves);
+    state.ResumeTiming();
+    coll.add(ancestor.path, ancestor.now, ancestor.flags);
+    benchmark::DoNotOptimize(coll.getPendingItemCount());
+  }
+  state.SetItemsProcessed(state.iterations() * leaves.size());
+}
+BENCHMARK(prefix_prune_rmrf)->Arg(1000)->Arg(10000);
+
+// Models one IO-thread wakeup: the watcher has already filled the
+// shared collection; measure the ping + lockAndWait + stealItems drain
+// that sits on the settle latency path.
+void iothread_drain(benchmark::State& state) {
+  auto trace = makeCheckoutTrace(100, 10);
+  PendingCollection pending;
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      auto lock = pending.wlock();
+      addTrace(*lock, trace);
+      lock->ping();
+    }
+    state.ResumeTiming();
+    auto lock = pending.lockAndWait(std::chrono::milliseconds{0});
+    auto chain = lock->stealItems();
+    size_t drained = 0;
+    for (auto* p = chain.get(); p; p = p->next.get()) {
+      ++drained;
+    }
+    benchmark::DoNotOptimize(drained);
+  }
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(iothread_drain);
+
+// The producer-side handoff used by the notify thread: one drained
+// kernel read's worth of notifications in a single sorted batch.
+void add_batch_checkout_trace(benchmark::State& state) {
+  auto trace = makeCheckoutTrace(200, 20);
+  for (auto _ : state) {
+    PendingChanges coll;
+    coll.addBatch(trace);
+    benchmark::DoNotOptimize(coll.getPendingItemCount());
+  }
+  state.SetItemsProcessed(state.iterations() * trace.size());
+}
+BENCHMARK(add_batch_checkout_trace);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -11,6 +11,7 @@
 #include <folly/logging/xlog.h>
 #include <folly/portability/GTest.h>
 #include <chrono>
+#include <map>
 
 using namespace watchman;
 
@@ -362,6 +363,100 @@ TYPED_TEST(PendingCollectionFixture, queue_notify_then_crawl) {
   EXPECT_EQ(W_PENDING_VIA_NOTIFY, item->flags);
 }
 
+TEST(Pending, add_batch_parents_obsolete_children) {
+  PendingChanges coll;
+  auto now = std::chrono::system_clock::now();
+
+  // Regardless of arrival order within the batch, a recursive parent
+  // swallows its children before they are ever indexed.
+  std::vector<PendingChange> batch;
+  batch.push_back({w_string{"foo/bar/baz"}, now, PendingFlags{}});
+  batch.push_back({w_string{"qux"}, now, W_PENDING_VIA_NOTIFY});
+  batch.push_back({w_string{"foo"}, now, W_PENDING_RECURSIVE});
+  batch.push_back({w_string{"foo/bar"}, now, PendingFlags{}});
+  coll.addBatch(std::move(batch));
+
+  EXPECT_EQ(2, coll.getPendingItemCount());
+
+  std::map<w_string, PendingFlags> seen;
+  auto item = coll.stealItems();
+  while (item) {
+    seen.emplace(item->path, item->flags);
+    item = std::move(item->next);
+  }
+  ASSERT_EQ(2, seen.size());
+  EXPECT_EQ(W_PENDING_RECURSIVE, seen.at(w_string{"foo"}));
+  EXPECT_EQ(W_PENDING_VIA_NOTIFY, seen.at(w_string{"qux"}));
+}
+
+TEST(Pending, add_batch_consolidates_duplicates) {
+  PendingChanges coll;
+  auto now = std::chrono::system_clock::now();
+
+  std::vector<PendingChange> batch;
+  batch.push_back({w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY});
+  batch.push_back({w_string{"foo/bar"}, now, W_PENDING_RECURSIVE});
+  coll.addBatch(std::move(batch));
+
+  auto item = coll.stealItems();
+  ASSERT_NE(nullptr, item);
+  EXPECT_EQ(nullptr, item->next);
+  EXPECT_EQ(w_string{"foo/bar"}, item->path);
+  EXPECT_EQ(W_PENDING_VIA_NOTIFY | W_PENDING_RECURSIVE, item->flags);
+}
+
+TEST(Pending, known_removed_follows_latest_event) {
+  PendingChanges coll;
+  auto now = std::chrono::system_clock::now();
+
+  // A trusted removal followed by an event that may have recreated the
+  // path must fall back to a confirming stat.
+  coll.add(
+      w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY | W_PENDING_KNOWN_REMOVED);
+  coll.add(w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY);
+
+  auto item = coll.stealItems();
+  ASSERT_NE(nullptr, item);
+  EXPECT_EQ(nullptr, item->next);
+  EXPECT_EQ(W_PENDING_VIA_NOTIFY, item->flags);
+
+  // In the reverse order the removal is the latest word on the path and
+  // upgrades the pending item.
+  coll.add(w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY);
+  coll.add(
+      w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY | W_PENDING_KNOWN_REMOVED);
+
+  item = coll.stealItems();
+  ASSERT_NE(nullptr, item);
+  EXPECT_EQ(nullptr, item->next);
+  EXPECT_EQ(W_PENDING_VIA_NOTIFY | W_PENDING_KNOWN_REMOVED, item->flags);
+}
+
+TEST(Pending, known_removed_is_merge_order_independent) {
+  // A delete in one batch followed by a recreate in the next can reach
+  // the consumer inverted: appendRaw() splices newer batches onto the
+  // head of the chain, so the older delete is the incoming side when
+  // the consumer re-deduplicates.  The recreate is still the latest
+  // word on the path and must clear KNOWN_REMOVED.
+  PendingChanges producer;
+  auto now = std::chrono::system_clock::now();
+
+  producer.add(
+      w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY | W_PENDING_KNOWN_REMOVED);
+  auto older = producer.stealItems();
+  producer.add(w_string{"foo/bar"}, now, W_PENDING_VIA_NOTIFY);
+  auto newer = producer.stealItems();
+
+  PendingChanges consumer;
+  consumer.append(std::move(newer), {});
+  consumer.append(std::move(older), {});
+
+  auto item = consumer.stealItems();
+  ASSERT_NE(nullptr, item);
+  EXPECT_EQ(nullptr, item->next);
+  EXPECT_EQ(W_PENDING_VIA_NOTIFY, item->flags);
+}
+
 TYPED_TEST(PendingCollectionFixture, real_example) {
   this->coll.add(
       w_string{"/home/chadaustin/tmp/watchmanroots/test-root/foo/baz"},
@@ -394,3 +489,65 @@ TYPED_TEST(PendingCollectionFixture, real_example) {
   ASSERT_NE(nullptr, item);
   EXPECT_EQ(nullptr, item->next);
 }
+
+TEST(Pending, spill_to_disk_and_replay) {
+  PendingChanges coll;
+  coll.setSpillThreshold(4);
+  auto now = std::chrono::system_clock::now();
+
+  for (int i = 0; i < 10; ++i) {
+    coll.add(w_string::build("dir/file", i), now, W_PENDING_VIA_NOTIFY);
+  }
+
+  // Four items fit in memory; the remainder is parked on disk.
+  EXPECT_EQ(10, coll.getPendingItemCount());
+  auto stats = coll.getSpillStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(4, stats->queueDepth);
+  EXPECT_EQ(6, stats->spoolDepth);
+  EXPECT_EQ(6, stats->spilledTotal);
+
+  // Each steal returns the in-memory items plus at most one threshold's
+  // worth replayed from the spool, so a bounded number of steals drains
+  // everything with paths and flags intact.
+  std::map<w_string, PendingFlags> seen;
+  size_t steals = 0;
+  while (coll.getPendingItemCount() != 0) {
+    ASSERT_LT(steals, 10u);
+    ++steals;
+    for (auto item = coll.stealItems(); item; item = item->next) {
+      seen.emplace(item->path, item->flags);
+    }
+  }
+  EXPECT_EQ(10, seen.size());
+  for (int i = 0; i < 10; ++i) {
+    auto it = seen.find(w_string::build("dir/file", i));
+    ASSERT_NE(seen.end(), it);
+    EXPECT_EQ(W_PENDING_VIA_NOTIFY, it->second);
+  }
+
+  stats = coll.getSpillStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(0, stats->spoolDepth);
+  EXPECT_EQ(6, stats->replayedTotal);
+}
+
+TEST(Pending, spill_withholds_syncs_until_spool_drains) {
+  PendingChanges coll;
+  coll.setSpillThreshold(2);
+  auto now = std::chrono::system_clock::now();
+
+  for (int i = 0; i < 5; ++i) {
+    coll.add(w_string::build("dir/file", i), now, W_PENDING_VIA_NOTIFY);
+  }
+  coll.addSync(folly::Promise<folly::Unit>{});
+
+  // The sync was requested after items that are still parked in the
+  // spool, so it must not be released yet.
+  EXPECT_TRUE(coll.stealSyncs().empty());
+
+  while (coll.getSpillStats()->spoolDepth != 0) {
+    coll.stealItems();
+  }
+  EXPECT_EQ(1, coll.stealSyncs().size());
+}
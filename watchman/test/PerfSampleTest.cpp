@@ -108,3 +108,38 @@ TEST(Perf, large_samples_are_passed_in_stdin) {
   EXPECT_EQ("{\"value\": 1}", stdin_calls[0]);
   EXPECT_EQ("{\"value\": 2}", stdin_calls[1]);
 }
+
+TEST(Perf, histogram_percentiles) {
+  PerfHistogram hist;
+
+  // 1..1000 microseconds, uniformly.
+  for (uint64_t v = 1; v <= 1000; ++v) {
+    hist.add(v);
+  }
+
+  auto rendered = hist.toJson();
+  EXPECT_EQ(1000, json_integer_value(rendered.get("count")));
+  EXPECT_EQ(500500, json_integer_value(rendered.get("sum")));
+  EXPECT_EQ(1000, json_integer_value(rendered.get("max")));
+
+  // Buckets give ~6% relative precision; percentile estimates are
+  // bucket lower bounds, so they may under-report by one bucket width.
+  auto p50 = json_integer_value(rendered.get("p50"));
+  EXPECT_GE(p50, 450);
+  EXPECT_LE(p50, 500);
+  auto p99 = json_integer_value(rendered.get("p99"));
+  EXPECT_GE(p99, 930);
+  EXPECT_LE(p99, 990);
+}
+
+TEST(Perf, histogram_registry_is_stable) {
+  auto& a = perfHistogram(w_string{"test_metric"});
+  auto& b = perfHistogram(w_string{"test_metric"});
+  EXPECT_EQ(&a, &b);
+
+  a.add(42);
+  auto metrics = renderPerfMetrics();
+  auto entry = metrics.get_optional("test_metric");
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_GE(json_integer_value(entry->get("count")), 1);
+}
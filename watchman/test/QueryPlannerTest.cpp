@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <folly/portability/GTest.h>
+#include "watchman/Errors.h"
+#include "watchman/InMemoryView.h"
+#include "watchman/query/Query.h"
+#include "watchman/query/parse.h"
+#include "watchman/root/Root.h"
+#include "watchman/test/lib/FakeFileSystem.h"
+#include "watchman/test/lib/FakeWatcher.h"
+
+namespace {
+
+using namespace watchman;
+
+class QueryPlannerTest : public testing::Test {
+ public:
+  const w_string root_path{FAKEFS_ROOT "root"};
+
+  FakeFileSystem fs;
+  Configuration config;
+  std::shared_ptr<FakeWatcher> watcher = std::make_shared<FakeWatcher>(fs);
+  std::shared_ptr<InMemoryView> view =
+      std::make_shared<InMemoryView>(fs, root_path, config, watcher);
+  std::shared_ptr<Root> root;
+
+  QueryPlannerTest() {
+    fs.defineContents({FAKEFS_ROOT "root"});
+    root = std::make_shared<Root>(
+        fs, root_path, "fs_type", w_string_to_json("{}"), config, view, [] {});
+  }
+
+  std::shared_ptr<Query> parse(std::string json, bool caseSensitive = true) {
+    json_error_t err{};
+    auto spec = json_loads(json.c_str(), 0, &err);
+    EXPECT_TRUE(spec.has_value()) << err.text;
+    // Force a known case mode so the fixtures behave the same on every
+    // filesystem.
+    spec->set("case_sensitive", json_boolean(caseSensitive));
+    return parseQuery(root, *spec);
+  }
+};
+
+TEST_F(QueryPlannerTest, dirname_scopes_path_generator) {
+  auto query = parse(R"({"expression": ["dirname", "foo/bar"]})");
+
+  ASSERT_TRUE(query->paths.has_value());
+  ASSERT_EQ(1, query->paths->size());
+  EXPECT_EQ(w_string{"foo/bar"}, query->paths->at(0).name);
+  EXPECT_EQ(-1, query->paths->at(0).depth);
+  EXPECT_FALSE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, allof_with_dirname_scopes_path_generator) {
+  auto query = parse(
+      R"({"expression": ["allof", ["type", "f"], ["dirname", "src"]]})");
+
+  ASSERT_TRUE(query->paths.has_value());
+  ASSERT_EQ(1, query->paths->size());
+  EXPECT_EQ(w_string{"src"}, query->paths->at(0).name);
+  EXPECT_EQ(-1, query->paths->at(0).depth);
+}
+
+TEST_F(QueryPlannerTest, false_matches_nothing) {
+  auto query = parse(R"({"expression": ["false"]})");
+
+  ASSERT_TRUE(query->paths.has_value());
+  EXPECT_TRUE(query->paths->empty());
+  EXPECT_FALSE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, unbounded_expression_is_not_planned) {
+  auto query = parse(R"({"expression": ["type", "f"]})");
+
+  EXPECT_FALSE(query->paths.has_value());
+  EXPECT_TRUE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, wildcard_bound_scopes_glob_generator) {
+  // The upper bound contains glob specials, so it cannot be mapped onto
+  // path generator lookups -- but it is still a glob, so the planner
+  // hands it to the glob generator rather than walking all files.
+  auto query = parse(
+      R"({"expression": ["match", "src/**/*.c", "wholename"]})");
+
+  EXPECT_FALSE(query->paths.has_value());
+  ASSERT_TRUE(query->glob_tree);
+  EXPECT_TRUE(query->dedup_results);
+  EXPECT_FALSE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, folded_case_bound_scopes_glob_generator) {
+  // In case insensitive mode the bound is expressed in folded case, so
+  // it cannot key directory lookups, but the glob generator matches
+  // caselessly and can still scope the walk.
+  auto query = parse(
+      R"({"expression": ["dirname", "Foo"]})", /*caseSensitive=*/false);
+
+  EXPECT_FALSE(query->paths.has_value());
+  ASSERT_TRUE(query->glob_tree);
+  EXPECT_FALSE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, explicit_generators_are_left_alone) {
+  auto query = parse(
+      R"({"glob": ["*.c"], "expression": ["dirname", "foo"]})");
+
+  EXPECT_FALSE(query->paths.has_value());
+  EXPECT_TRUE(query->glob_tree);
+  EXPECT_TRUE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, since_query_is_not_planned) {
+  auto query = parse(
+      R"({"since": "c:0:0", "expression": ["dirname", "foo"]})");
+
+  EXPECT_FALSE(query->paths.has_value());
+  EXPECT_TRUE(query->plannerInfo.empty());
+}
+
+TEST_F(QueryPlannerTest, order_by_parses_field_and_direction) {
+  auto query =
+      parse(R"({"fields": ["name", "mtime"], "order_by": ["mtime", "desc"]})");
+  ASSERT_TRUE(query->order_by.has_value());
+  EXPECT_EQ(w_string{"mtime"}, query->order_by->field);
+  EXPECT_TRUE(query->order_by->descending);
+
+  query = parse(R"({"fields": ["name"], "order_by": "name"})");
+  ASSERT_TRUE(query->order_by.has_value());
+  EXPECT_EQ(w_string{"name"}, query->order_by->field);
+  EXPECT_FALSE(query->order_by->descending);
+}
+
+TEST_F(QueryPlannerTest, order_by_rejects_bad_specs) {
+  // Field not in the requested field list.
+  EXPECT_THROW(
+      parse(R"({"fields": ["name"], "order_by": "mtime"})"), QueryParseError);
+  // Unknown direction token.
+  EXPECT_THROW(
+      parse(R"({"fields": ["name"], "order_by": ["name", "down"]})"),
+      QueryParseError);
+}
+
+} // namespace
@@ -7,10 +7,32 @@
 
 #include "watchman/Serde.h"
 #include <folly/portability/GTest.h>
+#include "watchman/bser.h"
 
 namespace {
 using namespace watchman;
 
+int dump_to_string(const char* buffer, size_t size, void* data) {
+  auto str = (std::string*)data;
+  str->append(buffer, size);
+  return 0;
+}
+
+// Encodes a json value as a bare BSER document (no PDU header), the form
+// decodeBser operates on.
+std::string to_bser(const json_ref& json) {
+  std::string buffer;
+  bser_ctx_t ctx{2, 0, dump_to_string};
+  EXPECT_EQ(0, w_bser_dump(&ctx, json, &buffer));
+  return buffer;
+}
+
+template <typename T>
+T decode_bser(const json_ref& json) {
+  auto doc = to_bser(json);
+  return serde::decodeBser<T>(doc.data(), doc.data() + doc.size());
+}
+
 template <typename T>
 struct HasField : public serde::Object {
   T field;
@@ -314,4 +336,87 @@ TEST(SerdeTest, skip_if) {
   }
 }
 
+struct MixedBag : serde::Object {
+  std::string name;
+  int64_t count = 0;
+  bool flag = false;
+  std::vector<w_string> items;
+  std::optional<int64_t> maybe;
+
+  template <typename X>
+  void map(X& x) {
+    x.required("name", name);
+    x("count", count);
+    x("flag", flag);
+    x("items", items);
+    x("maybe", maybe);
+  }
+};
+
+TEST(SerdeTest, bser_direct_object) {
+  MixedBag bag;
+  bag.name = "hello";
+  bag.count = 12345;
+  bag.flag = true;
+  bag.items = {w_string{"one"}, w_string{"two"}};
+  bag.maybe = -9;
+
+  auto decoded = decode_bser<MixedBag>(serde::encode(bag));
+  EXPECT_EQ("hello", decoded.name);
+  EXPECT_EQ(12345, decoded.count);
+  EXPECT_EQ(true, decoded.flag);
+  ASSERT_EQ(2, decoded.items.size());
+  EXPECT_EQ("one", decoded.items[0]);
+  EXPECT_EQ("two", decoded.items[1]);
+  EXPECT_EQ(-9, decoded.maybe);
+}
+
+TEST(SerdeTest, bser_direct_missing_and_unknown_keys) {
+  // Unknown keys are skipped in place, absent optional keys
+  // default-initialize their fields, and absent required keys throw, just
+  // like the DOM decoder.
+  auto o = json_object(
+      {{"name", typed_string_to_json("n")},
+       {"wholly-unknown", json_integer(99)},
+       {"maybe", json_null()}});
+  auto decoded = decode_bser<MixedBag>(o);
+  EXPECT_EQ("n", decoded.name);
+  EXPECT_EQ(0, decoded.count);
+  EXPECT_EQ(false, decoded.flag);
+  EXPECT_TRUE(decoded.items.empty());
+  EXPECT_EQ(std::nullopt, decoded.maybe);
+
+  EXPECT_THROW(decode_bser<MixedBag>(json_object()), serde::MissingKey);
+}
+
+TEST(SerdeTest, bser_direct_matches_dom_decode) {
+  HasField<std::map<w_string, bool>> s;
+  s.field = {{"foo", false}, {"bar", true}};
+
+  // Types without a BserSerde rule fall back to materializing their own
+  // subtree and must still agree with the DOM path.
+  auto encoded = serde::encode(s);
+  auto direct = decode_bser<decltype(s)>(encoded);
+  auto dom = serde::decode<decltype(s)>(encoded);
+  EXPECT_EQ(dom.field, direct.field);
+}
+
+TEST(SerdeTest, bser_direct_tuples) {
+  auto ta = decode_bser<TupleArray>(
+      json_array({json_integer(10), json_true(), typed_string_to_json("x")}));
+  EXPECT_EQ(10, std::get<0>(ta));
+  EXPECT_EQ(true, std::get<1>(ta));
+
+  EXPECT_THROW(decode_bser<TupleArray>(json_array({})), std::domain_error);
+}
+
+TEST(SerdeTest, bser_direct_malformed_document) {
+  auto doc = to_bser(serde::encode(MixedBag{}));
+  // Truncating the document mid-value must throw rather than read out of
+  // bounds.
+  EXPECT_THROW(
+      serde::decodeBser<MixedBag>(doc.data(), doc.data() + doc.size() / 2),
+      BserParseError);
+}
+
 } // namespace
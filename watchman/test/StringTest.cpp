@@ -7,6 +7,8 @@
 
 #include <folly/portability/GTest.h>
 #include <string>
+#include <vector>
+#include "watchman/Hash.h"
 #include "watchman/watchman_string.h"
 
 TEST(String, fmt) {
@@ -164,6 +166,33 @@ TEST(String, lowercase_suffix) {
   EXPECT_EQ(str.asLowerCaseSuffix()->size(), 255);
 }
 
+TEST(String, lowercase_cached) {
+  // An already-folded string is returned as-is: same underlying buffer.
+  w_string lower("already/lower.case_42");
+  auto folded = lower.asLowerCase();
+  EXPECT_EQ(folded, lower);
+  EXPECT_EQ(folded.data(), lower.data());
+  // And again, now via the cached header bit.
+  EXPECT_EQ(lower.asLowerCase().data(), lower.data());
+
+  // Mixed case folds into a new string that is itself cached as folded.
+  w_string mixed("Some/Dir/README.TXT", W_STRING_UNICODE);
+  auto foldedMixed = mixed.asLowerCase();
+  EXPECT_EQ(foldedMixed, w_string("some/dir/readme.txt"));
+  EXPECT_NE(foldedMixed.data(), mixed.data());
+  EXPECT_EQ(foldedMixed.type(), W_STRING_UNICODE);
+  EXPECT_EQ(foldedMixed.asLowerCase().data(), foldedMixed.data());
+  // The original is unchanged and still folds on request.
+  EXPECT_EQ(mixed, w_string("Some/Dir/README.TXT"));
+  EXPECT_EQ(mixed.asLowerCase(), foldedMixed);
+
+  // Null and empty strings are their own folded form.
+  w_string null_str;
+  EXPECT_EQ(null_str.asLowerCase(), null_str);
+  w_string empty("");
+  EXPECT_EQ(empty.asLowerCase().data(), empty.data());
+}
+
 TEST(String, string_piece_suffix) {
   EXPECT_EQ(w_string_piece().suffix(), "");
   EXPECT_EQ(w_string_piece("").suffix(), "");
@@ -333,6 +362,19 @@ TEST(String, operators) {
   EXPECT_LT(w_string_piece("A"), w_string_piece("a"));
 }
 
+TEST(String, hash_bytes) {
+  auto h = [](std::string_view s, uint64_t seed = 0) {
+    return watchman::w_hash_bytes(s.data(), s.size(), seed);
+  };
+  // Deterministic for equal inputs
+  EXPECT_EQ(h("src/foo/bar.cpp"), h("src/foo/bar.cpp"));
+  // Sensitive to content, length and seed
+  EXPECT_NE(h("src/foo/bar.cpp"), h("src/foo/baz.cpp"));
+  EXPECT_NE(h("abc"), h("abcd"));
+  EXPECT_NE(h(""), h("", 1));
+  EXPECT_NE(h("src/foo/bar.cpp", 1), h("src/foo/bar.cpp", 2));
+}
+
 TEST(String, piece_and_string_should_have_same_hash) {
   EXPECT_EQ(w_string{""}.hashValue(), w_string_piece{""}.hashValue());
   EXPECT_EQ(
@@ -452,6 +494,50 @@ TEST(String, contains) {
   EXPECT_FALSE(haystack.contains("watchman2"));
 }
 
+TEST(String, intern_path_component) {
+  auto a = watchman::internPathComponent("node_modules");
+  auto b = watchman::internPathComponent("node_modules");
+  // Same pool entry: equality is satisfied by the identity fast path.
+  EXPECT_EQ(a.data(), b.data());
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a, w_string("node_modules"));
+
+  auto c = watchman::internPathComponent("node_module");
+  EXPECT_NE(a.data(), c.data());
+  EXPECT_EQ(c, w_string("node_module"));
+}
+
+TEST(String, intern_pool_reclaims_unreferenced_entries) {
+  auto held = watchman::internPathComponent("StringTest-held-entry");
+  auto baseline = watchman::getInternPoolStats().entries;
+
+  // Intern a large churning vocabulary, dropping each handle at once.
+  // The amortized sweep should reclaim these rather than letting the
+  // pool grow by the full insert count.
+  constexpr size_t kChurn = 40000;
+  for (size_t i = 0; i < kChurn; ++i) {
+    watchman::internPathComponent(
+        w_string::format("StringTest-churn-{}", i).piece());
+  }
+  auto after = watchman::getInternPoolStats().entries;
+  EXPECT_LT(after, baseline + kChurn);
+
+  // Entries with live references outside the pool survive sweeps.
+  auto again = watchman::internPathComponent("StringTest-held-entry");
+  EXPECT_EQ(held.data(), again.data());
+}
+
+TEST(String, intern_suffix_id) {
+  auto cpp = watchman::internSuffixId(w_string{"cpp"});
+  auto h = watchman::internSuffixId(w_string{"h"});
+  // Ids are stable across repeat interning and distinct per suffix.
+  EXPECT_EQ(cpp, watchman::internSuffixId(w_string{"cpp"}));
+  EXPECT_NE(cpp, h);
+  // 0 is reserved to mean "no suffix".
+  EXPECT_NE(cpp, 0u);
+  EXPECT_NE(h, 0u);
+}
+
 TEST(String, allocate_many_sizes) {
   // This strange test relies on ASAN to assert that our allocation size math is
   // correct.
@@ -465,3 +551,91 @@ TEST(String, allocate_many_sizes) {
   EXPECT_EQ(7, w_string("xxxxxxx", 7).size());
   EXPECT_EQ(8, w_string("xxxxxxxx", 8).size());
 }
+
+namespace {
+// Exercised at compile time below to keep the iterator constexpr-clean.
+constexpr size_t countPathComponents(w_string_piece piece) {
+  size_t n = 0;
+  for (auto it = piece.pathComponents().begin();
+       it != piece.pathComponents().end();
+       ++it) {
+    ++n;
+  }
+  return n;
+}
+
+static_assert(countPathComponents(w_string_piece{"a/b/c", 5}) == 3);
+static_assert(countPathComponents(w_string_piece{"abc", 3}) == 1);
+static_assert(countPathComponents(w_string_piece{"", 0}) == 0);
+} // namespace
+
+TEST(String, path_components) {
+  auto collect = [](w_string_piece piece) {
+    std::vector<w_string_piece> parts;
+    for (auto component : piece.pathComponents()) {
+      parts.push_back(component);
+    }
+    return parts;
+  };
+
+  auto parts = collect("foo/bar/baz.cpp");
+  ASSERT_EQ(3, parts.size());
+  EXPECT_EQ(w_string_piece{"foo"}, parts[0]);
+  EXPECT_EQ(w_string_piece{"bar"}, parts[1]);
+  EXPECT_EQ(w_string_piece{"baz.cpp"}, parts[2]);
+
+  parts = collect("single");
+  ASSERT_EQ(1, parts.size());
+  EXPECT_EQ(w_string_piece{"single"}, parts[0]);
+
+  // Empty input yields no components.
+  EXPECT_TRUE(collect(w_string_piece{"", size_t(0)}).empty());
+
+  // Non-canonical inputs: adjacent and trailing separators yield empty
+  // components rather than being silently swallowed.
+  parts = collect("a//b");
+  ASSERT_EQ(3, parts.size());
+  EXPECT_TRUE(parts[1].empty());
+
+  parts = collect("a/");
+  ASSERT_EQ(2, parts.size());
+  EXPECT_TRUE(parts[1].empty());
+
+  // The views alias the input storage: no allocation happens.
+  w_string backing{"x/y"};
+  parts = collect(backing.piece());
+  ASSERT_EQ(2, parts.size());
+  EXPECT_EQ(backing.data(), parts[0].data());
+  EXPECT_EQ(backing.data() + 2, parts[1].data());
+}
+
+TEST(String, small_block_recycling_round_trips_contents) {
+  // Exercise the thread-local small-block cache across many
+  // create/destroy cycles and size classes; contents must always be
+  // exactly what was stored, including the NUL terminator.
+  for (int cycle = 0; cycle < 4; ++cycle) {
+    std::vector<w_string> held;
+    for (int i = 0; i < 2000; ++i) {
+      auto text = "name-" + std::to_string(cycle) + "-" + std::to_string(i % 37);
+      auto str = w_string{text.c_str()};
+      EXPECT_EQ(text, str.view());
+      EXPECT_EQ(0, str.data()[str.size()]);
+      if (i % 3 == 0) {
+        held.push_back(std::move(str));
+      }
+    }
+    for (size_t i = 0; i < held.size(); ++i) {
+      auto expect =
+          "name-" + std::to_string(cycle) + "-" + std::to_string((i * 3) % 37);
+      EXPECT_EQ(expect, held[i].view());
+    }
+  }
+
+  // Sizes straddling every class boundary, including uncached ones.
+  for (size_t len : {1, 15, 16, 31, 32, 47, 48, 63, 64, 200}) {
+    std::string payload(len, 'x');
+    auto str = w_string{payload.c_str(), len};
+    EXPECT_EQ(len, str.size());
+    EXPECT_EQ(payload, str.view());
+  }
+}
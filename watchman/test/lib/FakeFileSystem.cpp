@@ -232,7 +232,6 @@ void FakeFileSystem::addNode(const char* path, const FileInformation& fi) {
 
   auto piece = parseAbsolute(path);
   while (!piece.empty()) {
-    fmt::print("piece = {}\n", piece);
     size_t idx = piece.find('/');
     folly::StringPiece this_level;
     if (idx == folly::StringPiece::npos) {
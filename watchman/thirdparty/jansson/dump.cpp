@@ -12,11 +12,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 
 #include "jansson.h"
 #include "jansson_private.h"
 #include "utf.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define MAX_INTEGER_STR_LENGTH 100
 #define MAX_REAL_STR_LENGTH 100
 
@@ -64,12 +69,55 @@ static int dump_indent(
   return 0;
 }
 
+/* Advance over a run of bytes that need neither escaping nor UTF-8
+ * validation: printable ASCII other than '"' and '\\' (and '/' when
+ * JSON_ESCAPE_SLASH is in effect). Control chars and non-ASCII bytes
+ * stop the scan so that the caller's utf8_iterate path handles them
+ * exactly as before; this only bulk-skips the overwhelmingly common
+ * clean-ASCII spans instead of paying one utf8_iterate call per byte. */
+static const char*
+skip_clean_ascii(const char* p, const char* end, size_t flags) {
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i slash = _mm_set1_epi8('/');
+
+  while (p + 16 <= end) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+    /* signed compare: bytes >= 0x80 are negative, so control chars and
+     * non-ASCII lead bytes are caught by the same test */
+    __m128i bad = _mm_cmplt_epi8(chunk, space);
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, quote));
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, bslash));
+    if (flags & JSON_ESCAPE_SLASH)
+      bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, slash));
+
+    if (_mm_movemask_epi8(bad)) {
+      /* the byte-wise loop below pinpoints the offender */
+      break;
+    }
+    p += 16;
+  }
+#endif
+
+  while (p < end) {
+    unsigned char c = (unsigned char)*p;
+    if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\' ||
+        ((flags & JSON_ESCAPE_SLASH) && c == '/'))
+      break;
+    p++;
+  }
+  return p;
+}
+
 static int dump_string(
     const char* str,
     json_dump_callback_t dump,
     void* data,
     size_t flags) {
   const char *pos, *end;
+  const char* str_end = str + strlen(str);
   int32_t codepoint;
 
   if (dump("\"", 1, data))
@@ -81,7 +129,13 @@ static int dump_string(
     char seq[13];
     int length;
 
-    while (*end) {
+    while (end != str_end) {
+      /* bulk-skip the clean ASCII run starting here */
+      pos = skip_clean_ascii(pos, str_end, flags);
+      end = pos;
+      if (pos == str_end)
+        break;
+
       end = utf8_iterate(pos, &codepoint);
       if (!end) {
         return -1;
@@ -170,6 +224,70 @@ static int dump_string(
   return dump("\"", 1, data);
 }
 
+static int do_dump(
+    const json_ref& json,
+    size_t flags,
+    int depth,
+    json_dump_callback_t dump,
+    void* data);
+
+/* Render one columnar (array-form) row of a templated array as the
+ * object it stands for, pairing the template's keys with the row's
+ * values positionally.  A short row stands for an object whose
+ * trailing properties are not set. */
+static int dump_templ_row(
+    const json_ref& templ,
+    const json_ref& row,
+    size_t flags,
+    int depth,
+    json_dump_callback_t dump,
+    void* data) {
+  const char* separator;
+  int separator_length;
+
+  if (flags & JSON_COMPACT) {
+    separator = ":";
+    separator_length = 1;
+  } else {
+    separator = ": ";
+    separator_length = 2;
+  }
+
+  auto& keys = templ.array();
+  auto& values = row.array();
+  auto n = std::min(keys.size(), values.size());
+
+  if (dump("{", 1, data)) {
+    return -1;
+  }
+  if (n == 0) {
+    return dump("}", 1, data);
+  }
+
+  if (dump_indent(flags, depth + 1, 0, dump, data)) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    dump_string(json_string_value(keys[i]), dump, data, flags);
+    if (dump(separator, separator_length, data) ||
+        do_dump(values[i], flags, depth + 1, dump, data)) {
+      return -1;
+    }
+
+    if (i + 1 < n) {
+      if (dump(",", 1, data) || dump_indent(flags, depth + 1, 1, dump, data)) {
+        return -1;
+      }
+    } else {
+      if (dump_indent(flags, depth, 0, dump, data)) {
+        return -1;
+      }
+    }
+  }
+  return dump("}", 1, data);
+}
+
 static int do_dump(
     const json_ref& json,
     size_t flags,
@@ -221,6 +339,21 @@ static int do_dump(
     case JSON_ARRAY: {
       auto& arr = json.array();
 
+      /* Pre-encoded arrays carry their elements only as BSER bytes;
+       * there is nothing here to render as text, so fail loudly rather
+       * than silently emitting an empty array. */
+      if (json_array_get_preencoded(json)) {
+        return -1;
+      }
+
+      /* Templated arrays may hold columnar rows (arrays in template
+       * key order); those are expanded back into objects on the wire
+       * so that the JSON representation is identical to object rows. */
+      auto templ = json_array_get_template(json);
+      if (templ && !templ->isArray()) {
+        templ = std::nullopt;
+      }
+
       if (dump("[", 1, data)) {
         return -1;
       }
@@ -231,7 +364,11 @@ static int do_dump(
         return -1;
 
       for (size_t i = 0; i < arr.size(); ++i) {
-        if (do_dump(arr[i], flags, depth + 1, dump, data)) {
+        if (templ && arr[i].isArray()) {
+          if (dump_templ_row(*templ, arr[i], flags, depth + 1, dump, data)) {
+            return -1;
+          }
+        } else if (do_dump(arr[i], flags, depth + 1, dump, data)) {
           return -1;
         }
 
@@ -14,6 +14,7 @@
 #include <atomic>
 #include <cstdlib> /* for size_t */
 #include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <type_traits>
@@ -36,6 +37,9 @@ enum json_type : char {
 
 struct json_t {
   json_type type;
+  // watchman::MemorySubsystem this value was charged to at construction;
+  // lives in the padding between type and refcount, so tagging is free.
+  uint8_t memTag;
   std::atomic<size_t> refcount;
 
   explicit json_t(json_type type);
@@ -44,6 +48,15 @@ struct json_t {
   // true, false, null are never heap allocated, always
   // reference a global singleton value with a bogus refcount
   json_t(json_type type, SingletonHack&&);
+
+  // json nodes are created and destroyed in storms: building one large
+  // response allocates hundreds of thousands of values that all die
+  // together right after encoding.  The concrete value types therefore
+  // draw their storage from a thread-local recycling pool (see
+  // value.cpp) instead of going to the heap per node; these overloads
+  // are inherited by every json_*_t subtype.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr, size_t size);
 };
 
 #define JSON_INTEGER_FORMAT PRId64
@@ -288,6 +301,25 @@ size_t json_array_size(const json_ref& array);
 int json_array_set_template_new(const json_ref& json, json_ref&& templ);
 std::optional<json_ref> json_array_get_template(const json_ref& array);
 
+namespace watchman {
+struct BserPreencodedArray;
+}
+
+/* Out-of-band annotation like the template above: when set, the array's
+ * elements were already BSER-encoded (see BserRenderSink in bser.h) and
+ * the BSER encoder splices those bytes verbatim instead of walking the
+ * (empty) element vector.  Such arrays cannot be rendered as JSON text;
+ * the JSON dumper fails on them rather than emitting wrong data.
+ *
+ * Unlike the template, the annotation may be set after the document is
+ * shared (the parallel pre-encoder annotates whatever it serializes),
+ * so both accessors are atomic and safe to race. */
+int json_array_set_preencoded(
+    const json_ref& json,
+    std::shared_ptr<const watchman::BserPreencodedArray> pre);
+std::shared_ptr<const watchman::BserPreencodedArray> json_array_get_preencoded(
+    const json_ref& array);
+
 const char* json_string_value(const json_ref& string);
 json_int_t json_integer_value(const json_ref& integer);
 double json_real_value(const json_ref& real);
@@ -8,6 +8,7 @@
 #ifndef JANSSON_PRIVATE_H
 #define JANSSON_PRIVATE_H
 
+#include <folly/concurrency/AtomicSharedPtr.h>
 #include <stddef.h>
 #include <algorithm>
 #include <unordered_map>
@@ -26,6 +27,10 @@ struct json_object_t : json_t {
 struct json_array_t : json_t {
   std::vector<json_ref> table;
   std::optional<json_ref> templ;
+  // Atomic because result arrays are shared across client threads
+  // (eg: via the query result cache) and each encode may annotate the
+  // array it is serializing; see json_array_set_preencoded().
+  folly::atomic_shared_ptr<const watchman::BserPreencodedArray> preencoded;
 
   json_array_t(std::vector<json_ref> values);
   json_array_t(std::initializer_list<json_ref> values);
@@ -47,6 +52,8 @@ struct json_integer_t : json_t {
   json_int_t value;
 
   json_integer_t(json_int_t value);
+  // For the shared small integer singletons; see json_integer()
+  json_integer_t(json_int_t value, json_t::SingletonHack&&);
 };
 
 inline json_object_t* json_to_object(const json_t* json) {
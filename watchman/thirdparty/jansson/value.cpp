@@ -12,10 +12,13 @@
 #include "jansson_private.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <deque>
 #include <string>
 
 #include "utf.h"
+#include "watchman/MemoryAccounting.h"
 #include "watchman/watchman_string.h"
 
 namespace {
@@ -46,8 +49,111 @@ static json_t the_null{JSON_NULL, json_t::SingletonHack()};
 static json_t the_false{JSON_FALSE, json_t::SingletonHack()};
 static json_t the_true{JSON_TRUE, json_t::SingletonHack()};
 
+/**
+ * Recycling pool backing json_t::operator new/delete.
+ *
+ * Responses are built and torn down in waves: a 100k-entry result set
+ * means several hundred thousand nodes allocated back to back and freed
+ * together after encoding.  Freed node storage is kept on per-size
+ * freelists and handed straight back to the next wave, so the steady
+ * state allocates and frees nodes without touching malloc at all.
+ *
+ * A scope-freed arena would be cheaper still, but is unsound here:
+ * rendered fragments outlive their response by design (the render
+ * fragment cache, the query result cache, and subscription state all
+ * retain json values), so nodes must remain individually owned.  The
+ * pool keeps the refcounting and reclaims only the allocator traffic.
+ *
+ * The pool is thread-local, so no locks are taken on the node path.
+ * A node freed on a different thread than it was allocated on simply
+ * migrates to the freeing thread's pool; blocks of one size class are
+ * interchangeable.  Each bin is capped so an unusually large response
+ * does not permanently park its storage on one thread.
+ */
+class JsonNodePool {
+ public:
+  // All node sizes are rounded up to this granularity; a freed block
+  // must be able to hold the freelist link.
+  static constexpr size_t kGranularity = 16;
+  // Nodes are small; anything larger than this is not a json node
+  // shape we know about and goes straight to the heap.
+  static constexpr size_t kMaxPooledSize = 128;
+  // Per-bin retention cap.  Generous enough to absorb a subscription
+  // storm's worth of integers and strings, small enough that a dozen
+  // threads' pools are noise next to the view itself.
+  static constexpr size_t kMaxBytesPerBin = 2 * 1024 * 1024;
+
+  void* allocate(size_t size) {
+    if (size == 0 || size > kMaxPooledSize) {
+      return ::operator new(size);
+    }
+    auto& bin = bins_[binIndex(size)];
+    if (bin.head) {
+      void* p = bin.head;
+      bin.head = *static_cast<void**>(p);
+      bin.bytes -= binSize(size);
+      return p;
+    }
+    return ::operator new(binSize(size));
+  }
+
+  void deallocate(void* ptr, size_t size) {
+    if (size == 0 || size > kMaxPooledSize) {
+      ::operator delete(ptr);
+      return;
+    }
+    auto& bin = bins_[binIndex(size)];
+    if (bin.bytes + binSize(size) > kMaxBytesPerBin) {
+      ::operator delete(ptr);
+      return;
+    }
+    *static_cast<void**>(ptr) = bin.head;
+    bin.head = ptr;
+    bin.bytes += binSize(size);
+  }
+
+  ~JsonNodePool() {
+    for (auto& bin : bins_) {
+      while (bin.head) {
+        void* p = bin.head;
+        bin.head = *static_cast<void**>(p);
+        ::operator delete(p);
+      }
+    }
+  }
+
+ private:
+  struct Bin {
+    void* head{nullptr};
+    size_t bytes{0};
+  };
+
+  static size_t binSize(size_t size) {
+    return (size + kGranularity - 1) & ~(kGranularity - 1);
+  }
+
+  static size_t binIndex(size_t size) {
+    return binSize(size) / kGranularity - 1;
+  }
+
+  std::array<Bin, kMaxPooledSize / kGranularity> bins_;
+};
+
+JsonNodePool& threadJsonNodePool() {
+  static thread_local JsonNodePool pool;
+  return pool;
+}
+
 } // namespace
 
+void* json_t::operator new(size_t size) {
+  return threadJsonNodePool().allocate(size);
+}
+
+void json_t::operator delete(void* ptr, size_t size) {
+  threadJsonNodePool().deallocate(ptr, size);
+}
+
 json_ref::~json_ref() {
   decref();
 }
@@ -86,10 +192,45 @@ json_ref& json_ref::operator=(json_ref&& other) noexcept {
   return *this;
 }
 
-json_t::json_t(json_type type) : type(type), refcount(1) {}
+json_t::json_t(json_type type)
+    : type(type),
+      memTag{static_cast<uint8_t>(watchman::currentMemorySubsystem())},
+      refcount(1) {}
 
 json_t::json_t(json_type type, json_t::SingletonHack&&)
-    : type(type), refcount(-1) {}
+    : type(type), memTag{0}, refcount(-1) {}
+
+namespace {
+
+// Bytes charged against MemoryAccounting for a heap json value: the
+// concrete node plus, for strings, the payload.  Container backing
+// storage is not counted; each element is charged as its own node.
+size_t accountedSize(const json_t* json) {
+  switch (json->type) {
+    case JSON_OBJECT:
+      return sizeof(json_object_t);
+    case JSON_ARRAY:
+      return sizeof(json_array_t);
+    case JSON_STRING:
+      return sizeof(json_string_t) + json_to_string(json)->value.size();
+    case JSON_INTEGER:
+      return sizeof(json_integer_t);
+    case JSON_REAL:
+      return sizeof(json_real_t);
+    default:
+      return 0;
+  }
+}
+
+// Called from the body of each heap value's constructor, where the type
+// field and (for strings) the payload are already in place.
+void chargeAlloc(const json_t* json) {
+  watchman::recordMemoryAlloc(
+      static_cast<watchman::MemorySubsystem>(json->memTag),
+      accountedSize(json));
+}
+
+} // namespace
 
 const w_string& json_ref::asString() const {
   if (!isString()) {
@@ -132,7 +273,9 @@ const std::unordered_map<w_string, json_ref>& json_ref::object() const {
 }
 
 json_object_t::json_object_t(std::unordered_map<w_string, json_ref> values)
-    : json_t{JSON_OBJECT}, map{std::move(values)} {}
+    : json_t{JSON_OBJECT}, map{std::move(values)} {
+  chargeAlloc(this);
+}
 
 json_ref json_object(std::unordered_map<w_string, json_ref> values) {
   return json_ref::takeOwnership(new json_object_t(std::move(values)));
@@ -296,10 +439,14 @@ static json_ref json_object_deep_copy(const json_ref& object) {
 /*** array ***/
 
 json_array_t::json_array_t(std::vector<json_ref> values)
-    : json_t(JSON_ARRAY), table{std::move(values)} {}
+    : json_t(JSON_ARRAY), table{std::move(values)} {
+  chargeAlloc(this);
+}
 
 json_array_t::json_array_t(std::initializer_list<json_ref> values)
-    : json_t(JSON_ARRAY), table(values) {}
+    : json_t(JSON_ARRAY), table(values) {
+  chargeAlloc(this);
+}
 
 const std::vector<json_ref>& json_ref::array() const {
   if (!isArray()) {
@@ -335,6 +482,29 @@ std::optional<json_ref> json_array_get_template(const json_ref& array) {
   return json_to_array(array.get())->templ;
 }
 
+int json_array_set_preencoded(
+    const json_ref& json,
+    std::shared_ptr<const watchman::BserPreencodedArray> pre) {
+  if (!json.isArray()) {
+    return 0;
+  }
+  // The slot is atomic: two client threads can encode a shared result
+  // array concurrently and both try to annotate it.  Each stores a
+  // complete, self-describing annotation (readers check its version
+  // and capabilities before splicing), so last-writer-wins is fine;
+  // the loser's work is merely wasted.
+  json_to_array(json.get())->preencoded.store(std::move(pre));
+  return 1;
+}
+
+std::shared_ptr<const watchman::BserPreencodedArray> json_array_get_preencoded(
+    const json_ref& array) {
+  if (!array.isArray()) {
+    return nullptr;
+  }
+  return json_to_array(array.get())->preencoded.load();
+}
+
 size_t json_array_size(const json_ref& json) {
   if (!json.isArray()) {
     return 0;
@@ -372,7 +542,9 @@ static json_ref json_array_deep_copy(const json_ref& array) {
 /*** string ***/
 
 json_string_t::json_string_t(w_string str)
-    : json_t(JSON_STRING), value(std::move(str)) {}
+    : json_t(JSON_STRING), value(std::move(str)) {
+  chargeAlloc(this);
+}
 
 json_ref w_string_to_json(w_string str) {
   return json_ref::takeOwnership(new json_string_t(str));
@@ -402,9 +574,39 @@ static int json_string_equal(const json_ref& string1, const json_ref& string2) {
 /*** integer ***/
 
 json_integer_t::json_integer_t(json_int_t value)
-    : json_t(JSON_INTEGER), value(value) {}
+    : json_t(JSON_INTEGER), value(value) {
+  chargeAlloc(this);
+}
+
+json_integer_t::json_integer_t(json_int_t value, json_t::SingletonHack&& hack)
+    : json_t(JSON_INTEGER, std::move(hack)), value(value) {}
+
+namespace {
+// Small integer values come up constantly when rendering query results
+// (sizes, link counts, uids/gids), so we share immortal singletons for
+// them rather than heap allocating a json_integer_t per use.  Values
+// are immutable so sharing is safe; the bogus singleton refcount makes
+// incref/decref no-ops, just like the true/false/null singletons above.
+constexpr json_int_t kMinCachedInteger = -1;
+constexpr json_int_t kMaxCachedInteger = 255;
+
+struct CachedIntegers {
+  std::deque<json_integer_t> values;
+
+  CachedIntegers() {
+    for (json_int_t i = kMinCachedInteger; i <= kMaxCachedInteger; ++i) {
+      values.emplace_back(i, json_t::SingletonHack());
+    }
+  }
+};
+} // namespace
 
 json_ref json_integer(json_int_t value) {
+  if (value >= kMinCachedInteger && value <= kMaxCachedInteger) {
+    // Meyers singleton to avoid SIOF
+    static CachedIntegers cache;
+    return json_ref::takeOwnership(&cache.values[value - kMinCachedInteger]);
+  }
   return json_ref::takeOwnership(new json_integer_t(value));
 }
 
@@ -427,7 +629,9 @@ static int json_integer_equal(
 
 /*** real ***/
 
-json_real_t::json_real_t(double value) : json_t(JSON_REAL), value(value) {}
+json_real_t::json_real_t(double value) : json_t(JSON_REAL), value(value) {
+  chargeAlloc(this);
+}
 
 json_ref json_real(double value) {
   if (!std::isfinite(value)) {
@@ -476,6 +680,13 @@ json_ref json_null() {
 /*** deletion ***/
 
 void json_ref::json_delete(json_t* json) {
+  if (json->type <= JSON_REAL) {
+    // Release against the subsystem the value was charged to at
+    // construction; the simple-value singletons never reach here.
+    watchman::recordMemoryFree(
+        static_cast<watchman::MemorySubsystem>(json->memTag),
+        accountedSize(json));
+  }
   switch (json->type) {
     case JSON_OBJECT:
       delete (json_object_t*)json;
@@ -1229,3 +1229,148 @@ int art_tree<ValueType, KeyType>::iterPrefix(
   }
   return 0;
 }
+
+// Appends every leaf under n whose key carries the prefix.  The
+// prefixMatches filter is needed for the same reason as the filtering in
+// iterPrefix: a sub-tree located via minimum() can contain shorter keys
+// once inserts and deletes have churned the prefixes.
+template <typename ValueType, typename KeyType>
+void art_tree<ValueType, KeyType>::recursiveCollect(
+    Node* n,
+    const unsigned char* prefix,
+    uint32_t prefix_len,
+    std::vector<Leaf*>& out) {
+  union node_ptr p = {n};
+
+  if (!n) {
+    return;
+  }
+  if (IS_LEAF(n)) {
+    auto l = LEAF_RAW(n);
+    if (l->prefixMatches(prefix, prefix_len)) {
+      out.push_back(l);
+    }
+    return;
+  }
+
+  switch (n->type) {
+    case Node_type::NODE4:
+      for (int i = 0; i < n->num_children; i++) {
+        recursiveCollect(p.n4->children[i].get(), prefix, prefix_len, out);
+      }
+      break;
+
+    case Node_type::NODE16:
+      for (int i = 0; i < n->num_children; i++) {
+        recursiveCollect(p.n16->children[i].get(), prefix, prefix_len, out);
+      }
+      break;
+
+    case Node_type::NODE48:
+      for (int i = 0; i < 256; i++) {
+        auto idx = p.n48->keys[i];
+        if (!idx) {
+          continue;
+        }
+        recursiveCollect(
+            p.n48->children[idx - 1].get(), prefix, prefix_len, out);
+      }
+      break;
+
+    case Node_type::NODE256:
+      for (int i = 0; i < 256; i++) {
+        if (!p.n256->children[i]) {
+          continue;
+        }
+        recursiveCollect(p.n256->children[i].get(), prefix, prefix_len, out);
+      }
+      break;
+
+    default:
+      abort();
+  }
+}
+
+/**
+ * Collects the leaves matching a prefix in one pass.  The navigation to
+ * the covering sub-tree mirrors iterPrefix.
+ */
+template <typename ValueType, typename KeyType>
+typename std::vector<typename art_tree<ValueType, KeyType>::Leaf*>
+art_tree<ValueType, KeyType>::collectPrefix(
+    const unsigned char* key,
+    uint32_t key_len) {
+  std::vector<Leaf*> out;
+  auto n = root_.get();
+  uint32_t prefix_len, depth = 0;
+
+  while (n) {
+    // Might be a leaf
+    if (IS_LEAF(n)) {
+      auto l = LEAF_RAW(n);
+      if (l->prefixMatches(key, key_len)) {
+        out.push_back(l);
+      }
+      return out;
+    }
+
+    // If the depth matches the prefix, we need to handle this node
+    if (depth == key_len) {
+      auto l = n->minimum();
+      if (l->prefixMatches(key, key_len)) {
+        recursiveCollect(n, key, key_len, out);
+      }
+      return out;
+    }
+
+    // Bail if the prefix does not match
+    if (n->partial_len) {
+      prefix_len = n->prefixMismatch(key, key_len, depth);
+
+      // If there is no match, search is terminated
+      if (!prefix_len) {
+        return out;
+      }
+      // If we've matched the prefix, collect from this node
+      else if (depth + prefix_len == key_len) {
+        recursiveCollect(n, key, key_len, out);
+        return out;
+      }
+
+      // if there is a full match, go deeper
+      depth = depth + n->partial_len;
+    }
+
+    if (depth > key_len) {
+      return out;
+    }
+
+    // Recursively search
+    auto child = n->findChild(keyAt(key, key_len, depth));
+    n = child ? child->get() : nullptr;
+    depth++;
+  }
+  return out;
+}
+
+template <typename ValueType, typename KeyType>
+template <typename ShouldErase>
+uint32_t art_tree<ValueType, KeyType>::erasePrefix(
+    const unsigned char* prefix,
+    uint32_t prefix_len,
+    ShouldErase&& shouldErase) {
+  // The collected pointers stay valid while we erase: removing one leaf
+  // only rearranges interior nodes, never relocates other leaves.
+  auto leaves = collectPrefix(prefix, prefix_len);
+  uint32_t erased = 0;
+  for (auto* leaf : leaves) {
+    if (!shouldErase(leaf->key, leaf->value)) {
+      continue;
+    }
+    erase(
+        reinterpret_cast<const unsigned char*>(leaf->key.data()),
+        leaf->key.size());
+    ++erased;
+  }
+  return erased;
+}
@@ -5,6 +5,7 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 
 #define ART_MAX_PREFIX_LEN 10u
 
@@ -264,6 +265,32 @@ struct art_tree {
   template <typename Func>
   int iterPrefix(const unsigned char* prefix, uint32_t prefix_len, Func&& func);
 
+  /**
+   * Collects every leaf whose key begins with the given prefix into a
+   * single contiguous run, avoiding per-leaf callback dispatch.
+   * The returned pointers remain valid until the corresponding leaves
+   * are erased or the tree is cleared.
+   */
+  std::vector<Leaf*> collectPrefix(
+      const unsigned char* prefix,
+      uint32_t prefix_len);
+
+  /**
+   * Erases every leaf whose key begins with the given prefix and for
+   * which shouldErase(key, value) returns true.  The predicate may
+   * consume state from a value it approves; that leaf is unlinked
+   * immediately afterwards.  One scan collects the candidates and each
+   * is then deleted individually, so the cost is proportional to the
+   * subtree size plus one tree descent per erased leaf, rather than a
+   * restarted prefix scan per deletion.
+   * @return the number of leaves erased.
+   */
+  template <typename ShouldErase>
+  uint32_t erasePrefix(
+      const unsigned char* prefix,
+      uint32_t prefix_len,
+      ShouldErase&& shouldErase);
+
  private:
   NodePtr root_;
   uint64_t size_;
@@ -283,6 +310,11 @@ struct art_tree {
 
   template <typename Func>
   int recursiveIter(Node* n, Func& func);
+  void recursiveCollect(
+      Node* n,
+      const unsigned char* prefix,
+      uint32_t prefix_len,
+      std::vector<Leaf*>& out);
 };
 
 #include "art-inl.h"
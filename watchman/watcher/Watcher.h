@@ -7,6 +7,7 @@
 
 #pragma once
 #include <folly/futures/Future.h>
+#include <optional>
 #include <stdexcept>
 #include "watchman/PendingCollection.h"
 #include "watchman/fs/DirHandle.h"
@@ -38,8 +39,20 @@ class Watcher : public std::enable_shared_from_this<Watcher> {
   // if this watcher notifies for individual files contained within
   // a watched dir, false if it only notifies for dirs
 #define WATCHER_HAS_PER_FILE_NOTIFICATIONS 1
+  // if this watcher places an OS-level watch on individual files via
+  // startWatchFile and therefore needs statPath to visit every file,
+  // even one whose stat data is unchanged, to (re)arm that watch
+#define WATCHER_NEEDS_PER_FILE_WATCHES 2
   // if the watcher is comprised of multiple watchers
 #define WATCHER_HAS_SPLIT_WATCH 4
+  // if the watcher's event queue is causally ordered -- an event is
+  // never reported before another event that happened earlier -- and
+  // event loss is always surfaced as an explicit overflow/desync
+  // rather than silent omission.  Sync and recovery planning key off
+  // this: a queue barrier is then equivalent to a filesystem round
+  // trip (see syncBarrier), and a desync's blast radius can be probed
+  // by sampling instead of assumed to be the whole tree.
+#define WATCHER_PRECISELY_ORDERED 8
   unsigned flags;
 
   Watcher(const char* name, unsigned flags);
@@ -71,9 +84,43 @@ class Watcher : public std::enable_shared_from_this<Watcher> {
     return folly::SemiFuture<folly::Unit>::makeEmpty();
   }
 
+  /**
+   * If the watcher can vouch for a monotonic event position -- every
+   * change completed before this call is already queued behind it --
+   * returns a valid SemiFuture that completes once everything at or
+   * before that position has been handed to the PendingCollection and
+   * processed. InMemoryView uses this to synchronize queries without
+   * paying for a cookie file write and its round trip through the
+   * filesystem.
+   *
+   * Returns an invalid SemiFuture when the watcher cannot make that
+   * ordering guarantee; the caller must fall back to cookie sync.
+   * Only consulted for watchers advertising WATCHER_PRECISELY_ORDERED,
+   * whose static claim this call makes good on dynamically (it may
+   * still decline, eg: when inotify sharding defeats the single-queue
+   * ordering).
+   */
+  virtual folly::SemiFuture<folly::Unit> syncBarrier() {
+    return folly::SemiFuture<folly::Unit>::makeEmpty();
+  }
+
   // Initiate an OS-level watch on the provided file
   virtual bool startWatchFile(watchman_file* file);
 
+  /**
+   * If `dest` is a directory the watcher knows was just renamed into
+   * place -- it paired both halves of the move via its native rename
+   * cookies -- returns the watched path it was renamed from and forgets
+   * the pairing.  InMemoryView::statPath uses this, together with the
+   * W_PENDING_RENAMED flag, to graft the source subtree onto the new
+   * path in memory instead of re-statting every file beneath it.
+   * Watchers without rename pairing return nullopt.
+   */
+  virtual std::optional<w_string> takeRenameSource(const w_string& dest) {
+    (void)dest;
+    return std::nullopt;
+  }
+
   // Initiate an OS-level watch on the provided dir, return a DIR
   // handle, or throw on error.
   //
@@ -600,7 +600,7 @@ void filterOutPaths(std::vector<NameAndDType>& files, QueryContext* ctx) {
       std::remove_if(
           files.begin(),
           files.end(),
-          [ctx](const NameAndDType& item) {
+          [ctx, ignore = ctx->root->ignore.get()](const NameAndDType& item) {
             auto full = w_string::pathCat({ctx->root->root_path, item.name});
 
             if (!ctx->fileMatchesRelativeRoot(full)) {
@@ -608,7 +608,7 @@ void filterOutPaths(std::vector<NameAndDType>& files, QueryContext* ctx) {
               return true;
             }
 
-            return ctx->root->ignore.isIgnored(full.data(), full.size());
+            return ignore->isIgnored(full.data(), full.size());
           }),
       files.end());
 }
@@ -729,6 +729,134 @@ std::shared_ptr<apache::thrift::RequestChannel> makeThriftChannel(
   return channel;
 }
 
+/**
+ * Layers EdenFS thrift fast paths over the SCM implementation detected
+ * for the mount.  `hg status -n --rev <mergebase>` forks a process and
+ * asks hg to compute state that EdenFS already tracks: the delta between
+ * the mergebase and the working copy parent, and the dirty set of the
+ * working copy itself.  We ask the daemon for both and union the
+ * results, falling back to the wrapped implementation if the daemon
+ * cannot answer (older server, concurrent checkout, diff errors).
+ */
+class EdenScm final : public SCM {
+ public:
+  EdenScm(
+      std::unique_ptr<SCM> inner,
+      std::shared_ptr<apache::thrift::RequestChannel> thriftChannel,
+      std::string mountPoint)
+      : SCM{inner->getRootPath(), inner->getSCMRoot()},
+        inner_{std::move(inner)},
+        thriftChannel_{std::move(thriftChannel)},
+        mountPoint_{std::move(mountPoint)} {}
+
+  w_string mergeBaseWith(
+      w_string_piece commitId,
+      const std::optional<w_string>& requestId) const override {
+    // Computing a mergebase needs the commit graph, which EdenFS does
+    // not expose; this continues to go through hg and its cache layer.
+    return inner_->mergeBaseWith(commitId, requestId);
+  }
+
+  std::vector<w_string> getFilesChangedSinceMergeBaseWith(
+      w_string_piece commitId,
+      w_string_piece clock,
+      const std::optional<w_string>& requestId) const override {
+    try {
+      return getFilesChangedViaThrift(commitId);
+    } catch (const std::exception& exc) {
+      log(ERR,
+          "eden: getScmStatus fast path failed: ",
+          exc.what(),
+          "; falling back to hg\n");
+      return inner_->getFilesChangedSinceMergeBaseWith(
+          commitId, clock, requestId);
+    }
+  }
+
+  std::chrono::time_point<std::chrono::system_clock> getCommitDate(
+      w_string_piece commitId,
+      const std::optional<w_string>& requestId) const override {
+    return inner_->getCommitDate(commitId, requestId);
+  }
+
+  std::vector<w_string> getCommitsPriorToAndIncluding(
+      w_string_piece commitId,
+      int numCommits,
+      const std::optional<w_string>& requestId) const override {
+    return inner_->getCommitsPriorToAndIncluding(
+        commitId, numCommits, requestId);
+  }
+
+  void prewarm() const override {
+    inner_->prewarm();
+  }
+
+ private:
+  // EdenFS may return hashes in 20-byte binary form but accepts either
+  // binary or 40-byte hex; normalize to hex for comparisons.
+  static std::string hexHash(const std::string& hash) {
+    return hash.size() == 20 ? folly::hexlify(hash) : hash;
+  }
+
+  std::vector<w_string> getFilesChangedViaThrift(
+      w_string_piece mergeBaseCommit) const {
+    auto client = getEdenClient(thriftChannel_);
+
+    // The journal position carries the current working copy parent
+    // commit.
+    JournalPosition position;
+    client->sync_getCurrentJournalPosition(position, mountPoint_);
+    auto currentCommit = *position.snapshotHash();
+
+    std::unordered_set<w_string> paths;
+    auto collect = [&](const ScmStatus& status) {
+      if (!status.errors()->empty()) {
+        auto& error = *status.errors()->begin();
+        SCMError::throwf(
+            "{} path(s) failed to diff, eg {}: {}",
+            status.errors()->size(),
+            error.first,
+            error.second);
+      }
+      for (auto& [path, fileStatus] : *status.entries()) {
+        if (fileStatus == ScmFileStatus::IGNORED) {
+          continue;
+        }
+        paths.insert(w_string{path.data(), path.size()});
+      }
+    };
+
+    std::string mergeBase{mergeBaseCommit.view()};
+    if (hexHash(mergeBase) != hexHash(currentCommit)) {
+      // Files changed by the commits between the mergebase and the
+      // working copy parent.  Like `hg status --rev`, this cannot report
+      // directories; see the caveats where eval.cpp consumes the result.
+      ScmStatus committed;
+      client->sync_getScmStatusBetweenRevisions(
+          committed, mountPoint_, mergeBase, currentCommit);
+      collect(committed);
+    }
+
+    // Files dirty in the working copy itself.  Untracked (but not
+    // ignored) files are reported as ADDED, matching `hg status`.  The
+    // server rejects the call if `commit` is no longer the working copy
+    // parent, which turns a racing checkout into a clean fallback.
+    GetScmStatusParams params;
+    params.mountPoint() = mountPoint_;
+    params.commit() = currentCommit;
+    params.listIgnored() = false;
+    GetScmStatusResult wdir;
+    client->sync_getScmStatusV2(wdir, params);
+    collect(*wdir.status());
+
+    return std::vector<w_string>{paths.begin(), paths.end()};
+  }
+
+  std::unique_ptr<SCM> inner_;
+  std::shared_ptr<apache::thrift::RequestChannel> thriftChannel_;
+  std::string mountPoint_;
+};
+
 } // namespace
 
 class EdenView final : public QueryableView {
@@ -745,7 +873,14 @@ class EdenView final : public QueryableView {
             "eden_file_count_threshold_for_fresh_instance",
             10000)),
         enableGlobUpperBounds_(
-            config.getBool("eden_enable_glob_upper_bounds", true)) {}
+            config.getBool("eden_enable_glob_upper_bounds", true)) {
+    // Wrap the detected SCM so that scm-aware queries compute their
+    // changed-files sets via thrift instead of forking hg.
+    if (auto inner = exchangeSCM(nullptr)) {
+      exchangeSCM(std::make_unique<EdenScm>(
+          std::move(inner), thriftChannel_, mountPoint_));
+    }
+  }
 
   void timeGenerator(const Query* /*query*/, QueryContext* ctx) const override {
     ctx->generationStarted();
@@ -1089,7 +1224,7 @@ class EdenView final : public QueryableView {
       GetJournalPositionCallback getJournalPositionCallback{
           &subscriberEventBase_, thriftChannel_, mountPoint_};
       // Figure out the correct value for settling
-      std::chrono::milliseconds settleTimeout(root->trigger_settle);
+      std::chrono::milliseconds settleTimeout(root->trigger_settle.load());
 
       subscription = rocketSubscribe(
           root, settleCallback, getJournalPositionCallback, settleTimeout);
@@ -1222,11 +1357,20 @@ class EdenView final : public QueryableView {
     GetAllChangesSinceResult result;
     result.ticks = *resultChangesSince.toPosition()->sequenceNumber();
 
-    // -1 = removed
-    // 0 = changed
-    // 1 = added
-    std::unordered_map<std::string, int> byFile;
-    std::unordered_map<std::string, EdenDtype> dtypes;
+    // The accumulated state of one file across the delta.
+    // count: -1 = removed, 0 = changed, 1 = added
+    struct ChangeInfo {
+      int count = 0;
+      EdenDtype dtype;
+    };
+
+    // The stream is consumed incrementally as chunks arrive from EdenFS,
+    // but streamChangesSince provides no ordering guarantee, so the whole
+    // delta must be accumulated before the per-file outcome is known: a
+    // file that was added and then removed must be reported as MODIFIED.
+    // A single map keyed by name keeps that accumulation to one hash
+    // probe per change.
+    std::unordered_map<std::string, ChangeInfo> byFile;
 
     std::move(stream).subscribeInline(
         [&](folly::Try<ChangedFileResult>&& changeTry) mutable {
@@ -1246,31 +1390,34 @@ class EdenView final : public QueryableView {
 
           const auto& change = changeTry.value();
           auto& name = *change.name();
+          auto dtype = *change.dtype();
+
+          if (*change.status() == ScmFileStatus::IGNORED) {
+            return true;
+          }
+
+          auto [element, inserted] = byFile.emplace(name, ChangeInfo{0, dtype});
+          auto& info = element->second;
 
-          // Changes needs to be deduplicated so a file that was added and then
-          // removed is reported as MODIFIED.
           switch (*change.status()) {
             case ScmFileStatus::ADDED:
-              byFile[name] += 1;
+              info.count += 1;
               break;
             case ScmFileStatus::MODIFIED:
-              byFile[name];
               break;
             case ScmFileStatus::REMOVED:
-              byFile[name] -= 1;
+              info.count -= 1;
               break;
             case ScmFileStatus::IGNORED:
               break;
           }
 
-          auto dtype = *change.dtype();
-          auto [element, inserted] = dtypes.emplace(name, dtype);
-          if (!inserted && element->second != dtype) {
+          if (!inserted && info.dtype != dtype) {
             // Due to streamChangesSince not providing any ordering guarantee,
             // Watchman can't tell what DType a file has in the case where it
             // changed. Thus let's fallback to an UNKNOWN type, and Watchman
             // will later query the actual DType from EdenFS.
-            element->second = EdenDtype::UNKNOWN;
+            info.dtype = EdenDtype::UNKNOWN;
           }
 
           // Engineers usually don't work on a thousands of files, but on an
@@ -1292,11 +1439,16 @@ class EdenView final : public QueryableView {
           return true;
         });
 
-    for (auto& [name, count] : byFile) {
-      result.fileInfo.emplace_back(name, getDTypeFromEden(dtypes[name]));
-      if (count > 0) {
-        result.createdFileNames.emplace(name);
+    // Drain by extracting nodes so the name strings move into the result
+    // rather than being copied; on a big rebase this delta can be huge.
+    result.fileInfo.reserve(byFile.size());
+    while (!byFile.empty()) {
+      auto node = byFile.extract(byFile.begin());
+      if (node.mapped().count > 0) {
+        result.createdFileNames.emplace(node.key());
       }
+      result.fileInfo.emplace_back(
+          std::move(node.key()), getDTypeFromEden(node.mapped().dtype));
     }
 
     return result;
@@ -119,6 +119,42 @@ struct FSEventsLogEntry {
 };
 static_assert(64 == sizeof(FSEventsLogEntry));
 
+FSEventsWatcher::Items::Items(size_t ringSize)
+    : slots(std::max<size_t>(ringSize, 2)) {}
+
+void FSEventsWatcher::Items::pushBatch(std::vector<watchman_fsevent>&& batch) {
+  if (count == slots.size()) {
+    // The ring is saturated: the consumer has fallen this many whole
+    // callbacks behind. Fold the payload into the newest slot rather
+    // than dropping events; the accounting makes the condition visible
+    // before fseventsd itself starts dropping and forces a recrawl.
+    auto& newest = slots[(head + count - 1) % slots.size()];
+    newest.insert(
+        newest.end(),
+        std::make_move_iterator(batch.begin()),
+        std::make_move_iterator(batch.end()));
+    ++saturationCount;
+    return;
+  }
+  slots[(head + count) % slots.size()] = std::move(batch);
+  ++count;
+  highWater = std::max(highWater, count);
+}
+
+std::vector<std::vector<watchman_fsevent>>
+FSEventsWatcher::Items::drainBatches() {
+  std::vector<std::vector<watchman_fsevent>> batches;
+  batches.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto& slot = slots[(head + i) % slots.size()];
+    batches.push_back(std::move(slot));
+    slot.clear();
+  }
+  head = (head + count) % slots.size();
+  count = 0;
+  return batches;
+}
+
 std::shared_ptr<FSEventsWatcher> watcherFromRoot(
     const std::shared_ptr<Root>& root) {
   auto view = std::dynamic_pointer_cast<watchman::InMemoryView>(root->view());
@@ -279,7 +315,7 @@ propagate:
       len--;
     }
 
-    if (root->ignore.isIgnored(path, len)) {
+    if (watcher->ignoreMemo_.isIgnored(root->ignore, path, len)) {
       continue;
     }
 
@@ -291,7 +327,7 @@ propagate:
 
   if (!items.empty()) {
     auto wlock = watcher->items_.lock();
-    wlock->items.push_back(std::move(items));
+    wlock->pushBatch(std::move(items));
     watcher->fseCond_.notify_one();
   }
 }
@@ -416,7 +452,7 @@ std::unique_ptr<FSEventsStream> FSEventsWatcher::fse_stream_make(
       fse_stream->stream, CFRunLoopGetCurrent(), kCFRunLoopDefaultMode);
 
   if (root->config.getBool("_use_fsevents_exclusions", true)) {
-    auto& dirs_vec = root->ignore.getIgnoredDirs();
+    auto dirs_vec = root->ignore.getIgnoredDirs();
 
     size_t nitems = std::min(dirs_vec.size(), kMaxExclusions);
     size_t appended = 0;
@@ -533,12 +569,22 @@ FSEventsWatcher::FSEventsWatcher(
     : Watcher(
           hasFileWatching ? "fsevents" : "dirfsevents",
           hasFileWatching ? WATCHER_HAS_PER_FILE_NOTIFICATIONS : 0),
+      items_{folly::in_place, size_t(config.getInt("fsevents_ring_size", 1024))},
       attemptResyncOnDrop_{config.getBool("fsevents_try_resync", false)},
       hasFileWatching_{hasFileWatching},
       enableStreamFlush_{config.getBool("fsevents_enable_stream_flush", true)},
       subdir{std::move(dir)} {
-  // TODO: Add ring buffer logging for events in the shared kqueue+fsevents
-  // logger.
+  // Each instance carries its own log ring.  In the sharded
+  // kqueue+fsevents configuration one FSEventsWatcher exists per
+  // top-level directory, so this gives every stream an independent ring
+  // and keeps a storm in one shard from evicting the history of the
+  // others.
+  json_int_t fsevents_ring_log_size =
+      config.getInt("fsevents_ring_log_size", 0);
+  if (fsevents_ring_log_size) {
+    ringBuffer_ =
+        std::make_unique<RingBuffer<FSEventsLogEntry>>(fsevents_ring_log_size);
+  }
 }
 
 FSEventsWatcher::FSEventsWatcher(
@@ -548,14 +594,7 @@ FSEventsWatcher::FSEventsWatcher(
     : FSEventsWatcher(
           config.getBool("fsevents_watch_files", true),
           config,
-          dir) {
-  json_int_t fsevents_ring_log_size =
-      config.getInt("fsevents_ring_log_size", 0);
-  if (fsevents_ring_log_size) {
-    ringBuffer_ =
-        std::make_unique<RingBuffer<FSEventsLogEntry>>(fsevents_ring_log_size);
-  }
-}
+          dir) {}
 
 FSEventsWatcher::~FSEventsWatcher() = default;
 
@@ -647,7 +686,7 @@ folly::SemiFuture<folly::Unit> FSEventsWatcher::flushPendingEvents() {
   // Now return a Future that is fulfilled when all of the items have been
   // processed by InMemoryView.
   auto wlock = items_.lock();
-  wlock->syncs.push_back(std::move(p));
+  wlock->syncs.push_back(PendingSync{std::move(p)});
   fseCond_.notify_one();
   return std::move(f);
 }
@@ -656,12 +695,12 @@ bool FSEventsWatcher::waitNotify(int timeoutms) {
   auto wlock = items_.lock();
   // First check to see if someone added elements to these lists while the lock
   // wasn't held.
-  if (!wlock->items.empty() || !wlock->syncs.empty()) {
+  if (wlock->hasBatches() || !wlock->syncs.empty()) {
     // Yes, let's not wait on the condition.
     return true;
   }
   fseCond_.wait_for(wlock.as_lock(), std::chrono::milliseconds(timeoutms));
-  return !wlock->items.empty() || !wlock->syncs.empty();
+  return wlock->hasBatches() || !wlock->syncs.empty();
 }
 
 namespace {
@@ -681,16 +720,17 @@ Watcher::ConsumeNotifyRet FSEventsWatcher::consumeNotify(
     PendingChanges& coll) {
   char flags_label[128];
   std::vector<std::vector<watchman_fsevent>> items;
-  std::vector<folly::Promise<folly::Unit>> syncs;
+  std::vector<PendingSync> syncs;
   bool cancelSelf = false;
 
   {
     auto wlock = items_.lock();
-    std::swap(items, wlock->items);
+    items = wlock->drainBatches();
     std::swap(syncs, wlock->syncs);
   }
 
   auto now = std::chrono::system_clock::now();
+  std::vector<PendingChange> batch;
 
   for (auto& vec : items) {
     for (auto& item : vec) {
@@ -706,8 +746,17 @@ Watcher::ConsumeNotifyRet FSEventsWatcher::consumeNotify(
           (kFSEventStreamEventFlagUserDropped |
            kFSEventStreamEventFlagKernelDropped)) {
         if (!subdir) {
-          root->scheduleRecrawl(flags_label);
-          break;
+          if ((item.flags & kFSEventStreamEventFlagMustScanSubDirs) &&
+              item.path.size() > root->root_path.size()) {
+            // The drop names the subtree whose events were lost, so the
+            // RECURSIVE|DESYNCED flags applied below scope the re-stat
+            // to it and clocks elsewhere in the tree are preserved.
+            auto reason = fmt::format("{}: {}", item.path, flags_label);
+            root->recrawlTriggered(reason.c_str());
+          } else {
+            root->scheduleRecrawl(flags_label);
+            break;
+          }
         } else {
           w_assert(
               item.flags & kFSEventStreamEventFlagMustScanSubDirs,
@@ -770,7 +819,23 @@ Watcher::ConsumeNotifyRet FSEventsWatcher::consumeNotify(
         flags.set(W_PENDING_IS_DESYNCED);
       }
 
-      coll.add(item.path, now, flags);
+      if (hasFileWatching_ &&
+          (item.flags & kFSEventStreamEventFlagItemRemoved) &&
+          !(item.flags &
+            (kFSEventStreamEventFlagItemCreated |
+             kFSEventStreamEventFlagItemRenamed |
+             kFSEventStreamEventFlagMustScanSubDirs |
+             kFSEventStreamEventFlagUserDropped |
+             kFSEventStreamEventFlagKernelDropped))) {
+        // FSEvents coalesces the flags for a path without preserving
+        // their order, so ItemRemoved is only trustworthy when no flag
+        // suggesting a recreation or rename accompanies it.  In that
+        // case statPath can apply the deletion without a confirming
+        // lstat.
+        flags.set(W_PENDING_KNOWN_REMOVED);
+      }
+
+      batch.push_back(PendingChange{item.path, now, flags});
 
       if (hasFileWatching_ && item.path.size() > root->root_path.size() &&
           (item.flags &
@@ -789,11 +854,14 @@ Watcher::ConsumeNotifyRet FSEventsWatcher::consumeNotify(
         // Watchman does not guarantee minimal notifications, but limiting
         // the event types above should avoid unnecessary results in
         // queries.
-        coll.add(item.path.dirName(), now, W_PENDING_VIA_NOTIFY);
+        batch.push_back(
+            PendingChange{item.path.dirName(), now, W_PENDING_VIA_NOTIFY});
       }
     }
   }
 
+  coll.addBatch(std::move(batch));
+
   for (auto& sync : syncs) {
     coll.addSync(std::move(sync));
   }
@@ -820,9 +888,20 @@ json_ref FSEventsWatcher::getDebugInfo() {
     }
     events = json_array(std::move(elements));
   }
+  json_ref pendingRing = json_null();
+  {
+    auto wlock = items_.lock();
+    pendingRing = json_object({
+        {"capacity", json_integer(wlock->slots.size())},
+        {"depth", json_integer(wlock->count)},
+        {"high_water", json_integer(wlock->highWater)},
+        {"saturation_count", json_integer(wlock->saturationCount)},
+    });
+  }
   return json_object({
       {"events", events},
       {"total_event_count", json_integer(totalEventsSeen_.load())},
+      {"pending_ring", pendingRing},
   });
 }
 
@@ -834,6 +913,9 @@ void FSEventsWatcher::clearDebugInfo() {
   if (ringBuffer_) {
     ringBuffer_->clear();
   }
+  auto wlock = items_.lock();
+  wlock->highWater = wlock->count;
+  wlock->saturationCount = 0;
 }
 
 static RegisterWatcher<FSEventsWatcher> reg("fsevents");
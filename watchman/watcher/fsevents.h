@@ -8,6 +8,7 @@
 #pragma once
 
 #include <optional>
+#include "watchman/IgnoreSet.h"
 #include "watchman/RingBuffer.h"
 #include "watchman/fs/Pipe.h"
 #include "watchman/watcher/Watcher.h"
@@ -84,12 +85,40 @@ class FSEventsWatcher : public Watcher {
 
   std::condition_variable fseCond_;
   struct Items {
-    // Unflattened queue of pending events. The fse_callback function will push
-    // exactly one vector to the end of this one, flattening the vector would
-    // require extra copying and allocations.
-    std::vector<std::vector<watchman_fsevent>> items;
-    // Sync requests to be inserted into PendingCollection.
-    std::vector<folly::Promise<folly::Unit>> syncs;
+    explicit Items(size_t ringSize);
+
+    /**
+     * Bounded ring of pending event batches, oldest first, sized by the
+     * `fsevents_ring_size` config key. Each fse_callback invocation
+     * contributes exactly one batch, so the producer pays for a single
+     * lock acquisition per callback no matter how many events the
+     * payload carries. When the ring is full, further batches are
+     * folded into the newest slot rather than dropped; the saturation
+     * counter records every time that happens.
+     */
+    void pushBatch(std::vector<watchman_fsevent>&& batch);
+
+    /** Removes and returns all queued batches, oldest first. */
+    std::vector<std::vector<watchman_fsevent>> drainBatches();
+
+    bool hasBatches() const {
+      return count != 0;
+    }
+
+    std::vector<std::vector<watchman_fsevent>> slots;
+    size_t head{0};
+    size_t count{0};
+
+    // Backpressure accounting, surfaced via getDebugInfo so that ring
+    // saturation is visible before a storm escalates into dropped
+    // events and a forced recrawl.
+    size_t highWater{0};
+    uint64_t saturationCount{0};
+
+    // Sync requests to be inserted into PendingCollection.  Stamped
+    // as PendingSync at the point the requesting thread asked for the
+    // flush so trace attribution survives the hand-off.
+    std::vector<PendingSync> syncs;
   };
   folly::Synchronized<Items, std::mutex> items_;
 
@@ -101,6 +130,12 @@ class FSEventsWatcher : public Watcher {
 
   // Incremented in fse_callback
   std::atomic<size_t> totalEventsSeen_{0};
+  /**
+   * Caches the last ignored directory so clustered bursts of ignored
+   * events are discarded with a prefix compare.  Only touched from
+   * fse_callback on the run loop thread.
+   */
+  IgnoreMemo ignoreMemo_;
   /**
    * If not null, holds a fixed-size ring of the last `fsevents_ring_log_size`
    * FSEvents events.
@@ -7,11 +7,16 @@
 
 #include <folly/String.h>
 #include <folly/Synchronized.h>
+#include <algorithm>
 #include <atomic>
+#include <thread>
+#include <vector>
 #include "watchman/Constants.h"
 #include "watchman/Errors.h"
 #include "watchman/FlagMap.h"
+#include "watchman/IgnoreSet.h"
 #include "watchman/InMemoryView.h"
+#include "watchman/Logging.h"
 #include "watchman/Poison.h"
 #include "watchman/RingBuffer.h"
 #include "watchman/fs/FSDetect.h"
@@ -40,6 +45,10 @@ using namespace watchman;
 
 namespace {
 
+// Upper bound on `inotify_shards`; each shard costs an inotify instance,
+// a reader thread and a read buffer.
+constexpr json_int_t kMaxInotifyShards = 64;
+
 const struct flag_map inflags[] = {
     {IN_ACCESS, "IN_ACCESS"},
     {IN_MODIFY, "IN_MODIFY"},
@@ -122,8 +131,35 @@ static_assert(64 == sizeof(InotifyLogEntry));
 } // namespace
 
 struct InotifyWatcher : public Watcher {
-  /* we use one inotify instance per watched root dir */
-  FileDescriptor infd;
+  /**
+   * One inotify instance. The kernel serializes event delivery per
+   * instance, so with `inotify_shards` > 1 we spread watched dirs over
+   * several instances (selected by a hash of the dir path) and read each
+   * from its own thread; event ingestion then scales with cores instead
+   * of being capped by a single queue and reader.
+   */
+  struct Shard {
+    FileDescriptor infd;
+
+    /* map of active watch descriptor to name of the corresponding dir.
+     * Keyed per shard because watch descriptors are only unique within
+     * their own inotify instance. */
+    folly::Synchronized<std::unordered_map<int, w_string>> wdToName;
+
+    // Make the buffer big enough for 16k entries, which
+    // happens to be the default fs.inotify.max_queued_events
+    char ibuf
+        [WATCHMAN_BATCH_LIMIT *
+         (sizeof(struct inotify_event) + (NAME_MAX + 1))];
+
+    /* Caches the last ignored directory so clustered bursts of events
+     * under it (e.g. an unwatched .git entry changing repeatedly) are
+     * discarded with a prefix compare.  Only touched by the single
+     * thread consuming this shard. */
+    IgnoreMemo ignoreMemo;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
   Pipe terminatePipe_;
 
   /**
@@ -137,22 +173,62 @@ struct InotifyWatcher : public Watcher {
    */
   std::atomic<uint64_t> totalEventsSeen_ = 0;
 
-  struct maps {
-    /* map of active watch descriptor to name of the corresponding dir */
-    std::unordered_map<int, w_string> wd_to_name;
-    /* map of inotify cookie to corresponding name */
-    std::unordered_map<uint32_t, pending_move> move_map;
+  /* map of inotify cookie to corresponding name. Shared between shards
+   * so that the two halves of a rename still pair up when the source and
+   * destination parent dirs hash to different instances. */
+  folly::Synchronized<std::unordered_map<uint32_t, pending_move>> moveMap_;
+
+  /**
+   * A directory IN_MOVED_FROM whose deletion pending is being held back
+   * for a short window (`inotify_rename_pair_window_ms`) in case the
+   * matching IN_MOVED_TO arrives -- possibly in a later read batch.  If
+   * it does, the pair is applied as one in-memory rename and the held
+   * delete is never enqueued; otherwise the hold expires via
+   * ageOutMoveMap and the delete goes out with W_PENDING_KNOWN_REMOVED
+   * stripped (events for the path may have been delivered in the
+   * meantime, so the deletion must be re-confirmed by lstat).
+   */
+  struct HeldMove {
+    std::chrono::system_clock::time_point created;
+    PendingChange change;
   };
+  folly::Synchronized<std::unordered_map<uint32_t, HeldMove>> heldMoves_;
+
+  /* Paired directory renames waiting for the IO thread to claim the
+   * source path, keyed by destination; see takeRenameSource().  Entries
+   * the IO thread never claims (eg: lost to an overflow recrawl) are
+   * aged out alongside the move map. */
+  folly::Synchronized<std::unordered_map<w_string, pending_move>>
+      renameDests_;
+
+  /* How long to hold a directory MOVED_FROM waiting for its MOVED_TO;
+   * zero disables rename pairing entirely. */
+  std::chrono::milliseconds renamePairWindow_{0};
 
-  folly::Synchronized<maps> maps;
+  /**
+   * Events processed by the per-shard reader threads, waiting for the
+   * notify thread to splice them into its collection. Only used when
+   * more than one shard is configured; with a single shard the notify
+   * thread reads the instance directly, as it always has.
+   */
+  PendingCollection sharedPending_;
+  std::atomic<bool> cancelSelf_{false};
 
-  // Make the buffer big enough for 16k entries, which
-  // happens to be the default fs.inotify.max_queued_events
-  char ibuf
-      [WATCHMAN_BATCH_LIMIT * (sizeof(struct inotify_event) + (NAME_MAX + 1))];
+  /**
+   * Sync barrier promises waiting for the notify thread to drain the
+   * kernel queue; see syncBarrier(). Only used when barrier sync is
+   * enabled, which requires a single shard.
+   */
+  folly::Synchronized<std::vector<folly::Promise<folly::Unit>>, std::mutex>
+      pendingBarriers_;
+  // Wakes the notify thread when a barrier is requested.
+  Pipe barrierPipe_;
+  bool barrierSyncEnabled_{false};
 
   explicit InotifyWatcher(const Configuration& config);
 
+  bool start(const std::shared_ptr<Root>& root) override;
+
   std::unique_ptr<DirHandle> startWatchDir(
       const std::shared_ptr<Root>& root,
       const char* path) override;
@@ -163,15 +239,71 @@ struct InotifyWatcher : public Watcher {
 
   bool waitNotify(int timeoutms) override;
 
-  // Process a single inotify event and add it to the pending collection if
-  // needed. Returns true if the root directory was removed and the watch needs
-  // to be cancelled.
+  folly::SemiFuture<folly::Unit> syncBarrier() override;
+
+  /** Returns the shard responsible for watching the given dir. */
+  Shard& shardFor(const w_string& name) {
+    if (shards_.size() == 1) {
+      return *shards_[0];
+    }
+    return *shards_[name.piece().hashValue() % shards_.size()];
+  }
+
+  /** Returns true if the shard's descriptor has unread events. */
+  static bool shardReadable(Shard& shard) {
+    struct pollfd pfd;
+    pfd.fd = shard.infd.fd();
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+  }
+
+  // Read one batch of events from the shard's inotify descriptor and
+  // process them into `coll`.
+  Watcher::ConsumeNotifyRet consumeShard(
+      const std::shared_ptr<Root>& root,
+      Shard& shard,
+      PendingChanges& coll);
+
+  // Blocking read loop for one shard; used when sharding is enabled.
+  void readerThread(const std::shared_ptr<Root>& root, Shard& shard);
+
+  // Process a single inotify event, recording any resulting pending
+  // changes in `batch`. Returns true if the root directory was removed and
+  // the watch needs to be cancelled.
   bool process_inotify_event(
       const std::shared_ptr<Root>& root,
-      PendingChanges& coll,
+      std::vector<PendingChange>& batch,
+      Shard& shard,
       struct inotify_event* ine,
       std::chrono::system_clock::time_point now);
 
+  // Expire pending_move entries whose other half never arrived, release
+  // held MOVED_FROM deletes whose pairing window has lapsed into `coll`,
+  // and drop unclaimed rename pairings.
+  void ageOutMoveMap(
+      std::chrono::system_clock::time_point now,
+      PendingChanges& coll);
+
+  // The move-map half of ageOutMoveMap.
+  void ageOutMoveMapEntries(std::chrono::system_clock::time_point now);
+
+  // Rewrites the wd -> name mappings for `from` and everything beneath
+  // it to live under `to`.  The kernel keeps watch descriptors attached
+  // to their inodes across a rename, so the watches themselves survive;
+  // only our names go stale.
+  void renameWatchedDirs(const w_string& from, const w_string& to);
+
+  // Bounds a poll timeout by the earliest held-move deadline so that an
+  // expired hold is released promptly even when the watch goes quiet.
+  int boundTimeoutForHeldMoves(
+      int timeoutms,
+      std::chrono::system_clock::time_point now);
+
+  // True if a held move's pairing window has lapsed.
+  bool hasExpiredHeldMoves(std::chrono::system_clock::time_point now);
+
+  std::optional<w_string> takeRenameSource(const w_string& dest) override;
+
   void stopThreads() override;
 
   json_ref getDebugInfo() override;
@@ -179,22 +311,52 @@ struct InotifyWatcher : public Watcher {
 };
 
 InotifyWatcher::InotifyWatcher(const Configuration& config)
-    : Watcher("inotify", WATCHER_HAS_PER_FILE_NOTIFICATIONS) {
+    : Watcher(
+          "inotify",
+          // The kernel delivers events in the order they occurred and
+          // reports queue loss explicitly via IN_Q_OVERFLOW.  Cleared
+          // below when sharding splits that single queue.
+          WATCHER_HAS_PER_FILE_NOTIFICATIONS | WATCHER_PRECISELY_ORDERED) {
+  auto nShards = size_t(std::clamp<json_int_t>(
+      config.getInt("inotify_shards", 1), 1, kMaxInotifyShards));
+
+  if (nShards > 1) {
+    // Events for different directories land in different kernel queues
+    // and reader batches, so there is no longer a single causal order
+    // to vouch for.  Keeping the flag would let the notify thread's
+    // cookie fast path complete a sync while pre-cookie events still
+    // sit in another shard's queue.
+    flags &= ~unsigned(WATCHER_PRECISELY_ORDERED);
+  }
+  auto dirHint =
+      size_t(config.getInt(CFG_HINT_NUM_DIRS, HINT_NUM_DIRS)) / nShards;
+
+  shards_.reserve(nShards);
+  for (size_t i = 0; i < nShards; ++i) {
+    auto shard = std::make_unique<Shard>();
 #ifdef HAVE_INOTIFY_INIT1
-  infd = FileDescriptor(
-      inotify_init1(IN_CLOEXEC), FileDescriptor::FDType::Generic);
+    shard->infd = FileDescriptor(
+        inotify_init1(IN_CLOEXEC), FileDescriptor::FDType::Generic);
 #else
-  infd = FileDescriptor(inotify_init(), FileDescriptor::FDType::Generic);
+    shard->infd =
+        FileDescriptor(inotify_init(), FileDescriptor::FDType::Generic);
 #endif
-  if (infd.fd() == -1) {
-    throw std::system_error(errno, inotify_category(), "inotify_init");
+    if (shard->infd.fd() == -1) {
+      throw std::system_error(errno, inotify_category(), "inotify_init");
+    }
+    shard->infd.setCloExec();
+    shard->wdToName.wlock()->reserve(dirHint);
+    shards_.push_back(std::move(shard));
   }
-  infd.setCloExec();
 
-  {
-    auto wlock = maps.wlock();
-    wlock->wd_to_name.reserve(config.getInt(CFG_HINT_NUM_DIRS, HINT_NUM_DIRS));
-  }
+  renamePairWindow_ = std::chrono::milliseconds(std::max<json_int_t>(
+      config.getInt("inotify_rename_pair_window_ms", 1000), 0));
+
+  // Cookie-less sync relies on draining a single kernel queue to a
+  // known position; with multiple shards there is no such single
+  // position, so the barrier stays disabled and cookies are used.
+  barrierSyncEnabled_ =
+      nShards == 1 && config.getBool("inotify_barrier_sync", false);
 
   json_int_t inotify_ring_log_size = config.getInt("inotify_ring_log_size", 0);
   if (inotify_ring_log_size) {
@@ -203,6 +365,87 @@ InotifyWatcher::InotifyWatcher(const Configuration& config)
   }
 }
 
+bool InotifyWatcher::start(const std::shared_ptr<Root>& root) {
+  if (shards_.size() == 1) {
+    // The notify thread reads the sole instance directly.
+    return true;
+  }
+
+  auto self = std::static_pointer_cast<InotifyWatcher>(shared_from_this());
+  for (auto& shard : shards_) {
+    auto* shardPtr = shard.get();
+    std::thread thread([self, root, shardPtr]() {
+      try {
+        self->readerThread(root, *shardPtr);
+      } catch (const std::exception& e) {
+        log(ERR, "uncaught exception in inotify reader: ", e.what(), "\n");
+        root->cancel();
+      }
+    });
+    // Detached for the same reason as the fsevents thread: a reader may
+    // be the last thing holding the watcher alive and cannot join
+    // itself.
+    thread.detach();
+  }
+  return true;
+}
+
+void InotifyWatcher::readerThread(
+    const std::shared_ptr<Root>& root,
+    Shard& shard) {
+  w_set_thread_name("inotify ", root->root_path.view());
+
+  PendingChanges local;
+  while (true) {
+    struct pollfd pfd[2];
+    pfd[0].fd = shard.infd.fd();
+    pfd[0].events = POLLIN;
+    pfd[1].fd = terminatePipe_.read.fd();
+    pfd[1].events = POLLIN;
+
+    // Bounded rather than infinite so a held MOVED_FROM whose other
+    // half never arrives is still released on schedule.
+    int n = poll(
+        pfd,
+        std::size(pfd),
+        boundTimeoutForHeldMoves(-1, std::chrono::system_clock::now()));
+    if (n < 0) {
+      continue;
+    }
+    if (n == 0) {
+      ageOutMoveMap(std::chrono::system_clock::now(), local);
+      if (!local.empty()) {
+        auto lock = sharedPending_.lock();
+        lock->appendRaw(local.stealItems(), local.stealSyncs());
+        lock->ping();
+      }
+      continue;
+    }
+    if (pfd[1].revents) {
+      // We were signalled via stopThreads
+      break;
+    }
+    if (!pfd[0].revents) {
+      continue;
+    }
+
+    auto ret = consumeShard(root, shard, local);
+    ageOutMoveMap(std::chrono::system_clock::now(), local);
+
+    if (!local.empty()) {
+      // Hand the batch to the notify thread without doing tree work
+      // while holding the shared lock; dedup runs downstream.
+      auto lock = sharedPending_.lock();
+      lock->appendRaw(local.stealItems(), local.stealSyncs());
+      lock->ping();
+    }
+    if (ret.cancelSelf) {
+      cancelSelf_.store(true, std::memory_order_release);
+      sharedPending_.lock()->ping();
+    }
+  }
+}
+
 std::unique_ptr<DirHandle> InotifyWatcher::startWatchDir(
     const std::shared_ptr<Root>&,
     const char* path) {
@@ -211,20 +454,18 @@ std::unique_ptr<DirHandle> InotifyWatcher::startWatchDir(
   auto osdir = openDir(path);
 
   w_string dir_name(path, W_STRING_BYTE);
+  auto& shard = shardFor(dir_name);
 
   // The directory might be different since the last time we looked at it, so
   // call inotify_add_watch unconditionally.
-  int newwd = inotify_add_watch(infd.fd(), path, WATCHMAN_INOTIFY_MASK);
+  int newwd = inotify_add_watch(shard.infd.fd(), path, WATCHMAN_INOTIFY_MASK);
   if (newwd == -1) {
     int err = errno;
     throw std::system_error(err, inotify_category(), "inotify_add_watch");
   }
 
   // record mapping
-  {
-    auto wlock = maps.wlock();
-    wlock->wd_to_name[newwd] = dir_name;
-  }
+  (*shard.wdToName.wlock())[newwd] = dir_name;
   logf(DBG, "adding {} -> {} mapping\n", newwd, path);
 
   return osdir;
@@ -232,7 +473,8 @@ std::unique_ptr<DirHandle> InotifyWatcher::startWatchDir(
 
 bool InotifyWatcher::process_inotify_event(
     const std::shared_ptr<Root>& root,
-    PendingChanges& coll,
+    std::vector<PendingChange>& batch,
+    Shard& shard,
     struct inotify_event* ine,
     std::chrono::system_clock::time_point now) {
   char flags_label[128];
@@ -260,9 +502,9 @@ bool InotifyWatcher::process_inotify_event(
     std::optional<w_string> dir_name;
 
     {
-      auto rlock = maps.rlock();
-      auto it = rlock->wd_to_name.find(ine->wd);
-      if (it != rlock->wd_to_name.end()) {
+      auto rlock = shard.wdToName.rlock();
+      auto it = rlock->find(ine->wd);
+      if (it != rlock->end()) {
         dir_name = it->second;
       }
     }
@@ -288,22 +530,22 @@ bool InotifyWatcher::process_inotify_event(
             (IN_MOVED_FROM | IN_ISDIR)) {
       // record this as a pending move, so that we can automatically
       // watch the target when we get the other side of it.
-      {
-        auto wlock = maps.wlock();
-        wlock->move_map.emplace(ine->cookie, pending_move(now, name));
-      }
+      moveMap_.wlock()->emplace(ine->cookie, pending_move(now, name));
 
       log(DBG, "recording move_from ", ine->cookie, " ", name, "\n");
     }
 
     if (ine->len > 0 &&
-        (ine->mask & (IN_MOVED_TO | IN_ISDIR)) == (IN_MOVED_FROM | IN_ISDIR)) {
-      auto wlock = maps.wlock();
-      auto it = wlock->move_map.find(ine->cookie);
-      if (it != wlock->move_map.end()) {
+        (ine->mask & (IN_MOVED_TO | IN_ISDIR)) == (IN_MOVED_TO | IN_ISDIR)) {
+      auto wlock = moveMap_.wlock();
+      auto it = wlock->find(ine->cookie);
+      if (it != wlock->end()) {
         auto& old = it->second;
-        int wd =
-            inotify_add_watch(infd.fd(), name.c_str(), WATCHMAN_INOTIFY_MASK);
+        // The destination dir may hash to a different shard than the
+        // one this event arrived on.
+        auto& target = shardFor(name);
+        int wd = inotify_add_watch(
+            target.infd.fd(), name.c_str(), WATCHMAN_INOTIFY_MASK);
         if (wd == -1) {
           if (errno == ENOSPC || errno == ENOMEM) {
             // Limits exceeded, no recovery from our perspective
@@ -323,8 +565,45 @@ bool InotifyWatcher::process_inotify_event(
           }
         } else {
           logf(DBG, "moved {} -> {}\n", old.name.c_str(), name.c_str());
-          // TODO: assert that there is no entry in wd_to_name
-          wlock->wd_to_name[wd] = name;
+          // TODO: assert that there is no entry in wdToName
+          (*target.wdToName.wlock())[wd] = name;
+        }
+
+        if (renamePairWindow_.count() > 0) {
+          if (!shard.ignoreMemo.isIgnored(
+                  root->ignore, name.data(), name.size())) {
+            // If the matching delete is still held, the two halves form
+            // a complete in-tree directory rename: drop the held
+            // delete, remember the source keyed by destination, fix up
+            // the watch descriptor names, and flag this pending so the
+            // IO thread grafts the subtree in memory instead of
+            // re-statting every file beneath it.
+            auto held = heldMoves_.wlock();
+            auto hit = held->find(ine->cookie);
+            if (hit != held->end()) {
+              held->erase(hit);
+              held.unlock();
+              renameDests_.wlock()->insert_or_assign(
+                  name, pending_move(now, old.name));
+              renameWatchedDirs(old.name, name);
+              pending_flags.set(W_PENDING_RENAMED);
+              logf(DBG, "paired rename {} -> {}\n", old.name, name);
+            }
+          } else {
+            // The destination is ignored, so the IO thread will never
+            // process it; release the held source delete so the old
+            // subtree still drops out of the view.
+            auto held = heldMoves_.wlock();
+            auto hit = held->find(ine->cookie);
+            if (hit != held->end()) {
+              // Events for the source path may have been enqueued while
+              // the delete was held, so it no longer sorts before them;
+              // force a confirming lstat.
+              hit->second.change.flags.clear(W_PENDING_KNOWN_REMOVED);
+              batch.push_back(std::move(hit->second.change));
+              held->erase(hit);
+            }
+          }
         }
       } else {
         logf(
@@ -356,18 +635,58 @@ bool InotifyWatcher::process_inotify_event(
         pending_flags.set(W_PENDING_RECURSIVE);
       }
 
-      logf(
-          DBG,
-          "add_pending for inotify mask={:x} {}\n",
-          ine->mask,
-          name.c_str());
-      coll.add(name, now, pending_flags);
+      if (ine->len > 0 && (ine->mask & (IN_DELETE | IN_MOVED_FROM)) &&
+          !(ine->mask &
+            (IN_UNMOUNT | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))) {
+        // The kernel told us this directory entry is gone, so statPath
+        // can apply the deletion without a confirming lstat.
+        pending_flags.set(W_PENDING_KNOWN_REMOVED);
+      }
 
-      if (ine->mask & (IN_CREATE | IN_DELETE)) {
-        // When a directory's child is created or unlinked, inotify does not
-        // tell us its parent has also changed. It should be rescanned, so
-        // synthesize an event for the IO thread here.
-        coll.add(name.dirName(), now, W_PENDING_VIA_NOTIFY);
+      if (ine->len > 0 && (ine->mask & IN_ATTRIB) &&
+          !(ine->mask &
+            (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+             IN_MOVED_FROM | IN_MOVED_TO | IN_ISDIR | IN_UNMOUNT | IN_IGNORED |
+             IN_DELETE_SELF | IN_MOVE_SELF))) {
+        // The kernel attributes this event purely to metadata
+        // (chmod/chown/utimensat); the file's bytes are untouched, so
+        // statPath can preserve the content fingerprint and cached
+        // content hashes stay valid across touch storms.
+        pending_flags.set(W_PENDING_ATTRIB_ONLY);
+      }
+
+      if (shard.ignoreMemo.isIgnored(root->ignore, name.data(), name.size())) {
+        // We never watch ignored dirs, but the watch on their parent
+        // still reports the entries themselves (a repository's .git dir
+        // changes on every ref update, for instance).  Drop those here
+        // so they never cross into the pending tree and wake the IO
+        // thread.  The fsevents and win32 notify paths do the same.
+        logf(DBG, "ignoring inotify event for {}\n", name.c_str());
+      } else {
+        logf(
+            DBG,
+            "add_pending for inotify mask={:x} {}\n",
+            ine->mask,
+            name.c_str());
+        if (renamePairWindow_.count() > 0 && ine->len > 0 &&
+            (ine->mask & (IN_MOVED_FROM | IN_ISDIR)) ==
+                (IN_MOVED_FROM | IN_ISDIR)) {
+          // Hold a directory's move-away delete back for the pairing
+          // window; see heldMoves_.
+          heldMoves_.wlock()->insert_or_assign(
+              ine->cookie,
+              HeldMove{now, PendingChange{name, now, pending_flags}});
+        } else {
+          batch.push_back(PendingChange{name, now, pending_flags});
+        }
+
+        if (ine->mask & (IN_CREATE | IN_DELETE)) {
+          // When a directory's child is created or unlinked, inotify does
+          // not tell us its parent has also changed. It should be
+          // rescanned, so synthesize an event for the IO thread here.
+          batch.push_back(
+              PendingChange{name.dirName(), now, W_PENDING_VIA_NOTIFY});
+        }
       }
 
       // The kernel removed the wd -> name mapping, so let's update
@@ -379,8 +698,7 @@ bool InotifyWatcher::process_inotify_event(
             ine->mask,
             ine->wd,
             dir_name.value());
-        auto wlock = maps.wlock();
-        wlock->wd_to_name.erase(ine->wd);
+        shard.wdToName.wlock()->erase(ine->wd);
       }
 
     } else if ((ine->mask & (IN_MOVE_SELF | IN_IGNORED)) == 0) {
@@ -399,10 +717,11 @@ bool InotifyWatcher::process_inotify_event(
   return false;
 }
 
-Watcher::ConsumeNotifyRet InotifyWatcher::consumeNotify(
+Watcher::ConsumeNotifyRet InotifyWatcher::consumeShard(
     const std::shared_ptr<Root>& root,
+    Shard& shard,
     PendingChanges& coll) {
-  int n = read(infd.fd(), &ibuf, sizeof(ibuf));
+  int n = read(shard.infd.fd(), &shard.ibuf, sizeof(shard.ibuf));
   if (n == -1) {
     if (errno == EINTR) {
       return {false};
@@ -410,8 +729,8 @@ Watcher::ConsumeNotifyRet InotifyWatcher::consumeNotify(
     logf(
         FATAL,
         "read({}, {}): error {}\n",
-        infd.fd(),
-        sizeof(ibuf),
+        shard.infd.fd(),
+        sizeof(shard.ibuf),
         folly::errnoStr(errno));
   }
 
@@ -421,66 +740,276 @@ Watcher::ConsumeNotifyRet InotifyWatcher::consumeNotify(
   struct inotify_event* ine;
   bool cancel = false;
   size_t eventsSeen = 0;
-  for (char* iptr = ibuf; iptr < ibuf + n; iptr += sizeof(*ine) + ine->len) {
+  std::vector<PendingChange> batch;
+  for (char* iptr = shard.ibuf; iptr < shard.ibuf + n;
+       iptr += sizeof(*ine) + ine->len) {
     ine = (struct inotify_event*)iptr;
 
-    cancel |= process_inotify_event(root, coll, ine, now);
+    cancel |= process_inotify_event(root, batch, shard, ine, now);
     ++eventsSeen;
   }
+  coll.addBatch(std::move(batch));
 
   // Relaxed because we don't really care exactly when the value is visible.
   totalEventsSeen_.fetch_add(eventsSeen, std::memory_order_relaxed);
 
+  return {cancel};
+}
+
+void InotifyWatcher::renameWatchedDirs(
+    const w_string& from,
+    const w_string& to) {
+  auto isUnder = [&](const w_string& name) {
+    return name.size() > from.size() && name.data()[from.size()] == '/' &&
+        name.piece().startsWith(from);
+  };
+  for (auto& shard : shards_) {
+    auto wlock = shard->wdToName.wlock();
+    for (auto& [wd, dirname] : *wlock) {
+      if (dirname == from) {
+        dirname = to;
+      } else if (isUnder(dirname)) {
+        dirname = w_string::build(
+            to,
+            w_string_piece{
+                dirname.data() + from.size(), dirname.size() - from.size()});
+      }
+    }
+  }
+}
+
+std::optional<w_string> InotifyWatcher::takeRenameSource(const w_string& dest) {
+  auto wlock = renameDests_.wlock();
+  auto it = wlock->find(dest);
+  if (it == wlock->end()) {
+    return std::nullopt;
+  }
+  auto source = it->second.name;
+  wlock->erase(it);
+  return source;
+}
+
+int InotifyWatcher::boundTimeoutForHeldMoves(
+    int timeoutms,
+    std::chrono::system_clock::time_point now) {
+  auto held = heldMoves_.rlock();
+  if (held->empty()) {
+    return timeoutms;
+  }
+  auto earliest = now;
+  for (auto& entry : *held) {
+    earliest = std::min(earliest, entry.second.created);
+  }
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      earliest + renamePairWindow_ - now);
+  auto bound = int(std::max<std::chrono::milliseconds::rep>(
+      remaining.count(), 0));
+  return timeoutms < 0 ? bound : std::min(timeoutms, bound);
+}
+
+bool InotifyWatcher::hasExpiredHeldMoves(
+    std::chrono::system_clock::time_point now) {
+  auto held = heldMoves_.rlock();
+  for (auto& entry : *held) {
+    if (now - entry.second.created >= renamePairWindow_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void InotifyWatcher::ageOutMoveMap(
+    std::chrono::system_clock::time_point now,
+    PendingChanges& coll) {
+  if (renamePairWindow_.count() > 0) {
+    // Release held deletes whose matching MOVED_TO never arrived (the
+    // directory moved outside the watched tree).  The hold reordered
+    // the delete relative to any events delivered meanwhile, so
+    // KNOWN_REMOVED is stripped and the deletion re-confirmed by lstat.
+    auto held = heldMoves_.wlock();
+    auto it = held->begin();
+    while (it != held->end()) {
+      if (now - it->second.created >= renamePairWindow_) {
+        auto& change = it->second.change;
+        logf(
+            DBG,
+            "releasing held move {} (moved outside of watch?)\n",
+            change.path);
+        change.flags.clear(W_PENDING_KNOWN_REMOVED);
+        coll.add(change.path, change.now, change.flags);
+        it = held->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  {
+    // Pairings the IO thread never claimed (eg: the destination pending
+    // was swallowed by an overflow recrawl) are dropped on the same
+    // grace period as the move map.
+    auto wlock = renameDests_.wlock();
+    auto it = wlock->begin();
+    while (it != wlock->end()) {
+      if (now - it->second.created > std::chrono::seconds{5}) {
+        it = wlock->erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  ageOutMoveMapEntries(now);
+}
+
+void InotifyWatcher::ageOutMoveMapEntries(
+    std::chrono::system_clock::time_point now) {
   // It is possible that we can accumulate a set of pending_move
-  // structs in move_map.  This happens when a directory is moved
+  // structs in the move map.  This happens when a directory is moved
   // outside of the watched tree; we get the MOVE_FROM but never
   // get the MOVE_TO with the same cookie.  To avoid leaking these,
-  // we'll age out the move_map after processing a full set of
+  // we'll age out the move map after processing a full set of
   // inotify events.   We age out rather than delete all because
   // the MOVE_TO may yet be waiting to read in another go around.
   // We allow a somewhat arbitrary but practical grace period to
   // observe the corresponding MOVE_TO.
+  auto wlock = moveMap_.wlock();
+  auto it = wlock->begin();
+  while (it != wlock->end()) {
+    auto& pending = it->second;
+    if (now - pending.created > std::chrono::seconds{5}) {
+      logf(
+          DBG,
+          "deleting pending move {} (moved outside of watch?)\n",
+          pending.name);
+      it = wlock->erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+Watcher::ConsumeNotifyRet InotifyWatcher::consumeNotify(
+    const std::shared_ptr<Root>& root,
+    PendingChanges& coll) {
+  if (shards_.size() > 1) {
+    // The reader threads have already processed the raw events; just
+    // splice their output over.
+    auto lock = sharedPending_.lock();
+    coll.appendRaw(lock->stealItems(), lock->stealSyncs());
+    return {cancelSelf_.load(std::memory_order_acquire)};
+  }
+
+  auto& shard = *shards_[0];
+  Watcher::ConsumeNotifyRet ret{false};
+
+  if (!barrierSyncEnabled_) {
+    // waitNotify may have woken us purely to release an expired held
+    // move, so only issue the (blocking) read when the descriptor is
+    // actually readable.
+    if (shardReadable(shard)) {
+      ret = consumeShard(root, shard, coll);
+    }
+    ageOutMoveMap(std::chrono::system_clock::now(), coll);
+    return ret;
+  }
+
+  // With barrier sync enabled, waitNotify may have woken us for a
+  // barrier request with no events queued, so only issue the (blocking)
+  // read when the descriptor is actually readable.
+  if (shardReadable(shard)) {
+    ret = consumeShard(root, shard, coll);
+  }
+  ageOutMoveMap(std::chrono::system_clock::now(), coll);
+
   {
-    auto wlock = maps.wlock();
-    auto it = wlock->move_map.begin();
-    while (it != wlock->move_map.end()) {
-      auto& pending = it->second;
-      if (now - pending.created > std::chrono::seconds{5}) {
-        logf(
-            DBG,
-            "deleting pending move {} (moved outside of watch?)\n",
-            pending.name);
-        it = wlock->move_map.erase(it);
-      } else {
-        ++it;
+    auto lock = pendingBarriers_.lock();
+    if (!lock->empty() && !shardReadable(shard)) {
+      // Every event queued before the barrier request has now been
+      // read, so the promises can be ordered into the pending stream
+      // behind those events; the IO thread completes them once the
+      // events have been processed. If the queue still has data, the
+      // notify thread's drain loop will call us again and we retry.
+      for (auto& barrier : *lock) {
+        coll.addSync(std::move(barrier));
       }
+      lock->clear();
     }
   }
-
-  return {cancel};
+  return ret;
 }
 
 bool InotifyWatcher::waitNotify(int timeoutms) {
-  struct pollfd pfd[2];
-  pfd[0].fd = infd.fd();
+  if (shards_.size() > 1) {
+    // The reader threads block on the inotify descriptors; we only wait
+    // for one of them to hand over a batch (or for cancellation).
+    auto lock =
+        sharedPending_.lockAndWait(std::chrono::milliseconds(timeoutms));
+    return !lock->empty() || cancelSelf_.load(std::memory_order_acquire);
+  }
+
+  struct pollfd pfd[3];
+  pfd[0].fd = shards_[0]->infd.fd();
   pfd[0].events = POLLIN;
   pfd[1].fd = terminatePipe_.read.fd();
   pfd[1].events = POLLIN;
+  size_t nfds = 2;
+  if (barrierSyncEnabled_) {
+    pfd[nfds].fd = barrierPipe_.read.fd();
+    pfd[nfds].events = POLLIN;
+    ++nfds;
+  }
 
-  int n = poll(pfd, std::size(pfd), timeoutms);
+  // Bound the wait by the earliest held-move deadline so an expired
+  // hold is flushed by consumeNotify without waiting for more events.
+  int n = poll(
+      pfd,
+      nfds,
+      boundTimeoutForHeldMoves(timeoutms, std::chrono::system_clock::now()));
 
   if (n > 0) {
     if (pfd[1].revents) {
       // We were signalled via signalThreads
       return false;
     }
+    if (nfds > 2 && pfd[2].revents) {
+      // A sync barrier was requested; drain the wakeup bytes (the
+      // promises themselves live in pendingBarriers_) and let
+      // consumeNotify service them.
+      char buf[64];
+      ignore_result(read(barrierPipe_.read.fd(), buf, sizeof(buf)));
+      return true;
+    }
     return pfd[0].revents != 0;
   }
-  return false;
+  return hasExpiredHeldMoves(std::chrono::system_clock::now());
+}
+
+folly::SemiFuture<folly::Unit> InotifyWatcher::syncBarrier() {
+  if (!barrierSyncEnabled_) {
+    return folly::SemiFuture<folly::Unit>::makeEmpty();
+  }
+
+  // inotify queues events synchronously with the mutating syscall, so
+  // everything that happened before this call is already in the kernel
+  // queue. Draining the queue and then slotting a promise into the
+  // pending stream is therefore equivalent to syncing on a monotonic
+  // event position, with no cookie file round trips.
+  auto [p, f] = folly::makePromiseContract<folly::Unit>();
+  pendingBarriers_.lock()->push_back(std::move(p));
+  // Wake the notify thread so the barrier is serviced even if no
+  // further filesystem events arrive.
+  ignore_result(write(barrierPipe_.write.fd(), "B", 1));
+  return std::move(f);
 }
 
 void InotifyWatcher::stopThreads() {
   ignore_result(write(terminatePipe_.write.fd(), "X", 1));
+  if (shards_.size() > 1) {
+    // Wake the notify thread too in case it is waiting on the shared
+    // collection rather than the pipe.
+    sharedPending_.lock()->ping();
+  }
 }
 
 json_ref InotifyWatcher::getDebugInfo() {
@@ -492,9 +1021,17 @@ json_ref InotifyWatcher::getDebugInfo() {
     }
     events = json_array(std::move(arr));
   }
+  std::vector<json_ref> shardInfo;
+  shardInfo.reserve(shards_.size());
+  for (auto& shard : shards_) {
+    shardInfo.push_back(json_object({
+        {"watch_count", json_integer(shard->wdToName.rlock()->size())},
+    }));
+  }
   return json_object({
       {"events", events},
       {"total_event_count", json_integer(totalEventsSeen_.load())},
+      {"shards", json_array(std::move(shardInfo))},
   });
 }
 
@@ -8,7 +8,9 @@
 #include "kqueue.h"
 #include <folly/String.h>
 #include <folly/Synchronized.h>
+#include <algorithm>
 #include <array>
+#include <vector>
 #include "watchman/FlagMap.h"
 #include "watchman/InMemoryView.h"
 #include "watchman/fs/FileDescriptor.h"
@@ -44,6 +46,21 @@ void* make_udata(bool is_dir) {
   }
 }
 
+// Drops a watch entry from both maps, keeping the file watch count in
+// step.  Caller holds the write lock; closing the FileDescriptor held
+// in name_to_fd also removes the kqueue registration for that fd.
+void eraseWatchEntry(KQueueWatcher::maps& state, int fd) {
+  auto it = state.fd_to_name.find(fd);
+  if (it == state.fd_to_name.end()) {
+    return;
+  }
+  if (!it->second.isDir && state.fileWatchCount > 0) {
+    --state.fileWatchCount;
+  }
+  state.name_to_fd.erase(it->second.name);
+  state.fd_to_name.erase(it);
+}
+
 } // namespace
 
 static const struct flag_map kflags[] = {
@@ -61,9 +78,10 @@ KQueueWatcher::KQueueWatcher(
     const w_string& /*root_path*/,
     const Configuration& config,
     bool recursive)
-    : Watcher("kqueue", 0),
+    : Watcher("kqueue", WATCHER_NEEDS_PER_FILE_WATCHES),
       maps_(maps(config.getInt(CFG_HINT_NUM_DIRS, HINT_NUM_DIRS))),
-      recursive_(recursive) {
+      recursive_(recursive),
+      fileFdBudget_(config.getInt("kqueue_file_fd_budget", 0)) {
   kq_fd = FileDescriptor(kqueue(), "kqueue", FileDescriptor::FDType::Generic);
   kq_fd.setCloExec();
 }
@@ -125,35 +143,134 @@ bool KQueueWatcher::startWatchFile(struct watchman_file* file) {
       &k,
       rawFd,
       EVFILT_VNODE,
-      EV_ADD | EV_CLEAR,
+      EV_ADD | EV_CLEAR | EV_RECEIPT,
       NOTE_WRITE | NOTE_DELETE | NOTE_EXTEND | NOTE_RENAME | NOTE_ATTRIB,
       0,
       make_udata(isDir));
 
+  if (fileFdBudget_ > 0 && !isDir) {
+    bool overBudget;
+    {
+      auto rlock = maps_.rlock();
+      overBudget = rlock->fileWatchCount >= size_t(fileFdBudget_);
+    }
+    if (overBudget) {
+      // Flush first: a queued EV_ADD must never outlive a recycled
+      // descriptor number that a later open() could reuse.
+      flushPendingRegistrations();
+      auto wlock = maps_.wlock();
+      maybeRecycleFileWatches(*wlock);
+    }
+  }
+
+  bool flushNow;
   {
     auto wlock = maps_.wlock();
     wlock->name_to_fd[full_name] = std::move(fdHolder);
-    wlock->fd_to_name[rawFd] = full_name;
+    wlock->fd_to_name[rawFd] =
+        FdRecord{full_name, isDir, ++wlock->activityTick};
+    if (!isDir) {
+      ++wlock->fileWatchCount;
+    }
+    // Registration is batched: crawling a large root used to pay one
+    // kevent() round-trip per file.  The entry is submitted once the
+    // changelist fills, and always before the watcher sleeps.
+    wlock->pendingRegistrations.push_back(k);
+    flushNow = wlock->pendingRegistrations.size() >= WATCHMAN_BATCH_LIMIT;
+  }
+  if (flushNow) {
+    flushPendingRegistrations();
   }
 
-  if (kevent(kq_fd.fd(), &k, 1, nullptr, 0, 0)) {
+  return true;
+}
+
+void KQueueWatcher::flushPendingRegistrations() {
+  std::vector<struct kevent> changes;
+  {
+    auto wlock = maps_.wlock();
+    if (wlock->pendingRegistrations.empty()) {
+      return;
+    }
+    changes = std::move(wlock->pendingRegistrations);
+    wlock->pendingRegistrations.clear();
+  }
+
+  // Every change carries EV_RECEIPT, so the kernel reports per-entry
+  // status through the event list without draining any queued
+  // notifications.
+  std::vector<struct kevent> receipts(changes.size());
+  int n = kevent(
+      kq_fd.fd(),
+      changes.data(),
+      changes.size(),
+      receipts.data(),
+      receipts.size(),
+      0);
+  if (n < 0) {
     watchman::log(
-        watchman::DBG,
-        "kevent EV_ADD file ",
-        full_name,
-        " failed: ",
-        full_name.c_str(),
+        watchman::ERR,
+        "kevent batch EV_ADD of ",
+        changes.size(),
+        " entries failed: ",
         folly::errnoStr(errno),
         "\n");
     auto wlock = maps_.wlock();
-    wlock->name_to_fd.erase(full_name);
-    wlock->fd_to_name.erase(rawFd);
-  } else {
-    watchman::log(
-        watchman::DBG, "kevent file ", full_name, " -> ", rawFd, "\n");
+    for (auto& change : changes) {
+      eraseWatchEntry(*wlock, int(change.ident));
+    }
+    return;
   }
 
-  return true;
+  for (int i = 0; i < n; i++) {
+    auto& receipt = receipts[i];
+    if ((receipt.flags & EV_ERROR) && receipt.data != 0) {
+      watchman::log(
+          watchman::DBG,
+          "kevent EV_ADD fd ",
+          int(receipt.ident),
+          " failed: ",
+          folly::errnoStr(int(receipt.data)),
+          "\n");
+      auto wlock = maps_.wlock();
+      eraseWatchEntry(*wlock, int(receipt.ident));
+    }
+  }
+}
+
+void KQueueWatcher::maybeRecycleFileWatches(maps& state) {
+  if (fileFdBudget_ <= 0 || state.fileWatchCount < size_t(fileFdBudget_)) {
+    return;
+  }
+
+  // Evict a slice of the budget at a time so the cold scan amortizes
+  // over many registrations rather than running per file.
+  size_t target = std::max<size_t>(1, size_t(fileFdBudget_) / 16);
+
+  std::vector<std::pair<uint64_t, int>> candidates;
+  candidates.reserve(state.fileWatchCount);
+  for (auto& [fd, record] : state.fd_to_name) {
+    if (!record.isDir) {
+      candidates.emplace_back(record.lastActivity, fd);
+    }
+  }
+  target = std::min(target, candidates.size());
+  std::partial_sort(
+      candidates.begin(), candidates.begin() + target, candidates.end());
+
+  // A recycled file is re-opened and re-registered the next time the
+  // view stats it (its directory changing, a fresh crawl or a recrawl);
+  // a write landing while it is unwatched is observed then rather than
+  // immediately.  That latency on cold files is the price of the fd
+  // budget, which is why the budget is off by default.
+  for (size_t i = 0; i < target; i++) {
+    logf(
+        DBG,
+        "recycling cold kqueue watch fd={} {}\n",
+        candidates[i].second,
+        state.fd_to_name[candidates[i].second].name);
+    eraseWatchEntry(state, candidates[i].second);
+  }
 }
 
 std::unique_ptr<DirHandle> KQueueWatcher::startWatchDir(
@@ -175,7 +292,7 @@ std::unique_ptr<DirHandle> KQueueWatcher::startWatchDir(
   }
   if (fstat(rawFd, &st) == -1 || fstat(osdir->getFd(), &osdirst) == -1) {
     // whaaa?
-    root->scheduleRecrawl("fstat failed");
+    root->scheduleSubtreeRecrawl(w_string{path}, "fstat failed");
     throw std::system_error(
         errno,
         std::generic_category(),
@@ -207,15 +324,15 @@ std::unique_ptr<DirHandle> KQueueWatcher::startWatchDir(
   {
     auto wlock = maps_.wlock();
     wlock->name_to_fd[dir_name] = std::move(fdHolder);
-    wlock->fd_to_name[rawFd] = dir_name;
+    wlock->fd_to_name[rawFd] =
+        FdRecord{dir_name, true, ++wlock->activityTick};
   }
 
   if (kevent(kq_fd.fd(), &k, 1, nullptr, 0, 0)) {
     logf(DBG, "kevent EV_ADD dir {} failed: {}", path, folly::errnoStr(errno));
 
     auto wlock = maps_.wlock();
-    wlock->name_to_fd.erase(dir_name);
-    wlock->fd_to_name.erase(rawFd);
+    eraseWatchEntry(*wlock, rawFd);
   } else {
     watchman::log(watchman::DBG, "kevent dir ", dir_name, " -> ", rawFd, "\n");
   }
@@ -228,6 +345,8 @@ Watcher::ConsumeNotifyRet KQueueWatcher::consumeNotify(
     PendingChanges& coll) {
   struct timespec ts = {0, 0};
 
+  flushPendingRegistrations();
+
   errno = 0;
   int n = kevent(
       kq_fd.fd(),
@@ -247,6 +366,7 @@ Watcher::ConsumeNotifyRet KQueueWatcher::consumeNotify(
   }
 
   auto now = std::chrono::system_clock::now();
+  std::vector<PendingChange> batch;
   for (int i = 0; n > 0 && i < n; i++) {
     uint32_t fflags = keventbuf[i].fflags;
     bool is_dir = is_udata_dir(keventbuf[i].udata);
@@ -267,7 +387,8 @@ Watcher::ConsumeNotifyRet KQueueWatcher::consumeNotify(
           flags_label);
       continue;
     }
-    w_string path = it->second;
+    w_string path = it->second.name;
+    it->second.lastActivity = ++wlock->activityTick;
 
     logf(DBG, " KQ fd={} path {} [{:x} {}]\n", fd, path, fflags, flags_label);
     if ((fflags & (NOTE_DELETE | NOTE_RENAME | NOTE_REVOKE))) {
@@ -286,8 +407,7 @@ Watcher::ConsumeNotifyRet KQueueWatcher::consumeNotify(
       memset(&k, 0, sizeof(k));
       EV_SET(&k, fd, EVFILT_VNODE, EV_DELETE, 0, 0, nullptr);
       kevent(kq_fd.fd(), &k, 1, nullptr, 0, 0);
-      wlock->name_to_fd.erase(path);
-      wlock->fd_to_name.erase(fd);
+      eraseWatchEntry(*wlock, fd);
     }
 
     PendingFlags flags = W_PENDING_VIA_NOTIFY;
@@ -304,13 +424,18 @@ Watcher::ConsumeNotifyRet KQueueWatcher::consumeNotify(
       // W_PENDING_NONRECURSIVE_SCAN here still allows cookies to be
       // discovered...
     }
-    coll.add(path, now, flags);
+    batch.push_back(PendingChange{std::move(path), now, flags});
   }
+  coll.addBatch(std::move(batch));
 
   return {false};
 }
 
 bool KQueueWatcher::waitNotify(int timeoutms) {
+  // Arm anything still buffered before sleeping; an un-armed watch
+  // cannot wake us.
+  flushPendingRegistrations();
+
   std::array<struct pollfd, 2> pfd;
 
   pfd[0].fd = kq_fd.fd();
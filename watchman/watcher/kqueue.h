@@ -20,10 +20,26 @@ struct KQueueWatcher : public Watcher {
   FileDescriptor kq_fd;
   Pipe terminatePipe_;
 
+  struct FdRecord {
+    w_string name;
+    bool isDir;
+    // Monotonic activity stamp (registration or last received event);
+    // used to pick the coldest file watches when over the fd budget.
+    uint64_t lastActivity;
+  };
+
   struct maps {
     std::unordered_map<w_string, FileDescriptor> name_to_fd;
-    /* map of active watch descriptor to name of the corresponding item */
-    std::unordered_map<int, w_string> fd_to_name;
+    /* map of active watch descriptor to the corresponding item */
+    std::unordered_map<int, FdRecord> fd_to_name;
+    // EV_ADD entries accumulated by startWatchFile() and submitted as
+    // one changelist; registering one kevent per file would cost a
+    // syscall round-trip per file during crawl.
+    std::vector<struct kevent> pendingRegistrations;
+    // Number of non-directory entries in fd_to_name.
+    size_t fileWatchCount{0};
+    // Source for FdRecord::lastActivity.
+    uint64_t activityTick{0};
 
     explicit maps(json_int_t sizeHint) {
       name_to_fd.reserve(sizeHint);
@@ -33,6 +49,11 @@ struct KQueueWatcher : public Watcher {
   folly::Synchronized<maps> maps_;
   bool recursive_;
 
+  // When > 0, the maximum number of per-file watch descriptors to keep
+  // open; the coldest file watches are recycled to stay under it.  0
+  // (the default) keeps every file watched.  See kqueue_file_fd_budget.
+  json_int_t fileFdBudget_{0};
+
   struct kevent keventbuf[WATCHMAN_BATCH_LIMIT];
 
   explicit KQueueWatcher(
@@ -52,6 +73,18 @@ struct KQueueWatcher : public Watcher {
 
   bool waitNotify(int timeoutms) override;
   void stopThreads() override;
+
+ private:
+  // Submits any buffered EV_ADD entries in a single kevent() call and
+  // unwinds the mappings of entries the kernel rejected.  Must run
+  // before the watcher sleeps so no registration is left un-armed.
+  void flushPendingRegistrations();
+
+  // When the file watch count is at or over budget, closes the coldest
+  // file descriptors (closing an fd removes its kqueue registration).
+  // Caller must have flushed pending registrations first so no queued
+  // EV_ADD can reference a recycled descriptor number.
+  void maybeRecycleFileWatches(maps& state);
 };
 
 } // namespace watchman
@@ -105,6 +105,9 @@ class KQueueAndFSEventsWatcher : public Watcher {
   bool waitNotify(int timeoutms) override;
   void stopThreads() override;
 
+  json_ref getDebugInfo() override;
+  void clearDebugInfo() override;
+
   /**
    * Force a recrawl to be injected in the stream. Used in the
    * 'debug-kqueue-and-fsevents-recrawl' command.
@@ -125,7 +128,9 @@ class KQueueAndFSEventsWatcher : public Watcher {
 KQueueAndFSEventsWatcher::KQueueAndFSEventsWatcher(
     const w_string& root_path,
     const Configuration& config)
-    : Watcher("kqueue+fsevents", WATCHER_HAS_SPLIT_WATCH),
+    : Watcher(
+          "kqueue+fsevents",
+          WATCHER_HAS_SPLIT_WATCH | WATCHER_NEEDS_PER_FILE_WATCHES),
       kqueueWatcher_(std::make_shared<KQueueWatcher>(root_path, config, false)),
       pendingCondition_(std::make_shared<PendingEventsCond>()) {}
 
@@ -286,6 +291,30 @@ void KQueueAndFSEventsWatcher::stopThreads() {
   kqueueWatcher_->stopThreads();
 }
 
+json_ref KQueueAndFSEventsWatcher::getDebugInfo() {
+  // Each top-level directory has its own FSEventsWatcher with a
+  // dedicated stream, pending ring and log ring; report them keyed by
+  // directory so saturation on one stream is attributable to the shard
+  // it covers.
+  std::unordered_map<w_string, json_ref> shards;
+  {
+    auto fseventWatches = fseventWatchers_.rlock();
+    for (auto& [watchpath, fsevent] : *fseventWatches) {
+      shards.emplace(watchpath, fsevent->getDebugInfo());
+    }
+  }
+  return json_object({
+      {"shards", json_object(std::move(shards))},
+  });
+}
+
+void KQueueAndFSEventsWatcher::clearDebugInfo() {
+  auto fseventWatches = fseventWatchers_.rlock();
+  for (auto& [_, fsevent] : *fseventWatches) {
+    fsevent->clearDebugInfo();
+  }
+}
+
 void KQueueAndFSEventsWatcher::injectRecrawl(w_string path) {
   *injectedRecrawl_.wlock() = path;
   pendingCondition_->notifyOneOrStop();
@@ -91,7 +91,7 @@ static std::unique_ptr<watchman_port_file> make_port_file(
 }
 
 PortFSWatcher::PortFSWatcher(watchman_root* root)
-    : Watcher("portfs", 0),
+    : Watcher("portfs", WATCHER_NEEDS_PER_FILE_WATCHES),
       port_fd(port_create(), "port_create()"),
       port_delete_fd(port_create(), "port_create()"),
       root_deleted(false) {
@@ -195,7 +195,7 @@ std::unique_ptr<DirHandle> PortFSWatcher::startWatchDir(
       root->cancel();
     } else {
       // whaaa?
-      root->scheduleRecrawl("fstat failed");
+      root->scheduleSubtreeRecrawl(fullPath, "fstat failed");
     }
     throw std::system_error(
         errno,
@@ -6,6 +6,7 @@
  */
 
 #include <folly/Synchronized.h>
+#include "watchman/IgnoreSet.h"
 #include "watchman/InMemoryView.h"
 #include "watchman/fs/FileDescriptor.h"
 #include "watchman/portability/WinError.h"
@@ -14,16 +15,23 @@
 #include "watchman/watcher/WatcherRegistry.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <iterator>
 #include <list>
 #include <mutex>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 using namespace watchman;
 
 #ifdef _WIN32
 
+struct WinWatcher;
+
 namespace {
 
 constexpr DWORD kNetworkBufSize = 64 * 1024;
@@ -36,18 +44,94 @@ struct Item {
       : path(std::move(path)), flags(flags) {}
 };
 
+/**
+ * Pool of ReadDirectoryChangesW result buffers.  Each watched root keeps
+ * exactly one buffer outstanding for the life of the watch and returns
+ * it here on teardown so that the next watch reuses the allocation
+ * instead of growing a fresh one.
+ */
+class RdcwBufferPool {
+ public:
+  static RdcwBufferPool& instance();
+
+  std::vector<uint8_t> acquire(size_t size) {
+    std::vector<uint8_t> buf;
+    {
+      auto pool = pool_.lock();
+      if (!pool->empty()) {
+        buf = std::move(pool->back());
+        pool->pop_back();
+      }
+    }
+    buf.resize(size);
+    return buf;
+  }
+
+  void release(std::vector<uint8_t>&& buf) {
+    if (buf.capacity() == 0) {
+      return;
+    }
+    auto pool = pool_.lock();
+    if (pool->size() < kMaxPooled) {
+      pool->push_back(std::move(buf));
+    }
+  }
+
+ private:
+  static constexpr size_t kMaxPooled = 8;
+  folly::Synchronized<std::vector<std::vector<uint8_t>>, std::mutex> pool_;
+};
+
+RdcwBufferPool& RdcwBufferPool::instance() {
+  static RdcwBufferPool pool;
+  return pool;
+}
+
+/**
+ * A single process-wide IO completion port with a small worker pool that
+ * services the directory-change reads for every watched root.  We used
+ * to run one blocking reader thread per root, which bloated the thread
+ * count and left change buffers backlogged behind descheduled threads on
+ * busy hosts.
+ *
+ * The registry holds a strong reference to each watcher while it is
+ * associated with the port; the terminal completion (cancellation or
+ * unrecoverable error) drops it, mirroring the way the old per-root
+ * thread owned a reference to the watcher for its lifetime.
+ */
+class WinIoCompletionPool {
+ public:
+  static WinIoCompletionPool& instance();
+
+  // Associate the directory handle with the port and begin dispatching
+  // its completions to watcher->onDirChanges().
+  bool associate(HANDLE h, std::shared_ptr<WinWatcher> watcher);
+
+  // Drop the registry reference for this watcher.  Called from the
+  // worker once the final completion has drained, so no further packets
+  // for this key can be in flight.
+  void forget(WinWatcher* watcher);
+
+ private:
+  WinIoCompletionPool();
+  void workerThread() noexcept;
+
+  HANDLE iocp_;
+  folly::Synchronized<
+      std::unordered_map<ULONG_PTR, std::shared_ptr<WinWatcher>>,
+      std::mutex>
+      watchers_;
+};
+
 } // namespace
 
 struct WinWatcher : public Watcher {
-  HANDLE ping{INVALID_HANDLE_VALUE};
-  HANDLE olapEvent{INVALID_HANDLE_VALUE};
   FileDescriptor dir_handle;
 
   std::condition_variable cond;
   folly::Synchronized<std::list<Item>, std::mutex> changedItems;
 
   explicit WinWatcher(const w_string& root_path, const Configuration& config);
-  ~WinWatcher();
 
   std::unique_ptr<DirHandle> startWatchDir(
       const std::shared_ptr<Root>& root,
@@ -60,11 +144,129 @@ struct WinWatcher : public Watcher {
   bool waitNotify(int timeoutms) override;
   bool start(const std::shared_ptr<Root>& root) override;
   void stopThreads() override;
-  void readChangesThread(const std::shared_ptr<Root>& root);
+
+  // Invoked on a WinIoCompletionPool worker whenever our outstanding
+  // ReadDirectoryChangesW completes.
+  void onDirChanges(BOOL ok, DWORD err, DWORD bytes);
+
+ private:
+  // Queue the next overlapped ReadDirectoryChangesW.  Returns false and
+  // sets the win32 last error when the read could not be queued.
+  bool issueRead();
+  // Translate a completed change buffer into Items and publish them.
+  void processNotifyBuffer(const std::shared_ptr<Root>& root);
+  // Release our buffer and drop the completion pool's reference to us.
+  // Must be the last thing a worker does with this watcher.
+  void teardown();
+
+  OVERLAPPED olap_{};
+  std::vector<uint8_t> buf_;
+  DWORD size_;
+  DWORD filter_;
+  // Caches the last ignored directory so clustered bursts of ignored
+  // events are discarded with a prefix compare.  Only one overlapped
+  // read is outstanding at a time, so workers touch this serially.
+  IgnoreMemo ignoreMemo_;
+  // Artificial extra latency to impose around processing changes.
+  // This is needed to avoid trying to access files and dirs too
+  // soon after a change is noticed, as this can cause recursive
+  // deletes to fail.
+  std::chrono::milliseconds extraLatency_;
+  // Updated (under the changedItems lock) each time a batch of items
+  // arrives; waitNotify debounces against it.
+  std::chrono::steady_clock::time_point lastArrival_;
+  std::weak_ptr<Root> root_;
+  std::atomic<bool> stopping_{false};
 };
 
+namespace {
+
+WinIoCompletionPool& WinIoCompletionPool::instance() {
+  static WinIoCompletionPool pool;
+  return pool;
+}
+
+WinIoCompletionPool::WinIoCompletionPool() {
+  iocp_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+  if (!iocp_) {
+    throw std::runtime_error(
+        std::string("failed to create IO completion port: ") +
+        win32_strerror(GetLastError()));
+  }
+  // A pair of workers keeps any number of roots serviced without
+  // devoting a thread to each; per-completion work is just parsing the
+  // notify buffer and re-queueing the read.
+  for (size_t i = 0; i < 2; ++i) {
+    std::thread thr([this]() noexcept { workerThread(); });
+    // The pool lives for the duration of the process
+    thr.detach();
+  }
+}
+
+bool WinIoCompletionPool::associate(
+    HANDLE h,
+    std::shared_ptr<WinWatcher> watcher) {
+  auto key = reinterpret_cast<ULONG_PTR>(watcher.get());
+  if (!CreateIoCompletionPort(h, iocp_, key, 0)) {
+    return false;
+  }
+  watchers_.lock()->emplace(key, std::move(watcher));
+  return true;
+}
+
+void WinIoCompletionPool::forget(WinWatcher* watcher) {
+  std::shared_ptr<WinWatcher> ref;
+  {
+    auto map = watchers_.lock();
+    auto it = map->find(reinterpret_cast<ULONG_PTR>(watcher));
+    if (it != map->end()) {
+      // Arrange to drop the reference outside the lock; it may be the
+      // last one and the destructor shouldn't run with the map locked.
+      ref = std::move(it->second);
+      map->erase(it);
+    }
+  }
+}
+
+void WinIoCompletionPool::workerThread() noexcept {
+  w_set_thread_name("win32iocp");
+
+  while (true) {
+    DWORD bytes = 0;
+    ULONG_PTR key = 0;
+    LPOVERLAPPED olap = nullptr;
+    BOOL ok = GetQueuedCompletionStatus(iocp_, &bytes, &key, &olap, INFINITE);
+    DWORD err = ok ? 0 : GetLastError();
+
+    if (!olap) {
+      // Port-level failure with no packet dequeued; nothing to dispatch
+      continue;
+    }
+
+    std::shared_ptr<WinWatcher> watcher;
+    {
+      auto map = watchers_.lock();
+      auto it = map->find(key);
+      if (it != map->end()) {
+        watcher = it->second;
+      }
+    }
+    if (watcher) {
+      watcher->onDirChanges(ok, err, bytes);
+    }
+  }
+}
+
+} // namespace
+
 WinWatcher::WinWatcher(const w_string& root_path, const Configuration& config)
-    : Watcher("win32", WATCHER_HAS_PER_FILE_NOTIFICATIONS) {
+    : Watcher("win32", WATCHER_HAS_PER_FILE_NOTIFICATIONS),
+      size_(DWORD(config.getInt("win32_rdcw_buf_size", 64 * 1024))),
+      filter_(
+          FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+          FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |
+          FILE_NOTIFY_CHANGE_LAST_WRITE),
+      extraLatency_(config.getInt("win32_batch_latency_ms", 30)) {
   auto wpath = root_path.piece().asWideUNC();
 
   // Create an overlapped handle so that we can avoid blocking forever
@@ -85,286 +287,189 @@ WinWatcher::WinWatcher(const w_string& root_path, const Configuration& config)
         std::string("failed to open dir ") + root_path.c_str() + ": " +
         win32_strerror(GetLastError()));
   }
-
-  ping = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-  if (!ping) {
-    throw std::runtime_error(
-        std::string("failed to create event: ") +
-        win32_strerror(GetLastError()));
-  }
-  olapEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-  if (!olapEvent) {
-    throw std::runtime_error(
-        std::string("failed to create event: ") +
-        win32_strerror(GetLastError()));
-  }
-}
-
-WinWatcher::~WinWatcher() {
-  if (ping != INVALID_HANDLE_VALUE) {
-    CloseHandle(ping);
-  }
-  if (olapEvent != INVALID_HANDLE_VALUE) {
-    CloseHandle(olapEvent);
-  }
 }
 
 void WinWatcher::stopThreads() {
-  SetEvent(ping);
+  stopping_.store(true, std::memory_order_release);
+  // Wake the outstanding read; its aborted completion performs the
+  // teardown on a pool worker.  If no read is outstanding, the worker
+  // currently processing our completion observes stopping_ and tears
+  // down instead.
+  CancelIoEx((HANDLE)dir_handle.handle(), &olap_);
+  cond.notify_all();
 }
 
-void WinWatcher::readChangesThread(const std::shared_ptr<Root>& root) {
-  std::vector<uint8_t> buf;
-  auto olap = OVERLAPPED();
-  BOOL initiate_read = true;
-  HANDLE handles[2] = {olapEvent, ping};
-  DWORD bytes;
-
-  w_set_thread_name("readchange ", root->root_path.view());
-  watchman::log(watchman::DBG, "initializing\n");
+bool WinWatcher::issueRead() {
+  return ReadDirectoryChangesW(
+             (HANDLE)dir_handle.handle(),
+             buf_.data(),
+             size_,
+             TRUE,
+             filter_,
+             nullptr,
+             &olap_,
+             nullptr) != FALSE;
+}
 
-  // Artificial extra latency to impose around processing changes.
-  // This is needed to avoid trying to access files and dirs too
-  // soon after a change is noticed, as this can cause recursive
-  // deletes to fail.
-  auto extraLatency = root->config.getInt("win32_batch_latency_ms", 30);
+void WinWatcher::teardown() {
+  RdcwBufferPool::instance().release(std::move(buf_));
+  cond.notify_all();
+  // May drop the last reference to us; nothing may touch `this` after
+  WinIoCompletionPool::instance().forget(this);
+}
 
-  DWORD size = root->config.getInt("win32_rdcw_buf_size", 16384);
+void WinWatcher::processNotifyBuffer(const std::shared_ptr<Root>& root) {
+  std::list<Item> items;
+  PFILE_NOTIFY_INFORMATION notify = (PFILE_NOTIFY_INFORMATION)buf_.data();
+
+  while (true) {
+    // FileNameLength is in BYTES, but FileName is WCHAR
+    DWORD n_chars = notify->FileNameLength / sizeof(notify->FileName[0]);
+    w_string name(notify->FileName, n_chars);
+
+    auto full = w_string::pathCat({root->root_path, name});
+
+    if (!ignoreMemo_.isIgnored(root->ignore, full.data(), full.size())) {
+      // If we have a delete or rename-away it may be part of
+      // a recursive tree remove or rename.  In that situation
+      // the notifications that we'll receive from the OS will
+      // be from the leaves and bubble up to the root of the
+      // delete/rename.  We want to flag those paths for recursive
+      // analysis so that we can prune children from the trie
+      // that is built when we pass this to the pending list
+      // later.  We don't do that here on the completion worker because
+      // we're trying to minimize latency in this context.
+      items.emplace_back(
+          w_string{full},
+          (notify->Action == FILE_ACTION_REMOVED ||
+           notify->Action == FILE_ACTION_RENAMED_OLD_NAME)
+              ? W_PENDING_RECURSIVE
+              : 0);
+
+      if (!name.empty() &&
+          (notify->Action == FILE_ACTION_ADDED ||
+           notify->Action == FILE_ACTION_REMOVED ||
+           notify->Action == FILE_ACTION_RENAMED_OLD_NAME ||
+           notify->Action == FILE_ACTION_RENAMED_NEW_NAME)) {
+        // ReadDirectoryChangesW provides change events when the child
+        // entry list changes, but may not provide a notification for the
+        // parent when its mtime changes. It should be rescanned, so
+        // synthesize an event for the IO thread here.
+        items.emplace_back(full.dirName(), PendingFlags{});
+      }
+    }
 
-  DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
-      FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SIZE |
-      FILE_NOTIFY_CHANGE_LAST_WRITE;
+    // Advance to next item
+    if (notify->NextEntryOffset == 0) {
+      break;
+    }
+    notify = (PFILE_NOTIFY_INFORMATION)(notify->NextEntryOffset + (char*)notify);
+  }
 
-  // Block until winmatch_root_st is waiting for our initialization
-  {
+  if (!items.empty()) {
     auto wlock = changedItems.lock();
+    wlock->splice(wlock->end(), items);
+    lastArrival_ = std::chrono::steady_clock::now();
+    cond.notify_one();
+  }
+}
 
-    olap.hEvent = olapEvent;
+void WinWatcher::onDirChanges(BOOL ok, DWORD err, DWORD bytes) {
+  auto root = root_.lock();
 
-    buf.resize(size);
+  if (stopping_.load(std::memory_order_acquire) || !root ||
+      root->inner.cancelled || err == ERROR_OPERATION_ABORTED) {
+    teardown();
+    return;
+  }
 
-    if (!ReadDirectoryChangesW(
-            (HANDLE)dir_handle.handle(),
-            &buf[0],
-            size,
-            TRUE,
-            filter,
-            nullptr,
-            &olap,
-            nullptr)) {
-      DWORD err = GetLastError();
+  if (!ok) {
+    logf(
+        ERR,
+        "overlapped ReadDirectoryChangesW({}): {:x} {}\n",
+        root->root_path,
+        err,
+        win32_strerror(err));
+
+    if (err == ERROR_INVALID_PARAMETER && size_ > kNetworkBufSize) {
+      // May be a network buffer related size issue; the docs say that
+      // we can hit this when watching a UNC path. Let's downsize and
+      // retry the read just one time
       logf(
           ERR,
-          "ReadDirectoryChangesW: failed, cancel watch. {}\n",
-          win32_strerror(err));
+          "retrying watch for possible network location {} "
+          "with smaller buffer\n",
+          root->root_path);
+      size_ = kNetworkBufSize;
+      buf_.resize(size_);
+    } else if (err == ERROR_NOTIFY_ENUM_DIR) {
+      root->scheduleRecrawl("ERROR_NOTIFY_ENUM_DIR");
+    } else {
+      logf(ERR, "Cancelling watch for {}\n", root->root_path);
       root->cancel();
+      teardown();
       return;
     }
-    // Signal that we are done with init.  We MUST do this AFTER our first
-    // successful ReadDirectoryChangesW, otherwise there is a race condition
-    // where we'll miss observing the cookie for a query that comes in
-    // after we've crawled but before the watch is established.
-    logf(DBG, "ReadDirectoryChangesW signalling as init done\n");
-    cond.notify_one();
+  } else if (bytes == 0) {
+    // A successful zero-byte completion means the changes overflowed
+    // our buffer; the buffer contents are undefined and everything must
+    // be rescanned.
+    root->scheduleRecrawl("ReadDirectoryChangesW buffer overflow");
+  } else {
+    processNotifyBuffer(root);
   }
-  initiate_read = false;
-
-  std::list<Item> items;
-
-  // The mutex must not be held when we enter the loop
-  while (!root->inner.cancelled) {
-    if (initiate_read) {
-      if (!ReadDirectoryChangesW(
-              (HANDLE)dir_handle.handle(),
-              &buf[0],
-              size,
-              TRUE,
-              filter,
-              nullptr,
-              &olap,
-              nullptr)) {
-        DWORD err = GetLastError();
-        logf(
-            ERR,
-            "ReadDirectoryChangesW: failed, cancel watch. {}\n",
-            win32_strerror(err));
-        root->cancel();
-        break;
-      } else {
-        initiate_read = false;
-      }
-    }
 
-    watchman::log(watchman::DBG, "waiting for change notifications\n");
-    DWORD status = WaitForMultipleObjects(
-        2,
-        handles,
-        FALSE,
-        // We use a 10 second timeout by default until we start accumulating a
-        // batch.  Once we have a batch we prefer to add more to it than notify
-        // immediately, so we introduce a 30ms latency.  Without this artificial
-        // latency we'll wake up and start trying to look at a directory that
-        // may be in the process of being recursively deleted and that act can
-        // block the recursive delete.
-        items.empty() ? 10000 : extraLatency);
-    watchman::log(watchman::DBG, "wait returned with status ", status, "\n");
-
-    if (status == WAIT_OBJECT_0) {
-      bytes = 0;
-      if (!GetOverlappedResult(
-              (HANDLE)dir_handle.handle(), &olap, &bytes, FALSE)) {
-        DWORD err = GetLastError();
-        logf(
-            ERR,
-            "overlapped ReadDirectoryChangesW({}): {:x} {}\n",
-            root->root_path,
-            err,
-            win32_strerror(err));
-
-        if (err == ERROR_INVALID_PARAMETER && size > kNetworkBufSize) {
-          // May be a network buffer related size issue; the docs say that
-          // we can hit this when watching a UNC path. Let's downsize and
-          // retry the read just one time
-          logf(
-              ERR,
-              "retrying watch for possible network location {} "
-              "with smaller buffer\n",
-              root->root_path);
-          size = kNetworkBufSize;
-          initiate_read = true;
-          continue;
-        }
-
-        if (err == ERROR_NOTIFY_ENUM_DIR) {
-          root->scheduleRecrawl("ERROR_NOTIFY_ENUM_DIR");
-        } else {
-          logf(ERR, "Cancelling watch for {}\n", root->root_path);
-          root->cancel();
-          break;
-        }
-      } else {
-        PFILE_NOTIFY_INFORMATION notify = (PFILE_NOTIFY_INFORMATION)buf.data();
-
-        while (true) {
-          // FileNameLength is in BYTES, but FileName is WCHAR
-          DWORD n_chars = notify->FileNameLength / sizeof(notify->FileName[0]);
-          w_string name(notify->FileName, n_chars);
-
-          auto full = w_string::pathCat({root->root_path, name});
-
-          if (!root->ignore.isIgnored(full.data(), full.size())) {
-            // If we have a delete or rename-away it may be part of
-            // a recursive tree remove or rename.  In that situation
-            // the notifications that we'll receive from the OS will
-            // be from the leaves and bubble up to the root of the
-            // delete/rename.  We want to flag those paths for recursive
-            // analysis so that we can prune children from the trie
-            // that is built when we pass this to the pending list
-            // later.  We don't do that here in this thread because
-            // we're trying to minimize latency in this context.
-            items.emplace_back(
-                w_string{full},
-                (notify->Action == FILE_ACTION_REMOVED ||
-                 notify->Action == FILE_ACTION_RENAMED_OLD_NAME)
-                    ? W_PENDING_RECURSIVE
-                    : 0);
-
-            if (!name.empty() &&
-                (notify->Action == FILE_ACTION_ADDED ||
-                 notify->Action == FILE_ACTION_REMOVED ||
-                 notify->Action == FILE_ACTION_RENAMED_OLD_NAME ||
-                 notify->Action == FILE_ACTION_RENAMED_NEW_NAME)) {
-              // ReadDirectoryChangesW provides change events when the child
-              // entry list changes, but may not provide a notification for the
-              // parent when its mtime changes. It should be rescanned, so
-              // synthesize an event for the IO thread here.
-              items.emplace_back(full.dirName(), PendingFlags{});
-            }
-          }
-
-          // Advance to next item
-          if (notify->NextEntryOffset == 0) {
-            break;
-          }
-          notify =
-              (PFILE_NOTIFY_INFORMATION)(notify->NextEntryOffset + (char*)notify);
-        }
-
-        ResetEvent(olapEvent);
-        initiate_read = true;
-      }
-    } else if (status == WAIT_OBJECT_0 + 1) {
-      logf(ERR, "signalled\n");
-      break;
-    } else if (status == WAIT_TIMEOUT) {
-      if (!items.empty()) {
-        watchman::log(
-            watchman::DBG,
-            "timed out waiting for changes, and we have ",
-            items.size(),
-            " items; move and notify\n");
-        auto wlock = changedItems.lock();
-        wlock->splice(wlock->end(), items);
-        cond.notify_one();
-      }
-    } else {
-      logf(ERR, "impossible wait status={}\n", status);
-      break;
-    }
+  if (!issueRead()) {
+    DWORD rerr = GetLastError();
+    logf(
+        ERR,
+        "ReadDirectoryChangesW: failed, cancel watch. {}\n",
+        win32_strerror(rerr));
+    root->cancel();
+    teardown();
+    return;
   }
 
-  logf(DBG, "done\n");
+  if (stopping_.load(std::memory_order_acquire)) {
+    // stopThreads() raced with the re-issue above and its CancelIoEx
+    // may have found no read outstanding; cancel the one we just queued
+    // so the aborted completion tears us down.
+    CancelIoEx((HANDLE)dir_handle.handle(), &olap_);
+  }
 }
 
 bool WinWatcher::start(const std::shared_ptr<Root>& root) {
-  // Spin up the changes reading thread; it owns a ref on the root
-
-  try {
-    // Acquire the mutex so thread initialization waits until we release it
-    auto wlock = changedItems.lock();
-
-    watchman::log(watchman::DBG, "starting readChangesThread\n");
-    auto self = std::dynamic_pointer_cast<WinWatcher>(shared_from_this());
-    std::thread thread([self, root]() noexcept {
-      try {
-        self->readChangesThread(root);
-      } catch (const std::exception& e) {
-        watchman::log(watchman::ERR, "uncaught exception: ", e.what());
-        root->cancel();
-      }
-
-      // Ensure that we signal the condition variable before we
-      // finish this thread.  That ensures that don't get stuck
-      // waiting in WinWatcher::start if something unexpected happens.
-      auto wlock = self->changedItems.lock();
-      self->cond.notify_one();
-    });
-    // We have to detach because the readChangesThread may wind up
-    // being the last thread to reference the watcher state and
-    // cannot join itself.
-    thread.detach();
-
-    // Allow thread init to proceed; wait for its signal
-    if (cond.wait_for(wlock.as_lock(), std::chrono::seconds(10)) ==
-        std::cv_status::timeout) {
-      watchman::log(
-          watchman::ERR, "timedout waiting for readChangesThread to start\n");
-      root->cancel();
-      return false;
-    }
+  root_ = root;
+
+  auto self = std::dynamic_pointer_cast<WinWatcher>(shared_from_this());
+  if (!WinIoCompletionPool::instance().associate(
+          (HANDLE)dir_handle.handle(), self)) {
+    logf(
+        ERR,
+        "failed to associate {} with completion port: {}\n",
+        root->root_path,
+        win32_strerror(GetLastError()));
+    return false;
+  }
 
-    if (root->failure_reason) {
-      logf(
-          ERR,
-          "failed to start readchanges thread: {}\n",
-          *root->failure_reason);
-      return false;
-    }
-    return true;
-  } catch (const std::exception& e) {
-    logf(ERR, "failed to start readchanges thread: {}\n", e.what());
+  buf_ = RdcwBufferPool::instance().acquire(size_);
+
+  // We MUST issue the first read before returning, otherwise there is a
+  // race condition where we'll miss observing the cookie for a query
+  // that comes in after we've crawled but before the watch is
+  // established.
+  if (!issueRead()) {
+    DWORD err = GetLastError();
+    logf(
+        ERR,
+        "ReadDirectoryChangesW: failed, cancel watch. {}\n",
+        win32_strerror(err));
+    stopping_.store(true, std::memory_order_release);
+    WinIoCompletionPool::instance().forget(this);
     return false;
   }
+  logf(DBG, "ReadDirectoryChangesW queued, init done\n");
+  return true;
 }
 
 std::unique_ptr<DirHandle> WinWatcher::startWatchDir(
@@ -385,6 +490,8 @@ Watcher::ConsumeNotifyRet WinWatcher::consumeNotify(
 
   auto now = std::chrono::system_clock::now();
 
+  std::vector<PendingChange> batch;
+  batch.reserve(items.size());
   for (auto& item : items) {
     watchman::log(
         watchman::DBG,
@@ -393,20 +500,40 @@ Watcher::ConsumeNotifyRet WinWatcher::consumeNotify(
         " ",
         item.flags.format(),
         "\n");
-    coll.add(item.path, now, W_PENDING_VIA_NOTIFY | item.flags);
+    batch.push_back(PendingChange{
+        std::move(item.path), now, W_PENDING_VIA_NOTIFY | item.flags});
   }
+  coll.addBatch(std::move(batch));
 
-  // The readChangesThread cancels itself.
+  // The completion pool cancels our read itself.
   return {false};
 }
 
 bool WinWatcher::waitNotify(int timeoutms) {
   auto wlock = changedItems.lock();
-  if (!wlock->empty()) {
-    return true;
+  if (wlock->empty()) {
+    cond.wait_for(wlock.as_lock(), std::chrono::milliseconds(timeoutms));
+    if (wlock->empty()) {
+      return false;
+    }
+  }
+
+  // Debounce: hold the items until no further changes arrived for
+  // extraLatency_.  Without this artificial latency we'll wake up and
+  // start trying to look at a directory that may be in the process of
+  // being recursively deleted and that act can block the recursive
+  // delete.
+  while (!stopping_.load(std::memory_order_acquire)) {
+    auto quiet = std::chrono::steady_clock::now() - lastArrival_;
+    if (quiet >= extraLatency_) {
+      break;
+    }
+    cond.wait_for(
+        wlock.as_lock(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            extraLatency_ - quiet));
   }
-  cond.wait_for(wlock.as_lock(), std::chrono::milliseconds(timeoutms));
-  return !wlock->empty();
+  return true;
 }
 
 static RegisterWatcher<WinWatcher> reg("win32");
@@ -32,6 +32,12 @@ struct watchman_dir {
   // to its children when processing deletes.
   bool last_check_existed{true};
 
+  // Journal sequence at which this dir was last observed to exist on
+  // disk (see ViewDatabase::noteDirObserved).  A deferred recursive
+  // delete queued before this point is stale for this dir and must not
+  // mark its files.
+  uint64_t last_observed_seq{0};
+
   watchman_dir(w_string name, watchman_dir* parent);
 
   watchman_dir* getChildDir(w_string_piece name) const;
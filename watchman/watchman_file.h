@@ -8,34 +8,74 @@
 #pragma once
 
 #include "watchman/Clock.h"
+#include "watchman/FileNodeArena.h"
 #include "watchman/fs/FileInformation.h"
 #include "watchman/watchman_dir.h"
 
 struct watchman_file {
-  /* the parent dir */
-  watchman_dir* parent;
+  /* Fields are ordered hot-first: full-tree evaluation walks the
+   * recency list and rejects most nodes on `exists`/`otime` alone, so
+   * the traversal link and those filter fields share the first cache
+   * line, while fields that are only read once a node is accepted (or
+   * only during tree maintenance) follow. */
 
   /* linkage to files ordered by changed time.
    * prev points to the address of `next` in the
    * previous file node, or the head of the list. */
   struct watchman_file **prev, *next;
 
+  /* the parent dir */
+  watchman_dir* parent;
+
   /* the time we last observed a change to this file */
   watchman::ClockStamp otime;
-  /* the time we first observed this file OR the time
-   * that this file switched from !exists to exists.
-   * This is thus the "created time" */
-  watchman::ClockStamp ctime;
 
   /* whether we believe that this file still exists */
   bool exists;
   /* whether we think this file might not exist */
   bool maybe_deleted;
 
+  /* directory entry type decoded from `stat.mode` when the stat result
+   * lands, so `type` terms match with a one-byte compare instead of
+   * copying the stat block and re-deriving it per file per query.
+   * DType::Unknown (zero) until the first stat.  Sits in the padding
+   * after the bools, so it costs no space in the hot cache line. */
+  watchman::DType dtype;
+
+  /* the time we first observed this file OR the time
+   * that this file switched from !exists to exists.
+   * This is thus the "created time" */
+  watchman::ClockStamp ctime;
+
+  /* sequence number of this file's newest record in the view's change
+   * journal; older records for the file are recognized as superseded by
+   * a mismatching sequence.  Zero until the file is first marked
+   * changed. */
+  uint64_t journal_seq;
+
+  /* linkage to files sharing the same lower-cased name suffix.
+   * suffix_prev points to the address of `suffix_next` in the previous
+   * file node, or the head slot in the view's suffix index. */
+  struct watchman_file **suffix_prev, *suffix_next;
+
+  /* id of the lower-cased name suffix in the process-wide dictionary
+   * (internSuffixId), or 0 when the name has no suffix.  Captured once
+   * at insert time so `suffix` terms match with an integer compare
+   * instead of re-deriving the suffix per file. */
+  uint32_t suffix_id;
+
   /* cache stat results so we can tell if an entry
    * changed */
   watchman::FileInformation stat;
 
+  /* content fingerprint: the mtime as of the last observation that
+   * could have changed the file's bytes.  Events positively known to
+   * be metadata-only (W_PENDING_ATTRIB_ONLY, with size and inode
+   * unchanged) leave it alone, so content-hash cache keys built from
+   * it stay stable across mtime-only touch storms and the cached sha1
+   * is returned without re-reading the file. */
+  struct timespec content_mtime;
+
   inline w_string_piece getName() const {
     uint32_t len;
     memcpy(&len, this + 1, 4);
@@ -43,6 +83,7 @@ struct watchman_file {
   }
 
   void removeFromFileList();
+  void removeFromSuffixList();
 
   watchman_file() = delete;
   watchman_file(const watchman_file&) = delete;
@@ -51,7 +92,70 @@ struct watchman_file {
 
   static std::unique_ptr<watchman_file, watchman_dir::Deleter> make(
       const w_string& name,
-      watchman_dir* parent);
+      watchman_dir* parent,
+      watchman::FileNodeArena& arena);
 };
 
 void free_file_node(struct watchman_file* file);
+
+namespace watchman {
+
+/**
+ * Operations on the head-anchored intrusive lists that watchman_file
+ * nodes participate in.  Both lists share the same shape: the `prev`
+ * slot points at the address of `next` in the previous node, or at the
+ * head slot itself, which is what lets unlink fix up the head without
+ * knowing where it lives.  Specializing per link pair keeps the pointer
+ * surgery in one place instead of hand-rolled at each mutation site.
+ */
+template <
+    watchman_file** watchman_file::*Prev,
+    watchman_file* watchman_file::*Next>
+struct FileListOps {
+  /** Unlinks `file` from whichever list (or detached chain) it is on. */
+  static void unlink(watchman_file* file) {
+    if (file->*Next) {
+      (file->*Next)->*Prev = file->*Prev;
+    }
+    if (file->*Prev) {
+      *(file->*Prev) = file->*Next;
+    }
+  }
+
+  /** Links `file` in as the new head of the list anchored at `head`. */
+  static void insertHead(watchman_file*& head, watchman_file* file) {
+    file->*Next = head;
+    if (head) {
+      head->*Prev = &(file->*Next);
+    }
+    head = file;
+    file->*Prev = &head;
+  }
+
+  /**
+   * Splices the detached chain running from `first` (newest) to `last`
+   * (oldest) onto the head of the list anchored at `head`.  The chain's
+   * interior links must already be consistent; only the two boundary
+   * links are written here, which is what makes batched insertion
+   * cheaper than repeated insertHead calls.
+   */
+  static void
+  spliceHead(watchman_file*& head, watchman_file* first, watchman_file* last) {
+    last->*Next = head;
+    if (head) {
+      head->*Prev = &(last->*Next);
+    }
+    head = first;
+    first->*Prev = &head;
+  }
+};
+
+/** The recency index: files ordered by most recent observed change. */
+using RecencyListOps =
+    FileListOps<&watchman_file::prev, &watchman_file::next>;
+
+/** The per-suffix index: files sharing a lower-cased name suffix. */
+using SuffixListOps =
+    FileListOps<&watchman_file::suffix_prev, &watchman_file::suffix_next>;
+
+} // namespace watchman
@@ -24,11 +24,40 @@ class Event {
   virtual bool isSocket() = 0;
 };
 
+/**
+ * One element of a gather-write chain; layout matches POSIX iovec so the
+ * unix stream can hand the chain to writev() directly.
+ */
+struct StreamSegment {
+  void* data;
+  size_t size;
+};
+
 class Stream {
  public:
   virtual ~Stream() = default;
   virtual int read(void* buf, int size) = 0;
   virtual int write(const void* buf, int size) = 0;
+
+  /**
+   * Gather-write a chain of segments in order. Returns the total number
+   * of bytes written, which may be short, or -1 on error like write().
+   * The default implementation loops over write(); socket streams
+   * override it with a single writev() so encoders can reference payloads
+   * in place instead of copying them into one contiguous buffer.
+   */
+  virtual int writev(const StreamSegment* segs, int count);
+
+  /**
+   * Write `buf` and attach the file descriptor `fdToSend` as ancillary
+   * data (SCM_RIGHTS) on the leading bytes, so the peer receives its
+   * own reference to the descriptor along with the message.  Returns
+   * the number of bytes written, or -1 with errno set if nothing was
+   * sent (in which case the descriptor was not transferred and the
+   * caller can fall back to a plain write).  Only local unix sockets
+   * support this; the default implementation fails with ENOTSUP.
+   */
+  virtual int writeWithFd(const void* buf, int size, int fdToSend);
   virtual Event* getEvents() = 0;
   virtual void setNonBlock(bool nonBlock) = 0;
   virtual bool rewind() = 0;
@@ -78,3 +107,12 @@ std::unique_ptr<watchman_stream> w_stm_open(const char* path, int flags, ...);
 // Make a temporary file name and open it.
 // Marks the file as CLOEXEC
 std::unique_ptr<watchman_stream> w_mkstemp(char* templ);
+
+/**
+ * Opens an anonymous temporary file in the system temporary directory,
+ * suitable for spooling data that will be handed to a child process as
+ * an inherited descriptor.  Prefers O_TMPFILE, which never creates a
+ * directory entry; falls back to w_mkstemp() plus unlink on platforms
+ * and filesystems without it.
+ */
+std::unique_ptr<watchman_stream> w_stm_open_anonymous();
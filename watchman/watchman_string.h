@@ -44,6 +44,85 @@ namespace watchman {
  */
 using StringHash = uint32_t;
 
+/**
+ * Thread-local recycling cache for small string blocks.
+ *
+ * Most basenames are under 16 bytes, so crawl-heavy workloads used to
+ * pay a malloc/free round-trip per short-lived name; allocation counts,
+ * not bytes, dominate the crawl malloc profile.  An inline (SSO)
+ * representation is not an option here: w_string_piece views into a
+ * w_string's buffer must stay valid while the owning handle is moved or
+ * copied (the view tree keys its child maps that way), so the bytes
+ * cannot live inside the handle.  Recycling the header blocks instead
+ * removes most of the allocator traffic with no representation change.
+ *
+ * Blocks are bucketed by total size (header + bytes + NUL) into a few
+ * classes; anything larger goes straight to malloc/free.  The lists are
+ * per-thread, so no locking: a block freed on another thread simply
+ * joins that thread's list.
+ */
+struct StringBlockCache {
+  static constexpr size_t kClassSizes[3] = {32, 48, 64};
+  static constexpr size_t kNumClasses = 3;
+  // Bounds per-thread retention to a few hundred KB in the worst case.
+  static constexpr size_t kMaxPerClass = 1024;
+
+  struct FreeNode {
+    FreeNode* next;
+  };
+
+  FreeNode* heads[kNumClasses] = {nullptr, nullptr, nullptr};
+  size_t counts[kNumClasses] = {0, 0, 0};
+
+  /** Returns the size class for a block, or -1 if it is not cached. */
+  static int classFor(size_t blockSize) {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      if (blockSize <= kClassSizes[i]) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  void* pop(int klass) {
+    auto* node = heads[klass];
+    if (!node) {
+      return nullptr;
+    }
+    heads[klass] = node->next;
+    --counts[klass];
+    return node;
+  }
+
+  /** Returns false when the class list is full; caller frees instead. */
+  bool push(int klass, void* block) {
+    if (counts[klass] >= kMaxPerClass) {
+      return false;
+    }
+    auto* node = static_cast<FreeNode*>(block);
+    node->next = heads[klass];
+    heads[klass] = node;
+    ++counts[klass];
+    return true;
+  }
+
+  ~StringBlockCache() {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      auto* node = heads[i];
+      while (node) {
+        auto* next = node->next;
+        free(node);
+        node = next;
+      }
+    }
+  }
+
+  static StringBlockCache& get() {
+    static thread_local StringBlockCache cache;
+    return cache;
+  }
+};
+
 /**
  * w_string is a heap-allocated string buffer with a fixed-size header and
  * variable-size contents.
@@ -51,8 +130,11 @@ using StringHash = uint32_t;
 struct StringHeader {
   // Bottom 2 bits are w_string_type_t.
   // Third bit is whether _hval is computed.
-  // Remaining 61 bits are the reference count. At 10 nanoseconds per increment,
-  // overflow would take over 700 years.
+  // Fourth bit records that the bytes are known to equal their own ASCII
+  // lower-case folding, so case-insensitive code can reuse this string
+  // instead of folding it again.
+  // Remaining 60 bits are the reference count. At 10 nanoseconds per increment,
+  // overflow would take over 350 years.
   std::atomic<size_t> refcnt;
   uint32_t len;
   std::atomic<StringHash> _hval;
@@ -68,6 +150,14 @@ struct StringHeader {
     refcnt.fetch_or(kHasHval, std::memory_order_acq_rel);
   }
 
+  bool is_self_lowered() const {
+    return refcnt.load(std::memory_order_acquire) & kSelfLowered;
+  }
+
+  void set_self_lowered() {
+    refcnt.fetch_or(kSelfLowered, std::memory_order_acq_rel);
+  }
+
   w_string_type_t get_type() const {
     return static_cast<w_string_type_t>(
         refcnt.load(std::memory_order_relaxed) & kTypeMask);
@@ -98,10 +188,22 @@ struct StringHeader {
   }
 
   /**
-   * Allocates storage for length + 1 bytes.
+   * Allocates storage for length + 1 bytes, recycling a cached block
+   * for small strings.  Cacheable blocks are always allocated at their
+   * full class size so release() can classify them from `len` alone.
    */
   static StringHeader* alloc(uint32_t length, w_string_type_t type) {
-    void* s = malloc(sizeof(StringHeader) + length + 1);
+    size_t blockSize = sizeof(StringHeader) + length + 1;
+    void* s = nullptr;
+    int klass = StringBlockCache::classFor(blockSize);
+    if (klass >= 0) {
+      s = StringBlockCache::get().pop(klass);
+      if (!s) {
+        s = malloc(StringBlockCache::kClassSizes[klass]);
+      }
+    } else {
+      s = malloc(blockSize);
+    }
     if (!s) {
       throw std::bad_alloc{};
     }
@@ -109,6 +211,20 @@ struct StringHeader {
     return static_cast<StringHeader*>(s);
   }
 
+  /**
+   * Destroys a fully-dereferenced header, returning small blocks to the
+   * thread's cache.  The counterpart of alloc(); regular delete cannot
+   * be used because the storage came from malloc.
+   */
+  static void release(StringHeader* hdr) {
+    int klass = StringBlockCache::classFor(sizeof(StringHeader) + hdr->len + 1);
+    hdr->~StringHeader();
+    if (klass >= 0 && StringBlockCache::get().push(klass, hdr)) {
+      return;
+    }
+    free(hdr);
+  }
+
   char* buf() {
     return reinterpret_cast<char*>(this + 1);
   }
@@ -119,7 +235,8 @@ struct StringHeader {
 
   static constexpr uint8_t kTypeMask = 3ull;
   static constexpr size_t kHasHval = 1ull << 2ull;
-  static constexpr size_t kRefShift = 3ull;
+  static constexpr size_t kSelfLowered = 1ull << 3ull;
+  static constexpr size_t kRefShift = 4ull;
   static constexpr size_t kRefIncrement = 1ull << kRefShift;
   static constexpr size_t kRefMask = ~(kRefIncrement - 1);
 };
@@ -140,7 +257,7 @@ bool w_string_path_is_absolute(w_string_piece path);
 
 uint32_t strlen_uint32(const char* str);
 
-inline bool is_slash(char c) {
+inline constexpr bool is_slash(char c) {
   return c == '/'
 #ifdef _WIN32
       || c == '\\'
@@ -160,7 +277,7 @@ class w_string_piece {
   size_t len_;
 
  public:
-  w_string_piece() : str_{nullptr}, len_{0} {}
+  constexpr w_string_piece() : str_{nullptr}, len_{0} {}
 
   /* implicit */ w_string_piece(const std::string& str)
       : str_{str.data()}, len_{str.size()} {}
@@ -173,7 +290,8 @@ class w_string_piece {
   /* implicit */ w_string_piece(const char* cstr)
       : str_(cstr), len_(strlen(cstr)) {}
 
-  w_string_piece(const char* cstr, size_t len) : str_(cstr), len_(len) {}
+  constexpr w_string_piece(const char* cstr, size_t len)
+      : str_(cstr), len_(len) {}
 
   w_string_piece(const char* begin, const char* end)
       : str_{begin}, len_{static_cast<size_t>(end - begin)} {
@@ -187,19 +305,19 @@ class w_string_piece {
   w_string_piece& operator=(const w_string_piece& other) = default;
   w_string_piece(w_string_piece&& other) noexcept;
 
-  const char* data() const noexcept {
+  constexpr const char* data() const noexcept {
     return str_;
   }
 
-  bool empty() const noexcept {
+  constexpr bool empty() const noexcept {
     return len_ == 0;
   }
 
-  size_t size() const noexcept {
+  constexpr size_t size() const noexcept {
     return len_;
   }
 
-  const char& operator[](size_t i) const noexcept {
+  constexpr const char& operator[](size_t i) const noexcept {
     return str_[i];
   }
 
@@ -236,6 +354,93 @@ class w_string_piece {
   w_string_piece baseName() const;
   w_string_piece suffix() const;
 
+  /**
+   * Forward iterator over the slash-separated components of a path.
+   * Dereferencing yields a w_string_piece aliasing the original storage,
+   * so iterating never allocates; the backing string must outlive the
+   * iteration.  Usable in constexpr contexts.
+   *
+   * Adjacent separators yield empty components; canonical watchman
+   * paths never contain them, but callers fed external input should
+   * skip empties themselves if they matter.
+   */
+  class PathComponentIterator {
+   public:
+    /// The end sentinel.
+    constexpr PathComponentIterator() noexcept = default;
+
+    /// Positions the iterator at the first component of [pos, end).
+    constexpr PathComponentIterator(const char* pos, const char* end) noexcept
+        : pos_{pos}, end_{end} {
+      findComponentEnd();
+    }
+
+    constexpr w_string_piece operator*() const noexcept {
+      return w_string_piece{pos_, static_cast<size_t>(compEnd_ - pos_)};
+    }
+
+    constexpr PathComponentIterator& operator++() noexcept {
+      if (compEnd_ == end_) {
+        // Consumed the final component.
+        pos_ = nullptr;
+        compEnd_ = nullptr;
+      } else {
+        pos_ = compEnd_ + 1; // skip the separator
+        findComponentEnd();
+      }
+      return *this;
+    }
+
+    constexpr bool operator==(
+        const PathComponentIterator& other) const noexcept {
+      return pos_ == other.pos_;
+    }
+
+    constexpr bool operator!=(
+        const PathComponentIterator& other) const noexcept {
+      return pos_ != other.pos_;
+    }
+
+   private:
+    constexpr void findComponentEnd() noexcept {
+      compEnd_ = pos_;
+      while (compEnd_ != end_ && !is_slash(*compEnd_)) {
+        ++compEnd_;
+      }
+    }
+
+    const char* pos_{nullptr};
+    const char* end_{nullptr};
+    const char* compEnd_{nullptr};
+  };
+
+  class PathComponentRange {
+   public:
+    constexpr PathComponentRange(const char* begin, const char* end) noexcept
+        : begin_{begin}, end_{end} {}
+
+    constexpr PathComponentIterator begin() const noexcept {
+      return begin_ == end_ ? PathComponentIterator{}
+                            : PathComponentIterator{begin_, end_};
+    }
+
+    constexpr PathComponentIterator end() const noexcept {
+      return PathComponentIterator{};
+    }
+
+   private:
+    const char* begin_;
+    const char* end_;
+  };
+
+  /**
+   * Returns a range over the slash-separated components of this path.
+   * An empty piece yields no components.
+   */
+  constexpr PathComponentRange pathComponents() const noexcept {
+    return PathComponentRange{str_, str_ + len_};
+  }
+
   /** Split the string by delimiter and emit to the provided vector */
   template <typename Vector>
   void split(Vector& result, char delim) const {
@@ -509,6 +714,19 @@ class w_string {
     return str_ ? str_->get_type() : W_STRING_UNICODE;
   }
 
+  /**
+   * Returns true when this w_string holds the only reference to its
+   * buffer.  The interning pool uses this to reclaim entries that no
+   * root references any more; the answer is only stable while the
+   * caller prevents new copies being taken (the pool checks under its
+   * shard lock, through which all new copies are handed out).
+   */
+  bool isSoleOwner() const noexcept {
+    return str_ &&
+        (str_->refcnt.load(std::memory_order_acquire) &
+         StringHeader::kRefMask) == StringHeader::kRefIncrement;
+  }
+
   /** Returns the directory component of the string, assuming a path string */
   w_string dirName() const;
   /** Returns the file name component of the string, assuming a path string */
@@ -516,12 +734,64 @@ class w_string {
   /** Returns the filename suffix of a path string */
   std::optional<w_string> asLowerCaseSuffix() const;
 
+  /**
+   * Returns the ASCII lower-case folding of this string, preserving its
+   * type. Most path names are already lower-case, so when the fold turns
+   * out to be the identity this returns the same underlying string and
+   * remembers that in the header; subsequent calls are a flag test and a
+   * reference count bump rather than a scan and an allocation.
+   */
+  w_string asLowerCase() const;
+
  private:
   StringHash computeAndStoreHash() const noexcept;
 
   StringHeader* str_ = nullptr;
 };
 
+namespace watchman {
+
+/**
+ * Returns a w_string with the same bytes as `component`, drawn from a
+ * process-wide interning pool keyed by the string's hash.
+ *
+ * Path component names repeat enormously across a large tree: a few tens of
+ * thousands of distinct basenames cover millions of files. Callers that
+ * materialize per-entry component strings (the crawler's readdir loop, dir
+ * node creation) should route them through here so that repeat lookups share
+ * one underlying StringHeader, deduplicating storage and letting w_string's
+ * identity fast path resolve equality with a pointer compare.
+ *
+ * Entries whose only remaining reference is the pool itself are swept out
+ * on an amortized schedule as new strings are interned, so vocabulary that
+ * disappears when a root is cancelled does not pin memory forever.
+ */
+w_string internPathComponent(w_string_piece component);
+
+/**
+ * Occupancy of the process-wide component interning pool, exposed for
+ * tests and memory diagnostics.
+ */
+struct InternPoolStats {
+  size_t entries{0};
+};
+InternPoolStats getInternPoolStats();
+
+/**
+ * Returns the integer id assigned to `lowerCaseSuffix` in the process-wide
+ * suffix dictionary, assigning the next free id on first sight.  Ids start
+ * at 1; 0 is reserved to mean "the name has no suffix".
+ *
+ * File records capture their name's suffix id once at insert time, which
+ * lets the `suffix` query term match by comparing integers instead of
+ * re-deriving and hashing the lower-cased suffix for every file visited.
+ * Like the component pool above, the dictionary grows for the life of the
+ * process and is only suitable for the bounded vocabulary of file suffixes.
+ */
+uint32_t internSuffixId(const w_string& lowerCaseSuffix);
+
+} // namespace watchman
+
 /** Allow w_string to act as a key in unordered_(map|set) */
 namespace std {
 template <>